@@ -0,0 +1,435 @@
+//Throughput and per-call latency of every demodulator and decoder stage, on a synthetic TETRA downlink generated
+//from a fixed seed (or a recorded 36 kHz cf32 file), so two builds can be compared run for run
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dsp/taps/root_raised_cosine.h>
+
+#include "dsp/fll.h"
+#include "dsp/complex_fd.h"
+#include "dsp/pi4dqpsk_costas.h"
+#include "dsp/pi4dqpsk.h"
+#include "dsp/dqpsk_sym_extr.h"
+#include "dsp/osmotetra_dec.h"
+
+extern "C" {
+    #include <lower_mac/viterbi.h>
+    #include <crypto/tea1.h>
+    #include <crypto/tea1_bs.h>
+    #include <crypto/tea2.h>
+    #include <crypto/tea3.h>
+    #include <crypto/tetra_ks_sched.h>
+}
+
+//Same demodulator parameters as the plugin
+#define DEMOD_SAMPLERATE 36000
+#define SYMBOLRATE 18000
+#define CLOCK_RECOVERY_BW 0.00628f
+#define CLOCK_RECOVERY_DAMPN_F 0.707f
+#define CLOCK_RECOVERY_REL_LIM 0.02f
+#define RRC_TAP_COUNT 65
+#define RRC_ALPHA 0.35f
+#define AGC_RATE 0.02f
+#define COSTAS_LOOP_BANDWIDTH 0.01f
+#define FLL_LOOP_BANDWIDTH 0.006f
+
+//Fixture: a continuous downlink with a sync burst in every 4th slot, 50 Hz off and at 25 dB SNR
+#define BENCH_BURST_BITS 510
+#define BENCH_FREQ_OFFSET 50.0
+#define BENCH_SNR_DB 25.0
+//Chains set up side by side for the memory figures
+#define BENCH_MEM_CHAINS 8
+//Samples / bits handed to every call, about what a block of the SDR++ VFO stream holds
+#define BENCH_CHUNK_SAMPLES 2048
+#define BENCH_CHUNK_BITS 2048
+//Keystream of one TCH slot, 432 bits
+#define BENCH_KS_BYTES 54
+//Decoders whose four timeslots follow an encrypted call, for the keystream producer
+#define BENCH_KS_SCHEDS 8
+
+struct BenchResult {
+    std::string stage;
+    std::string unit;
+    int calls;
+    double items;
+    double seconds;
+    double meanUs;
+    double p50Us;
+    double p99Us;
+    double maxUs;
+};
+
+static std::vector<BenchResult> results;
+
+//Time fn(i) for i in [0, calls), items is the amount of work of all calls together
+template <class F>
+static void bench(const char* stage, const char* unit, int calls, double items, F fn) {
+    std::vector<double> lat(calls);
+    for (int i = 0; i < calls; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn(i);
+        auto t1 = std::chrono::steady_clock::now();
+        lat[i] = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    }
+    BenchResult r;
+    r.stage = stage;
+    r.unit = unit;
+    r.calls = calls;
+    r.items = items;
+    r.seconds = 0;
+    for (double l : lat) { r.seconds += l; }
+    r.meanUs = r.seconds / calls;
+    r.seconds /= 1e6;
+    std::sort(lat.begin(), lat.end());
+    r.p50Us = lat[calls / 2];
+    r.p99Us = lat[std::min<int>(calls - 1, (calls * 99) / 100)];
+    r.maxUs = lat[calls - 1];
+    results.push_back(r);
+    printf("%-34s %8d %12.3f M%s/s %10.2f %10.2f %10.2f %10.2f\n", stage, calls, items / r.seconds / 1e6, unit, r.meanUs, r.p50Us, r.p99Us, r.maxUs);
+}
+
+//Bursts with random payloads, the lower MAC ends up doing all its work but the CRCs fail
+static std::vector<uint8_t> generateBits(std::mt19937& rng, int burstCount) {
+    std::vector<uint8_t> bits(burstCount * BENCH_BURST_BITS);
+    uint8_t payload[2][216], bb[30], sb[120];
+    for (int b = 0; b < burstCount; b++) {
+        for (auto& x : payload[0]) { x = rng() & 1; }
+        for (auto& x : payload[1]) { x = rng() & 1; }
+        for (auto& x : bb) { x = rng() & 1; }
+        for (auto& x : sb) { x = rng() & 1; }
+        if (b % 4 == 0) {
+            build_sync_c_d_burst(&bits[b * BENCH_BURST_BITS], sb, bb, payload[1]);
+        }
+        else {
+            build_norm_c_d_burst(&bits[b * BENCH_BURST_BITS], payload[0], bb, payload[1], 0);
+        }
+    }
+    return bits;
+}
+
+//pi/4-DQPSK at 2 samples per symbol through an RRC, then the frequency offset and white noise.
+//Gaussian noise is made with Box-Muller from the raw generator so every platform gets the same fixture
+static std::vector<dsp::complex_t> modulate(std::mt19937& rng, const std::vector<uint8_t>& bits) {
+    static const float phaseSteps[4] = { FL_M_PI / 4.0f, 3.0f * FL_M_PI / 4.0f, -FL_M_PI / 4.0f, -3.0f * FL_M_PI / 4.0f };
+    int symCount = bits.size() / 2;
+    std::vector<dsp::complex_t> up(symCount * 2, { 0, 0 });
+    float phase = 0;
+    for (int i = 0; i < symCount; i++) {
+        phase += phaseSteps[(bits[i * 2] << 1) | bits[i * 2 + 1]];
+        up[i * 2] = { cosf(phase), sinf(phase) };
+    }
+
+    dsp::tap<float> rrc = dsp::taps::rootRaisedCosine<float>(RRC_TAP_COUNT, RRC_ALPHA, SYMBOLRATE, DEMOD_SAMPLERATE);
+    std::vector<dsp::complex_t> out(up.size());
+    float noiseStd = powf(10.0f, -BENCH_SNR_DB / 20.0f) / sqrtf(2.0f);
+    double lo = 0;
+    double loStep = 2.0 * M_PI * BENCH_FREQ_OFFSET / DEMOD_SAMPLERATE;
+    for (int n = 0; n < (int)up.size(); n++) {
+        dsp::complex_t acc = { 0, 0 };
+        for (int k = 0; k < rrc.size && k <= n; k++) {
+            acc = acc + up[n - k] * rrc.taps[k];
+        }
+        //Zero stuffing halved the power
+        acc = acc * 2.0f;
+        dsp::complex_t rot = { (float)cos(lo), (float)sin(lo) };
+        lo = fmod(lo + loStep, 2.0 * M_PI);
+        float u1 = ((float)rng() + 1.0f) / 4294967296.0f;
+        float u2 = (float)rng() / 4294967296.0f;
+        float r = sqrtf(-2.0f * logf(u1)) * noiseStd;
+        out[n] = acc * rot + dsp::complex_t{ r * cosf(2.0f * FL_M_PI * u2), r * sinf(2.0f * FL_M_PI * u2) };
+    }
+    dsp::taps::free(rrc);
+    return out;
+}
+
+static bool loadRecording(const char* path, std::vector<dsp::complex_t>& iq) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { return false; }
+    dsp::complex_t buf[4096];
+    int n;
+    while ((n = fread(buf, sizeof(dsp::complex_t), 4096, f)) > 0) {
+        iq.insert(iq.end(), buf, buf + n);
+    }
+    fclose(f);
+    return !iq.empty();
+}
+
+//Address space and resident set of the process in KiB
+static bool readMemory(double& sizeKiB, double& rssKiB) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) { return false; }
+    long size, rss;
+    int n = fscanf(f, "%ld %ld", &size, &rss);
+    fclose(f);
+    if (n != 2) { return false; }
+    double pageKiB = sysconf(_SC_PAGESIZE) / 1024.0;
+    sizeKiB = size * pageKiB;
+    rssKiB = rss * pageKiB;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void writeCsv(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return;
+    }
+    fprintf(f, "stage,unit,calls,items,seconds,items_per_s,mean_us,p50_us,p99_us,max_us\n");
+    for (const auto& r : results) {
+        fprintf(f, "%s,%s,%d,%.0f,%.6f,%.1f,%.3f,%.3f,%.3f,%.3f\n", r.stage.c_str(), r.unit.c_str(), r.calls, r.items, r.seconds,
+                r.items / r.seconds, r.meanUs, r.p50Us, r.p99Us, r.maxUs);
+    }
+    fclose(f);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -t <sec>    seconds of synthetic signal (default 10)\n"
+        "  -s <seed>   fixture seed (default 1)\n"
+        "  -i <file>   use a recorded 36 kHz cf32 file for the DSP stages instead\n"
+        "  -c <file>   also write the results as CSV\n", prog);
+}
+
+int main(int argc, char** argv) {
+    double seconds = 10;
+    unsigned int seed = 1;
+    const char* recording = NULL;
+    const char* csvPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        switch (argv[i][1]) {
+            case 't': seconds = atof(argv[++i]); break;
+            case 's': seed = strtoul(argv[++i], NULL, 10); break;
+            case 'i': recording = argv[++i]; break;
+            case 'c': csvPath = argv[++i]; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    //Fixtures
+    std::mt19937 rng(seed);
+    int burstCount = std::max<int>(4, (int)(seconds * SYMBOLRATE * 2 / BENCH_BURST_BITS));
+    std::vector<uint8_t> bits = generateBits(rng, burstCount);
+    std::vector<dsp::complex_t> iq;
+    if (recording) {
+        if (!loadRecording(recording, iq)) {
+            fprintf(stderr, "Could not read %s\n", recording);
+            return 1;
+        }
+    }
+    else {
+        iq = modulate(rng, bits);
+    }
+    int sampleCount = iq.size();
+    int chunks = (sampleCount + BENCH_CHUNK_SAMPLES - 1) / BENCH_CHUNK_SAMPLES;
+    auto chunkLen = [sampleCount](int i) { return std::min<int>(BENCH_CHUNK_SAMPLES, sampleCount - i * BENCH_CHUNK_SAMPLES); };
+
+    float recov_bandwidth = CLOCK_RECOVERY_BW;
+    float recov_dampningFactor = CLOCK_RECOVERY_DAMPN_F;
+    float recov_denominator = (1.0f + 2.0*recov_dampningFactor*recov_bandwidth + recov_bandwidth*recov_bandwidth);
+    float recov_mu = (4.0f * recov_dampningFactor * recov_bandwidth) / recov_denominator;
+    float recov_omega = (4.0f * recov_bandwidth * recov_bandwidth) / recov_denominator;
+
+    printf("%d samples, %d bursts, seed %u%s\n\n", sampleCount, burstCount, seed, recording ? ", recorded IQ" : "");
+    printf("%-34s %8s %18s %10s %10s %10s %10s\n", "stage", "calls", "throughput", "mean us", "p50 us", "p99 us", "max us");
+
+    //Blocks are used through process() only, the scratch buffers hold up to one chunk of output
+    dsp::complex_t* scratch = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+    uint8_t* bitScratch = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+    float* audioScratch = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+
+    dsp::loop::FLL fll;
+    fll.init(NULL, FLL_LOOP_BANDWIDTH, SYMBOLRATE, DEMOD_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, 0, -FL_M_PI/2.0f, FL_M_PI/2.0f);
+    fll.setBlockSize(16);
+    bench("FLL::process", "samples", chunks, sampleCount, [&](int i) {
+        fll.process(chunkLen(i), &iq[i * BENCH_CHUNK_SAMPLES], scratch);
+    });
+
+    dsp::clock_recovery::COMPLEX_FD recov;
+    recov.init(NULL, (double)DEMOD_SAMPLERATE / SYMBOLRATE, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+    std::vector<dsp::complex_t> recovered;
+    bench("COMPLEX_FD::process", "samples", chunks, sampleCount, [&](int i) {
+        int n = recov.process(chunkLen(i), &iq[i * BENCH_CHUNK_SAMPLES], scratch);
+        recovered.insert(recovered.end(), scratch, scratch + n);
+    });
+
+    //The Costas loop works in place, give it a copy of the recovered symbols
+    dsp::loop::PI4DQPSK_COSTAS costas;
+    costas.init(NULL, COSTAS_LOOP_BANDWIDTH, 0, 0, -FL_M_PI/10.0f, FL_M_PI/10.0f);
+    int symCount = recovered.size();
+    int symChunks = (symCount + BENCH_CHUNK_SAMPLES - 1) / BENCH_CHUNK_SAMPLES;
+    auto symChunkLen = [symCount](int i) { return std::min<int>(BENCH_CHUNK_SAMPLES, symCount - i * BENCH_CHUNK_SAMPLES); };
+    bench("PI4DQPSK_COSTAS::process", "symbols", symChunks, symCount, [&](int i) {
+        memcpy(scratch, &recovered[i * BENCH_CHUNK_SAMPLES], symChunkLen(i) * sizeof(dsp::complex_t));
+        costas.process(symChunkLen(i), scratch, scratch);
+    });
+
+    dsp::demod::PI4DQPSK demod;
+    demod.init(NULL, SYMBOLRATE, DEMOD_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+    std::vector<dsp::complex_t> symbols;
+    bench("PI4DQPSK::process (full demod)", "samples", chunks, sampleCount, [&](int i) {
+        int n = demod.process(chunkLen(i), &iq[i * BENCH_CHUNK_SAMPLES], scratch);
+        symbols.insert(symbols.end(), scratch, scratch + n);
+    });
+
+    //Same chain with the int16 front end, its symbols are not used further
+    dsp::demod::PI4DQPSK demodFixed;
+    demodFixed.init(NULL, SYMBOLRATE, DEMOD_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+    demodFixed.setFixedPoint(true);
+    bench(dsp::q15::haveNeon() ? "PI4DQPSK::process (fixed point, NEON)" : "PI4DQPSK::process (fixed point)", "samples", chunks, sampleCount, [&](int i) {
+        demodFixed.process(chunkLen(i), &iq[i * BENCH_CHUNK_SAMPLES], scratch);
+    });
+
+    dsp::DQPSKSymbolExtractor symbolExtractor;
+    symbolExtractor.init(NULL);
+    symbolExtractor.setUnpackBits(true);
+    symCount = symbols.size();
+    symChunks = (symCount + BENCH_CHUNK_SAMPLES - 1) / BENCH_CHUNK_SAMPLES;
+    bench("DQPSKSymbolExtractor::process", "symbols", symChunks, symCount, [&](int i) {
+        symbolExtractor.process(std::min<int>(BENCH_CHUNK_SAMPLES, symCount - i * BENCH_CHUNK_SAMPLES), &symbols[i * BENCH_CHUNK_SAMPLES], bitScratch);
+    });
+
+    //Burst sync plus everything it calls into: lower MAC, Viterbi, CRC and upper MAC
+    dsp::osmotetradec decoder;
+    decoder.init(NULL);
+    int bitCount = bits.size();
+    int bitChunks = (bitCount + BENCH_CHUNK_BITS - 1) / BENCH_CHUNK_BITS;
+    bench("tetra_burst_sync_in", "bursts", bitChunks, burstCount, [&](int i) {
+        decoder.process(std::min<int>(BENCH_CHUNK_BITS, bitCount - i * BENCH_CHUNK_BITS), &bits[i * BENCH_CHUNK_BITS], audioScratch);
+    });
+
+    //Depunctured type-3 bits as the lower MAC passes them: 0, 1 or 0xff for a punctured position
+    struct tetra_viterbi_cache viterbi;
+    memset(&viterbi, 0, sizeof(viterbi));
+    const int vitBlocks = 2000;
+    std::vector<uint8_t> type3(288 * 4 * vitBlocks);
+    for (int i = 0; i < (int)type3.size(); i++) {
+        type3[i] = ((i % 3) == 2) ? 0xff : (rng() & 1);
+    }
+    uint8_t type2[288];
+    bench("viterbi_dec_sb1_wrapper SB1", "blocks", vitBlocks, vitBlocks, [&](int i) {
+        viterbi_dec_sb1_wrapper(&viterbi, &type3[i * 80 * 4], type2, 80);
+    });
+    bench("viterbi_dec_sb1_wrapper SCH/F", "blocks", vitBlocks, vitBlocks, [&](int i) {
+        viterbi_dec_sb1_wrapper(&viterbi, &type3[i * 288 * 4], type2, 288);
+    });
+    tetra_viterbi_cache_free(&viterbi);
+
+    //The speech decoder path of one TCH slot: deinterleave, channel decode and two 30 ms ACELP frames
+    struct tetra_codec codec;
+    tetra_codec_open(&codec);
+    const int tchSlots = 500;
+    std::vector<int16_t> coded(TETRA_CODEC_CODED_BITS * tchSlots);
+    for (auto& c : coded) { c = (rng() & 1) ? 127 : -127; }
+    bench("ACELP decode (TCH slot)", "slots", tchSlots, tchSlots, [&](int i) {
+        int16_t synth[TETRA_CODEC_SLOT_SAMPLES];
+        tetra_codec_decode_slot(&codec, &coded[i * TETRA_CODEC_CODED_BITS], NULL, synth);
+    });
+    tetra_codec_close(&codec);
+
+    uint8_t key[16];
+    for (auto& k : key) { k = rng(); }
+    uint8_t ks[BENCH_KS_BYTES];
+    const int ksSlots = 20000;
+    bench("tea1", "bytes", ksSlots, ksSlots * BENCH_KS_BYTES, [&](int i) { tea1(i, key, BENCH_KS_BYTES, ks); });
+    bench("tea2", "bytes", ksSlots, ksSlots * BENCH_KS_BYTES, [&](int i) { tea2(i, key, BENCH_KS_BYTES, ks); });
+    bench("tea3", "bytes", ksSlots, ksSlots * BENCH_KS_BYTES, [&](int i) { tea3(i, key, BENCH_KS_BYTES, ks); });
+
+    //Bulk TEA1 over many key registers, the reference core against one bit-sliced batch per call
+    const int bsBatches = 50;
+    std::vector<uint64_t> ivRegs(TEA1_BS_LANES);
+    std::vector<uint32_t> keyRegs(TEA1_BS_LANES * bsBatches);
+    std::vector<uint8_t> bsKs(TEA1_BS_LANES * BENCH_KS_BYTES);
+    for (auto& iv : ivRegs) { iv = tea1_expand_iv(rng()); }
+    for (auto& k : keyRegs) { k = rng(); }
+    bench("tea1_inner", "bytes", bsBatches * TEA1_BS_LANES, bsBatches * TEA1_BS_LANES * BENCH_KS_BYTES, [&](int i) {
+        tea1_inner(ivRegs[i % TEA1_BS_LANES], keyRegs[i], BENCH_KS_BYTES, ks);
+    });
+    bench("tea1_bs_inner (batch)", "bytes", bsBatches, bsBatches * TEA1_BS_LANES * BENCH_KS_BYTES, [&](int i) {
+        tea1_bs_inner(TEA1_BS_LANES, ivRegs.data(), &keyRegs[i * TEA1_BS_LANES], BENCH_KS_BYTES, bsKs.data());
+    });
+    int bsErrors = 0;
+    for (int l = 0; l < TEA1_BS_LANES; l++) {
+        tea1_inner(ivRegs[l], keyRegs[(bsBatches - 1) * TEA1_BS_LANES + l], BENCH_KS_BYTES, ks);
+        bsErrors += memcmp(ks, &bsKs[l * BENCH_KS_BYTES], BENCH_KS_BYTES) != 0;
+    }
+    if (bsErrors) { fprintf(stderr, "tea1_bs_inner: %d of %d lanes differ from tea1_inner\n", bsErrors, TEA1_BS_LANES); }
+
+    //One round of the keystream producer, every timeslot of the decoders just moved to a new TEA1 key so their rings
+    //are filled from empty. Frame 18 has no voice
+    const int schedRounds = 5;
+    const int schedKs = BENCH_KS_SCHEDS * 4 * (TETRA_KS_AHEAD_FRAMES - TETRA_KS_AHEAD_FRAMES / 18);
+    std::vector<struct tetra_ks_sched*> scheds(BENCH_KS_SCHEDS);
+    for (auto& s : scheds) { s = tetra_ks_sched_alloc(); }
+    bench("tetra_ks_sched_fill (TEA1)", "keystreams", schedRounds, schedRounds * schedKs, [&](int i) {
+        uint8_t eck[10], slotKs[TETRA_KS_VOICE_BYTES];
+        for (auto s : scheds) {
+            for (uint32_t tn = 1; tn <= 4; tn++) {
+                struct tetra_tdma_time t = { 1, 1, tn, 1, 1 };
+                for (auto& k : eck) { k = rng(); }
+                tetra_ks_sched_take(s, &t, i, KSG_TEA1, eck, slotKs);
+            }
+        }
+        tetra_ks_sched_fill(scheds.data(), scheds.size());
+    });
+    for (auto s : scheds) { tetra_ks_sched_free(s); }
+
+    //Footprint of one narrowband chain: what its blocks allocate, and of that what a second of signal touches
+    struct MemChain {
+        dsp::demod::PI4DQPSK demod;
+        dsp::DQPSKSymbolExtractor symbolExtractor;
+        dsp::osmotetradec decoder;
+    };
+    double size0, rss0, size1, rss1, size2, rss2;
+    if (readMemory(size0, rss0)) {
+        std::vector<std::unique_ptr<MemChain>> memChains;
+        for (int c = 0; c < BENCH_MEM_CHAINS; c++) {
+            memChains.push_back(std::make_unique<MemChain>());
+            MemChain& ch = *memChains.back();
+            ch.demod.init(NULL, SYMBOLRATE, DEMOD_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+            ch.symbolExtractor.init(NULL);
+            ch.symbolExtractor.setUnpackBits(true);
+            ch.decoder.init(NULL);
+        }
+        readMemory(size1, rss1);
+        int secChunks = std::min<int>(chunks, DEMOD_SAMPLERATE / BENCH_CHUNK_SAMPLES);
+        for (auto& ch : memChains) {
+            for (int i = 0; i < secChunks; i++) {
+                int n = ch->demod.process(chunkLen(i), &iq[i * BENCH_CHUNK_SAMPLES], scratch);
+                n = ch->symbolExtractor.process(n, scratch, bitScratch);
+                ch->decoder.process(n, bitScratch, audioScratch);
+            }
+        }
+        readMemory(size2, rss2);
+        printf("\nper chain, of %d: %.0f KiB allocated, %.0f KiB resident after setup, %.0f KiB after a second of signal\n", BENCH_MEM_CHAINS,
+               (size1 - size0) / BENCH_MEM_CHAINS, (rss1 - rss0) / BENCH_MEM_CHAINS, (rss2 - rss0) / BENCH_MEM_CHAINS);
+    }
+
+    dsp::buffer::free(scratch);
+    dsp::buffer::free(bitScratch);
+    dsp::buffer::free(audioScratch);
+
+    if (csvPath) { writeCsv(csvPath); }
+    return 0;
+}
@@ -0,0 +1,1280 @@
+//Headless TETRA decoder: reads baseband IQ from a file or stdin, runs the same demodulator and decoder chain as
+//the plugin and writes the bits, the decoded blocks / MAC PDUs and the voice audio to files. There is no VFO,
+//so the input already has to be centered on the carrier. Recordings can be decoded in parallel shards, see runBatch,
+//and carriers of a wideband receiver elsewhere on a node of its cluster, see runNode
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "dsp/pi4dqpsk.h"
+#include "dsp/dqpsk_sym_extr.h"
+#include "dsp/osmotetra_dec.h"
+#include "dsp/packet_capture.h"
+#include "dsp/gsmtap.h"
+#include "dsp/netsyms.h"
+#include "dsp/burst_replay.h"
+#include "dsp/burst_merge.h"
+#include "dsp/worker_pool.h"
+#include "dsp/metrics_server.h"
+#include "dsp/decoder_metrics.h"
+#include "dsp/cluster.h"
+#include "dsp/call_recorder.h"
+#include "dsp/event_database.h"
+#include <utils/net.h>
+
+extern "C" {
+    #include <tetra_pbits.h>
+    #include <tetra_llc_pdu.h>
+    #include <tetra_mle_pdu.h>
+    #include <tetra_prof.h>
+}
+
+//Same demodulator parameters as the plugin
+#define DEMOD_SAMPLERATE 36000
+#define SYMBOLRATE 18000
+#define CLOCK_RECOVERY_BW 0.00628f
+#define CLOCK_RECOVERY_DAMPN_F 0.707f
+#define CLOCK_RECOVERY_REL_LIM 0.02f
+#define RRC_TAP_COUNT 65
+#define RRC_ALPHA 0.35f
+#define AGC_RATE 0.02f
+#define COSTAS_LOOP_BANDWIDTH 0.01f
+#define FLL_LOOP_BANDWIDTH 0.006f
+
+//IQ samples read per iteration
+#define CLI_BLOCK_SIZE 8192
+#define CLI_EVENT_QUEUE_SIZE 1024
+//Soft bit given to the decided bits of a NETSYMS stream, that of an ideal symbol
+#define CLI_HARD_SOFT_BIT 64
+
+//TDMA structure in symbols and slots
+#define TDMA_MULTIFRAME_SYMBOLS (18 * 4 * 255)
+#define TDMA_HYPERFRAME_SYMBOLS (60 * TDMA_MULTIFRAME_SYMBOLS)
+#define TDMA_HYPERFRAME_SLOTS (60 * 18 * 4)
+//Batch mode: shards of this many hyperframes by default
+#define BATCH_DEFAULT_SHARD_HYPERFRAMES 1
+//A shard starts decoding this far ahead of its own part, so that its decoder is locked when the part begins
+#define BATCH_WARMUP_MULTIFRAMES 4
+//Records decoded this close to a shard boundary go to the side their TDMA time falls on. The shards decode this far
+//past their end as well
+#define BATCH_SLACK_MULTIFRAMES 1
+
+enum InputFormat { FORMAT_CF32, FORMAT_CS16, FORMAT_CU8, FORMAT_NETSYMS, FORMAT_BURSTS };
+
+struct Options {
+    std::string input = "-";
+    InputFormat format = FORMAT_CF32;
+    double samplerate = DEMOD_SAMPLERATE;
+    std::string bitsPath;
+    std::string pduPath;
+    std::string capturePath;
+    bool captureGsmtap = false;
+    std::string archivePath;
+    std::string gsmtapHost;
+    int gsmtapPort = GSMTAP_UDP_PORT;
+    std::string audioPath;
+    std::string slotAudioPrefix;
+    std::string keyfile;
+    bool keystreamAhead = false;
+    int trainSeqErrors = 0;
+    int maxSlip = TETRA_RX_MAX_SLIP_SYMS;
+    int listPaths = 0;
+    bool fixedPoint = false;
+    int batchThreads = 0;
+    int shardHyperframes = BATCH_DEFAULT_SHARD_HYPERFRAMES;
+    double replaySpeed = 0;
+    std::string profilePath;
+    std::string metricsHost;
+    int metricsPort = METRICS_DEFAULT_PORT;
+    std::string clusterHost;
+    int clusterPort = CLUSTER_DEFAULT_PORT;
+    std::string clusterSecret;
+    int nodeChains = 0;
+    int nodeUdpPort = CLUSTER_DEFAULT_UDP_PORT;
+    std::string recordDir;
+    std::string databasePath;
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -i <file>   IQ input, - for stdin (default)\n"
+        "  -f <fmt>    input format: cf32 (default), cs16, cu8, netsyms for the framed bits or symbols of the plugin, or bursts\n"
+        "              to replay a burst archive (-w) into the decoder. -i a.bur,b.bur,... merges the archives of several\n"
+        "              receivers of one cell, every burst once with the best copy, the cell with the most bursts\n"
+        "  -x <speed>  replay speed of a burst archive, 1 for real time, 0 as fast as possible (default). Merged\n"
+        "              archives go as fast as possible\n"
+        "  -r <rate>   input samplerate in Hz, at least %d (default %d)\n"
+        "  -b <file>   write the demodulated bits, one bit per byte\n"
+        "  -p <file>   write the decoded blocks and MAC PDUs as text\n"
+        "  -c <file>   write the SNDCP N-PDUs (IP packets) to a pcapng capture\n"
+        "  -C <file>   same as -c, with the decoded MAC blocks added as GSMTAP\n"
+        "  -w <file>   write the locked bursts to a burst archive, for replay without the DSP\n"
+        "  -u <host>   send the decoded MAC blocks as GSMTAP over UDP to host[:port] (default port %d)\n"
+        "  -a <file>   write the voice audio, 8 kHz signed 16 bit mono\n"
+        "  -s <prefix> write the voice audio of every timeslot to <prefix>1.s16 .. <prefix>4.s16\n"
+        "  -R <dir>    record every call to a FLAC file of its own in dir, named by time, timeslot and call\n"
+        "  -d <file>   keep the CMCE and MM PDUs (calls, allocations, registrations) in an SQLite database, in a build\n"
+        "              with OPT_TETRA_SQLITE\n"
+        "  -e <n>      training sequence bit errors tolerated once locked (default 0)\n"
+        "  -t <n>      symbols a locked burst may slip and be followed instead of losing the sync, at most %d (default %d)\n"
+        "  -L <n>      on a CRC failure try the n best paths of the trellis, at most %d of them per TDMA frame (default off)\n"
+        "  -D <arith>  demodulator arithmetic: float (default), or fixed for the int16 path, NEON on ARM\n"
+        "  -k <file>   keystore for decrypting the air interface\n"
+        "  -K <0|1>    1 makes the voice keystream of the followed encrypted calls ahead of time on a thread of its own\n"
+        "  -j <n>      batch mode: decode the IQ file in shards on n threads, 0 for one per core. Takes -p, -a and -s\n"
+        "  -P <file>   write the counters of the decoder stages as JSON once done, in a build with OPT_TETRA_PROFILE\n"
+        "  -m <host>   serve Prometheus metrics of the decoder at http://host[:port]/metrics while it runs (default port %d)\n"
+        "  -S <n>      hyperframes (61.2 s) per shard in batch mode (default %d)\n"
+        "  -N <host>   node mode: decode the carriers the coordinator of a wideband receiver at host[:port] assigns (default\n"
+        "              port %d), until interrupted. Takes -p, -u, -e, -t, -L and -k, the coordinator sends no keys\n"
+        "  -T <secret> secret of the coordinator, without it a node is refused by one that has a secret\n"
+        "  -n <n>      decoders of a node, 0 for one per core (default)\n"
+        "  -U <port>   UDP port of the first decoder of a node, the others take the ports after it (default %d)\n"
+        "Output files other than the capture may be - for stdout\n", prog, DEMOD_SAMPLERATE, DEMOD_SAMPLERATE, GSMTAP_UDP_PORT,
+        TETRA_RX_MAX_SLIP_SYMS, TETRA_RX_MAX_SLIP_SYMS, TETRA_VITERBI_LIST_DEFAULT_BUDGET,
+        METRICS_DEFAULT_PORT, BATCH_DEFAULT_SHARD_HYPERFRAMES, CLUSTER_DEFAULT_PORT, CLUSTER_DEFAULT_UDP_PORT);
+}
+
+static bool parseArgs(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") { return false; }
+        if (arg.size() != 2 || arg[0] != '-' || i + 1 >= argc) {
+            fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+            return false;
+        }
+        std::string val = argv[++i];
+        switch (arg[1]) {
+            case 'i': opts.input = val; break;
+            case 'b': opts.bitsPath = val; break;
+            case 'p': opts.pduPath = val; break;
+            case 'c': opts.capturePath = val; break;
+            case 'C':
+                opts.capturePath = val;
+                opts.captureGsmtap = true;
+                break;
+            case 'w': opts.archivePath = val; break;
+            case 'u': {
+                size_t colon = val.rfind(':');
+                opts.gsmtapHost = val.substr(0, colon);
+                if (colon != std::string::npos) { opts.gsmtapPort = atoi(val.c_str() + colon + 1); }
+                break;
+            }
+            case 'a': opts.audioPath = val; break;
+            case 's': opts.slotAudioPrefix = val; break;
+            case 'r': opts.samplerate = atof(val.c_str()); break;
+            case 'e': opts.trainSeqErrors = atoi(val.c_str()); break;
+            case 't': opts.maxSlip = atoi(val.c_str()); break;
+            case 'L': opts.listPaths = atoi(val.c_str()); break;
+            case 'k': opts.keyfile = val; break;
+            case 'K': opts.keystreamAhead = atoi(val.c_str()) != 0; break;
+            case 'D':
+                if (val == "float") { opts.fixedPoint = false; }
+                else if (val == "fixed") { opts.fixedPoint = true; }
+                else {
+                    fprintf(stderr, "Unknown demodulator arithmetic: %s\n", val.c_str());
+                    return false;
+                }
+                break;
+            case 'j':
+                opts.batchThreads = atoi(val.c_str());
+                if (opts.batchThreads <= 0) { opts.batchThreads = std::max<int>(std::thread::hardware_concurrency(), 1); }
+                break;
+            case 'P': opts.profilePath = val; break;
+            case 'm': {
+                size_t colon = val.rfind(':');
+                opts.metricsHost = val.substr(0, colon);
+                if (colon != std::string::npos) { opts.metricsPort = atoi(val.c_str() + colon + 1); }
+                break;
+            }
+            case 'N': {
+                size_t colon = val.rfind(':');
+                opts.clusterHost = val.substr(0, colon);
+                if (colon != std::string::npos) { opts.clusterPort = atoi(val.c_str() + colon + 1); }
+                break;
+            }
+            case 'n': opts.nodeChains = std::clamp<int>(atoi(val.c_str()), 0, CLUSTER_MAX_CHAINS); break;
+            case 'U': opts.nodeUdpPort = atoi(val.c_str()); break;
+            case 'T':
+                //A field of HELLO
+                if (val.empty() || val.size() > 127 || val.find_first_of(" \t") != std::string::npos) {
+                    fprintf(stderr, "The secret takes 1 to 127 characters without spaces\n");
+                    return false;
+                }
+                opts.clusterSecret = val;
+                break;
+            case 'R': opts.recordDir = val; break;
+            case 'd': opts.databasePath = val; break;
+            case 'x': opts.replaySpeed = atof(val.c_str()); break;
+            case 'S': opts.shardHyperframes = std::max<int>(atoi(val.c_str()), 1); break;
+            case 'f':
+                if (val == "cf32") { opts.format = FORMAT_CF32; }
+                else if (val == "cs16") { opts.format = FORMAT_CS16; }
+                else if (val == "cu8") { opts.format = FORMAT_CU8; }
+                else if (val == "netsyms") { opts.format = FORMAT_NETSYMS; }
+                else if (val == "bursts") { opts.format = FORMAT_BURSTS; }
+                else {
+                    fprintf(stderr, "Unknown input format: %s\n", val.c_str());
+                    return false;
+                }
+                break;
+            default:
+                fprintf(stderr, "Invalid argument: %s\n", argv[i - 1]);
+                return false;
+        }
+    }
+    if (opts.samplerate < DEMOD_SAMPLERATE) {
+        fprintf(stderr, "Samplerate has to be at least %d Hz\n", DEMOD_SAMPLERATE);
+        return false;
+    }
+    if (opts.format == FORMAT_BURSTS && (opts.input == "-" || !opts.bitsPath.empty())) {
+        fprintf(stderr, "Burst replay needs an archive file and has no bits for -b\n");
+        return false;
+    }
+    if (!opts.clusterHost.empty()) {
+        if (opts.batchThreads || opts.input != "-" || !opts.bitsPath.empty() || !opts.capturePath.empty() || !opts.archivePath.empty() ||
+            !opts.audioPath.empty() || !opts.slotAudioPrefix.empty() || !opts.metricsHost.empty() || !opts.recordDir.empty() ||
+            !opts.databasePath.empty()) {
+            fprintf(stderr, "Node mode takes its input from the coordinator and only writes -p and -u\n");
+            return false;
+        }
+        if (!opts.nodeChains) { opts.nodeChains = std::clamp<int>(std::thread::hardware_concurrency(), 1, CLUSTER_MAX_CHAINS); }
+    }
+    if (opts.batchThreads) {
+        if (opts.input == "-" || opts.format == FORMAT_NETSYMS || opts.format == FORMAT_BURSTS) {
+            fprintf(stderr, "Batch mode needs an IQ file\n");
+            return false;
+        }
+        if (!opts.bitsPath.empty() || !opts.capturePath.empty() || !opts.gsmtapHost.empty() || !opts.archivePath.empty() || !opts.metricsHost.empty() ||
+            !opts.recordDir.empty() || !opts.databasePath.empty()) {
+            fprintf(stderr, "Batch mode only writes -p, -a and -s\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static FILE* openFile(const std::string& path, const char* mode) {
+    if (path.empty()) { return NULL; }
+    if (path == "-") { return (mode[0] == 'r') ? stdin : stdout; }
+    FILE* f = fopen(path.c_str(), mode);
+    if (!f) { fprintf(stderr, "Could not open %s\n", path.c_str()); }
+    return f;
+}
+
+static void closeFile(FILE* f) {
+    if (f && f != stdin && f != stdout) { fclose(f); }
+}
+
+static int sampleSize(InputFormat format) {
+    switch (format) {
+        case FORMAT_CS16: return 2 * sizeof(int16_t);
+        case FORMAT_CU8: return 2 * sizeof(uint8_t);
+        default: return sizeof(dsp::complex_t);
+    }
+}
+
+//Convert count samples to complex float
+static void convertSamples(InputFormat format, const void* raw, dsp::complex_t* out, int count) {
+    switch (format) {
+        case FORMAT_CS16:
+            volk_16i_s32f_convert_32f((float*)out, (const int16_t*)raw, 32768.0f, count * 2);
+            break;
+        case FORMAT_CU8:
+            for (int i = 0; i < count; i++) {
+                out[i].re = ((float)((const uint8_t*)raw)[2 * i] - 127.5f) / 128.0f;
+                out[i].im = ((float)((const uint8_t*)raw)[2 * i + 1] - 127.5f) / 128.0f;
+            }
+            break;
+        default:
+            memcpy(out, raw, count * sizeof(dsp::complex_t));
+    }
+}
+
+//Read up to count samples and convert them to complex float, returns the number of samples read
+static int readSamples(FILE* f, InputFormat format, void* raw, dsp::complex_t* out, int count) {
+    if (format == FORMAT_CF32) { return fread(out, sizeof(dsp::complex_t), count, f); }
+    int n = fread(raw, sampleSize(format), count, f);
+    convertSamples(format, raw, out, n);
+    return n;
+}
+
+//Read the next framed NETSYMS packet. Bytes that do not start a packet are skipped until one does, so a stream joined
+//in the middle resyncs. Returns the packet length, -1 at the end
+static int readNetsymsPacket(FILE* f, uint8_t* pkt) {
+    int have = 0;
+    while (true) {
+        have += fread(&pkt[have], 1, NETSYMS_HEADER_LEN - have, f);
+        if (have < NETSYMS_HEADER_LEN) { return -1; }
+        int len = dsp::NetsymsDeframer::packetLength(pkt);
+        if (len >= 0) {
+            if ((int)fread(&pkt[NETSYMS_HEADER_LEN], 1, len - NETSYMS_HEADER_LEN, f) < len - NETSYMS_HEADER_LEN) { return -1; }
+            return len;
+        }
+        memmove(pkt, &pkt[1], --have);
+    }
+}
+
+struct AudioFiles {
+    FILE* active = NULL;
+    FILE* slots[TETRA_CODEC_TIMESLOTS] = {};
+    dsp::AudioFrameClock activeClock;
+    dsp::AudioFrameClock slotClocks[TETRA_CODEC_TIMESLOTS];
+};
+
+//The codec output goes to the files as it is, with silence written for the traffic frames that brought no audio
+static void writeAudioFrame(FILE* f, dsp::AudioFrameClock& clock, const dsp::TetraAudioFrame& frame) {
+    static const int16_t silence[TETRA_CODEC_SLOT_SAMPLES] = {};
+    for (int n = clock.silenceBefore(frame); n > 0; n -= TETRA_CODEC_SLOT_SAMPLES) {
+        fwrite(silence, sizeof(int16_t), std::min<int>(n, TETRA_CODEC_SLOT_SAMPLES), f);
+    }
+    fwrite(frame.samples, sizeof(int16_t), TETRA_CODEC_SLOT_SAMPLES, f);
+}
+
+static void audioFrameHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+    AudioFiles* files = (AudioFiles*)ctx;
+    for (int i = 0; i < count; i++) {
+        const dsp::TetraAudioFrame& frame = frames[i];
+        if (files->active && frame.active) { writeAudioFrame(files->active, files->activeClock, frame); }
+        int tn = frame.time.tn;
+        if (files->slots[tn - 1]) { writeAudioFrame(files->slots[tn - 1], files->slotClocks[tn - 1], frame); }
+    }
+}
+
+//The decoder has one L3 handler, the capture, the recorder and the database share it
+struct L3Sinks {
+    dsp::PacketCapture* capture = NULL;
+    dsp::CallRecorder* recorder = NULL;
+    dsp::EventDatabase* database = NULL;
+    dsp::osmotetradec* decoder = NULL;
+};
+
+static void l3SinksHandler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len) {
+    L3Sinks* sinks = (L3Sinks*)ctx;
+    if (sinks->capture) { dsp::PacketCapture::l3Handler(sinks->capture, time, l3, bits, len); }
+    if (sinks->recorder) { sinks->recorder->handleL3(0, l3); }
+    if (sinks->database) { sinks->database->handleL3(0, time, l3, sinks->decoder->getCellInfo()); }
+}
+
+static void recordFrameHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+    ((dsp::CallRecorder*)ctx)->pushFrames(0, frames, count);
+}
+
+static const char* eventKindName(uint8_t kind) {
+    switch (kind) {
+        case TETRA_EV_BLOCK: return "BLOCK";
+        case TETRA_EV_MAC_PDU: return "MAC_PDU";
+        case TETRA_EV_L3: return "L3";
+        default: return "?";
+    }
+}
+
+//Decoded header of an L3 record, in front of its payload
+static void writeL3(FILE* f, const tetra_l3_event& l3) {
+    fprintf(f, "ssi=%u fcs=%s %s", l3.ssi, (l3.fcs == TLLC_FCS_BAD) ? "bad" : (l3.fcs == TLLC_FCS_OK) ? "ok" : "none",
+            tetra_get_mle_pdisc_name(l3.pdisc));
+    if (!l3.parsed) {
+        fputs(" short ", f);
+        return;
+    }
+    switch (l3.pdisc) {
+        case TMLE_PDISC_CMCE:
+            fprintf(f, " %s", tetra_get_cmce_pdut_name(l3.cmce.pdu_type, 0));
+            if (l3.cmce.call_id) { fprintf(f, " call=%u", l3.cmce.call_id); }
+            if (l3.cmce.party_type) { fprintf(f, " party=%u", l3.cmce.party_ssi); }
+            if (l3.cmce.pdu_type == TCMCE_PDU_T_D_SDS_DATA) { fprintf(f, " sds=%u/%u", l3.cmce.sds_type, l3.cmce.sds_len); }
+            break;
+        case TMLE_PDISC_MM:
+            fprintf(f, " %s", tetra_get_mm_pdut_name(l3.mm.pdu_type, 0));
+            break;
+        case TMLE_PDISC_SNDCP:
+            fprintf(f, " %s nsapi=%u", tetra_get_sndcp_pdut_name(l3.sndcp.pdu_type, 0), l3.sndcp.nsapi);
+            break;
+        case TMLE_PDISC_MLE:
+            fprintf(f, " %s", tetra_get_mle_pdut_name(l3.mle_pdu_type, 0));
+            break;
+    }
+    if (l3.chan_alloc) { fprintf(f, " chan=%x/%u", l3.chan_timeslot, l3.chan_carrier); }
+    fputc(' ', f);
+}
+
+//One line per record: TDMA time, record kind, logical channel, block number, CRC, the decoded header of L3 records,
+//payload as hex (MSB first)
+static void writeEvents(FILE* f, const tetra_burst_event* evs, int count) {
+    for (int i = 0; i < count; i++) {
+        const tetra_burst_event& ev = evs[i];
+        fprintf(f, "%u/%u/%u/%u %s %s blk=%u crc=%s off=%u len=%u ", ev.time.hn, ev.time.mn, ev.time.fn, ev.time.tn,
+                eventKindName(ev.kind), tetra_get_lchan_name((enum tetra_log_chan)ev.lchan),
+                ev.blk_num, ev.crc_ok ? "ok" : "bad", ev.offset, ev.len);
+        if (ev.kind == TETRA_EV_L3) { writeL3(f, ev.l3); }
+        for (unsigned int b = 0; b < ev.len; b += 4) {
+            unsigned int nibble = 0;
+            for (unsigned int j = b; j < b + 4; j++) {
+                nibble = (nibble << 1) | ((j < ev.len) ? tetra_pwords_get(ev.bits, j) : 0);
+            }
+            fputc("0123456789abcdef"[nibble], f);
+        }
+        fputc('\n', f);
+    }
+}
+
+//Demodulator, symbol extractor and decoder as the plugin sets them up. The blocks are never started, their process()
+//functions are called directly by whoever owns the chain
+struct DecodeChain {
+    dsp::demod::PI4DQPSK demod;
+    dsp::DQPSKSymbolExtractor symbolExtractor;
+    dsp::osmotetradec decoder;
+
+    void init(const Options& opts) {
+        //Clock recov coeffs
+        float recov_bandwidth = CLOCK_RECOVERY_BW;
+        float recov_dampningFactor = CLOCK_RECOVERY_DAMPN_F;
+        float recov_denominator = (1.0f + 2.0*recov_dampningFactor*recov_bandwidth + recov_bandwidth*recov_bandwidth);
+        float recov_mu = (4.0f * recov_dampningFactor * recov_bandwidth) / recov_denominator;
+        float recov_omega = (4.0f * recov_bandwidth * recov_bandwidth) / recov_denominator;
+
+        demod.init(NULL, SYMBOLRATE, DEMOD_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+        demod.setInputSamplerate(opts.samplerate);
+        demod.setFixedPoint(opts.fixedPoint);
+        symbolExtractor.init(NULL);
+        symbolExtractor.setUnpackBits(true);
+        symbolExtractor.setSoftBits(true);
+        decoder.init(NULL);
+        decoder.setSoftBits(true);
+        decoder.setTrainSeqMaxErrors(opts.trainSeqErrors);
+        decoder.setMaxSlip(opts.maxSlip);
+        decoder.setListDecoding(opts.listPaths);
+        decoder.setKeystreamAhead(opts.keystreamAhead);
+    }
+};
+
+//What the metrics collector looks at, on the server thread
+struct MetricsSource {
+    DecodeChain* chain;
+    tetra_event_queue* queue;
+};
+
+static void metricsCollector(dsp::MetricsWriter& w, void* ctx) {
+    MetricsSource* src = (MetricsSource*)ctx;
+    dsp::writeDecoderMetrics(w, "", src->chain->demod, src->chain->symbolExtractor, src->chain->decoder);
+    if (src->queue) {
+        w.gauge("tetra_event_queue_depth", "Decoded records waiting to be written", "", tetra_event_queue_depth(src->queue));
+    }
+}
+
+//Slot of a TDMA time within its hyperframe
+static inline int tdmaSlot(const struct tetra_tdma_time& t) {
+    return (((t.mn + 59) % 60) * 18 + (t.fn + 17) % 18) * 4 + (t.tn + 3) % 4;
+}
+
+//Slots from b to a, the shorter way round the hyperframe
+static inline int tdmaSlotDistance(int a, int b) {
+    return ((a - b + TDMA_HYPERFRAME_SLOTS + TDMA_HYPERFRAME_SLOTS / 2) % TDMA_HYPERFRAME_SLOTS) - TDMA_HYPERFRAME_SLOTS / 2;
+}
+
+//One part of a recording in batch mode and what its decoder made of it. Records carry the sample at which they
+//came out, the end of the block that was being decoded
+struct BatchShard {
+    uint64_t begin;
+    uint64_t end;
+    std::vector<tetra_burst_event> events;
+    std::vector<uint64_t> eventPos;
+    std::vector<dsp::TetraAudioFrame> frames;
+    std::vector<uint64_t> framePos;
+    //Slot of the first record that came out at or after begin, -1 if none did
+    int startSlot = -1;
+    uint64_t pos = 0;
+};
+
+struct Batch {
+    const Options* opts;
+    InputFormat format;
+    int sampleSize;
+    uint64_t samples;
+    //The whole recording, NULL where it could not be mapped and every shard reads its part itself
+    const uint8_t* map = NULL;
+    uint64_t warmup;
+    uint64_t slack;
+    bool pdus;
+    bool audio;
+    bool allSlots;
+    std::vector<BatchShard> shards;
+    int wave = 0;
+    unsigned int dropped = 0;
+    std::mutex droppedMtx;
+};
+
+static void batchFrameHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+    BatchShard* shard = (BatchShard*)ctx;
+    for (int i = 0; i < count; i++) {
+        if (shard->startSlot < 0 && shard->pos >= shard->begin) { shard->startSlot = tdmaSlot(frames[i].time); }
+        shard->frames.push_back(frames[i]);
+        shard->framePos.push_back(shard->pos);
+    }
+}
+
+//Decodes one shard from its warm up to its slack past the end, on a chain of its own
+static void batchShardJob(int index, void* ctx) {
+    Batch* batch = (Batch*)ctx;
+    BatchShard& shard = batch->shards[batch->wave + index];
+    uint64_t from = (shard.begin > batch->warmup) ? shard.begin - batch->warmup : 0;
+    uint64_t to = std::min<uint64_t>(shard.end + batch->slack, batch->samples);
+
+    DecodeChain chain;
+    chain.init(*batch->opts);
+    if (batch->audio) { chain.decoder.setAudioFrameHandler(batchFrameHandler, &shard, batch->allSlots, 1); }
+    chain.decoder.setAudioWanted(batch->audio);
+    if (!batch->pdus) { chain.decoder.setSubscriptions(TETRA_SUB_SYSINFO | TETRA_SUB_RESOURCE); }
+    //Block records come out whatever the subscriptions, they mark where the shard starts
+    tetra_event_queue queue;
+    if (tetra_event_queue_init(&queue, CLI_EVENT_QUEUE_SIZE) < 0) { return; }
+    chain.decoder.setEventQueue(&queue);
+
+    FILE* f = NULL;
+    if (!batch->map) {
+        f = fopen(batch->opts->input.c_str(), "rb");
+#ifdef _WIN32
+        if (f) { _fseeki64(f, (int64_t)(from * batch->sampleSize), SEEK_SET); }
+#else
+        if (f) { fseeko(f, (off_t)(from * batch->sampleSize), SEEK_SET); }
+#endif
+    }
+    uint8_t* raw = dsp::buffer::alloc<uint8_t>(CLI_BLOCK_SIZE * sizeof(dsp::complex_t));
+    dsp::complex_t* iq = dsp::buffer::alloc<dsp::complex_t>(CLI_BLOCK_SIZE);
+    dsp::complex_t* syms = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+    uint8_t* bits = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+    float* audio = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+    unsigned int dropped = 0;
+
+    for (uint64_t p = from; p < to && (batch->map || f);) {
+        int count = std::min<uint64_t>(CLI_BLOCK_SIZE, to - p);
+        if (batch->map) {
+            convertSamples(batch->format, &batch->map[p * batch->sampleSize], iq, count);
+        } else if ((count = readSamples(f, batch->format, raw, iq, count)) <= 0) {
+            break;
+        }
+        p += count;
+        shard.pos = p;
+        int n = chain.demod.process(count, iq, syms);
+        n = chain.symbolExtractor.process(n, syms, bits);
+        chain.decoder.process(n, bits, audio);
+
+        const tetra_burst_event* evs;
+        unsigned int evCount;
+        while ((evCount = tetra_event_queue_peek(&queue, &evs, CLI_EVENT_QUEUE_SIZE)) > 0) {
+            if (shard.startSlot < 0 && p >= shard.begin) { shard.startSlot = tdmaSlot(evs[0].time); }
+            if (batch->pdus) {
+                shard.events.insert(shard.events.end(), evs, evs + evCount);
+                shard.eventPos.insert(shard.eventPos.end(), evCount, p);
+            }
+            tetra_event_queue_release(&queue, evCount);
+        }
+        dropped += tetra_event_queue_take_dropped(&queue);
+    }
+
+    chain.decoder.setEventQueue(NULL);
+    tetra_event_queue_deinit(&queue);
+    if (f) { fclose(f); }
+    dsp::buffer::free(raw);
+    dsp::buffer::free(iq);
+    dsp::buffer::free(syms);
+    dsp::buffer::free(bits);
+    dsp::buffer::free(audio);
+    std::lock_guard<std::mutex> lck(batch->droppedMtx);
+    batch->dropped += dropped;
+}
+
+//Whether a record of shard that came out at pos with the TDMA slot slot is the shard's to write. Away from the
+//boundaries that is where it came out. Near one it goes by the slot: the shard after the boundary starts with the slot
+//of its first record past it, the one before ends just ahead of that slot. Without such a record the position decides
+static bool batchKeeps(const Batch& batch, int index, uint64_t pos, int slot) {
+    const BatchShard& shard = batch.shards[index];
+    if (index > 0) {
+        if (pos + batch.slack < shard.begin) { return false; }
+        if (pos < shard.begin + batch.slack) {
+            if (shard.startSlot < 0) {
+                if (pos < shard.begin) { return false; }
+            } else if (tdmaSlotDistance(slot, shard.startSlot) < 0) {
+                return false;
+            }
+        }
+    }
+    if (index + 1 < (int)batch.shards.size()) {
+        const BatchShard& next = batch.shards[index + 1];
+        if (pos >= next.begin + batch.slack) { return false; }
+        if (pos + batch.slack >= next.begin) {
+            if (next.startSlot < 0) { return pos < next.begin; }
+            return tdmaSlotDistance(slot, next.startSlot) < 0;
+        }
+    }
+    return true;
+}
+
+//Batch mode: the recording is mapped and cut into shards of whole hyperframes, decoded in parallel by chains of their
+//own, each starting a few multiframes early to be locked on time. The shards go in waves of one per thread, the
+//records and the voice of a wave are stitched at the boundaries by TDMA time and written in order before the next
+//wave starts, so memory stays at one wave
+static int runBatch(const Options& opts, FILE* pduOut, FILE* audioOut, FILE** slotAudioOut) {
+    Batch batch;
+    batch.opts = &opts;
+    batch.format = opts.format;
+    batch.sampleSize = sampleSize(opts.format);
+    batch.pdus = (pduOut != NULL);
+    batch.audio = audioOut || slotAudioOut[0];
+    batch.allSlots = (slotAudioOut[0] != NULL);
+    double samplesPerSymbol = opts.samplerate / SYMBOLRATE;
+    batch.warmup = BATCH_WARMUP_MULTIFRAMES * TDMA_MULTIFRAME_SYMBOLS * samplesPerSymbol;
+    batch.slack = BATCH_SLACK_MULTIFRAMES * TDMA_MULTIFRAME_SYMBOLS * samplesPerSymbol;
+    uint64_t shardSamples = (uint64_t)opts.shardHyperframes * TDMA_HYPERFRAME_SYMBOLS * samplesPerSymbol;
+
+    uint64_t bytes = 0;
+#ifndef _WIN32
+    int fd = open(opts.input.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Could not open %s\n", opts.input.c_str());
+        if (fd >= 0) { close(fd); }
+        return 1;
+    }
+    bytes = st.st_size;
+    void* map = (bytes > 0) ? mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        //Every shard reads its part front to back
+        madvise(map, bytes, MADV_SEQUENTIAL);
+        batch.map = (const uint8_t*)map;
+    }
+#else
+    FILE* sizeFile = fopen(opts.input.c_str(), "rb");
+    if (!sizeFile) {
+        fprintf(stderr, "Could not open %s\n", opts.input.c_str());
+        return 1;
+    }
+    _fseeki64(sizeFile, 0, SEEK_END);
+    bytes = _ftelli64(sizeFile);
+    fclose(sizeFile);
+#endif
+    batch.samples = bytes / batch.sampleSize;
+    for (uint64_t b = 0; b < batch.samples; b += shardSamples) {
+        BatchShard shard;
+        shard.begin = b;
+        shard.end = std::min<uint64_t>(b + shardSamples, batch.samples);
+        batch.shards.push_back(std::move(shard));
+    }
+
+    AudioFiles files;
+    files.active = audioOut;
+    std::copy(slotAudioOut, slotAudioOut + TETRA_CODEC_TIMESLOTS, files.slots);
+    dsp::WorkerPool pool(opts.batchThreads);
+    uint64_t totalEvents = 0;
+    uint64_t totalFrames = 0;
+    int shardCount = batch.shards.size();
+    for (batch.wave = 0; batch.wave < shardCount; batch.wave += opts.batchThreads) {
+        int count = std::min<int>(opts.batchThreads, shardCount - batch.wave);
+        pool.run(count, batchShardJob, &batch);
+        //The last shard of a wave is cut against the first of the next one, which is decoded with the next wave. It
+        //stays in memory until then
+        int ready = (batch.wave + count < shardCount) ? count - 1 : count;
+        for (int i = batch.wave - (batch.wave ? 1 : 0); i < batch.wave + ready; i++) {
+            BatchShard& shard = batch.shards[i];
+            for (size_t j = 0; j < shard.events.size(); j++) {
+                if (!batchKeeps(batch, i, shard.eventPos[j], tdmaSlot(shard.events[j].time))) { continue; }
+                writeEvents(pduOut, &shard.events[j], 1);
+                totalEvents++;
+            }
+            for (size_t j = 0; j < shard.frames.size(); j++) {
+                if (!batchKeeps(batch, i, shard.framePos[j], tdmaSlot(shard.frames[j].time))) { continue; }
+                audioFrameHandler(&shard.frames[j], 1, &files);
+                totalFrames++;
+            }
+            //The next shard still looks at begin and startSlot
+            std::vector<tetra_burst_event>().swap(shard.events);
+            std::vector<uint64_t>().swap(shard.eventPos);
+            std::vector<dsp::TetraAudioFrame>().swap(shard.frames);
+            std::vector<uint64_t>().swap(shard.framePos);
+        }
+        fprintf(stderr, "%d of %d shards decoded\r", batch.wave + count, shardCount);
+    }
+
+    fprintf(stderr, "\n%llu samples in %d shards, %llu records (%u dropped), %llu voice frames\n", (unsigned long long)batch.samples,
+            shardCount, (unsigned long long)totalEvents, batch.dropped, (unsigned long long)totalFrames);
+#ifndef _WIN32
+    if (batch.map) { munmap(map, bytes); }
+    close(fd);
+#endif
+    return 0;
+}
+
+//Node mode: every chain takes the NETSYMS stream of one carrier on a UDP port of its own and decodes it. What it
+//decodes is the coordinator's to say, each assignment gets a new decoder preset with the cell state sent along
+struct NodeDecoder {
+    int work;
+    std::string label;
+    struct NodeChain* chain;
+    dsp::NetsymsDeframer deframer;
+    dsp::DQPSKSymbolExtractor symbolExtractor;
+    dsp::osmotetradec decoder;
+    tetra_event_queue queue;
+    bool useEvents = false;
+    dsp::GsmtapSender gsmtap;
+
+    ~NodeDecoder() {
+        if (gsmtap.isOpen()) { gsmtap.close(); }
+        if (useEvents) {
+            decoder.setEventQueue(NULL);
+            tetra_event_queue_deinit(&queue);
+        }
+    }
+};
+
+struct NodeChain {
+    int index;
+    struct Node* node;
+    std::shared_ptr<net::Socket> sock;
+    std::thread thread;
+    //Written by the cluster thread, taken over by the chain's own before the next packet
+    std::mutex mtx;
+    int work = CLUSTER_NO_WORK;
+    std::string label;
+    uint64_t generation = 0;
+    bool cellPending = false;
+    dsp::ClusterCellState cell;
+    std::atomic<uint64_t> busyNs = 0;
+    uint64_t packets = 0;
+    uint64_t assignments = 0;
+};
+
+struct Node {
+    const Options* opts;
+    FILE* pduOut;
+    std::mutex pduMtx;
+    dsp::ClusterNode cluster;
+    std::vector<std::unique_ptr<NodeChain>> chains;
+    std::atomic<bool> running = true;
+};
+
+static std::atomic<bool> nodeInterrupted = false;
+
+static void nodeSignalHandler(int sig) {
+    nodeInterrupted = true;
+}
+
+static void nodeAssignHandler(int chain, int work, const std::string& label, void* ctx) {
+    Node* node = (Node*)ctx;
+    NodeChain* ch = node->chains[chain].get();
+    std::lock_guard<std::mutex> lck(ch->mtx);
+    ch->work = work;
+    ch->label = label;
+    ch->cellPending = false;
+    ch->generation++;
+    if (work != CLUSTER_NO_WORK) { ch->assignments++; }
+    fprintf(stderr, (work != CLUSTER_NO_WORK) ? "Decoder %d: %s\n" : "Decoder %d released\n", chain, label.c_str());
+}
+
+static void nodeCellHandler(int chain, const dsp::ClusterCellState& state, void* ctx) {
+    Node* node = (Node*)ctx;
+    NodeChain* ch = node->chains[chain].get();
+    std::lock_guard<std::mutex> lck(ch->mtx);
+    ch->cell = state;
+    ch->cellPending = true;
+}
+
+static void nodeL3Handler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len) {
+    NodeDecoder* dec = (NodeDecoder*)ctx;
+    dec->chain->node->cluster.reportL3(dec->work, l3);
+}
+
+static std::unique_ptr<NodeDecoder> makeNodeDecoder(NodeChain* ch, int work, const std::string& label) {
+    const Options& opts = *ch->node->opts;
+    std::unique_ptr<NodeDecoder> dec = std::make_unique<NodeDecoder>();
+    dec->work = work;
+    dec->label = label;
+    dec->chain = ch;
+    dec->symbolExtractor.init(NULL);
+    dec->symbolExtractor.setUnpackBits(true);
+    dec->symbolExtractor.setSoftBits(true);
+    dec->decoder.init(NULL);
+    dec->decoder.setSoftBits(true);
+    dec->decoder.setTrainSeqMaxErrors(opts.trainSeqErrors);
+    dec->decoder.setMaxSlip(opts.maxSlip);
+    dec->decoder.setListDecoding(opts.listPaths);
+    dec->decoder.setAudioWanted(false);
+    dec->decoder.setL3Handler(nodeL3Handler, dec.get());
+    if (!opts.gsmtapHost.empty() && !dec->gsmtap.open(opts.gsmtapHost, opts.gsmtapPort)) {
+        fprintf(stderr, "Could not send to %s:%d\n", opts.gsmtapHost.c_str(), opts.gsmtapPort);
+    }
+    dec->useEvents = ch->node->pduOut || dec->gsmtap.isOpen();
+    if (dec->useEvents && tetra_event_queue_init(&dec->queue, CLI_EVENT_QUEUE_SIZE) < 0) {
+        fprintf(stderr, "Could not allocate the event queue\n");
+        dec->useEvents = false;
+    }
+    if (dec->useEvents) { dec->decoder.setEventQueue(&dec->queue); }
+    //Without the PDU output only what the channel following depends on is decoded
+    if (!ch->node->pduOut) { dec->decoder.setSubscriptions(TETRA_SUB_SYSINFO | TETRA_SUB_RESOURCE); }
+    return dec;
+}
+
+static void nodeChainWorker(NodeChain* ch) {
+    Node* node = ch->node;
+    uint8_t pkt[NETSYMS_MAX_PACKET];
+    dsp::complex_t* syms = dsp::buffer::alloc<dsp::complex_t>(NETSYMS_MAX_FILL_SYMBOLS + NETSYMS_MAX_SYMBOLS);
+    uint8_t* bits = dsp::buffer::alloc<uint8_t>(2 * (NETSYMS_MAX_FILL_SYMBOLS + NETSYMS_MAX_SYMBOLS));
+    uint8_t* hardBits = dsp::buffer::alloc<uint8_t>(2 * (NETSYMS_MAX_FILL_SYMBOLS + NETSYMS_MAX_SYMBOLS));
+    std::unique_ptr<NodeDecoder> dec;
+    uint64_t generation = 0;
+    while (node->running) {
+        int len = ch->sock->recv(pkt, sizeof(pkt), false, 200);
+        {
+            std::lock_guard<std::mutex> lck(ch->mtx);
+            if (ch->generation != generation) {
+                generation = ch->generation;
+                dec.reset();
+                if (ch->work != CLUSTER_NO_WORK) { dec = makeNodeDecoder(ch, ch->work, ch->label); }
+            }
+            if (dec && ch->cellPending) {
+                dsp::TetraCellInfo info;
+                info.mcc = ch->cell.mcc;
+                info.mnc = ch->cell.mnc;
+                info.cc = ch->cell.cc;
+                info.hn = ch->cell.hn;
+                info.cckId = ch->cell.cckId;
+                dec->decoder.presetCell(info);
+                ch->cellPending = false;
+            }
+        }
+        //Streams that come in while the chain is not assigned are left alone
+        if (len <= 0 || !dec) { continue; }
+        auto start = std::chrono::steady_clock::now();
+        int n;
+        if (dsp::netsymsCarriesSymbols(pkt[3])) {
+            n = std::max<int>(dec->deframer.processSymbols(pkt, len, syms), 0);
+            n = dec->symbolExtractor.process(n, syms, bits);
+        } else {
+            n = std::max<int>(dec->deframer.process(pkt, len, hardBits), 0);
+            for (int i = 0; i < n; i++) { bits[i] = (uint8_t)(hardBits[i] ? -CLI_HARD_SOFT_BIT : CLI_HARD_SOFT_BIT); }
+        }
+        //The audio is not wanted, the output stays empty
+        dec->decoder.process(n, bits, NULL);
+        if (dec->useEvents) {
+            const tetra_burst_event* evs;
+            unsigned int evCount;
+            while ((evCount = tetra_event_queue_peek(&dec->queue, &evs, CLI_EVENT_QUEUE_SIZE)) > 0) {
+                if (node->pduOut) {
+                    std::lock_guard<std::mutex> lck(node->pduMtx);
+                    for (unsigned int i = 0; i < evCount; i++) {
+                        fprintf(node->pduOut, "%s ", dec->label.c_str());
+                        writeEvents(node->pduOut, &evs[i], 1);
+                    }
+                }
+                if (dec->gsmtap.isOpen()) { dec->gsmtap.write(evs, evCount); }
+                tetra_event_queue_release(&dec->queue, evCount);
+            }
+        }
+        if (dec->gsmtap.isOpen()) { dec->gsmtap.poll(); }
+        dsp::TetraCellInfo info = dec->decoder.getCellInfo();
+        if (info.syncs) {
+            dsp::ClusterCellState s;
+            s.valid = true;
+            s.mcc = info.mcc;
+            s.mnc = info.mnc;
+            s.cc = info.cc;
+            s.hn = info.hn;
+            s.cckId = info.cckId;
+            node->cluster.reportState(ch->index, dec->work, s);
+        }
+        ch->packets++;
+        ch->busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    dec.reset();
+    dsp::buffer::free(syms);
+    dsp::buffer::free(bits);
+    dsp::buffer::free(hardBits);
+}
+
+static int runNode(const Options& opts, FILE* pduOut) {
+    Node node;
+    node.opts = &opts;
+    node.pduOut = pduOut;
+    for (int i = 0; i < opts.nodeChains; i++) {
+        std::unique_ptr<NodeChain> ch = std::make_unique<NodeChain>();
+        ch->index = i;
+        ch->node = &node;
+        try {
+            ch->sock = net::openudp("0.0.0.0", 0, "0.0.0.0", opts.nodeUdpPort + i);
+        } catch (std::runtime_error& e) {
+            ch->sock.reset();
+        }
+        if (!ch->sock || !ch->sock->isOpen()) {
+            fprintf(stderr, "Could not take UDP port %d\n", opts.nodeUdpPort + i);
+            return 1;
+        }
+        node.chains.push_back(std::move(ch));
+    }
+    for (auto& ch : node.chains) { ch->thread = std::thread(nodeChainWorker, ch.get()); }
+
+    char name[256] = "node";
+#ifndef _WIN32
+    if (gethostname(name, sizeof(name) - 1) != 0) { strcpy(name, "node"); }
+#endif
+    node.cluster.setHandlers(nodeAssignHandler, nodeCellHandler, &node);
+    int cores = std::max<int>(std::thread::hardware_concurrency(), 1);
+    node.cluster.start(opts.clusterHost, opts.clusterPort, name, opts.nodeChains, opts.nodeUdpPort, cores, opts.clusterSecret);
+    fprintf(stderr, "Node %s: %d decoders on UDP %d - %d, coordinator %s:%d\n", name, opts.nodeChains, opts.nodeUdpPort,
+            opts.nodeUdpPort + opts.nodeChains - 1, opts.clusterHost.c_str(), opts.clusterPort);
+
+    signal(SIGINT, nodeSignalHandler);
+    signal(SIGTERM, nodeSignalHandler);
+    //The load the coordinator places by is what the chains spent decoding
+    bool connected = false;
+    uint64_t lastBusy = 0;
+    auto last = std::chrono::steady_clock::now();
+    while (!nodeInterrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(CLUSTER_REPORT_MS));
+        uint64_t busy = 0;
+        for (auto& ch : node.chains) { busy += ch->busyNs.load(); }
+        auto now = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(now - last).count();
+        node.cluster.setLoad((double)(busy - lastBusy) / 1e9 / secs);
+        lastBusy = busy;
+        last = now;
+        if (node.cluster.isConnected() != connected) {
+            connected = !connected;
+            fprintf(stderr, connected ? "Joined the coordinator\n" : "Waiting for the coordinator\n");
+        }
+    }
+
+    node.cluster.stop();
+    node.running = false;
+    uint64_t packets = 0;
+    uint64_t assignments = 0;
+    for (auto& ch : node.chains) {
+        ch->thread.join();
+        ch->sock->close();
+        packets += ch->packets;
+        assignments += ch->assignments;
+    }
+    fprintf(stderr, "%llu assignments, %llu NETSYMS packets decoded\n", (unsigned long long)assignments, (unsigned long long)packets);
+    return 0;
+}
+
+//The counters of all threads, the batch shards included
+static void writeProfile(const std::string& path) {
+    FILE* f = openFile(path, "w");
+    if (!f) { return; }
+    char json[2048];
+    tetra_prof_json(json, sizeof(json));
+    fprintf(f, "%s\n", json);
+    closeFile(f);
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!opts.keyfile.empty() && load_keystore((char*)opts.keyfile.c_str()) < 0) { return 1; }
+
+    FILE* in = openFile(opts.input, "rb");
+    FILE* bitsOut = openFile(opts.bitsPath, "wb");
+    FILE* pduOut = openFile(opts.pduPath, "w");
+    FILE* audioOut = openFile(opts.audioPath, "wb");
+    if (!in || (!opts.bitsPath.empty() && !bitsOut) || (!opts.pduPath.empty() && !pduOut) || (!opts.audioPath.empty() && !audioOut)) {
+        return 1;
+    }
+    FILE* slotAudioOut[TETRA_CODEC_TIMESLOTS] = {};
+    if (!opts.slotAudioPrefix.empty()) {
+        for (int tn = 1; tn <= TETRA_CODEC_TIMESLOTS; tn++) {
+            slotAudioOut[tn - 1] = openFile(opts.slotAudioPrefix + std::to_string(tn) + ".s16", "wb");
+            if (!slotAudioOut[tn - 1]) { return 1; }
+        }
+    }
+
+    if (!opts.clusterHost.empty()) {
+        int ret = runNode(opts, pduOut);
+        closeFile(in);
+        closeFile(pduOut);
+        return ret;
+    }
+
+    if (opts.batchThreads) {
+        int ret = runBatch(opts, pduOut, audioOut, slotAudioOut);
+        writeProfile(opts.profilePath);
+        closeFile(in);
+        closeFile(pduOut);
+        closeFile(audioOut);
+        for (FILE* f : slotAudioOut) { closeFile(f); }
+        return ret;
+    }
+
+    DecodeChain chain;
+    chain.init(opts);
+    dsp::demod::PI4DQPSK& demod = chain.demod;
+    dsp::DQPSKSymbolExtractor& symbolExtractor = chain.symbolExtractor;
+    dsp::osmotetradec& decoder = chain.decoder;
+    bool netsymsIn = (opts.format == FORMAT_NETSYMS);
+    dsp::NetsymsDeframer deframer;
+    bool burstsIn = (opts.format == FORMAT_BURSTS);
+    dsp::BurstReplay replay;
+    dsp::BurstMerge merge;
+    if (burstsIn && opts.input.find(',') != std::string::npos) {
+        std::vector<std::string> paths;
+        size_t start = 0;
+        while (start <= opts.input.size()) {
+            size_t end = std::min(opts.input.find(',', start), opts.input.size());
+            if (end > start) { paths.push_back(opts.input.substr(start, end - start)); }
+            start = end + 1;
+        }
+        std::string failed;
+        if (!merge.open(paths, failed)) {
+            fprintf(stderr, "%s is not a burst archive\n", failed.c_str());
+            return 1;
+        }
+        const std::vector<dsp::BurstMerge::Cell>& cells = merge.getCells();
+        if (cells.empty()) {
+            fprintf(stderr, "No SYNC burst in the archives\n");
+            return 1;
+        }
+        for (const auto& c : cells) {
+            fprintf(stderr, "Cell %d-%d-%d: %llu bursts in %d archives\n", c.mcc, c.mnc, c.cc, (unsigned long long)c.records, c.archives);
+        }
+        merge.selectCell(0);
+    } else if (burstsIn) {
+        if (!replay.open(opts.input)) {
+            fprintf(stderr, "%s is not a burst archive\n", opts.input.c_str());
+            return 1;
+        }
+        replay.setSpeed(opts.replaySpeed);
+    }
+    uint8_t netPkt[NETSYMS_MAX_PACKET];
+    AudioFiles audioFiles;
+    audioFiles.active = audioOut;
+    std::copy(std::begin(slotAudioOut), std::end(slotAudioOut), audioFiles.slots);
+    if (audioOut || slotAudioOut[0]) { decoder.setAudioFrameHandler(audioFrameHandler, &audioFiles, slotAudioOut[0] != NULL); }
+    dsp::CallRecorder recorder;
+    if (!opts.recordDir.empty()) {
+        if (!recorder.start(opts.recordDir)) {
+            fprintf(stderr, "%s is not a directory\n", opts.recordDir.c_str());
+            return 1;
+        }
+        recorder.setSource(0, "cell");
+        decoder.setRecordHandler(recordFrameHandler, &recorder);
+    }
+    dsp::EventDatabase database;
+    if (!opts.databasePath.empty()) {
+        if (!dsp::EventDatabase::isAvailable()) {
+            fprintf(stderr, "-d needs a build with OPT_TETRA_SQLITE\n");
+            return 1;
+        }
+        if (!database.open(opts.databasePath)) {
+            fprintf(stderr, "Could not open %s\n", opts.databasePath.c_str());
+            return 1;
+        }
+        database.setSource(0, "cell");
+    }
+    decoder.setAudioWanted(audioOut || slotAudioOut[0]);
+    //Without the PDU output only what the voice, the recorder, the database and the capture depend on is decoded
+    if (!pduOut) {
+        bool frag = !opts.capturePath.empty() || recorder.isRunning() || database.isOpen();
+        decoder.setSubscriptions(TETRA_SUB_SYSINFO | TETRA_SUB_RESOURCE | (frag ? TETRA_SUB_FRAG : 0));
+    }
+
+    dsp::GsmtapSender gsmtap;
+    if (!opts.gsmtapHost.empty() && !gsmtap.open(opts.gsmtapHost, opts.gsmtapPort)) {
+        fprintf(stderr, "Could not send to %s:%d\n", opts.gsmtapHost.c_str(), opts.gsmtapPort);
+        return 1;
+    }
+
+    dsp::PacketCapture capture;
+    if (!opts.capturePath.empty()) {
+        if (!capture.open(opts.capturePath, opts.captureGsmtap)) {
+            fprintf(stderr, "Could not open %s\n", opts.capturePath.c_str());
+            return 1;
+        }
+        //A replay comes out with the same timestamps every time
+        if (burstsIn) { capture.setClock(merge.isOpen() ? merge.getStartUs() : replay.getStartUs()); }
+    }
+
+    L3Sinks l3Sinks;
+    l3Sinks.capture = capture.isOpen() ? &capture : NULL;
+    l3Sinks.recorder = recorder.isRunning() ? &recorder : NULL;
+    l3Sinks.database = database.isOpen() ? &database : NULL;
+    l3Sinks.decoder = &decoder;
+    if (l3Sinks.capture || l3Sinks.recorder || l3Sinks.database) { decoder.setL3Handler(l3SinksHandler, &l3Sinks); }
+
+    std::unique_ptr<tetra_burst_archive> archive;
+    if (!opts.archivePath.empty()) {
+        archive = std::make_unique<tetra_burst_archive>();
+        if (tetra_burst_archive_open(archive.get(), opts.archivePath.c_str()) < 0) {
+            fprintf(stderr, "Could not open %s\n", opts.archivePath.c_str());
+            return 1;
+        }
+        decoder.setBurstArchive(archive.get());
+    }
+
+    bool useEvents = pduOut || opts.captureGsmtap || gsmtap.isOpen();
+    tetra_event_queue queue;
+    if (useEvents) {
+        if (tetra_event_queue_init(&queue, CLI_EVENT_QUEUE_SIZE) < 0) {
+            fprintf(stderr, "Could not allocate the event queue\n");
+            return 1;
+        }
+        decoder.setEventQueue(&queue);
+    }
+
+    MetricsSource metricsSource = { &chain, useEvents ? &queue : NULL };
+    dsp::MetricsServer& metrics = dsp::MetricsServer::get();
+    if (!opts.metricsHost.empty()) {
+        metrics.addCollector(metricsCollector, &metricsSource);
+        if (!metrics.start(opts.metricsHost, opts.metricsPort)) {
+            fprintf(stderr, "Could not serve the metrics on %s:%d\n", opts.metricsHost.c_str(), opts.metricsPort);
+            return 1;
+        }
+    }
+
+    uint8_t* raw = dsp::buffer::alloc<uint8_t>(CLI_BLOCK_SIZE * 2 * sizeof(int16_t));
+    dsp::complex_t* iq = dsp::buffer::alloc<dsp::complex_t>(CLI_BLOCK_SIZE);
+    dsp::complex_t* syms = dsp::buffer::alloc<dsp::complex_t>(STREAM_BUFFER_SIZE);
+    uint8_t* bits = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+    uint8_t* hardBits = dsp::buffer::alloc<uint8_t>(STREAM_BUFFER_SIZE);
+    float* audio = dsp::buffer::alloc<float>(STREAM_BUFFER_SIZE);
+
+    uint64_t totalSamples = 0;
+    uint64_t totalBits = 0;
+    uint64_t totalEvents = 0;
+    unsigned int dropped = 0;
+    while (true) {
+        int n;
+        if (burstsIn) {
+            //Straight into the lower MAC, the decoder only runs from its bursts on
+            const tetra_burst_record* recs;
+            if (merge.isOpen()) {
+                const int8_t* const* soft;
+                n = merge.next(&recs, &soft);
+                if (n <= 0) { break; }
+                decoder.replayBursts(recs, n, soft);
+            } else {
+                n = replay.next(&recs);
+                if (n <= 0) { break; }
+                decoder.replayBursts(recs, n);
+            }
+        } else if (netsymsIn) {
+            int len = readNetsymsPacket(in, netPkt);
+            if (len < 0) { break; }
+            if (dsp::netsymsCarriesSymbols(netPkt[3])) {
+                //Symbols from the far demodulator, the rest of the chain runs here
+                n = std::max<int>(deframer.processSymbols(netPkt, len, syms), 0);
+                n = symbolExtractor.process(n, syms, bits);
+            } else {
+                //Decided bits go in as soft bits of full confidence
+                n = std::max<int>(deframer.process(netPkt, len, hardBits), 0);
+                for (int i = 0; i < n; i++) { bits[i] = (uint8_t)(hardBits[i] ? -CLI_HARD_SOFT_BIT : CLI_HARD_SOFT_BIT); }
+            }
+        } else {
+            int count = readSamples(in, opts.format, raw, iq, CLI_BLOCK_SIZE);
+            if (count <= 0) { break; }
+            totalSamples += count;
+            n = demod.process(count, iq, syms);
+            n = symbolExtractor.process(n, syms, bits);
+        }
+        if (!burstsIn) { totalBits += n; }
+        if (bitsOut && n) {
+            //Soft bits carry the hard decision in their sign
+            for (int i = 0; i < n; i++) { hardBits[i] = (int8_t)bits[i] < 0; }
+            fwrite(hardBits, 1, n, bitsOut);
+        }
+        //The audio goes out through audioFrameHandler
+        if (!burstsIn) { decoder.process(n, bits, audio); }
+
+        //Same thread on both ends, so the queue only has to hold the records of one block
+        if (useEvents) {
+            const tetra_burst_event* evs;
+            unsigned int evCount;
+            while ((evCount = tetra_event_queue_peek(&queue, &evs, CLI_EVENT_QUEUE_SIZE)) > 0) {
+                if (pduOut) { writeEvents(pduOut, evs, evCount); }
+                if (opts.captureGsmtap) { capture.writeEvents(evs, evCount); }
+                if (gsmtap.isOpen()) { gsmtap.write(evs, evCount); }
+                tetra_event_queue_release(&queue, evCount);
+                totalEvents += evCount;
+            }
+            dropped += tetra_event_queue_take_dropped(&queue);
+        }
+        if (gsmtap.isOpen()) { gsmtap.poll(); }
+    }
+
+    fprintf(stderr, "%llu samples, %llu bits, %llu records (%u dropped), rx state %d\n", (unsigned long long)totalSamples,
+            (unsigned long long)totalBits, (unsigned long long)totalEvents, dropped, decoder.getRxState());
+    if (merge.isOpen()) {
+        fprintf(stderr, "%llu bursts merged from %llu copies, %llu duplicates left out, %llu soft combined\n", (unsigned long long)merge.getRecords(),
+                (unsigned long long)merge.getCopies(), (unsigned long long)merge.getDuplicates(), (unsigned long long)merge.getCombined());
+    } else if (burstsIn) {
+        fprintf(stderr, "%llu of %llu bursts replayed\n", (unsigned long long)replay.getPosition(), (unsigned long long)replay.getRecords());
+    }
+    if (netsymsIn) {
+        fprintf(stderr, "%llu NETSYMS packets lost, %llu symbols\n", (unsigned long long)deframer.getLostPackets(), (unsigned long long)deframer.getLostSymbols());
+    }
+
+    if (metrics.isRunning()) {
+        metrics.stop();
+        fprintf(stderr, "%llu metrics scrapes served\n", (unsigned long long)metrics.getScrapes());
+    }
+    metrics.removeCollector(&metricsSource);
+    decoder.setL3Handler(NULL, NULL);
+    if (recorder.isRunning()) {
+        decoder.setRecordHandler(NULL, NULL);
+        recorder.stop();
+        fprintf(stderr, "%llu calls recorded, %llu bytes (%llu frames dropped)\n", (unsigned long long)recorder.getCalls(),
+                (unsigned long long)recorder.getBytes(), (unsigned long long)recorder.getDropped());
+    }
+    if (database.isOpen()) {
+        database.close();
+        fprintf(stderr, "%llu events stored (%llu dropped, %llu failed)\n", (unsigned long long)database.getRows(),
+                (unsigned long long)database.getDropped(), (unsigned long long)database.getErrors());
+    }
+    if (capture.isOpen()) {
+        capture.close();
+        fprintf(stderr, "%llu N-PDUs captured (%llu compressed left out, %llu dropped)\n", (unsigned long long)capture.getPackets(),
+                (unsigned long long)capture.getCompressed(), (unsigned long long)capture.getDropped());
+    }
+    if (archive) {
+        decoder.setBurstArchive(NULL);
+        tetra_burst_archive_close(archive.get());
+        fprintf(stderr, "%llu bursts archived (%llu failed)\n", (unsigned long long)archive->records, (unsigned long long)archive->failed);
+    }
+    if (gsmtap.isOpen()) {
+        gsmtap.close();
+        fprintf(stderr, "%llu GSMTAP packets sent (%llu failed)\n", (unsigned long long)gsmtap.getSent(), (unsigned long long)gsmtap.getErrors());
+    }
+    if (useEvents) {
+        decoder.setEventQueue(NULL);
+        tetra_event_queue_deinit(&queue);
+    }
+    writeProfile(opts.profilePath);
+    dsp::buffer::free(raw);
+    dsp::buffer::free(iq);
+    dsp::buffer::free(syms);
+    dsp::buffer::free(bits);
+    dsp::buffer::free(hardBits);
+    dsp::buffer::free(audio);
+    closeFile(in);
+    closeFile(bitsOut);
+    closeFile(pduOut);
+    closeFile(audioOut);
+    for (auto f : slotAudioOut) { closeFile(f); }
+    return 0;
+}
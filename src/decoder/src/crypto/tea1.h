@@ -6,4 +6,13 @@
 
 void tea1(uint32_t dwFrameNumbers, const uint8_t *lpKey, uint32_t dwNumKsBytes, uint8_t *lpKsOut);
 
+/* Building blocks of tea1(), shared with the bit-sliced version in tea1_bs.c */
+extern const uint16_t g_awTea1LutA[8];
+extern const uint16_t g_awTea1LutB[8];
+extern const uint8_t g_abTea1Sbox[256];
+uint64_t tea1_expand_iv(uint32_t dwShortIv);
+uint8_t tea1_reorder_state_byte(uint8_t bStByte);
+int32_t tea1_init_key_register(const uint8_t *lpKey);
+void tea1_inner(uint64_t qwIvReg, uint32_t dwKeyReg, uint32_t dwNumKsBytes, uint8_t *lpKsOut);
+
 #endif /* HAVE_TEA1_H */
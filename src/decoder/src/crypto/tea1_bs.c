@@ -0,0 +1,224 @@
+/* Bit-sliced TETRA TEA1 keystream generator, see tea1.c for the reference */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "tea1.h"
+#include "tea1_bs.h"
+
+#if TEA1_BS_WORDS > 1
+/* The vectors only pass between static functions of this file */
+#pragma GCC diagnostic ignored "-Wpsabi"
+typedef uint64_t bs_word __attribute__((vector_size(8 * TEA1_BS_WORDS)));
+#else
+typedef uint64_t bs_word;
+#endif
+
+/* Monomials of the algebraic normal form of every output bit, as the mask of
+ * the input bits they multiply. Derived once from the tables of tea1.c */
+static uint8_t sbox_terms[8][256];
+static int sbox_nterms[8];
+static uint8_t lut_terms[2][8][16];
+static int lut_nterms[2][8];
+/* bit of the state byte each bit of tea1_reorder_state_byte() comes from */
+static int reorder_src[8];
+/* highest set bit of each mask, to build the monomials incrementally */
+static uint8_t top_bit[256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* Truth table to algebraic normal form */
+static void moebius(uint8_t *f, int vars)
+{
+	int i, m;
+
+	for (i = 0; i < vars; i++) {
+		for (m = 0; m < (1 << vars); m++) {
+			if (m & (1 << i))
+				f[m] ^= f[m ^ (1 << i)];
+		}
+	}
+}
+
+static void tables_init_once(void)
+{
+	uint8_t f[256];
+	int b, i, l, m;
+
+	for (b = 0; b < 8; b++) {
+		for (m = 0; m < 256; m++)
+			f[m] = (g_abTea1Sbox[m] >> b) & 1;
+		moebius(f, 8);
+		for (m = 0; m < 256; m++) {
+			if (f[m])
+				sbox_terms[b][sbox_nterms[b]++] = m;
+		}
+	}
+
+	for (l = 0; l < 2; l++) {
+		const uint16_t *lut = l ? g_awTea1LutB : g_awTea1LutA;
+		for (i = 0; i < 8; i++) {
+			for (m = 0; m < 16; m++)
+				f[m] = (lut[i] >> m) & 1;
+			moebius(f, 4);
+			for (m = 0; m < 16; m++) {
+				if (f[m])
+					lut_terms[l][i][lut_nterms[l][i]++] = m;
+			}
+		}
+	}
+
+	for (b = 0; b < 8; b++) {
+		uint8_t out = tea1_reorder_state_byte(1 << b);
+		for (i = 0; i < 8; i++) {
+			if (out & (1 << i))
+				reorder_src[i] = b;
+		}
+	}
+
+	for (m = 1; m < 256; m++)
+		top_bit[m] = 31 - __builtin_clz(m);
+}
+
+/* Evaluate the terms over vars inputs, m[] has room for 1 << vars monomials */
+static inline bs_word anf_eval(bs_word *mono, const uint8_t *terms, int nterms)
+{
+	bs_word acc = mono[0] ^ mono[0];
+	int t;
+
+	for (t = 0; t < nterms; t++)
+		acc ^= mono[terms[t]];
+	return acc;
+}
+
+static inline void monomials(bs_word *mono, const bs_word *x, int vars)
+{
+	int m;
+
+	mono[0] = ~(x[0] ^ x[0]);
+	for (m = 1; m < (1 << vars); m++)
+		mono[m] = mono[m ^ (1 << top_bit[m])] & x[top_bit[m]];
+}
+
+/* Logical bit i of the registers, which shift by renaming instead of moving */
+#define S(i)	s[((i) + so) & 63]
+#define K(i)	k[((i) + ko) & 31]
+
+/* tea1_state_word_to_newbyte() of the 16 state bits from bit base up */
+static inline void state_word_to_newbyte(const bs_word *s, int so, int base, int l, bs_word *out)
+{
+	bs_word mono[16];
+	bs_word x[4];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		x[0] = S(base + ((i + 7) & 7));
+		x[1] = S(base + i);
+		x[2] = S(base + 8 + ((i + 1) & 7));
+		x[3] = S(base + 8 + ((i + 2) & 7));
+		monomials(mono, x, 4);
+		out[i] = anf_eval(mono, lut_terms[l][i], lut_nterms[l][i]);
+	}
+}
+
+/* Lanes to slices: bit j of every lane value goes into slice j */
+static void load_slices(bs_word *slices, int bits, unsigned int count, const uint64_t *values)
+{
+	uint64_t w[TEA1_BS_WORDS];
+	unsigned int lane;
+	int j;
+
+	for (j = 0; j < bits; j++) {
+		memset(w, 0, sizeof(w));
+		for (lane = 0; lane < count; lane++)
+			w[lane / 64] |= ((values[lane] >> j) & 1) << (lane % 64);
+		memcpy(&slices[j], w, sizeof(w));
+	}
+}
+
+void tea1_bs_inner(unsigned int count, const uint64_t *iv_regs, const uint32_t *key_regs, uint32_t num_ks_bytes, uint8_t *ks_out)
+{
+	uint64_t keys[TEA1_BS_LANES];
+	bs_word s[64], k[32];
+	bs_word in[8], o[8], d12[8], d56[8], nb[8];
+	bs_word mono[256];
+	uint64_t w[8][TEA1_BS_WORDS];
+	unsigned int lane, byte;
+	int so = 0, ko = 0;
+	int rounds = 54;
+	int b, r;
+
+	pthread_once(&tables_once, tables_init_once);
+
+	if (count > TEA1_BS_LANES)
+		count = TEA1_BS_LANES;
+	for (lane = 0; lane < count; lane++)
+		keys[lane] = key_regs[lane];
+	load_slices(s, 64, count, iv_regs);
+	load_slices(k, 32, count, keys);
+
+	for (byte = 0; byte < num_ks_bytes; byte++) {
+		for (r = 0; r < rounds; r++) {
+			/* Step 1: S-box of the key register, fed back into it */
+			for (b = 0; b < 8; b++)
+				in[b] = K(24 + b) ^ K(b);
+			monomials(mono, in, 8);
+			for (b = 0; b < 8; b++)
+				o[b] = anf_eval(mono, sbox_terms[b], sbox_nterms[b]);
+			ko = (ko - 8) & 31;
+			for (b = 0; b < 8; b++)
+				K(b) = o[b];
+
+			/* Step 2 and 3: bytes derived from the state, combined with the S-box output */
+			state_word_to_newbyte(s, so, 8, 0, d12);
+			state_word_to_newbyte(s, so, 40, 1, d56);
+			for (b = 0; b < 8; b++)
+				nb[b] = d56[b] ^ S(56 + b) ^ S(32 + reorder_src[b]) ^ o[b];
+
+			/* Step 4: shift by 8, mix in the derived byte and the new one */
+			so = (so - 8) & 63;
+			for (b = 0; b < 8; b++) {
+				S(32 + b) ^= d12[b];
+				S(b) = nb[b];
+			}
+		}
+		rounds = 19;
+
+		/* The top byte of the state is this keystream byte of every lane */
+		for (b = 0; b < 8; b++)
+			memcpy(w[b], &S(56 + b), sizeof(w[b]));
+		for (lane = 0; lane < count; lane++) {
+			uint8_t v = 0;
+			for (b = 0; b < 8; b++)
+				v |= ((w[b][lane / 64] >> (lane % 64)) & 1) << b;
+			ks_out[lane * num_ks_bytes + byte] = v;
+		}
+	}
+}
+
+void tea1_batch(unsigned int count, const uint32_t *ivs, const uint8_t *keys, uint32_t num_ks_bytes, uint8_t *ks_out)
+{
+	uint64_t iv_regs[TEA1_BS_LANES];
+	uint32_t key_regs[TEA1_BS_LANES];
+	unsigned int done, lane, n;
+
+	for (done = 0; done < count; done += n) {
+		n = count - done < TEA1_BS_LANES ? count - done : TEA1_BS_LANES;
+		for (lane = 0; lane < n; lane++) {
+			iv_regs[lane] = tea1_expand_iv(ivs[done + lane]);
+			key_regs[lane] = tea1_init_key_register(&keys[(done + lane) * 10]);
+		}
+		tea1_bs_inner(n, iv_regs, key_regs, num_ks_bytes, &ks_out[done * num_ks_bytes]);
+	}
+}
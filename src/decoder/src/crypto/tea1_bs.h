@@ -0,0 +1,35 @@
+#ifndef HAVE_TEA1_BS_H
+#define HAVE_TEA1_BS_H
+
+/* Bit-sliced TEA1: the keystream of many (IV, key) pairs at once
+ *
+ * Every bit of the IV and key registers is held in a word whose bit n belongs
+ * to lane n, so each lane runs its own TEA1 instance and all of them advance
+ * together with plain logic operations. The S-box and the state byte
+ * functions are evaluated from their algebraic normal form. Worth it for bulk
+ * work over many keys, a single keystream is faster with tea1() */
+
+#include <inttypes.h>
+
+/* 64 bit words per slice. With GCC / clang vector types 4 gives 256 lanes
+ * that compile to AVX2 where -march allows it */
+#ifndef TEA1_BS_WORDS
+#if defined(__GNUC__)
+#define TEA1_BS_WORDS	4
+#else
+#define TEA1_BS_WORDS	1
+#endif
+#endif
+
+#define TEA1_BS_LANES	(64 * TEA1_BS_WORDS)
+
+/* Up to TEA1_BS_LANES pairs of IV and key register as tea1_inner() takes them.
+ * Lane i writes num_ks_bytes of keystream to ks_out + i * num_ks_bytes, lanes
+ * beyond count are idle */
+void tea1_bs_inner(unsigned int count, const uint64_t *iv_regs, const uint32_t *key_regs, uint32_t num_ks_bytes, uint8_t *ks_out);
+
+/* Any number of pairs of short IV (see tea_build_iv) and 80 bit key (10 bytes
+ * each), in batches of TEA1_BS_LANES. Same output layout as tea1_bs_inner() */
+void tea1_batch(unsigned int count, const uint32_t *ivs, const uint8_t *keys, uint32_t num_ks_bytes, uint8_t *ks_out);
+
+#endif /* HAVE_TEA1_BS_H */
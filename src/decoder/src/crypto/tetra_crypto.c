@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 // #include <osmocom/core/utils.h>
 
@@ -34,13 +35,17 @@
 #include <phy/tetra_burst.h>
 
 #include "tetra_crypto.h"
+#include "tetra_ks_sched.h"
 #include "tea1.h"
 #include "tea2.h"
 #include "tea3.h"
 #include "taa1.h"
 
 
-struct tetra_crypto_database _tcdb, *tcdb = &_tcdb;
+/* Current keystore snapshot. tcdb_lock guards swapping it and the refs of
+ * every snapshot, a decoder only takes it when the snapshot changed */
+static struct tetra_crypto_database *tcdb;
+static pthread_mutex_t tcdb_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static const struct value_string tetra_key_types[] = {
 	{ KEYTYPE_UNDEFINED,		"UNDEFINED" },
@@ -101,25 +106,19 @@ void tetra_crypto_state_init(struct tetra_crypto_state *tcs)
 	tcs->cc =  -1;
 
 	/* Initialize database key/network pointers to zero */
+	tcs->db = 0;
+	tcs->prev_db = 0;
 	tcs->cck = 0;
 	tcs->network = 0;
-}
-
-void tetra_crypto_db_init(void)
-{
-	/* Initialize tetra_crypto_database */
-	tcdb->num_keys = 0;
-	tcdb->num_nets = 0;
-	tcdb->keys = malloc(sizeof(struct tetra_key)*TCDB_ALLOC_BLOCK_SIZE);
-	tcdb->nets = malloc(sizeof(struct tetra_netinfo)*TCDB_ALLOC_BLOCK_SIZE);
-	tcdb->nets_cnt = TCDB_ALLOC_BLOCK_SIZE;
-	// tcdb->keys = talloc_zero_array(NULL, struct tetra_key, TCDB_ALLOC_BLOCK_SIZE);
-	// tcdb->nets = talloc_zero_array(NULL, struct tetra_netinfo, TCDB_ALLOC_BLOCK_SIZE);
 
-	if (!tcdb->keys || !tcdb->nets) {
-		fprintf(stderr, "couldn't allocate memory for tetra_crypto_database\n");
-		exit(1);
-	}
+	memset(tcs->eck_cache, 0, sizeof(tcs->eck_cache));
+	tcs->eck_cache_len = 0;
+	memset(tcs->ks_cache, 0, sizeof(tcs->ks_cache));
+	tcs->ks_cache_next = 0;
+	tcs->precompute = false;
+	memset(&tcs->voice_eck, 0, sizeof(tcs->voice_eck));
+	tcs->voice_eck.cn = -1;
+	tcs->sched = NULL;
 }
 
 char *dump_key(struct tetra_key *k)
@@ -159,56 +158,214 @@ uint32_t tea_build_iv(struct tetra_tdma_time *tm, uint16_t hn, uint8_t dir)
 	return ((tm->tn - 1) | (tm->fn << 2) | (tm->mn << 7) | ((hn & 0x7FFF) << 13) | (dir << 28));
 }
 
-static bool generate_keystream(struct tetra_crypto_state *tcs, struct tetra_key *key, struct tetra_tdma_time *t, int num_bits, uint8_t *ks_out)
+/* TB5 only depends on the key and the cell, so its output is kept until either changes */
+static const uint8_t *get_eck(struct tetra_crypto_state *tcs, struct tetra_key *key)
 {
-	if (!key)
-		return false;
-
-	/* Construct IV and prepare buf for bytewise keystream */
-	int num_bytes = (num_bits + 7) / 8;
-	// uint8_t ks_bytes[num_bytes];
-	//I HATE FUCKING MSVC
-	uint8_t* ks_bytes = malloc(num_bytes);
-	uint32_t iv = tea_build_iv(t, tcs->hn, 0);
+	struct tetra_eck_entry entry;
+	uint8_t cn[2], la[2], cc[1];
+	int i;
+
+	for (i = 0; i < tcs->eck_cache_len; i++) {
+		struct tetra_eck_entry *e = &tcs->eck_cache[i];
+		if (e->key == key && e->cn == tcs->cn && e->la == tcs->la && e->cc == tcs->cc &&
+				!memcmp(e->ck, key->key, sizeof(e->ck))) {
+			entry = *e;
+			goto hit;
+		}
+	}
 
 	/* Compute ECK from net info and CK */
-	if (tcs->cn < 0 || tcs->la < 0 || tcs->cc < 0) {
-		/* Missing data for TB5 */
-		free(ks_bytes);
-		return false;
-	}
+	cn[0] = (tcs->cn >> 8) & 0xFF;
+	cn[1] = tcs->cn & 0xFF;
+	la[0] = (tcs->la >> 8) & 0xFF;
+	la[1] = tcs->la & 0xFF;
+	cc[0] = tcs->cc & 0xFF;
+	entry.key = key;
+	memcpy(entry.ck, key->key, sizeof(entry.ck));
+	entry.cn = tcs->cn;
+	entry.la = tcs->la;
+	entry.cc = tcs->cc;
+	tb5(cn, la, cc, key->key, entry.eck);
+
+	if (tcs->eck_cache_len < TETRA_ECK_CACHE_SIZE)
+		tcs->eck_cache_len++;
+	i = tcs->eck_cache_len - 1;
+hit:
+	/* move to the front */
+	memmove(&tcs->eck_cache[1], &tcs->eck_cache[0], i * sizeof(tcs->eck_cache[0]));
+	tcs->eck_cache[0] = entry;
+	return tcs->eck_cache[0].eck;
+}
 
+/* Returns at least num_bytes of keystream for iv, from the cache or generated
+ * into it. The buffer stays valid until the next call */
+static const uint8_t *get_keystream(struct tetra_crypto_state *tcs, struct tetra_key *key, uint32_t iv, uint32_t num_bytes)
+{
+	struct tetra_ks_entry *e;
 	uint8_t eck[10];
-	uint8_t cn[2] = {(tcs->cn >> 8) & 0xFF, tcs->cn & 0xFF};
-	uint8_t la[2] = {(tcs->la >> 8) & 0xFF, tcs->la & 0xFF};
-	uint8_t cc[1] = {tcs->cc & 0xFF};
-	tb5(cn, la, cc, key->key, eck);
+	enum tetra_ksg_type ksg_type = key->network_info->ksg_type;
+	int i;
+
+	if (num_bytes > TETRA_KS_MAX_BYTES)
+		return NULL;
+	if (ksg_type != KSG_TEA1 && ksg_type != KSG_TEA2 && ksg_type != KSG_TEA3) {
+		// fprintf(stderr, "tetra_crypto: KSG type %d not supported\n", ksg_type);
+		return NULL;
+	}
 
+	memcpy(eck, get_eck(tcs, key), sizeof(eck));
+	for (i = 0; i < TETRA_KS_CACHE_SIZE; i++) {
+		e = &tcs->ks_cache[i];
+		if (e->num_bytes && e->iv == iv && e->ksg_type == ksg_type && !memcmp(e->eck, eck, sizeof(e->eck))) {
+			if (e->num_bytes >= num_bytes)
+				return e->ks;
+			/* too short, generate it again in place */
+			goto generate;
+		}
+	}
+	e = &tcs->ks_cache[tcs->ks_cache_next];
+	tcs->ks_cache_next = (tcs->ks_cache_next + 1) % TETRA_KS_CACHE_SIZE;
+
+generate:
 	/* Generate keystream with required KSG */
-	switch (key->network_info->ksg_type) {
+	switch (ksg_type) {
 	case KSG_TEA1:
-		tea1(iv, eck, num_bytes, ks_bytes);
+		tea1(iv, eck, num_bytes, e->ks);
 		break;
-
 	case KSG_TEA2:
-		tea2(iv, eck, num_bytes, ks_bytes);
+		tea2(iv, eck, num_bytes, e->ks);
 		break;
+	default:
+		tea3(iv, eck, num_bytes, e->ks);
+		break;
+	}
+	e->iv = iv;
+	e->ksg_type = ksg_type;
+	memcpy(e->eck, eck, sizeof(e->eck));
+	e->num_bytes = num_bytes;
+	return e->ks;
+}
+
+static const uint8_t *generate_keystream(struct tetra_crypto_state *tcs, struct tetra_key *key, struct tetra_tdma_time *t, int num_bits)
+{
+	if (!key)
+		return NULL;
 
-	case KSG_TEA3:
-		tea3(iv, eck, num_bytes, ks_bytes);
-			break;
+	/* Missing data for TB5 */
+	if (tcs->cn < 0 || tcs->la < 0 || tcs->cc < 0)
+		return NULL;
 
-	default:
-		// fprintf(stderr, "tetra_crypto: KSG type %d not supported\n", key->network_info->ksg_type);
-		free(ks_bytes);
-		return false;
+	return get_keystream(tcs, key, tea_build_iv(t, tcs->hn, 0), (num_bits + 7) / 8);
+}
+
+/* The keystream is used bitwise, MSB first */
+static inline uint8_t ks_bit(const uint8_t *ks, int i)
+{
+	return (ks[i / 8] >> (7 - (i % 8))) & 1;
+}
+
+/* Generate the keystream of tdma_time ahead of time, so the decryption of its
+ * slot only has to apply it */
+void tetra_crypto_precompute(struct tetra_crypto_state *tcs, struct tetra_key *key, struct tetra_tdma_time *tdma_time, uint16_t hn)
+{
+	if (!key || tcs->cn < 0 || tcs->la < 0 || tcs->cc < 0)
+		return;
+	get_keystream(tcs, key, tea_build_iv(tdma_time, hn, 0), TETRA_KS_SLOT_BYTES);
+}
+
+/* Keystream of the same timeslot in the next frame, the hyperframe number
+ * goes up with the wrap of the multiframe */
+static void precompute_next_frame(struct tetra_crypto_state *tcs, struct tetra_key *key, struct tetra_tdma_time *tdma_time)
+{
+	struct tetra_tdma_time next = *tdma_time;
+	uint16_t hn = tcs->hn;
+
+	if (!tcs->precompute)
+		return;
+	tetra_tdma_time_add_fn(&next, 1);
+	if (next.mn < tdma_time->mn)
+		hn++;
+	tetra_crypto_precompute(tcs, key, &next, hn);
+}
+
+struct tetra_ks_sched *tetra_crypto_set_scheduled(struct tetra_crypto_state *tcs, bool on)
+{
+	if (on && !tcs->sched)
+		tcs->sched = tetra_ks_sched_alloc();
+	if (!on) {
+		tetra_ks_sched_free(tcs->sched);
+		tcs->sched = NULL;
 	}
+	return tcs->sched;
+}
+
+void tetra_crypto_voice_key(struct tetra_crypto_state *tcs, bool encrypted, struct tetra_key *key, struct tetra_voice_key *vk)
+{
+	memset(vk, 0, sizeof(*vk));
+	vk->encrypted = encrypted;
+	vk->cn = tcs->cn;
+	vk->la = tcs->la;
+	vk->cc = tcs->cc;
+	vk->hn = __atomic_load_n(&tcs->hn, __ATOMIC_RELAXED);
+	if (!key)
+		return;
+	vk->have_key = 1;
+	vk->ksg_type = key->network_info->ksg_type;
+	memcpy(vk->ck, key->key, 10);
+}
+
+/* TB5 output of the voice path, kept apart from eck_cache as the lower MAC
+ * asks for it and may run on another thread than the upper MAC */
+static const uint8_t *get_voice_eck(struct tetra_crypto_state *tcs, const struct tetra_voice_key *vk)
+{
+	struct tetra_eck_entry *e = &tcs->voice_eck;
+	int cn = vk->cn, la = vk->la, cc = vk->cc;
+	uint8_t cn_b[2], la_b[2], cc_b[1];
+
+	if (e->cn == cn && e->la == la && e->cc == cc && !memcmp(e->ck, vk->ck, sizeof(e->ck)))
+		return e->eck;
+	cn_b[0] = (cn >> 8) & 0xFF;
+	cn_b[1] = cn & 0xFF;
+	la_b[0] = (la >> 8) & 0xFF;
+	la_b[1] = la & 0xFF;
+	cc_b[0] = cc & 0xFF;
+	memcpy(e->ck, vk->ck, sizeof(e->ck));
+	e->cn = cn;
+	e->la = la;
+	e->cc = cc;
+	tb5(cn_b, la_b, cc_b, e->ck, e->eck);
+	return e->eck;
+}
+
+bool tetra_crypto_voice_keystream(struct tetra_crypto_state *tcs, const struct tetra_voice_key *vk, struct tetra_tdma_time *tdma_time, uint8_t *ks)
+{
+	enum tetra_ksg_type ksg_type = vk->ksg_type;
+	uint8_t eck[10];
+	uint16_t hn = vk->hn;
+	uint32_t iv;
+
+	if (!vk->have_key || vk->cn < 0 || vk->la < 0 || vk->cc < 0)
+		return false;
+	if (ksg_type != KSG_TEA1 && ksg_type != KSG_TEA2 && ksg_type != KSG_TEA3)
+		return false;
 
-	/* Expand keystream bytes into ubit format */
-	for (int i = 0; i < num_bits; i++)
-		ks_out[i] = (ks_bytes[i / 8] >> (7-(i % 8))) & 1;
+	memcpy(eck, get_voice_eck(tcs, vk), sizeof(eck));
+	if (tcs->sched && tetra_ks_sched_take(tcs->sched, tdma_time, hn, ksg_type, eck, ks))
+		return true;
 
-	free(ks_bytes);
+	/* not made ahead, or nobody does */
+	iv = tea_build_iv(tdma_time, hn, 0);
+	switch (ksg_type) {
+	case KSG_TEA1:
+		tea1(iv, eck, TETRA_KS_VOICE_BYTES, ks);
+		break;
+	case KSG_TEA2:
+		tea2(iv, eck, TETRA_KS_VOICE_BYTES, ks);
+		break;
+	default:
+		tea3(iv, eck, TETRA_KS_VOICE_BYTES, ks);
+		break;
+	}
 	return true;
 }
 
@@ -249,21 +406,18 @@ bool decrypt_mac_element(struct tetra_crypto_state *tcs, struct tetra_tmvsap_pri
 	int ks_num_bits = ks_skip_bits + ct_len;
 	uint8_t *ct_start = msg->l1h + tmpdu_offset;
 	// uint8_t *ct_start = tmvp->msg + tmpdu_offset;
-	// uint8_t ks[ks_num_bits];
-	uint8_t* ks = malloc(ks_num_bits);
-	if (!generate_keystream(tcs, key, tdma_time, ks_num_bits, ks)) {
-		free(ks);
+	const uint8_t *ks = generate_keystream(tcs, key, tdma_time, ks_num_bits);
+	if (!ks)
 		return false;
-	}
 
 	/* Apply keystream */
 	for (int i = 0; i < ct_len; i++)
-		ct_start[i] = ct_start[i] ^ ks[i + ks_skip_bits];
+		ct_start[i] = ct_start[i] ^ ks_bit(ks, i + ks_skip_bits);
 
 	// printf("tetra_crypto: addr %8d -> key %4d, time %5d/%s, tmpdu offset %d, decrypting %d bits\n",
 		// key->addr, key->index, tcs->hn, tetra_tdma_time_dump(tdma_time), tmpdu_offset, ct_len);
 
-	free(ks);
+	precompute_next_frame(tcs, key, tdma_time);
 	return true;
 }
 
@@ -280,28 +434,169 @@ bool decrypt_voice_timeslot(struct tetra_crypto_state *tcs, struct tetra_tdma_ti
 		return false;
 	}
 
-	/* Generate keystream */
-	int ks_num_bits = 137*2; // two half slots of voice
-	// uint8_t ks[ks_num_bits];
-	uint8_t* ks = malloc(ks_num_bits);
-	if (!generate_keystream(tcs, key, tdma_time, ks_num_bits, ks)) {
-		free(ks);
+	/* Generate keystream of the two half slots of voice, unless the scheduler has it already */
+	struct tetra_voice_key vk;
+	uint8_t ks[TETRA_KS_VOICE_BYTES];
+	tetra_crypto_voice_key(tcs, true, key, &vk);
+	if (!tetra_crypto_voice_keystream(tcs, &vk, tdma_time, ks))
 		return false;
-	}
 
 	/* Apply keystream */
 	for (int i = 0; i < 137; i++) {
-		type1_block[i + 1] = type1_block[i + 1] ^ ks[i];
-		type1_block[i + 139] = type1_block[i + 139] ^ ks[i + 137];
+		type1_block[i + 1] = type1_block[i + 1] ^ ks_bit(ks, i);
+		type1_block[i + 139] = type1_block[i + 139] ^ ks_bit(ks, i + 137);
 	}
 
 	// printf("tetra_crypto: addr %8d -> key %4d, time %5d/%s, decrypted voice\n",
 		// key->addr, key->index, tcs->hn, tetra_tdma_time_dump(tdma_time));
-	free(ks);
 	return true;
 }
 
-int load_keystore(char *tetra_keyfile)
+/* Hash of the fields an index is keyed on */
+static uint32_t crypto_hash(uint64_t a, uint64_t b)
+{
+	uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ b;
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return (uint32_t)h;
+}
+
+static uint32_t net_hash(uint32_t mcc, uint32_t mnc)
+{
+	return crypto_hash(mcc, mnc);
+}
+
+static uint32_t cck_hash(uint32_t mcc, uint32_t mnc, uint32_t key_num)
+{
+	return crypto_hash(((uint64_t)mcc << 32) | mnc, key_num);
+}
+
+static uint32_t addr_hash(uint32_t mcc, uint32_t mnc, uint32_t addr)
+{
+	return crypto_hash(((uint64_t)mcc << 32) | mnc, addr);
+}
+
+static int index_alloc(struct tetra_crypto_index *ix, uint32_t entries)
+{
+	uint32_t slots = 16;
+
+	/* at most half full */
+	while (slots < 2 * entries)
+		slots <<= 1;
+	ix->slots = malloc(slots * sizeof(int32_t));
+	if (!ix->slots)
+		return -1;
+	memset(ix->slots, 0xff, slots * sizeof(int32_t));
+	ix->mask = slots - 1;
+	return 0;
+}
+
+static bool net_match(const struct tetra_crypto_database *db, int32_t i, uint32_t mcc, uint32_t mnc)
+{
+	return db->nets[i].mcc == mcc && db->nets[i].mnc == mnc;
+}
+
+static bool cck_match(const struct tetra_crypto_database *db, int32_t i, uint32_t mcc, uint32_t mnc, uint32_t key_num)
+{
+	const struct tetra_key *k = &db->keys[i];
+	return k->mcc == mcc && k->mnc == mnc && k->key_num == key_num;
+}
+
+/* key_type is a mask, like the stored key_type of a key may be */
+static bool addr_match(const struct tetra_crypto_database *db, int32_t i, uint32_t mcc, uint32_t mnc, uint32_t addr, uint32_t key_type)
+{
+	const struct tetra_key *k = &db->keys[i];
+	return k->mcc == mcc && k->mnc == mnc && k->addr == addr && (k->key_type & key_type);
+}
+
+/* Probe from hash until match(slot) or an empty slot, returns the slot */
+#define INDEX_PROBE(ix, hash, match) ({ \
+	uint32_t _slot = (hash) & (ix)->mask; \
+	while ((ix)->slots[_slot] >= 0 && !(match)) \
+		_slot = (_slot + 1) & (ix)->mask; \
+	_slot; \
+})
+
+/* The first entry of the file wins when several share a key, like the linear
+ * scans did */
+static void index_insert(struct tetra_crypto_index *ix, uint32_t slot, int32_t entry)
+{
+	if (ix->slots[slot] < 0)
+		ix->slots[slot] = entry;
+}
+
+static void db_free(struct tetra_crypto_database *db)
+{
+	free(db->keys);
+	free(db->nets);
+	free(db->net_index.slots);
+	free(db->cck_index.slots);
+	free(db->addr_index.slots);
+	free(db);
+}
+
+static void db_release(struct tetra_crypto_database *db)
+{
+	bool last;
+
+	if (!db)
+		return;
+	pthread_mutex_lock(&tcdb_lock);
+	last = --db->refs == 0;
+	pthread_mutex_unlock(&tcdb_lock);
+	if (last)
+		db_free(db);
+}
+
+static int db_build_indices(struct tetra_crypto_database *db)
+{
+	uint32_t i;
+
+	if (index_alloc(&db->net_index, db->num_nets) < 0 ||
+			index_alloc(&db->cck_index, db->num_keys) < 0 ||
+			index_alloc(&db->addr_index, db->num_keys) < 0)
+		return -1;
+
+	for (i = 0; i < db->num_nets; i++) {
+		struct tetra_netinfo *n = &db->nets[i];
+		struct tetra_crypto_index *ix = &db->net_index;
+		index_insert(ix, INDEX_PROBE(ix, net_hash(n->mcc, n->mnc),
+				net_match(db, ix->slots[_slot], n->mcc, n->mnc)), i);
+	}
+	for (i = 0; i < db->num_keys; i++) {
+		struct tetra_key *k = &db->keys[i];
+		struct tetra_crypto_index *ix = &db->addr_index;
+		/* Every key of an address gets a slot, in file order along its probe
+		 * sequence, so a lookup by any mask meets the first one of the file
+		 * first */
+		index_insert(ix, INDEX_PROBE(ix, addr_hash(k->mcc, k->mnc, k->addr), false), i);
+		if (k->key_type != KEYTYPE_CCK_SCK)
+			continue;
+		ix = &db->cck_index;
+		index_insert(ix, INDEX_PROBE(ix, cck_hash(k->mcc, k->mnc, k->key_num),
+				cck_match(db, ix->slots[_slot], k->mcc, k->mnc, k->key_num)), i);
+	}
+	return 0;
+}
+
+/* Grow an array of size elements by doubling its capacity */
+static void *grow(void *array, uint32_t *capacity, uint32_t used, size_t size)
+{
+	void *n;
+
+	if (used < *capacity)
+		return array;
+	n = realloc(array, (size_t)*capacity * 2 * size);
+	if (n)
+		*capacity *= 2;
+	return n;
+}
+
+static int parse_keystore(FILE *fp)
 {
 	/* Keystore file:
 	 * Each line contains network or key definition.
@@ -318,19 +613,25 @@ int load_keystore(char *tetra_keyfile)
 	 *   - key: 80-bit key hex string
 	 */
 
-	int i, c;
+	struct tetra_crypto_database *db, *old;
+	uint32_t key_cap = TCDB_ALLOC_BLOCK_SIZE, net_cap = TCDB_ALLOC_BLOCK_SIZE;
+	unsigned int kb[10];
+	uint32_t i;
+	int c, j, line = 0;
 	char buf[1000]; // max line len
-	FILE *fp;
 
-	tetra_crypto_db_init();
-
-	fp = fopen(tetra_keyfile, "r");
-	if (!fp) {
-		printf("tetra_crypto: cannot read keyfile\n");
-		exit(1);
+	db = calloc(1, sizeof(*db));
+	if (db) {
+		db->keys = malloc(sizeof(struct tetra_key) * key_cap);
+		db->nets = malloc(sizeof(struct tetra_netinfo) * net_cap);
+	}
+	if (!db || !db->keys || !db->nets) {
+		fprintf(stderr, "couldn't allocate memory for tetra_crypto_database\n");
+		goto err;
 	}
 
 	while (fgets(buf, sizeof(buf), fp)) {
+		line++;
 
 		if (strlen(buf) <= 1 || buf[0] == '#') {
 			/* Commented/empty line */
@@ -339,87 +640,180 @@ int load_keystore(char *tetra_keyfile)
 		} else if (!strncmp(buf, "network ", 8)) {
 
 			/* Network definition */
-			i = tcdb->num_nets;
-			if (i > 0 && (i % TCDB_ALLOC_BLOCK_SIZE == 0)) {
-				// tcdb->nets = talloc_realloc(NULL, tcdb->nets, struct tetra_netinfo, i + TCDB_ALLOC_BLOCK_SIZE);
-				void* newnets = malloc(sizeof(struct tetra_netinfo)*(i + TCDB_ALLOC_BLOCK_SIZE));
-				memcpy(newnets, tcdb->nets, sizeof(struct tetra_netinfo)*tcdb->nets_cnt);
-				free(tcdb->nets);
-				tcdb->nets = newnets;
-			}
+			struct tetra_netinfo *nets = grow(db->nets, &net_cap, db->num_nets, sizeof(*nets));
+			if (!nets)
+				goto err;
+			db->nets = nets;
+			struct tetra_netinfo *n = &db->nets[db->num_nets];
 
-			c = sscanf(buf, "network mcc %d mnc %d ksg_type %d security_class %d\n",
-				&tcdb->nets[i].mcc, &tcdb->nets[i].mnc,
-				(uint32_t *) &tcdb->nets[i].ksg_type,
-				(uint32_t *) &tcdb->nets[i].security_class);
+			c = sscanf(buf, "network mcc %u mnc %u ksg_type %u security_class %u\n",
+				&n->mcc, &n->mnc, (uint32_t *) &n->ksg_type, (uint32_t *) &n->security_class);
 
 			if (c != 4) {
-				printf("tetra_crypto: Failed to parse network info element %d [%s] (%d)\n", i, buf, c);
-				exit(1);
+				printf("tetra_crypto: Failed to parse network info on line %d [%s] (%d)\n", line, buf, c);
+				goto err;
 			}
-			// printf("tetra_crypto: Loaded MNC [%s]\n", dump_network_info(&tcdb->nets[i]));
-			tcdb->num_nets++;
+			// printf("tetra_crypto: Loaded MNC [%s]\n", dump_network_info(n));
+			db->num_nets++;
 
 		} else if (!strncmp(buf, "key ", 4)) {
 
 			/* Key definition */
-			i = tcdb->num_keys;
-			if (i > 0 && (i % TCDB_ALLOC_BLOCK_SIZE == 0)) {
-				// tcdb->keys = talloc_realloc(NULL, tcdb->keys, struct tetra_key, i + TCDB_ALLOC_BLOCK_SIZE);
-				void* newnets = malloc(sizeof(struct tetra_netinfo)*(i + TCDB_ALLOC_BLOCK_SIZE));
-				memcpy(newnets, tcdb->nets, sizeof(struct tetra_netinfo)*tcdb->nets_cnt);
-				free(tcdb->nets);
-				tcdb->nets = newnets;
-			}
-
-			c = sscanf(buf, "key mcc %d mnc %d addr %d key_type %d key_num %d key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X\n",
-				&tcdb->keys[i].mcc, &tcdb->keys[i].mnc, &tcdb->keys[i].addr,
-				(uint32_t *) &tcdb->keys[i].key_type, &tcdb->keys[i].key_num,
-				(uint32_t *) &tcdb->keys[i].key[0], (uint32_t *) &tcdb->keys[i].key[1],
-				(uint32_t *) &tcdb->keys[i].key[2], (uint32_t *) &tcdb->keys[i].key[3],
-				(uint32_t *) &tcdb->keys[i].key[4], (uint32_t *) &tcdb->keys[i].key[5],
-				(uint32_t *) &tcdb->keys[i].key[6], (uint32_t *) &tcdb->keys[i].key[7],
-				(uint32_t *) &tcdb->keys[i].key[8], (uint32_t *) &tcdb->keys[i].key[9]);
-			tcdb->keys[i].index = i;
+			struct tetra_key *keys = grow(db->keys, &key_cap, db->num_keys, sizeof(*keys));
+			if (!keys)
+				goto err;
+			db->keys = keys;
+			struct tetra_key *k = &db->keys[db->num_keys];
+			memset(k, 0, sizeof(*k));
+
+			c = sscanf(buf, "key mcc %u mnc %u addr %u key_type %u key_num %u key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X\n",
+				&k->mcc, &k->mnc, &k->addr, (uint32_t *) &k->key_type, &k->key_num,
+				&kb[0], &kb[1], &kb[2], &kb[3], &kb[4], &kb[5], &kb[6], &kb[7], &kb[8], &kb[9]);
 			if (c != 15) {
-				printf("tetra_crypto: Failed to parse key %d [%s] (%d)\n", i, buf, c);
-				exit(1);
+				printf("tetra_crypto: Failed to parse key on line %d [%s] (%d)\n", line, buf, c);
+				goto err;
 			}
-			// printf("tetra_crypto: Loaded key [%s]\n", dump_key(&tcdb->keys[i]));
-			tcdb->num_keys++;
+			for (j = 0; j < 10; j++)
+				k->key[j] = kb[j];
+			k->index = db->num_keys;
+			// printf("tetra_crypto: Loaded key [%s]\n", dump_key(k));
+			db->num_keys++;
 
 		} else {
-			printf("tetra_crypto: Could not parse line: %s\n", buf);
-			exit(1);
+			printf("tetra_crypto: Could not parse line %d: %s\n", line, buf);
+			goto err;
 		}
 	}
+	if (db_build_indices(db) < 0) {
+		fprintf(stderr, "couldn't allocate memory for tetra_crypto_database\n");
+		goto err;
+	}
 
 	/* Check network info available for each key and set ptrs for convenience */
-	for (i = 0; i < tcdb->num_keys; i++) {
-		struct tetra_netinfo *network_info_ptr = get_network_info(tcdb->keys[i].mcc, tcdb->keys[i].mnc);
+	for (i = 0; i < db->num_keys; i++) {
+		struct tetra_netinfo *network_info_ptr = get_network_info(db, db->keys[i].mcc, db->keys[i].mnc);
 		if (!network_info_ptr) {
-			printf("tetra_crypto: Required network info is missing for %4d", tcdb->keys[i].mnc);
-			exit(1);
+			printf("tetra_crypto: Required network info is missing for %4d\n", db->keys[i].mnc);
+			goto err;
 		}
-		tcdb->keys[i].network_info = network_info_ptr;
+		db->keys[i].network_info = network_info_ptr;
 	}
 
-	fclose(fp);
+	/* Publish, decoders pick it up with their next tetra_crypto_refresh() */
+	db->refs = 1;
+	pthread_mutex_lock(&tcdb_lock);
+	old = tcdb;
+	__atomic_store_n(&tcdb, db, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tcdb_lock);
+	db_release(old);
 	return 0;
+
+err:
+	if (db)
+		db_free(db);
+	return -1;
 }
 
-struct tetra_key *get_key_by_addr(struct tetra_crypto_state *tcs, int addr, enum tetra_key_type key_type)
+int load_keystore(char *tetra_keyfile)
 {
-	for (int i = 0; i < tcdb->num_keys; i++) {
-		struct tetra_key *key = &tcdb->keys[i];
-		if (key->mnc == tcs->mnc &&
-				key->mcc == tcs->mcc &&
-				key->addr == addr &&
-				(key->key_type & key_type)) {
-			return key;
-		}
+	FILE *fp;
+	int rc;
+
+	fp = fopen(tetra_keyfile, "r");
+	if (!fp) {
+		printf("tetra_crypto: cannot read keyfile\n");
+		return -1;
 	}
-	return 0;
+	rc = parse_keystore(fp);
+	fclose(fp);
+	return rc;
+}
+
+void tetra_crypto_state_deinit(struct tetra_crypto_state *tcs)
+{
+	db_release(tcs->prev_db);
+	db_release(tcs->db);
+	tcs->prev_db = 0;
+	tcs->db = 0;
+	tcs->network = 0;
+	tcs->cck = 0;
+	tetra_crypto_set_scheduled(tcs, false);
+}
+
+bool tetra_crypto_refresh(struct tetra_crypto_state *tcs)
+{
+	struct tetra_crypto_database *db;
+
+	/* Fast path, no lock while nothing was reloaded */
+	if (__atomic_load_n(&tcdb, __ATOMIC_ACQUIRE) == tcs->db)
+		return false;
+
+	pthread_mutex_lock(&tcdb_lock);
+	db = tcdb;
+	if (db)
+		db->refs++;
+	pthread_mutex_unlock(&tcdb_lock);
+
+	db_release(tcs->prev_db);
+	tcs->prev_db = tcs->db;
+	tcs->db = db;
+
+	/* The cached ECKs point to keys of the old snapshot */
+	memset(tcs->eck_cache, 0, sizeof(tcs->eck_cache));
+	tcs->eck_cache_len = 0;
+
+	/* Select network and CCK again, the current mcc / mnc / cck_id stay */
+	update_current_network(tcs, tcs->mcc, tcs->mnc);
+	return true;
+}
+
+/* The same key (by network, type, number and address) in the new snapshot */
+struct tetra_key *tetra_crypto_rebind_key(struct tetra_crypto_state *tcs, struct tetra_key *key)
+{
+	struct tetra_crypto_database *db = tcs->db;
+	struct tetra_crypto_index *ix;
+	uint32_t slot;
+
+	if (!key || !db)
+		return 0;
+	if (key->key_type == KEYTYPE_CCK_SCK) {
+		ix = &db->cck_index;
+		slot = INDEX_PROBE(ix, cck_hash(key->mcc, key->mnc, key->key_num),
+			cck_match(db, ix->slots[_slot], key->mcc, key->mnc, key->key_num));
+	} else {
+		ix = &db->addr_index;
+		slot = INDEX_PROBE(ix, addr_hash(key->mcc, key->mnc, key->addr),
+			addr_match(db, ix->slots[_slot], key->mcc, key->mnc, key->addr, key->key_type) &&
+			db->keys[ix->slots[_slot]].key_type == key->key_type);
+	}
+	return ix->slots[slot] >= 0 ? &db->keys[ix->slots[slot]] : 0;
+}
+
+void tetra_crypto_refresh_done(struct tetra_crypto_state *tcs)
+{
+	db_release(tcs->prev_db);
+	tcs->prev_db = 0;
+}
+
+bool tetra_crypto_have_keys(struct tetra_crypto_state *tcs)
+{
+	return tcs->db && tcs->db->num_keys;
+}
+
+struct tetra_key *get_key_by_addr(struct tetra_crypto_state *tcs, int addr, enum tetra_key_type key_type)
+{
+	struct tetra_crypto_database *db = tcs->db;
+	struct tetra_crypto_index *ix;
+	uint32_t slot;
+
+	if (!db)
+		return 0;
+
+	/* The first key of the file with any of the types of key_type wins */
+	ix = &db->addr_index;
+	slot = INDEX_PROBE(ix, addr_hash(tcs->mcc, tcs->mnc, addr),
+		addr_match(db, ix->slots[_slot], tcs->mcc, tcs->mnc, addr, key_type));
+	return ix->slots[slot] >= 0 ? &db->keys[ix->slots[slot]] : 0;
 }
 
 struct tetra_key *get_ksg_key(struct tetra_crypto_state *tcs, int addr)
@@ -450,14 +844,7 @@ void update_current_network(struct tetra_crypto_state *tcs, int mcc, int mnc)
 	tcs->mnc = mnc;
 
 	/* Network changed, update reference to current network */
-	tcs->network = 0;
-	for (int i = 0; i < tcdb->num_nets; i++) {
-		struct tetra_netinfo *network = &tcdb->nets[i];
-		if (network->mnc == tcs->mnc && network->mcc == tcs->mcc) {
-			tcs->network = network;
-			break;
-		}
-	}
+	tcs->network = tcs->db ? get_network_info(tcs->db, mcc, mnc) : 0;
 
 	/* (Try to) select new CCK/SCK */
 	update_current_cck(tcs);
@@ -465,27 +852,27 @@ void update_current_network(struct tetra_crypto_state *tcs, int mcc, int mnc)
 
 void update_current_cck(struct tetra_crypto_state *tcs)
 {
+	struct tetra_crypto_database *db = tcs->db;
+	struct tetra_crypto_index *ix;
+	uint32_t slot;
+
 	// printf("\ntetra_crypto: update_current_cck invoked cck %d mcc %d mnc %d\n", tcs->cck_id, tcs->mcc, tcs->mnc);
 	tcs->cck = 0;
-
-	for (int i = 0; i < tcdb->num_keys; i++) {
-		struct tetra_key *key = &tcdb->keys[i];
-		/* TODO FIXME consider selecting CCK or SCK key type based on network config */
-		if (key->mcc == tcs->mcc && key->mnc == tcs->mnc && key->key_num == tcs->cck_id) {
-			if (key->key_type == KEYTYPE_CCK_SCK) {
-				tcs->cck = key;
-				// printf("tetra_crypto: Set new current_cck %d (type: full)\n", i);
-				break;
-			}
-		}
-	}
+	if (!db)
+		return;
+
+	/* TODO FIXME consider selecting CCK or SCK key type based on network config */
+	ix = &db->cck_index;
+	slot = INDEX_PROBE(ix, cck_hash(tcs->mcc, tcs->mnc, tcs->cck_id),
+		cck_match(db, ix->slots[_slot], tcs->mcc, tcs->mnc, tcs->cck_id));
+	if (ix->slots[slot] >= 0)
+		tcs->cck = &db->keys[ix->slots[slot]];
 }
 
-struct tetra_netinfo *get_network_info(int mcc, int mnc)
+struct tetra_netinfo *get_network_info(struct tetra_crypto_database *db, int mcc, int mnc)
 {
-	for (int i = 0; i < tcdb->num_nets; i++) {
-		if (tcdb->nets[i].mcc == mcc && tcdb->nets[i].mnc == mnc)
-			return &tcdb->nets[i];
-	}
-	return 0;
+	struct tetra_crypto_index *ix = &db->net_index;
+	uint32_t slot = INDEX_PROBE(ix, net_hash(mcc, mnc), net_match(db, ix->slots[_slot], mcc, mnc));
+
+	return ix->slots[slot] >= 0 ? &db->nets[ix->slots[slot]] : 0;
 }
@@ -34,6 +34,18 @@
 
 #define TCDB_ALLOC_BLOCK_SIZE 16
 
+struct tetra_ks_sched;
+
+/* ECKs and keystreams kept per decoder, see generate_keystream() */
+#define TETRA_ECK_CACHE_SIZE	4
+#define TETRA_KS_CACHE_SIZE	8
+/* longest keystream one call needs: 216 bits skipped for the 2nd half slot, then a full slot */
+#define TETRA_KS_MAX_BYTES	((216 + 432 + 7) / 8)
+/* keystream generated ahead of time, enough for a voice slot or two half slots */
+#define TETRA_KS_SLOT_BYTES	(432 / 8)
+/* the 2 x 137 type-1 bits of both speech frames of a voice slot */
+#define TETRA_KS_VOICE_BYTES	((2 * 137 + 7) / 8)
+
 enum tetra_key_type {
 	KEYTYPE_UNDEFINED		= 0,
 
@@ -81,14 +93,40 @@ struct tetra_key {
 	struct tetra_netinfo *network_info;	/* Network with which the key is associated */
 };
 
+/* Open addressing hash table of entry indices */
+struct tetra_crypto_index {
+	uint32_t mask;				/* slot count - 1, the count is a power of two */
+	int32_t *slots;				/* index into keys / nets, -1 = empty */
+};
+
+/* One loaded keystore. A snapshot never changes once published, a reload
+ * builds a new one and swaps it in; every decoder moves over on its next
+ * tetra_crypto_refresh() and the old one is freed with its last user */
 struct tetra_crypto_database {
 	uint32_t num_keys;
 	struct tetra_key *keys;
 	uint32_t num_nets;
 	struct tetra_netinfo *nets;
-	int nets_cnt;
+	struct tetra_crypto_index net_index;	/* (mcc, mnc) */
+	struct tetra_crypto_index cck_index;	/* (mcc, mnc, key_num) of CCK/SCK keys */
+	struct tetra_crypto_index addr_index;	/* (mcc, mnc, addr), every key of an address */
+	int refs;				/* decoders using it, plus one while it's the current one */
+};
+
+struct tetra_eck_entry {
+	struct tetra_key *key;
+	uint8_t ck[10];			/* key contents the ECK was derived from */
+	int cn, la, cc;
+	uint8_t eck[10];
+};
+
+struct tetra_ks_entry {
+	uint32_t iv;
+	enum tetra_ksg_type ksg_type;
+	uint8_t eck[10];
+	uint32_t num_bytes;		/* 0 = unused */
+	uint8_t ks[TETRA_KS_MAX_BYTES];
 };
-extern struct tetra_crypto_database *tcdb;
 
 struct tetra_crypto_state {
 	int mnc;			/* Network info for selecting keys */
@@ -98,8 +136,20 @@ struct tetra_crypto_state {
 	int la;				/* location area for TB5 */
 	int cn;				/* carrier number for TB5. WARNING: only set correctly if tuned to main control channel */
 	int cc;				/* colour code for TB5 */
+	struct tetra_crypto_database *db;	/* keystore snapshot the pointers below point into */
+	struct tetra_crypto_database *prev_db;	/* during a refresh, the snapshot it replaces */
 	struct tetra_netinfo *network;	/* pointer to network info struct loaded from file */
 	struct tetra_key *cck;		/* pointer to CCK or SCK for this network and version (from SYSINFO) */
+
+	/* TB5 output per key and cell, most recently used first */
+	struct tetra_eck_entry eck_cache[TETRA_ECK_CACHE_SIZE];
+	int eck_cache_len;
+	/* keystream per IV and ECK, replaced round robin */
+	struct tetra_ks_entry ks_cache[TETRA_KS_CACHE_SIZE];
+	unsigned int ks_cache_next;
+	bool precompute;		/* after each decryption, generate the keystream of the same timeslot in the next frame */
+	struct tetra_eck_entry voice_eck;	/* TB5 output of the voice path, see tetra_crypto_voice_keystream(). key is unused */
+	struct tetra_ks_sched *sched;	/* voice keystream made ahead on another thread, see tetra_ks_sched.h. NULL = off */
 };
 
 const char *tetra_get_key_type_name(enum tetra_key_type);
@@ -108,16 +158,42 @@ const char *tetra_get_security_class_name(uint8_t pdut);
 
 /* Key loading / unloading */
 void tetra_crypto_state_init(struct tetra_crypto_state *tcs);
+void tetra_crypto_state_deinit(struct tetra_crypto_state *tcs);
+/* Parse a keystore and make it the current one, from any thread and while
+ * decoders run. On error the current keystore stays, returns -1 */
 int load_keystore(char *filename);
 
+/* Move tcs to the current keystore if it changed, returns true if it did. Key
+ * pointers kept elsewhere then have to be passed through
+ * tetra_crypto_rebind_key() before tetra_crypto_refresh_done() */
+bool tetra_crypto_refresh(struct tetra_crypto_state *tcs);
+struct tetra_key *tetra_crypto_rebind_key(struct tetra_crypto_state *tcs, struct tetra_key *key);
+void tetra_crypto_refresh_done(struct tetra_crypto_state *tcs);
+bool tetra_crypto_have_keys(struct tetra_crypto_state *tcs);
+
 /* Keystream generation and decryption functions */
 uint32_t tea_build_iv(struct tetra_tdma_time *tm, uint16_t hn, uint8_t dir);
 bool decrypt_identity(struct tetra_crypto_state *tcs, struct tetra_addr *addr);
 bool decrypt_mac_element(struct tetra_crypto_state *tcs, struct tetra_tmvsap_prim *tmvp, struct tetra_key *key, int l1_len, int tmpdu_offset);
 bool decrypt_voice_timeslot(struct tetra_crypto_state *tcs, struct tetra_tdma_time *tdma_time, int16_t *type1_bits);
+void tetra_crypto_precompute(struct tetra_crypto_state *tcs, struct tetra_key *key, struct tetra_tdma_time *tdma_time, uint16_t hn);
+/* Voice key of a call with key (NULL if none is loaded) and the cell data of
+ * tcs, on the thread of the upper MAC */
+void tetra_crypto_voice_key(struct tetra_crypto_state *tcs, bool encrypted, struct tetra_key *key, struct tetra_voice_key *vk);
+/* Keystream of the 2 x 137 type-1 bits of the voice slot at tdma_time with
+ * vk into ks (TETRA_KS_VOICE_BYTES), from the scheduler where it has it.
+ * false without a key, the cell data for TB5 or with an unsupported KSG.
+ * Only touches voice_eck and the scheduler of tcs, so the lower MAC can
+ * ask while the upper MAC decrypts or reloads the keystore on another thread */
+bool tetra_crypto_voice_keystream(struct tetra_crypto_state *tcs, const struct tetra_voice_key *vk, struct tetra_tdma_time *tdma_time, uint8_t *ks);
+/* Voice keystream from a scheduler (see tetra_ks_sched.h) that a producer
+ * fills, returned, or NULL when turned off or out of memory. Not while the
+ * decoder runs, and the producer has to be done with it before it is turned
+ * off. tetra_crypto_state_deinit() turns it off */
+struct tetra_ks_sched *tetra_crypto_set_scheduled(struct tetra_crypto_state *tcs, bool on);
 
 /* Key selection and crypto state management */
-struct tetra_netinfo *get_network_info(int mcc, int mnc);
+struct tetra_netinfo *get_network_info(struct tetra_crypto_database *db, int mcc, int mnc);
 struct tetra_key *get_ksg_key(struct tetra_crypto_state *tcs, int addr);
 void update_current_network(struct tetra_crypto_state *tcs, int mcc, int mnc);
 void update_current_cck(struct tetra_crypto_state *tcs);
@@ -0,0 +1,204 @@
+/* Keystream of followed encrypted calls, generated ahead of time */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetra_ks_sched.h"
+#include "tea1.h"
+#include "tea1_bs.h"
+#include "tea2.h"
+#include "tea3.h"
+
+/* a keystream to make, and where it goes */
+struct ks_job {
+	struct tetra_ks_sched *s;
+	unsigned int tn;
+	unsigned int pos;
+	uint32_t gen;
+	uint32_t iv;
+	enum tetra_ksg_type ksg_type;
+	uint8_t eck[10];
+};
+
+static inline unsigned int ring_pos(const struct tetra_tdma_time *t)
+{
+	return ((t->mn - 1) * 18 + (t->fn - 1)) % TETRA_KS_AHEAD_FRAMES;
+}
+
+struct tetra_ks_sched *tetra_ks_sched_alloc(void)
+{
+	struct tetra_ks_sched *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return NULL;
+	pthread_mutex_init(&s->lock, NULL);
+	return s;
+}
+
+void tetra_ks_sched_free(struct tetra_ks_sched *s)
+{
+	if (!s)
+		return;
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+bool tetra_ks_sched_take(struct tetra_ks_sched *s, const struct tetra_tdma_time *t, uint16_t hn,
+			 enum tetra_ksg_type ksg_type, const uint8_t *eck, uint8_t *ks)
+{
+	struct tetra_ks_sched_slot *ts;
+	struct tetra_ks_ahead *e;
+	uint32_t iv;
+	bool hit;
+
+	if (t->tn < 1 || t->tn > 4)
+		return false;
+	iv = tea_build_iv((struct tetra_tdma_time *)t, hn, 0);
+	ts = &s->ts[t->tn - 1];
+
+	pthread_mutex_lock(&s->lock);
+	if (!ts->gen || ts->ksg_type != ksg_type || memcmp(ts->eck, eck, sizeof(ts->eck))) {
+		/* a new call or a new key, what is in the ring is of no use */
+		if (!++s->next_gen)
+			s->next_gen = 1;
+		ts->gen = s->next_gen;
+		ts->ksg_type = ksg_type;
+		memcpy(ts->eck, eck, sizeof(ts->eck));
+	}
+	e = &ts->ring[ring_pos(t)];
+	hit = e->gen == ts->gen && e->iv == iv;
+	if (hit)
+		memcpy(ks, e->ks, TETRA_KS_VOICE_BYTES);
+	ts->last = *t;
+	ts->last_hn = hn;
+	pthread_mutex_unlock(&s->lock);
+
+	if (hit)
+		__atomic_store_n(&s->hits, s->hits + 1, __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(&s->misses, s->misses + 1, __ATOMIC_RELAXED);
+	return hit;
+}
+
+/* the voice slots ahead of one timeslot that are missing, called locked */
+static unsigned int collect_jobs(struct tetra_ks_sched *s, unsigned int tn, struct ks_job *jobs)
+{
+	struct tetra_ks_sched_slot *ts = &s->ts[tn - 1];
+	struct tetra_tdma_time t = ts->last;
+	uint16_t hn = ts->last_hn;
+	unsigned int k, n = 0;
+
+	if (!ts->gen)
+		return 0;
+	for (k = 0; k < TETRA_KS_AHEAD_FRAMES; k++) {
+		uint8_t mn = t.mn;
+		struct tetra_ks_ahead *e;
+		uint32_t iv;
+
+		/* the hyperframe number goes up with the wrap of the multiframe */
+		tetra_tdma_time_add_fn(&t, 1);
+		if (t.mn < mn)
+			hn++;
+		/* frame 18 is control, it has no voice */
+		if (t.fn == 18)
+			continue;
+		iv = tea_build_iv(&t, hn, 0);
+		e = &ts->ring[ring_pos(&t)];
+		if (e->gen == ts->gen && e->iv == iv)
+			continue;
+		jobs[n].s = s;
+		jobs[n].tn = tn;
+		jobs[n].pos = ring_pos(&t);
+		jobs[n].gen = ts->gen;
+		jobs[n].iv = iv;
+		jobs[n].ksg_type = ts->ksg_type;
+		memcpy(jobs[n].eck, ts->eck, sizeof(jobs[n].eck));
+		n++;
+	}
+	return n;
+}
+
+unsigned int tetra_ks_sched_fill(struct tetra_ks_sched *const *scheds, unsigned int count)
+{
+	struct ks_job *jobs;
+	uint32_t *tea1_ivs;
+	uint8_t *tea1_keys, *ks;
+	unsigned int i, tn, n = 0, n_tea1 = 0;
+
+	if (!count)
+		return 0;
+	jobs = malloc(count * 4 * TETRA_KS_AHEAD_FRAMES * sizeof(*jobs));
+	ks = malloc(count * 4 * TETRA_KS_AHEAD_FRAMES * TETRA_KS_VOICE_BYTES);
+	tea1_ivs = malloc(count * 4 * TETRA_KS_AHEAD_FRAMES * sizeof(*tea1_ivs));
+	tea1_keys = malloc(count * 4 * TETRA_KS_AHEAD_FRAMES * 10);
+	if (!jobs || !ks || !tea1_ivs || !tea1_keys)
+		goto out;
+
+	for (i = 0; i < count; i++) {
+		pthread_mutex_lock(&scheds[i]->lock);
+		for (tn = 1; tn <= 4; tn++)
+			n += collect_jobs(scheds[i], tn, &jobs[n]);
+		pthread_mutex_unlock(&scheds[i]->lock);
+	}
+	if (!n)
+		goto out;
+
+	/* TEA1 first, in front of the others, so its keystreams are contiguous for the batch */
+	for (i = 0; i < n; i++) {
+		if (jobs[i].ksg_type != KSG_TEA1)
+			continue;
+		struct ks_job j = jobs[i];
+		jobs[i] = jobs[n_tea1];
+		jobs[n_tea1] = j;
+		tea1_ivs[n_tea1] = j.iv;
+		memcpy(&tea1_keys[n_tea1 * 10], j.eck, 10);
+		n_tea1++;
+	}
+	if (n_tea1 >= TETRA_KS_BATCH_MIN) {
+		tea1_batch(n_tea1, tea1_ivs, tea1_keys, TETRA_KS_VOICE_BYTES, ks);
+	} else {
+		for (i = 0; i < n_tea1; i++)
+			tea1(jobs[i].iv, jobs[i].eck, TETRA_KS_VOICE_BYTES, &ks[i * TETRA_KS_VOICE_BYTES]);
+	}
+	for (i = n_tea1; i < n; i++) {
+		if (jobs[i].ksg_type == KSG_TEA2)
+			tea2(jobs[i].iv, jobs[i].eck, TETRA_KS_VOICE_BYTES, &ks[i * TETRA_KS_VOICE_BYTES]);
+		else
+			tea3(jobs[i].iv, jobs[i].eck, TETRA_KS_VOICE_BYTES, &ks[i * TETRA_KS_VOICE_BYTES]);
+	}
+
+	/* a timeslot that moved on to another key in the meantime does not take them */
+	for (i = 0; i < n; i++) {
+		struct tetra_ks_sched *s = jobs[i].s;
+		struct tetra_ks_sched_slot *ts = &s->ts[jobs[i].tn - 1];
+		struct tetra_ks_ahead *e = &ts->ring[jobs[i].pos];
+
+		pthread_mutex_lock(&s->lock);
+		if (ts->gen == jobs[i].gen) {
+			e->iv = jobs[i].iv;
+			e->gen = jobs[i].gen;
+			memcpy(e->ks, &ks[i * TETRA_KS_VOICE_BYTES], TETRA_KS_VOICE_BYTES);
+		}
+		pthread_mutex_unlock(&s->lock);
+		__atomic_store_n(&s->generated, s->generated + 1, __ATOMIC_RELAXED);
+	}
+
+out:
+	free(jobs);
+	free(ks);
+	free(tea1_ivs);
+	free(tea1_keys);
+	return n;
+}
@@ -0,0 +1,70 @@
+#ifndef TETRA_KS_SCHED_H
+#define TETRA_KS_SCHED_H
+
+/* Keystream of followed encrypted calls, generated ahead of time
+ *
+ * Every voice slot decrypted on a timeslot tells the scheduler its time and
+ * key, and a producer on another thread (tetra_ks_sched_fill) generates the
+ * keystream of the voice slots in the TETRA_KS_AHEAD_FRAMES after it into a
+ * ring of the timeslot. The voice path then only copies and applies it, and
+ * falls back to generating its own where the producer fell behind */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../tetra_tdma.h"
+#include "tetra_crypto.h"
+
+/* frames the ring of a timeslot runs ahead of its last voice slot, two
+ * multiframes. Divides the 1080 frames of a hyperframe, so the place of a
+ * slot in the ring is its frame number modulo this */
+#define TETRA_KS_AHEAD_FRAMES	36
+/* fewer TEA1 keystreams than this in a round are generated one by one, more
+ * go through the bit-sliced tea1_batch() */
+#define TETRA_KS_BATCH_MIN	16
+
+struct tetra_ks_ahead {
+	uint32_t iv;
+	uint32_t gen;			/* key generation it was made with, 0 = empty */
+	uint8_t ks[TETRA_KS_VOICE_BYTES];
+};
+
+struct tetra_ks_sched_slot {
+	uint32_t gen;			/* goes up with every new key, 0 until the first voice slot */
+	enum tetra_ksg_type ksg_type;
+	uint8_t eck[10];
+	struct tetra_tdma_time last;	/* the last voice slot decrypted, the ring runs ahead of it */
+	uint16_t last_hn;
+	struct tetra_ks_ahead ring[TETRA_KS_AHEAD_FRAMES];
+};
+
+/* One decoder's timeslots. Shared by its decoder thread and the producer */
+struct tetra_ks_sched {
+	pthread_mutex_t lock;
+	struct tetra_ks_sched_slot ts[4];
+	uint32_t next_gen;
+	/* readable from any thread with __atomic_load_n */
+	uint64_t hits;			/* voice slots decrypted from the ring */
+	uint64_t misses;		/* ... that had to generate their own keystream */
+	uint64_t generated;		/* keystreams the producer made */
+};
+
+struct tetra_ks_sched *tetra_ks_sched_alloc(void);
+void tetra_ks_sched_free(struct tetra_ks_sched *s);
+
+/* The voice path, for the slot at t in hyperframe hn with key eck: copies its
+ * keystream to ks (TETRA_KS_VOICE_BYTES) and returns true if the producer
+ * made it. Either way the ring of the timeslot moves on to t, a different key
+ * starts it over */
+bool tetra_ks_sched_take(struct tetra_ks_sched *s, const struct tetra_tdma_time *t, uint16_t hn,
+			 enum tetra_ksg_type ksg_type, const uint8_t *eck, uint8_t *ks);
+
+/* The producer: one round over count schedulers, generating the keystream
+ * of every voice slot ahead of their timeslots that is not in the ring yet.
+ * The TEA1 ones of all schedulers go through the bit-sliced generator
+ * together. The locks are only held to look and to store, not while the
+ * keystream is generated. Returns how many were made */
+unsigned int tetra_ks_sched_fill(struct tetra_ks_sched *const *scheds, unsigned int count);
+
+#endif /* TETRA_KS_SCHED_H */
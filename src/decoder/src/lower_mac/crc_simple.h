@@ -42,6 +42,13 @@ uint16_t crc16_itut_bytes(uint16_t crc,
 uint16_t crc16_itut_bits(uint16_t crc,
 			 const uint8_t *input, const int number_bits);
 
+/**
+ * Packed 64 bits per word, first bit in the MSB of the first word (see
+ * tetra_pbits.h). Table driven, slicing by eight over every full word.
+ */
+uint16_t crc16_itut_pwords(uint16_t crc,
+			   const uint64_t *input, const int number_bits);
+
 
 uint16_t crc16_ccitt_bits(uint8_t *bits, unsigned int len);
 
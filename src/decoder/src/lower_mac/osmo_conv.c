@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
 
 
 /* ------------------------------------------------------------------------ */
@@ -30,7 +31,7 @@
 	vdec_free = &osmo_conv_##simd##_vdec_free; \
 }
 
-static int init_complete = 0;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
 
 /**
  * These pointers are being initialized at runtime by the
@@ -137,8 +138,7 @@ static void gen_path_metrics(int num_states, int16_t *sums,
 {
 	int i;
 	int16_t min;
-	// int16_t new_sums[num_states];
-	int16_t* new_sums = malloc(2*num_states);
+	int16_t new_sums[64];	/* NUM_STATES(7) */
 
 	for (i = 0; i < num_states / 2; i++)
 		acs_butterfly(i, num_states, metrics[i],
@@ -156,7 +156,6 @@ static void gen_path_metrics(int num_states, int16_t *sums,
 	}
 
 	memcpy(sums, new_sums, num_states * sizeof(int16_t));
-	free(new_sums);
 }
 
 /* Not-aligned Memory Allocator */
@@ -475,6 +474,20 @@ static void free_trellis(struct vtrellis *trellis)
 	free(trellis->vals);
 }
 
+/* Set the accumulated path metrics back to their start values
+ * For termination other than tail-biting, initialize the zero state
+ * as the encoder starting state. Initialize with the maximum
+ * accumulated sum at length equal to the constraint length.
+ */
+static void reset_trellis_sums(struct vtrellis *trellis,
+	const struct osmo_conv_code *code)
+{
+	memset(trellis->sums, 0, trellis->num_states * sizeof(int16_t));
+
+	if (code->term != CONV_TERM_TAIL_BITING)
+		trellis->sums[0] = INT8_MAX * code->N * code->K;
+}
+
 /* Initialize the trellis object
  * Initialization consists of generating the outputs and output value of a
  * given state. Due to trellis symmetry and anti-symmetry, only one of the
@@ -501,6 +514,9 @@ static int generate_trellis(struct vdecoder *dec,
 		goto fail;
 	}
 
+	/* N=3 leaves every 4th output unused, SIMD units still load it */
+	memset(trellis->outputs, 0, ns * olen * sizeof(int16_t));
+
 	/* Populate the trellis state objects */
 	for (i = 0; i < ns; i++) {
 		outputs = &trellis->outputs[olen * i];
@@ -514,18 +530,9 @@ static int generate_trellis(struct vdecoder *dec,
 
 		if (rc < 0)
 			goto fail;
-
-		/* Set accumulated path metrics to zero */
-		trellis->sums[i] = 0;
 	}
 
-	/**
-	 * For termination other than tail-biting, initialize the zero state
-	 * as the encoder starting state. Initialize with the maximum
-	 * accumulated sum at length equal to the constraint length.
-	 */
-	if (code->term != CONV_TERM_TAIL_BITING)
-		trellis->sums[0] = INT8_MAX * code->N * code->K;
+	reset_trellis_sums(trellis, code);
 
 	return 0;
 
@@ -740,14 +747,12 @@ static void forward_traverse(struct vdecoder *dec, const int8_t *seq)
 /* Convolutional decode with a decoder object
  * Initial puncturing run if necessary followed by the forward recursion.
  * For tail-biting perform a second pass before running the backward
- * traceback operation.
+ * traceback operation. depunc must hold dec->len * dec->n soft bits when
+ * punc is set, it is not used otherwise.
  */
 static int conv_decode(struct vdecoder *dec, const int8_t *seq,
-	const int *punc, uint8_t *out, int len, int term)
+	const int *punc, int8_t *depunc, uint8_t *out, int len, int term)
 {
-	int8_t* depunc = malloc(dec->len * dec->n);
-	// int8_t depunc[dec->len * dec->n];
-
 	if (punc) {
 		depuncture(seq, punc, depunc, dec->len * dec->n);
 		seq = depunc;
@@ -759,13 +764,21 @@ static int conv_decode(struct vdecoder *dec, const int8_t *seq,
 	if (term == CONV_TERM_TAIL_BITING)
 		forward_traverse(dec, seq);
 
-	free(depunc);
 	return traceback(dec, out, term, len);
 }
 
 static void osmo_conv_init(void)
 {
-	init_complete = 1;
+#ifdef OSMO_CONV_HAVE_SSE
+	if (__builtin_cpu_supports("ssse3")) {
+		INIT_POINTERS(sse);
+		return;
+	}
+#endif
+#ifdef OSMO_CONV_HAVE_NEON
+	INIT_POINTERS(neon);
+	return;
+#endif
 	INIT_POINTERS(gen);
 }
 
@@ -776,9 +789,9 @@ int osmo_conv_decode_acc(const struct osmo_conv_code *code,
 {
 	int rc;
 	struct vdecoder dec;
+	int8_t *depunc = NULL;
 
-	if (!init_complete)
-		osmo_conv_init();
+	pthread_once(&init_once, osmo_conv_init);
 
 	if ((code->N < 2) || (code->N > 4) || (code->len < 1) ||
 		((code->K != 5) && (code->K != 7)))
@@ -788,14 +801,82 @@ int osmo_conv_decode_acc(const struct osmo_conv_code *code,
 	if (rc)
 		return rc;
 
-	rc = conv_decode(&dec, input, code->puncture,
+	if (code->puncture) {
+		depunc = malloc(dec.len * dec.n);
+		if (!depunc) {
+			vdec_deinit(&dec);
+			return -ENOMEM;
+		}
+	}
+
+	rc = conv_decode(&dec, input, code->puncture, depunc,
 		output, code->len, code->term);
 
+	free(depunc);
 	vdec_deinit(&dec);
 
 	return rc;
 }
 
+/* Persistent decoder: trellis, path metrics and depuncture workspace are
+ * built once for a given code and length and reused for every block */
+struct osmo_conv_vdec {
+	struct osmo_conv_code code;
+	struct vdecoder dec;
+	int8_t *depunc;
+};
+
+struct osmo_conv_vdec *osmo_conv_vdec_create(const struct osmo_conv_code *code)
+{
+	struct osmo_conv_vdec *vdec;
+
+	pthread_once(&init_once, osmo_conv_init);
+
+	if ((code->N < 2) || (code->N > 4) || (code->len < 1) ||
+		((code->K != 5) && (code->K != 7)))
+		return NULL;
+
+	vdec = calloc(1, sizeof(struct osmo_conv_vdec));
+	if (!vdec)
+		return NULL;
+
+	memcpy(&vdec->code, code, sizeof(struct osmo_conv_code));
+
+	if (vdec_init(&vdec->dec, &vdec->code)) {
+		free(vdec);
+		return NULL;
+	}
+
+	if (code->puncture) {
+		vdec->depunc = malloc(vdec->dec.len * vdec->dec.n);
+		if (!vdec->depunc) {
+			osmo_conv_vdec_destroy(vdec);
+			return NULL;
+		}
+	}
+
+	return vdec;
+}
+
+int osmo_conv_vdec_run(struct osmo_conv_vdec *vdec,
+	const sbit_t *input, ubit_t *output)
+{
+	reset_trellis_sums(&vdec->dec.trellis, &vdec->code);
+
+	return conv_decode(&vdec->dec, input, vdec->code.puncture,
+		vdec->depunc, output, vdec->code.len, vdec->code.term);
+}
+
+void osmo_conv_vdec_destroy(struct osmo_conv_vdec *vdec)
+{
+	if (!vdec)
+		return;
+
+	vdec_deinit(&vdec->dec);
+	free(vdec->depunc);
+	free(vdec);
+}
+
 
 void
 osmo_conv_decode_init(struct osmo_conv_decoder *decoder,
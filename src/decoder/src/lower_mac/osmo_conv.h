@@ -1,9 +1,37 @@
 #pragma once
 #include <stdint.h>
 
+#include <stddef.h>
+
 typedef int8_t  sbit_t;
 typedef uint8_t ubit_t;
 
+/* SIMD variants of the Viterbi metric units, picked at runtime by osmo_conv_init() */
+#if defined(__x86_64__) || defined(__i386__)
+#define OSMO_CONV_HAVE_SSE 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OSMO_CONV_HAVE_NEON 1
+#endif
+
+#define OSMO_CONV_DECLARE_METRICS(simd) \
+	void osmo_conv_##simd##_metrics_k5_n2(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	void osmo_conv_##simd##_metrics_k5_n3(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	void osmo_conv_##simd##_metrics_k5_n4(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	void osmo_conv_##simd##_metrics_k7_n2(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	void osmo_conv_##simd##_metrics_k7_n3(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	void osmo_conv_##simd##_metrics_k7_n4(const int8_t *seq, const int16_t *out, int16_t *sums, int16_t *paths, int norm); \
+	int16_t *osmo_conv_##simd##_vdec_malloc(size_t n); \
+	void osmo_conv_##simd##_vdec_free(int16_t *ptr);
+
+OSMO_CONV_DECLARE_METRICS(gen)
+#ifdef OSMO_CONV_HAVE_SSE
+OSMO_CONV_DECLARE_METRICS(sse)
+#endif
+#ifdef OSMO_CONV_HAVE_NEON
+OSMO_CONV_DECLARE_METRICS(neon)
+#endif
+
 /*! possibe termination types
  *
  *  The termination type will determine which state the encoder/decoder
@@ -75,3 +103,11 @@ int osmo_conv_decode_get_output(struct osmo_conv_decoder *decoder,
 	/* All-in-one */
 int osmo_conv_decode(const struct osmo_conv_code *code,
                      const sbit_t *input, ubit_t *output);
+
+	/* Persistent decoder, no allocations per block */
+struct osmo_conv_vdec;
+
+struct osmo_conv_vdec *osmo_conv_vdec_create(const struct osmo_conv_code *code);
+int osmo_conv_vdec_run(struct osmo_conv_vdec *vdec,
+                       const sbit_t *input, ubit_t *output);
+void osmo_conv_vdec_destroy(struct osmo_conv_vdec *vdec);
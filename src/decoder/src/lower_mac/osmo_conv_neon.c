@@ -0,0 +1,131 @@
+/* NEON accelerated ACS butterflies for the 16-state (K=5) Viterbi decoder */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "osmo_conv.h"
+
+#ifdef OSMO_CONV_HAVE_NEON
+
+#include <stdlib.h>
+#include <arm_neon.h>
+
+/* 8 butterflies of the 16-state trellis, same semantics as acs_butterfly():
+ * path selections are -1 when the '0' predecessor wins, 0 otherwise */
+static inline void neon_acs_k5(int16x8_t metrics, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	/* vld2 deinterleaves straight into the even and odd states */
+	int16x8x2_t s = vld2q_s16(sums);
+
+	int16x8_t sum0 = vqaddq_s16(s.val[0], metrics);
+	int16x8_t sum1 = vqsubq_s16(s.val[1], metrics);
+	int16x8_t sum2 = vqsubq_s16(s.val[0], metrics);
+	int16x8_t sum3 = vqaddq_s16(s.val[1], metrics);
+
+	int16x8_t new_lo = vmaxq_s16(sum0, sum1);
+	int16x8_t new_hi = vmaxq_s16(sum2, sum3);
+
+	vst1q_s16(&paths[0], vreinterpretq_s16_u16(vceqq_s16(new_lo, sum0)));
+	vst1q_s16(&paths[8], vreinterpretq_s16_u16(vceqq_s16(new_hi, sum2)));
+
+	if (norm) {
+		int16x4_t m = vmin_s16(vget_low_s16(new_lo), vget_high_s16(new_lo));
+		m = vmin_s16(m, vmin_s16(vget_low_s16(new_hi), vget_high_s16(new_hi)));
+		m = vpmin_s16(m, m);
+		m = vpmin_s16(m, m);
+		int16x8_t min = vdupq_lane_s16(m, 0);
+		new_lo = vqsubq_s16(new_lo, min);
+		new_hi = vqsubq_s16(new_hi, min);
+	}
+
+	vst1q_s16(&sums[0], new_lo);
+	vst1q_s16(&sums[8], new_hi);
+}
+
+/* Branch metrics for the 8 butterflies; trellis outputs have a stride of
+ * 2 (N=2) or 4 (N=3, N=4) values per state */
+static inline int16x8_t neon_branch_metrics(const int8_t *seq,
+	const int16_t *out, int n)
+{
+	int16_t m[8];
+	int i;
+
+	if (n == 2) {
+		int16x8x2_t o = vld2q_s16(out);
+		return vaddq_s16(vmulq_n_s16(o.val[0], seq[0]), vmulq_n_s16(o.val[1], seq[1]));
+	}
+
+	for (i = 0; i < 8; i++) {
+		m[i] = seq[0] * out[4 * i + 0] + seq[1] * out[4 * i + 1] +
+			seq[2] * out[4 * i + 2];
+		if (n == 4)
+			m[i] += seq[3] * out[4 * i + 3];
+	}
+	return vld1q_s16(m);
+}
+
+void osmo_conv_neon_metrics_k5_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	neon_acs_k5(neon_branch_metrics(seq, out, 2), sums, paths, norm);
+}
+
+void osmo_conv_neon_metrics_k5_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	neon_acs_k5(neon_branch_metrics(seq, out, 3), sums, paths, norm);
+}
+
+void osmo_conv_neon_metrics_k5_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	/* vld4 splits the four NRZ outputs of every state into separate lanes */
+	int16x8x4_t o = vld4q_s16(out);
+	int16x8_t m = vmulq_n_s16(o.val[0], seq[0]);
+	m = vmlaq_n_s16(m, o.val[1], seq[1]);
+	m = vmlaq_n_s16(m, o.val[2], seq[2]);
+	m = vmlaq_n_s16(m, o.val[3], seq[3]);
+
+	neon_acs_k5(m, sums, paths, norm);
+}
+
+/* TETRA only uses K=5 codes, the 64-state ones stay on the generic units */
+void osmo_conv_neon_metrics_k7_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n2(seq, out, sums, paths, norm);
+}
+
+void osmo_conv_neon_metrics_k7_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n3(seq, out, sums, paths, norm);
+}
+
+void osmo_conv_neon_metrics_k7_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n4(seq, out, sums, paths, norm);
+}
+
+int16_t *osmo_conv_neon_vdec_malloc(size_t n)
+{
+	return (int16_t *) malloc(sizeof(int16_t) * n);
+}
+
+void osmo_conv_neon_vdec_free(int16_t *ptr)
+{
+	free(ptr);
+}
+
+#endif /* OSMO_CONV_HAVE_NEON */
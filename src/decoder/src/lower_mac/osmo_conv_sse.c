@@ -0,0 +1,151 @@
+/* SSE accelerated ACS butterflies for the 16-state (K=5) Viterbi decoder */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "osmo_conv.h"
+
+#ifdef OSMO_CONV_HAVE_SSE
+
+#include <stdlib.h>
+#include <tmmintrin.h>
+
+#define SSE_TARGET __attribute__((target("ssse3")))
+
+/* Split 16 interleaved path metrics into the even (state 2i) and odd
+ * (state 2i+1) halves used by the butterflies. SSE2 only: sign-extend the
+ * low/high 16-bit half of every 32-bit lane and pack them back together */
+SSE_TARGET static inline void sse_deinterleave(__m128i lo, __m128i hi,
+	__m128i *even, __m128i *odd)
+{
+	*even = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16),
+		_mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+	*odd = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+}
+
+/* Broadcast the minimum of all 16-bit lanes */
+SSE_TARGET static inline __m128i sse_hmin(__m128i m)
+{
+	m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm_min_epi16(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+	m = _mm_min_epi16(m, _mm_shufflehi_epi16(_mm_shufflelo_epi16(m,
+		_MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)));
+	return m;
+}
+
+/* 8 butterflies of the 16-state trellis, same semantics as acs_butterfly():
+ * path selections are -1 when the '0' predecessor wins, 0 otherwise */
+SSE_TARGET static inline void sse_acs_k5(__m128i metrics, int16_t *sums,
+	int16_t *paths, int norm)
+{
+	__m128i s_even, s_odd, sum0, sum1, sum2, sum3, new_lo, new_hi;
+
+	sse_deinterleave(_mm_loadu_si128((const __m128i *) &sums[0]),
+		_mm_loadu_si128((const __m128i *) &sums[8]), &s_even, &s_odd);
+
+	sum0 = _mm_adds_epi16(s_even, metrics);
+	sum1 = _mm_subs_epi16(s_odd, metrics);
+	sum2 = _mm_subs_epi16(s_even, metrics);
+	sum3 = _mm_adds_epi16(s_odd, metrics);
+
+	new_lo = _mm_max_epi16(sum0, sum1);
+	new_hi = _mm_max_epi16(sum2, sum3);
+
+	_mm_storeu_si128((__m128i *) &paths[0], _mm_cmpeq_epi16(new_lo, sum0));
+	_mm_storeu_si128((__m128i *) &paths[8], _mm_cmpeq_epi16(new_hi, sum2));
+
+	if (norm) {
+		__m128i min = sse_hmin(_mm_min_epi16(new_lo, new_hi));
+		new_lo = _mm_subs_epi16(new_lo, min);
+		new_hi = _mm_subs_epi16(new_hi, min);
+	}
+
+	_mm_storeu_si128((__m128i *) &sums[0], new_lo);
+	_mm_storeu_si128((__m128i *) &sums[8], new_hi);
+}
+
+/* Branch metrics for the 8 butterflies. Trellis outputs are NRZ int16 with
+ * a stride of 2 (N=2) or 4 (N=3, N=4) values per state */
+SSE_TARGET static inline __m128i sse_branch_metrics_n2(const int8_t *seq,
+	const int16_t *out)
+{
+	__m128i s = _mm_set_epi16(seq[1], seq[0], seq[1], seq[0],
+		seq[1], seq[0], seq[1], seq[0]);
+	__m128i m0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[0]), s);
+	__m128i m1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[8]), s);
+
+	return _mm_packs_epi32(m0, m1);
+}
+
+SSE_TARGET static inline __m128i sse_branch_metrics_n4(const int8_t *seq,
+	const int16_t *out, int n)
+{
+	__m128i s = (n == 4) ?
+		_mm_set_epi16(seq[3], seq[2], seq[1], seq[0], seq[3], seq[2], seq[1], seq[0]) :
+		_mm_set_epi16(0, seq[2], seq[1], seq[0], 0, seq[2], seq[1], seq[0]);
+	__m128i m0 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[0]), s);
+	__m128i m1 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[8]), s);
+	__m128i m2 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[16]), s);
+	__m128i m3 = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) &out[24]), s);
+
+	return _mm_packs_epi32(_mm_hadd_epi32(m0, m1), _mm_hadd_epi32(m2, m3));
+}
+
+SSE_TARGET void osmo_conv_sse_metrics_k5_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	sse_acs_k5(sse_branch_metrics_n2(seq, out), sums, paths, norm);
+}
+
+SSE_TARGET void osmo_conv_sse_metrics_k5_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	sse_acs_k5(sse_branch_metrics_n4(seq, out, 3), sums, paths, norm);
+}
+
+SSE_TARGET void osmo_conv_sse_metrics_k5_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	sse_acs_k5(sse_branch_metrics_n4(seq, out, 4), sums, paths, norm);
+}
+
+/* TETRA only uses K=5 codes, the 64-state ones stay on the generic units */
+void osmo_conv_sse_metrics_k7_n2(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n2(seq, out, sums, paths, norm);
+}
+
+void osmo_conv_sse_metrics_k7_n3(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n3(seq, out, sums, paths, norm);
+}
+
+void osmo_conv_sse_metrics_k7_n4(const int8_t *seq, const int16_t *out,
+	int16_t *sums, int16_t *paths, int norm)
+{
+	osmo_conv_gen_metrics_k7_n4(seq, out, sums, paths, norm);
+}
+
+/* 16-byte aligned allocator, one trellis step is 16 int16 */
+int16_t *osmo_conv_sse_vdec_malloc(size_t n)
+{
+	return (int16_t *) _mm_malloc(sizeof(int16_t) * n, 16);
+}
+
+void osmo_conv_sse_vdec_free(int16_t *ptr)
+{
+	_mm_free(ptr);
+}
+
+#endif /* OSMO_CONV_HAVE_SSE */
@@ -250,6 +250,29 @@ int tetra_rcpc_depunct(enum tetra_rcpc_puncturer pu, const uint8_t *in, int len,
 	return 0;
 }
 
+/* Mother code position of each of the 'len' type-3 bits, what
+ * tetra_rcpc_depunct() does as an index map: out[j] = k */
+int tetra_rcpc_depunct_map(enum tetra_rcpc_puncturer pu, int len, uint16_t *out)
+{
+	const struct puncturer *punct;
+	uint32_t i, j;
+	uint8_t t;
+	const uint8_t *P;
+
+	if (pu >= ARRAY_SIZE(tetra_puncts))
+		return -EINVAL;
+
+	punct = tetra_puncts[pu];
+	t = punct->t;
+	P = punct->P;
+
+	for (j = 1; j <= len; j++) {
+		i = punct->i_func(j);
+		out[j-1] = punct->period * ((i-1)/t) + P[i - t*((i-1)/t)] - 1;
+	}
+	return 0;
+}
+
 struct punct_test_param {
 	uint16_t type2_len;
 	uint16_t type3_len;
@@ -30,6 +30,7 @@
 
 #include <tetra_common.h>
 
+#include <tetra_pbits.h>
 #include <lower_mac/tetra_interleave.h>
 
 /* Section 8.2.4.1 Block interleaving for phase modulation */
@@ -58,6 +59,28 @@ void block_deinterleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out)
 	}
 }
 
+/* Same permutation on packed bit strings (see tetra_pbits.h). (a * i) % K is
+ * stepped incrementally instead of taking a modulo per bit */
+void block_deinterleave_pwords(uint32_t K, uint32_t a, const uint64_t *in, uint64_t *out)
+{
+	uint32_t i, k = 0;
+	uint64_t acc = 0;
+
+	for (i = 0; i < K; i++) {
+		k += a;
+		if (k >= K)
+			k %= K;
+		acc = (acc << 1) | tetra_pwords_get(in, k);
+		if ((i & 63) == 63) {
+			out[i >> 6] = acc;
+			acc = 0;
+		}
+	}
+
+	if (K & 63)
+		out[K >> 6] = acc << (64 - (K & 63));
+}
+
 /* EN 300 395-2 Section 5.5.3 Matrix interleaving (voice */
 void matrix_interleave(uint32_t lines, uint32_t columns,
 			const uint8_t *in, uint8_t *out)
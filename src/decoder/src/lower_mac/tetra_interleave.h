@@ -8,6 +8,8 @@
 
 void block_interleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out);
 void block_deinterleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out);
+/* packed variant, in and out hold TETRA_PWORDS(K) words */
+void block_deinterleave_pwords(uint32_t K, uint32_t a, const uint64_t *in, uint64_t *out);
 
 void matrix_interleave(uint32_t lines, uint32_t columns,
 			const uint8_t *in, uint8_t *out);
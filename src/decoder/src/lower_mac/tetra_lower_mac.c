@@ -23,6 +23,7 @@
 #include <string.h>
 // #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 // #include <linux/limits.h>
 
 // #include <osmocom/core/utils.h>
@@ -31,19 +32,28 @@
 
 #include <tetra_common.h>
 #include <tetra_tdma.h>
+#include <tetra_events.h>
+#include <tetra_mac_pipe.h>
+#include <tetra_prof.h>
 #include <phy/tetra_burst.h>
 #include <phy/tetra_burst_sync.h>
+#include <phy/tetra_burst_archive.h>
 #include <lower_mac/crc_simple.h>
 #include <lower_mac/tetra_scramb.h>
 #include <lower_mac/tetra_interleave.h>
 #include <lower_mac/tetra_conv_enc.h>
+#include <lower_mac/tetra_rm3014.h>
 #include <tetra_prim.h>
 #include "tetra_upper_mac.h"
 #include <lower_mac/viterbi.h>
+#include <lower_mac/viterbi_list.h>
+#include <lower_mac/tetra_soft_gather.h>
 #include <crypto/tetra_crypto.h>
 
-#include "c-code/channel.h"
-#include "c-code/source.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#endif
 
 struct tetra_blk_param {
 	const char *name;
@@ -104,16 +114,43 @@ static const struct tetra_blk_param tetra_blk_param[] = {
 	},
 };
 
-struct tetra_cell_data {
-	uint16_t mcc;
-	uint16_t mnc;
-	uint8_t colour_code;
-	struct tetra_tdma_time time;
+/* The codec only runs for voice frames someone listens to and can make sense
+ * of: the timeslot is wanted (unless all are, only the active one is) and
+ * the call is in the clear or its key is loaded */
+static bool voice_frame_wanted(struct tetra_mac_state *tms, int tn, bool active, const struct tetra_voice_key *vk)
+{
+	uint8_t wanted = __atomic_load_n(&tms->voice_wanted, __ATOMIC_RELAXED);
+
+	if (!(wanted & (1 << (tn-1))))
+		return false;
+	if (!tms->voice_all_slots && !active)
+		return false;
+	if (vk->encrypted && !vk->have_key)
+		return false;
+	return true;
+}
 
-	uint32_t scramb_init;
-};
+/* Soft symbol gather tables of the interleaved block types, shared by all
+ * instances. They only depend on tetra_blk_param, a table that does not build
+ * is a mistake in it */
+static struct tetra_soft_gather soft_gather[ARRAY_SIZE(tetra_blk_param)];
+static pthread_once_t soft_gather_once = PTHREAD_ONCE_INIT;
 
-static struct tetra_cell_data _tcd, *tcd = &_tcd;
+static void soft_gather_init_once(void)
+{
+	int i, rc;
+
+	for (i = 0; i < ARRAY_SIZE(tetra_blk_param); i++) {
+		const struct tetra_blk_param *tbp = &tetra_blk_param[i];
+
+		if (!tbp->interleave_a)
+			continue;
+		rc = tetra_soft_gather_init(&soft_gather[i], tbp->type345_bits, tbp->interleave_a,
+					    TETRA_RCPC_PUNCT_2_3, tbp->type2_bits);
+		assert(rc == 0);
+		(void)rc;
+	}
+}
 
 int is_bsch(struct tetra_tdma_time *tm)
 {
@@ -129,14 +166,13 @@ int is_bnch(struct tetra_tdma_time *tm)
 	return 0;
 }
 
-struct tetra_tmvsap_prim *tmvsap_prim_alloc(uint16_t prim, uint8_t op)
+struct tetra_tmvsap_prim *tmvsap_prim_alloc(struct tetra_mac_state *tms, uint16_t prim, uint8_t op)
 {
 	struct tetra_tmvsap_prim *ttp;
 
 	// ttp = talloc_zero(NULL, struct tetra_tmvsap_prim);
-	ttp = malloc(sizeof(struct tetra_tmvsap_prim));
-	memset(ttp, 0, sizeof(struct tetra_tmvsap_prim));
-	ttp->oph.msg = msgb_alloc(412, "tmvsap_prim");
+	ttp = tetra_pool_alloc(&tms->prim_pool);
+	ttp->oph.msg = msgb_alloc_pool(&tms->msgb_pool, TMVSAP_MSGB_SIZE, "tmvsap_prim");
 	ttp->oph.sap = TETRA_SAP_TMV;
 	ttp->oph.primitive = prim;
 	ttp->oph.operation = op;
@@ -144,18 +180,135 @@ struct tetra_tmvsap_prim *tmvsap_prim_alloc(uint16_t prim, uint8_t op)
 	return ttp;
 }
 
+/* queue one record for the event consumer, silently lost if it falls behind */
+static void push_event(struct tetra_mac_state *tms, enum tetra_event_kind kind, enum tp_sap_data_type type,
+		       const struct tmv_unitdata_param *tup, unsigned int offset, unsigned int len)
+{
+	struct tetra_burst_event *ev = tetra_event_queue_reserve(tms->events);
+
+	if (!ev)
+		return;
+	if (len > TETRA_EVENT_MAX_BITS)
+		len = TETRA_EVENT_MAX_BITS;
+
+	ev->time = tup->tdma_time;
+	ev->scrambling_code = tup->scrambling_code;
+	ev->kind = kind;
+	ev->lchan = tup->lchan;
+	ev->blk_type = type;
+	ev->blk_num = tup->blk_num;
+	ev->crc_ok = tup->crc_ok;
+	ev->snr = tup->snr;
+	ev->offset = offset;
+	ev->len = len;
+	tetra_pwords_copy(ev->bits, 0, tup->pbits, offset, len);
+	tetra_event_queue_commit(tms->events);
+}
+
+/* Paths of the trellis after the Viterbi one, best first, until one passes
+ * the CRC or the budget of the carrier is spent. A block taken this way has
+ * had that many tries at the CRC, its false accept rate goes up with them */
+static bool list_decode(struct tetra_mac_state *tms, const struct tetra_blk_param *tbp,
+			const int8_t *vit_inp, uint8_t *type2)
+{
+	uint8_t cand[TETRA_VITERBI_LIST_MAX_SYMS];
+	struct tetra_viterbi_list *list;
+	int paths = tms->list_paths;
+	int rank;
+
+	if (tms->cell_data.time.fn != tms->list_fn) {
+		tms->list_fn = tms->cell_data.time.fn;
+		tms->list_tokens += tms->list_budget;
+		/* a few frames worth saved up for a burst of bad blocks */
+		if (tms->list_tokens > 4 * tms->list_budget)
+			tms->list_tokens = 4 * tms->list_budget;
+	}
+	if (paths > tms->list_tokens + 1)
+		paths = tms->list_tokens + 1;
+	if (paths < 2)
+		return false;
+
+	list = tetra_viterbi_cache_list(&tms->viterbi);
+	if (!list || viterbi_list_start(list, vit_inp, tbp->type2_bits, paths) < 0)
+		return false;
+	/* rank 0 is the Viterbi path, which already failed */
+	while ((rank = viterbi_list_next(list, cand)) >= 0) {
+		if (rank == 0)
+			continue;
+		tms->list_tokens--;
+		if (crc16_ccitt_bits(cand, tbp->type1_bits + 16) == TETRA_CRC_OK) {
+			memcpy(type2, cand, tbp->type2_bits);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Hand a decoded block up: to the upper MAC, one MAC PDU after the other, and
+ * to the event queue. In line or on the upper MAC thread, see tetra_mac_pipe_run() */
+static void deliver_block(struct tetra_mac_state *tms, enum tp_sap_data_type type,
+			  struct tetra_tmvsap_prim *ttp, const struct tetra_cell_data *tcd)
+{
+	const struct tetra_blk_param *tbp = &tetra_blk_param[type];
+	struct tmv_unitdata_param *tup = &ttp->u.unitdata;
+	struct msgb *msg = ttp->oph.msg;
+	struct tetra_crypto_state *tcs = tms->tcs;
+
+	if (type == TPSAP_T_SB1) {
+		/* Update colour code and network info for crypto IV generation */
+		tcs->cc = tcd->colour_code;
+		if (tcs->mcc != tcd->mcc || tcs->mnc != tcd->mnc)
+			update_current_network(tcs, tcd->mcc, tcd->mnc);
+	}
+
+	if (tms->events)
+		push_event(tms, TETRA_EV_BLOCK, type, tup, 0, tbp->type1_bits);
+
+	int pdu_bits = 0;
+	uint32_t offset = 0;
+	uint8_t *orig_head = msg->head; /* The true start of the timeslot */
+	uint8_t *orig_tail = msg->tail; /* The true end of the timeslot */
+	while (offset < tbp->type1_bits - 16) {
+		/* send Rx time along with the TMV-UNITDATA.ind primitive */
+		memcpy(&tup->tdma_time, &tcd->time, sizeof(tup->tdma_time));
+
+		/* Parse MAC element in timeslot (just one, possibly more later in the loop) */
+		pdu_bits = upper_mac_prim_recv(&ttp->oph, tms);
+
+		/* Check if we are done (-1 returned), a PDU of no length would never get there */
+		if (pdu_bits <= 0)
+			break;
+
+		if (tms->events && pdu_bits > 0)
+			push_event(tms, TETRA_EV_MAC_PDU, type, tup, offset,
+				   offset + pdu_bits > tbp->type1_bits ? tbp->type1_bits - offset : (unsigned int) pdu_bits);
+
+		/* Not done */
+		/* Increment head and l1h ptrs */
+		/* Reset tail to end of msg (may be altered by removing FCS) */
+		offset += pdu_bits;
+		msg->head = orig_head + offset;		/* New head is old head plus parsed len from prev msg */
+		msg->tail = orig_tail;			/* Restore original tail */
+		msg->len = msg->tail - msg->head;	/* Fixup len */
+		msg->l1h = msg->head;
+		msg->l2h = 0;
+		msg->l3h = 0;
+		msg->l4h = 0;
+	}
+}
+
 /* incoming TP-SAP UNITDATA.ind  from PHY into lower MAC */
-void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bits, unsigned int len, void *priv)
+void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bits, const int8_t *soft, unsigned int len, void *priv)
 {
 	/* various intermediary buffers */
 	uint8_t type4[512];
-	uint8_t type3dp[512*4];
-	uint8_t type3[512];
+	int8_t soft4[512];
+	int8_t vit_inp[TETRA_GATHER_MAX_SOFT];
 	uint8_t type2[512];
 
 	const struct tetra_blk_param *tbp = &tetra_blk_param[type];
 	struct tetra_mac_state *tms = priv;
-	struct tetra_crypto_state *tcs = tms->tcs;
+	struct tetra_cell_data *tcd = &tms->cell_data;
 	const char *time_str;
 
 	/* TMV-SAP.UNITDATA.ind primitive which we will send to the upper MAC */
@@ -164,12 +317,13 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 
 	struct msgb *msg;
 
-	ttp = tmvsap_prim_alloc(PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
+	TETRA_PROF_START(prof_t);
+	ttp = tmvsap_prim_alloc(tms, PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
 	tup = &ttp->u.unitdata;
 	msg = ttp->oph.msg;
 
 	/* update the cell time */
-	memcpy(&tcd->time, &t_phy_state.time, sizeof(tcd->time));
+	memcpy(&tcd->time, &tms->phy_state.time, sizeof(tcd->time));
 	time_str = tetra_tdma_time_dump(&tcd->time);
 
 	if (type == TPSAP_T_SB2 && is_bnch(&tcd->time)) {
@@ -181,18 +335,25 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 		osmo_ubit_dump(bits, tbp->type345_bits));
 
 	/* De-scramble, pay special attention to SB1 pre-defined scrambling */
-	memcpy(type4, bits, tbp->type345_bits);
 	if (type == TPSAP_T_SB1) {
-		tetra_scramb_bits(SCRAMB_INIT, type4, tbp->type345_bits);
+		tetra_scramb_cache_bits(&tms->scramb_cache, SCRAMB_INIT, bits, type4, tbp->type345_bits);
 		tup->scrambling_code = SCRAMB_INIT;
 	} else {
-		tetra_scramb_bits(tcd->scramb_init, type4, tbp->type345_bits);
+		tetra_scramb_cache_bits(&tms->scramb_cache, tcd->scramb_init, bits, type4, tbp->type345_bits);
 		tup->scrambling_code = tcd->scramb_init;
 	}
+	tup->snr = tms->cur_burst.snr;
 
 	DEBUGP("%s %s type4: %s\n", tbp->name, time_str,
 		osmo_ubit_dump(type4, tbp->type345_bits));
 
+	/* Descrambling a soft bit is a sign flip wherever the scrambling
+	 * sequence, i.e. type-5 XOR type-4, is a one */
+	if (soft) {
+		for (int i = 0; i < tbp->type345_bits; i++)
+			soft4[i] = ((bits[i] ^ type4[i]) & 1) ? -soft[i] : soft[i];
+	}
+
 	/* Handle block 1 slot stealing, see clause 19.4.4 */
 	/* Block 1 is stolen if AACH says slot is traffic and burst used training sequence 1 */
 	/* Block 2 is stolen if indicated in stolen block 1 resource len (-2) */
@@ -200,38 +361,65 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 		tms->cur_burst.blk1_stolen = true;
 
 	if (tbp->interleave_a) {
-		/* Run block deinterleaving: type-3 bits */
-		block_deinterleave(tbp->type345_bits, tbp->interleave_a, type4, type3);
-		DEBUGP("%s %s type3: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3, tbp->type345_bits));
-		/* De-puncture */
-		memset(type3dp, 0xff, sizeof(type3dp));
-		tetra_rcpc_depunct(TETRA_RCPC_PUNCT_2_3, type3, tbp->type345_bits, type3dp);
-		DEBUGP("%s %s type3dp: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3dp, tbp->type2_bits*4));
-		viterbi_dec_sb1_wrapper(type3dp, type2, tbp->type2_bits);
+		/* Block deinterleaving, de-puncturing and soft symbol mapping of
+		 * the type-4 bits in one table driven pass */
+		pthread_once(&soft_gather_once, soft_gather_init_once);
+		if (soft)
+			tetra_soft_gather_sbits(&soft_gather[type], soft4, vit_inp);
+		else
+			tetra_soft_gather(&soft_gather[type], type4, vit_inp);
+		viterbi_dec_soft(&tms->viterbi, vit_inp, type2, tbp->type2_bits);
 		DEBUGP("%s %s type2: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type2_bits));
 	}
 
 	if (tbp->have_crc16) {
 		uint16_t crc = crc16_ccitt_bits(type2, tbp->type1_bits+16);
+		/* SCH/F of a traffic slot is voice, it never passes */
+		if (crc != TETRA_CRC_OK && tms->list_paths && tbp->interleave_a &&
+		    !(type == TPSAP_T_SCH_F && tms->cur_burst.is_traffic) &&
+		    list_decode(tms, tbp, vit_inp, type2)) {
+			crc = TETRA_CRC_OK;
+			TETRA_STAT_ADD(tms->stats.crc_list_ok, 1);
+		}
 		// printf("CRC COMP: 0x%04x ", crc);
+		tms->cur_burst.crc_flags |= blk_num == BLK_2 ? TETRA_BURST_F_BLK2_CRC : TETRA_BURST_F_BLK1_CRC;
 		if (crc == TETRA_CRC_OK) {
 			// printf("OK\n");
 			tup->crc_ok = 1;
+			tms->cur_burst.crc_flags |= blk_num == BLK_2 ? TETRA_BURST_F_BLK2_OK : TETRA_BURST_F_BLK1_OK;
+			TETRA_PROF_ADD(TETRA_PROF_CRC_OK, 1);
+			TETRA_STAT_ADD(tms->stats.crc_ok, 1);
 			// printf("%s %s type1: %s\n", tbp->name, time_str,
 				// osmo_ubit_dump(type2, tbp->type1_bits));
 			tms->t_display_st->last_crc_fail = false;
 		} else if(type != TPSAP_T_SCH_F) {
 			// printf("WRONG\n");
+			TETRA_PROF_ADD(TETRA_PROF_CRC_FAIL, 1);
+			TETRA_STAT_ADD(tms->stats.crc_fail, 1);
 			tms->t_display_st->last_crc_fail = true;
 		}
 	} else if (type == TPSAP_T_BBK) {
-		/* FIXME: RM3014-decode */
-		tup->crc_ok = 1;
-		tms->t_display_st->last_crc_fail = false;
+		uint32_t cw = 0;
+		uint16_t aach;
+
+		for (int i = 0; i < tbp->type2_bits; i++)
+			cw = (cw << 1) | (type4[i] & 1);
 		memcpy(type2, type4, tbp->type2_bits);
+		if (tetra_rm3014_decode(cw, &aach) >= 0) {
+			tup->crc_ok = 1;
+			tms->t_display_st->last_crc_fail = false;
+			for (int i = 0; i < tbp->type1_bits; i++)
+				type2[i] = (aach >> (tbp->type1_bits - 1 - i)) & 1;
+		} else {
+			/* Without an ACCESS-ASSIGN the slot is not known to carry
+			 * traffic, so it is not sent to the codec */
+			tms->cur_burst.is_traffic = 0;
+			tms->cur_burst.blk1_stolen = false;
+			tms->cur_burst.blk2_stolen = false;
+			TETRA_STAT_ADD(tms->stats.aach_fail, 1);
+			tms->t_display_st->last_crc_fail = true;
+		}
 		DEBUGP("%s %s type1: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type1_bits));
 	}
@@ -241,6 +429,10 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 
 	msg->l1h = msgb_put(msg, tbp->type1_bits);
 	memcpy(msg->l1h, type2, tbp->type1_bits);
+	/* the prim comes zeroed from the pool, so are the bits past type1_bits */
+	tup->pbits_base = msg->l1h;
+	tup->pbits_len = tbp->type1_bits;
+	tetra_ubit2pwords(type2, tup->pbits, 0, tbp->type1_bits);
 
 	switch (type) {
 	case TPSAP_T_SB1:
@@ -263,16 +455,14 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 			tcd->mnc = bits_to_uint(type2+41, 14);
 			/* compute the scrambling code for the current cell */
 			tcd->scramb_init = tetra_scramb_get_init(tcd->mcc, tcd->mnc, tcd->colour_code);
+			TETRA_STAT_SET(tms->stats.mcc, tcd->mcc);
+			TETRA_STAT_SET(tms->stats.mnc, tcd->mnc);
+			TETRA_STAT_SET(tms->stats.cc, tcd->colour_code);
+			TETRA_STAT_PUBLISH(tms->stats.sync_ok);
 		}
 		/* update the PHY layer time */
-		memcpy(&t_phy_state.time, &tcd->time, sizeof(t_phy_state.time));
+		memcpy(&tms->phy_state.time, &tcd->time, sizeof(tms->phy_state.time));
 		tup->lchan = TETRA_LC_BSCH;
-
-		/* Update colour code and network info for crypto IV generation */
-		tcs->cc = tcd->colour_code;
-		if (tcs->mcc != tcd->mcc || tcs->mnc != tcd->mnc)
-			update_current_network(tcs, tcd->mcc, tcd->mnc);
-
 		break;
 	case TPSAP_T_SB2:
 	case TPSAP_T_NDB:
@@ -280,36 +470,68 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 		break;
 	case TPSAP_T_BBK:
 		tup->lchan = TETRA_LC_AACH;
+		/* the rest of the burst depends on it, it can't wait for the upper MAC */
+		if (tms->mac_pipe)
+			upper_mac_rx_access_assign(ttp, tms);
 		break;
 	case TPSAP_T_SCH_F:
 		tup->lchan = TETRA_LC_SCH_F;
 		//Process voice frame
 		if (tms->cur_burst.is_traffic) {
+			int tn = tms->phy_state.time.tn;
+			if (tn < 1 || tn > TETRA_CODEC_TIMESLOTS)
+				break;
+			if(tms->t_display_st->curr_frame != tms->last_frame) {
+				tms->curr_active_timeslot = tn;
+				tms->last_frame = tms->t_display_st->curr_frame;
+			}
+			bool active = tms->curr_active_timeslot == tn;
+			struct tetra_voice_key vk;
+			tetra_voice_key_read(tms, tms->cur_burst.is_traffic, &vk);
+			tms->voice_skipped[tn-1] = !voice_frame_wanted(tms, tn, active, &vk);
+			if (tms->voice_skipped[tn-1])
+				break;
+
+			/* an encrypted call goes to the codec with its keystream, which it applies to the type-1 bits */
+			uint8_t ks_buf[TETRA_KS_VOICE_BYTES];
+			const uint8_t *ks = NULL;
+			if (vk.encrypted) {
+				if (!tetra_crypto_voice_keystream(tms->tcs, &vk, &tcd->time, ks_buf)) {
+					tms->voice_skipped[tn-1] = true;
+					break;
+				}
+				ks = ks_buf;
+			}
+
 			int16_t block[690];
 			/* Generate a block */
 			memset(block, 0x00, sizeof(int16_t) * 690);
 			for (int i = 0; i < 6; i++)
 				block[115*i] = 0x6b21 + i;
+
+			/* the speech channel decoder takes soft bits as well */
+			if (!soft) {
+				for (int i = 0; i < 432; i++)
+					soft4[i] = type4[i] ? -127 : 127;
+			}
    
 			for (int i = 0; i < 114; i++)
-				block[1+i] = type4[i] ? -127 : 127;
+				block[1+i] = soft4[i];
    
 			for (int i = 0; i < 114; i++)
-				block[116+i] = type4[114+i] ? -127 : 127;
+				block[116+i] = soft4[114+i];
    
 			for (int i = 0; i < 114; i++)
-				block[231+i] = type4[228+i] ? -127 : 127;
+				block[231+i] = soft4[228+i];
    
 			for (int i = 0; i < 90; i++)
-				block[346+i] = type4[342+i] ? -127 : 127;
+				block[346+i] = soft4[342+i];
 			
 			//i'm not sure this is legal, but i don't want to make temp files and execute external programs so
 			
 			//decoding the speech using the etsi codec
 			
-			int16_t interleaved_coded_array[432]; /*time-slot length at 7.2 kb/s*/
-			int16_t  Coded_array[432];
-			int16_t  Reordered_array[286];   /* 2 frames vocoder + 8 + 4 */
+			int16_t interleaved_coded_array[TETRA_CODEC_CODED_BITS]; /*time-slot length at 7.2 kb/s*/
 			//block1
 			for(int i = 0; i < 114; i++) {
 				interleaved_coded_array[0+i] = block[1+i];
@@ -332,42 +554,17 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 					interleaved_coded_array[i] = interleaved_coded_array[i] | 0xFF00;
 				}
 			}
-			Desinterleaving_Speech(interleaved_coded_array, Coded_array);
-			bool corrupted = Channel_Decoding(tms->codec_first_pass, 0, Coded_array, Reordered_array);
-			tms->codec_first_pass = false;
-			int16_t cdecoder_output[276];
-			cdecoder_output[0] = corrupted;
-			for(int i = 0; i < 137; i++) {
-				cdecoder_output[1+i] = Reordered_array[i];
-			}
-			cdecoder_output[138] = corrupted;
-			for(int i = 0; i < 137; i++) {
-				cdecoder_output[139+i] = Reordered_array[137+i];
-			}
-			
-			int16_t parm[24];
-			int16_t synth[480];
-			int16_t* synth_p2 = &(synth[240]);
-			int16_t serial[138];
-			for(int i = 0; i < 138; i++) {
-				serial[i] = cdecoder_output[i];
-			}
-			Bits2prm_Tetra(serial, parm);	/* serial to parameters */
-			Decod_Tetra(parm, synth);		/* decoder */
-			Post_Process(synth, (int16_t)240);	/* Post processing of synthesis  */
-			for(int i = 0; i < 138; i++) {
-				serial[i] = cdecoder_output[i+138];
-			}
-			Bits2prm_Tetra(serial, parm);	/* serial to parameters */
-			Decod_Tetra(parm, synth_p2);		/* decoder */
-			Post_Process(synth_p2, (int16_t)240);	/* Post processing of synthesis  */
-			//USE SYNTH
-			if(tms->t_display_st->curr_frame != tms->last_frame) {
-				tms->curr_active_timeslot = t_phy_state.time.tn;
-				tms->last_frame = tms->t_display_st->curr_frame;
-			}
-			if(tms->curr_active_timeslot == t_phy_state.time.tn) {
-				tms->put_voice_data(tms->put_voice_data_ctx, 480, synth);
+			if (tms->put_voice_frame) {
+				tms->put_voice_frame(tms->put_voice_data_ctx, &tcd->time, active, interleaved_coded_array, ks);
+			} else {
+				struct tetra_codec *codec = &tms->codec[tn-1];
+				int16_t synth[TETRA_CODEC_SLOT_SAMPLES];
+				if (!codec->slot)
+					tetra_codec_open(codec);
+				tetra_codec_decode_slot(codec, interleaved_coded_array, ks, synth);
+				//USE SYNTH
+				if (active)
+					tms->put_voice_data(tms->put_voice_data_ctx, TETRA_CODEC_SLOT_SAMPLES, synth);
 			}
 		}
 		break;
@@ -376,37 +573,33 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bi
 		break;
 	}
 
-	int pdu_bits = 0;
-	uint32_t offset = 0;
-	uint8_t *orig_head = msg->head; /* The true start of the timeslot */
-	uint8_t *orig_tail = msg->tail; /* The true end of the timeslot */
-	while (offset < tbp->type1_bits - 16) {
-		/* send Rx time along with the TMV-UNITDATA.ind primitive */
-		memcpy(&tup->tdma_time, &tcd->time, sizeof(tup->tdma_time));
-
-		/* Parse MAC element in timeslot (just one, possibly more later in the loop) */
-		pdu_bits = upper_mac_prim_recv(&ttp->oph, tms);
-
-		/* Check if we are done (-1 returned) */
-		if (pdu_bits < 0)
-			break;
-
-		/* Not done */
-		/* Increment head and l1h ptrs */
-		/* Reset tail to end of msg (may be altered by removing FCS) */
-		offset += pdu_bits;
-		msg->head = orig_head + offset;		/* New head is old head plus parsed len from prev msg */
-		msg->tail = orig_tail;			/* Restore original tail */
-		msg->len = msg->tail - msg->head;	/* Fixup len */
-		msg->l1h = msg->head;
-		msg->l2h = 0;
-		msg->l3h = 0;
-		msg->l4h = 0;
-	}
+	memcpy(&tup->tdma_time, &tcd->time, sizeof(tup->tdma_time));
+	if (!tms->mac_pipe)
+		deliver_block(tms, type, ttp, tcd);
+	else
+		tetra_mac_pipe_push(tms->mac_pipe, type, ttp, tcd);
 
 out:
 	// talloc_free(msg);
-	free(msg);
+	msgb_free_pool(&tms->msgb_pool, msg);
 	// talloc_free(ttp);
-	free(ttp);
+	tetra_pool_free(&tms->prim_pool, ttp);
+	TETRA_PROF_ADD(TETRA_PROF_LOWER_MAC_BLOCKS, 1);
+	TETRA_PROF_STOP(TETRA_PROF_LOWER_MAC_NS, prof_t);
+}
+
+unsigned int tetra_mac_pipe_run(struct tetra_mac_state *tms, unsigned int max)
+{
+	struct tetra_mac_pipe_blk *blk;
+	unsigned int n = 0;
+
+	while (n < max && (blk = tetra_mac_pipe_peek(tms->mac_pipe))) {
+		TETRA_PROF_START(prof_t);
+		deliver_block(tms, blk->type, &blk->prim, &blk->cell);
+		tetra_mac_pipe_release(tms->mac_pipe);
+		TETRA_PROF_ADD(TETRA_PROF_UPPER_MAC_BLOCKS, 1);
+		TETRA_PROF_STOP(TETRA_PROF_UPPER_MAC_NS, prof_t);
+		n++;
+	}
+	return n;
 }
@@ -20,57 +20,21 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <lower_mac/tetra_rm3014.h>
 
-/* Generator matrix from Section 8.2.3.2  */
-
-static const uint8_t rm_30_14_gen[14][16] = {
-	{ 1, 0, 0, 1, 1, 0, 1, 1, 0, 1, 1, 0, 0, 0, 0, 0 },
-	{ 0, 0, 1, 0, 1, 1, 0, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
-	{ 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0 },
-	{ 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0 },
-	{ 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1, 1, 1, 0, 1, 0 },
-	{ 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1, 0 },
-	{ 0, 0, 1, 0, 1, 1, 0, 0, 0, 0, 1, 0, 1, 1, 1, 0 },
-	{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1 },
-	{ 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0, 1 },
-	{ 0, 1, 0, 0, 0, 0, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1 },
-	{ 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1 },
-	{ 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 1 },
-	{ 0, 0, 0, 0, 1, 0, 0, 1, 0, 1, 1, 0, 1, 0, 1, 1 },
-	{ 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 1, 1 }
+/* Rows of the systematic generator matrix from Section 8.2.3.2: upper 14 bits
+ * identity matrix, lower 16 bits the parity part. Kept precomputed so there is
+ * no shared state to set up at runtime */
+static const uint32_t rm_30_14_rows[14] = {
+	0x20009b60, 0x10002de0, 0x0800fc20, 0x0400e03c,
+	0x0200983a, 0x01005436, 0x00802c2e, 0x0040ffdf,
+	0x00208339, 0x001042b5, 0x000821ad, 0x00041273,
+	0x0002096b, 0x000104e7
 };
 
-static uint32_t rm_30_14_rows[14];
-
-
-static uint32_t shift_bits_together(const uint8_t *bits, int len)
-{
-	uint32_t ret = 0;
-	int i;
-
-	for (i = len-1; i >= 0; i--)
-		ret |= bits[i] << (len-1-i);
-
-	return ret;
-}
-
-void tetra_rm3014_init(void)
-{
-	int i;
-	uint32_t val;
-
-	for (i = 0; i < 14; i++) {
-		/* upper 14 bits identity matrix */
-		val = (1 << (16+13 - i));
-		/* lower 16 bits from rm_30_14_gen */
-		val |= shift_bits_together(rm_30_14_gen[i], 16);
-		rm_30_14_rows[i] = val;
-		// printf("rm_30_14_rows[%u] = 0x%08x\n", i, val);
-	}
-}
-
 uint32_t tetra_rm3014_compute(const uint16_t in)
 {
 	int i;
@@ -85,12 +49,61 @@ uint32_t tetra_rm3014_compute(const uint16_t in)
 	return val;
 }
 
+/* The code has a minimum distance of 8: every error of up to three bits has a
+ * syndrome of its own, and four bit errors are told apart from them.
+ *
+ * rm3014_syndrome_col[i] is the syndrome of an error in codeword bit i.
+ * rm3014_syndrome_err maps a syndrome to the error of at most
+ * RM3014_CORRECT_MAX_BITS bits that has it, or RM3014_UNCORRECTABLE */
+#define RM3014_BITS			30
+#define RM3014_CORRECT_MAX_BITS	3
+#define RM3014_UNCORRECTABLE		0xffffffff
+
+static uint16_t rm3014_syndrome_col[RM3014_BITS];
+static uint32_t rm3014_syndrome_err[65536];
+static pthread_once_t rm3014_tables_once = PTHREAD_ONCE_INIT;
+
+static inline uint16_t rm3014_syndrome(const uint32_t inp)
+{
+	return (tetra_rm3014_compute(inp >> 16) ^ inp) & 0xffff;
+}
+
+static void rm3014_tables_init(void)
+{
+	int i, j, k;
+
+	for (i = 0; i < RM3014_BITS; i++)
+		rm3014_syndrome_col[i] = rm3014_syndrome(1u << i);
+
+	memset(rm3014_syndrome_err, 0xff, sizeof(rm3014_syndrome_err));
+	rm3014_syndrome_err[0] = 0;
+	for (i = 0; i < RM3014_BITS; i++) {
+		uint16_t si = rm3014_syndrome_col[i];
+		rm3014_syndrome_err[si] = 1u << i;
+		for (j = i + 1; j < RM3014_BITS; j++) {
+			uint16_t sj = si ^ rm3014_syndrome_col[j];
+			rm3014_syndrome_err[sj] = (1u << i) | (1u << j);
+			for (k = j + 1; k < RM3014_BITS; k++)
+				rm3014_syndrome_err[sj ^ rm3014_syndrome_col[k]] =
+					(1u << i) | (1u << j) | (1u << k);
+		}
+	}
+}
+
 /**
- * This is a systematic code. We can remove the control bits
- * and then check for an error. Maybe correct it in the future.
+ * This is a systematic code: the data is the upper 14 bits once the error
+ * the syndrome points at is taken out.
  */
 int tetra_rm3014_decode(const uint32_t inp, uint16_t *out)
 {
-	*out = inp >> 16;
-	return 0;
+	uint32_t err;
+
+	pthread_once(&rm3014_tables_once, rm3014_tables_init);
+	err = rm3014_syndrome_err[rm3014_syndrome(inp)];
+	if (err == RM3014_UNCORRECTABLE) {
+		*out = (inp >> 16) & 0x3fff;
+		return -1;
+	}
+	*out = ((inp ^ err) >> 16) & 0x3fff;
+	return __builtin_popcount(err);
 }
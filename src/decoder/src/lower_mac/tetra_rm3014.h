@@ -3,14 +3,13 @@
 
 #include <stdint.h>
 
-void tetra_rm3014_init(void);
 uint32_t tetra_rm3014_compute(const uint16_t in);
 
 /**
- * Decode @param inp to @param out and return if there was
- * an error in the input. In the future this should correct
- * the error or such.
+ * Decode the 30 bit codeword @param inp, first bit in bit 29, to the 14 data
+ * bits in @param out. Returns the number of bit errors corrected, up to 3, or
+ * -1 if there were more, in which case @param out is the data as received.
  */
-int tetra_rm3013_decode(const uint32_t inp, uint16_t *out);
+int tetra_rm3014_decode(const uint32_t inp, uint16_t *out);
 
 #endif
@@ -21,6 +21,8 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 #include <lower_mac/tetra_scramb.h>
 
 /* Tap macro for the standard XOR / Fibonacci form */
@@ -63,12 +65,53 @@ static uint8_t next_lfsr_bit(uint32_t *lf)
 }
 #endif
 
+/* The LFSR is linear, so 32 steps at once are the XOR of the contributions
+ * of the four state bytes. After 32 steps the state holds exactly the 32
+ * generated bits, the first one in bit 0 */
+static uint32_t lfsr_leap[4][256];
+static pthread_once_t lfsr_leap_once = PTHREAD_ONCE_INIT;
+
+static void lfsr_leap_init(void)
+{
+	int b, v, i;
+
+	for (b = 0; b < 4; b++) {
+		for (v = 0; v < 256; v++) {
+			uint32_t lfsr = (uint32_t)v << (8 * b);
+
+			for (i = 0; i < 32; i++)
+				next_lfsr_bit(&lfsr);
+			lfsr_leap[b][v] = lfsr;
+		}
+	}
+}
+
+static inline uint32_t lfsr_leap32(uint32_t lfsr)
+{
+	return lfsr_leap[0][lfsr & 0xff] ^ lfsr_leap[1][(lfsr >> 8) & 0xff] ^
+	       lfsr_leap[2][(lfsr >> 16) & 0xff] ^ lfsr_leap[3][lfsr >> 24];
+}
+
+static inline uint32_t bitrev32(uint32_t x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+	return (x >> 16) | (x << 16);
+}
+
 int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len)
 {
-	int i;
+	int i, j;
 
-	for (i = 0; i < len; i++)
-		out[i] = next_lfsr_bit(&lfsr_init);
+	pthread_once(&lfsr_leap_once, lfsr_leap_init);
+
+	for (i = 0; i < len; i += 32) {
+		lfsr_init = lfsr_leap32(lfsr_init);
+		for (j = 0; j < 32 && i + j < len; j++)
+			out[i + j] = (lfsr_init >> j) & 1;
+	}
 
 	return 0;
 }
@@ -76,10 +119,80 @@ int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len)
 /* XOR the bitstring at 'out/len' using the TETRA scrambling LFSR */
 int tetra_scramb_bits(uint32_t lfsr_init, uint8_t *out, int len)
 {
+	int i, j;
+
+	pthread_once(&lfsr_leap_once, lfsr_leap_init);
+
+	for (i = 0; i < len; i += 32) {
+		lfsr_init = lfsr_leap32(lfsr_init);
+		for (j = 0; j < 32 && i + j < len; j++)
+			out[i + j] ^= (lfsr_init >> j) & 1;
+	}
+
+	return 0;
+}
+
+/* XOR the packed bitstring at 'out/len' using the TETRA scrambling LFSR */
+int tetra_scramb_pwords(uint32_t lfsr_init, uint64_t *out, int len)
+{
+	int i;
+
+	pthread_once(&lfsr_leap_once, lfsr_leap_init);
+
+	for (i = 0; i < len; i += 64) {
+		uint64_t ks;
+
+		lfsr_init = lfsr_leap32(lfsr_init);
+		ks = (uint64_t)bitrev32(lfsr_init) << 32;
+		lfsr_init = lfsr_leap32(lfsr_init);
+		ks |= bitrev32(lfsr_init);
+
+		/* leave the bits past the end of the string alone */
+		if (len - i < 64)
+			ks &= ~0ULL << (64 - (len - i));
+		out[i / 64] ^= ks;
+	}
+
+	return 0;
+}
+
+const uint8_t *tetra_scramb_cache_get(struct tetra_scramb_cache *cache, uint32_t lfsr_init)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->num; i++) {
+		if (cache->lfsr_init[i] == lfsr_init)
+			return cache->bits[i];
+	}
+
+	if (cache->num < SCRAMB_CACHE_SIZE) {
+		i = cache->num++;
+	} else {
+		i = cache->next;
+		cache->next = (cache->next + 1) % SCRAMB_CACHE_SIZE;
+	}
+
+	cache->lfsr_init[i] = lfsr_init;
+	tetra_scramb_get_bits(lfsr_init, cache->bits[i], SCRAMB_CACHE_BITS);
+
+	return cache->bits[i];
+}
+
+int tetra_scramb_cache_bits(struct tetra_scramb_cache *cache, uint32_t lfsr_init,
+			    const uint8_t *in, uint8_t *out, int len)
+{
+	const uint8_t *seq;
 	int i;
 
+	if (len > SCRAMB_CACHE_BITS) {
+		if (out != in)
+			memcpy(out, in, len);
+		return tetra_scramb_bits(lfsr_init, out, len);
+	}
+
+	seq = tetra_scramb_cache_get(cache, lfsr_init);
 	for (i = 0; i < len; i++)
-		out[i] ^= next_lfsr_bit(&lfsr_init);
+		out[i] = in[i] ^ seq[i];
 
 	return 0;
 }
@@ -20,4 +20,27 @@ int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len);
 /* XOR the bitstring at 'out/len' using the TETRA scrambling LFSR */
 int tetra_scramb_bits(uint32_t lfsr_init, uint8_t *out, int len);
 
+/* XOR the packed bitstring (see tetra_pbits.h) at 'out/len' using the TETRA scrambling LFSR */
+int tetra_scramb_pwords(uint32_t lfsr_init, uint64_t *out, int len);
+
+/* The longest block (SCH/F) has 432 type-5 bits */
+#define SCRAMB_CACHE_BITS	432
+#define SCRAMB_CACHE_SIZE	8
+
+/* Scrambling sequences of recently seen cells (and SCRAMB_INIT for SB1),
+ * so descrambling a block is a plain XOR of a stored sequence */
+struct tetra_scramb_cache {
+	unsigned int num;		/* valid entries */
+	unsigned int next;		/* entry to replace once full */
+	uint32_t lfsr_init[SCRAMB_CACHE_SIZE];
+	uint8_t bits[SCRAMB_CACHE_SIZE][SCRAMB_CACHE_BITS];
+};
+
+/* first SCRAMB_CACHE_BITS scrambling bits for lfsr_init, generated on first use */
+const uint8_t *tetra_scramb_cache_get(struct tetra_scramb_cache *cache, uint32_t lfsr_init);
+
+/* out = in XOR scrambling sequence, in and out may be the same buffer */
+int tetra_scramb_cache_bits(struct tetra_scramb_cache *cache, uint32_t lfsr_init,
+			    const uint8_t *in, uint8_t *out, int len);
+
 #endif /* TETRA_SCRAMB_H */
@@ -0,0 +1,70 @@
+/* Deinterleave + de-puncture + soft symbol mapping in one pass */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <errno.h>
+
+#include <lower_mac/tetra_soft_gather.h>
+
+int tetra_soft_gather_init(struct tetra_soft_gather *g, uint32_t K, uint32_t a,
+			   enum tetra_rcpc_puncturer pu, uint32_t type2_bits)
+{
+	uint16_t mother[TETRA_GATHER_MAX_SOFT];
+	uint32_t j;
+	int rc;
+
+	if (type2_bits > TETRA_GATHER_MAX_TYPE2 || K > TETRA_GATHER_MAX_SOFT)
+		return -EINVAL;
+
+	rc = tetra_rcpc_depunct_map(pu, K, mother);
+	if (rc < 0)
+		return rc;
+
+	g->type2_bits = type2_bits;
+	g->soft_len = type2_bits*4 + TETRA_VITERBI_TAIL;
+	for (j = 0; j < g->soft_len; j++)
+		g->src[j] = -1;
+
+	/* Section 8.2.4.1: type-3 bit j (1-based) is type-4 bit (a * j) % K
+	 * (0-based), and it lands on mother code symbol mother[j-1] */
+	for (j = 1; j <= K; j++) {
+		if (mother[j-1] >= type2_bits*4)
+			return -EINVAL;
+		g->src[mother[j-1]] = (a * j) % K;
+	}
+
+	return 0;
+}
+
+void tetra_soft_gather(const struct tetra_soft_gather *g, const uint8_t *type4, int8_t *soft)
+{
+	int i;
+
+	for (i = 0; i < g->soft_len; i++) {
+		int16_t s = g->src[i];
+
+		/* '0' -> 127, '1' -> -127, punctured and tail -> 0 */
+		soft[i] = (s < 0) ? 0 : (127 - 254 * (type4[s] & 1));
+	}
+}
+
+void tetra_soft_gather_sbits(const struct tetra_soft_gather *g, const int8_t *type4, int8_t *soft)
+{
+	int i;
+
+	for (i = 0; i < g->soft_len; i++) {
+		int16_t s = g->src[i];
+
+		soft[i] = (s < 0) ? 0 : type4[s];
+	}
+}
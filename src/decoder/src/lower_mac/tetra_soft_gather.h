@@ -0,0 +1,35 @@
+#ifndef TETRA_SOFT_GATHER_H
+#define TETRA_SOFT_GATHER_H
+
+/* Block deinterleaving, de-puncturing and the mapping to Viterbi soft
+ * symbols of one block type, folded into a single precomputed gather */
+
+#include <stdint.h>
+
+#include <lower_mac/tetra_conv_enc.h>
+#include <lower_mac/viterbi.h>
+
+/* SCH/F: 432 type-3 bits, 288 type-2 bits of the rate 1/4 mother code */
+#define TETRA_GATHER_MAX_TYPE2	288
+#define TETRA_GATHER_MAX_SOFT	(TETRA_GATHER_MAX_TYPE2*4 + TETRA_VITERBI_TAIL)
+
+struct tetra_soft_gather {
+	uint16_t type2_bits;
+	uint16_t soft_len;		/* mother code symbols plus the zero tail */
+	/* type-4 bit feeding each mother code symbol, -1 if punctured */
+	int16_t src[TETRA_GATHER_MAX_SOFT];
+};
+
+/* Build the table for K type-3/4 bits interleaved with parameter a and
+ * punctured with pu down from type2_bits */
+int tetra_soft_gather_init(struct tetra_soft_gather *g, uint32_t K, uint32_t a,
+			   enum tetra_rcpc_puncturer pu, uint32_t type2_bits);
+
+/* type-4 bits (one per byte) in, soft_len Viterbi soft symbols out,
+ * ready for viterbi_dec_soft() */
+void tetra_soft_gather(const struct tetra_soft_gather *g, const uint8_t *type4, int8_t *soft);
+
+/* same for soft type-4 bits (positive = '0'), which go through unchanged */
+void tetra_soft_gather_sbits(const struct tetra_soft_gather *g, const int8_t *type4, int8_t *soft);
+
+#endif /* TETRA_SOFT_GATHER_H */
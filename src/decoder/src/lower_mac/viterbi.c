@@ -1,11 +1,72 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "osmo_conv.h"
+#include <tetra_prof.h>
+#include <lower_mac/viterbi.h>
 #include <lower_mac/viterbi_cch.h>
+#include <lower_mac/viterbi_list.h>
 
-void viterbi_dec_sb1_wrapper(const uint8_t *in, uint8_t *out, unsigned int sym_count)
+static struct osmo_conv_vdec *viterbi_cache_get(struct tetra_viterbi_cache *cache, unsigned int sym_count)
 {
-	int8_t vit_inp[864*4] = {0};
+	int i;
+
+	for (i = 0; i < cache->num; i++) {
+		if (cache->len[i] == sym_count)
+			return cache->dec[i];
+	}
+
+	if (cache->num == TETRA_VITERBI_CACHE_SIZE)
+		return NULL;
+
+	cache->dec[cache->num] = conv_cch_decoder_create(sym_count);
+	if (!cache->dec[cache->num])
+		return NULL;
+	cache->len[cache->num] = sym_count;
+
+	return cache->dec[cache->num++];
+}
+
+void tetra_viterbi_cache_free(struct tetra_viterbi_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->num; i++)
+		osmo_conv_vdec_destroy(cache->dec[i]);
+	cache->num = 0;
+	viterbi_list_free(cache->list);
+	cache->list = NULL;
+}
+
+struct tetra_viterbi_list *tetra_viterbi_cache_list(struct tetra_viterbi_cache *cache)
+{
+	if (!cache->list)
+		cache->list = viterbi_list_alloc();
+	return cache->list;
+}
+
+void viterbi_dec_soft(struct tetra_viterbi_cache *cache, const int8_t *soft, uint8_t *out, unsigned int sym_count)
+{
+	struct osmo_conv_vdec *dec;
+
+	TETRA_PROF_START(prof_t);
+	/* the lengths of TETRA have their own decoder, the cache is for the rest */
+	if (!conv_cch_decode_fixed(soft, out, sym_count))
+		goto out;
+	dec = viterbi_cache_get(cache, sym_count);
+	if (dec)
+		osmo_conv_vdec_run(dec, soft, out);
+	else
+		conv_cch_decode((int8_t *) soft, out, sym_count);
+out:
+	TETRA_PROF_ADD(TETRA_PROF_VITERBI_CALLS, 1);
+	TETRA_PROF_STOP(TETRA_PROF_VITERBI_NS, prof_t);
+}
+
+void viterbi_dec_sb1_wrapper(struct tetra_viterbi_cache *cache, const uint8_t *in, uint8_t *out, unsigned int sym_count)
+{
+	/* the flushed decoder reads K-1 symbols past sym_count, only those need clearing */
+	int8_t vit_inp[864*4 + TETRA_VITERBI_TAIL];
 	int i;
 
 	for (i = 0; i < sym_count*4; i++) {
@@ -21,5 +82,8 @@ void viterbi_dec_sb1_wrapper(const uint8_t *in, uint8_t *out, unsigned int sym_c
 			break;
 		}
 	}
-	conv_cch_decode(vit_inp, out, sym_count);
+
+	memset(&vit_inp[sym_count*4], 0, TETRA_VITERBI_TAIL);
+
+	viterbi_dec_soft(cache, vit_inp, out, sym_count);
 }
@@ -1,6 +1,33 @@
 #ifndef VITERBI_H
 #define VITERBI_H
 
-void viterbi_dec_sb1_wrapper(const uint8_t *in, uint8_t *out, unsigned int sym_count);
+#include <stdint.h>
+
+struct osmo_conv_vdec;
+struct tetra_viterbi_list;
+
+/* TETRA only uses a handful of type-2 block lengths (SB1 80, SCH/HU 112,
+ * SB2/NDB 144, SCH/F 288), one persistent decoder is kept per length */
+#define TETRA_VITERBI_CACHE_SIZE	8
+
+struct tetra_viterbi_cache {
+	int num;
+	unsigned int len[TETRA_VITERBI_CACHE_SIZE];
+	struct osmo_conv_vdec *dec[TETRA_VITERBI_CACHE_SIZE];
+	/* list decoder, allocated on the first block that needs it */
+	struct tetra_viterbi_list *list;
+};
+
+void tetra_viterbi_cache_free(struct tetra_viterbi_cache *cache);
+
+/* The list decoder of the cache, NULL if it could not be allocated */
+struct tetra_viterbi_list *tetra_viterbi_cache_list(struct tetra_viterbi_cache *cache);
+
+void viterbi_dec_sb1_wrapper(struct tetra_viterbi_cache *cache, const uint8_t *in, uint8_t *out, unsigned int sym_count);
+
+/* Same on soft symbols (127 = '0', -127 = '1', 0 = erased), soft has to
+ * hold sym_count*4 symbols followed by TETRA_VITERBI_TAIL zeros */
+#define TETRA_VITERBI_TAIL	(4*4)
+void viterbi_dec_soft(struct tetra_viterbi_cache *cache, const int8_t *soft, uint8_t *out, unsigned int sym_count);
 
 #endif /* VITERBI_H */
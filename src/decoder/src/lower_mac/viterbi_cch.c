@@ -56,6 +56,11 @@ static const struct osmo_conv_code conv_cch = {
 };
 
 
+const struct osmo_conv_code *conv_cch_get_code(void)
+{
+	return &conv_cch;
+}
+
 int conv_cch_decode(int8_t *input, uint8_t *output, int n)
 {
 	struct osmo_conv_code code;
@@ -65,3 +70,116 @@ int conv_cch_decode(int8_t *input, uint8_t *output, int n)
 
 	return osmo_conv_decode(&code, input, output);
 }
+
+struct osmo_conv_vdec *conv_cch_decoder_create(int n)
+{
+	struct osmo_conv_code code;
+
+	memcpy(&code, &conv_cch, sizeof(struct osmo_conv_code));
+	code.len = n;
+
+	return osmo_conv_vdec_create(&code);
+}
+
+/* Decoder specialised to this code and the block lengths of TETRA. K, N,
+ * the trellis and the length are all constants, the eight butterflies of a
+ * step are one eight lane vector operation (GCC vector extensions, SSE2 or
+ * NEON as the target has it) and the compiler unrolls the steps for each
+ * length.
+ *
+ * A state holds the last four input bits, the newest in bit 0. States 2j
+ * and 2j+1 are both reached from j and j+8. The transitions from j+8 put out
+ * the complement of those from j, and so do those for the input bit 1 of
+ * those for 0: butterfly j needs a single branch metric. The path metrics are
+ * 16 bit, set back by the metric of state 0 every CCH_NORM_STEPS steps. Their
+ * spread stays under 4 steps of the largest branch metric (4 * 127 * 4), the
+ * growth in between under CCH_NORM_STEPS of them */
+#define CCH_TAIL	4
+#define CCH_MAX_STEPS	(288 + CCH_TAIL)
+#define CCH_NORM_STEPS	16
+#define CCH_UNREACHED	(-8192)
+
+typedef int16_t cch_v8 __attribute__((vector_size(16)));
+
+/* Sign soft bit k takes in the branch metric of butterfly j for the input bit
+ * 0, from its output conv_cch_next_output[j][0] = 0, 11, 6, 13, 5, 14, 3, 8 */
+#define CCH_SIGN(o, k)	((((o) >> (3 - (k))) & 1) ? -1 : 1)
+#define CCH_SIGNS(k)	{ CCH_SIGN(0, k), CCH_SIGN(11, k), CCH_SIGN(6, k), CCH_SIGN(13, k), \
+			  CCH_SIGN(5, k), CCH_SIGN(14, k), CCH_SIGN(3, k), CCH_SIGN(8, k) }
+
+static inline __attribute__((always_inline))
+void conv_cch_decode_len(const int8_t *soft, uint8_t *out, const int n)
+{
+	static const cch_v8 sign0 = CCH_SIGNS(0), sign1 = CCH_SIGNS(1);
+	static const cch_v8 sign2 = CCH_SIGNS(2), sign3 = CCH_SIGNS(3);
+	/* per step the decisions of the even and the odd states, by butterfly */
+	cch_v8 dec[CCH_MAX_STEPS][2];
+	/* metrics of the states 0 .. 7 and 8 .. 15 */
+	cch_v8 lo = { 0, CCH_UNREACHED, CCH_UNREACHED, CCH_UNREACHED,
+		      CCH_UNREACHED, CCH_UNREACHED, CCH_UNREACHED, CCH_UNREACHED };
+	cch_v8 hi = lo - lo + CCH_UNREACHED;
+	int t;
+	unsigned s;
+
+	for (t = 0; t < n + CCH_TAIL; t++) {
+		const int8_t *sym = &soft[4 * t];
+		cch_v8 bm = sym[0] * sign0 + sym[1] * sign1 + sym[2] * sign2 + sym[3] * sign3;
+		cch_v8 a0 = lo + bm, b0 = hi - bm;
+		cch_v8 a1 = lo - bm, b1 = hi + bm;
+		cch_v8 d0 = b0 > a0, d1 = b1 > a1;
+		cch_v8 n0 = (b0 & d0) | (a0 & ~d0);
+		cch_v8 n1 = (b1 & d1) | (a1 & ~d1);
+
+		dec[t][0] = d0;
+		dec[t][1] = d1;
+		/* state 2j is n0[j], 2j+1 is n1[j] */
+		lo = __builtin_shuffle(n0, n1, (cch_v8){ 0, 8, 1, 9, 2, 10, 3, 11 });
+		hi = __builtin_shuffle(n0, n1, (cch_v8){ 4, 12, 5, 13, 6, 14, 7, 15 });
+		if (!(t % CCH_NORM_STEPS)) {
+			cch_v8 norm = lo - lo + lo[0];
+
+			lo -= norm;
+			hi -= norm;
+		}
+	}
+
+	/* flushed, the path ends in state 0 */
+	s = 0;
+	for (t = n + CCH_TAIL - 1; t >= 0; t--) {
+		if (t < n)
+			out[t] = s & 1;
+		s = (s >> 1) | ((dec[t][s & 1][s >> 1] & 1) << 3);
+	}
+}
+
+#define CONV_CCH_DECODE_FIXED(n) \
+	static void conv_cch_decode_##n(const int8_t *soft, uint8_t *out) \
+	{ \
+		conv_cch_decode_len(soft, out, n); \
+	}
+
+/* SB1, SCH/HU, SB2 and NDB, SCH/F */
+CONV_CCH_DECODE_FIXED(80)
+CONV_CCH_DECODE_FIXED(112)
+CONV_CCH_DECODE_FIXED(144)
+CONV_CCH_DECODE_FIXED(288)
+
+int conv_cch_decode_fixed(const int8_t *soft, uint8_t *out, int n)
+{
+	switch (n) {
+	case 80:
+		conv_cch_decode_80(soft, out);
+		return 0;
+	case 112:
+		conv_cch_decode_112(soft, out);
+		return 0;
+	case 144:
+		conv_cch_decode_144(soft, out);
+		return 0;
+	case 288:
+		conv_cch_decode_288(soft, out);
+		return 0;
+	default:
+		return -1;
+	}
+}
@@ -4,4 +4,18 @@
 int conv_cch_encode(uint8_t *input, uint8_t *output, int n);
 int conv_cch_decode(int8_t *input, uint8_t *output, int n);
 
+struct osmo_conv_vdec;
+struct osmo_conv_code;
+
+/* The code itself, with the block length left at 0 */
+const struct osmo_conv_code *conv_cch_get_code(void);
+
+/* Decoder for a fixed block length, to be run with osmo_conv_vdec_run() */
+struct osmo_conv_vdec *conv_cch_decoder_create(int n);
+
+/* Same decoding with everything but the input fixed at compile time, for the
+ * block lengths of TETRA (80, 112, 144 and 288). soft as for
+ * viterbi_dec_soft(). -1 for any other length, out is left alone then */
+int conv_cch_decode_fixed(const int8_t *soft, uint8_t *out, int n);
+
 #endif /* VITERBI_CCH_H */
@@ -0,0 +1,215 @@
+/* Serial list Viterbi decoder of the TETRA mother code, see viterbi_list.h */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "osmo_conv.h"
+#include <lower_mac/viterbi_cch.h>
+#include <lower_mac/viterbi_list.h>
+
+#define LIST_K		5
+#define LIST_N		4
+#define LIST_STATES	(1 << (LIST_K - 1))
+#define LIST_STEPS	(TETRA_VITERBI_LIST_MAX_SYMS + LIST_K - 1)
+#define LIST_UNREACHED	INT_MIN
+
+/* A path not given out yet: the detour off path 'parent' that takes the
+ * losing branch into 'state' at transition 'step' */
+struct list_cand {
+	int metric;
+	int parent;
+	int step;
+	int state;
+};
+
+struct tetra_viterbi_list {
+	/* the two transitions into every state, and their outputs as +-1 */
+	uint8_t pred_state[LIST_STATES][2];
+	uint8_t pred_bit[LIST_STATES][2];
+	int8_t pred_out[LIST_STATES][2][LIST_N];
+
+	int steps;
+	int sym_count;
+	int max_paths;
+	int found;
+	int end_metric;
+
+	/* per transition and state reached: the survivor (0/1 into pred_*) and
+	 * the metric the other branch was short of it, -1 if it was unreachable */
+	uint8_t surv[LIST_STEPS][LIST_STATES];
+	int delta[LIST_STEPS][LIST_STATES];
+
+	/* the paths given out, their input bits and metrics */
+	uint8_t bits[TETRA_VITERBI_LIST_MAX_PATHS][LIST_STEPS];
+	int metric[TETRA_VITERBI_LIST_MAX_PATHS];
+
+	/* the best candidates, no more than can still be given out */
+	struct list_cand cand[TETRA_VITERBI_LIST_MAX_PATHS];
+	int num_cand;
+};
+
+struct tetra_viterbi_list *viterbi_list_alloc(void)
+{
+	const struct osmo_conv_code *code = conv_cch_get_code();
+	struct tetra_viterbi_list *list;
+	int s, b, j, seen[LIST_STATES];
+
+	list = calloc(1, sizeof(*list));
+	if (!list)
+		return NULL;
+
+	memset(seen, 0, sizeof(seen));
+	for (s = 0; s < LIST_STATES; s++) {
+		for (b = 0; b < 2; b++) {
+			int next = code->next_state[s][b];
+			int out = code->next_output[s][b];
+			int i = seen[next]++;
+
+			list->pred_state[next][i] = s;
+			list->pred_bit[next][i] = b;
+			/* first coded bit in the MSB, a '0' is a positive soft bit */
+			for (j = 0; j < LIST_N; j++)
+				list->pred_out[next][i][j] = ((out >> (LIST_N - 1 - j)) & 1) ? -1 : 1;
+		}
+	}
+
+	return list;
+}
+
+void viterbi_list_free(struct tetra_viterbi_list *list)
+{
+	free(list);
+}
+
+int viterbi_list_start(struct tetra_viterbi_list *list, const int8_t *soft, unsigned int sym_count, int max_paths)
+{
+	int m[LIST_STATES], m_next[LIST_STATES];
+	int t, s, i, j;
+
+	if (sym_count > TETRA_VITERBI_LIST_MAX_SYMS)
+		return -1;
+
+	list->sym_count = sym_count;
+	list->steps = sym_count + LIST_K - 1;
+	list->max_paths = max_paths < TETRA_VITERBI_LIST_MAX_PATHS ? max_paths : TETRA_VITERBI_LIST_MAX_PATHS;
+	list->found = 0;
+	list->num_cand = 0;
+
+	for (s = 0; s < LIST_STATES; s++)
+		m[s] = LIST_UNREACHED;
+	m[0] = 0;
+
+	for (t = 0; t < list->steps; t++) {
+		const int8_t *sym = &soft[LIST_N * t];
+
+		for (s = 0; s < LIST_STATES; s++) {
+			int cand[2];
+
+			for (i = 0; i < 2; i++) {
+				int p = m[list->pred_state[s][i]];
+				int bm = 0;
+
+				if (p == LIST_UNREACHED) {
+					cand[i] = LIST_UNREACHED;
+					continue;
+				}
+				for (j = 0; j < LIST_N; j++)
+					bm += sym[j] * list->pred_out[s][i][j];
+				cand[i] = p + bm;
+			}
+			i = cand[1] > cand[0];
+			list->surv[t][s] = i;
+			m_next[s] = cand[i];
+			list->delta[t][s] = (cand[!i] == LIST_UNREACHED) ? -1 : cand[i] - cand[!i];
+		}
+		memcpy(m, m_next, sizeof(m));
+	}
+
+	/* flushed: every path ends in state 0 */
+	list->end_metric = m[0];
+
+	return 0;
+}
+
+/* Keep the candidate if it is among the best that can still be given out */
+static void list_add_cand(struct tetra_viterbi_list *list, int metric, int parent, int step, int state)
+{
+	int room = list->max_paths - list->found;
+	int i, worst = 0;
+
+	if (room <= 0)
+		return;
+	if (list->num_cand >= room) {
+		for (i = 1; i < list->num_cand; i++) {
+			if (list->cand[i].metric < list->cand[worst].metric)
+				worst = i;
+		}
+		if (metric <= list->cand[worst].metric)
+			return;
+		i = worst;
+	} else {
+		i = list->num_cand++;
+	}
+	list->cand[i].metric = metric;
+	list->cand[i].parent = parent;
+	list->cand[i].step = step;
+	list->cand[i].state = state;
+}
+
+/* Follow the survivors back from state at step (the state reached by
+ * transition step-1), filling in the bits before it and offering the detours
+ * off them */
+static void list_traceback(struct tetra_viterbi_list *list, int k, int state, int step)
+{
+	uint8_t *bits = list->bits[k];
+	int t;
+
+	for (t = step - 1; t >= 0; t--) {
+		int i = list->surv[t][state];
+
+		if (list->delta[t][state] >= 0)
+			list_add_cand(list, list->metric[k] - list->delta[t][state], k, t, state);
+		bits[t] = list->pred_bit[state][i];
+		state = list->pred_state[state][i];
+	}
+}
+
+int viterbi_list_next(struct tetra_viterbi_list *list, uint8_t *out)
+{
+	int k = list->found;
+	struct list_cand c;
+	int i, best;
+
+	if (k >= list->max_paths || list->end_metric == LIST_UNREACHED)
+		return -1;
+
+	if (k == 0) {
+		list->metric[0] = list->end_metric;
+		list->found = 1;
+		list_traceback(list, 0, 0, list->steps);
+	} else {
+		if (!list->num_cand)
+			return -1;
+		best = 0;
+		for (i = 1; i < list->num_cand; i++) {
+			if (list->cand[i].metric > list->cand[best].metric)
+				best = i;
+		}
+		c = list->cand[best];
+		list->cand[best] = list->cand[--list->num_cand];
+
+		/* the parent's bits after the detour, the losing branch into the
+		 * state at c.step, and the survivors before it */
+		i = !list->surv[c.step][c.state];
+		memcpy(&list->bits[k][c.step + 1], &list->bits[c.parent][c.step + 1], list->steps - c.step - 1);
+		list->bits[k][c.step] = list->pred_bit[c.state][i];
+		list->metric[k] = c.metric;
+		list->found++;
+		list_traceback(list, k, list->pred_state[c.state][i], c.step);
+	}
+
+	memcpy(out, list->bits[k], list->sym_count);
+	return k;
+}
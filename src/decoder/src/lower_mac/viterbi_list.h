@@ -0,0 +1,42 @@
+#ifndef VITERBI_LIST_H
+#define VITERBI_LIST_H
+
+#include <stdint.h>
+
+/* Serial list Viterbi decoding of the TETRA mother code (K=5, rate 1/4,
+ * flushed), for blocks that failed their CRC: the paths through the trellis
+ * come out best first, each as its type-2 bits, for the caller to check.
+ *
+ * The forward pass keeps the survivor and the metric lost against the other
+ * branch of every state and step. A path is found again as a detour off one
+ * found before it, which takes the losing branch at one state and follows the
+ * survivors back from there.
+ *
+ *	viterbi_list_start(list, soft, len, max_paths);
+ *	while (viterbi_list_next(list, out) >= 0 && CRC of out fails) ;
+ */
+
+/* longest block, SCH/F, and paths of one block at most */
+#define TETRA_VITERBI_LIST_MAX_SYMS	288
+#define TETRA_VITERBI_LIST_MAX_PATHS	64
+/* paths tried on a failed block, and paths a carrier may spend per TDMA
+ * frame. A failed SCH/F takes about 35 us for the forward pass and 1 us per
+ * path after it, some 50 us with 16 paths */
+#define TETRA_VITERBI_LIST_DEFAULT_PATHS	16
+#define TETRA_VITERBI_LIST_DEFAULT_BUDGET	128
+
+struct tetra_viterbi_list;
+
+struct tetra_viterbi_list *viterbi_list_alloc(void);
+void viterbi_list_free(struct tetra_viterbi_list *list);
+
+/* Run the forward pass over soft (as for viterbi_dec_soft, sym_count*4
+ * symbols followed by TETRA_VITERBI_TAIL zeros) and list up to max_paths
+ * paths. -1 if sym_count is over TETRA_VITERBI_LIST_MAX_SYMS */
+int viterbi_list_start(struct tetra_viterbi_list *list, const int8_t *soft, unsigned int sym_count, int max_paths);
+
+/* Next best path into out, sym_count bits. Returns its rank, 0 for the
+ * Viterbi path, or -1 once max_paths were given or there are no more */
+int viterbi_list_next(struct tetra_viterbi_list *list, uint8_t *out);
+
+#endif /* VITERBI_LIST_H */
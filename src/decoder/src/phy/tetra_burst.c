@@ -26,7 +26,11 @@
 
 #include "tetra_common.h"
 
+#include <tetra_pbits.h>
 #include <phy/tetra_burst.h>
+#include <phy/tetra_burst_archive.h>
+#include <phy/tetra_train_corr.h>
+#include <tetra_prof.h>
 
 #define DQPSK4_BITS_PER_SYM	2
 
@@ -38,8 +42,11 @@
 #define SB_BBK_BITS	(15*DQPSK4_BITS_PER_SYM)
 #define SB_BLK2_BITS	(108*DQPSK4_BITS_PER_SYM)
 
+#define SB_TRAIN_OFFSET	((6+1+40+60)*DQPSK4_BITS_PER_SYM)
+
 #define NDB_BLK1_OFFSET ((5+1+1)*DQPSK4_BITS_PER_SYM)
 #define NDB_BBK1_OFFSET	((5+1+1+108)*DQPSK4_BITS_PER_SYM)
+#define NDB_TRAIN_OFFSET	((5+1+1+108+7)*DQPSK4_BITS_PER_SYM)
 #define NDB_BBK2_OFFSET	((5+1+1+108+7+11)*DQPSK4_BITS_PER_SYM)
 #define NDB_BLK2_OFFSET	((5+1+1+108+7+11+8)*DQPSK4_BITS_PER_SYM)
 
@@ -161,7 +168,7 @@ void put_phase_adj_bits(const uint8_t *bits, enum phase_adj_bits pa, uint8_t *ou
 	sum_phase = sum_up_phase(bits + 2*(pan->n1-1), 1 + pan->n2 - pan->n1);
 	adj_phase = calc_phase_adj(sum_phase);
 
-	p2b = &phase2bits[adj_phase];
+	p2b = &phase2bits[PHASE(adj_phase)];
 
 	*out++ = p2b->bits[0];
 	*out++ = p2b->bits[1];
@@ -271,19 +278,12 @@ int build_norm_c_d_burst(uint8_t *buf, const uint8_t *bkn1, const uint8_t *bb, c
 int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
 			 uint32_t mask_of_train_seq, unsigned int *offset)
 {
-	static uint32_t tsq_bytes[5];
-
-	if (tsq_bytes[0] == 0) {
 #define FILTER_LOOKAHEAD_LEN 22
 #define FILTER_LOOKAHEAD_MASK ((1<<FILTER_LOOKAHEAD_LEN)-1)
-		for (int i = 0; i < FILTER_LOOKAHEAD_LEN; i++) {
-			tsq_bytes[0] = (tsq_bytes[0] << 1) | y_bits[i];
-			tsq_bytes[1] = (tsq_bytes[1] << 1) | n_bits[i];
-			tsq_bytes[2] = (tsq_bytes[2] << 1) | p_bits[i];
-			tsq_bytes[3] = (tsq_bytes[3] << 1) | q_bits[i];
-			tsq_bytes[4] = (tsq_bytes[4] << 1) | x_bits[i];
-		}
-	}
+	/* first FILTER_LOOKAHEAD_LEN bits of y, n, p, q and x, packed MSB first */
+	static const uint32_t tsq_bytes[5] = {
+		0x30673a, 0x343a74, 0x1e90de, 0x2dc1ad, 0x2743a7
+	};
 
 	uint32_t filter = 0;
 
@@ -340,54 +340,133 @@ int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
 	return -1;
 }
 
-void tetra_burst_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv)
+int tetra_burst_block_ranges(enum tetra_train_seq type, int blk, unsigned int offs[2], unsigned int len[2])
+{
+	switch (type) {
+	case TETRA_TRAIN_SYNC:
+		offs[0] = blk == BLK_2 ? SB_BLK2_OFFSET : SB_BLK1_OFFSET;
+		len[0] = blk == BLK_2 ? SB_BLK2_BITS : SB_BLK1_BITS;
+		return 1;
+	case TETRA_TRAIN_NORM_2:
+		offs[0] = blk == BLK_2 ? NDB_BLK2_OFFSET : NDB_BLK1_OFFSET;
+		len[0] = NDB_BLK_BITS;
+		return 1;
+	case TETRA_TRAIN_NORM_1:
+		if (blk != BLK_1)
+			return 0;
+		offs[0] = NDB_BLK1_OFFSET;
+		offs[1] = NDB_BLK2_OFFSET;
+		len[0] = len[1] = NDB_BLK_BITS;
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+void tetra_burst_rx_cb(const uint64_t *burst, unsigned int offs, const int8_t *soft, unsigned int len, enum tetra_train_seq type, void *priv)
+{
+	tetra_burst_rx_snr(burst, offs, soft, len, type, 0, priv);
+}
+
+void tetra_burst_rx_snr(const uint64_t *burst, unsigned int offs, const int8_t *soft, unsigned int len,
+			enum tetra_train_seq type, uint8_t snr, void *priv)
 {
 	uint8_t bbk_buf[NDB_BBK_BITS];
 	uint8_t ndbf_buf[2*NDB_BLK_BITS];
+	int8_t ndbf_soft[2*NDB_BLK_BITS];
+	const int8_t *blk_soft = soft ? ndbf_soft : NULL;
 	struct tetra_mac_state *tms = priv;
 	
-	tms->t_display_st->curr_multiframe = t_phy_state.time.mn;
-	tms->t_display_st->curr_frame = t_phy_state.time.fn;
+	tms->t_display_st->curr_multiframe = tms->phy_state.time.mn;
+	tms->t_display_st->curr_frame = tms->phy_state.time.fn;
+	tms->cur_burst.crc_flags = 0;
+	TETRA_PROF_ADD(TETRA_PROF_BURSTS, 1);
+	if (type < TETRA_STATS_TRAIN_SEQS)
+		TETRA_STAT_ADD(tms->stats.bursts[type], 1);
+
+	/* the quality of the burst, from its training sequence where the data
+	 * sits, before the blocks (and their events) go up */
+	if (!snr && soft && type == TETRA_TRAIN_SYNC)
+		snr = tetra_train_snr(soft + SB_TRAIN_OFFSET, type);
+	else if (!snr && soft && (type == TETRA_TRAIN_NORM_1 || type == TETRA_TRAIN_NORM_2))
+		snr = tetra_train_snr(soft + NDB_TRAIN_OFFSET, type);
+	tms->cur_burst.snr = snr;
+	if (tms->cur_burst.snr) {
+		TETRA_STAT_ADD(tms->stats.snr_sum, tms->cur_burst.snr);
+		TETRA_STAT_ADD(tms->stats.snr_bursts, 1);
+		TETRA_STAT_SET(tms->stats.snr_last, snr);
+	}
 
+	/* only the blocks are unpacked, straight out of the burst buffer. The
+	 * broadcast block is not convolutionally coded and stays hard */
 	switch (type) {
 	case TETRA_TRAIN_SYNC:
 		/* Split SB1, SB2 and Broadcast Block */
 		/* send three parts of the burst via TP-SAP into lower MAC */
-		tp_sap_udata_ind(TPSAP_T_SB1, BLK_1, burst+SB_BLK1_OFFSET, SB_BLK1_BITS, priv);
-		tp_sap_udata_ind(TPSAP_T_BBK, 0,     burst+SB_BBK_OFFSET, SB_BBK_BITS, priv);
-		tp_sap_udata_ind(TPSAP_T_SB2, BLK_2, burst+SB_BLK2_OFFSET, SB_BLK2_BITS, priv);
-		tms->t_display_st->timeslot_content[t_phy_state.time.tn-1] = 3;
+		tetra_pwords2ubit(burst, offs+SB_BLK1_OFFSET, ndbf_buf, SB_BLK1_BITS);
+		if (soft)
+			memcpy(ndbf_soft, soft+SB_BLK1_OFFSET, SB_BLK1_BITS);
+		tp_sap_udata_ind(TPSAP_T_SB1, BLK_1, ndbf_buf, blk_soft, SB_BLK1_BITS, priv);
+		tetra_pwords2ubit(burst, offs+SB_BBK_OFFSET, bbk_buf, SB_BBK_BITS);
+		tp_sap_udata_ind(TPSAP_T_BBK, 0,     bbk_buf, NULL, SB_BBK_BITS, priv);
+		tetra_pwords2ubit(burst, offs+SB_BLK2_OFFSET, ndbf_buf, SB_BLK2_BITS);
+		if (soft)
+			memcpy(ndbf_soft, soft+SB_BLK2_OFFSET, SB_BLK2_BITS);
+		tp_sap_udata_ind(TPSAP_T_SB2, BLK_2, ndbf_buf, blk_soft, SB_BLK2_BITS, priv);
+		tms->t_display_st->timeslot_content[tms->phy_state.time.tn-1] = 3;
 		break;
 	case TETRA_TRAIN_NORM_2:
 		/* re-combine the broadcast block */
-		memcpy(bbk_buf, burst+NDB_BBK1_OFFSET, NDB_BBK1_BITS);
-		memcpy(bbk_buf+NDB_BBK1_BITS, burst+NDB_BBK2_OFFSET, NDB_BBK2_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BBK1_OFFSET, bbk_buf, NDB_BBK1_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BBK2_OFFSET, bbk_buf+NDB_BBK1_BITS, NDB_BBK2_BITS);
 		/* send three parts of the burst via TP-SAP into lower MAC */
-		tp_sap_udata_ind(TPSAP_T_BBK, 0, bbk_buf, NDB_BBK_BITS, priv);
-		tp_sap_udata_ind(TPSAP_T_NDB, BLK_1, burst+NDB_BLK1_OFFSET, NDB_BLK_BITS, priv);
-		tp_sap_udata_ind(TPSAP_T_NDB, BLK_2, burst+NDB_BLK2_OFFSET, NDB_BLK_BITS, priv);
-		tms->t_display_st->timeslot_content[t_phy_state.time.tn-1] = 2;
+		tp_sap_udata_ind(TPSAP_T_BBK, 0, bbk_buf, NULL, NDB_BBK_BITS, priv);
+		tetra_pwords2ubit(burst, offs+NDB_BLK1_OFFSET, ndbf_buf, NDB_BLK_BITS);
+		if (soft)
+			memcpy(ndbf_soft, soft+NDB_BLK1_OFFSET, NDB_BLK_BITS);
+		tp_sap_udata_ind(TPSAP_T_NDB, BLK_1, ndbf_buf, blk_soft, NDB_BLK_BITS, priv);
+		tetra_pwords2ubit(burst, offs+NDB_BLK2_OFFSET, ndbf_buf, NDB_BLK_BITS);
+		if (soft)
+			memcpy(ndbf_soft, soft+NDB_BLK2_OFFSET, NDB_BLK_BITS);
+		tp_sap_udata_ind(TPSAP_T_NDB, BLK_2, ndbf_buf, blk_soft, NDB_BLK_BITS, priv);
+		tms->t_display_st->timeslot_content[tms->phy_state.time.tn-1] = 2;
 		break;
 	case TETRA_TRAIN_NORM_1:
 		/* re-combine the broadcast block */
-		memcpy(bbk_buf, burst+NDB_BBK1_OFFSET, NDB_BBK1_BITS);
-		memcpy(bbk_buf+NDB_BBK1_BITS, burst+NDB_BBK2_OFFSET, NDB_BBK2_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BBK1_OFFSET, bbk_buf, NDB_BBK1_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BBK2_OFFSET, bbk_buf+NDB_BBK1_BITS, NDB_BBK2_BITS);
 		/* re-combine the two parts */
-		memcpy(ndbf_buf, burst+NDB_BLK1_OFFSET, NDB_BLK_BITS);
-		memcpy(ndbf_buf+NDB_BLK_BITS, burst+NDB_BLK2_OFFSET, NDB_BLK_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BLK1_OFFSET, ndbf_buf, NDB_BLK_BITS);
+		tetra_pwords2ubit(burst, offs+NDB_BLK2_OFFSET, ndbf_buf+NDB_BLK_BITS, NDB_BLK_BITS);
+		if (soft) {
+			memcpy(ndbf_soft, soft+NDB_BLK1_OFFSET, NDB_BLK_BITS);
+			memcpy(ndbf_soft+NDB_BLK_BITS, soft+NDB_BLK2_OFFSET, NDB_BLK_BITS);
+		}
 		/* send two parts of the burst via TP-SAP into lower MAC */
-		tp_sap_udata_ind(TPSAP_T_BBK, 0, bbk_buf, NDB_BBK_BITS, priv);
-		tp_sap_udata_ind(TPSAP_T_SCH_F, 0, ndbf_buf, 2*NDB_BLK_BITS, priv);
+		tp_sap_udata_ind(TPSAP_T_BBK, 0, bbk_buf, NULL, NDB_BBK_BITS, priv);
+		tp_sap_udata_ind(TPSAP_T_SCH_F, 0, ndbf_buf, blk_soft, 2*NDB_BLK_BITS, priv);
 		if(!tms->cur_burst.is_traffic) {
-			tms->t_display_st->timeslot_content[t_phy_state.time.tn-1] = 1;
+			tms->t_display_st->timeslot_content[tms->phy_state.time.tn-1] = 1;
 		} else {
-			tms->t_display_st->timeslot_content[t_phy_state.time.tn-1] = 4;
+			tms->t_display_st->timeslot_content[tms->phy_state.time.tn-1] = 4;
 		}
 		break;
 	case TETRA_TRAIN_NORM_3:
 	case TETRA_TRAIN_EXT:
-		/* uplink training sequences, should not be encountered, ignore */
-		tms->t_display_st->timeslot_content[t_phy_state.time.tn-1] = 0;
+	case TETRA_TRAIN_NORM_1_D8PSK:
+	case TETRA_TRAIN_NORM_2_D8PSK:
+	case TETRA_TRAIN_EXT_D8PSK:
+		/* uplink (or D8PSK) training sequences, should not be encountered, ignore */
+		tms->t_display_st->timeslot_content[tms->phy_state.time.tn-1] = 0;
 		break;
 	}
+
+	/* archived with the time the lower MAC ended up with, SB1 sets it */
+	if (tms->burst_archive)
+		tetra_burst_archive_append(tms->burst_archive, &tms->phy_state.time, type,
+					   tms->cur_burst.crc_flags | (soft ? TETRA_BURST_F_SOFT : 0),
+					   tms->cur_burst.snr, burst, offs);
+
+	/* once per slot, what the GUI and the exporters see */
+	tetra_display_publish(tms);
 }
@@ -15,7 +15,8 @@ enum tp_sap_data_type {
 	TPSAP_T_SCH_F,
 };
 
-extern void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bits, unsigned int len, void *priv);
+/* soft holds the reliabilities of bits (positive = '0'), or is NULL for hard bits */
+extern void tp_sap_udata_ind(enum tp_sap_data_type type, int blk_num, const uint8_t *bits, const int8_t *soft, unsigned int len, void *priv);
 
 /* 9.4.4.2.6 Synchronization continuous downlink burst */
 int build_sync_c_d_burst(uint8_t *buf, const uint8_t *sb, const uint8_t *bb, const uint8_t *bkn);
@@ -29,10 +30,29 @@ enum tetra_train_seq {
 	TETRA_TRAIN_NORM_3,
 	TETRA_TRAIN_SYNC,
 	TETRA_TRAIN_EXT,
+	/* 33 and 45 bit variants for D8PSK (N, P and X) */
+	TETRA_TRAIN_NORM_1_D8PSK,
+	TETRA_TRAIN_NORM_2_D8PSK,
+	TETRA_TRAIN_EXT_D8PSK,
 };
 
 /* find a TETRA training sequence in the burst buffer indicated */
 int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
 			 uint32_t mask_of_train_seq, unsigned int *offset);
 
+/* a full burst found by the synchronizer, packed at bit offs of burst. soft
+ * points at the soft value of its first bit, NULL if there are none */
+void tetra_burst_rx_cb(const uint64_t *burst, unsigned int offs, const int8_t *soft, unsigned int len, enum tetra_train_seq type, void *priv);
+
+/* the same with the SNR of the burst (see tetra_train_snr()) already known,
+ * as for a replayed one. 0 estimates it from soft like tetra_burst_rx_cb() */
+void tetra_burst_rx_snr(const uint64_t *burst, unsigned int offs, const int8_t *soft, unsigned int len,
+			enum tetra_train_seq type, uint8_t snr, void *priv);
+
+/* the bits of block blk (BLK_1 or BLK_2) within a burst of type, as up to two
+ * ranges of len[i] bits from offs[i]. Block 1 of a NORM_1 burst is the full
+ * slot SCH/F over both halves, as the TETRA_BURST_F_BLK1_* flags have it.
+ * Returns the number of ranges, 0 where the burst has no such block */
+int tetra_burst_block_ranges(enum tetra_train_seq type, int blk, unsigned int offs[2], unsigned int len[2]);
+
 #endif /* TETRA_BURST_H */
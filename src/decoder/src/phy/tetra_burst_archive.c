@@ -0,0 +1,273 @@
+/* Append-only, memory mapped archive of TETRA bursts */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tetra_common.h"
+#include <tetra_pbits.h>
+#include <phy/tetra_burst_archive.h>
+
+static uint64_t wall_us(void)
+{
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static FILE *open_index(const char *path, const char *mode)
+{
+	size_t len = strlen(path);
+	char *idx_path = malloc(len + 5);
+	FILE *f;
+
+	if (!idx_path)
+		return NULL;
+	memcpy(idx_path, path, len);
+	memcpy(idx_path + len, ".idx", 5);
+	f = fopen(idx_path, mode);
+	free(idx_path);
+	return f;
+}
+
+int tetra_burst_archive_open(struct tetra_burst_archive *ar, const char *path)
+{
+	struct tetra_burst_archive_header hdr;
+
+	memset(ar, 0, offsetof(struct tetra_burst_archive, buf));
+	ar->last_mn = -1;
+	ar->f = fopen(path, "wb");
+	if (!ar->f)
+		return -1;
+	ar->idx = open_index(path, "wb");
+	if (!ar->idx) {
+		fclose(ar->f);
+		ar->f = NULL;
+		return -1;
+	}
+	setvbuf(ar->f, (char *)ar->buf, _IOFBF, sizeof(ar->buf));
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TETRA_BURST_ARCHIVE_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = TETRA_BURST_ARCHIVE_BYTE_ORDER;
+	hdr.version = TETRA_BURST_ARCHIVE_VERSION;
+	hdr.record_size = sizeof(struct tetra_burst_record);
+	hdr.start_us = wall_us();
+	fwrite(&hdr, sizeof(hdr), 1, ar->f);
+	return 0;
+}
+
+void tetra_burst_archive_close(struct tetra_burst_archive *ar)
+{
+	if (ar->f)
+		fclose(ar->f);
+	if (ar->idx)
+		fclose(ar->idx);
+	ar->f = NULL;
+	ar->idx = NULL;
+}
+
+void tetra_burst_archive_append(struct tetra_burst_archive *ar, const struct tetra_tdma_time *time,
+				enum tetra_train_seq type, uint8_t flags, uint8_t snr,
+				const uint64_t *burst, unsigned int offs)
+{
+	struct tetra_burst_record rec;
+
+	if (!ar->f)
+		return;
+
+	/* a new multiframe gets an index entry. The records written so far go
+	 * out with it, so the archive can be read while it grows */
+	if (time->mn != ar->last_mn || time->hn != ar->last_hn) {
+		struct tetra_burst_index_entry ent;
+
+		memset(&ent, 0, sizeof(ent));
+		ent.record = ar->records;
+		ent.wall_us = wall_us();
+		ent.hn = time->hn;
+		ent.mn = time->mn;
+		fflush(ar->f);
+		fwrite(&ent, sizeof(ent), 1, ar->idx);
+		fflush(ar->idx);
+		ar->last_mn = time->mn;
+		ar->last_hn = time->hn;
+	}
+
+	memset(&rec, 0, sizeof(rec));
+	rec.hn = time->hn;
+	rec.mn = time->mn;
+	rec.fn = time->fn;
+	rec.tn = time->tn;
+	rec.train_seq = type;
+	rec.flags = flags;
+	rec.snr = snr;
+	tetra_pwords_copy(rec.bits, 0, burst, offs, TETRA_BITS_PER_TS);
+	if (fwrite(&rec, sizeof(rec), 1, ar->f) != 1) {
+		ar->failed++;
+		return;
+	}
+	ar->records++;
+}
+
+#ifndef _WIN32
+static void *map_file(int fd, size_t *len)
+{
+	struct stat st;
+	void *p;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0)
+		return NULL;
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	/* replay reads straight through */
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+	*len = st.st_size;
+	return p;
+}
+
+static void *map_path(const char *path, int index, size_t *len)
+{
+	FILE *f = index ? open_index(path, "rb") : fopen(path, "rb");
+	void *p;
+
+	if (!f)
+		return NULL;
+	p = map_file(fileno(f), len);
+	fclose(f);
+	return p;
+}
+
+static void unmap_path(void *p, size_t len)
+{
+	munmap(p, len);
+}
+#else
+/* no mmap, the file is read into memory as it is */
+static void *map_path(const char *path, int index, size_t *len)
+{
+	FILE *f = index ? open_index(path, "rb") : fopen(path, "rb");
+	long size;
+	void *p = NULL;
+
+	if (!f)
+		return NULL;
+	if (fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+		p = malloc(size);
+		if (p && fread(p, 1, size, f) != (size_t)size) {
+			free(p);
+			p = NULL;
+		}
+		*len = size;
+	}
+	fclose(f);
+	return p;
+}
+
+static void unmap_path(void *p, size_t len)
+{
+	free(p);
+}
+#endif
+
+int tetra_burst_archive_map(struct tetra_burst_archive_map *m, const char *path)
+{
+	const struct tetra_burst_archive_header *hdr;
+
+	memset(m, 0, sizeof(*m));
+	m->base = map_path(path, 0, &m->len);
+	if (!m->base)
+		return -1;
+	hdr = m->base;
+	if (m->len < sizeof(*hdr) || memcmp(hdr->magic, TETRA_BURST_ARCHIVE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->byte_order != TETRA_BURST_ARCHIVE_BYTE_ORDER || hdr->version != TETRA_BURST_ARCHIVE_VERSION ||
+	    hdr->record_size != sizeof(struct tetra_burst_record)) {
+		tetra_burst_archive_unmap(m);
+		return -1;
+	}
+	m->hdr = hdr;
+	m->records = (const struct tetra_burst_record *)(hdr + 1);
+	m->nr_records = (m->len - sizeof(*hdr)) / sizeof(struct tetra_burst_record);
+
+	/* an index entry may be ahead of the records that made it to the disk */
+	m->idx_base = map_path(path, 1, &m->idx_len);
+	if (m->idx_base) {
+		m->index = m->idx_base;
+		m->nr_index = m->idx_len / sizeof(struct tetra_burst_index_entry);
+		while (m->nr_index && m->index[m->nr_index - 1].record >= m->nr_records)
+			m->nr_index--;
+	}
+	return 0;
+}
+
+void tetra_burst_archive_unmap(struct tetra_burst_archive_map *m)
+{
+	if (m->base)
+		unmap_path(m->base, m->len);
+	if (m->idx_base)
+		unmap_path(m->idx_base, m->idx_len);
+	memset(m, 0, sizeof(*m));
+}
+
+uint64_t tetra_burst_archive_find(const struct tetra_burst_archive_map *m, uint16_t hn, uint8_t mn)
+{
+	uint64_t i;
+
+	if (m->index) {
+		for (i = 0; i < m->nr_index; i++) {
+			if (m->index[i].hn == hn && m->index[i].mn == mn)
+				return m->index[i].record;
+		}
+		return m->nr_records;
+	}
+	for (i = 0; i < m->nr_records; i++) {
+		if (m->records[i].hn == hn && m->records[i].mn == mn)
+			return i;
+	}
+	return m->nr_records;
+}
+
+uint64_t tetra_burst_archive_seek_us(const struct tetra_burst_archive_map *m, uint64_t wall_us)
+{
+	uint64_t lo = 0, hi = m->nr_index;
+
+	/* the entries are in the order they were written */
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (m->index[mid].wall_us < wall_us)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < m->nr_index ? m->index[lo].record : (m->nr_index ? m->nr_records : 0);
+}
+
+void tetra_burst_archive_replay(const struct tetra_burst_record *rec, const int8_t *soft, struct tetra_mac_state *tms)
+{
+	tms->phy_state.time.hn = rec->hn;
+	tms->phy_state.time.mn = rec->mn;
+	tms->phy_state.time.fn = rec->fn;
+	tms->phy_state.time.tn = rec->tn;
+	tms->phy_state.time.sn = 1;
+	tetra_burst_rx_snr(rec->bits, 0, soft, TETRA_BITS_PER_TS, rec->train_seq, rec->snr, tms);
+}
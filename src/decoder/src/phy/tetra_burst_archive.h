@@ -0,0 +1,119 @@
+#ifndef TETRA_BURST_ARCHIVE_H
+#define TETRA_BURST_ARCHIVE_H
+
+/* On-disk archive of locked bursts, as the synchronizer hands them to
+ * tetra_burst_rx_cb(). Fixed-size records are appended one per burst, so the
+ * file maps straight into an array of them and replays from the burst level
+ * without running the DSP again. A sidecar index (<path>.idx) points at the
+ * first record of every multiframe, with the wall clock it was written at.
+ *
+ * Everything is in host byte order: a reader on the other byte order sees
+ * byte_order swapped and refuses the file. The bits are the decided ones,
+ * the record does not keep the soft values of a soft decision input */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "tetra_common.h"
+#include <phy/tetra_burst.h>
+
+#define TETRA_BURST_ARCHIVE_MAGIC	"TETRABUR"
+#define TETRA_BURST_ARCHIVE_BYTE_ORDER	0x1A2B3C4D
+#define TETRA_BURST_ARCHIVE_VERSION	1
+/* 64 kB of records between writes, a little under 15 s of a busy carrier */
+#define TETRA_BURST_ARCHIVE_BUF_SIZE	65536
+
+/* flags of a record. Block 1 stands for the full slot block of an SCH/F */
+#define TETRA_BURST_F_BLK1_CRC	(1 << 0)	/* block 1 was decoded and has a CRC */
+#define TETRA_BURST_F_BLK1_OK	(1 << 1)	/* ... which checked out */
+#define TETRA_BURST_F_BLK2_CRC	(1 << 2)
+#define TETRA_BURST_F_BLK2_OK	(1 << 3)
+#define TETRA_BURST_F_SOFT	(1 << 4)	/* the blocks were decoded from soft bits */
+
+/* 32 bytes at the start of the archive */
+struct tetra_burst_archive_header {
+	char magic[8];			/* TETRA_BURST_ARCHIVE_MAGIC, no terminator */
+	uint32_t byte_order;		/* TETRA_BURST_ARCHIVE_BYTE_ORDER */
+	uint16_t version;		/* TETRA_BURST_ARCHIVE_VERSION */
+	uint16_t record_size;		/* sizeof(struct tetra_burst_record) */
+	uint64_t start_us;		/* wall clock the archive was opened at, us since the epoch */
+	uint8_t reserved[8];
+};
+
+/* 72 bytes per burst */
+struct tetra_burst_record {
+	uint16_t hn;			/* TDMA time of the burst, after the lower MAC saw it */
+	uint8_t mn;
+	uint8_t fn;
+	uint8_t tn;
+	uint8_t train_seq;		/* enum tetra_train_seq the synchronizer found */
+	uint8_t flags;			/* TETRA_BURST_F_* */
+	uint8_t snr;			/* see tetra_train_snr(), 0 if unknown */
+	uint64_t bits[TETRA_PWORDS(TETRA_BITS_PER_TS)];	/* the burst, packed from bit 0 (see tetra_pbits.h) */
+};
+
+/* 24 bytes per multiframe in the sidecar index */
+struct tetra_burst_index_entry {
+	uint64_t record;		/* number of the first record of the multiframe */
+	uint64_t wall_us;		/* wall clock it was written at, us since the epoch */
+	uint16_t hn;
+	uint8_t mn;
+	uint8_t reserved[5];
+};
+
+/* the writing end, owned by the decoder thread between open and close */
+struct tetra_burst_archive {
+	FILE *f;
+	FILE *idx;
+	uint64_t records;		/* appended so far */
+	uint64_t failed;		/* records lost to write errors */
+	int last_mn;			/* multiframe of the last record, -1 before the first */
+	uint16_t last_hn;
+	unsigned char buf[TETRA_BURST_ARCHIVE_BUF_SIZE];
+};
+
+/* create (truncate) the archive at path and its index. Returns 0, or -1 if
+ * either file cannot be opened */
+int tetra_burst_archive_open(struct tetra_burst_archive *ar, const char *path);
+void tetra_burst_archive_close(struct tetra_burst_archive *ar);
+
+/* append the TETRA_BITS_PER_TS bits of a burst, packed at bit offs of burst */
+void tetra_burst_archive_append(struct tetra_burst_archive *ar, const struct tetra_tdma_time *time,
+				enum tetra_train_seq type, uint8_t flags, uint8_t snr,
+				const uint64_t *burst, unsigned int offs);
+
+/* an archive mapped for reading. index is NULL (nr_index 0) if the sidecar
+ * is missing, a record cut short by a crash is left out */
+struct tetra_burst_archive_map {
+	const struct tetra_burst_archive_header *hdr;
+	const struct tetra_burst_record *records;
+	uint64_t nr_records;
+	const struct tetra_burst_index_entry *index;
+	uint64_t nr_index;
+
+	void *base;
+	size_t len;
+	void *idx_base;
+	size_t idx_len;
+};
+
+/* map the archive at path. Returns 0, or -1 if it cannot be read or is not an
+ * archive of this version and byte order */
+int tetra_burst_archive_map(struct tetra_burst_archive_map *m, const char *path);
+void tetra_burst_archive_unmap(struct tetra_burst_archive_map *m);
+
+/* the first record of multiframe hn/mn, nr_records if there is none. Scans
+ * the records if there is no index */
+uint64_t tetra_burst_archive_find(const struct tetra_burst_archive_map *m, uint16_t hn, uint8_t mn);
+
+/* the first record written at or after wall clock wall_us, by the index.
+ * 0 without one */
+uint64_t tetra_burst_archive_seek_us(const struct tetra_burst_archive_map *m, uint64_t wall_us);
+
+/* feed one record through tetra_burst_rx_cb() into the lower MAC of tms,
+ * from the TDMA time it was recorded at and with its SNR. soft holds TETRA_BITS_PER_TS soft
+ * values to decode the blocks from instead of the bits, or is NULL */
+void tetra_burst_archive_replay(const struct tetra_burst_record *rec, const int8_t *soft, struct tetra_mac_state *tms);
+
+#endif /* TETRA_BURST_ARCHIVE_H */
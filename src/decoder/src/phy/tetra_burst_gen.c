@@ -0,0 +1,330 @@
+/* Synthetic TETRA continuous downlink, the transmit side of the lower MAC */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tetra_common.h"
+#include "tetra_mac_pdu.h"
+
+#include <phy/tetra_burst.h>
+#include <phy/tetra_burst_gen.h>
+#include <lower_mac/crc_simple.h>
+#include <lower_mac/tetra_conv_enc.h>
+#include <lower_mac/tetra_interleave.h>
+#include <lower_mac/tetra_scramb.h>
+#include <lower_mac/tetra_rm3014.h>
+
+/* type-1 bits, type-5 bits and interleaver parameter a of the blocks, as in
+ * tetra_blk_param of the lower MAC */
+#define GEN_SB1_TYPE1	60
+#define GEN_SB1_TYPE5	120
+#define GEN_SB1_A	11
+#define GEN_SB2_TYPE1	124
+#define GEN_SB2_TYPE5	216
+#define GEN_SB2_A	101
+#define GEN_SCHF_TYPE1	268
+#define GEN_SCHF_TYPE5	432
+#define GEN_SCHF_A	103
+#define GEN_AACH_TYPE1	14
+#define GEN_AACH_TYPE5	30
+
+/* octets of the MAC-RESOURCE of a random slot: its 43 bit header and an
+ * LLC PDU type at least, and room for the null PDU behind it */
+#define GEN_RANDOM_MIN_OCTETS	6
+#define GEN_RANDOM_MAX_OCTETS	31
+
+/* usage marker of the call on timeslot tn, 4 and up mean traffic */
+#define GEN_USAGE_MARKER(tn)	(4 + (tn))
+
+/* the slot of frame 18 the cell sends its BSCH and BNCH in, where is_bnch()
+ * of the lower MAC expects them */
+static int gen_is_bnch(const struct tetra_tdma_time *t)
+{
+	return t->fn == 18 && t->tn == 4 - ((t->mn + 3) % 4);
+}
+
+/* xorshift64*, the same stream of bits on every platform */
+static uint64_t gen_rand(struct tetra_burst_gen *gen)
+{
+	gen->rng ^= gen->rng >> 12;
+	gen->rng ^= gen->rng << 25;
+	gen->rng ^= gen->rng >> 27;
+	return gen->rng * 0x2545f4914f6cdd1dULL;
+}
+
+static void gen_rand_bits(struct tetra_burst_gen *gen, uint8_t *out, int len)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((i & 63) == 0)
+			r = gen_rand(gen);
+		out[i] = (r >> (i & 63)) & 1;
+	}
+}
+
+/* n bits of v, MSB first, at *pos */
+static void put_bits(uint8_t *out, unsigned int *pos, uint32_t v, int n)
+{
+	int i;
+
+	for (i = n - 1; i >= 0; i--)
+		out[(*pos)++] = (v >> i) & 1;
+}
+
+/* type-1 to type-5 bits: CRC and tail bits, 2/3 rate punctured mother code,
+ * block interleaving and scrambling (8.2) */
+static void encode_block(const uint8_t *type1, int type1_bits, int type5_bits, uint32_t a,
+			 uint32_t lfsr_init, uint8_t *out)
+{
+	uint8_t type2[GEN_SCHF_TYPE1 + 16 + 4];
+	uint8_t mother[4 * sizeof(type2)];
+	uint8_t type3[GEN_SCHF_TYPE5];
+	struct conv_enc_state ces;
+	int type2_bits = type1_bits + 16 + 4;
+	uint16_t crc;
+	unsigned int pos = type1_bits;
+
+	memcpy(type2, type1, type1_bits);
+	/* the receiver checks for the residue TETRA_CRC_OK over data and CRC */
+	crc = ~crc16_ccitt_bits(type2, type1_bits);
+	put_bits(type2, &pos, crc, 16);
+	put_bits(type2, &pos, 0, 4);
+
+	conv_enc_init(&ces);
+	conv_enc_input(&ces, type2, type2_bits, mother);
+	get_punctured_rate(TETRA_RCPC_PUNCT_2_3, mother, type5_bits, type3);
+	block_interleave(type5_bits, a, type3, out);
+	tetra_scramb_bits(lfsr_init, out, type5_bits);
+}
+
+/* 21.4.7.2 ACCESS-ASSIGN, RM(30,14) coded and scrambled */
+static void encode_aach(struct tetra_burst_gen *gen, uint8_t *out)
+{
+	const struct tetra_tdma_time *t = &gen->time;
+	uint16_t aach;
+	uint32_t cw;
+	int i;
+
+	if (t->fn != 18 && gen->cell.slot_pattern[t->tn - 1] == TETRA_GEN_SLOT_TRAFFIC) {
+		/* DL and UL usage markers of the call */
+		aach = (TETRA_ACC_ASS_DLF1_ULF1 << 12) | (GEN_USAGE_MARKER(t->tn) << 6) | GEN_USAGE_MARKER(t->tn);
+	} else {
+		/* common control, both access fields open to access code A */
+		aach = TETRA_ACC_ASS_DLCC_ULCO << 12;
+	}
+	cw = tetra_rm3014_compute(aach);
+	for (i = 0; i < GEN_AACH_TYPE5; i++)
+		out[i] = (cw >> (GEN_AACH_TYPE5 - 1 - i)) & 1;
+	tetra_scramb_bits(gen->scramb_init, out, GEN_AACH_TYPE5);
+}
+
+/* 21.4.4.2 SYNC with 18.4.2.1 D-MLE-SYNC */
+static void encode_sync(struct tetra_burst_gen *gen, uint8_t *out)
+{
+	const struct tetra_tdma_time *t = &gen->time;
+	uint8_t pdu[GEN_SB1_TYPE1];
+	unsigned int pos = 0;
+
+	put_bits(pdu, &pos, 0, 4);			/* system code */
+	put_bits(pdu, &pos, gen->cell.colour_code, 6);
+	put_bits(pdu, &pos, t->tn - 1, 2);
+	put_bits(pdu, &pos, t->fn, 5);
+	put_bits(pdu, &pos, t->mn, 6);
+	put_bits(pdu, &pos, 0, 2);			/* sharing mode: continuous */
+	put_bits(pdu, &pos, 0, 3);			/* TS reserved frames */
+	put_bits(pdu, &pos, 0, 1);			/* U-plane DTX */
+	put_bits(pdu, &pos, 0, 1);			/* frame 18 extension */
+	put_bits(pdu, &pos, 0, 1);			/* reserved */
+	put_bits(pdu, &pos, gen->cell.mcc, 10);
+	put_bits(pdu, &pos, gen->cell.mnc, 14);
+	put_bits(pdu, &pos, 0, 2);			/* neighbour cell broadcast */
+	put_bits(pdu, &pos, 0, 2);			/* cell service level */
+	put_bits(pdu, &pos, 0, 1);			/* late entry */
+
+	encode_block(pdu, GEN_SB1_TYPE1, GEN_SB1_TYPE5, GEN_SB1_A, SCRAMB_INIT, out);
+}
+
+/* 21.4.4.1 SYSINFO with 18.4.2.2 D-MLE-SYSINFO, in the layout macpdu_decode_sysinfo() reads */
+static void encode_sysinfo(struct tetra_burst_gen *gen, uint8_t *out)
+{
+	const struct tetra_gen_cell *c = &gen->cell;
+	uint8_t pdu[GEN_SB2_TYPE1];
+	unsigned int pos = 0;
+
+	put_bits(pdu, &pos, TETRA_PDU_T_BROADCAST, 2);
+	put_bits(pdu, &pos, 0, 2);			/* SYSINFO */
+	put_bits(pdu, &pos, c->main_carrier, 12);
+	put_bits(pdu, &pos, c->freq_band, 4);
+	put_bits(pdu, &pos, c->freq_offset, 2);
+	put_bits(pdu, &pos, c->duplex_spacing, 3);
+	put_bits(pdu, &pos, 0, 1);			/* reverse operation */
+	put_bits(pdu, &pos, 0, 2);			/* no secondary control channels */
+	put_bits(pdu, &pos, 7, 3);			/* MS_TXPWR_MAX_CELL */
+	put_bits(pdu, &pos, 0, 4);			/* RXLEV_ACCESS_MIN */
+	put_bits(pdu, &pos, 0, 4);			/* ACCESS_PARAMETER */
+	put_bits(pdu, &pos, 0, 4);			/* RADIO_DOWNLINK_TIMEOUT */
+	put_bits(pdu, &pos, 0, 1);			/* hyperframe number follows */
+	put_bits(pdu, &pos, gen->time.hn, 16);
+	put_bits(pdu, &pos, 0, 2);			/* optional field: even multiframe bitmap */
+	put_bits(pdu, &pos, 0xfffff, 20);
+	put_bits(pdu, &pos, c->la, 14);
+	put_bits(pdu, &pos, 0xffff, 16);		/* subscriber class */
+	put_bits(pdu, &pos, 0, 12);			/* BS service details */
+
+	encode_block(pdu, GEN_SB2_TYPE1, GEN_SB2_TYPE5, GEN_SB2_A, gen->scramb_init, out);
+}
+
+/* 21.4.3.1 MAC-RESOURCE null PDU at *pos, then fill bits */
+static void put_null_pdu(uint8_t *out, unsigned int *pos)
+{
+	put_bits(out, pos, TETRA_PDU_T_MAC_RESOURCE, 2);
+	put_bits(out, pos, 0, 1);		/* fill bit indication */
+	put_bits(out, pos, 0, 1);		/* position of grant */
+	put_bits(out, pos, 0, 2);		/* encryption mode */
+	put_bits(out, pos, 0, 1);		/* random access flag */
+	put_bits(out, pos, 2, 6);		/* length: 2 octets */
+	put_bits(out, pos, ADDR_TYPE_NULL, 3);
+	out[*pos] = 1;
+}
+
+/* SCH/F of a timeslot in common control, or the TCH/S of a call */
+static void encode_full_slot(struct tetra_burst_gen *gen, uint8_t *out)
+{
+	const struct tetra_tdma_time *t = &gen->time;
+	uint8_t pdu[GEN_SCHF_TYPE1];
+	unsigned int pos = 0, len;
+	uint8_t pattern = gen->cell.slot_pattern[t->tn - 1];
+
+	if (t->fn == 18)
+		pattern = TETRA_GEN_SLOT_IDLE;
+
+	switch (pattern) {
+	case TETRA_GEN_SLOT_TRAFFIC:
+		/* speech is not CRC protected, random type-5 bits are all the codec needs */
+		gen_rand_bits(gen, out, GEN_SCHF_TYPE5);
+		gen->traffic_bursts++;
+		return;
+	case TETRA_GEN_SLOT_RANDOM:
+		/* 21.4.3.1 MAC-RESOURCE to a random SSI with a random TM-SDU, the
+		 * LLC and layer 3 parsers get random bits in a well-formed MAC PDU.
+		 * The null PDU after it ends the slot for the upper MAC */
+		memset(pdu, 0, sizeof(pdu));
+		len = GEN_RANDOM_MIN_OCTETS + gen_rand(gen) % (GEN_RANDOM_MAX_OCTETS - GEN_RANDOM_MIN_OCTETS + 1);
+		put_bits(pdu, &pos, TETRA_PDU_T_MAC_RESOURCE, 2);
+		put_bits(pdu, &pos, 0, 1);		/* fill bit indication */
+		put_bits(pdu, &pos, 0, 1);		/* position of grant */
+		put_bits(pdu, &pos, 0, 2);		/* encryption mode */
+		put_bits(pdu, &pos, 0, 1);		/* random access flag */
+		put_bits(pdu, &pos, len, 6);		/* length in octets */
+		put_bits(pdu, &pos, ADDR_TYPE_SSI, 3);
+		put_bits(pdu, &pos, gen_rand(gen) & 0xffffff, 24);
+		put_bits(pdu, &pos, 0, 1);		/* power control */
+		put_bits(pdu, &pos, 0, 1);		/* slot granting */
+		put_bits(pdu, &pos, 0, 1);		/* channel allocation */
+		gen_rand_bits(gen, pdu + pos, len * 8 - pos);
+		pos = len * 8;
+		put_null_pdu(pdu, &pos);
+		break;
+	default:
+		memset(pdu, 0, sizeof(pdu));
+		put_null_pdu(pdu, &pos);
+		break;
+	}
+	encode_block(pdu, GEN_SCHF_TYPE1, GEN_SCHF_TYPE5, GEN_SCHF_A, gen->scramb_init, out);
+}
+
+void tetra_gen_cell_default(struct tetra_gen_cell *cell)
+{
+	memset(cell, 0, sizeof(*cell));
+	cell->mcc = 901;
+	cell->mnc = 1;
+	cell->colour_code = 1;
+	cell->la = 1;
+	cell->main_carrier = 1000;
+	cell->freq_band = 4;
+}
+
+int tetra_gen_parse_pattern(const char *str, uint8_t *pattern)
+{
+	int len = strlen(str);
+	int i;
+
+	if (len == 0)
+		return -1;
+	for (i = 0; i < 4; i++) {
+		switch (str[i % len]) {
+		case 'i':
+			pattern[i] = TETRA_GEN_SLOT_IDLE;
+			break;
+		case 'r':
+			pattern[i] = TETRA_GEN_SLOT_RANDOM;
+			break;
+		case 't':
+			pattern[i] = TETRA_GEN_SLOT_TRAFFIC;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void tetra_burst_gen_init(struct tetra_burst_gen *gen, const struct tetra_gen_cell *cell, uint64_t seed)
+{
+	memset(gen, 0, sizeof(*gen));
+	gen->cell = *cell;
+	gen->time.hn = 1;
+	gen->time.sn = 1;
+	gen->time.tn = 1;
+	gen->time.fn = 1;
+	gen->time.mn = 1;
+	gen->scramb_init = tetra_scramb_get_init(cell->mcc, cell->mnc, cell->colour_code);
+	/* xorshift must not start at 0 */
+	gen->rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+}
+
+int tetra_burst_gen_next(struct tetra_burst_gen *gen, uint8_t *out)
+{
+	struct tetra_tdma_time *t = &gen->time;
+	uint8_t blk1[GEN_SCHF_TYPE5], blk2[GEN_SB2_TYPE5], bb[GEN_AACH_TYPE5];
+	int len;
+
+	encode_aach(gen, bb);
+	if (gen_is_bnch(t)) {
+		encode_sync(gen, blk1);
+		encode_sysinfo(gen, blk2);
+		len = build_sync_c_d_burst(out, blk1, bb, blk2);
+		gen->sync_bursts++;
+	} else {
+		/* one full slot block over both halves, training sequence 1 */
+		encode_full_slot(gen, blk1);
+		len = build_norm_c_d_burst(out, blk1, bb, blk1 + GEN_SB2_TYPE5, 0);
+	}
+	gen->bursts++;
+
+	if (++t->tn > 4) {
+		t->tn = 1;
+		if (++t->fn > 18) {
+			t->fn = 1;
+			if (++t->mn > 60) {
+				t->mn = 1;
+				t->hn++;
+			}
+		}
+	}
+	return len;
+}
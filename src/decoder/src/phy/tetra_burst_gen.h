@@ -0,0 +1,64 @@
+#ifndef TETRA_BURST_GEN_H
+#define TETRA_BURST_GEN_H
+
+/* Synthetic TETRA downlink: the continuous downlink bursts of a cell, built
+ * from its PDUs through the transmit side of the lower MAC (CRC, tail bits,
+ * convolutional code, puncturing, interleaving and scrambling), for load
+ * and regression tests without live RF. The decoder locks on the result and
+ * sees valid SYNC, SYSINFO and ACCESS-ASSIGN PDUs */
+
+#include <stdint.h>
+
+#include "tetra_tdma.h"
+
+/* bits of one burst, 255 symbols */
+#define TETRA_GEN_BURST_BITS	510
+
+/* what a timeslot carries in frames 1 .. 17 */
+enum tetra_gen_slot {
+	TETRA_GEN_SLOT_IDLE,		/* SCH/F with a null PDU */
+	TETRA_GEN_SLOT_RANDOM,		/* SCH/F with a MAC-RESOURCE of random TM-SDU bits, the LLC and L3 parsers get to work */
+	TETRA_GEN_SLOT_TRAFFIC,		/* TCH/S of random bits, the AACH marks the slot traffic so the codec runs */
+};
+
+struct tetra_gen_cell {
+	uint16_t mcc;
+	uint16_t mnc;
+	uint8_t colour_code;
+	uint16_t la;
+	/* as the SYSINFO gives them, see tetra_dl_carrier_hz() */
+	uint16_t main_carrier;
+	uint8_t freq_band;
+	uint8_t freq_offset;
+	uint8_t duplex_spacing;
+	uint8_t slot_pattern[4];	/* enum tetra_gen_slot of timeslots 1 .. 4 */
+};
+
+struct tetra_burst_gen {
+	struct tetra_gen_cell cell;
+	struct tetra_tdma_time time;	/* of the next burst */
+	uint32_t scramb_init;
+	uint64_t rng;
+	/* bursts generated, and of them sync and traffic bursts */
+	uint64_t bursts;
+	uint64_t sync_bursts;
+	uint64_t traffic_bursts;
+};
+
+/* a cell with every timeslot idle */
+void tetra_gen_cell_default(struct tetra_gen_cell *cell);
+
+/* Pattern of the four timeslots from a string like "itrr": i(dle), r(andom)
+ * or t(raffic) per slot, a shorter string repeats. -1 if it has other
+ * characters */
+int tetra_gen_parse_pattern(const char *str, uint8_t *pattern);
+
+/* the generator starts at TN 1, FN 1, MN 1, the random bits come from seed */
+void tetra_burst_gen_init(struct tetra_burst_gen *gen, const struct tetra_gen_cell *cell, uint64_t seed);
+
+/* Write the TETRA_GEN_BURST_BITS bits of the next burst, one bit per byte,
+ * and move on by a timeslot. A sync burst with SYNC and SYSINFO goes out in
+ * frame 18 where the BNCH is, every other burst is a normal one */
+int tetra_burst_gen_next(struct tetra_burst_gen *gen, uint8_t *out);
+
+#endif /* TETRA_BURST_GEN_H */
@@ -30,38 +30,212 @@
 #include <phy/tetra_burst.h>
 #include <tetra_tdma.h>
 #include <phy/tetra_burst_sync.h>
+#include <phy/tetra_train_corr.h>
 
-struct tetra_phy_state t_phy_state;
+/* length of the synchronization training sequence y */
+#define TRAIN_SEQ_SYNC_BITS	38
+/* length of the normal training sequences */
+#define TRAIN_SEQ_NORM_BITS	22
+/* where the training sequences start in a downlink slot */
+#define TRAIN_SEQ_SYNC_OFFS	214
+#define TRAIN_SEQ_NORM_OFFS	244
 
-void tetra_burst_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv);
+/* After the training sequences are lost the slot timing and the TDMA time are
+ * kept for this many slots, four multiframes, and every predicted slot is
+ * looked at for a training sequence up to REACQ_WINDOW_BITS early or late.
+ * That covers the symbols the clock recovery slips during a fade */
+#define REACQ_SLOTS		(4 * 18 * 4)
+#define REACQ_WINDOW_BITS	16
 
-static void make_bitbuf_space(struct tetra_rx_state *trs, unsigned int len)
+#define DQPSK_BITS_PER_SYM	2
+
+/* Look for the training sequence of a locked burst starting at bit first of
+ * the bitbuf (which may be before bitbuf_head, the bits just consumed are
+ * still there) where it is predicted, the SYNC one and both downlink normal
+ * ones */
+static int locked_find(struct tetra_rx_state *trs, unsigned int first)
+{
+	unsigned int offs;
+	int rc;
+
+	rc = tetra_train_corr_find(trs->bitbuf, first + TRAIN_SEQ_NORM_OFFS, TRAIN_SEQ_NORM_BITS,
+				   (1 << TETRA_TRAIN_NORM_1) | (1 << TETRA_TRAIN_NORM_2),
+				   trs->train_seq_max_errors, &offs);
+	if (rc < 0)
+		rc = tetra_train_corr_find(trs->bitbuf, first + TRAIN_SEQ_SYNC_OFFS, TRAIN_SEQ_SYNC_BITS,
+					   (1 << TETRA_TRAIN_SYNC), trs->train_seq_max_errors, &offs);
+	return rc;
+}
+
+/* A locked burst that is not where it is predicted, up to max_slip_bits
+ * early or late by whole symbols, the smaller slips first. Returns the
+ * sequence and writes how many bits late the burst is to delta, or -1 */
+static int slip_find(struct tetra_rx_state *trs, int *delta)
+{
+	int d, rc;
+
+	for (d = DQPSK_BITS_PER_SYM; d <= (int)trs->max_slip_bits; d += DQPSK_BITS_PER_SYM) {
+		/* the ring is mirrored, a burst that starts before bit 0 of it
+		 * is the one at the end of the first copy. The consumed bits are
+		 * gone once the ring is nearly full */
+		if (trs->bits_in_buf + d <= TETRA_RX_BITBUF_BITS) {
+			rc = locked_find(trs, (trs->bitbuf_head + TETRA_RX_BITBUF_BITS - d) % TETRA_RX_BITBUF_BITS);
+			if (rc >= 0) {
+				*delta = -d;
+				return rc;
+			}
+		}
+		rc = locked_find(trs, trs->bitbuf_head + d);
+		if (rc >= 0) {
+			*delta = d;
+			return rc;
+		}
+	}
+	return -1;
+}
+
+/* drop the first 'len' bits of the bitbuf, nothing is moved */
+static void consume_bitbuf(struct tetra_rx_state *trs, unsigned int len)
+{
+	trs->bits_in_buf -= len;
+	trs->bitbuf_head = (trs->bitbuf_head + len) % TETRA_RX_BITBUF_BITS;
+	trs->bitbuf_start_bitnum += len;
+}
+
+/* returns how many leading bits of the input do not fit into the bitbuf at all */
+static unsigned int make_bitbuf_space(struct tetra_rx_state *trs, unsigned int len)
 {
-	unsigned int bitbuf_space = sizeof(trs->bitbuf) - trs->bits_in_buf;
+	unsigned int bitbuf_space = TETRA_RX_BITBUF_BITS - trs->bits_in_buf;
+	unsigned int skip = 0;
+
+	if (len > TETRA_RX_BITBUF_BITS) {
+		skip = len - TETRA_RX_BITBUF_BITS;
+		len = TETRA_RX_BITBUF_BITS;
+	}
 
 	if (bitbuf_space < len) {
 		unsigned int delta = len - bitbuf_space;
 
 		DEBUGP("bitbuf left: %u, shrinking by %u\n", bitbuf_space, delta);
-		memmove(trs->bitbuf, trs->bitbuf + delta, trs->bits_in_buf - delta);
-		trs->bits_in_buf -= delta;
-		trs->bitbuf_start_bitnum += delta;
-		bitbuf_space = sizeof(trs->bitbuf) - trs->bits_in_buf;
+		consume_bitbuf(trs, delta);
 	}
+	trs->bitbuf_start_bitnum += skip;
+
+	return skip;
 }
 
-/* input a raw bitstream into the tetra burst synchronizaer */
-int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len)
+/* append bits [done, len) of the input to the ring, every bit goes into both copies */
+static void append_bitbuf(struct tetra_rx_state *trs, const uint8_t *bits,
+			  const int8_t *soft, const uint64_t *words, unsigned int done, unsigned int len)
+{
+	while (done < len) {
+		unsigned int pos = (trs->bitbuf_head + trs->bits_in_buf) % TETRA_RX_BITBUF_BITS;
+		unsigned int n = TETRA_RX_BITBUF_BITS - pos;
+
+		if (n > len - done)
+			n = len - done;
+
+		if (bits) {
+			tetra_ubit2pwords(bits + done, trs->bitbuf, pos, n);
+			tetra_ubit2pwords(bits + done, trs->bitbuf, pos + TETRA_RX_BITBUF_BITS, n);
+		} else if (soft) {
+			tetra_sbit2pwords(soft + done, trs->bitbuf, pos, n);
+			tetra_sbit2pwords(soft + done, trs->bitbuf, pos + TETRA_RX_BITBUF_BITS, n);
+			memcpy(&trs->softbuf[pos], soft + done, n);
+			memcpy(&trs->softbuf[pos + TETRA_RX_BITBUF_BITS], soft + done, n);
+		} else {
+			tetra_pwords_copy(trs->bitbuf, pos, words, done, n);
+			tetra_pwords_copy(trs->bitbuf, pos + TETRA_RX_BITBUF_BITS, words, done, n);
+		}
+
+		trs->bits_in_buf += n;
+		done += n;
+	}
+}
+
+/* Look for a training sequence of the slot starting REACQ_WINDOW_BITS into the
+ * bitbuf, where it is predicted first and then anywhere in the window. Returns
+ * the sequence and writes how many bits late the slot is to delta, or -1 */
+static int reacq_find(struct tetra_rx_state *trs, int *delta)
 {
+	unsigned int head = trs->bitbuf_head + REACQ_WINDOW_BITS;
+	unsigned int offs;
 	int rc;
+
+	rc = locked_find(trs, head);
+	if (rc >= 0) {
+		*delta = 0;
+		return rc;
+	}
+
+	rc = tetra_train_corr_find(trs->bitbuf, head - REACQ_WINDOW_BITS + TRAIN_SEQ_NORM_OFFS,
+				   2 * REACQ_WINDOW_BITS + TRAIN_SEQ_NORM_BITS,
+				   (1 << TETRA_TRAIN_NORM_1) | (1 << TETRA_TRAIN_NORM_2),
+				   trs->train_seq_max_errors, &offs);
+	if (rc < 0)
+		rc = tetra_train_corr_find(trs->bitbuf, head - REACQ_WINDOW_BITS + TRAIN_SEQ_SYNC_OFFS,
+					   2 * REACQ_WINDOW_BITS + TRAIN_SEQ_SYNC_BITS,
+					   (1 << TETRA_TRAIN_SYNC), trs->train_seq_max_errors, &offs);
+	if (rc >= 0)
+		*delta = (int)offs - REACQ_WINDOW_BITS;
+	return rc;
+}
+
+/* One predicted slot while reacquiring. The slot is expected at
+ * next_frame_start_bitnum, the bitbuf is kept from REACQ_WINDOW_BITS before it */
+static int reacquire_run(struct tetra_rx_state *trs, unsigned int len)
+{
+	struct tetra_mac_state *tms = trs->burst_cb_priv;
+	unsigned int win_start = trs->next_frame_start_bitnum - REACQ_WINDOW_BITS;
 	unsigned int train_seq_offs;
+	int rc, delta;
 
-	DEBUGP("burst_sync_in: %u bits, state %u\n", len, trs->state);
+	if ((int)(win_start - trs->bitbuf_start_bitnum) < 0) {
+		/* the window was pushed out of the bitbuf */
+		trs->state = RX_S_UNLOCKED;
+		return len;
+	}
+	/* the whole window, and every start of a SYNC in the slot */
+	if (trs->bitbuf_start_bitnum + trs->bits_in_buf < win_start + TETRA_BITS_PER_TS + TRAIN_SEQ_SYNC_BITS)
+		return len;
+	consume_bitbuf(trs, win_start - trs->bitbuf_start_bitnum);
+
+	rc = reacq_find(trs, &delta);
+	if (rc >= 0) {
+		/* back on the slot, which goes out as soon as it is all in */
+		DEBUGP("-> reacquired %d bits off the predicted timing\n", delta);
+		trs->next_frame_start_bitnum += delta;
+		trs->state = RX_S_KNOW_FSTART;
+		TETRA_STAT_ADD(tms->stats.reacquired, 1);
+		return len;
+	}
+
+	/* a SYNC anywhere else sets the timing anew, as in the unlocked state */
+	rc = tetra_train_corr_find(trs->bitbuf, trs->bitbuf_head, TETRA_BITS_PER_TS + TRAIN_SEQ_SYNC_BITS - 1,
+				   (1 << TETRA_TRAIN_SYNC), trs->train_seq_max_errors, &train_seq_offs);
+	if (rc >= 0) {
+		trs->next_frame_start_bitnum = trs->bitbuf_start_bitnum + train_seq_offs + TETRA_BITS_PER_TS - TRAIN_SEQ_SYNC_OFFS;
+		trs->state = RX_S_KNOW_FSTART;
+		return len;
+	}
+
+	/* nothing in this slot, keep the time going for the next one */
+	tetra_tdma_time_add_tn(&tms->phy_state.time, 1);
+	trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
+	if (--trs->reacq_slots == 0) {
+		/* the SYNC search picks up after the slots searched here */
+		trs->state = RX_S_UNLOCKED;
+		trs->search_bitnum = trs->bitbuf_start_bitnum + TETRA_BITS_PER_TS;
+	}
+	return len;
+}
 
-	/* First: append the data to the bitbuf */
-	make_bitbuf_space(trs, len);
-	memcpy(trs->bitbuf + trs->bits_in_buf, bits, len);
-	trs->bits_in_buf += len;
+static int burst_sync_run(struct tetra_rx_state *trs, unsigned int len)
+{
+	int rc, search_offs, slip, delta;
+	unsigned int train_seq_offs, first;
+	struct tetra_mac_state *tms;
+	const int8_t *soft;
 
 	switch (trs->state) {
 	case RX_S_UNLOCKED:
@@ -70,12 +244,22 @@ int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int
 			DEBUGP("-> waiting for more bits to arrive\n");
 			return len;
 		}
+		/* skip the part of the bitbuf that was already searched */
+		search_offs = (int)(trs->search_bitnum - trs->bitbuf_start_bitnum);
+		if (search_offs < 0 || search_offs > trs->bits_in_buf)
+			search_offs = 0;
 		DEBUGP("-> trying to find training sequence between bit %u and %u\n",
-			trs->bitbuf_start_bitnum, trs->bits_in_buf);
-		rc = tetra_find_train_seq(trs->bitbuf, trs->bits_in_buf,
-					  (1 << TETRA_TRAIN_SYNC), &train_seq_offs);
-		if (rc < 0)
+			trs->bitbuf_start_bitnum + search_offs, trs->bits_in_buf);
+		rc = tetra_train_corr_find(trs->bitbuf, trs->bitbuf_head + search_offs,
+					   trs->bits_in_buf - search_offs, (1 << TETRA_TRAIN_SYNC),
+					   trs->train_seq_max_errors, &train_seq_offs);
+		if (rc < 0) {
+			/* every start that still had room for the sequence has been tried */
+			if (trs->bits_in_buf >= TRAIN_SEQ_SYNC_BITS)
+				trs->search_bitnum = trs->bitbuf_start_bitnum + trs->bits_in_buf - TRAIN_SEQ_SYNC_BITS + 1;
 			return rc;
+		}
+		train_seq_offs += search_offs;
 		// printf("found SYNC training sequence in bit #%u\n", train_seq_offs);
 		trs->state = RX_S_KNOW_FSTART;
 		trs->next_frame_start_bitnum = trs->bitbuf_start_bitnum + train_seq_offs + 296;
@@ -89,39 +273,62 @@ int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int
 #endif
 		break;
 	case RX_S_KNOW_FSTART:
+		if (trs->next_frame_start_bitnum < trs->bitbuf_start_bitnum) {
+			/* the frame start was already pushed out of the bitbuf, search again */
+			trs->state = RX_S_UNLOCKED;
+			break;
+		}
 		/* we are locked, i.e. already know when the next frame should start */
 		if (trs->bitbuf_start_bitnum + trs->bits_in_buf < trs->next_frame_start_bitnum)
 			return 0;
 		else {
 			/* shift start of frame to start of bitbuf */
-			int offset = trs->next_frame_start_bitnum - trs->bitbuf_start_bitnum;
-			int bits_remaining = trs->bits_in_buf - offset;
-
-			memmove(trs->bitbuf, trs->bitbuf+offset, bits_remaining);
-			trs->bits_in_buf = bits_remaining;
-			trs->bitbuf_start_bitnum += offset;
+			consume_bitbuf(trs, trs->next_frame_start_bitnum - trs->bitbuf_start_bitnum);
 
 			trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
 			trs->state = RX_S_LOCKED;
 		}
 	case RX_S_LOCKED:
-		if (trs->bits_in_buf < TETRA_BITS_PER_TS) {
+		/* a late burst is taken from up to max_slip_bits after the slot */
+		if (trs->bits_in_buf < TETRA_BITS_PER_TS + trs->max_slip_bits) {
 			/* not sufficient data for the full frame yet */
 			return len;
 		} else {
 			/* we have successfully received (at least) one frame */
-			tetra_tdma_time_add_tn(&t_phy_state.time, 1);
+			tms = trs->burst_cb_priv;
+			tetra_tdma_time_add_tn(&tms->phy_state.time, 1);
 			// printf("\nBURST");
-			DEBUGP(": %s", osmo_ubit_dump(trs->bitbuf, TETRA_BITS_PER_TS));
 			// printf("\n");
-			rc = tetra_find_train_seq(trs->bitbuf, trs->bits_in_buf,
-						  (1 << TETRA_TRAIN_NORM_1)|
-						  (1 << TETRA_TRAIN_NORM_2)|
-						  (1 << TETRA_TRAIN_SYNC), &train_seq_offs);
+			rc = tetra_train_corr_find(trs->bitbuf, trs->bitbuf_head, trs->bits_in_buf,
+						   (1 << TETRA_TRAIN_NORM_1)|
+						   (1 << TETRA_TRAIN_NORM_2)|
+						   (1 << TETRA_TRAIN_SYNC),
+						   trs->train_seq_max_errors, &train_seq_offs);
+			delta = 0;
+			if (trs->max_slip_bits &&
+			    !((rc == TETRA_TRAIN_SYNC && train_seq_offs == TRAIN_SEQ_SYNC_OFFS) ||
+			      ((rc == TETRA_TRAIN_NORM_1 || rc == TETRA_TRAIN_NORM_2) && train_seq_offs == TRAIN_SEQ_NORM_OFFS))) {
+				/* the first match is not that of the slot. The slot may
+				 * have it where predicted after all, behind a false
+				 * match in the bits before, or a symbol or two off */
+				slip = locked_find(trs, trs->bitbuf_head);
+				if (slip < 0)
+					slip = slip_find(trs, &delta);
+				if (slip >= 0) {
+					rc = slip;
+					train_seq_offs = rc == TETRA_TRAIN_SYNC ? TRAIN_SEQ_SYNC_OFFS : TRAIN_SEQ_NORM_OFFS;
+				}
+				if (delta) {
+					DEBUGP("-> burst %d bits off the predicted timing\n", delta);
+					TETRA_STAT_ADD(tms->stats.slips, 1);
+				}
+			}
+			first = (trs->bitbuf_head + TETRA_RX_BITBUF_BITS + delta) % TETRA_RX_BITBUF_BITS;
+			soft = trs->have_soft ? &trs->softbuf[first] : NULL;
 			switch (rc) {
 			case TETRA_TRAIN_SYNC:
-				if (train_seq_offs == 214)
-					tetra_burst_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+				if (train_seq_offs == TRAIN_SEQ_SYNC_OFFS)
+					tetra_burst_rx_cb(trs->bitbuf, first, soft, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
 				else {
 					// fprintf(stderr, "#### SYNC burst at offset %u?!?\n", train_seq_offs);
 					trs->state = RX_S_UNLOCKED;
@@ -130,26 +337,131 @@ int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int
 			case TETRA_TRAIN_NORM_1:
 			case TETRA_TRAIN_NORM_2:
 			case TETRA_TRAIN_NORM_3:
-				if (train_seq_offs == 244)
-					tetra_burst_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+				if (train_seq_offs == TRAIN_SEQ_NORM_OFFS)
+					tetra_burst_rx_cb(trs->bitbuf, first, soft, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
 				else {
 					// fprintf(stderr, "#### SYNC burst at offset %u?!?\n", train_seq_offs);
 				}
 				break;
 			default:
 				// fprintf(stderr, "#### could not find successive burst training sequence\n");
-				trs->state = RX_S_UNLOCKED;
+				/* most likely a fade, the next slots are where they would have been */
+				trs->state = RX_S_REACQUIRE;
+				trs->reacq_slots = REACQ_SLOTS;
+				TETRA_STAT_ADD(tms->stats.sync_lost, 1);
 				break;
 			}
 
-			/* move remainder to start of buffer */
-			trs->bits_in_buf -= TETRA_BITS_PER_TS;
-			memmove(trs->bitbuf, trs->bitbuf+TETRA_BITS_PER_TS, trs->bits_in_buf);
-			trs->bitbuf_start_bitnum += TETRA_BITS_PER_TS;
-			trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
+			if (trs->state == RX_S_REACQUIRE) {
+				/* next_frame_start_bitnum already is the slot after this
+				 * one, the window before it stays in the bitbuf */
+				consume_bitbuf(trs, TETRA_BITS_PER_TS - REACQ_WINDOW_BITS);
+				break;
+			}
+			/* advance to the next burst, which follows a slipped one */
+			consume_bitbuf(trs, TETRA_BITS_PER_TS + delta);
+			trs->next_frame_start_bitnum += TETRA_BITS_PER_TS + delta;
 		}
 		break;
-
+	case RX_S_REACQUIRE:
+		return reacquire_run(trs, len);
 	}
 	return len;
 }
+
+/* Bits appended at a time. burst_sync_run() takes one step, which is at most
+ * one burst, so after each piece it is run until it gets nowhere. What it
+ * leaves buffered and a piece always fit the bitbuf together */
+#define SYNC_IN_PIECE_BITS	(TETRA_RX_BITBUF_BITS / 2)
+
+/* append bits [0, len) of one of the inputs and run burst sync over them */
+static int burst_sync_feed(struct tetra_rx_state *trs, const uint8_t *bits,
+			   const int8_t *soft, const uint64_t *words, unsigned int len)
+{
+	unsigned int done, n, start_bitnum;
+	enum rx_state state;
+	int rc = 0;
+
+	for (done = 0; done < len; done += n) {
+		n = len - done < SYNC_IN_PIECE_BITS ? len - done : SYNC_IN_PIECE_BITS;
+		append_bitbuf(trs, bits, soft, words, done + make_bitbuf_space(trs, n), done + n);
+		do {
+			start_bitnum = trs->bitbuf_start_bitnum;
+			state = trs->state;
+			rc = burst_sync_run(trs, n);
+		} while (trs->bitbuf_start_bitnum != start_bitnum || trs->state != state);
+	}
+
+	return rc;
+}
+
+/* Longest gap the slot timing is carried across, about 8 hours. Beyond that
+ * the bit numbers would wrap */
+#define SKIP_MAX_BITS	0x40000000u
+
+void tetra_burst_sync_skip(struct tetra_rx_state *trs, uint64_t len)
+{
+	struct tetra_mac_state *tms = trs->burst_cb_priv;
+	unsigned int resume_bitnum, next, slots;
+
+	if (!len)
+		return;
+	if (len > SKIP_MAX_BITS) {
+		trs->state = RX_S_UNLOCKED;
+		len = SKIP_MAX_BITS;
+	}
+	/* first bit after the gap, the buffered ones are not contiguous with it */
+	resume_bitnum = trs->bitbuf_start_bitnum + trs->bits_in_buf + (unsigned int)len;
+	trs->bitbuf_head = 0;
+	trs->bits_in_buf = 0;
+	trs->bitbuf_start_bitnum = resume_bitnum;
+	trs->search_bitnum = resume_bitnum;
+
+	switch (trs->state) {
+	case RX_S_UNLOCKED:
+		return;
+	case RX_S_LOCKED:
+		/* the slot at the start of the bitbuf was not handed out yet */
+		next = trs->next_frame_start_bitnum - TETRA_BITS_PER_TS;
+		break;
+	default:
+		next = trs->next_frame_start_bitnum;
+		break;
+	}
+	/* every slot that starts before the reacquisition window could be
+	 * looked at went by in the gap. The TDMA time is that of the slot before next */
+	slots = 0;
+	if ((int)(resume_bitnum + REACQ_WINDOW_BITS - next) > 0)
+		slots = (resume_bitnum + REACQ_WINDOW_BITS - next + TETRA_BITS_PER_TS - 1) / TETRA_BITS_PER_TS;
+	tetra_tdma_time_add_tn(&tms->phy_state.time, slots);
+	trs->next_frame_start_bitnum = next + slots * TETRA_BITS_PER_TS;
+	trs->state = RX_S_REACQUIRE;
+	trs->reacq_slots = REACQ_SLOTS;
+}
+
+/* input a raw bitstream into the tetra burst synchronizaer */
+int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len)
+{
+	DEBUGP("burst_sync_in: %u bits, state %u\n", len, trs->state);
+
+	trs->have_soft = 0;
+	return burst_sync_feed(trs, bits, NULL, NULL, len);
+}
+
+/* input soft bits into the tetra burst synchronizaer */
+int tetra_burst_sync_in_soft(struct tetra_rx_state *trs, const int8_t *soft, unsigned int len)
+{
+	DEBUGP("burst_sync_in_soft: %u bits, state %u\n", len, trs->state);
+
+	trs->have_soft = 1;
+	return burst_sync_feed(trs, NULL, soft, NULL, len);
+}
+
+/* input a packed bitstream into the tetra burst synchronizaer */
+int tetra_burst_sync_in_pwords(struct tetra_rx_state *trs, const uint64_t *words, unsigned int len)
+{
+	DEBUGP("burst_sync_in_pwords: %u bits, state %u\n", len, trs->state);
+
+	trs->have_soft = 0;
+	return burst_sync_feed(trs, NULL, NULL, words, len);
+}
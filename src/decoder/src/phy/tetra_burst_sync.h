@@ -3,24 +3,62 @@
 
 #include <stdint.h>
 
+#include <tetra_pbits.h>
+
 enum rx_state {
 	RX_S_UNLOCKED,		/* we're completely unlocked */
 	RX_S_KNOW_FSTART,	/* we know the next frame start */
 	RX_S_LOCKED,		/* fully locked */
+	RX_S_REACQUIRE,		/* lost the training sequences, the slot timing is kept */
 };
 
+#define TETRA_RX_BITBUF_BITS	4096
+
+/* symbols the clock recovery may slip between two locked bursts and the
+ * burst still be taken, see max_slip_bits */
+#define TETRA_RX_MAX_SLIP_SYMS	2
+
 struct tetra_rx_state {
 	enum rx_state state;
 	unsigned int bits_in_buf;		/* how many bits are currently in bitbuf */
-	uint8_t bitbuf[4096];
-	unsigned int bitbuf_start_bitnum;	/* bit number at first element in bitbuf */
+	/* packed ring (see tetra_pbits.h) of TETRA_RX_BITBUF_BITS, stored twice back
+	 * to back so every window starting at bitbuf_head is contiguous. One spare
+	 * word for tetra_pwords_peek() */
+	uint64_t bitbuf[2 * TETRA_PWORDS(TETRA_RX_BITBUF_BITS) + 1];
+	unsigned int bitbuf_head;		/* position of the first valid bit in bitbuf */
+	unsigned int bitbuf_start_bitnum;	/* bit number at first valid bit in bitbuf */
 	unsigned int next_frame_start_bitnum;	/* frame start expected at this bitnum */
+	unsigned int search_bitnum;		/* unlocked: no SYNC starts before this bitnum */
+	unsigned int reacq_slots;		/* reacquiring: slots left before falling back to unlocked */
+	unsigned int train_seq_max_errors;	/* bit errors tolerated in a training sequence */
+	/* locked: a burst whose training sequence is up to this many bits (whole
+	 * symbols) early or late is taken from where it is, and the slot timing
+	 * follows it. 0 takes bursts only where they are predicted */
+	unsigned int max_slip_bits;
+	/* soft value of every bit in bitbuf (positive = '0'), mirrored the same
+	 * way. Only valid while the input comes from tetra_burst_sync_in_soft() */
+	int8_t softbuf[2 * TETRA_RX_BITBUF_BITS];
+	int have_soft;
 
 	void *burst_cb_priv;
 };
 
 
-/* input a raw bitstream into the tetra burst synchronizaer */
+/* input a raw bitstream (one bit per byte) into the tetra burst synchronizaer */
 int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len);
 
+/* input soft bits (one int8 per bit, positive = '0', -127..127) into the
+ * tetra burst synchronizaer. The reliabilities are handed on to the lower MAC
+ * for soft decision decoding. Do not mix with the hard bit inputs */
+int tetra_burst_sync_in_soft(struct tetra_rx_state *trs, const int8_t *soft, unsigned int len);
+
+/* input a packed bitstream into the tetra burst synchronizaer */
+int tetra_burst_sync_in_pwords(struct tetra_rx_state *trs, const uint64_t *words, unsigned int len);
+
+/* 'len' bits of the stream were never received, e.g. while the input was
+ * suspended. The bits buffered so far are dropped. Once locked, the slot
+ * timing and the TDMA time are carried across the gap and the next slot
+ * after it is reacquired around where it is predicted */
+void tetra_burst_sync_skip(struct tetra_rx_state *trs, uint64_t len);
+
 #endif /* TETRA_BURST_SYNC_H */
@@ -0,0 +1,169 @@
+/* Training sequence correlator on packed bits
+ *
+ * Candidate positions are handled 64 at a time: lane k of the word peeked at
+ * bit i + j is the j-th bit of the candidate starting at i + k. The mismatch
+ * against sequence bit j is then one XOR for all 64 candidates, and the errors
+ * are summed in a bit-sliced saturating counter, so the cost per candidate is
+ * a handful of logic operations per sequence bit instead of a shift and a
+ * compare each */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include <tetra_pbits.h>
+#include <phy/tetra_train_corr.h>
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* 9.4.4.3.2 - 9.4.4.3.4, packed MSB first in order of precedence */
+static const struct {
+	enum tetra_train_seq type;
+	unsigned int len;
+	uint64_t bits;
+} train_seqs[] = {
+	{ TETRA_TRAIN_SYNC,		38, 0xc19ce9c19c000000ULL },	/* y */
+	{ TETRA_TRAIN_NORM_1,		22, 0xd0e9d00000000000ULL },	/* n */
+	{ TETRA_TRAIN_NORM_2,		22, 0x7a43780000000000ULL },	/* p */
+	{ TETRA_TRAIN_NORM_3,		22, 0xb706b40000000000ULL },	/* q */
+	{ TETRA_TRAIN_EXT,		30, 0x9d0e9d0c00000000ULL },	/* x */
+	{ TETRA_TRAIN_NORM_1_D8PSK,	33, 0xe6f1e3c000000000ULL },	/* N */
+	{ TETRA_TRAIN_NORM_2_D8PSK,	33, 0xafd5718900000000ULL },	/* P */
+	{ TETRA_TRAIN_EXT_D8PSK,	45, 0x73423b57d0700000ULL },	/* X */
+};
+
+/* lanes (MSB first) of the candidates that match with at most max_errors errors */
+static uint64_t corr_lanes(const uint64_t *in, unsigned int pos, unsigned int seq,
+			   unsigned int max_errors, uint64_t lanes)
+{
+	uint64_t c0 = 0, c1 = 0, c2 = 0, ovf = 0;
+	uint64_t ok, eq;
+	unsigned int j, v;
+
+	for (j = 0; j < train_seqs[seq].len && lanes; j++) {
+		uint64_t ref = ((train_seqs[seq].bits >> (63 - j)) & 1) ? ~0ULL : 0;
+		uint64_t e = tetra_pwords_peek(in, pos + j) ^ ref;
+		uint64_t t;
+
+		if (!max_errors) {
+			lanes &= ~e;
+			continue;
+		}
+
+		/* c2:c1:c0 += e, lanes beyond 7 errors are dropped */
+		t = c0 & e;
+		c0 ^= e;
+		e = c1 & t;
+		c1 ^= t;
+		t = c2 & e;
+		c2 ^= e;
+		ovf |= t;
+		lanes &= ~ovf;
+	}
+
+	if (!max_errors || !lanes)
+		return lanes;
+
+	ok = 0;
+	for (v = 0; v <= max_errors; v++) {
+		eq = (v & 1) ? c0 : ~c0;
+		eq &= (v & 2) ? c1 : ~c1;
+		eq &= (v & 4) ? c2 : ~c2;
+		ok |= eq;
+	}
+
+	return lanes & ok;
+}
+
+int tetra_train_corr_find(const uint64_t *in, unsigned int in_offs, unsigned int end_of_in,
+			  uint32_t mask_of_train_seq, unsigned int max_errors, unsigned int *offset)
+{
+	uint64_t match[ARRAY_SIZE(train_seqs)];
+	unsigned int i, s;
+
+	if (max_errors > TETRA_TRAIN_CORR_MAX_ERRORS)
+		max_errors = TETRA_TRAIN_CORR_MAX_ERRORS;
+
+	for (i = 0; i < end_of_in; i += 64) {
+		uint64_t any = 0;
+
+		for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+			unsigned int len = train_seqs[s].len;
+			uint64_t lanes;
+
+			match[s] = 0;
+			if (!(mask_of_train_seq & (1 << train_seqs[s].type)) ||
+			    end_of_in - i < len)
+				continue;
+
+			/* only candidates with room for the whole sequence */
+			if (end_of_in - i - len + 1 < 64)
+				lanes = ~0ULL << (64 - (end_of_in - i - len + 1));
+			else
+				lanes = ~0ULL;
+
+			match[s] = corr_lanes(in, in_offs + i, s, max_errors, lanes);
+			any |= match[s];
+		}
+
+		if (!any)
+			continue;
+
+		/* earliest candidate, then the sequence with precedence there */
+		unsigned int k = __builtin_clzll(any);
+
+		for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+			if ((match[s] >> (63 - k)) & 1) {
+				*offset = i + k;
+				return train_seqs[s].type;
+			}
+		}
+	}
+
+	return -1;
+}
+
+uint8_t tetra_train_snr(const int8_t *soft, enum tetra_train_seq type)
+{
+	int64_t sum = 0, sum2 = 0, var;
+	unsigned int s, j, n;
+	float steps;
+
+	for (s = 0; s < ARRAY_SIZE(train_seqs) && train_seqs[s].type != type; s++)
+		;
+	if (s == ARRAY_SIZE(train_seqs))
+		return 0;
+
+	n = train_seqs[s].len;
+	for (j = 0; j < n; j++) {
+		int y = ((train_seqs[s].bits >> (63 - j)) & 1) ? -soft[j] : soft[j];
+
+		sum += y;
+		sum2 += y * y;
+	}
+
+	/* n^2 times the variance, the mean squared is sum^2 / n^2 */
+	var = n * sum2 - sum * sum;
+	if (sum <= 0)
+		return 1;
+	if (var <= 0)
+		return TETRA_TRAIN_SNR_MAX;
+
+	steps = 10.0f * TETRA_TRAIN_SNR_STEPS_PER_DB * log10f((float)(sum * sum) / (float)var);
+	if (steps < 1.0f)
+		return 1;
+	if (steps >= TETRA_TRAIN_SNR_MAX)
+		return TETRA_TRAIN_SNR_MAX;
+	return (uint8_t)lrintf(steps);
+}
@@ -0,0 +1,39 @@
+#ifndef TETRA_TRAIN_CORR_H
+#define TETRA_TRAIN_CORR_H
+
+/* Training sequence correlator on packed bits (see tetra_pbits.h) */
+
+#include <stdint.h>
+
+#include <phy/tetra_burst.h>
+
+/* words the correlator may read past the last input bit */
+#define TETRA_TRAIN_CORR_PAD_WORDS	1
+
+/* more errors than this are not tracked by the correlator */
+#define TETRA_TRAIN_CORR_MAX_ERRORS	6
+
+/* Find the first position in bits [in_offs, in_offs + end_of_in) where one of
+ * the sequences in mask_of_train_seq starts with at most max_errors bit errors.
+ * Sequences must fit completely before end_of_in. When several match at the
+ * same position, SYNC, NORM_1, NORM_2, NORM_3, EXT and then the D8PSK ones
+ * win in that order. Returns the sequence and writes the position relative
+ * to in_offs to offset, or -1 if there is none */
+int tetra_train_corr_find(const uint64_t *in, unsigned int in_offs, unsigned int end_of_in,
+			  uint32_t mask_of_train_seq, unsigned int max_errors, unsigned int *offset);
+
+/* SNR in steps of 1/TETRA_TRAIN_SNR_STEPS_PER_DB dB, 0 is unknown */
+#define TETRA_TRAIN_SNR_STEPS_PER_DB	4
+#define TETRA_TRAIN_SNR_MAX		255
+
+/* Signal to noise ratio of a burst, from the soft bits (soft decision sign
+ * convention of tetra_sbit2pwords) where its training sequence type sits.
+ * Every soft bit is turned to the sign of the bit that belongs there, the
+ * squared mean of them over their variance is the SNR at the output of the
+ * differential detector. Blind on the data and scale free, so the AGC does
+ * not move it. 1 (or less than 1 / TETRA_TRAIN_SNR_STEPS_PER_DB dB) when the
+ * sequence is mostly wrong, 0 for a type without a known sequence. The error
+ * vector magnitude is 10^(-dB / 20) */
+uint8_t tetra_train_snr(const int8_t *soft, enum tetra_train_seq type);
+
+#endif /* TETRA_TRAIN_CORR_H */
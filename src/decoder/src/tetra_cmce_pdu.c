@@ -20,8 +20,10 @@
 
 // #include <unistd.h>
 // #include <osmocom/core/utils.h>
+#include "tetra_common.h"
 
 #include "tetra_cmce_pdu.h"
+#include "tetra_pbits.h"
 
 static const struct value_string cmce_pdut_d_names[] = {
 	{ TCMCE_PDU_T_D_ALERT,			"D-ALERT" },
@@ -67,3 +69,134 @@ const char *tetra_get_cmce_pdut_name(uint16_t pdut, int uplink)
 	else
 		return get_value_string(cmce_pdut_u_names, pdut);
 }
+
+/* Party type identifier and the address it announces */
+static void parse_party(struct tetra_cmce_decoded *cmce, struct tetra_bitreader *br)
+{
+	cmce->party_type = tetra_bitreader_get(br, 2);
+	if (cmce->party_type == TCMCE_PARTY_SSI || cmce->party_type == TCMCE_PARTY_TSI)
+		cmce->party_ssi = tetra_bitreader_get(br, 24);
+	if (cmce->party_type == TCMCE_PARTY_TSI)
+		cmce->party_ext = tetra_bitreader_get(br, 24);
+}
+
+/* Only the fields up to the elements of interest are parsed, the type 3
+ * elements are left alone. Reads past len give 0 and are caught at the end */
+int tetra_cmce_pdu_parse(struct tetra_cmce_decoded *cmce, const uint8_t *bits, unsigned int len)
+{
+	struct tetra_bitreader br;
+	unsigned int n;
+
+	memset(cmce, 0, sizeof(*cmce));
+	tetra_bitreader_init(&br, bits, len);
+	cmce->pdu_type = tetra_bitreader_get(&br, 5);
+
+	switch (cmce->pdu_type) {
+	case TCMCE_PDU_T_D_SETUP:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		tetra_bitreader_skip(&br, 4);	/* call time-out */
+		tetra_bitreader_skip(&br, 1);	/* hook method selection */
+		cmce->duplex = tetra_bitreader_get(&br, 1);
+		cmce->basic_service = tetra_bitreader_get(&br, 8);
+		cmce->tx_grant = tetra_bitreader_get(&br, 2);
+		tetra_bitreader_skip(&br, 1);	/* transmission request permission */
+		cmce->call_priority = tetra_bitreader_get(&br, 4);
+		if (tetra_bitreader_get(&br, 1)) {	/* O-bit */
+			if (tetra_bitreader_get(&br, 1))
+				tetra_bitreader_skip(&br, 6);	/* notification indicator */
+			if (tetra_bitreader_get(&br, 1))
+				tetra_bitreader_skip(&br, 24);	/* temporary address */
+			if (tetra_bitreader_get(&br, 1))
+				parse_party(cmce, &br);		/* calling party */
+		}
+		break;
+	case TCMCE_PDU_T_D_CONNECT:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		tetra_bitreader_skip(&br, 4);	/* call time-out */
+		tetra_bitreader_skip(&br, 1);	/* hook method selection */
+		cmce->duplex = tetra_bitreader_get(&br, 1);
+		cmce->tx_grant = tetra_bitreader_get(&br, 2);
+		tetra_bitreader_skip(&br, 1);	/* transmission request permission */
+		tetra_bitreader_skip(&br, 1);	/* call ownership */
+		if (tetra_bitreader_get(&br, 1)) {	/* O-bit */
+			if (tetra_bitreader_get(&br, 1))
+				cmce->call_priority = tetra_bitreader_get(&br, 4);
+			if (tetra_bitreader_get(&br, 1))
+				cmce->basic_service = tetra_bitreader_get(&br, 8);
+		}
+		break;
+	case TCMCE_PDU_T_D_CONNECT_ACK:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		tetra_bitreader_skip(&br, 4);	/* call time-out */
+		cmce->tx_grant = tetra_bitreader_get(&br, 2);
+		break;
+	case TCMCE_PDU_T_D_CALL_PROCEEDING:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		tetra_bitreader_skip(&br, 3);	/* call time-out, set-up phase */
+		tetra_bitreader_skip(&br, 1);	/* hook method selection */
+		cmce->duplex = tetra_bitreader_get(&br, 1);
+		break;
+	case TCMCE_PDU_T_D_ALERT:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		tetra_bitreader_skip(&br, 3);	/* call time-out, set-up phase */
+		tetra_bitreader_skip(&br, 1);	/* reserved */
+		cmce->duplex = tetra_bitreader_get(&br, 1);
+		break;
+	case TCMCE_PDU_T_D_TX_GRANTED:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		cmce->tx_grant = tetra_bitreader_get(&br, 2);
+		tetra_bitreader_skip(&br, 1);	/* transmission request permission */
+		cmce->encryption = tetra_bitreader_get(&br, 1);
+		tetra_bitreader_skip(&br, 1);	/* reserved */
+		if (tetra_bitreader_get(&br, 1)) {	/* O-bit */
+			if (tetra_bitreader_get(&br, 1))
+				tetra_bitreader_skip(&br, 6);	/* notification indicator */
+			if (tetra_bitreader_get(&br, 1))
+				parse_party(cmce, &br);		/* transmitting party */
+		}
+		break;
+	case TCMCE_PDU_T_D_DISCONNECT:
+	case TCMCE_PDU_T_D_RELEASE:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		cmce->disconnect_cause = tetra_bitreader_get(&br, 5);
+		break;
+	case TCMCE_PDU_T_D_INFO:
+	case TCMCE_PDU_T_D_TX_CEASED:
+	case TCMCE_PDU_T_D_TX_CONTINUE:
+	case TCMCE_PDU_T_D_TX_WAIT:
+	case TCMCE_PDU_T_D_TX_INTERRUPT:
+	case TCMCE_PDU_T_D_CALL_RESTORE:
+		cmce->call_id = tetra_bitreader_get(&br, 14);
+		break;
+	case TCMCE_PDU_T_D_STATUS:
+		parse_party(cmce, &br);
+		cmce->status = tetra_bitreader_get(&br, 16);
+		break;
+	case TCMCE_PDU_T_D_SDS_DATA:
+		parse_party(cmce, &br);
+		cmce->sds_type = tetra_bitreader_get(&br, 2);
+		switch (cmce->sds_type) {
+		case TCMCE_SDS_UDATA1:
+			n = 16;
+			break;
+		case TCMCE_SDS_UDATA2:
+			n = 32;
+			break;
+		case TCMCE_SDS_UDATA3:
+			n = 64;
+			break;
+		default:
+			n = tetra_bitreader_get(&br, 11);
+			break;
+		}
+		cmce->sds_offset = tetra_bitreader_tell(&br);
+		cmce->sds_len = n;
+		tetra_bitreader_skip(&br, n);
+		break;
+	default:
+		break;
+	}
+
+	n = tetra_bitreader_tell(&br);
+	return n > len ? -1 : (int) n;
+}
@@ -1,7 +1,6 @@
 #ifndef TETRA_CMCE_PDU_H
 #define TETRA_CMCE_PDU_H
 
-#include "tetra_common.h"
 #include <stdint.h>
 
 /* 14.8.28 */
@@ -46,4 +45,51 @@ enum tetra_cmce_pdu_type_u {
 
 const char *tetra_get_cmce_pdut_name(uint16_t pdut, int uplink);
 
+/* Transmission grant */
+enum tetra_cmce_tx_grant {
+	TCMCE_TX_GRANTED		= 0,
+	TCMCE_TX_NOT_GRANTED		= 1,
+	TCMCE_TX_QUEUED			= 2,
+	TCMCE_TX_GRANTED_OTHER		= 3,	/* granted to another user */
+};
+
+/* Party type identifier, of the calling / transmitting party */
+enum tetra_cmce_party_type {
+	TCMCE_PARTY_NONE		= 0,	/* or not present */
+	TCMCE_PARTY_SSI			= 1,
+	TCMCE_PARTY_TSI			= 2,	/* SSI and extension (MCC / MNC) */
+};
+
+/* Short data type identifier */
+enum tetra_cmce_sds_type {
+	TCMCE_SDS_UDATA1		= 0,	/* 16 bit */
+	TCMCE_SDS_UDATA2		= 1,	/* 32 bit */
+	TCMCE_SDS_UDATA3		= 2,	/* 64 bit */
+	TCMCE_SDS_UDATA4		= 3,	/* length given, up to 2047 bit */
+};
+
+/* The header of a downlink CMCE PDU, which fields are set depends on pdu_type */
+struct tetra_cmce_decoded {
+	uint8_t pdu_type;		/* enum tetra_cmce_pdu_type_d */
+	uint16_t call_id;		/* 14 bit call identifier of the call related PDUs */
+	uint8_t tx_grant;		/* enum tetra_cmce_tx_grant: D-SETUP, D-CONNECT, D-CONNECT ACK, D-TX GRANTED */
+	uint8_t disconnect_cause;	/* D-DISCONNECT, D-RELEASE */
+	uint8_t basic_service;		/* basic service information: D-SETUP, D-CONNECT */
+	uint8_t call_priority;		/* D-SETUP, D-CONNECT */
+	uint8_t duplex;			/* simplex / duplex selection: D-SETUP, D-CONNECT, D-CALL PROCEEDING */
+	uint8_t encryption;		/* D-TX GRANTED: encryption control */
+	uint8_t party_type;		/* enum tetra_cmce_party_type: calling party of D-SETUP, D-SDS DATA, D-STATUS,
+					 * transmitting party of D-TX GRANTED */
+	uint32_t party_ssi;
+	uint32_t party_ext;		/* MCC (10 bit) and MNC (14 bit) */
+	uint16_t status;		/* D-STATUS: pre-coded status */
+	uint8_t sds_type;		/* D-SDS DATA: enum tetra_cmce_sds_type */
+	uint16_t sds_offset;		/* D-SDS DATA: first bit of the user defined data, from the PDU type on */
+	uint16_t sds_len;		/* D-SDS DATA: bits of user defined data */
+};
+
+/* Parse len bits (one per byte) at bits, from the PDU type on. Returns the
+ * bits parsed, -1 if the PDU is cut short */
+int tetra_cmce_pdu_parse(struct tetra_cmce_decoded *cmce, const uint8_t *bits, unsigned int len);
+
 #endif /* TETRA_CMCE_PDU_H */
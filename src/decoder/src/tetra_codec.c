@@ -0,0 +1,194 @@
+/* Per decoder access to the ETSI TETRA speech codec */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "tetra_codec.h"
+#include "tetra_prof.h"
+
+#define TETRA_CODEC_MAX_SLOTS	8
+
+#if TETRA_CODEC_SLOTS < 1 || TETRA_CODEC_SLOTS > TETRA_CODEC_MAX_SLOTS
+#error "TETRA_CODEC_SLOTS has to be between 1 and 8"
+#endif
+
+/* one bit per value in the channel decoder output, BFI first */
+#define SERIAL_BITS	138
+#define REORDERED_BITS	286
+#define PARM_COUNT	24
+
+struct tetra_codec_slot {
+	void (*init_decod)(void);
+	void (*desinterleave)(int16_t *in, int16_t *out);
+	int16_t (*channel_decode)(int16_t first_pass, int16_t frame_stealing, int16_t *in, int16_t *out);
+	void (*bits2prm)(int16_t *serial, int16_t *parm);
+	void (*decod)(int16_t *parm, int16_t *synth);
+	void (*post_process)(int16_t *signal, int16_t lg);
+
+	pthread_mutex_t lock;
+	unsigned int users;
+	bool used;		/* Init_Decod_Tetra has run on this copy */
+	bool first_pass;	/* Channel_Decoding has not run on this copy yet */
+};
+
+/* Entry points of the patched reference codec (codec/c-code). With more than
+ * one slot the build renames them per copy to tetra_codec<n>_<name> */
+#define CODEC_ENTRY_POINTS(p) \
+	void p##Init_Decod_Tetra(void); \
+	void p##Desinterleaving_Speech(int16_t *in, int16_t *out); \
+	int16_t p##Channel_Decoding(int16_t first_pass, int16_t frame_stealing, int16_t *in, int16_t *out); \
+	void p##Bits2prm_Tetra(int16_t *serial, int16_t *parm); \
+	void p##Decod_Tetra(int16_t *parm, int16_t *synth); \
+	void p##Post_Process(int16_t *signal, int16_t lg);
+
+#define CODEC_SLOT(p) { \
+	.init_decod	= p##Init_Decod_Tetra, \
+	.desinterleave	= p##Desinterleaving_Speech, \
+	.channel_decode	= p##Channel_Decoding, \
+	.bits2prm	= p##Bits2prm_Tetra, \
+	.decod		= p##Decod_Tetra, \
+	.post_process	= p##Post_Process, \
+	.lock		= PTHREAD_MUTEX_INITIALIZER, \
+	.first_pass	= true, \
+}
+
+#if TETRA_CODEC_SLOTS == 1
+CODEC_ENTRY_POINTS()
+
+static struct tetra_codec_slot codec_slots[] = {
+	CODEC_SLOT(),
+};
+#else
+CODEC_ENTRY_POINTS(tetra_codec0_)
+CODEC_ENTRY_POINTS(tetra_codec1_)
+#if TETRA_CODEC_SLOTS > 2
+CODEC_ENTRY_POINTS(tetra_codec2_)
+#endif
+#if TETRA_CODEC_SLOTS > 3
+CODEC_ENTRY_POINTS(tetra_codec3_)
+#endif
+#if TETRA_CODEC_SLOTS > 4
+CODEC_ENTRY_POINTS(tetra_codec4_)
+#endif
+#if TETRA_CODEC_SLOTS > 5
+CODEC_ENTRY_POINTS(tetra_codec5_)
+#endif
+#if TETRA_CODEC_SLOTS > 6
+CODEC_ENTRY_POINTS(tetra_codec6_)
+#endif
+#if TETRA_CODEC_SLOTS > 7
+CODEC_ENTRY_POINTS(tetra_codec7_)
+#endif
+
+static struct tetra_codec_slot codec_slots[] = {
+	CODEC_SLOT(tetra_codec0_),
+	CODEC_SLOT(tetra_codec1_),
+#if TETRA_CODEC_SLOTS > 2
+	CODEC_SLOT(tetra_codec2_),
+#endif
+#if TETRA_CODEC_SLOTS > 3
+	CODEC_SLOT(tetra_codec3_),
+#endif
+#if TETRA_CODEC_SLOTS > 4
+	CODEC_SLOT(tetra_codec4_),
+#endif
+#if TETRA_CODEC_SLOTS > 5
+	CODEC_SLOT(tetra_codec5_),
+#endif
+#if TETRA_CODEC_SLOTS > 6
+	CODEC_SLOT(tetra_codec6_),
+#endif
+#if TETRA_CODEC_SLOTS > 7
+	CODEC_SLOT(tetra_codec7_),
+#endif
+};
+#endif
+
+/* guards the users counts while slots are handed out */
+static pthread_mutex_t codec_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void tetra_codec_open(struct tetra_codec *codec)
+{
+	struct tetra_codec_slot *slot = &codec_slots[0];
+	unsigned int i;
+
+	pthread_mutex_lock(&codec_slots_lock);
+	for (i = 1; i < TETRA_CODEC_SLOTS; i++) {
+		if (codec_slots[i].users < slot->users)
+			slot = &codec_slots[i];
+	}
+	slot->users++;
+	pthread_mutex_unlock(&codec_slots_lock);
+
+	codec->slot = slot;
+	codec->fresh = true;
+}
+
+void tetra_codec_close(struct tetra_codec *codec)
+{
+	if (!codec->slot)
+		return;
+	pthread_mutex_lock(&codec_slots_lock);
+	codec->slot->users--;
+	pthread_mutex_unlock(&codec_slots_lock);
+	codec->slot = NULL;
+}
+
+bool tetra_codec_decode_slot(struct tetra_codec *codec, int16_t *coded, const uint8_t *ks, int16_t *synth)
+{
+	struct tetra_codec_slot *slot = codec->slot;
+	int16_t deinterleaved[TETRA_CODEC_CODED_BITS];
+	int16_t reordered[REORDERED_BITS];
+	int16_t serial[SERIAL_BITS];
+	int16_t parm[PARM_COUNT];
+	bool bfi;
+	int f, i;
+
+	TETRA_PROF_START(prof_t);
+	pthread_mutex_lock(&slot->lock);
+
+	/* A copy that is not shared starts every call from a clean synthesis
+	 * state instead of the filter memory of whoever used it last. Shared
+	 * copies are never reset, that would garble the other calls on it */
+	if (codec->fresh) {
+		pthread_mutex_lock(&codec_slots_lock);
+		if (!slot->used || slot->users == 1)
+			slot->init_decod();
+		pthread_mutex_unlock(&codec_slots_lock);
+		slot->used = true;
+		codec->fresh = false;
+	}
+
+	slot->desinterleave(coded, deinterleaved);
+	bfi = slot->channel_decode(slot->first_pass, 0, deinterleaved, reordered);
+	slot->first_pass = false;
+	if (ks) {
+		for (i = 0; i < 2 * (SERIAL_BITS - 1); i++)
+			reordered[i] ^= (ks[i / 8] >> (7 - (i % 8))) & 1;
+	}
+
+	for (f = 0; f < 2; f++) {
+		serial[0] = bfi;
+		memcpy(&serial[1], &reordered[f * (SERIAL_BITS - 1)], (SERIAL_BITS - 1) * sizeof(int16_t));
+		slot->bits2prm(serial, parm);
+		slot->decod(parm, &synth[f * TETRA_CODEC_FRAME_SAMPLES]);
+		slot->post_process(&synth[f * TETRA_CODEC_FRAME_SAMPLES], TETRA_CODEC_FRAME_SAMPLES);
+	}
+
+	pthread_mutex_unlock(&slot->lock);
+	TETRA_PROF_ADD(TETRA_PROF_CODEC_FRAMES, 1);
+	TETRA_PROF_STOP(TETRA_PROF_CODEC_NS, prof_t);
+	return bfi;
+}
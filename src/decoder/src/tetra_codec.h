@@ -0,0 +1,46 @@
+#ifndef TETRA_CODEC_H
+#define TETRA_CODEC_H
+
+/* Per decoder access to the ETSI TETRA speech codec
+ *
+ * The reference codec keeps its synthesis state in file-scope statics. The
+ * build links TETRA_CODEC_SLOTS private copies of it (see CMakeLists.txt),
+ * each with its own state, and every decoder instance is given the least used
+ * copy. Up to TETRA_CODEC_SLOTS calls are decoded without sharing any state,
+ * beyond that instances share a copy and take turns using it as before */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef TETRA_CODEC_SLOTS
+#define TETRA_CODEC_SLOTS	1
+#endif
+
+/* coded bits of one TCH/S slot and speech samples of its two 30 ms frames */
+#define TETRA_CODEC_CODED_BITS	432
+#define TETRA_CODEC_FRAME_SAMPLES	240
+#define TETRA_CODEC_SLOT_SAMPLES	(2*TETRA_CODEC_FRAME_SAMPLES)
+
+/* traffic timeslots of a carrier, each voice call needs a codec of its own */
+#define TETRA_CODEC_TIMESLOTS	4
+/* keystream of the 2 x 137 type-1 bits of an encrypted slot */
+#define TETRA_CODEC_KS_BYTES	((2 * 137 + 7) / 8)
+
+struct tetra_codec_slot;
+
+struct tetra_codec {
+	struct tetra_codec_slot *slot;
+	bool fresh;	/* no slot decoded since open */
+};
+
+void tetra_codec_open(struct tetra_codec *codec);
+void tetra_codec_close(struct tetra_codec *codec);
+
+/* Decode one slot of interleaved soft bits (positive = '0', magnitude up to
+ * 127) into 8 kHz speech, returns true if the channel decoder flagged the
+ * frames as bad. ks, unless NULL, is the keystream of an encrypted call
+ * (TETRA_CODEC_KS_BYTES, MSB first), applied to the bits out of the channel
+ * decoder */
+bool tetra_codec_decode_slot(struct tetra_codec *codec, int16_t *coded, const uint8_t *ks, int16_t *synth);
+
+#endif /* TETRA_CODEC_H */
@@ -20,6 +20,7 @@
 
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -101,6 +102,91 @@ struct msgb *msgb_alloc(uint16_t size, const char *name)
 	return msgb_alloc_c(size, name);
 }
 
+#define TETRA_POOL_ALIGN	16
+
+int tetra_pool_init(struct tetra_pool *pool, size_t obj_size, unsigned int count)
+{
+	unsigned int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->obj_size = (obj_size + TETRA_POOL_ALIGN - 1) & ~(size_t)(TETRA_POOL_ALIGN - 1);
+	pool->mem = (uint8_t*)malloc(pool->obj_size * count);
+	if (!pool->mem)
+		return -1;
+	pool->count = count;
+
+	/* Thread all objects onto the free list, lowest address first */
+	for (i = count; i > 0; i--) {
+		void **obj = (void **)&pool->mem[(i - 1) * pool->obj_size];
+		*obj = pool->free_list;
+		pool->free_list = obj;
+	}
+
+	return 0;
+}
+
+void tetra_pool_deinit(struct tetra_pool *pool)
+{
+	free(pool->mem);
+	memset(pool, 0, sizeof(*pool));
+}
+
+void *tetra_pool_alloc(struct tetra_pool *pool)
+{
+	void **obj = pool->free_list;
+
+	if (!obj) {
+		/* Pool exhausted (or never initialized), take it from the heap */
+		return calloc(1, pool->obj_size ? pool->obj_size : 1);
+	}
+
+	pool->free_list = *obj;
+	memset(obj, 0, pool->obj_size);
+
+	return obj;
+}
+
+void tetra_pool_free(struct tetra_pool *pool, void *ptr)
+{
+	uint8_t *p = (uint8_t*)ptr;
+
+	if (!ptr)
+		return;
+
+	if (pool->mem && p >= pool->mem && p < pool->mem + pool->obj_size * pool->count) {
+		*(void **)ptr = pool->free_list;
+		pool->free_list = ptr;
+	} else {
+		free(ptr);
+	}
+}
+
+struct msgb *msgb_alloc_pool(struct tetra_pool *pool, uint16_t size, const char *name)
+{
+	struct msgb *msg;
+
+	if (sizeof(*msg) + size > pool->obj_size)
+		return msgb_alloc_c(size, name);
+
+	msg = (struct msgb*)tetra_pool_alloc(pool);
+	if (!msg) {
+		return NULL;
+	}
+
+	msg->data_len = size;
+	msg->len = 0;
+	msg->data = msg->_data;
+	msg->head = msg->_data;
+	msg->tail = msg->_data;
+
+	return msg;
+}
+
+void msgb_free_pool(struct tetra_pool *pool, struct msgb *msg)
+{
+	tetra_pool_free(pool, msg);
+}
+
 
 
 
@@ -211,5 +297,103 @@ const char *tetra_get_sap_name(uint8_t sap)
 void tetra_mac_state_init(struct tetra_mac_state *tms)
 {
 	// INIT_LLIST_HEAD(&tms->voice_channels);
-	tms->codec_first_pass = true;
+	memset(tms->codec, 0, sizeof(tms->codec));
+	memset(tms->um_crypt, 0, sizeof(tms->um_crypt));
+	memset(tms->voice_key_pub, 0, sizeof(tms->voice_key_pub));
+	memset(tms->voice_key_seq, 0, sizeof(tms->voice_key_seq));
+	tms->voice_key_dirty = 0;
+	tms->voice_key_cn = tms->voice_key_la = tms->voice_key_cc = tms->voice_key_hn = -1;
+	memset(tms->voice_skipped, 0, sizeof(tms->voice_skipped));
+	tms->voice_wanted = (1 << TETRA_CODEC_TIMESLOTS) - 1;
+	tms->voice_all_slots = false;
+	tms->subscriptions = TETRA_SUB_ALL;
+	tms->last_sid_len = 0;
+
+	/* Only one TMV-SAP primitive is in flight per block, a few spare ones cover re-entry */
+	tetra_pool_init(&tms->prim_pool, sizeof(struct tetra_tmvsap_prim), 4);
+	tetra_pool_init(&tms->msgb_pool, sizeof(struct msgb) + TMVSAP_MSGB_SIZE, 4);
+	fragslot_store_init(&tms->frag_store, FRAGSLOT_DEFAULT_MEM_LIMIT);
+}
+
+void tetra_mac_state_deinit(struct tetra_mac_state *tms)
+{
+	int i;
+
+	tetra_viterbi_cache_free(&tms->viterbi);
+	for (i = 0; i < TETRA_CODEC_TIMESLOTS; i++)
+		tetra_codec_close(&tms->codec[i]);
+	tetra_pool_deinit(&tms->prim_pool);
+	tetra_pool_deinit(&tms->msgb_pool);
+	fragslot_store_deinit(&tms->frag_store);
+}
+
+/* Seqlock: the writer makes seq odd, copies, and makes it even again, a
+ * reader retries until it saw the same even seq before and after its copy.
+ * The copies go a word at a time through relaxed atomics, so the race with
+ * the writer is a retry and never torn data */
+static void seqlock_write(unsigned int *seq, void *dst, const void *src, size_t len)
+{
+	uint32_t *d = dst;
+	const uint32_t *w = src;
+	unsigned int s = *seq;
+	size_t i;
+
+	__atomic_store_n(seq, s + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (i = 0; i < len / sizeof(*d); i++)
+		__atomic_store_n(&d[i], w[i], __ATOMIC_RELAXED);
+	__atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+}
+
+static void seqlock_read(unsigned int *seq, void *dst, const void *src, size_t len)
+{
+	uint32_t *d = dst;
+	const uint32_t *w = src;
+	unsigned int s0, s1;
+	size_t i;
+
+	do {
+		s0 = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		for (i = 0; i < len / sizeof(*d); i++)
+			d[i] = __atomic_load_n(&w[i], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s1 = __atomic_load_n(seq, __ATOMIC_RELAXED);
+	} while ((s0 & 1) || s0 != s1);
+}
+
+/* everything up to cell, which has a writer of its own */
+#define DISPLAY_PHY_LEN	offsetof(struct tetra_display_state, cell)
+
+_Static_assert(DISPLAY_PHY_LEN % sizeof(uint32_t) == 0, "display state is copied in words");
+_Static_assert(sizeof(struct tetra_display_cell) % sizeof(uint32_t) == 0, "display state is copied in words");
+
+void tetra_display_publish(struct tetra_mac_state *tms)
+{
+	seqlock_write(&tms->display_seq, &tms->display_pub, tms->t_display_st, DISPLAY_PHY_LEN);
+}
+
+void tetra_display_publish_cell(struct tetra_mac_state *tms)
+{
+	seqlock_write(&tms->display_cell_seq, &tms->display_pub.cell, &tms->t_display_st->cell,
+		      sizeof(struct tetra_display_cell));
+}
+
+void tetra_display_read(struct tetra_mac_state *tms, struct tetra_display_state *out)
+{
+	seqlock_read(&tms->display_seq, out, &tms->display_pub, DISPLAY_PHY_LEN);
+	seqlock_read(&tms->display_cell_seq, &out->cell, &tms->display_pub.cell,
+		     sizeof(struct tetra_display_cell));
+}
+
+_Static_assert(sizeof(struct tetra_voice_key) % sizeof(uint32_t) == 0, "voice keys are copied in words");
+_Static_assert(TETRA_USAGE_MARKERS <= 64, "voice_key_dirty has a bit per usage marker");
+
+void tetra_voice_key_publish(struct tetra_mac_state *tms, int um, const struct tetra_voice_key *vk)
+{
+	seqlock_write(&tms->voice_key_seq[um], &tms->voice_key_pub[um], vk, sizeof(*vk));
+}
+
+void tetra_voice_key_read(struct tetra_mac_state *tms, int um, struct tetra_voice_key *vk)
+{
+	seqlock_read(&tms->voice_key_seq[um], vk, &tms->voice_key_pub[um], sizeof(*vk));
 }
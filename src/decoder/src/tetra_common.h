@@ -12,6 +12,10 @@
 // #include <osmocom/core/linuxlist.h>
 
 #include "tetra_fragslot.h"
+#include <lower_mac/viterbi.h>
+#include <lower_mac/tetra_scramb.h>
+#include "tetra_events.h"
+#include "tetra_codec.h"
 
 
 struct value_string {
@@ -81,6 +85,29 @@ struct msgb *msgb_alloc_c(uint16_t size, const char *name);
  */
 struct msgb *msgb_alloc(uint16_t size, const char *name);
 
+/*! Fixed-size object pool
+ * All objects are carved out of one block allocated up front, so the
+ * steady-state decode path does not go to the heap. When the pool runs
+ * dry, allocation falls back to malloc and the object is returned to the
+ * heap on release.
+ */
+struct tetra_pool {
+	size_t obj_size;	/*!< size of one object, rounded up for alignment */
+	unsigned int count;	/*!< number of objects in the pool */
+	uint8_t *mem;		/*!< backing storage of count * obj_size octets */
+	void *free_list;	/*!< singly linked list of unused objects */
+};
+
+int tetra_pool_init(struct tetra_pool *pool, size_t obj_size, unsigned int count);
+void tetra_pool_deinit(struct tetra_pool *pool);
+/*! Take a zero-initialized object from the pool */
+void *tetra_pool_alloc(struct tetra_pool *pool);
+void tetra_pool_free(struct tetra_pool *pool, void *ptr);
+
+/*! Allocate a message buffer from a pool of at least sizeof(struct msgb) + size octets */
+struct msgb *msgb_alloc_pool(struct tetra_pool *pool, uint16_t size, const char *name);
+void msgb_free_pool(struct tetra_pool *pool, struct msgb *msg);
+
 /*! obtain L1 header of msgb */
 #define msgb_l1(m)	((void *)((m)->l1h))
 /*! obtain L2 header of msgb */
@@ -237,6 +264,9 @@ struct osmo_prim_hdr {
 #define TETRA_SYM_PER_TS	255
 #define TETRA_BITS_PER_TS	(TETRA_SYM_PER_TS*2)
 
+/* usage markers are 6 bit */
+#define TETRA_USAGE_MARKERS	64
+
 /* Chapter 22.2.x */
 enum tetra_log_chan {
 	TETRA_LC_UNKNOWN,
@@ -257,31 +287,76 @@ enum tetra_log_chan {
 	/* FIXME: QAM */
 };
 
+/* MAC PDUs the upper MAC decodes, the others are passed over and take the
+ * rest of their block with them. ACCESS-ASSIGN is always decoded, the lower
+ * MAC needs it to tell traffic from signalling */
+enum tetra_mac_sub {
+	TETRA_SUB_SYSINFO	= 1 << 0,	/* BNCH SYSINFO: cell data, frequencies, hyperframe for decryption */
+	TETRA_SUB_RESOURCE	= 1 << 1,	/* MAC-RESOURCE: addressing, call encryption, the TM-SDU and PDU lengths */
+	TETRA_SUB_FRAG		= 1 << 2,	/* MAC-FRAG and MAC-END, reassembled onto a MAC-RESOURCE */
+	TETRA_SUB_SUPPL		= 1 << 3,	/* MAC-D-BLCK */
+};
+#define TETRA_SUB_ALL	(TETRA_SUB_SYSINFO | TETRA_SUB_RESOURCE | TETRA_SUB_FRAG | TETRA_SUB_SUPPL)
+
+/* longest SYSINFO kept to recognise its repeats, the type-1 bits of a BNCH on SCH/HD */
+#define TETRA_SYSINFO_CMP_BITS	124
+
 uint32_t bits_to_uint(const uint8_t *bits, unsigned int len);
 
+/* training sequences counted by tetra_mac_stats, enum tetra_train_seq */
+#define TETRA_STATS_TRAIN_SEQS	8
+
+/* Running totals for health monitoring. Only the decoder thread writes them
+ * (with TETRA_STAT_ADD), other threads read them with __atomic_load_n */
+struct tetra_mac_stats {
+	uint64_t bursts[TETRA_STATS_TRAIN_SEQS];	/* locked bursts by training sequence */
+	uint64_t crc_ok;				/* blocks with a CRC, by its result. The */
+	uint64_t crc_fail;				/* SCH/F of traffic slots are left out */
+	uint64_t crc_list_ok;				/* of crc_ok, found by list decoding */
+	uint64_t aach_fail;				/* AACH with more errors than RM(30,14) corrects */
+	uint64_t sync_lost;				/* times the burst sync lost the training sequences */
+	uint64_t reacquired;				/* of them, found again at the predicted timing */
+	uint64_t slips;					/* locked bursts taken a symbol or two off their
+							 * predicted start, the timing followed them */
+	uint64_t snr_sum;				/* cur_burst.snr of the downlink bursts that have */
+	uint64_t snr_bursts;				/* one, mean SNR = sum / bursts / STEPS_PER_DB */
+	uint8_t snr_last;				/* of the last of them */
+	/* Cell seen on the carrier, for the channel scanner. The fields are
+	 * stored before the count that goes with them, which is stored with
+	 * TETRA_STAT_PUBLISH: a reader that loads the count with
+	 * __ATOMIC_ACQUIRE sees the fields of that SYNC / SYSINFO or newer */
+	uint64_t sync_ok;				/* SYNC PDUs with a good CRC */
+	uint16_t mcc;					/* of the last of them */
+	uint16_t mnc;
+	uint8_t cc;
+	uint64_t sysinfo;				/* SYSINFO PDUs, the repeats included */
+	uint32_t dl_hz;					/* main carrier of the last one */
+	uint32_t ul_hz;
+};
+
+#define TETRA_STAT_ADD(v, n)	__atomic_store_n(&(v), (v) + (n), __ATOMIC_RELAXED)
+#define TETRA_STAT_SET(v, x)	__atomic_store_n(&(v), (x), __ATOMIC_RELAXED)
+#define TETRA_STAT_PUBLISH(v)	__atomic_store_n(&(v), (v) + 1, __ATOMIC_RELEASE)
+
 #include "tetra_tdma.h"
 struct tetra_phy_state {
 	struct tetra_tdma_time time;
 };
-extern struct tetra_phy_state t_phy_state;
 
-struct tetra_display_state {
+struct tetra_cell_data {
+	uint16_t mcc;
+	uint16_t mnc;
+	uint8_t colour_code;
+	struct tetra_tdma_time time;
+
+	uint32_t scramb_init;
+};
+
+/* What the last SYSINFO told, written by the upper MAC */
+struct tetra_display_cell {
 	int curr_hyperframe;//
-	int curr_multiframe;//
-	int curr_frame;//
-	int timeslot_content[4]; //0-other, 1-NORM1, 2-NORM2, 3-SYNC//
-	int dl_usage;//
-	int ul_usage;//
-	char access1_code;//
-	char access2_code;//
-	int access1;//
-	int access2;//
 	int dl_freq;//
 	int ul_freq;//
-	int mcc;//
-	int mnc;//
-	int cc;//
-	bool last_crc_fail;//
 	bool advanced_link;
 	bool air_encryption;
 	bool sndcp_data;
@@ -295,14 +370,53 @@ struct tetra_display_state {
 	bool reg_mandatory;
 };
 
+/* Written by the PHY and the lower MAC, but for cell. Other threads read it
+ * through tetra_display_read() */
+struct tetra_display_state {
+	int curr_multiframe;//
+	int curr_frame;//
+	int timeslot_content[4]; //0-other, 1-NORM1, 2-NORM2, 3-SYNC//
+	int dl_usage;//
+	int ul_usage;//
+	char access1_code;//
+	char access2_code;//
+	int access1;//
+	int access2;//
+	int mcc;//
+	int mnc;//
+	int cc;//
+	bool last_crc_fail;//
+	/* last, see tetra_display_publish() */
+	struct tetra_display_cell cell;
+};
+
+/* What the lower MAC needs of the key of a call to make its voice keystream,
+ * copied out of the keystore by the upper MAC, so the lower one never follows
+ * a key pointer into a snapshot that a reload frees. Copied in words */
+struct tetra_voice_key {
+	uint32_t encrypted;		/* the call on the usage marker is */
+	uint32_t have_key;		/* ... and its key is loaded */
+	uint32_t ksg_type;		/* enum tetra_ksg_type of the network of the key */
+	int32_t cn, la, cc, hn;		/* cell data for TB5 and the IV, -1 = unknown */
+	uint8_t ck[12];			/* the 80 bits of the key */
+};
+
 struct tetra_mac_state {
 	// struct llist_head voice_channels;
 	struct {
 		int is_traffic;
 		bool blk1_stolen;
 		bool blk2_stolen;
+		uint8_t crc_flags;	/* TETRA_BURST_F_* of the blocks decoded so far */
+		uint8_t snr;		/* of its training sequence, see tetra_train_snr() */
 	} cur_burst;
 	struct tetra_si_decoded last_sid;
+	/* the bits last_sid was decoded from, a repeat of them is not decoded
+	 * again. last_sid_len is 0 until there are some */
+	uint64_t last_sid_bits[TETRA_PWORDS(TETRA_SYSINFO_CMP_BITS)];
+	unsigned int last_sid_len;
+	/* MAC PDUs to decode, enum tetra_mac_sub. Set from other threads */
+	uint32_t subscriptions;
 
 	struct tetra_crypto_state *tcs; /* contains all state relevant to encryption */
 
@@ -313,19 +427,107 @@ struct tetra_mac_state {
 	int addr_type;
 	
 	struct tetra_display_state *t_display_st;
-	bool codec_first_pass;
+	/* t_display_st as published for other threads, each part under a seqlock
+	 * of its own writer, see tetra_display_read() */
+	struct tetra_display_state display_pub;
+	unsigned int display_seq;
+	unsigned int display_cell_seq;
+	/* speech decoder of each timeslot, opened on its first voice frame */
+	struct tetra_codec codec[TETRA_CODEC_TIMESLOTS];
 	
 	void (*put_voice_data)(void* ctx, int count, int16_t* data);
+	/* If set, the coded bits of the voice frames are handed out here with the
+	 * TDMA time of their burst (time->tn is the timeslot, 1 .. 4) instead of
+	 * being decoded in line. active tells if this is the timeslot
+	 * put_voice_data would have played, ks is the keystream of an encrypted
+	 * call for tetra_codec_decode_slot() (NULL if clear) and only valid
+	 * during the call */
+	void (*put_voice_frame)(void *ctx, const struct tetra_tdma_time *time, bool active, int16_t *coded, const uint8_t *ks);
 	void* put_voice_data_ctx;
+	/* timeslots (bit tn-1) whose audio is consumed, the voice frames of the
+	 * others never reach the codec. Set from other threads */
+	uint8_t voice_wanted;
+	/* put_voice_frame gets every timeslot, otherwise only the active one */
+	bool voice_all_slots;
+	/* the last voice frame of the timeslot was dropped before the codec */
+	bool voice_skipped[TETRA_CODEC_TIMESLOTS];
+	/* encryption of the call on each usage marker, from the MAC-RESOURCE that
+	 * assigned it, and its key if one is loaded */
+	struct {
+		bool encrypted;
+		struct tetra_key *key;
+	} um_crypt[TETRA_USAGE_MARKERS];
+	/* um_crypt as published for the lower MAC, each under a seqlock of its
+	 * own, see tetra_voice_key_read(). The usage markers to publish again
+	 * (bit per marker) and the cell data last published belong to the upper
+	 * MAC */
+	struct tetra_voice_key voice_key_pub[TETRA_USAGE_MARKERS];
+	unsigned int voice_key_seq[TETRA_USAGE_MARKERS];
+	uint64_t voice_key_dirty;
+	int voice_key_cn, voice_key_la, voice_key_cc, voice_key_hn;
 	int last_frame;
 	int curr_active_timeslot;
 	
 	struct fragslot* fragslots;
+
+	/* per-instance PHY timing and cell data, so several decoders can run side by side */
+	struct tetra_phy_state phy_state;
+	struct tetra_cell_data cell_data;
+
+	/* descrambling sequences of the cells seen last */
+	struct tetra_scramb_cache scramb_cache;
+
+	/* persistent Viterbi decoders, built on first use of each block length */
+	struct tetra_viterbi_cache viterbi;
+	/* CRC-aided list decoding of the blocks that fail their CRC: paths tried
+	 * per block, 0 for off, and the paths the carrier may spend per TDMA
+	 * frame. list_tokens is what is left of it, refilled as list_fn changes.
+	 * Set with the decoder stopped */
+	int list_paths;
+	int list_budget;
+	int list_tokens;
+	int list_fn;
+
+	/* per-instance pools for the primitives and message buffers of every timeslot */
+	struct tetra_pool prim_pool;
+	struct tetra_pool msgb_pool;
+
+	/* packed storage of the fragmented MAC PDUs being reassembled */
+	struct frag_store frag_store;
+
+	struct tetra_mac_stats stats;
+
+	/* decoded blocks and MAC PDUs for an external consumer, NULL if nobody listens */
+	struct tetra_event_queue *events;
+	/* If set, every decoded TL-SDU is also handed out here, in line on the
+	 * decoder's thread, with the TDMA time of the block that completed it.
+	 * bits are its len bits (one per byte), from the MLE discriminator on */
+	void (*put_l3)(void *ctx, const struct tetra_tdma_time *time, const struct tetra_l3_event *l3,
+		       const uint8_t *bits, unsigned int len);
+	void *put_l3_ctx;
+	/* If set, every locked burst is appended here (see phy/tetra_burst_archive.h) */
+	struct tetra_burst_archive *burst_archive;
+	/* If set, the lower MAC hands its blocks to the upper MAC on another
+	 * thread through here (see tetra_mac_pipe.h), only ACCESS-ASSIGN is
+	 * parsed in line. Set with both stopped */
+	struct tetra_mac_pipe *mac_pipe;
 };
 
 extern struct tetra_display_state t_display_state;
 
 void tetra_mac_state_init(struct tetra_mac_state *tms);
+void tetra_mac_state_deinit(struct tetra_mac_state *tms);
+
+/* Publish t_display_st to the readers: the PHY after every burst, the upper
+ * MAC the cell part after every new SYSINFO. Neither waits for a reader */
+void tetra_display_publish(struct tetra_mac_state *tms);
+void tetra_display_publish_cell(struct tetra_mac_state *tms);
+/* A consistent copy of what was published last, from any thread */
+void tetra_display_read(struct tetra_mac_state *tms, struct tetra_display_state *out);
+/* Voice key of usage marker um, published by the upper MAC and read by the
+ * lower one, from any thread */
+void tetra_voice_key_publish(struct tetra_mac_state *tms, int um, const struct tetra_voice_key *vk);
+void tetra_voice_key_read(struct tetra_mac_state *tms, int um, struct tetra_voice_key *vk);
 
 #define TETRA_CRC_OK	0x1d0f
 
@@ -0,0 +1,93 @@
+/* Lock-free SPSC queue of decoded block / MAC PDU records */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetra_events.h"
+
+/* head and tail run freely and wrap at 2^32, the ring index is taken modulo size */
+
+int tetra_event_queue_init(struct tetra_event_queue *q, unsigned int size)
+{
+	unsigned int n = 1;
+
+	while (n < size)
+		n <<= 1;
+
+	memset(q, 0, sizeof(*q));
+	q->ring = calloc(n, sizeof(*q->ring));
+	if (!q->ring)
+		return -1;
+	q->size = n;
+	return 0;
+}
+
+void tetra_event_queue_deinit(struct tetra_event_queue *q)
+{
+	free(q->ring);
+	q->ring = NULL;
+	q->size = 0;
+}
+
+struct tetra_burst_event *tetra_event_queue_reserve(struct tetra_event_queue *q)
+{
+	unsigned int head = q->head;
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= q->size) {
+		__atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &q->ring[head & (q->size - 1)];
+}
+
+void tetra_event_queue_commit(struct tetra_event_queue *q)
+{
+	__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int tetra_event_queue_peek(struct tetra_event_queue *q, const struct tetra_burst_event **evs, unsigned int max)
+{
+	unsigned int tail = q->tail;
+	unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	unsigned int idx = tail & (q->size - 1);
+	unsigned int count = head - tail;
+
+	/* stop at the end of the ring, the rest comes with the next call */
+	if (count > q->size - idx)
+		count = q->size - idx;
+	if (count > max)
+		count = max;
+
+	*evs = &q->ring[idx];
+	return count;
+}
+
+void tetra_event_queue_release(struct tetra_event_queue *q, unsigned int count)
+{
+	__atomic_store_n(&q->tail, q->tail + count, __ATOMIC_RELEASE);
+}
+
+unsigned int tetra_event_queue_depth(struct tetra_event_queue *q)
+{
+	unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+	return __atomic_load_n(&q->head, __ATOMIC_RELAXED) - tail;
+}
+
+unsigned int tetra_event_queue_take_dropped(struct tetra_event_queue *q)
+{
+	return __atomic_exchange_n(&q->dropped, 0, __ATOMIC_RELAXED);
+}
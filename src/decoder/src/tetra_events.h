@@ -0,0 +1,99 @@
+#ifndef TETRA_EVENTS_H
+#define TETRA_EVENTS_H
+
+/* Decoded block / MAC PDU records handed from the decoder thread to one
+ * consumer thread through a lock-free single-producer single-consumer ring */
+
+#include <stdint.h>
+
+#include "tetra_tdma.h"
+#include "tetra_pbits.h"
+#include "tetra_cmce_pdu.h"
+#include "tetra_mm_pdu.h"
+#include "tetra_sndcp_pdu.h"
+
+/* largest payload of a record, the type-1 bits of an SCH/F block */
+#define TETRA_EVENT_MAX_BITS	268
+
+enum tetra_event_kind {
+	TETRA_EV_BLOCK,		/* one decoded MAC block, as passed up from the lower MAC */
+	TETRA_EV_MAC_PDU,	/* one MAC PDU parsed out of a block */
+	TETRA_EV_L3,		/* one TL-SDU (MLE PDU) out of a MAC PDU, decoded in l3 */
+};
+
+/* A TL-SDU with the MAC and LLC header it came with. The bits of the record
+ * are the TL-SDU, from the MLE protocol discriminator on, and offset is
+ * where it starts in the (reassembled) MAC PDU. blk_type is not set. It is
+ * queued ahead of the MAC PDU record of its block */
+struct tetra_l3_event {
+	uint32_t ssi;			/* address of the MAC PDU */
+	uint8_t addr_type;		/* enum tetra_mac_res_addr_type */
+	uint8_t usage_marker;		/* with ADDR_TYPE_SSI_USAGE */
+	uint8_t encryption_mode;	/* of the MAC PDU, 0 for clear */
+	uint32_t main_dl_hz;		/* downlink frequency of the main carrier of the cell, 0 before the first SYSINFO */
+	uint8_t chan_alloc;		/* the MAC PDU allocated a channel: */
+	uint8_t chan_alloc_type;	/* enum tetra_mac_alloc_type */
+	uint8_t chan_timeslot;		/* timeslots assigned, bit 3 is TN 1 to bit 0 TN 4 */
+	uint8_t chan_ul_dl;
+	uint16_t chan_carrier;
+	uint32_t chan_dl_hz;		/* downlink frequency of that carrier, 0 before the first SYSINFO */
+	uint8_t llc_type;		/* enum tllc_pdut_dec */
+	uint8_t fcs;			/* enum tetra_llc_fcs */
+	uint8_t pdisc;			/* enum tetra_mle_pdisc */
+	uint8_t parsed;			/* the header of the PDU below fits in the TL-SDU */
+	uint16_t sdu_len;		/* bits of TL-SDU, the record holds the first len of them */
+	union {
+		struct tetra_cmce_decoded cmce;	/* TMLE_PDISC_CMCE */
+		struct tetra_mm_decoded mm;		/* TMLE_PDISC_MM */
+		struct tetra_sndcp_decoded sndcp;	/* TMLE_PDISC_SNDCP */
+		uint8_t mle_pdu_type;			/* TMLE_PDISC_MLE */
+	};
+};
+
+struct tetra_burst_event {
+	struct tetra_tdma_time time;	/* TDMA time of the slot */
+	uint32_t scrambling_code;	/* scrambling code used for the block */
+	uint8_t kind;			/* enum tetra_event_kind */
+	uint8_t lchan;			/* enum tetra_log_chan */
+	uint8_t blk_type;		/* enum tp_sap_data_type */
+	uint8_t blk_num;		/* BLK_1 / BLK_2, or 0 for full slot blocks */
+	uint8_t crc_ok;			/* CRC of the block verified OK */
+	uint8_t snr;			/* of the burst it came in, see tetra_train_snr() */
+	uint16_t offset;		/* MAC PDU: first bit within the block */
+	uint16_t len;			/* number of payload bits */
+	uint64_t bits[TETRA_PWORDS(TETRA_EVENT_MAX_BITS)];	/* packed payload, see tetra_pbits.h */
+	struct tetra_l3_event l3;	/* TETRA_EV_L3 only */
+};
+
+/* Only the decoder writes head and only the consumer writes tail, each on
+ * its own cache line so the two threads do not bounce it between them */
+struct tetra_event_queue {
+	struct tetra_burst_event *ring;
+	unsigned int size;		/* number of records, a power of two */
+	unsigned int head __attribute__((aligned(64)));	/* next record to be written */
+	unsigned int dropped;		/* records lost because the ring was full */
+	unsigned int tail __attribute__((aligned(64)));	/* next record to be read */
+};
+
+/* size is rounded up to a power of two */
+int tetra_event_queue_init(struct tetra_event_queue *q, unsigned int size);
+void tetra_event_queue_deinit(struct tetra_event_queue *q);
+
+/* Producer side: reserve the next free record, or NULL when the ring is full
+ * (counted in dropped). The record becomes visible to the consumer on commit */
+struct tetra_burst_event *tetra_event_queue_reserve(struct tetra_event_queue *q);
+void tetra_event_queue_commit(struct tetra_event_queue *q);
+
+/* Consumer side: point *evs at the oldest pending records and return how many
+ * of them are contiguous in the ring, at most max. They stay valid until
+ * released, which hands the slots back to the producer */
+unsigned int tetra_event_queue_peek(struct tetra_event_queue *q, const struct tetra_burst_event **evs, unsigned int max);
+void tetra_event_queue_release(struct tetra_event_queue *q, unsigned int count);
+
+/* records waiting for the consumer, from any thread */
+unsigned int tetra_event_queue_depth(struct tetra_event_queue *q);
+
+/* records lost since the last call */
+unsigned int tetra_event_queue_take_dropped(struct tetra_event_queue *q);
+
+#endif /* TETRA_EVENTS_H */
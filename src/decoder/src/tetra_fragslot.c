@@ -0,0 +1,180 @@
+/* Reassembly of fragmented MAC PDUs (MAC-RESOURCE, MAC-FRAG, MAC-END) */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetra_common.h"
+#include "tetra_fragslot.h"
+#include "tetra_pbits.h"
+
+int fragslot_store_init(struct frag_store *fs, unsigned int mem_limit)
+{
+	unsigned int i, n = mem_limit * 8 / FRAGSLOT_CHUNK_BITS;
+
+	memset(fs, 0, sizeof(*fs));
+	if (n < 1)
+		n = 1;
+	fs->mem = malloc(n * sizeof(struct frag_chunk));
+	fs->linear = msgb_alloc_c(FRAGSLOT_MAX_BITS, "fragslot");
+	if (!fs->mem || !fs->linear) {
+		fragslot_store_deinit(fs);
+		return -1;
+	}
+	fs->num_chunks = n;
+	for (i = n; i > 0; i--) {
+		fs->mem[i - 1].next = fs->free_list;
+		fs->free_list = &fs->mem[i - 1];
+	}
+	return 0;
+}
+
+void fragslot_store_deinit(struct frag_store *fs)
+{
+	free(fs->mem);
+	free(fs->linear);
+	memset(fs, 0, sizeof(*fs));
+}
+
+int fragslot_set_mem_limit(struct tetra_mac_state *tms, unsigned int mem_limit)
+{
+	unsigned int dropped = tms->frag_store.dropped;
+	int i, ret;
+
+	for (i = 0; i < FRAGSLOT_NR_SLOTS; i++)
+		cleanup_fragslot(tms, &tms->fragslots[i]);
+	fragslot_store_deinit(&tms->frag_store);
+	ret = fragslot_store_init(&tms->frag_store, mem_limit);
+	tms->frag_store.dropped = dropped;
+	return ret;
+}
+
+static void release_chunks(struct frag_store *fs, struct fragslot *fragslot)
+{
+	if (fragslot->head) {
+		fragslot->tail->next = fs->free_list;
+		fs->free_list = fragslot->head;
+	}
+	fragslot->head = 0;
+	fragslot->tail = 0;
+}
+
+/* Pack bitlen bits (one per byte) onto the end of the chain */
+static void store_bits(struct frag_store *fs, struct fragslot *fragslot, const uint8_t *bits, int bitlen)
+{
+	if (fragslot->overflow)
+		return;
+	if (fragslot->stored + bitlen > FRAGSLOT_MAX_BITS)
+		goto overflow;
+
+	while (bitlen > 0) {
+		int offs = fragslot->stored % FRAGSLOT_CHUNK_BITS;
+		int n = FRAGSLOT_CHUNK_BITS - offs;
+
+		if (offs == 0) {
+			struct frag_chunk *c = fs->free_list;
+			if (!c)
+				goto overflow;
+			fs->free_list = c->next;
+			c->next = 0;
+			if (fragslot->tail)
+				fragslot->tail->next = c;
+			else
+				fragslot->head = c;
+			fragslot->tail = c;
+		}
+		if (n > bitlen)
+			n = bitlen;
+		tetra_ubit2pwords(bits, fragslot->tail->bits, offs, n);
+		fragslot->stored += n;
+		bits += n;
+		bitlen -= n;
+	}
+	return;
+
+overflow:
+	/* Drop it now so the other slots get the storage back */
+	// printf(" WARNING: FRAG LENGTH ERROR!\n");
+	release_chunks(fs, fragslot);
+	fragslot->overflow = true;
+	fs->dropped++;
+}
+
+void init_fragslot(struct tetra_mac_state *tms, struct fragslot *fragslot, const uint8_t *l1, int l2_offset, int l2_len)
+{
+	if (fragslot->active || fragslot->head) {
+		/* Should never be the case, but just to be sure */
+		cleanup_fragslot(tms, fragslot);
+	}
+	fragslot->active = 1;
+	fragslot->num_frags = 1;
+	fragslot->length = l2_len;
+	fragslot->l2_offset = l2_offset;
+	store_bits(&tms->frag_store, fragslot, l1, l2_offset + l2_len);
+}
+
+void cleanup_fragslot(struct tetra_mac_state *tms, struct fragslot *fragslot)
+{
+	release_chunks(&tms->frag_store, fragslot);
+	memset(fragslot, 0, sizeof(struct fragslot));
+}
+
+void age_fragslots(struct tetra_mac_state *tms)
+{
+	int i;
+	for (i = 0; i < FRAGSLOT_NR_SLOTS; i++) {
+		if (tms->fragslots[i].active) {
+			tms->fragslots[i].age++;
+			if (tms->fragslots[i].age > N203) {
+				// printf("\nFRAG: aged out old fragments for slot=%d fragments=%d length=%d timer=%d\n", i, tms->fragslots[i].num_frags, tms->fragslots[i].length, tms->fragslots[i].age);
+				cleanup_fragslot(tms, &tms->fragslots[i]);
+			}
+		}
+	}
+}
+
+void append_frag_bits(struct tetra_mac_state *tms, int slot, const uint8_t *bits, int bitlen)
+{
+	struct fragslot *fragslot = &tms->fragslots[slot];
+
+	store_bits(&tms->frag_store, fragslot, bits, bitlen);
+	fragslot->length = fragslot->length + bitlen;
+	fragslot->num_frags++;
+	fragslot->age = 0;
+}
+
+struct msgb *fragslot_linearize(struct tetra_mac_state *tms, struct fragslot *fragslot)
+{
+	struct msgb *msg = tms->frag_store.linear;
+	struct frag_chunk *c;
+	uint8_t *out;
+	int left;
+
+	if (!fragslot->active || fragslot->overflow || !msg)
+		return 0;
+
+	msg->data = msg->head = msg->tail = msg->_data;
+	msg->len = 0;
+	out = msgb_put(msg, fragslot->stored);
+	for (c = fragslot->head, left = fragslot->stored; c && left > 0; c = c->next) {
+		int n = left < FRAGSLOT_CHUNK_BITS ? left : FRAGSLOT_CHUNK_BITS;
+		tetra_pwords2ubit(c->bits, 0, out, n);
+		out += n;
+		left -= n;
+	}
+	msg->l1h = msg->data;
+	msg->l2h = msg->l1h + fragslot->l2_offset;
+	msg->l3h = 0;
+	return msg;
+}
@@ -1,17 +1,69 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tetra_mac_pdu.h"
+
 #define REASSEMBLE_FRAGMENTS 1		/* Set to 0 to disable reassembly functionality */
 #define FRAGSLOT_NR_SLOTS 5		/* Slot 0 is unused */
 
 #define N203 6				/* Fragslot max age, see N.203 in the tetra docs, must be 4 multiframes or greater */
-#define FRAGSLOT_MSGB_SIZE 8192
+
+/* Fragments are kept packed, 64 bits per word, in a chain of fixed size chunks
+ * per slot. Only the completed PDU is unpacked again, once, at MAC-END */
+#define FRAGSLOT_CHUNK_BITS 512		/* a little more than the TM-SDU of one full slot */
+#define FRAGSLOT_MAX_BITS 16384		/* longest reassembled PDU, a 2 kB TM-SDU */
+/* Default payload bytes of the chunk storage shared by all slots, enough for
+ * every slot to hold a PDU of FRAGSLOT_MAX_BITS */
+#define FRAGSLOT_DEFAULT_MEM_LIMIT ((FRAGSLOT_NR_SLOTS - 1) * FRAGSLOT_MAX_BITS / 8)
+
+struct tetra_mac_state;
+struct msgb;
+
+struct frag_chunk {
+	struct frag_chunk *next;
+	uint64_t bits[FRAGSLOT_CHUNK_BITS / 64];
+};
+
+/* Chunk storage of one decoder, allocated up front. When it runs out the
+ * PDU being appended to is dropped instead of passed up truncated */
+struct frag_store {
+	struct frag_chunk *mem;
+	struct frag_chunk *free_list;
+	unsigned int num_chunks;
+	unsigned int dropped;		/* PDUs lost because they outgrew the storage or FRAGSLOT_MAX_BITS */
+	struct msgb *linear;		/* the completed PDU, unpacked */
+};
+
 struct fragslot {
 	bool active;			/* Set to 1 when fragslot holds a partially constructed message */
+	bool overflow;			/* Ran out of storage, the message is dropped at MAC-END */
 	uint32_t age;			/* Maintains the number of multiframes since the last fragment */
-	int num_frags;			/* Maintains the number of fragments appended in the msgb */
-	int length;			/* Maintains the number of bits appended in the msgb */
+	int num_frags;			/* Maintains the number of fragments appended */
+	int length;			/* Maintains the number of TM-SDU bits appended */
+	int l2_offset;			/* MAC-RESOURCE header bits stored ahead of the TM-SDU */
+	int stored;			/* Bits held in the chunk chain, header included */
 	bool encryption;		/* Set to true if the fragments were received encrypted */
 	struct tetra_key *key;		/* Holds pointer to the key to be used for this slot */
-	struct msgb *msgb;		/* Message buffer in which fragments are appended */
+	struct tetra_resrc_decoded rsd;	/* Header of the MAC-RESOURCE that started the message */
+	struct frag_chunk *head;	/* Chunk chain holding the fragments, head first */
+	struct frag_chunk *tail;
 };
 
+/* mem_limit is in bytes of fragment payload, at least one chunk */
+int fragslot_store_init(struct frag_store *fs, unsigned int mem_limit);
+void fragslot_store_deinit(struct frag_store *fs);
+/* Resize the storage of tms, the messages in progress are dropped */
+int fragslot_set_mem_limit(struct tetra_mac_state *tms, unsigned int mem_limit);
+
+/* Start the message of a MAC-RESOURCE from its l2_offset bits of MAC header
+ * at l1, directly followed by the l2_len bits of the first TM-SDU fragment */
+void init_fragslot(struct tetra_mac_state *tms, struct fragslot *fragslot, const uint8_t *l1, int l2_offset, int l2_len);
+void cleanup_fragslot(struct tetra_mac_state *tms, struct fragslot *fragslot);
+void age_fragslots(struct tetra_mac_state *tms);
+void append_frag_bits(struct tetra_mac_state *tms, int slot, const uint8_t *bits, int bitlen);
+
+/* The reassembled message as one bit per byte, l1h at the MAC header and l2h
+ * at the TM-SDU. NULL if it was dropped. Valid until the next call */
+struct msgb *fragslot_linearize(struct tetra_mac_state *tms, struct fragslot *fragslot);
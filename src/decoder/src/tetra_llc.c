@@ -0,0 +1,111 @@
+/* TETRA LLC Layer */
+
+/* (C) 2011 by Harald Welte <laforge@gnumonks.org>
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// #include <osmocom/core/msgb.h>
+// #include <osmocom/core/talloc.h>
+// #include <osmocom/core/bits.h>
+
+#include "tetra_llc.h"
+#include "tetra_llc_pdu.h"
+#include "tetra_mle.h"
+
+/* Receive TM-SDU (MAC SDU == LLC PDU) */
+/* this resembles TMA-UNITDATA.ind (TM-SDU / length) */
+int rx_tm_sdu(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup,
+	      const struct tetra_resrc_decoded *rsd, struct msgb *msg, unsigned int len)
+{
+	struct tetra_llc_pdu lpp;
+	struct tetra_l3_event l3;
+
+	if (!len) {
+		return -1;
+	} else if (len < 4) {
+		// printf("WARNING rx_tm_sdu: l2len too small: %d\n", len);
+		return -1;
+	}
+
+	memset(&lpp, 0, sizeof(lpp));
+	tetra_llc_pdu_parse(&lpp, msg->l2h, len);
+	/* nothing for the MLE, as of a PDU too short to parse */
+	if (!lpp.tl_sdu_len) {
+		return len;
+	}
+
+	msg->l3h = lpp.tl_sdu;
+	msg->tail = msg->l3h + lpp.tl_sdu_len; // Strips off FCS (if present)
+	msg->len = msg->tail - msg->head;
+
+	// printf("TM-SDU(%s)", tetra_get_llc_pdut_dec_name(lpp.pdu_type));
+	if (lpp.have_fcs) {
+		// printf(" fcs=%s ", (lpp.have_fcs && lpp.fcs_invalid ? "BAD" : "OK"));
+	}
+	// printf(" l3len=%d", msgb_l3len(msg));
+	if (msgb_l3len(msg)) {
+		// printf(" %s", osmo_ubit_dump(msg->l3h, msgb_l3len(msg)));
+	}
+	// printf("\n");
+
+	switch (lpp.pdu_type) {
+	case TLLC_PDUT_DEC_BL_ADATA:
+	case TLLC_PDUT_DEC_BL_DATA:
+	case TLLC_PDUT_DEC_BL_UDATA:
+	case TLLC_PDUT_DEC_BL_ACK:
+		/* directly hand it to MLE */
+		break;
+	default:
+		/* FIXME: the segments of the advanced link are not
+		 * reassembled, nor is their FCS checked */
+		return len;
+	}
+
+	memset(&l3, 0, sizeof(l3));
+	l3.ssi = rsd->addr.ssi;
+	l3.addr_type = rsd->addr.type;
+	l3.usage_marker = rsd->addr.usage_marker;
+	l3.encryption_mode = rsd->encryption_mode;
+	if (tms->last_sid.main_carrier)
+		l3.main_dl_hz = tetra_dl_carrier_hz(tms->last_sid.freq_band, tms->last_sid.main_carrier,
+						    tms->last_sid.freq_offset);
+	if (rsd->chan_alloc_pres) {
+		l3.chan_alloc = 1;
+		l3.chan_alloc_type = rsd->cad.type;
+		l3.chan_timeslot = rsd->cad.timeslot;
+		l3.chan_ul_dl = rsd->cad.ul_dl;
+		l3.chan_carrier = rsd->cad.carrier_nr;
+		if (rsd->cad.ext_carr_pres)
+			l3.chan_dl_hz = tetra_dl_carrier_hz(rsd->cad.ext_carr.freq_band, rsd->cad.carrier_nr,
+							    rsd->cad.ext_carr.freq_offset);
+		else if (tms->last_sid.main_carrier)
+			l3.chan_dl_hz = tetra_dl_carrier_hz(tms->last_sid.freq_band, rsd->cad.carrier_nr,
+							    tms->last_sid.freq_offset);
+	}
+	l3.llc_type = lpp.pdu_type;
+	if (!lpp.have_fcs)
+		l3.fcs = TLLC_FCS_NONE;
+	else
+		l3.fcs = lpp.fcs_invalid ? TLLC_FCS_BAD : TLLC_FCS_OK;
+
+	rx_tl_sdu(tms, tup, &l3, msg, lpp.tl_sdu_len);
+	return len;
+}
@@ -0,0 +1,12 @@
+#ifndef TETRA_LLC_H
+#define TETRA_LLC_H
+
+#include "tetra_common.h"
+#include "tetra_prim.h"
+
+/* rsd is the header of the MAC PDU the TM-SDU came in, the MAC-RESOURCE that
+ * started it when it was reassembled from fragments */
+int rx_tm_sdu(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup,
+	      const struct tetra_resrc_decoded *rsd, struct msgb *msg, unsigned int len);
+
+#endif
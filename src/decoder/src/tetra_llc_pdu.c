@@ -24,12 +24,16 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 
-#include <osmocom/core/utils.h>
+// #include <osmocom/core/utils.h>
 
 #include "tetra_common.h"
 #include "tetra_llc_pdu.h"
+#include "tetra_pbits.h"
+
+#define TLLC_FCS_POLY	0x04C11DB7
 
 static const struct value_string tetra_llc_pdut_names[] = {
 	{ TLLC_PDUT_BL_ADATA,		"BL-ADATA" },
@@ -102,18 +106,49 @@ static const uint8_t tetra_llc_pdu_lengths[16] = {
 	0,	/* Not implemented, TLLD_PDUT_AL_DISC */
 };
 
-static uint32_t tetra_llc_compute_fcs(const uint8_t *buf, int len)
+/* CRC of one byte, fed MSB first */
+static uint32_t fcs_table[256];
+static pthread_once_t fcs_table_once = PTHREAD_ONCE_INIT;
+
+static void fcs_table_init_once(void)
+{
+	uint32_t crc;
+	int i, b;
+
+	for (i = 0; i < 256; i++) {
+		crc = (uint32_t) i << 24;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ TLLC_FCS_POLY : crc << 1;
+		fcs_table[i] = crc;
+	}
+}
+
+uint32_t tetra_llc_compute_fcs(const uint8_t *buf, int len)
 {
 	uint32_t crc = 0xFFFFFFFF;
-	if (len < 32) {
+	uint64_t w;
+	int i = 0, b;
+
+	/* a TL-SDU with no bits left before its FCS shifts them all out */
+	if (len <= 0) {
+		crc = 0;
+	} else if (len < 32) {
 		crc <<= (32 - len);
 	}
 
-	for (size_t i = 0; i < len; i++) {
+	/* a byte at a time out of every 64 bits packed */
+	pthread_once(&fcs_table_once, fcs_table_init_once);
+	for (; i + 64 <= len; i += 64) {
+		tetra_ubit2pwords(buf + i, &w, 0, 64);
+		for (b = 56; b >= 0; b -= 8)
+			crc = (crc << 8) ^ fcs_table[((crc >> 24) ^ (w >> b)) & 0xff];
+	}
+
+	for (; i < len; i++) {
 		uint8_t bit = (buf[i] ^ (crc >> 31)) & 1;
 		crc <<= 1;
 		if (bit) {
-			crc = crc ^ 0x04C11DB7;
+			crc = crc ^ TLLC_FCS_POLY;
 		}
 	}
 	return ~crc;
@@ -139,6 +174,7 @@ int tetra_llc_pdu_parse(struct tetra_llc_pdu *lpp, uint8_t *buf, int len)
 	/* Check length to prevent out of bounds reads */
 	if (len < tetra_llc_pdu_lengths[pdu_type]) {
 		// printf("WARNING llc pdu too small to parse, needed %d\n", tetra_llc_pdu_lengths[pdu_type]);
+		lpp->tl_sdu = cur;
 		lpp->tl_sdu_len = 0;
 		return len;
 	}
@@ -2,8 +2,7 @@
 #define TETRA_LLC_PDU_H
 
 #include <stdbool.h>
-
-// #include <osmocom/core/linuxlist.h>
+#include <stdint.h>
 
 /* Table 21.1 */
 enum tetra_llc_pdu_t {
@@ -83,24 +82,18 @@ struct tetra_llc_pdu {
 	uint32_t tl_sdu_len;	/* in bits */
 };
 
-/* parse a received LLC PDU and parse it into 'lpp' */
-int tetra_llc_pdu_parse(struct tetra_llc_pdu *lpp, uint8_t *buf, int len);
-
-/* TETRA LLC state */
-struct tllc_state {
-	// struct llist_head list;
-
-	// struct {
-	// 	struct llist_head defrag_list;
-	// } rx;
+/* FCS check of a TL-SDU as passed on */
+enum tetra_llc_fcs {
+	TLLC_FCS_NONE,		/* the PDU has none, or it is only known after reassembly */
+	TLLC_FCS_OK,
+	TLLC_FCS_BAD,
 };
 
-/* entry in the defragmentation queue */
-struct tllc_defrag_q_e {
-	// struct llist_head list;
-	unsigned int ns;	/* current de-fragmenting */
-	unsigned int last_ss;	/* last received S(S) */
+/* parse a received LLC PDU and parse it into 'lpp'. Nothing is allocated,
+ * tl_sdu points into buf */
+int tetra_llc_pdu_parse(struct tetra_llc_pdu *lpp, uint8_t *buf, int len);
+
+/* The 32 bit FCS over len bits (one per byte) at buf, clause 22.3.3.3 */
+uint32_t tetra_llc_compute_fcs(const uint8_t *buf, int len);
 
-	struct msgb *tl_sdu;
-};
 #endif /* TETRA_LLC_PDU_H */
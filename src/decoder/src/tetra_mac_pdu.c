@@ -24,115 +24,147 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <stddef.h>
 
 // #include <osmocom/core/utils.h>
 
 #include "tetra_common.h"
 #include "tetra_mac_pdu.h"
 
-static void decode_d_mle_sysinfo(struct tetra_mle_si_decoded *msid, const uint8_t *bits)
-{
-	const uint8_t *cur = bits;
+/* Declarative layout of the MAC PDU headers, run by macpdu_parse() over a
+ * tetra_bitreader in one pass */
+enum macpdu_op {
+	MF_READ8,		/* next bits into the member, by its size */
+	MF_READ16,
+	MF_READ32,
+	MF_SKIP,		/* skip bits */
+	MF_SKIP_IF_SET,		/* 1 bit flag, followed by bits when it is set */
+	MF_IF_IN,		/* the next skip entries only apply if the (uint8_t) member has one of the values in mask */
+};
 
-	msid->la = bits_to_uint(cur, 14); cur += 14;
-	msid->subscr_class = bits_to_uint(cur, 16); cur += 16;
-	msid->bs_service_details = bits_to_uint(cur, 12); cur += 12;
-}
+struct macpdu_field {
+	uint8_t op;
+	uint8_t bits;
+	uint8_t skip;
+	uint16_t offset;	/* offsetof the member */
+	uint32_t mask;		/* bit n set: value n */
+};
 
-/* see 21.4.4.1 */
-void macpdu_decode_sysinfo(struct tetra_si_decoded *sid, const uint8_t *si_bits)
+#define MF_READ_OP(size)		((size) == 1 ? MF_READ8 : (size) == 2 ? MF_READ16 : MF_READ32)
+#define MF_FIELD(type, member, n)	{ MF_READ_OP(sizeof(((type *)0)->member)), n, 0, offsetof(type, member), 0 }
+#define MF_SKIP(n)			{ MF_SKIP, n, 0, 0, 0 }
+#define MF_SKIP_IF_SET(n)		{ MF_SKIP_IF_SET, n, 0, 0, 0 }
+#define MF_IF(type, member, values, n)	{ MF_IF_IN, 0, n, offsetof(type, member), values }
+#define MF_V(v)				(1u << (v))
+
+static void macpdu_parse(struct tetra_bitreader *br, const struct macpdu_field *f, unsigned int count, void *out)
 {
-	const uint8_t *cur     = si_bits;
-	cur += 2; // skip Broadcast PDU header
-	cur += 2; // skip Sysinfo PDU header
-
-	sid->main_carrier      = bits_to_uint(cur, 12); cur += 12;
-	sid->freq_band         = bits_to_uint(cur,  4); cur +=  4;
-	sid->freq_offset       = bits_to_uint(cur,  2); cur +=  2;
-	sid->duplex_spacing    = bits_to_uint(cur,  3); cur +=  3;
-	sid->reverse_operation = *cur++;
-	sid->num_of_csch       = bits_to_uint(cur,  2); cur +=  2;
-	sid->ms_txpwr_max_cell = bits_to_uint(cur,  3); cur +=  3;
-	sid->rxlev_access_min  = bits_to_uint(cur,  4); cur +=  4;
-	sid->access_parameter  = bits_to_uint(cur,  4); cur +=  4;
-	sid->radio_dl_timeout  = bits_to_uint(cur,  4); cur +=  4;
-	sid->cck_valid_no_hf   = *cur++;
-	if (sid->cck_valid_no_hf)
-		sid->cck_id = bits_to_uint(cur, 16);
-	else
-		sid->hyperframe_number = bits_to_uint(cur, 16);
-	sid->option_field      = bits_to_uint(cur,  2); cur +=  2;
+	const struct macpdu_field *end = f + count;
+	uint8_t v;
 
-	switch (sid->option_field) {
-	case TETRA_MAC_OPT_FIELD_EVEN_MULTIFRAME:     // Even multiframe definition for TS mode
-	case TETRA_MAC_OPT_FIELD_ODD_MULTIFRAME:      // Odd multiframe definition for TS mode
-		sid->frame_bitmap = bits_to_uint(cur, 20); cur += 20;
-		break;
-	case TETRA_MAC_OPT_FIELD_ACCESS_CODE:         // Default definition for access code A
-		sid->access_code = bits_to_uint(cur, 20); cur += 20;
-		break;
-	case TETRA_MAC_OPT_FIELD_EXT_SERVICES:        // Extended services broadcast
-		sid->ext_service = bits_to_uint(cur, 20); cur += 20;
-		break;
-	}
+	for (; f < end; f++) {
+		uint8_t *p = (uint8_t *)out + f->offset;
 
-	decode_d_mle_sysinfo(&sid->mle_si, si_bits + 124-42);  // could be also cur due to previous fixes
+		switch (f->op) {
+		case MF_READ8:
+			*p = tetra_bitreader_get(br, f->bits);
+			break;
+		case MF_READ16:
+			*(uint16_t *)p = tetra_bitreader_get(br, f->bits);
+			break;
+		case MF_READ32:
+			*(uint32_t *)p = tetra_bitreader_get(br, f->bits);
+			break;
+		case MF_SKIP:
+			tetra_bitreader_skip(br, f->bits);
+			break;
+		case MF_SKIP_IF_SET:
+			tetra_bitreader_skip(br, tetra_bitreader_get(br, 1) * f->bits);
+			break;
+		case MF_IF_IN:
+			v = *p;
+			if (v >= 32 || !(f->mask & MF_V(v)))
+				f += f->skip;
+			break;
+		}
+	}
 }
 
-static const uint8_t addr_len_by_type[] = {
-	[ADDR_TYPE_SSI]		= 24,
-	[ADDR_TYPE_EVENT_LABEL]	= 10,
-	[ADDR_TYPE_USSI]	= 24,
-	[ADDR_TYPE_SMI]		= 24,
-	[ADDR_TYPE_SSI_EVENT]	= 34,
-	[ADDR_TYPE_SSI_USAGE]	= 30,
-	[ADDR_TYPE_SMI_EVENT]	= 34,
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* see 21.4.4.1 */
+static const struct macpdu_field sysinfo_fields[] = {
+	MF_SKIP(2),	/* Broadcast PDU header */
+	MF_SKIP(2),	/* Sysinfo PDU header */
+	MF_FIELD(struct tetra_si_decoded, main_carrier, 12),
+	MF_FIELD(struct tetra_si_decoded, freq_band, 4),
+	MF_FIELD(struct tetra_si_decoded, freq_offset, 2),
+	MF_FIELD(struct tetra_si_decoded, duplex_spacing, 3),
+	MF_FIELD(struct tetra_si_decoded, reverse_operation, 1),
+	MF_FIELD(struct tetra_si_decoded, num_of_csch, 2),
+	MF_FIELD(struct tetra_si_decoded, ms_txpwr_max_cell, 3),
+	MF_FIELD(struct tetra_si_decoded, rxlev_access_min, 4),
+	MF_FIELD(struct tetra_si_decoded, access_parameter, 4),
+	MF_FIELD(struct tetra_si_decoded, radio_dl_timeout, 4),
+	MF_FIELD(struct tetra_si_decoded, cck_valid_no_hf, 1),
+	/* cck_id or hyperframe_number, they share the storage */
+	MF_FIELD(struct tetra_si_decoded, cck_id, 16),
+	MF_FIELD(struct tetra_si_decoded, option_field, 2),
+	/* frame_bitmap, access_code or ext_service depending on option_field, all 20 bits */
+	MF_FIELD(struct tetra_si_decoded, frame_bitmap, 20),
+	/* D-MLE-SYSINFO */
+	MF_FIELD(struct tetra_si_decoded, mle_si.la, 14),
+	MF_FIELD(struct tetra_si_decoded, mle_si.subscr_class, 16),
+	MF_FIELD(struct tetra_si_decoded, mle_si.bs_service_details, 12),
 };
 
+void macpdu_decode_sysinfo(struct tetra_si_decoded *sid, struct tetra_bitreader *br)
+{
+	macpdu_parse(br, sysinfo_fields, ARRAY_SIZE(sysinfo_fields), sid);
+}
+
 /* 21.5.2 */
-int macpdu_decode_chan_alloc(struct tetra_chan_alloc_decoded *cad, const uint8_t *bits)
+static const struct macpdu_field chan_alloc_fields[] = {
+	MF_FIELD(struct tetra_chan_alloc_decoded, type, 2),
+	MF_FIELD(struct tetra_chan_alloc_decoded, timeslot, 4),
+	MF_FIELD(struct tetra_chan_alloc_decoded, ul_dl, 2),
+	MF_FIELD(struct tetra_chan_alloc_decoded, clch_perm, 1),
+	MF_FIELD(struct tetra_chan_alloc_decoded, cell_chg_f, 1),
+	MF_FIELD(struct tetra_chan_alloc_decoded, carrier_nr, 12),
+	MF_FIELD(struct tetra_chan_alloc_decoded, ext_carr_pres, 1),
+	MF_IF(struct tetra_chan_alloc_decoded, ext_carr_pres, MF_V(1), 4),
+		MF_FIELD(struct tetra_chan_alloc_decoded, ext_carr.freq_band, 4),
+		MF_FIELD(struct tetra_chan_alloc_decoded, ext_carr.freq_offset, 2),
+		MF_FIELD(struct tetra_chan_alloc_decoded, ext_carr.duplex_spc, 3),
+		MF_FIELD(struct tetra_chan_alloc_decoded, ext_carr.reverse_oper, 1),
+	MF_FIELD(struct tetra_chan_alloc_decoded, monit_pattern, 2),
+	MF_IF(struct tetra_chan_alloc_decoded, monit_pattern, MF_V(0), 1),
+		MF_FIELD(struct tetra_chan_alloc_decoded, monit_patt_f18, 2),
+	/* augmented channel allocation */
+	MF_IF(struct tetra_chan_alloc_decoded, ul_dl, MF_V(0), 15),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.ul_dl_ass, 2),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.bandwidth, 3),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.modulation, 3),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.max_ul_qam, 3),
+		MF_SKIP(3),	/* reserved */
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.conf_chan_stat, 3),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.bs_imbalance, 4),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.bs_tx_rel, 5),
+		MF_FIELD(struct tetra_chan_alloc_decoded, aug.napping_sts, 2),
+		MF_IF(struct tetra_chan_alloc_decoded, aug.napping_sts, MF_V(1), 1),
+			MF_SKIP(11),	/* napping info 21.5.2c */
+		MF_SKIP(4),	/* reserved */
+		MF_SKIP_IF_SET(16),
+		MF_SKIP_IF_SET(16),
+		MF_SKIP(1),
+};
+
+int macpdu_decode_chan_alloc(struct tetra_chan_alloc_decoded *cad, struct tetra_bitreader *br)
 {
-	const uint8_t *cur = bits;
-
-	cad->type =		bits_to_uint(cur, 2); cur += 2;
-	cad->timeslot =		bits_to_uint(cur, 4); cur += 4;
-	cad->ul_dl =		bits_to_uint(cur, 2); cur += 2;
-	cad->clch_perm =	*cur++;
-	cad->cell_chg_f =	*cur++;
-	cad->carrier_nr =	bits_to_uint(cur, 12); cur += 12;
-
-	cad->ext_carr_pres =	*cur++;
-	if (cad->ext_carr_pres) {
-		cad->ext_carr.freq_band =	bits_to_uint(cur, 4); cur += 4;
-		cad->ext_carr.freq_offset =	bits_to_uint(cur, 2); cur += 2;
-		cad->ext_carr.duplex_spc =	bits_to_uint(cur, 3); cur += 3;
-		cad->ext_carr.reverse_oper =	bits_to_uint(cur, 1); cur += 1;
-	}
-	cad->monit_pattern =	bits_to_uint(cur, 2); cur += 2;
-	if (cad->monit_pattern == 0) {
-		cad->monit_patt_f18 =	bits_to_uint(cur, 2);
-		cur += 2;
-	}
-	if (cad->ul_dl == 0) {
-		cad->aug.ul_dl_ass =		bits_to_uint(cur, 2); cur += 2;
-		cad->aug.bandwidth =		bits_to_uint(cur, 3); cur += 3;
-		cad->aug.modulation =		bits_to_uint(cur, 3); cur += 3;
-		cad->aug.max_ul_qam =		bits_to_uint(cur, 3); cur += 3;
-		cur += 3; /* reserved */
-		cad->aug.conf_chan_stat =	bits_to_uint(cur, 3); cur += 3;
-		cad->aug.bs_imbalance =		bits_to_uint(cur, 4); cur += 4;
-		cad->aug.bs_tx_rel =		bits_to_uint(cur, 5); cur += 5;
-		cad->aug.napping_sts =		bits_to_uint(cur, 2); cur += 2;
-		if (cad->aug.napping_sts == 1)
-			cur += 11; /* napping info 21.5.2c */
-		cur += 4; /* reserved */
-		if (*cur++)
-			cur += 16;
-		if (*cur++)
-			cur += 16;
-		cur++;
-	}
-	return cur - bits;
+	unsigned int start = tetra_bitreader_tell(br);
+
+	macpdu_parse(br, chan_alloc_fields, ARRAY_SIZE(chan_alloc_fields), cad);
+	return tetra_bitreader_tell(br) - start;
 }
 
 /* According to table 21.90 */
@@ -179,71 +211,62 @@ static int decode_length(unsigned int length_ind)
 }
 
 
-/* Section 21.4.3.1 MAC-RESOURCE */
-int macpdu_decode_resource(struct tetra_resrc_decoded *rsd, const uint8_t *bits, uint8_t is_decrypted)
+/* Section 21.4.3.1 MAC-RESOURCE, up to the address type */
+static const struct macpdu_field resource_hdr_fields[] = {
+	MF_SKIP(2),	/* MAC PDU type */
+	MF_FIELD(struct tetra_resrc_decoded, fill_bits, 1),
+	MF_FIELD(struct tetra_resrc_decoded, grant_position, 1),
+	MF_FIELD(struct tetra_resrc_decoded, encryption_mode, 2),
+	MF_FIELD(struct tetra_resrc_decoded, rand_acc_flag, 1),
+	MF_FIELD(struct tetra_resrc_decoded, macpdu_length, 6),	/* length indicator, see decode_length() */
+	MF_FIELD(struct tetra_resrc_decoded, addr.type, 3),
+};
+
+#define ADDR_VALID	(MF_V(ADDR_TYPE_NULL) | MF_V(ADDR_TYPE_SSI) | MF_V(ADDR_TYPE_EVENT_LABEL) | MF_V(ADDR_TYPE_USSI) | \
+			 MF_V(ADDR_TYPE_SMI) | MF_V(ADDR_TYPE_SSI_EVENT) | MF_V(ADDR_TYPE_SSI_USAGE) | MF_V(ADDR_TYPE_SMI_EVENT))
+#define ADDR_HAS_SSI	(MF_V(ADDR_TYPE_SSI) | MF_V(ADDR_TYPE_USSI) | MF_V(ADDR_TYPE_SMI) | \
+			 MF_V(ADDR_TYPE_SSI_EVENT) | MF_V(ADDR_TYPE_SSI_USAGE) | MF_V(ADDR_TYPE_SMI_EVENT))
+#define ADDR_HAS_EVENT	(MF_V(ADDR_TYPE_EVENT_LABEL) | MF_V(ADDR_TYPE_SSI_EVENT) | MF_V(ADDR_TYPE_SMI_EVENT))
+
+/* the rest of it, for any address type but ADDR_TYPE_NULL */
+static const struct macpdu_field resource_fields[] = {
+	MF_IF(struct tetra_resrc_decoded, addr.type, ADDR_HAS_SSI, 1),
+		MF_FIELD(struct tetra_resrc_decoded, addr.ssi, 24),
+	MF_IF(struct tetra_resrc_decoded, addr.type, ADDR_HAS_EVENT, 1),
+		MF_FIELD(struct tetra_resrc_decoded, addr.event_label, 10),
+	MF_IF(struct tetra_resrc_decoded, addr.type, MF_V(ADDR_TYPE_SSI_USAGE), 1),
+		MF_FIELD(struct tetra_resrc_decoded, addr.usage_marker, 6),
+	/* no intermediate napping in pi/4 */
+	MF_FIELD(struct tetra_resrc_decoded, power_control_pres, 1),
+	MF_IF(struct tetra_resrc_decoded, power_control_pres, MF_V(1), 1),
+		MF_SKIP(4),
+	/* FIXME: multiple slot granting flag (can only exist in QAM) */
+	MF_FIELD(struct tetra_resrc_decoded, slot_granting.pres, 1),
+	MF_IF(struct tetra_resrc_decoded, slot_granting.pres, MF_V(1), 2),
+		MF_FIELD(struct tetra_resrc_decoded, slot_granting.nr_slots, 4),	/* see decode_nr_slots() */
+		MF_FIELD(struct tetra_resrc_decoded, slot_granting.delay, 4),
+	MF_FIELD(struct tetra_resrc_decoded, chan_alloc_pres, 1),
+};
+
+int macpdu_decode_resource(struct tetra_resrc_decoded *rsd, struct tetra_bitreader *br, uint8_t is_decrypted)
 {
-	const uint8_t *cur = bits + 2;
-	rsd->fill_bits = bits_to_uint(cur, 1); cur += 1;
-	rsd->grant_position = bits_to_uint(cur, 1); cur += 1;
-	rsd->encryption_mode = bits_to_uint(cur, 2); cur += 2;
+	macpdu_parse(br, resource_hdr_fields, ARRAY_SIZE(resource_hdr_fields), rsd);
 	rsd->is_encrypted = rsd->encryption_mode > 0 && !is_decrypted;
-	rsd->rand_acc_flag = *cur++;
-	rsd->macpdu_length = decode_length(bits_to_uint(cur, 6)); cur += 6;
-	rsd->addr.type = bits_to_uint(cur, 3); cur += 3;
-	switch (rsd->addr.type) {
-	case ADDR_TYPE_NULL:
+	rsd->macpdu_length = decode_length(rsd->macpdu_length);
+	if (rsd->addr.type == ADDR_TYPE_NULL)
 		return 0;
-		break;
-	case ADDR_TYPE_SSI:
-	case ADDR_TYPE_USSI:
-	case ADDR_TYPE_SMI:
-		rsd->addr.ssi = bits_to_uint(cur, 24);
-		break;
-	case ADDR_TYPE_EVENT_LABEL:
-		rsd->addr.event_label = bits_to_uint(cur, 10);
-		break;
-	case ADDR_TYPE_SSI_EVENT:
-	case ADDR_TYPE_SMI_EVENT:
-		rsd->addr.ssi = bits_to_uint(cur, 24);
-		rsd->addr.event_label = bits_to_uint(cur+24, 10);
-		break;
-	case ADDR_TYPE_SSI_USAGE:
-		rsd->addr.ssi = bits_to_uint(cur, 24);
-		rsd->addr.usage_marker = bits_to_uint(cur+24, 6);
-		break;
-	default:
+	if (rsd->addr.type >= 32 || !(ADDR_VALID & MF_V(rsd->addr.type)))
 		return -EINVAL;
-		break;
-	}
-	cur += addr_len_by_type[rsd->addr.type];
-	/* no intermediate napping in pi/4 */
-	rsd->power_control_pres = *cur++;
-	if (rsd->power_control_pres)
-		cur += 4;
-	rsd->slot_granting.pres = *cur++;
-	if (rsd->slot_granting.pres) {
-#if 0
-		/* check for multiple slot granting flag (can only exist in QAM) */
-		if (*cur++) {
-			cur += 0; //FIXME;
-		} else {
-#endif
-			rsd->slot_granting.nr_slots =
-				decode_nr_slots(bits_to_uint(cur, 4));
-			cur += 4;
-			rsd->slot_granting.delay = bits_to_uint(cur, 4);
-			cur += 4;
-#if 0
-		}
-#endif
-	}
-	rsd->chan_alloc_pres = *cur++;
+
+	macpdu_parse(br, resource_fields, ARRAY_SIZE(resource_fields), rsd);
+	if (rsd->slot_granting.pres)
+		rsd->slot_granting.nr_slots = decode_nr_slots(rsd->slot_granting.nr_slots);
 
 	if (rsd->chan_alloc_pres && !rsd->is_encrypted)
 		// We can only determine length if the frame is unencrypted
-		cur += macpdu_decode_chan_alloc(&rsd->cad, cur);
+		macpdu_parse(br, chan_alloc_fields, ARRAY_SIZE(chan_alloc_fields), &rsd->cad);
 
-	return cur - bits;
+	return tetra_bitreader_tell(br);
 }
 
 static void decode_access_field(struct tetra_access_field *taf, uint8_t field)
@@ -254,12 +277,13 @@ static void decode_access_field(struct tetra_access_field *taf, uint8_t field)
 }
 
 /* Section 21.4.7.2 ACCESS-ASSIGN PDU */
-void macpdu_decode_access_assign(struct tetra_acc_ass_decoded *aad, const uint8_t *bits, int f18)
+void macpdu_decode_access_assign(struct tetra_acc_ass_decoded *aad, struct tetra_bitreader *br, int f18)
 {
 	uint8_t field1, field2;
-	aad->hdr = bits_to_uint(bits, 2);
-	field1 = bits_to_uint(bits+2, 6);
-	field2 = bits_to_uint(bits+8, 6);
+
+	aad->hdr = tetra_bitreader_get(br, 2);
+	field1 = tetra_bitreader_get(br, 6);
+	field2 = tetra_bitreader_get(br, 6);
 
 	if (f18 == 0) {
 		switch (aad->hdr) {
@@ -1,6 +1,8 @@
 #ifndef TETRA_MAC_PDU
 #define TETRA_MAC_PDU
 
+#include "tetra_pbits.h"
+
 #define MACPDU_LEN_2ND_STOLEN   -2
 #define MACPDU_LEN_START_FRAG   -1
 
@@ -81,7 +83,8 @@ struct tetra_si_decoded {
 
 const char *tetra_get_macpdu_name(uint8_t pdu_type);
 
-void macpdu_decode_sysinfo(struct tetra_si_decoded *sid, const uint8_t *si_bits);
+/* The decoders read the PDU from br, see tetra_pbits.h */
+void macpdu_decode_sysinfo(struct tetra_si_decoded *sid, struct tetra_bitreader *br);
 
 
 /* Section 21.4.7.2 ACCESS-ASSIGN PDU */
@@ -153,7 +156,7 @@ struct tetra_acc_ass_decoded {
 	struct tetra_access_field access[2];
 };
 
-void macpdu_decode_access_assign(struct tetra_acc_ass_decoded *aad, const uint8_t *bits, int f18);
+void macpdu_decode_access_assign(struct tetra_acc_ass_decoded *aad, struct tetra_bitreader *br, int f18);
 const char *tetra_get_dl_usage_name(uint8_t num);
 const char *tetra_get_ul_usage_name(uint8_t num);
 
@@ -235,9 +238,10 @@ struct tetra_resrc_decoded {
 	uint8_t chan_alloc_pres;
 	struct tetra_chan_alloc_decoded cad;
 };
-int macpdu_decode_resource(struct tetra_resrc_decoded *rsd, const uint8_t *bits, uint8_t is_decrypted);
+/* returns the bits taken by the header */
+int macpdu_decode_resource(struct tetra_resrc_decoded *rsd, struct tetra_bitreader *br, uint8_t is_decrypted);
 
-int macpdu_decode_chan_alloc(struct tetra_chan_alloc_decoded *cad, const uint8_t *bits);
+int macpdu_decode_chan_alloc(struct tetra_chan_alloc_decoded *cad, struct tetra_bitreader *br);
 
 const char *tetra_addr_dump(const struct tetra_addr *addr);
 
@@ -0,0 +1,102 @@
+/* Lock-free SPSC queue of decoded blocks between the lower and the upper MAC */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetra_mac_pipe.h"
+
+/* head and tail run freely and wrap at 2^32, the ring index is taken modulo size */
+
+int tetra_mac_pipe_init(struct tetra_mac_pipe *p, unsigned int size)
+{
+	unsigned int n = 1;
+
+	while (n < size)
+		n <<= 1;
+
+	memset(p, 0, sizeof(*p));
+	p->ring = calloc(n, sizeof(*p->ring));
+	if (!p->ring)
+		return -1;
+	p->size = n;
+	return 0;
+}
+
+void tetra_mac_pipe_deinit(struct tetra_mac_pipe *p)
+{
+	free(p->ring);
+	p->ring = NULL;
+	p->size = 0;
+}
+
+/* a pointer into the buffer of from, moved to the same place in that of blk */
+static uint8_t *rebase(struct tetra_mac_pipe_blk *blk, const struct msgb *from, const uint8_t *ptr)
+{
+	return ptr ? blk->data + (ptr - from->_data) : NULL;
+}
+
+bool tetra_mac_pipe_push(struct tetra_mac_pipe *p, uint8_t type, const struct tetra_tmvsap_prim *ttp,
+			 const struct tetra_cell_data *cell)
+{
+	unsigned int head = p->head;
+	unsigned int tail = __atomic_load_n(&p->tail, __ATOMIC_ACQUIRE);
+	const struct msgb *msg = ttp->oph.msg;
+	struct tetra_mac_pipe_blk *blk;
+
+	if (head - tail >= p->size) {
+		__atomic_fetch_add(&p->dropped, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	blk = &p->ring[head & (p->size - 1)];
+
+	blk->type = type;
+	blk->cell = *cell;
+	blk->prim = *ttp;
+	blk->msg = *msg;
+	memcpy(blk->data, msg->_data, msg->tail - msg->_data);
+	blk->msg.l1h = rebase(blk, msg, msg->l1h);
+	blk->msg.l2h = rebase(blk, msg, msg->l2h);
+	blk->msg.l3h = rebase(blk, msg, msg->l3h);
+	blk->msg.l4h = rebase(blk, msg, msg->l4h);
+	blk->msg.head = rebase(blk, msg, msg->head);
+	blk->msg.tail = rebase(blk, msg, msg->tail);
+	blk->msg.data = blk->data;
+	blk->prim.oph.msg = &blk->msg;
+	blk->prim.u.unitdata.pbits_base = rebase(blk, msg, ttp->u.unitdata.pbits_base);
+
+	__atomic_store_n(&p->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+struct tetra_mac_pipe_blk *tetra_mac_pipe_peek(struct tetra_mac_pipe *p)
+{
+	unsigned int tail = p->tail;
+
+	if (__atomic_load_n(&p->head, __ATOMIC_ACQUIRE) == tail)
+		return NULL;
+	return &p->ring[tail & (p->size - 1)];
+}
+
+void tetra_mac_pipe_release(struct tetra_mac_pipe *p)
+{
+	__atomic_store_n(&p->tail, p->tail + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int tetra_mac_pipe_depth(struct tetra_mac_pipe *p)
+{
+	unsigned int tail = __atomic_load_n(&p->tail, __ATOMIC_RELAXED);
+
+	return __atomic_load_n(&p->head, __ATOMIC_RELAXED) - tail;
+}
@@ -0,0 +1,58 @@
+#ifndef TETRA_MAC_PIPE_H
+#define TETRA_MAC_PIPE_H
+
+/* Blocks the lower MAC decoded, handed on to the upper MAC on a thread of its
+ * own through a lock-free single-producer single-consumer ring. Burst sync
+ * and channel decoding go on while the PDU parsers, reassembly and
+ * decryption work through the blocks before */
+
+#include <stdint.h>
+
+#include "tetra_common.h"
+#include "tetra_prim.h"
+
+/* Default number of blocks in flight, about 4 s of a busy carrier */
+#define TETRA_MAC_PIPE_BLOCKS	256
+
+/* One block with its primitive and message buffer, as the upper MAC gets it */
+struct tetra_mac_pipe_blk {
+	uint8_t type;				/* enum tp_sap_data_type */
+	struct tetra_cell_data cell;		/* cell and time the block came with */
+	struct tetra_tmvsap_prim prim;		/* prim.oph.msg points at msg */
+	struct msgb msg;
+	uint8_t data[TMVSAP_MSGB_SIZE];		/* the bits of msg */
+};
+
+/* Only the lower MAC writes head and only the upper MAC writes tail, each on
+ * its own cache line so the two threads do not bounce it between them */
+struct tetra_mac_pipe {
+	struct tetra_mac_pipe_blk *ring;
+	unsigned int size;		/* number of blocks, a power of two */
+	unsigned int head __attribute__((aligned(64)));	/* next block to be written */
+	unsigned int dropped;		/* blocks lost because the ring was full */
+	unsigned int tail __attribute__((aligned(64)));	/* next block to be read */
+};
+
+/* size is rounded up to a power of two */
+int tetra_mac_pipe_init(struct tetra_mac_pipe *p, unsigned int size);
+void tetra_mac_pipe_deinit(struct tetra_mac_pipe *p);
+
+/* Producer side: copy a block into the ring, false when it is full (counted
+ * in dropped). ttp is left to the caller */
+bool tetra_mac_pipe_push(struct tetra_mac_pipe *p, uint8_t type, const struct tetra_tmvsap_prim *ttp,
+			 const struct tetra_cell_data *cell);
+
+/* Consumer side: the oldest block, NULL if there is none. It stays valid,
+ * and may be changed, until released */
+struct tetra_mac_pipe_blk *tetra_mac_pipe_peek(struct tetra_mac_pipe *p);
+void tetra_mac_pipe_release(struct tetra_mac_pipe *p);
+
+/* Upper MAC side: put up to max of the waiting blocks through the upper MAC
+ * of tms, as the lower MAC does in line without the pipe. Returns how many
+ * (in lower_mac/tetra_lower_mac.c) */
+unsigned int tetra_mac_pipe_run(struct tetra_mac_state *tms, unsigned int max);
+
+/* blocks waiting for the upper MAC, from any thread */
+unsigned int tetra_mac_pipe_depth(struct tetra_mac_pipe *p);
+
+#endif /* TETRA_MAC_PIPE_H */
@@ -14,40 +14,75 @@
 #include "tetra_sndcp_pdu.h"
 #include "tetra_mle_pdu.h"
 
-//TODO: stole D-* parser from sq5bpf
+/* queue the decoded TL-SDU for the event consumer, silently lost if it falls behind */
+static void push_l3_event(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup,
+			  const struct tetra_l3_event *l3, const struct msgb *msg, unsigned int len)
+{
+	struct tetra_burst_event *ev = tetra_event_queue_reserve(tms->events);
+
+	if (!ev)
+		return;
+	if (len > TETRA_EVENT_MAX_BITS)
+		len = TETRA_EVENT_MAX_BITS;
+
+	ev->time = tup->tdma_time;
+	ev->scrambling_code = tup->scrambling_code;
+	ev->kind = TETRA_EV_L3;
+	ev->lchan = tup->lchan;
+	ev->blk_type = 0;
+	ev->blk_num = tup->blk_num;
+	ev->crc_ok = tup->crc_ok;
+	ev->snr = tup->snr;
+	ev->offset = msg->l3h - msg->l1h;
+	ev->len = len;
+	memset(ev->bits, 0, sizeof(ev->bits));
+	tetra_ubit2pwords(msg->l3h, ev->bits, 0, len);
+	ev->l3 = *l3;
+	tetra_event_queue_commit(tms->events);
+}
 
 /* Receive TL-SDU (LLC SDU == MLE PDU) */
-int rx_tl_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int len)
+int rx_tl_sdu(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup,
+	      struct tetra_l3_event *l3, struct msgb *msg, unsigned int len)
 {
 	uint8_t *bits = msg->l3h;
-	uint8_t mle_pdisc = bits_to_uint(bits, 3);
+	int parsed = -1;
+
+	if (len < 3)
+		return len;
+	l3->pdisc = bits_to_uint(bits, 3);
+	l3->sdu_len = len;
 
-	// printf("TL-SDU(%s): %s ", tetra_get_mle_pdisc_name(mle_pdisc),
+	// printf("TL-SDU(%s): %s ", tetra_get_mle_pdisc_name(l3->pdisc),
 		// osmo_ubit_dump(bits, len));
-	switch (mle_pdisc) {
+	switch (l3->pdisc) {
 	case TMLE_PDISC_MM:
-		// printf("%s\n", tetra_get_mm_pdut_name(bits_to_uint(bits+3, 4), 0));
+		parsed = tetra_mm_pdu_parse(&l3->mm, bits + 3, len - 3);
+		// printf("%s\n", tetra_get_mm_pdut_name(l3->mm.pdu_type, 0));
 		break;
 	case TMLE_PDISC_CMCE:
-		// printf("%s\n", tetra_get_cmce_pdut_name(bits_to_uint(bits+3, 5), 0));
+		parsed = tetra_cmce_pdu_parse(&l3->cmce, bits + 3, len - 3);
+		// printf("%s\n", tetra_get_cmce_pdut_name(l3->cmce.pdu_type, 0));
 		break;
 	case TMLE_PDISC_SNDCP:
-		// printf("%s ", tetra_get_sndcp_pdut_name(bits_to_uint(bits+3, 4), 0));
-		// printf(" NSAPI=%u PCOMP=%u, DCOMP=%u",
-			// bits_to_uint(bits+3+4, 4),
-			// bits_to_uint(bits+3+4+4, 4),
-			// bits_to_uint(bits+3+4+4+4, 4));
-		// printf(" V%u, IHL=%u",
-			// bits_to_uint(bits+3+4+4+4+4, 4),
-			// 4*bits_to_uint(bits+3+4+4+4+4+4, 4));
-		// printf(" Proto=%u\n",
-			// bits_to_uint(bits+3+4+4+4+4+4+4+64, 8));
+		parsed = tetra_sndcp_pdu_parse(&l3->sndcp, bits + 3, len - 3);
+		// printf("%s NSAPI=%u\n", tetra_get_sndcp_pdut_name(l3->sndcp.pdu_type, 0), l3->sndcp.nsapi);
 		break;
 	case TMLE_PDISC_MLE:
-		// printf("%s\n", tetra_get_mle_pdut_name(bits_to_uint(bits+3, 3), 0));
+		if (len >= 6) {
+			l3->mle_pdu_type = bits_to_uint(bits + 3, 3);
+			parsed = 3;
+		}
+		// printf("%s\n", tetra_get_mle_pdut_name(l3->mle_pdu_type, 0));
 		break;
 	default:
 		break;
 	}
+	l3->parsed = parsed >= 0;
+
+	if (tms->put_l3)
+		tms->put_l3(tms->put_l3_ctx, &tup->tdma_time, l3, msg->l3h, len);
+	if (tms->events)
+		push_l3_event(tms, tup, l3, msg, len);
 	return len;
 }
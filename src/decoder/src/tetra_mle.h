@@ -2,7 +2,11 @@
 #define TETRA_MLE_H
 
 #include "tetra_common.h"
+#include "tetra_prim.h"
 
-int rx_tl_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int len);
+/* l3 comes with the MAC and LLC part filled in, the rest is decoded here and
+ * the whole of it queued for the event consumer */
+int rx_tl_sdu(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup,
+	      struct tetra_l3_event *l3, struct msgb *msg, unsigned int len);
 
 #endif
@@ -45,3 +45,20 @@ const char *tetra_get_mm_pdut_name(uint8_t pdut, int uplink)
 	/* FIXME: uplink */
 	return get_value_string(mm_pdut_d_names, pdut);
 }
+
+int tetra_mm_pdu_parse(struct tetra_mm_decoded *mm, const uint8_t *bits, unsigned int len)
+{
+	unsigned int n = 4;
+
+	memset(mm, 0, sizeof(*mm));
+	if (len < n)
+		return -1;
+	mm->pdu_type = bits_to_uint(bits, 4);
+	if (mm->pdu_type == TMM_PDU_T_D_LOC_UPD_ACC) {
+		n += 3;
+		if (len < n)
+			return -1;
+		mm->loc_upd_type = bits_to_uint(bits + 4, 3);
+	}
+	return n;
+}
@@ -37,4 +37,13 @@ enum tetra_mm_loc_upd_acc_type {
 
 const char *tetra_get_mm_pdut_name(uint8_t pdut, int uplink);
 
+struct tetra_mm_decoded {
+	uint8_t pdu_type;		/* enum tetra_mm_pdu_type_d */
+	uint8_t loc_upd_type;		/* D-LOCATION UPDATE ACCEPT: enum tetra_mm_loc_upd_acc_type */
+};
+
+/* Parse len bits (one per byte) at bits, from the PDU type on. Returns the
+ * bits parsed, -1 if the PDU is cut short */
+int tetra_mm_pdu_parse(struct tetra_mm_decoded *mm, const uint8_t *bits, unsigned int len);
+
 #endif
@@ -0,0 +1,259 @@
+#ifndef TETRA_OP_INLINE_H
+#define TETRA_OP_INLINE_H
+
+/* Inline versions of the ETSI basic operators (codec/c-code/tetra_op.c)
+ *
+ * This header is force-included ahead of every codec source but tetra_op.c
+ * (see CMakeLists.txt), so the static definitions below come first and the
+ * plain prototypes of source.h / channel.h that follow keep them internal:
+ * the speech decoder calls these instead of the out-of-line ones.
+ *
+ * They are bit exact with the reference operators, Overflow included: it is
+ * set by every saturation and sature() clears it like the reference does.
+ * Branches are replaced by compare and select where the result allows it,
+ * which keeps the filter loops that only do add/mult/L_mac free of calls.
+ * Operators not listed here (div_s, L_mac0, ...) stay out of line */
+
+#include <stdint.h>
+
+/* defined by tetra_op.c, weak here so the header does not depend on it */
+int Overflow __attribute__((weak));
+
+#define TETRA_OP_MAX_16	((int16_t)0x7fff)
+#define TETRA_OP_MIN_16	((int16_t)0x8000)
+#define TETRA_OP_MAX_32	((int32_t)0x7fffffffL)
+#define TETRA_OP_MIN_32	((int32_t)0x80000000L)
+
+static inline int16_t sature(int32_t L_var1)
+{
+	if (L_var1 > 0x00007fffL) {
+		Overflow = 1;
+		return TETRA_OP_MAX_16;
+	}
+	if (L_var1 < -0x00008000L) {
+		Overflow = 1;
+		return TETRA_OP_MIN_16;
+	}
+	Overflow = 0;
+	return (int16_t)L_var1;
+}
+
+static inline int16_t add(int16_t var1, int16_t var2)
+{
+	return sature((int32_t)var1 + var2);
+}
+
+static inline int16_t sub(int16_t var1, int16_t var2)
+{
+	return sature((int32_t)var1 - var2);
+}
+
+static inline int16_t abs_s(int16_t var1)
+{
+	if (var1 == TETRA_OP_MIN_16)
+		return TETRA_OP_MAX_16;
+	return var1 < 0 ? -var1 : var1;
+}
+
+static inline int16_t negate(int16_t var1)
+{
+	return var1 == TETRA_OP_MIN_16 ? TETRA_OP_MAX_16 : -var1;
+}
+
+static inline int16_t extract_h(int32_t L_var1)
+{
+	return (int16_t)(L_var1 >> 16);
+}
+
+static inline int16_t extract_l(int32_t L_var1)
+{
+	return (int16_t)L_var1;
+}
+
+static inline int32_t L_deposit_h(int16_t var1)
+{
+	return (int32_t)((uint32_t)(int32_t)var1 << 16);
+}
+
+static inline int32_t L_deposit_l(int16_t var1)
+{
+	return var1;
+}
+
+static inline int16_t shr(int16_t var1, int16_t var2);
+
+static inline int16_t shl(int16_t var1, int16_t var2)
+{
+	int32_t result;
+
+	if (var2 < 0)
+		return shr(var1, -var2);
+	if (var1 == 0)
+		return 0;
+	if (var2 > 15) {
+		Overflow = 1;
+		return var1 > 0 ? TETRA_OP_MAX_16 : TETRA_OP_MIN_16;
+	}
+	result = (int32_t)var1 * ((int32_t)1 << var2);
+	if (result != (int16_t)result) {
+		Overflow = 1;
+		return var1 > 0 ? TETRA_OP_MAX_16 : TETRA_OP_MIN_16;
+	}
+	return (int16_t)result;
+}
+
+static inline int16_t shr(int16_t var1, int16_t var2)
+{
+	if (var2 < 0)
+		return shl(var1, -var2);
+	if (var2 >= 15)
+		return var1 < 0 ? -1 : 0;
+	/* the reference complements negative values around the shift, an
+	 * arithmetic shift gives the same result */
+	return var1 >> var2;
+}
+
+static inline int16_t mult(int16_t var1, int16_t var2)
+{
+	return sature(((int32_t)var1 * var2) >> 15);
+}
+
+static inline int16_t mult_r(int16_t var1, int16_t var2)
+{
+	return sature(((int32_t)var1 * var2 + 0x4000) >> 15);
+}
+
+static inline int32_t L_mult(int16_t var1, int16_t var2)
+{
+	int32_t product = (int32_t)var1 * var2;
+
+	if (product == 0x40000000L) {
+		Overflow = 1;
+		return TETRA_OP_MAX_32;
+	}
+	return product * 2;
+}
+
+static inline int32_t L_add(int32_t L_var1, int32_t L_var2)
+{
+	int32_t sum;
+
+	if (__builtin_add_overflow(L_var1, L_var2, &sum)) {
+		Overflow = 1;
+		return L_var1 < 0 ? TETRA_OP_MIN_32 : TETRA_OP_MAX_32;
+	}
+	return sum;
+}
+
+static inline int32_t L_sub(int32_t L_var1, int32_t L_var2)
+{
+	int32_t diff;
+
+	if (__builtin_sub_overflow(L_var1, L_var2, &diff)) {
+		Overflow = 1;
+		return L_var1 < 0 ? TETRA_OP_MIN_32 : TETRA_OP_MAX_32;
+	}
+	return diff;
+}
+
+static inline int32_t L_mac(int32_t L_var3, int16_t var1, int16_t var2)
+{
+	return L_add(L_var3, L_mult(var1, var2));
+}
+
+static inline int32_t L_msu(int32_t L_var3, int16_t var1, int16_t var2)
+{
+	return L_sub(L_var3, L_mult(var1, var2));
+}
+
+static inline int32_t L_negate(int32_t L_var1)
+{
+	return L_var1 == TETRA_OP_MIN_32 ? TETRA_OP_MAX_32 : -L_var1;
+}
+
+static inline int32_t L_abs(int32_t L_var1)
+{
+	if (L_var1 == TETRA_OP_MIN_32)
+		return TETRA_OP_MAX_32;
+	return L_var1 < 0 ? -L_var1 : L_var1;
+}
+
+static inline int32_t L_shr(int32_t L_var1, int16_t var2);
+
+/* The reference doubles var2 times and saturates as soon as a step leaves
+ * the 32 bit range, which is the same as comparing against the shifted limits */
+static inline int32_t L_shl(int32_t L_var1, int16_t var2)
+{
+	if (var2 <= 0)
+		return L_shr(L_var1, -var2);
+	if (L_var1 == 0)
+		return 0;
+	if (var2 > 31 || L_var1 > (TETRA_OP_MAX_32 >> var2) || L_var1 < (TETRA_OP_MIN_32 >> var2)) {
+		Overflow = 1;
+		return L_var1 > 0 ? TETRA_OP_MAX_32 : TETRA_OP_MIN_32;
+	}
+	return (int32_t)((uint32_t)L_var1 << var2);
+}
+
+static inline int32_t L_shr(int32_t L_var1, int16_t var2)
+{
+	if (var2 < 0)
+		return L_shl(L_var1, -var2);
+	if (var2 >= 31)
+		return L_var1 < 0 ? -1 : 0;
+	return L_var1 >> var2;
+}
+
+static inline int32_t L_shr_r(int32_t L_var1, int16_t var2)
+{
+	int32_t L_var_out;
+
+	if (var2 > 31)
+		return 0;
+	L_var_out = L_shr(L_var1, var2);
+	if (var2 > 0 && (L_var1 & ((int32_t)1 << (var2 - 1))))
+		L_var_out++;
+	return L_var_out;
+}
+
+static inline int16_t etsi_round(int32_t L_var1)
+{
+	return extract_h(L_add(L_var1, 0x00008000L));
+}
+
+static inline int16_t mac_r(int32_t L_var3, int16_t var1, int16_t var2)
+{
+	return etsi_round(L_mac(L_var3, var1, var2));
+}
+
+static inline int16_t msu_r(int32_t L_var3, int16_t var1, int16_t var2)
+{
+	return etsi_round(L_msu(L_var3, var1, var2));
+}
+
+/* leading sign bits, counted with clz instead of the shift loop */
+static inline int16_t norm_s(int16_t var1)
+{
+	uint32_t v;
+
+	if (var1 == 0)
+		return 0;
+	if (var1 == -1)
+		return 15;
+	v = var1 < 0 ? (uint32_t)(uint16_t)~var1 : (uint32_t)var1;
+	return __builtin_clz(v) - 17;
+}
+
+static inline int16_t norm_l(int32_t L_var1)
+{
+	uint32_t v;
+
+	if (L_var1 == 0)
+		return 0;
+	if (L_var1 == -1)
+		return 31;
+	v = L_var1 < 0 ? ~(uint32_t)L_var1 : (uint32_t)L_var1;
+	return __builtin_clz(v) - 1;
+}
+
+#endif /* TETRA_OP_INLINE_H */
@@ -0,0 +1,161 @@
+/* Packed bit vector helpers */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "tetra_pbits.h"
+
+/* n (1..64) bits starting at bit i, right aligned, never reads past them */
+static uint64_t pwords_read(const uint64_t *w, unsigned int i, unsigned int n)
+{
+	unsigned int s = i & 63;
+	const uint64_t *p = &w[i >> 6];
+	uint64_t v = p[0] << s;
+
+	if (s + n > 64)
+		v |= p[1] >> (64 - s);
+
+	return v >> (64 - n);
+}
+
+/* 8 unpacked bits to one byte, first bit in the MSB, without a loop: every
+ * bit lands on its own position of the top byte of the product */
+static inline uint64_t ubit_pack8(const uint8_t *in)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t v;
+
+	memcpy(&v, in, sizeof(v));
+	return ((v & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+#else
+	uint64_t v = 0;
+	unsigned int j;
+
+	for (j = 0; j < 8; j++)
+		v = (v << 1) | (in[j] & 1);
+	return v;
+#endif
+}
+
+void tetra_ubit2pwords(const uint8_t *in, uint64_t *out, unsigned int out_offs, unsigned int nbits)
+{
+	unsigned int i = 0;
+
+	/* leading partial word */
+	while (i < nbits && ((out_offs + i) & 63)) {
+		tetra_pwords_set(out, out_offs + i, in[i] & 1);
+		i++;
+	}
+
+	/* whole words */
+	while (nbits - i >= 64) {
+		uint64_t v = 0;
+		unsigned int j;
+
+		for (j = 0; j < 64; j += 8)
+			v = (v << 8) | ubit_pack8(&in[i + j]);
+		out[(out_offs + i) >> 6] = v;
+		i += 64;
+	}
+
+	/* trailing partial word */
+	for (; i < nbits; i++)
+		tetra_pwords_set(out, out_offs + i, in[i] & 1);
+}
+
+void tetra_sbit2pwords(const int8_t *in, uint64_t *out, unsigned int out_offs, unsigned int nbits)
+{
+	unsigned int i = 0;
+
+	while (i < nbits && ((out_offs + i) & 63)) {
+		tetra_pwords_set(out, out_offs + i, (uint8_t)in[i] >> 7);
+		i++;
+	}
+
+	while (nbits - i >= 64) {
+		uint64_t v = 0;
+		unsigned int j;
+
+		for (j = 0; j < 64; j++)
+			v = (v << 1) | ((uint8_t)in[i + j] >> 7);
+		out[(out_offs + i) >> 6] = v;
+		i += 64;
+	}
+
+	for (; i < nbits; i++)
+		tetra_pwords_set(out, out_offs + i, (uint8_t)in[i] >> 7);
+}
+
+void tetra_pwords2ubit(const uint64_t *in, unsigned int in_offs, uint8_t *out, unsigned int nbits)
+{
+	unsigned int i = 0;
+
+	while (i < nbits) {
+		unsigned int n = nbits - i < 64 ? nbits - i : 64;
+		uint64_t v = pwords_read(in, in_offs + i, n);
+		unsigned int j;
+
+		for (j = 0; j < n; j++)
+			out[i + j] = (v >> (n - 1 - j)) & 1;
+		i += n;
+	}
+}
+
+void tetra_pwords_copy(uint64_t *dst, unsigned int dst_offs,
+		       const uint64_t *src, unsigned int src_offs, unsigned int nbits)
+{
+	while (nbits) {
+		/* fill dst up to the end of its current word */
+		unsigned int ds = dst_offs & 63;
+		unsigned int n = 64 - ds;
+		uint64_t v, mask;
+
+		if (n > nbits)
+			n = nbits;
+
+		v = pwords_read(src, src_offs, n) << (64 - ds - n);
+		mask = (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << (64 - ds - n);
+		dst[dst_offs >> 6] = (dst[dst_offs >> 6] & ~mask) | v;
+
+		dst_offs += n;
+		src_offs += n;
+		nbits -= n;
+	}
+}
+
+int tetra_bitreader_fill(struct tetra_bitreader *br)
+{
+	unsigned int need = (br->pos >> 6) + 2;
+
+	/* packed words are all there from the start */
+	if (!br->in || need > TETRA_PWORDS(TETRA_BITREADER_MAX_BITS) + 1)
+		return -1;
+	for (; br->avail < need; br->avail++) {
+		unsigned int start = br->avail * 64;
+		uint64_t v = 0;
+		unsigned int j;
+
+		if (start + 64 <= br->len) {
+			for (j = 0; j < 64; j += 8)
+				v = (v << 8) | ubit_pack8(&br->in[start + j]);
+		} else if (start < br->len) {
+			/* last word of the input, zero filled */
+			for (j = 0; start + j < br->len; j++)
+				v |= (uint64_t)(br->in[start + j] & 1) << (63 - j);
+		}
+		br->buf[br->avail] = v;
+	}
+	return 0;
+}
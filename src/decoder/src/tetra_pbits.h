@@ -0,0 +1,120 @@
+#ifndef TETRA_PBITS_H
+#define TETRA_PBITS_H
+
+/* Packed bit vectors: 64 bits per word, the first bit of the vector is the
+ * MSB of word 0. Used by the burst synchronizer and the packed variants of
+ * descrambling, deinterleaving and CRC in place of one bit per uint8_t */
+
+#include <stdint.h>
+
+/* number of words needed to hold nbits */
+#define TETRA_PWORDS(nbits)	(((nbits) + 63) / 64)
+
+static inline unsigned int tetra_pwords_get(const uint64_t *w, unsigned int i)
+{
+	return (w[i >> 6] >> (63 - (i & 63))) & 1;
+}
+
+static inline void tetra_pwords_set(uint64_t *w, unsigned int i, unsigned int bit)
+{
+	uint64_t mask = 1ULL << (63 - (i & 63));
+
+	if (bit)
+		w[i >> 6] |= mask;
+	else
+		w[i >> 6] &= ~mask;
+}
+
+/* the 64 bits starting at bit i, MSB aligned. Always reads the word following
+ * the one holding bit i when i is not word aligned, callers keep a spare word */
+static inline uint64_t tetra_pwords_peek(const uint64_t *w, unsigned int i)
+{
+	unsigned int s = i & 63;
+	const uint64_t *p = &w[i >> 6];
+
+	return s ? (p[0] << s) | (p[1] >> (64 - s)) : p[0];
+}
+
+/* write nbits unpacked bits (one per byte, LSB used) starting at bit out_offs */
+void tetra_ubit2pwords(const uint8_t *in, uint64_t *out, unsigned int out_offs, unsigned int nbits);
+
+/* same for soft bits, a negative value is a '1' */
+void tetra_sbit2pwords(const int8_t *in, uint64_t *out, unsigned int out_offs, unsigned int nbits);
+
+/* read nbits starting at bit in_offs into one bit per byte */
+void tetra_pwords2ubit(const uint64_t *in, unsigned int in_offs, uint8_t *out, unsigned int nbits);
+
+/* copy nbits from src/src_offs to dst/dst_offs. dst and src may be the same
+ * buffer as long as dst_offs <= src_offs, which is how the bit buffers shift */
+void tetra_pwords_copy(uint64_t *dst, unsigned int dst_offs,
+		       const uint64_t *src, unsigned int src_offs, unsigned int nbits);
+
+/* Reader for the header parsers, over packed words or over unpacked bits
+ * that are packed a word at a time as the fields reach them. Every field is
+ * taken from a 64 bit window without branching on its width. Bits past the
+ * end read as 0 */
+#define TETRA_BITREADER_MAX_BITS	512
+
+struct tetra_bitreader {
+	const uint64_t *w;
+	unsigned int pos;		/* next bit in w */
+	unsigned int start;		/* pos of the first bit */
+	unsigned int avail;		/* words of w there are */
+	const uint8_t *in;		/* unpacked input, NULL when reading packed words */
+	unsigned int len;
+	uint64_t buf[TETRA_PWORDS(TETRA_BITREADER_MAX_BITS) + 1];
+};
+
+/* nbits packed bits at w, reading from bit offs on. Like for
+ * tetra_pwords_peek, w needs a spare word after them, and reads past nbits
+ * return whatever the words hold there, so they should be zero */
+static inline void tetra_bitreader_init_packed(struct tetra_bitreader *br, const uint64_t *w, unsigned int offs, unsigned int nbits)
+{
+	br->w = &w[offs >> 6];
+	br->pos = br->start = offs & 63;
+	br->avail = TETRA_PWORDS(nbits) + 1 - (offs >> 6);
+	br->in = 0;
+	br->len = 0;
+}
+
+/* the first len (up to TETRA_BITREADER_MAX_BITS) unpacked bits of in */
+static inline void tetra_bitreader_init(struct tetra_bitreader *br, const uint8_t *in, unsigned int len)
+{
+	br->w = br->buf;
+	br->pos = br->start = 0;
+	br->avail = 0;
+	br->in = in;
+	br->len = len < TETRA_BITREADER_MAX_BITS ? len : TETRA_BITREADER_MAX_BITS;
+}
+
+/* make the word of bit pos and the one after it available, -1 if there is
+ * no such data */
+int tetra_bitreader_fill(struct tetra_bitreader *br);
+
+/* the next n (0..32) bits, MSB first */
+static inline uint32_t tetra_bitreader_get(struct tetra_bitreader *br, unsigned int n)
+{
+	uint64_t v;
+
+	if ((br->pos >> 6) + 2 > br->avail && tetra_bitreader_fill(br) < 0) {
+		br->pos += n;
+		return 0;
+	}
+	v = tetra_pwords_peek(br->w, br->pos);
+	br->pos += n;
+	/* two shifts, n == 0 would be a shift by 64 */
+	return (uint32_t)((v >> 1) >> (63 - n));
+}
+
+static inline void tetra_bitreader_skip(struct tetra_bitreader *br, unsigned int n)
+{
+	br->pos += n;
+}
+
+/* bits taken so far */
+static inline unsigned int tetra_bitreader_tell(const struct tetra_bitreader *br)
+{
+	return br->pos - br->start;
+}
+
+#endif /* TETRA_PBITS_H */
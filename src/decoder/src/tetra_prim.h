@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+#include "tetra_pbits.h"
+
 // #include <osmocom/core/prim.h>
 
 
@@ -37,6 +39,8 @@ enum tmv_sap_prim {
 };
 
 /* Table 23.2 */
+#define TMVSAP_MSGB_SIZE	412	/* maximum num of bits in a non-QAM chan */
+
 struct tmv_unitdata_param {
 	uint32_t mac_block_len;		/* length of mac block */
 	enum tetra_log_chan lchan;	/* to which lchan do we belong? */
@@ -44,7 +48,14 @@ struct tmv_unitdata_param {
 	uint32_t scrambling_code;	/* which scrambling code was used */
 	struct tetra_tdma_time tdma_time;/* TDMA timestamp  */
 	int blk_num;				/* Indicates whether BLK1 or BLK2 in the downlink burst */
+	uint8_t snr;			/* of the burst, see tetra_train_snr(), 0 if unknown */
 	//uint8_t mac_block[412];		/* maximum num of bits in a non-QAM chan */
+	/* the type-1 bits of the block packed once for the PDU parsers, see
+	 * mac_bitreader() in tetra_upper_mac.c. They stay as received, the
+	 * parts decryption changes are read from the msgb */
+	const uint8_t *pbits_base;	/* block bit the first packed bit is */
+	unsigned int pbits_len;
+	uint64_t pbits[TETRA_PWORDS(TMVSAP_MSGB_SIZE) + 1];
 };
 
 /* Table 23.3 */
@@ -0,0 +1,163 @@
+/* Per-thread hot path counters, see tetra_prof.h */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tetra_prof.h"
+
+static const char *counter_names[TETRA_PROF_NR] = {
+	[TETRA_PROF_DEMOD_CALLS]	= "demod_calls",
+	[TETRA_PROF_DEMOD_SAMPLES]	= "demod_samples",
+	[TETRA_PROF_DEMOD_NS]		= "demod_ns",
+	[TETRA_PROF_DECODER_CALLS]	= "decoder_calls",
+	[TETRA_PROF_DECODER_BITS]	= "decoder_bits",
+	[TETRA_PROF_DECODER_NS]		= "decoder_ns",
+	[TETRA_PROF_BURSTS]		= "bursts",
+	[TETRA_PROF_LOWER_MAC_BLOCKS]	= "lower_mac_blocks",
+	[TETRA_PROF_LOWER_MAC_NS]	= "lower_mac_ns",
+	[TETRA_PROF_UPPER_MAC_BLOCKS]	= "upper_mac_blocks",
+	[TETRA_PROF_UPPER_MAC_NS]	= "upper_mac_ns",
+	[TETRA_PROF_CRC_OK]		= "crc_ok",
+	[TETRA_PROF_CRC_FAIL]		= "crc_fail",
+	[TETRA_PROF_VITERBI_CALLS]	= "viterbi_calls",
+	[TETRA_PROF_VITERBI_NS]		= "viterbi_ns",
+	[TETRA_PROF_CODEC_FRAMES]	= "codec_frames",
+	[TETRA_PROF_CODEC_NS]		= "codec_ns",
+	[TETRA_PROF_SWAPS]		= "swaps",
+	[TETRA_PROF_SWAP_WAIT_NS]	= "swap_wait_ns",
+};
+
+const char *tetra_prof_name(enum tetra_prof_counter c)
+{
+	return c < TETRA_PROF_NR ? counter_names[c] : "";
+}
+
+int tetra_prof_is_time(enum tetra_prof_counter c)
+{
+	switch (c) {
+	case TETRA_PROF_DEMOD_NS:
+	case TETRA_PROF_DECODER_NS:
+	case TETRA_PROF_LOWER_MAC_NS:
+	case TETRA_PROF_UPPER_MAC_NS:
+	case TETRA_PROF_VITERBI_NS:
+	case TETRA_PROF_CODEC_NS:
+	case TETRA_PROF_SWAP_WAIT_NS:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+#ifdef TETRA_PROFILE
+
+__thread struct tetra_prof_block *tetra_prof_tls;
+static struct tetra_prof_block *blocks;
+
+/* TSC ticks and ns at the first registration, to scale the ticks by */
+static uint64_t calib_ticks;
+static uint64_t calib_ns;
+
+static uint64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t tetra_prof_ticks(void)
+{
+	return mono_ns();
+}
+#endif
+
+struct tetra_prof_block *tetra_prof_register(void)
+{
+	struct tetra_prof_block *b = calloc(1, sizeof(*b));
+	struct tetra_prof_block *head;
+	uint64_t zero = 0;
+
+	/* without memory nothing is counted on this thread */
+	if (!b) {
+		static struct tetra_prof_block sink;
+		return &sink;
+	}
+	if (__atomic_compare_exchange_n(&calib_ns, &zero, mono_ns(), 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		__atomic_store_n(&calib_ticks, tetra_prof_ticks(), __ATOMIC_RELEASE);
+
+	/* pushed onto the list once, never taken off */
+	head = __atomic_load_n(&blocks, __ATOMIC_RELAXED);
+	do {
+		b->next = head;
+	} while (!__atomic_compare_exchange_n(&blocks, &head, b, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	tetra_prof_tls = b;
+	return b;
+}
+
+int tetra_prof_enabled(void)
+{
+	return 1;
+}
+
+void tetra_prof_snapshot(uint64_t *out)
+{
+	struct tetra_prof_block *b;
+	uint64_t ticks0 = __atomic_load_n(&calib_ticks, __ATOMIC_ACQUIRE);
+	uint64_t dt = tetra_prof_ticks() - ticks0;
+	uint64_t dns = mono_ns() - __atomic_load_n(&calib_ns, __ATOMIC_RELAXED);
+	double ns_per_tick = (ticks0 && dt) ? (double)dns / dt : 1.0;
+	int i;
+
+	memset(out, 0, TETRA_PROF_NR * sizeof(*out));
+	for (b = __atomic_load_n(&blocks, __ATOMIC_ACQUIRE); b; b = b->next) {
+		for (i = 0; i < TETRA_PROF_NR; i++)
+			out[i] += __atomic_load_n(&b->v[i], __ATOMIC_RELAXED);
+	}
+	for (i = 0; i < TETRA_PROF_NR; i++) {
+		if (tetra_prof_is_time(i))
+			out[i] = out[i] * ns_per_tick;
+	}
+}
+
+#else
+
+int tetra_prof_enabled(void)
+{
+	return 0;
+}
+
+void tetra_prof_snapshot(uint64_t *out)
+{
+	memset(out, 0, TETRA_PROF_NR * sizeof(*out));
+}
+
+#endif /* TETRA_PROFILE */
+
+int tetra_prof_json(char *buf, int len)
+{
+	uint64_t v[TETRA_PROF_NR];
+	int n, i;
+
+	tetra_prof_snapshot(v);
+	n = snprintf(buf, len, "{\"enabled\":%s", tetra_prof_enabled() ? "true" : "false");
+	for (i = 0; i < TETRA_PROF_NR; i++)
+		n += snprintf(n < len ? buf + n : NULL, n < len ? len - n : 0, ",\"%s\":%llu",
+			      counter_names[i], (unsigned long long)v[i]);
+	n += snprintf(n < len ? buf + n : NULL, n < len ? len - n : 0, "}");
+	return n;
+}
@@ -0,0 +1,98 @@
+#ifndef TETRA_PROF_H
+#define TETRA_PROF_H
+
+/* Hot path instrumentation: call, item and time counters of the stages from
+ * the demodulator down to the codec. Built in with -DTETRA_PROFILE (cmake
+ * -DOPT_TETRA_PROFILE=ON), otherwise the macros are empty and every counter
+ * reads 0.
+ *
+ * Every thread counts into a block of its own, which it alone writes, so an
+ * update is a plain add without a lock or a locked instruction. The blocks
+ * stay on a list for good and a snapshot sums them up, the counts of threads
+ * that ended included. Times are counted in TSC ticks on x86 and in ns
+ * elsewhere, a snapshot hands them out in ns */
+
+#include <stdint.h>
+
+enum tetra_prof_counter {
+	TETRA_PROF_DEMOD_CALLS,		/* PI4DQPSK::process() */
+	TETRA_PROF_DEMOD_SAMPLES,
+	TETRA_PROF_DEMOD_NS,
+	TETRA_PROF_DECODER_CALLS,	/* osmotetradec::process() */
+	TETRA_PROF_DECODER_BITS,
+	TETRA_PROF_DECODER_NS,
+	TETRA_PROF_BURSTS,		/* tetra_burst_rx_cb() */
+	TETRA_PROF_LOWER_MAC_BLOCKS,	/* tp_sap_udata_ind(), the upper MAC included unless pipelined */
+	TETRA_PROF_LOWER_MAC_NS,
+	TETRA_PROF_UPPER_MAC_BLOCKS,	/* tetra_mac_pipe_run(), the upper MAC of a pipelined decoder */
+	TETRA_PROF_UPPER_MAC_NS,
+	TETRA_PROF_CRC_OK,
+	TETRA_PROF_CRC_FAIL,
+	TETRA_PROF_VITERBI_CALLS,	/* viterbi_dec_soft() */
+	TETRA_PROF_VITERBI_NS,
+	TETRA_PROF_CODEC_FRAMES,	/* tetra_codec_decode_slot() */
+	TETRA_PROF_CODEC_NS,
+	TETRA_PROF_SWAPS,		/* stream swaps of the demodulator and the decoder */
+	TETRA_PROF_SWAP_WAIT_NS,	/* ... spent waiting for the reader */
+	TETRA_PROF_NR,
+};
+
+/* name of a counter, e.g. "demod_calls", for menus and exporters */
+const char *tetra_prof_name(enum tetra_prof_counter c);
+
+/* the counter is a time in ns */
+int tetra_prof_is_time(enum tetra_prof_counter c);
+
+/* built with TETRA_PROFILE */
+int tetra_prof_enabled(void);
+
+/* totals of all threads so far, TETRA_PROF_NR of them */
+void tetra_prof_snapshot(uint64_t *out);
+
+/* the counters as one JSON object of name: total. Returns the length, or
+ * what it would have been if len is too short (like snprintf) */
+int tetra_prof_json(char *buf, int len);
+
+#ifdef TETRA_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t tetra_prof_ticks(void)
+{
+	return __rdtsc();
+}
+#else
+uint64_t tetra_prof_ticks(void);
+#endif
+
+struct tetra_prof_block {
+	uint64_t v[TETRA_PROF_NR];
+	struct tetra_prof_block *next;
+};
+
+extern __thread struct tetra_prof_block *tetra_prof_tls;
+struct tetra_prof_block *tetra_prof_register(void);
+
+static inline void tetra_prof_add(enum tetra_prof_counter c, uint64_t n)
+{
+	struct tetra_prof_block *b = tetra_prof_tls;
+
+	if (!b)
+		b = tetra_prof_register();
+	/* only this thread writes it, the store is atomic for the readers */
+	__atomic_store_n(&b->v[c], b->v[c] + n, __ATOMIC_RELAXED);
+}
+
+#define TETRA_PROF_ADD(c, n)		tetra_prof_add(c, n)
+#define TETRA_PROF_START(t)		uint64_t t = tetra_prof_ticks()
+#define TETRA_PROF_STOP(c, t)		tetra_prof_add(c, tetra_prof_ticks() - (t))
+
+#else
+
+#define TETRA_PROF_ADD(c, n)		do {} while (0)
+#define TETRA_PROF_START(t)		do {} while (0)
+#define TETRA_PROF_STOP(c, t)		do {} while (0)
+
+#endif /* TETRA_PROFILE */
+
+#endif /* TETRA_PROF_H */
@@ -47,3 +47,24 @@ const char *tetra_get_sndcp_pdut_name(uint8_t pdut, int uplink)
 	/* FIXME: uplink */
 	return get_value_string(sndcp_pdut_names, pdut);
 }
+
+int tetra_sndcp_pdu_parse(struct tetra_sndcp_decoded *sn, const uint8_t *bits, unsigned int len)
+{
+	memset(sn, 0, sizeof(*sn));
+	if (len < 8)
+		return -1;
+	sn->pdu_type = bits_to_uint(bits, 4);
+	sn->nsapi = bits_to_uint(bits + 4, 4);
+	if (sn->pdu_type != SNDCP_PDU_T_DATA && sn->pdu_type != SNDCP_PDU_T_UNITDATA)
+		return 8;
+
+	/* SN-DATA and SN-UNITDATA carry the compression fields, the rest of
+	 * the TL-SDU is the N-PDU */
+	if (len < 16)
+		return -1;
+	sn->pcomp = bits_to_uint(bits + 8, 4);
+	sn->dcomp = bits_to_uint(bits + 12, 4);
+	sn->npdu_offset = 16;
+	sn->npdu_len = len - 16;
+	return 16;
+}
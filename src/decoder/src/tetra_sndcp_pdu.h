@@ -24,6 +24,19 @@ enum sndcp_pdu_type {
 #define SNDCP_PDU_T_ACT_PDP_DEMAND	SNDCP_PDU_T_ACT_PDP_ACCEPT
 #define	SNDCP_PDU_T_PAGE_RESPONSE	SNDCP_PDU_T_PAGE_REQUEST
 
-#endif /* TETRA_SNDCP_PDU_H */
-
 const char *tetra_get_sndcp_pdut_name(uint8_t pdut, int uplink);
+
+struct tetra_sndcp_decoded {
+	uint8_t pdu_type;		/* enum sndcp_pdu_type */
+	uint8_t nsapi;			/* network service access point identifier of the PDP context */
+	uint8_t pcomp;			/* SN-DATA, SN-UNITDATA: protocol (IP header) compression, 0 = none */
+	uint8_t dcomp;			/* SN-DATA, SN-UNITDATA: data compression, 0 = none */
+	uint16_t npdu_offset;		/* SN-DATA, SN-UNITDATA: first bit of the N-PDU, from the PDU type on */
+	uint16_t npdu_len;		/* SN-DATA, SN-UNITDATA: bits of N-PDU, 0 for the other PDUs */
+};
+
+/* Parse len bits (one per byte) at bits, from the PDU type on. Returns the
+ * bits parsed, -1 if the PDU is cut short */
+int tetra_sndcp_pdu_parse(struct tetra_sndcp_decoded *sn, const uint8_t *bits, unsigned int len);
+
+#endif /* TETRA_SNDCP_PDU_H */
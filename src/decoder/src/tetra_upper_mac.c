@@ -32,44 +32,19 @@
 #include "tetra_prim.h"
 #include "tetra_upper_mac.h"
 #include "tetra_mac_pdu.h"
-// #include "tetra_llc_pdu.h"
-// #include "tetra_llc.h"
+#include "tetra_llc.h"
 
 /* FIXME move global fragslots to context variable */
 // struct fragslot fragslots[FRAGSLOT_NR_SLOTS] = {0};
 
-void init_fragslot(struct fragslot *fragslot)
+/* Reader over len bits at bits. Straight from the packed copy of the block
+ * the lower MAC made while they are within it, packing them here otherwise */
+static void mac_bitreader(struct tetra_bitreader *br, const struct tmv_unitdata_param *tup, const uint8_t *bits, unsigned int len)
 {
-	if (fragslot->msgb) {
-		/* Should never be the case, but just to be sure */
-		// talloc_free(fragslot->msgb);
-		free(fragslot->msgb);
-		memset(fragslot, 0, sizeof(struct fragslot));
-	}
-	fragslot->msgb = msgb_alloc(FRAGSLOT_MSGB_SIZE, "fragslot");
-}
-
-void cleanup_fragslot(struct fragslot *fragslot)
-{
-	if (fragslot->msgb) {
-		// talloc_free(fragslot->msgb);
-		free(fragslot->msgb);
-	}
-	memset(fragslot, 0, sizeof(struct fragslot));
-}
-
-void age_fragslots(struct tetra_mac_state *tms)
-{
-	int i;
-	for (i = 0; i < FRAGSLOT_NR_SLOTS; i++) {
-		if (tms->fragslots[i].active) {
-			tms->fragslots[i].age++;
-			if (tms->fragslots[i].age > N203) {
-				// printf("\nFRAG: aged out old fragments for slot=%d fragments=%d length=%d timer=%d\n", i, tms->fragslots[i].num_frags, tms->fragslots[i].length, tms->fragslots[i].age);
-				cleanup_fragslot(&tms->fragslots[i]);
-			}
-		}
-	}
+	if (tup->pbits_base && bits >= tup->pbits_base && bits + len <= tup->pbits_base + tup->pbits_len && len)
+		tetra_bitreader_init_packed(br, tup->pbits, bits - tup->pbits_base, tup->pbits_len);
+	else
+		tetra_bitreader_init(br, bits, len);
 }
 
 static int get_num_fill_bits(const unsigned char *l1h, int len_with_fillbits)
@@ -83,16 +58,54 @@ static int get_num_fill_bits(const unsigned char *l1h, int len_with_fillbits)
 	return 0;
 }
 
+/* Whether the SYSINFO in len bits at bits is the one last_sid was decoded
+ * from. If not, it becomes that one */
+static bool sysinfo_repeated(struct tetra_mac_state *tms, const struct tmv_unitdata_param *tup, const uint8_t *bits, unsigned int len)
+{
+	uint64_t w[TETRA_PWORDS(TETRA_SYSINFO_CMP_BITS)];
+	unsigned int n = TETRA_PWORDS(len);
+
+	if (len > TETRA_SYSINFO_CMP_BITS || !len) {
+		tms->last_sid_len = 0;
+		return false;
+	}
+	if (bits == tup->pbits_base && len <= tup->pbits_len) {
+		memcpy(w, tup->pbits, n * sizeof(w[0]));
+	} else {
+		memset(w, 0, sizeof(w));
+		tetra_ubit2pwords(bits, w, 0, len);
+	}
+	if (len & 63)
+		w[n - 1] &= ~0ULL << (64 - (len & 63));
+
+	if (len == tms->last_sid_len && !memcmp(w, tms->last_sid_bits, n * sizeof(w[0])))
+		return true;
+	memcpy(tms->last_sid_bits, w, n * sizeof(w[0]));
+	tms->last_sid_len = len;
+	return false;
+}
+
 static int rx_bcast(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 {
 	struct msgb *msg = tmvp->oph.msg;
 	struct tetra_crypto_state *tcs = tms->tcs;
+	struct tetra_display_state *ds = tms->t_display_st;
 	struct tetra_si_decoded sid;
+	struct tetra_bitreader br;
 	uint32_t dl_freq, ul_freq;
-	int i;
+	uint16_t sd;
+
+	/* The cell repeats the same SYSINFO every multiframe, everything below
+	 * is still up to date from the last time */
+	if (sysinfo_repeated(tms, &tmvp->u.unitdata, msg->l1h, msgb_l1len(msg))) {
+		tmvp->u.unitdata.tdma_time.hn = tms->last_sid.hyperframe_number;
+		TETRA_STAT_PUBLISH(tms->stats.sysinfo);
+		return -1;
+	}
 
 	memset(&sid, 0, sizeof(sid));
-	macpdu_decode_sysinfo(&sid, msg->l1h);
+	mac_bitreader(&br, &tmvp->u.unitdata, msg->l1h, msgb_l1len(msg));
+	macpdu_decode_sysinfo(&sid, &br);
 	tmvp->u.unitdata.tdma_time.hn = sid.hyperframe_number;
 
 	dl_freq = tetra_dl_carrier_hz(sid.freq_band,
@@ -107,54 +120,32 @@ static int rx_bcast(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 
 	// printf("BNCH SYSINFO (DL %u Hz, UL %u Hz), service_details 0x%04x ",
 		// dl_freq, ul_freq, sid.mle_si.bs_service_details);
-	tms->t_display_st->dl_freq = dl_freq;
-	tms->t_display_st->ul_freq = ul_freq;
+	ds->cell.dl_freq = dl_freq;
+	ds->cell.ul_freq = ul_freq;
+	TETRA_STAT_SET(tms->stats.dl_hz, dl_freq);
+	TETRA_STAT_SET(tms->stats.ul_hz, ul_freq);
+	TETRA_STAT_PUBLISH(tms->stats.sysinfo);
 	if (sid.cck_valid_no_hf) {
 		// printf("CCK ID %u", sid.cck_id);
 	} else {
 		// printf("Hyperframe %u", sid.hyperframe_number);
-		tms->t_display_st->curr_hyperframe = sid.hyperframe_number;
+		ds->cell.curr_hyperframe = sid.hyperframe_number;
 	}
 	// printf("\n");
-	for (i = 0; i < 12; i++) {
-		// printf("\t%s: %u\n", tetra_get_bs_serv_det_name(1 << i),
-			// sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-			switch(i) {
-				case 0:
-					tms->t_display_st->advanced_link = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 1:
-					tms->t_display_st->air_encryption = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 2:
-					tms->t_display_st->sndcp_data = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 4:
-					tms->t_display_st->circuit_data = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 5:
-					tms->t_display_st->voice_service = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 6:
-					tms->t_display_st->normal_mode = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 7:
-					tms->t_display_st->migration_supported = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 8:
-					tms->t_display_st->never_minimum_mode = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 9:
-					tms->t_display_st->priority_cell = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 10:
-					tms->t_display_st->dereg_mandatory = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-				case 11:
-					tms->t_display_st->reg_mandatory = (sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
-					break;
-			}
-	}
+	/* BS service details, see tetra_get_bs_serv_det_name() */
+	sd = sid.mle_si.bs_service_details;
+	ds->cell.advanced_link = sd & (1 << 0);
+	ds->cell.air_encryption = sd & (1 << 1);
+	ds->cell.sndcp_data = sd & (1 << 2);
+	ds->cell.circuit_data = sd & (1 << 4);
+	ds->cell.voice_service = sd & (1 << 5);
+	ds->cell.normal_mode = sd & (1 << 6);
+	ds->cell.migration_supported = sd & (1 << 7);
+	ds->cell.never_minimum_mode = sd & (1 << 8);
+	ds->cell.priority_cell = sd & (1 << 9);
+	ds->cell.dereg_mandatory = sd & (1 << 10);
+	ds->cell.reg_mandatory = sd & (1 << 11);
+	tetra_display_publish_cell(tms);
 
 	memcpy(&tms->last_sid, &sid, sizeof(sid));
 
@@ -200,17 +191,22 @@ static int rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	struct msgb *msg = tmvp->oph.msg;
 	struct tetra_crypto_state *tcs = tms->tcs;
 	struct tetra_resrc_decoded rsd;
-	struct msgb *fragmsgb;
+	struct tetra_bitreader br;
 	struct tetra_key *key = 0;
 	int tmpdu_offset, slot;
 	int pdu_bits; /* Full length of pdu, including fill bits */
 
 	memset(&rsd, 0, sizeof(rsd));
-	tmpdu_offset = macpdu_decode_resource(&rsd, msg->l1h, 0);
+	mac_bitreader(&br, &tmvp->u.unitdata, msg->l1h, msgb_l1len(msg));
+	tmpdu_offset = macpdu_decode_resource(&rsd, &br, 0);
+	if (tmpdu_offset < 0)
+		return -1;			/* Address type reserved, the rest can't be told apart */
 
 	if (rsd.macpdu_length == MACPDU_LEN_2ND_STOLEN) {
+		/* The next block is also stolen. cur_burst is the lower MAC's,
+		 * which may be past this burst already when the MAC pipe runs,
+		 * and nothing goes by blk2_stolen, so it is not set from here */
 		pdu_bits = -1;				/* Fills slot */
-		tms->cur_burst.blk2_stolen = true;	/* Next block is also stolen */
 	} else if (rsd.macpdu_length == MACPDU_LEN_START_FRAG) {
 		pdu_bits = -1;				/* Fills slot */
 	} else {
@@ -227,15 +223,18 @@ static int rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	}
 
 	/* Decrypt buffer if encrypted and key available */
-	if (rsd.is_encrypted && tcdb->num_keys) {
+	if (rsd.is_encrypted && tetra_crypto_have_keys(tcs)) {
 		decrypt_identity(tcs, &rsd.addr);
 		key = get_ksg_key(tcs, rsd.addr.ssi);
 
 		if (key) {
 			rsd.is_encrypted = !decrypt_mac_element(tcs, tmvp, key, msgb_l1len(msg), tmpdu_offset);
 			if (rsd.chan_alloc_pres) {
-				// Re-decode the channel allocation element to get accurate L2 start
-				tmpdu_offset += macpdu_decode_chan_alloc(&rsd.cad, msg->l1h + tmpdu_offset);
+				// Re-decode the channel allocation element to get accurate L2 start,
+				// from the decrypted bits, the packed copy is still encrypted
+				tetra_bitreader_init(&br, msg->l1h + tmpdu_offset,
+						     msgb_l1len(msg) > tmpdu_offset ? msgb_l1len(msg) - tmpdu_offset : 0);
+				tmpdu_offset += macpdu_decode_chan_alloc(&rsd.cad, &br);
 			}
 		}
 	}
@@ -256,6 +255,13 @@ static int rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 		}
 	}
 
+	/* remember how the call on this usage marker is protected */
+	if (rsd.addr.type == ADDR_TYPE_SSI_USAGE) {
+		tms->um_crypt[rsd.addr.usage_marker].encrypted = rsd.encryption_mode > 0;
+		tms->um_crypt[rsd.addr.usage_marker].key = key;
+		tms->voice_key_dirty |= 1ULL << rsd.addr.usage_marker;
+	}
+
 	if (rsd.slot_granting.pres) {
 		// printf(" SlotGrant=%u/%u", rsd.slot_granting.nr_slots,
 			// rsd.slot_granting.delay);
@@ -278,32 +284,22 @@ static int rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	// printf(": %s\n", osmo_ubit_dump(msg->l2h, msgb_l2len(msg)));
 	if (rsd.macpdu_length != MACPDU_LEN_START_FRAG || !REASSEMBLE_FRAGMENTS) {
 		/* Non-fragmented resource (or no reassembly desired) */
-		// rx_tm_sdu(tms, msg, msgb_l2len(msg));
-		//TODO: fix llc
+		rx_tm_sdu(tms, &tmvp->u.unitdata, &rsd, msg, msgb_l2len(msg));
 	} else {
 		/* Fragmented resource */
 		slot = tmvp->u.unitdata.tdma_time.tn;
 		if (tms->fragslots[slot].active) {
 			// printf("\nWARNING: fragment slot still active\n");
-			cleanup_fragslot(&tms->fragslots[slot]);
+			cleanup_fragslot(tms, &tms->fragslots[slot]);
 		}
 
-		init_fragslot(&tms->fragslots[slot]);
-		fragmsgb = tms->fragslots[slot].msgb;
-
-		/* Copy l2 part to fragmsgb. l3h is constructed once all fragments are merged */
-		fragmsgb = tms->fragslots[slot].msgb;
-		fragmsgb->l1h = msgb_put(fragmsgb, msgb_l1len(msg));
-		fragmsgb->l2h = fragmsgb->l1h + tmpdu_offset;
-		fragmsgb->l3h = 0;
-		memcpy(fragmsgb->l2h, msg->l2h, msgb_l2len(msg));
+		/* Keep MAC header and first fragment, l3h is constructed once all fragments are merged */
+		init_fragslot(tms, &tms->fragslots[slot], msg->l1h, tmpdu_offset, msgb_l2len(msg));
 
-		// printf("\nFRAG-START slot=%d len=%d msgb=%s\n", slot, msgb_l2len(fragmsgb), osmo_ubit_dump(fragmsgb->l2h, msgb_l2len(msg)));
-		tms->fragslots[slot].active = 1;
-		tms->fragslots[slot].num_frags = 1;
-		tms->fragslots[slot].length = msgb_l2len(msg);
+		// printf("\nFRAG-START slot=%d len=%d\n", slot, msgb_l2len(msg));
 		tms->fragslots[slot].encryption = rsd.encryption_mode > 0;
 		tms->fragslots[slot].key = key;
+		tms->fragslots[slot].rsd = rsd;
 	}
 
 out:
@@ -311,26 +307,9 @@ out:
 	return pdu_bits;
 }
 
-void append_frag_bits(struct tetra_mac_state *tms, int slot, uint8_t *bits, int bitlen)
-{
-	struct msgb *fragmsgb;
-	fragmsgb = tms->fragslots[slot].msgb;
-	if (fragmsgb->len + bitlen > fragmsgb->data_len) {
-		// printf(" WARNING: FRAG LENGTH ERROR!\n");
-		return;
-	}
-	unsigned char *append_ptr = msgb_put(fragmsgb, bitlen);
-	memcpy(append_ptr, bits, bitlen);
-
-	tms->fragslots[slot].length = tms->fragslots[slot].length + bitlen;
-	tms->fragslots[slot].num_frags++;
-	tms->fragslots[slot].age = 0;
-}
-
 static int rx_macfrag(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 {
 	struct msgb *msg = tmvp->oph.msg;
-	struct msgb *fragmsgb;
 	int slot = tmvp->u.unitdata.tdma_time.tn;
 	uint8_t *bits = msg->l1h;
 	uint8_t fillbits_present;
@@ -351,13 +330,12 @@ static int rx_macfrag(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tm
 		}
 
 		/* Decrypt (if required) */
-		fragmsgb = tms->fragslots[slot].msgb;
 		if (tms->fragslots[slot].encryption && tms->fragslots[slot].key)
 			decrypt_mac_element(tms->tcs, tmvp, tms->fragslots[slot].key, msgb_l1len(msg), n);
 
 		/* Add frag to fragslot buffer */
 		append_frag_bits(tms, slot, msg->l2h, msgb_l2len(msg));
-		// printf("FRAG-CONT slot=%d added=%d msgb=%s\n", slot, msgb_l2len(msg), osmo_ubit_dump(fragmsgb->l2h, msgb_l2len(fragmsgb)));
+		// printf("FRAG-CONT slot=%d added=%d\n", slot, msgb_l2len(msg));
 	} else {
 		// printf("WARNING got fragment without start packet for slot=%d\n", slot);
 	}
@@ -372,7 +350,7 @@ static int rx_macend(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 	uint8_t *bits = msg->l1h;
 	uint8_t fillbits_present, chanalloc_present, length_indicator, slot_granting;
 	int num_fill_bits;
-	struct msgb *fragmsgb;
+	struct msgb *fragmsgb = NULL;
 	int n = 0;
 	int m = 0;
 
@@ -383,8 +361,9 @@ static int rx_macend(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 	m = 1; n = n + m; /* position_of_grant */
 	m = 6; length_indicator = bits_to_uint(bits + n, m); n = n + m;
 
-	fragmsgb = tms->fragslots[slot].msgb;
 	if (tms->fragslots[slot].active) {
+		/* Addressed by the MAC-RESOURCE, a channel allocation here replaces its one */
+		rsd = tms->fragslots[slot].rsd;
 
 		/* FIXME: handle napping bit in d8psk and qam */
 		m = 1; slot_granting = bits_to_uint(bits + n, m); n = n + m;
@@ -409,23 +388,27 @@ static int rx_macend(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 
 		/* Parse chanalloc element (if present) and update l2 offsets */
 		if (chanalloc_present) {
-			m = macpdu_decode_chan_alloc(&rsd.cad, bits + n); n = n + m;
+			struct tetra_bitreader br;
+			/* From the msgb, the element may just have been decrypted */
+			tetra_bitreader_init(&br, bits + n, msgb_l1len(msg) > n ? msgb_l1len(msg) - n : 0);
+			m = macpdu_decode_chan_alloc(&rsd.cad, &br); n = n + m;
+			rsd.chan_alloc_pres = 1;
 		}
 
 		msg->l2h = msg->l1h + n;
 		append_frag_bits(tms, slot, msg->l2h, msgb_l2len(msg));
-		// printf("FRAG-END slot=%d added=%d msgb=%s\n", slot, msgb_l2len(msg), osmo_ubit_dump(fragmsgb->l2h, msgb_l2len(fragmsgb)));
+		// printf("FRAG-END slot=%d added=%d\n", slot, msgb_l2len(msg));
 
-		/* Message is completed inside fragmsgb now */
-		if (!tms->fragslots[slot].encryption || tms->fragslots[slot].key) {
-			// rx_tm_sdu(tms, fragmsgb, tms->fragslots[slot].length);
-			//TODO: FIX LLC
-		}
+		/* Message is completed, unpack it in one go (NULL if it outgrew the storage) */
+		if (!tms->fragslots[slot].encryption || tms->fragslots[slot].key)
+			fragmsgb = fragslot_linearize(tms, &tms->fragslots[slot]);
+		if (fragmsgb)
+			rx_tm_sdu(tms, &tmvp->u.unitdata, &rsd, fragmsgb, tms->fragslots[slot].length);
 	} else {
 		// printf("FRAG: got end frag with len %d without start packet for slot=%d\n", length_indicator * 8, slot);
 	}
 
-	cleanup_fragslot(&tms->fragslots[slot]);
+	cleanup_fragslot(tms, &tms->fragslots[slot]);
 	return length_indicator * 8;
 }
 
@@ -470,11 +453,13 @@ static void rx_aach(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 {
 	struct tmv_unitdata_param *tup = &tmvp->u.unitdata;
 	struct tetra_acc_ass_decoded aad;
+	struct tetra_bitreader br;
 
 	// printf("ACCESS-ASSIGN PDU: ");
 
 	memset(&aad, 0, sizeof(aad));
-	macpdu_decode_access_assign(&aad, tmvp->oph.msg->l1h,
+	mac_bitreader(&br, tup, tmvp->oph.msg->l1h, msgb_l1len(tmvp->oph.msg));
+	macpdu_decode_access_assign(&aad, &br,
 				    tup->tdma_time.fn == 18 ? 1 : 0);
 
 	if (aad.pres & TETRA_ACC_ASS_PRES_ACCESS1) {
@@ -516,6 +501,7 @@ static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_
 	struct msgb *msg = tmvp->oph.msg;
 	uint8_t pdu_type = bits_to_uint(msg->l1h, 2);
 	const char *pdu_name;
+	uint32_t subs;
 	int len_parsed;
 
 	if (tup->lchan == TETRA_LC_BSCH)
@@ -542,24 +528,32 @@ static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_
 		age_fragslots(tms);
 
 	len_parsed = -1; /* Default for cases where slot is filled or otherwise irrelevant */
+	subs = __atomic_load_n(&tms->subscriptions, __ATOMIC_RELAXED);
 	switch (tup->lchan) {
 	case TETRA_LC_AACH:
-		rx_aach(tmvp, tms);
+		/* pipelined, the lower MAC did it already, see upper_mac_rx_access_assign() */
+		if (!tms->mac_pipe)
+			rx_aach(tmvp, tms);
 		break;
 	case TETRA_LC_BNCH:
 	case TETRA_LC_UNKNOWN:
 	case TETRA_LC_SCH_F:
 		switch (pdu_type) {
 		case TETRA_PDU_T_BROADCAST:
-			len_parsed = rx_bcast(tmvp, tms);
+			if (subs & TETRA_SUB_SYSINFO)
+				len_parsed = rx_bcast(tmvp, tms);
 			break;
 		case TETRA_PDU_T_MAC_RESOURCE:
-			len_parsed = rx_resrc(tmvp, tms);
+			if (subs & TETRA_SUB_RESOURCE)
+				len_parsed = rx_resrc(tmvp, tms);
 			break;
 		case TETRA_PDU_T_MAC_SUPPL:
-			len_parsed = rx_suppl(tmvp, tms);
+			if (subs & TETRA_SUB_SUPPL)
+				len_parsed = rx_suppl(tmvp, tms);
 			break;
 		case TETRA_PDU_T_MAC_FRAG_END:
+			if (!(subs & TETRA_SUB_FRAG))
+				break;
 			if (REASSEMBLE_FRAGMENTS) {
 				if (msg->l1h[2] == TETRA_MAC_FRAGE_FRAG) {
 					len_parsed = rx_macfrag(tmvp, tms);
@@ -595,12 +589,66 @@ static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_
 	return len_parsed;
 }
 
+/* Switch to a reloaded keystore between PDUs, the keys held by calls and
+ * fragments in progress move to their counterparts in the new one */
+static void refresh_keystore(struct tetra_mac_state *tms)
+{
+	struct tetra_crypto_state *tcs = tms->tcs;
+	int i;
+
+	if (!tetra_crypto_refresh(tcs))
+		return;
+	for (i = 0; i < TETRA_USAGE_MARKERS; i++)
+		tms->um_crypt[i].key = tetra_crypto_rebind_key(tcs, tms->um_crypt[i].key);
+	for (i = 1; i < FRAGSLOT_NR_SLOTS; i++)
+		tms->fragslots[i].key = tetra_crypto_rebind_key(tcs, tms->fragslots[i].key);
+	/* the lower MAC has its own copy of the keys of the calls, it takes the
+	 * new contents with the next voice slot */
+	tms->voice_key_dirty = ~0ULL;
+	tetra_crypto_refresh_done(tcs);
+}
+
+/* Publish the voice keys of the usage markers whose call or key changed, or
+ * of all of them when the cell data for TB5 and the IV did */
+static void update_voice_keys(struct tetra_mac_state *tms)
+{
+	struct tetra_crypto_state *tcs = tms->tcs;
+	struct tetra_voice_key vk;
+	uint64_t dirty = tms->voice_key_dirty;
+	int hn = __atomic_load_n(&tcs->hn, __ATOMIC_RELAXED);
+	int i;
+
+	if (tcs->cn != tms->voice_key_cn || tcs->la != tms->voice_key_la || tcs->cc != tms->voice_key_cc ||
+	    hn != tms->voice_key_hn) {
+		tms->voice_key_cn = tcs->cn;
+		tms->voice_key_la = tcs->la;
+		tms->voice_key_cc = tcs->cc;
+		tms->voice_key_hn = hn;
+		dirty = ~0ULL;
+	}
+	for (i = 0; dirty; i++, dirty >>= 1) {
+		if (!(dirty & 1))
+			continue;
+		tetra_crypto_voice_key(tcs, tms->um_crypt[i].encrypted, tms->um_crypt[i].key, &vk);
+		tetra_voice_key_publish(tms, i, &vk);
+	}
+	tms->voice_key_dirty = 0;
+}
+
+void upper_mac_rx_access_assign(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
+{
+	if (tmvp->u.unitdata.crc_ok)
+		rx_aach(tmvp, tms);
+}
+
 int upper_mac_prim_recv(struct osmo_prim_hdr *op, void *priv)
 {
 	struct tetra_tmvsap_prim *tmvp;
 	struct tetra_mac_state *tms = priv;
 	int pdu_bits = -1;
 
+	refresh_keystore(tms);
+
 	switch (op->sap) {
 	case TETRA_SAP_TMV:
 		tmvp = (struct tetra_tmvsap_prim *) op;
@@ -611,5 +659,6 @@ int upper_mac_prim_recv(struct osmo_prim_hdr *op, void *priv)
 		break;
 	}
 
+	update_voice_keys(tms);
 	return pdu_bits;
 }
@@ -8,4 +8,9 @@
 void upper_mac_init_fragslots();
 int upper_mac_prim_recv(struct osmo_prim_hdr *op, void *priv);
 
+/* ACCESS-ASSIGN of an AACH block on its own. With tms->mac_pipe set the lower
+ * MAC parses it in line, whether the slot is traffic is needed for the rest of
+ * the burst, and upper_mac_prim_recv() leaves it out */
+void upper_mac_rx_access_assign(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms);
+
 #endif
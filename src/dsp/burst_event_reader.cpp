@@ -0,0 +1,57 @@
+#include "burst_event_reader.h"
+
+#include <chrono>
+
+//Largest batch handed to the handler at once
+#define BURST_EVENT_BATCH 64
+//Sleep while the queue is empty, one TDMA slot is about 14ms
+#define BURST_EVENT_IDLE_MS 5
+
+namespace dsp {
+    BurstEventReader::~BurstEventReader() {
+        if (!_init) { return; }
+        stop();
+        _dec->setEventQueue(NULL);
+        tetra_event_queue_deinit(&queue);
+    }
+
+    void BurstEventReader::init(osmotetradec* dec, void (*handler)(const tetra_burst_event* events, int count, void* ctx), void* ctx, int queueSize) {
+        _dec = dec;
+        _handler = handler;
+        _ctx = ctx;
+        if (tetra_event_queue_init(&queue, queueSize) < 0) {
+            throw std::runtime_error("[BurstEventReader] Could not allocate the event queue");
+        }
+        _dec->setEventQueue(&queue);
+        _init = true;
+    }
+
+    void BurstEventReader::start() {
+        assert(_init);
+        if (running) { return; }
+        running = true;
+        workerThread = std::thread(&BurstEventReader::worker, this);
+    }
+
+    void BurstEventReader::stop() {
+        assert(_init);
+        if (!running) { return; }
+        running = false;
+        if (workerThread.joinable()) { workerThread.join(); }
+    }
+
+    void BurstEventReader::worker() {
+        while (running) {
+            const tetra_burst_event* events;
+            unsigned int count = tetra_event_queue_peek(&queue, &events, BURST_EVENT_BATCH);
+            dropped += tetra_event_queue_take_dropped(&queue);
+            if (!count) {
+                if (_idleHandler) { _idleHandler(_ctx); }
+                std::this_thread::sleep_for(std::chrono::milliseconds(BURST_EVENT_IDLE_MS));
+                continue;
+            }
+            _handler(events, count, _ctx);
+            tetra_event_queue_release(&queue, count);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "osmotetra_dec.h"
+
+#include <atomic>
+#include <thread>
+
+namespace dsp {
+    //Drains the decoded block / MAC PDU records of an osmotetradec on its own thread and passes them to the handler
+    //in batches. The decoder never waits for the reader, records that do not fit in the queue are dropped and counted
+    class BurstEventReader {
+    public:
+        BurstEventReader() {}
+
+        BurstEventReader(osmotetradec* dec, void (*handler)(const tetra_burst_event* events, int count, void* ctx), void* ctx, int queueSize = 1024) { init(dec, handler, ctx, queueSize); }
+
+        ~BurstEventReader();
+
+        void init(osmotetradec* dec, void (*handler)(const tetra_burst_event* events, int count, void* ctx), void* ctx, int queueSize = 1024);
+
+        //handler is called with the ctx of init each time the queue ran empty, before the reader sleeps. Set it before start
+        void setIdleHandler(void (*handler)(void* ctx)) { _idleHandler = handler; }
+
+        void start();
+        void stop();
+
+        //Records lost to a full queue since the reader was created
+        unsigned int getDropped() { return dropped; }
+        //Records waiting to be handed out
+        unsigned int getDepth() { return _init ? tetra_event_queue_depth(&queue) : 0; }
+
+    protected:
+        void worker();
+
+        bool _init = false;
+        osmotetradec* _dec = NULL;
+        void (*_handler)(const tetra_burst_event* events, int count, void* ctx) = NULL;
+        void* _ctx = NULL;
+        void (*_idleHandler)(void* ctx) = NULL;
+
+        tetra_event_queue queue;
+        std::atomic<bool> running = false;
+        std::atomic<unsigned int> dropped = 0;
+        std::thread workerThread;
+    };
+}
@@ -0,0 +1,311 @@
+#include "burst_merge.h"
+#include "osmotetra_dec.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+extern "C" {
+    #include <tetra_pbits.h>
+    #include <phy/tetra_train_corr.h>
+}
+
+//One multiframe is 18 * 4 timeslots of 85/6 ms
+#define BURST_MERGE_MULTIFRAME_US 1020000.0
+#define BURST_MERGE_SLOTS_PER_MULTIFRAME (18 * 4)
+#define BURST_MERGE_NO_CELL 0xFFFFFFFF
+//Bit error rate a vote is weighted with at most, 1e-4 weighs about five copies at 0 dB
+#define BURST_MERGE_MIN_BIT_ERRORS 1e-4f
+
+namespace dsp {
+    //Multiframe of a record counted from hyperframe 0 of the receiver that wrote it
+    static inline int64_t localMultiframe(int hn, int mn) {
+        return (int64_t)hn * 60 + (mn + 59) % 60;
+    }
+
+    static inline int64_t floorDiv(int64_t a, int64_t b) {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    //Every CRC block of the burst decoded and checked out
+    static inline bool crcValid(uint8_t flags) {
+        if (!(flags & (TETRA_BURST_F_BLK1_CRC | TETRA_BURST_F_BLK2_CRC))) { return false; }
+        if ((flags & TETRA_BURST_F_BLK1_CRC) && !(flags & TETRA_BURST_F_BLK1_OK)) { return false; }
+        if ((flags & TETRA_BURST_F_BLK2_CRC) && !(flags & TETRA_BURST_F_BLK2_OK)) { return false; }
+        return true;
+    }
+
+    static inline int crcScore(uint8_t flags) {
+        return ((flags & TETRA_BURST_F_BLK1_OK) ? 1 : 0) + ((flags & TETRA_BURST_F_BLK2_OK) ? 1 : 0);
+    }
+
+    //Weight of the vote of a copy with the SNR of its training sequence: the log likelihood ratio of one of its bits,
+    //log((1 - p) / p) with p the bit error rate at that SNR, so a copy at 5 dB counts about twice as much as one at
+    //0 dB while a clean copy does not outvote all the others alone
+    static inline float voteWeight(uint8_t snr) {
+        float linear = powf(10.0f, (float)snr / (10.0f * TETRA_TRAIN_SNR_STEPS_PER_DB));
+        float p = std::max<float>(0.5f * erfcf(sqrtf(0.5f * linear)), BURST_MERGE_MIN_BIT_ERRORS);
+        return logf((1.0f - p) / p);
+    }
+
+    BurstMerge::~BurstMerge() {
+        close();
+    }
+
+    bool BurstMerge::open(const std::vector<std::string>& paths, std::string& failed) {
+        close();
+        inputs.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (tetra_burst_archive_map(&inputs[i].map, paths[i].c_str()) < 0) {
+                inputs.resize(i);
+                failed = paths[i];
+                close();
+                return false;
+            }
+        }
+
+        //A lower MAC of its own to decode the SYNC bursts with, nothing above it
+        osmotetradec decoder;
+        decoder.init(NULL);
+        decoder.setSubscriptions(0);
+        for (auto& in : inputs) { identify(in, decoder); }
+
+        for (auto& in : inputs) {
+            std::vector<uint32_t> seen;
+            for (uint32_t key : in.cellOf) {
+                if (key == BURST_MERGE_NO_CELL) { continue; }
+                size_t c = std::find(cellKeys.begin(), cellKeys.end(), key) - cellKeys.begin();
+                if (c == cellKeys.size()) {
+                    cellKeys.push_back(key);
+                    cells.push_back({ (int)(key >> 20), (int)((key >> 6) & 0x3FFF), (int)(key & 0x3F), 0, 0 });
+                }
+                cells[c].records++;
+                if (std::find(seen.begin(), seen.end(), key) == seen.end()) {
+                    seen.push_back(key);
+                    cells[c].archives++;
+                }
+            }
+        }
+        //Most records first, the keys along with them
+        std::vector<size_t> order(cells.size());
+        for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return cells[a].records > cells[b].records; });
+        std::vector<Cell> sortedCells;
+        std::vector<uint32_t> sortedKeys;
+        for (size_t i : order) {
+            sortedCells.push_back(cells[i]);
+            sortedKeys.push_back(cellKeys[i]);
+        }
+        cells = sortedCells;
+        cellKeys = sortedKeys;
+        return true;
+    }
+
+    void BurstMerge::close() {
+        for (auto& in : inputs) { tetra_burst_archive_unmap(&in.map); }
+        inputs.clear();
+        cells.clear();
+        cellKeys.clear();
+        copies.clear();
+        pos = 0;
+    }
+
+    void BurstMerge::identify(Input& in, osmotetradec& decoder) {
+        uint64_t count = in.map.nr_records;
+        in.cellOf.assign(count, BURST_MERGE_NO_CELL);
+        uint32_t cur = BURST_MERGE_NO_CELL;
+        uint64_t first = count;
+        for (uint64_t r = 0; r < count; r++) {
+            const struct tetra_burst_record& rec = in.map.records[r];
+            if (rec.train_seq == TETRA_TRAIN_SYNC) {
+                uint64_t syncs = decoder.getCellInfo().syncs;
+                decoder.replayBursts(&rec, 1);
+                TetraCellInfo info = decoder.getCellInfo();
+                if (info.syncs != syncs) {
+                    cur = cellKey(info.mcc, info.mnc, info.cc);
+                    if (first == count) { first = r; }
+                }
+            }
+            in.cellOf[r] = cur;
+        }
+        for (uint64_t r = 0; r < first && first < count; r++) { in.cellOf[r] = in.cellOf[first]; }
+    }
+
+    bool BurstMerge::selectCell(int cell) {
+        if (cell < 0 || cell >= (int)cells.size()) { return false; }
+        uint32_t key = cellKeys[cell];
+        copies.clear();
+        pos = 0;
+        copiesRead = 0;
+        duplicates = 0;
+        combined = 0;
+        recordsOut = 0;
+
+        //The wall clock of the index gives the multiframe of a record to within the clock error, the TDMA time the
+        //multiframe within the hyperframe exactly. delta takes the first archive's own multiframe count to the wall
+        //clock. An archive is anchored to it at its first record and goes by its own count from there, as long as that
+        //keeps up with the wall clock: a receiver that lost the carrier for longer than half a hyperframe is anchored
+        //again. Archives written from a replay have a wall clock that runs fast, they never fall behind it
+        bool haveDelta = false;
+        double delta = 0;
+        for (int i = 0; i < (int)inputs.size(); i++) {
+            const struct tetra_burst_archive_map& m = inputs[i].map;
+            const std::vector<uint32_t>& cellOf = inputs[i].cellOf;
+            uint64_t entry = 0;
+            bool anchored = false;
+            double anchorWall = 0;
+            int64_t anchorLocal = 0;
+            int64_t offset = 0;
+            for (uint64_t r = 0; r < m.nr_records; r++) {
+                while (entry + 1 < m.nr_index && m.index[entry + 1].record <= r) { entry++; }
+                if (cellOf[r] != key) { continue; }
+                const struct tetra_burst_record& rec = m.records[r];
+                int64_t local = localMultiframe(rec.hn, rec.mn);
+                //In multiframes. Without an index the archive is taken to be one stretch from its start
+                double wall;
+                if (m.nr_index) {
+                    const struct tetra_burst_index_entry& e = m.index[entry];
+                    wall = (double)e.wall_us / BURST_MERGE_MULTIFRAME_US + (double)(local - localMultiframe(e.hn, e.mn));
+                } else {
+                    wall = (double)m.hdr->start_us / BURST_MERGE_MULTIFRAME_US + (double)(local - localMultiframe(m.records[0].hn, m.records[0].mn));
+                }
+                if (!haveDelta) {
+                    delta = wall - (double)local;
+                    startUs = m.hdr->start_us;
+                    haveDelta = true;
+                }
+                if (!anchored || (wall - anchorWall) - (double)(local - anchorLocal) > 30.0) {
+                    //The multiframe with the record's number closest to what the clock says
+                    int64_t mnIdx = (rec.mn + 59) % 60;
+                    int64_t mf = mnIdx + 60 * (int64_t)llround((wall - delta - (double)mnIdx) / 60.0);
+                    offset = mf - local;
+                    anchorWall = wall;
+                    anchorLocal = local;
+                    anchored = true;
+                }
+                Copy c;
+                c.slot = (local + offset) * BURST_MERGE_SLOTS_PER_MULTIFRAME + ((rec.fn + 17) % 18) * 4 + (rec.tn + 3) % 4;
+                c.input = i;
+                c.record = r;
+                copies.push_back(c);
+            }
+        }
+        //Stable, so the copies of a burst stay in the order of the archives
+        std::stable_sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) { return a.slot < b.slot; });
+        return true;
+    }
+
+    int BurstMerge::next(const struct tetra_burst_record** recs, const int8_t* const** soft, int max) {
+        max = std::max<int>(max, 1);
+        if ((int)outRecs.size() < max) {
+            outRecs.resize(max);
+            outSoft.resize(max * TETRA_BITS_PER_TS);
+            outSoftPtrs.resize(max);
+        }
+        int count = 0;
+        while (count < max && pos < copies.size()) {
+            size_t end = pos + 1;
+            while (end < copies.size() && copies[end].slot == copies[pos].slot) { end++; }
+            bool isSoft;
+            mergeSlot(pos, end - pos, outRecs[count], &outSoft[count * TETRA_BITS_PER_TS], isSoft);
+            outSoftPtrs[count] = isSoft ? &outSoft[count * TETRA_BITS_PER_TS] : NULL;
+            copiesRead += end - pos;
+            duplicates += end - pos - 1;
+            recordsOut++;
+            pos = end;
+            count++;
+        }
+        *recs = outRecs.data();
+        *soft = outSoftPtrs.data();
+        return count;
+    }
+
+    void BurstMerge::mergeSlot(size_t first, size_t count, struct tetra_burst_record& out, int8_t* soft, bool& isSoft) {
+        auto recOf = [this](size_t k) -> const struct tetra_burst_record& {
+            return inputs[copies[k].input].map.records[copies[k].record];
+        };
+
+        //The first copy that checked out, or the one with the most blocks that did and of those the one heard best
+        size_t base = first;
+        int bestScore = -1;
+        int bestSnr = -1;
+        uint8_t snr = 0;
+        for (size_t k = first; k < first + count; k++) {
+            uint8_t flags = recOf(k).flags;
+            snr = std::max<uint8_t>(snr, recOf(k).snr);
+            if (crcValid(flags)) {
+                base = k;
+                break;
+            }
+            if (crcScore(flags) > bestScore || (crcScore(flags) == bestScore && recOf(k).snr > bestSnr)) {
+                base = k;
+                bestScore = crcScore(flags);
+                bestSnr = recOf(k).snr;
+            }
+        }
+        out = recOf(base);
+        int64_t slot = copies[base].slot;
+        int64_t mf = floorDiv(slot, BURST_MERGE_SLOTS_PER_MULTIFRAME);
+        int s = (int)(slot - mf * BURST_MERGE_SLOTS_PER_MULTIFRAME);
+        int64_t hn = floorDiv(mf, 60);
+        out.hn = (uint16_t)(hn & 0xFFFF);
+        out.mn = (uint8_t)(mf - hn * 60 + 1);
+        out.fn = (uint8_t)(s / 4 + 1);
+        out.tn = (uint8_t)(s % 4 + 1);
+        isSoft = false;
+        if (count == 1 || crcValid(out.flags)) { return; }
+
+        //Copies the synchronizer took for another burst type can't be combined with it. Those without an SNR (older
+        //archives, hard bits) vote with the mean weight of the others, or all alike
+        float known = 0.0f;
+        int nKnown = 0;
+        int n = 0;
+        for (size_t k = first; k < first + count; k++) {
+            const struct tetra_burst_record& rec = recOf(k);
+            if (rec.train_seq != out.train_seq) { continue; }
+            if (rec.snr) {
+                known += voteWeight(rec.snr);
+                nKnown++;
+            }
+            n++;
+        }
+        if (n < 2) { return; }
+        float unknown = nKnown ? known / nKnown : 1.0f;
+        float votes[TETRA_BITS_PER_TS] = { 0 };
+        float total = 0.0f;
+        for (size_t k = first; k < first + count; k++) {
+            const struct tetra_burst_record& rec = recOf(k);
+            if (rec.train_seq != out.train_seq) { continue; }
+            float w = rec.snr ? voteWeight(rec.snr) : unknown;
+            for (int i = 0; i < TETRA_BITS_PER_TS; i++) { votes[i] += tetra_pwords_get(rec.bits, i) ? -w : w; }
+            total += w;
+        }
+        for (int i = 0; i < TETRA_BITS_PER_TS; i++) {
+            soft[i] = (int8_t)lrintf(127.0f * votes[i] / total);
+            //A tie keeps the bit of the best copy
+            if (soft[i]) { tetra_pwords_set(out.bits, i, soft[i] < 0); }
+        }
+        for (int blk = BLK_1; blk <= BLK_2; blk++) {
+            uint8_t okFlag = (blk == BLK_1) ? TETRA_BURST_F_BLK1_OK : TETRA_BURST_F_BLK2_OK;
+            for (size_t k = first; k < first + count; k++) {
+                const struct tetra_burst_record& rec = recOf(k);
+                if (rec.train_seq != out.train_seq || !(rec.flags & okFlag)) { continue; }
+                unsigned int offs[2], len[2];
+                int ranges = tetra_burst_block_ranges((enum tetra_train_seq)rec.train_seq, blk, offs, len);
+                for (int r = 0; r < ranges; r++) {
+                    for (unsigned int i = offs[r]; i < offs[r] + len[r]; i++) {
+                        unsigned int bit = tetra_pwords_get(rec.bits, i);
+                        soft[i] = bit ? -127 : 127;
+                        tetra_pwords_set(out.bits, i, bit);
+                    }
+                }
+                break;
+            }
+        }
+        //Decoded again from the soft bits, the flags are the decoder's to set. The SNR is that of the best copy
+        out.flags = 0;
+        out.snr = snr;
+        isSoft = true;
+        combined++;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <phy/tetra_burst_archive.h>
+}
+
+//Merged records handed out by one BurstMerge::next() by default, one TDMA frame
+#define BURST_MERGE_DEFAULT_BURSTS 4
+
+namespace dsp {
+    class osmotetradec;
+
+    //One stream out of the burst archives of several receivers that hear the same cell, every burst once. The records
+    //of an archive go with the cell its last SYNC came from (MCC, MNC and colour code) and are lined up by TDMA time.
+    //The hyperframe count of that time is each receiver's own, so where an archive starts, or resumes after a long
+    //loss of the carrier, its multiframes are matched up by the wall clock of the archive index. The clocks of the
+    //receivers have to agree to within half a hyperframe (30 s).
+    //Of the copies of a burst, the first whose CRC blocks all checked out is taken as it is. Without one the copies
+    //are soft combined: the soft value of a bit is the vote of the copies on it, each weighted by the SNR of its
+    //training sequence, a block that checked out in one of them is taken from that one at full confidence. The merged records have the TDMA time of the first archive
+    //with the cell and go to osmotetradec::replayBursts, archiving them there writes the merged archive
+    class BurstMerge {
+    public:
+        struct Cell {
+            int mcc;
+            int mnc;
+            int cc;
+            uint64_t records; //in all archives
+            int archives;
+        };
+
+        BurstMerge() {}
+
+        ~BurstMerge();
+
+        //Maps the archives and tells the cells in them apart by decoding their SYNC bursts. false if one can't be
+        //mapped, failed being its path
+        bool open(const std::vector<std::string>& paths, std::string& failed);
+        void close();
+        bool isOpen() { return !inputs.empty(); }
+
+        //Most records first. The records of an archive before its first SYNC go with the cell of that one, archives
+        //without a SYNC are left out
+        const std::vector<Cell>& getCells() { return cells; }
+
+        //Merges the records of cell from the start, false if there is no such cell
+        bool selectCell(int cell);
+
+        //Sets recs to the next merged records of the selected cell, at most max of them, and soft to their soft bits
+        //(NULL where one copy is taken as it is). Both stay valid until the next call. Returns how many, 0 at the end
+        int next(const struct tetra_burst_record** recs, const int8_t* const** soft, int max = BURST_MERGE_DEFAULT_BURSTS);
+
+        //Of the selected cell so far: copies read, copies left out as another one was taken, and merged records soft
+        //combined from more than one copy
+        uint64_t getCopies() { return copiesRead; }
+        uint64_t getDuplicates() { return duplicates; }
+        uint64_t getCombined() { return combined; }
+        uint64_t getRecords() { return recordsOut; }
+        //Wall clock the first archive with the cell was started at, us since the epoch
+        uint64_t getStartUs() { return startUs; }
+
+    protected:
+        struct Input {
+            struct tetra_burst_archive_map map;
+            //Cell key of every record, see cellKey()
+            std::vector<uint32_t> cellOf;
+        };
+
+        struct Copy {
+            int64_t slot; //TDMA slot since the start of hyperframe 0 of the first archive with the cell
+            int input;
+            uint64_t record;
+        };
+
+        static uint32_t cellKey(int mcc, int mnc, int cc) { return ((uint32_t)mcc << 20) | ((uint32_t)mnc << 6) | (uint32_t)cc; }
+        void identify(Input& in, osmotetradec& decoder);
+        void mergeSlot(size_t first, size_t count, struct tetra_burst_record& out, int8_t* soft, bool& isSoft);
+
+        std::vector<Input> inputs;
+        std::vector<Cell> cells;
+        std::vector<uint32_t> cellKeys;
+
+        //Of the selected cell, in slot order. Copies of one burst follow each other
+        std::vector<Copy> copies;
+        size_t pos = 0;
+        uint64_t startUs = 0;
+
+        std::vector<struct tetra_burst_record> outRecs;
+        std::vector<int8_t> outSoft;
+        std::vector<const int8_t*> outSoftPtrs;
+
+        uint64_t copiesRead = 0;
+        uint64_t duplicates = 0;
+        uint64_t combined = 0;
+        uint64_t recordsOut = 0;
+    };
+}
@@ -0,0 +1,76 @@
+#include "burst_replay.h"
+
+#include <algorithm>
+#include <thread>
+
+//One timeslot is 85/6 ms
+#define TDMA_SLOT_US_NUM 85000
+#define TDMA_SLOT_US_DEN 6
+#define TDMA_SLOTS_PER_HYPERFRAME (60 * 18 * 4)
+//A gap longer than this between two records is where the decoder was not locked, by the TDMA time alone it can't
+//be told how long. It counts as one slot
+#define BURST_REPLAY_MAX_GAP_SLOTS (18 * 4)
+
+namespace dsp {
+    static inline int recordSlot(const struct tetra_burst_record& rec) {
+        return (((rec.mn + 59) % 60) * 18 + (rec.fn + 17) % 18) * 4 + (rec.tn + 3) % 4;
+    }
+
+    BurstReplay::~BurstReplay() {
+        close();
+    }
+
+    bool BurstReplay::open(const std::string& path) {
+        close();
+        if (tetra_burst_archive_map(&map, path.c_str()) < 0) { return false; }
+        mapped = true;
+        pos = 0;
+        clockSet = false;
+        return true;
+    }
+
+    void BurstReplay::close() {
+        if (!mapped) { return; }
+        tetra_burst_archive_unmap(&map);
+        mapped = false;
+    }
+
+    void BurstReplay::setSpeed(double speed) {
+        _speed = (speed > 0) ? speed : 0;
+        clockSet = false;
+    }
+
+    bool BurstReplay::seek(uint16_t hn, uint8_t mn) {
+        if (!mapped) { return false; }
+        uint64_t rec = tetra_burst_archive_find(&map, hn, mn);
+        if (rec >= map.nr_records) { return false; }
+        pos = rec;
+        clockSet = false;
+        return true;
+    }
+
+    int BurstReplay::next(const struct tetra_burst_record** recs, int max) {
+        if (!mapped || pos >= map.nr_records) { return 0; }
+        int count = (int)std::min<uint64_t>(max, map.nr_records - pos);
+        *recs = &map.records[pos];
+        pos += count;
+        if (_speed <= 0) { return count; }
+
+        //Due once the air time up to the last of them has passed
+        if (!clockSet) {
+            start = std::chrono::steady_clock::now();
+            slots = 0;
+            lastSlot = recordSlot((*recs)[0]);
+            clockSet = true;
+        }
+        for (int i = 0; i < count; i++) {
+            int slot = recordSlot((*recs)[i]);
+            int d = (slot - lastSlot + TDMA_SLOTS_PER_HYPERFRAME) % TDMA_SLOTS_PER_HYPERFRAME;
+            slots += (d > BURST_REPLAY_MAX_GAP_SLOTS) ? 1 : d;
+            lastSlot = slot;
+        }
+        auto due = start + std::chrono::microseconds((int64_t)(slots * TDMA_SLOT_US_NUM / TDMA_SLOT_US_DEN / _speed));
+        std::this_thread::sleep_until(due);
+        return count;
+    }
+}
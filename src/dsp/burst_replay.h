@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+
+extern "C" {
+    #include <phy/tetra_burst_archive.h>
+}
+
+//Records handed out by one BurstReplay::next() by default, one TDMA frame
+#define BURST_REPLAY_DEFAULT_BURSTS 4
+
+namespace dsp {
+    //Plays the records of a burst archive back in order for osmotetradec::replayBursts. The pace is the TDMA timing
+    //of the air interface times a speed factor, or as fast as the decoder takes them. What comes out only depends on
+    //the archive, not on the speed: every record goes in once and in order
+    class BurstReplay {
+    public:
+        BurstReplay() {}
+
+        ~BurstReplay();
+
+        //false if path is not a burst archive that can be mapped
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() { return mapped; }
+
+        //1 is real time, 2 twice as fast, 0 as fast as possible
+        void setSpeed(double speed);
+
+        //Goes on from the first record of multiframe hn/mn, false if the archive has none
+        bool seek(uint16_t hn, uint8_t mn);
+
+        //Sets recs to the next records, at most max of them, once they are due. Returns how many, 0 at the end
+        int next(const struct tetra_burst_record** recs, int max = BURST_REPLAY_DEFAULT_BURSTS);
+
+        uint64_t getPosition() { return pos; }
+        uint64_t getRecords() { return map.nr_records; }
+        //Wall clock the archive was started at, us since the epoch
+        uint64_t getStartUs() { return mapped ? map.hdr->start_us : 0; }
+
+    protected:
+        struct tetra_burst_archive_map map = {};
+        bool mapped = false;
+        uint64_t pos = 0;
+        double _speed = 0;
+
+        //Air time of the records handed out, in slots, since start
+        bool clockSet = false;
+        std::chrono::steady_clock::time_point start;
+        uint64_t slots = 0;
+        int lastSlot = 0;
+    };
+}
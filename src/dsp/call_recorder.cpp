@@ -0,0 +1,224 @@
+#include "call_recorder.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <filesystem>
+
+extern "C" {
+    #include "tetra_cmce_pdu.h"
+    #include "tetra_mac_pdu.h"
+    #include "tetra_mle_pdu.h"
+}
+
+namespace dsp {
+    CallRecorder::~CallRecorder() {
+        stop();
+    }
+
+    bool CallRecorder::start(const std::string& dir, int hangMs) {
+        stop();
+        std::error_code ec;
+        if (!std::filesystem::is_directory(dir, ec)) { return false; }
+        _dir = dir;
+        hang = std::chrono::milliseconds(hangMs);
+        {
+            std::lock_guard<std::mutex> lck(queueMtx);
+            queue.resize(CALL_RECORDER_QUEUE_FRAMES);
+            head = 0;
+            tail = 0;
+        }
+        calls = 0;
+        dropped = 0;
+        bytes = 0;
+        closedBytes = 0;
+        running = true;
+        workerThread = std::thread(&CallRecorder::worker, this);
+        return true;
+    }
+
+    void CallRecorder::stop() {
+        if (!running) { return; }
+        running = false;
+        if (workerThread.joinable()) { workerThread.join(); }
+        std::lock_guard<std::mutex> lck(queueMtx);
+        std::vector<Item>().swap(queue);
+    }
+
+    void CallRecorder::setSource(int source, const std::string& label, uint32_t dlHz) {
+        std::lock_guard<std::mutex> lck(sourceMtx);
+        labels[source] = { label, dlHz };
+    }
+
+    void CallRecorder::pushFrames(int source, const TetraAudioFrame* frames, int count) {
+        if (!running) { return; }
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lck(queueMtx);
+        for (int i = 0; i < count; i++) {
+            Item* item = reserve();
+            if (!item) {
+                dropped += count - i;
+                return;
+            }
+            item->source = source;
+            item->kind = ITEM_FRAME;
+            item->received = now;
+            item->frame = frames[i];
+        }
+    }
+
+    void CallRecorder::handleL3(int source, const struct tetra_l3_event* l3) {
+        if (!running || l3->pdisc != TMLE_PDISC_CMCE || !l3->parsed) { return; }
+        int type = l3->cmce.pdu_type;
+        int kind;
+        if (type == TCMCE_PDU_T_D_RELEASE || type == TCMCE_PDU_T_D_DISCONNECT) {
+            kind = ITEM_RELEASE;
+        } else if (l3->chan_alloc && l3->chan_alloc_type != TMAC_ALLOC_T_QUIT_GO && l3->chan_ul_dl != 2 &&
+                   (type == TCMCE_PDU_T_D_SETUP || type == TCMCE_PDU_T_D_CONNECT || type == TCMCE_PDU_T_D_CONNECT_ACK || type == TCMCE_PDU_T_D_TX_GRANTED)) {
+            kind = ITEM_ALLOC;
+        } else {
+            return;
+        }
+        std::lock_guard<std::mutex> lck(queueMtx);
+        Item* item = reserve();
+        if (!item) { return; }
+        item->source = source;
+        item->kind = kind;
+        item->received = std::chrono::steady_clock::now();
+        item->callId = l3->cmce.call_id;
+        item->ssi = l3->ssi;
+        item->slots = l3->chan_timeslot;
+        item->chanHz = l3->chan_dl_hz;
+        item->mainHz = l3->main_dl_hz;
+    }
+
+    std::string CallRecorder::getLastPath() {
+        std::lock_guard<std::mutex> lck(lastMtx);
+        return lastPath;
+    }
+
+    //Also NULL once stopped, the queue is gone then
+    CallRecorder::Item* CallRecorder::reserve() {
+        if (head - tail >= queue.size()) { return NULL; }
+        return &queue[head++ % queue.size()];
+    }
+
+    void CallRecorder::worker() {
+        bool stopping = false;
+        while (!stopping) {
+            stopping = !running;
+            if (!stopping) { std::this_thread::sleep_for(std::chrono::milliseconds(CALL_RECORDER_POLL_MS)); }
+
+            //The records between tail and head are not touched by the decoders until tail moves past them
+            uint64_t end;
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                end = head;
+            }
+            for (uint64_t i = tail; i < end; i++) { process(queue[i % queue.size()]); }
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                tail = end;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            uint64_t openBytes = 0;
+            for (auto& [id, src] : sources) {
+                for (auto& rec : src.slots) {
+                    if (!rec.open) { continue; }
+                    if (stopping || now - rec.last > hang) {
+                        closeRecording(rec);
+                        //Without its D-RELEASE the call is taken to be over as well
+                        rec.named = false;
+                    } else {
+                        openBytes += rec.writer.getBytes();
+                    }
+                }
+            }
+            bytes = closedBytes + openBytes;
+        }
+        sources.clear();
+    }
+
+    void CallRecorder::process(const Item& item) {
+        Source& src = sources[item.source];
+        if (item.kind == ITEM_RELEASE) {
+            for (auto& rec : src.slots) {
+                if (!rec.named || rec.callId != item.callId) { continue; }
+                if (rec.open) { closeRecording(rec); }
+                rec.named = false;
+            }
+            return;
+        }
+        if (item.kind == ITEM_ALLOC) {
+            uint32_t own;
+            {
+                std::lock_guard<std::mutex> lck(sourceMtx);
+                auto it = labels.find(item.source);
+                own = (it != labels.end() && it->second.second) ? it->second.second : item.mainHz;
+            }
+            if (item.chanHz && own && item.chanHz != own) { return; }
+            //Bit 3 is timeslot 1
+            for (int tn = 1; tn <= TETRA_CODEC_TIMESLOTS; tn++) {
+                if (!(item.slots & (1 << (TETRA_CODEC_TIMESLOTS - tn)))) { continue; }
+                Recording& rec = src.slots[tn - 1];
+                if (rec.open && rec.named && rec.callId != item.callId) { closeRecording(rec); }
+                rec.named = true;
+                rec.callId = item.callId;
+                rec.ssi = item.ssi;
+            }
+            return;
+        }
+
+        int tn = item.frame.time.tn;
+        if (tn < 1 || tn > TETRA_CODEC_TIMESLOTS) { return; }
+        Recording& rec = src.slots[tn - 1];
+        if (rec.open && item.received - rec.last > hang) { closeRecording(rec); }
+        if (!rec.open) {
+            openRecording(item.source, tn, src, rec);
+            if (!rec.open) { return; }
+        }
+        int gap = rec.clock.silenceBefore(item.frame);
+        if (gap > 0 && gap <= CALL_RECORDER_MAX_GAP_MS * 8) {
+            static const int16_t silence[TETRA_CODEC_SLOT_SAMPLES] = {};
+            for (; gap > 0; gap -= TETRA_CODEC_SLOT_SAMPLES) { rec.writer.write(silence, std::min<int>(gap, TETRA_CODEC_SLOT_SAMPLES)); }
+        }
+        rec.writer.write(item.frame.samples, TETRA_CODEC_SLOT_SAMPLES);
+        rec.last = item.received;
+    }
+
+    void CallRecorder::openRecording(int source, int tn, Source& src, Recording& rec) {
+        {
+            std::lock_guard<std::mutex> lck(sourceMtx);
+            auto it = labels.find(source);
+            src.label = (it != labels.end()) ? it->second.first : std::to_string(source);
+        }
+        time_t t = time(NULL);
+        struct tm tm;
+#ifdef _WIN32
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &tm);
+        std::string path = _dir + "/" + stamp + "_" + src.label + "_ts" + std::to_string(tn);
+        if (rec.named) { path += "_call" + std::to_string(rec.callId) + "_" + std::to_string(rec.ssi); }
+        path += ".flac";
+        //A file that can't be created is tried again with the next frame
+        if (!rec.writer.open(path)) { return; }
+        rec.open = true;
+        rec.clock.reset();
+        calls++;
+        openCalls++;
+        std::lock_guard<std::mutex> lck(lastMtx);
+        lastPath = path;
+    }
+
+    void CallRecorder::closeRecording(Recording& rec) {
+        rec.writer.close();
+        closedBytes += rec.writer.getBytes();
+        rec.open = false;
+        openCalls--;
+    }
+}
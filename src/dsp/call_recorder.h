@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "osmotetra_dec.h"
+#include "flac_writer.h"
+
+extern "C" {
+    #include "tetra_events.h"
+}
+
+//Frames (60 ms of one timeslot) waiting for the recorder thread before new ones are dropped, 15 s of four timeslots
+#define CALL_RECORDER_QUEUE_FRAMES 1024
+//A recording ends after this long without voice on its timeslot, unless the D-RELEASE of its call came first
+#define CALL_RECORDER_DEFAULT_HANG_MS 5000
+//The thread takes what is queued this often
+#define CALL_RECORDER_POLL_MS 200
+//Gaps inside a recording up to this long are kept as silence, longer ones are cut out
+#define CALL_RECORDER_MAX_GAP_MS 2000
+
+namespace dsp {
+    //Writes the voice of every call to a FLAC file of its own. Fed from the record handler of osmotetradec, which
+    //hands out every timeslot, and from its L3 handler: a call starts with the first voice frame on a timeslot and
+    //ends with the D-RELEASE or D-DISCONNECT of its call identifier, or CALL_RECORDER_DEFAULT_HANG_MS without voice.
+    //A CMCE PDU that allocates timeslots of the carrier names the call on them (call identifier and address), a new
+    //call identifier on a timeslot starts a new file. The decoder threads only copy the frames into a queue, the
+    //calls are told apart, encoded and written by a thread of the recorder in large batches
+    class CallRecorder {
+    public:
+        CallRecorder() {}
+
+        ~CallRecorder();
+
+        //Files go to dir as <time>_<label>_ts<n>[_call<id>_<ssi>].flac. false if dir is not there
+        bool start(const std::string& dir, int hangMs = CALL_RECORDER_DEFAULT_HANG_MS);
+        //Finishes the open recordings
+        void stop();
+        bool isRunning() { return running; }
+
+        //Carriers are told apart by source, label names their files. dlHz is the carrier's downlink, allocations on
+        //other carriers are not taken for it. 0 takes the main carrier of the cell. Any thread
+        void setSource(int source, const std::string& label, uint32_t dlHz = 0);
+
+        //Only copies frames, fits the record handler of osmotetradec. Any thread
+        void pushFrames(int source, const TetraAudioFrame* frames, int count);
+        //Only copies what the recorder needs of a CMCE PDU, all others are left alone. Any thread
+        void handleL3(int source, const struct tetra_l3_event* l3);
+
+        uint64_t getCalls() { return calls; }
+        int getOpen() { return openCalls; }
+        uint64_t getDropped() { return dropped; }
+        uint64_t getBytes() { return bytes; }
+        std::string getLastPath();
+
+    protected:
+        enum ItemKind {
+            ITEM_FRAME,
+            ITEM_ALLOC,
+            ITEM_RELEASE
+        };
+
+        struct Item {
+            int source;
+            int kind;
+            std::chrono::steady_clock::time_point received;
+            //ITEM_ALLOC and ITEM_RELEASE
+            uint16_t callId;
+            uint32_t ssi;
+            uint8_t slots;
+            uint32_t chanHz;
+            uint32_t mainHz;
+            TetraAudioFrame frame;
+        };
+
+        struct Recording {
+            //Of the last allocation of the timeslot
+            bool named = false;
+            uint16_t callId = 0;
+            uint32_t ssi = 0;
+            bool open = false;
+            FlacWriter writer;
+            AudioFrameClock clock;
+            std::chrono::steady_clock::time_point last;
+        };
+
+        struct Source {
+            std::string label;
+            Recording slots[TETRA_CODEC_TIMESLOTS];
+        };
+
+        void worker();
+        //Called locked, NULL if the queue is full
+        Item* reserve();
+        void process(const Item& item);
+        void openRecording(int source, int tn, Source& src, Recording& rec);
+        void closeRecording(Recording& rec);
+
+        std::string _dir;
+        std::chrono::milliseconds hang = std::chrono::milliseconds(CALL_RECORDER_DEFAULT_HANG_MS);
+
+        //Filled by the decoders from head, taken by the thread from tail
+        std::mutex queueMtx;
+        std::vector<Item> queue;
+        uint64_t head = 0;
+        uint64_t tail = 0;
+
+        //Labels and carriers, set by the caller
+        std::mutex sourceMtx;
+        std::map<int, std::pair<std::string, uint32_t>> labels;
+        //Only the thread's
+        std::map<int, Source> sources;
+        uint64_t closedBytes = 0;
+
+        std::mutex lastMtx;
+        std::string lastPath;
+
+        std::thread workerThread;
+        std::atomic<bool> running = false;
+        std::atomic<uint64_t> calls = 0;
+        std::atomic<int> openCalls = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<uint64_t> bytes = 0;
+    };
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <dsp/sink.h>
+
+#include <functional>
+
+#include "thread_tuning.h"
+
+namespace dsp {
+    //Sink that runs a whole chain from its handler: the blocks of the chain are never started, the handler calls
+    //their process() one after the other on the output buffer of the one before. One thread instead of one per block
+    template <class T>
+    class ChainSink : public Sink<T> {
+        using base_type = Sink<T>;
+    public:
+        ChainSink() {}
+
+        ChainSink(stream<T>* in, void (*handler)(T* data, int count, void* ctx), void* ctx) { init(in, handler, ctx); }
+
+        void init(stream<T>* in, void (*handler)(T* data, int count, void* ctx), void* ctx) {
+            _handler = handler;
+            _ctx = ctx;
+            base_type::init(in);
+        }
+
+        //Runs change between two calls of the handler, as the setters of a block do while it runs
+        void reconfigure(const std::function<void()>& change) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            change();
+            base_type::tempStart();
+        }
+
+        //Pins the thread as tuning says, each time the block starts. tuning is the caller's and has to outlive the
+        //block, NULL leaves the thread alone
+        void setThreadTuning(const ThreadTuning* tuning) { threadTuning = tuning; }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+            _handler(base_type::_in->readBuf, count, _ctx);
+            base_type::_in->flush();
+            return count;
+        }
+
+    protected:
+        void doStart() override {
+            base_type::doStart();
+            if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+        }
+
+        const ThreadTuning* threadTuning = NULL;
+        void (*_handler)(T* data, int count, void* ctx) = NULL;
+        void* _ctx = NULL;
+    };
+}
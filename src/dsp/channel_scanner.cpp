@@ -0,0 +1,115 @@
+#include "channel_scanner.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace dsp {
+    void ChannelScanner::init(const std::vector<uint32_t>& hz, int channelCount, int spacing, int dwellMs, int rejectMs) {
+        std::vector<uint32_t> sorted = hz;
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        channels.clear();
+        for (uint32_t f : sorted) {
+            Channel ch;
+            ch.hz = f;
+            channels.push_back(ch);
+        }
+        window.clear();
+        _channelCount = channelCount;
+        _spacing = spacing;
+        _dwellMs = dwellMs;
+        _rejectMs = std::min<int>(rejectMs, dwellMs);
+        center = 0.0;
+        scanned = 0;
+        cells = 0;
+        windows = 0;
+    }
+
+    std::vector<uint32_t> ChannelScanner::bandChannels(int band, int first, int last, int offset) {
+        std::vector<uint32_t> hz;
+        first = std::clamp<int>(first, 0, 4095);
+        last = std::clamp<int>(last, 0, 4095);
+        if (first > last) { std::swap(first, last); }
+        for (int c = first; c <= last; c++) {
+            hz.push_back(tetra_dl_carrier_hz(band, c, offset));
+        }
+        return hz;
+    }
+
+    bool ChannelScanner::nextWindow() {
+        for (int i : window) {
+            if (channels[i].state == SCAN_ACTIVE) { resolve(channels[i], _dwellMs); }
+        }
+        window.clear();
+
+        int lowBin = -(_channelCount / 2) + 1;
+        int highBin = _channelCount - (_channelCount / 2) - 1;
+        //The lowest carrier left goes to the lowest bin, the ones above it that fall close enough to
+        //a bin come along. Those in between two bins, off the grid of this one, wait for a window of their own
+        for (int i = 0; i < (int)channels.size(); i++) {
+            Channel& ch = channels[i];
+            if (ch.state != SCAN_PENDING) { continue; }
+            if (window.empty()) { center = (double)ch.hz - (double)lowBin * _spacing; }
+            double pos = ((double)ch.hz - center) / _spacing;
+            int bin = (int)round(pos);
+            if (bin > highBin) { break; }
+            if (fabs(pos - bin) * _spacing > _spacing / 4) { continue; }
+            ch.bin = bin;
+            ch.state = SCAN_ACTIVE;
+            window.push_back(i);
+        }
+        if (window.empty()) { return false; }
+        windows++;
+        return true;
+    }
+
+    void ChannelScanner::observe(int i, const Observation& obs, int ms) {
+        Channel& ch = channels[i];
+        if (ch.state != SCAN_ACTIVE) { return; }
+        ch.locked |= obs.locked;
+        ch.cell = obs.cell;
+        ch.offset = obs.offset;
+        if (ch.cell.syncs && ch.cell.sysinfos) { resolve(ch, ms); }
+    }
+
+    bool ChannelScanner::windowDone(int ms) {
+        bool done = true;
+        for (int i : window) {
+            Channel& ch = channels[i];
+            if (ch.state != SCAN_ACTIVE) { continue; }
+            if (ms >= _dwellMs || (ms >= _rejectMs && !ch.locked)) {
+                resolve(ch, ms);
+                continue;
+            }
+            done = false;
+        }
+        return done;
+    }
+
+    void ChannelScanner::resolve(Channel& ch, int ms) {
+        if (ch.cell.syncs && ch.cell.sysinfos) {
+            ch.state = SCAN_CELL;
+            cells++;
+        } else {
+            ch.state = (ch.locked || ch.cell.syncs) ? SCAN_BURSTS : SCAN_EMPTY;
+        }
+        ch.ms = ms;
+        scanned++;
+    }
+
+    const char* ChannelScanner::stateName(ChannelState state) {
+        switch (state) {
+            case SCAN_PENDING:
+                return "Pending";
+            case SCAN_ACTIVE:
+                return "Scanning";
+            case SCAN_CELL:
+                return "Cell";
+            case SCAN_BURSTS:
+                return "Bursts";
+            default:
+                return "Empty";
+        }
+    }
+}
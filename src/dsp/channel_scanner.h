@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+#include "osmotetra_dec.h"
+
+//Longest a carrier is listened to. A cell sends SYNC every frame and SYSINFO every multiframe (1 s)
+#define CHANNEL_SCANNER_DEFAULT_DWELL_MS 3000
+//A carrier that has not even shown burst sync by then is given up on before the dwell is over
+#define CHANNEL_SCANNER_DEFAULT_REJECT_MS 1000
+
+namespace dsp {
+    //Survey of a list of carriers with a channelizer: the carriers are taken a window at a time, a window being as
+    //many as fit into the bins of the channelizer, and every carrier of the window gets a chain of its own. A window
+    //is done once each of its carriers brought a SYNC and a SYSINFO, showed no burst sync within the reject time, or
+    //the dwell is over. The scanner only plans and keeps the results, tuning and the chains are up to the caller:
+    //
+    //  while (scanner.nextWindow()) {
+    //      tune bin 0 to getCenter(), start a chain on getChannel(i).bin for every i in getWindow()
+    //      do { observe() every chain } while (!scanner.windowDone(ms since the chains started))
+    //  }
+    //
+    //Time is given by the caller, so recordings can be scanned faster than real time. Not thread safe
+    class ChannelScanner {
+    public:
+        enum ChannelState {
+            SCAN_PENDING,   //waits for its window
+            SCAN_ACTIVE,    //in the current window
+            SCAN_CELL,      //SYNC and SYSINFO decoded
+            SCAN_BURSTS,    //burst sync but not both of them within the dwell
+            SCAN_EMPTY      //no burst sync
+        };
+
+        //One carrier and what was found on it
+        struct Channel {
+            uint32_t hz;
+            ChannelState state = SCAN_PENDING;
+            //Bin in the window it is scanned in
+            int bin = 0;
+            TetraCellInfo cell;
+            //Carrier offset off hz that the chain corrected, in Hz
+            double offset = 0.0;
+            //Time into the dwell it took to resolve
+            int ms = 0;
+            bool locked = false;
+        };
+
+        //State of the chain of a carrier, see observe()
+        struct Observation {
+            //Burst sync found (osmotetradec::getRxState() != 0)
+            bool locked;
+            TetraCellInfo cell;
+            double offset;
+        };
+
+        ChannelScanner() {}
+
+        //Scan hz (duplicates are dropped) over a channelizer of channelCount bins, spacing Hz apart. The outermost bins
+        //are left out, they sit on the edges of the band it gets
+        void init(const std::vector<uint32_t>& hz, int channelCount, int spacing, int dwellMs = CHANNEL_SCANNER_DEFAULT_DWELL_MS, int rejectMs = CHANNEL_SCANNER_DEFAULT_REJECT_MS);
+
+        //Downlink carriers first .. last of a band with the given offset, as the SYSINFO of a cell
+        //gives them (tetra_dl_carrier_hz). Carriers are 0 .. 4095
+        static std::vector<uint32_t> bandChannels(int band, int first, int last, int offset);
+
+        //Move on to the next window, false once every carrier was scanned. Carriers of a window left active
+        //are resolved as if their dwell was over
+        bool nextWindow();
+
+        //Center of the current window, where bin 0 goes
+        double getCenter() { return center; }
+        //Indices into getChannels() of the carriers in the current window
+        const std::vector<int>& getWindow() { return window; }
+
+        //i is from getWindow(), ms the time since its chain started taking samples
+        void observe(int i, const Observation& obs, int ms);
+
+        //Resolve what ran out of time, true once nothing of the window is left active
+        bool windowDone(int ms);
+
+        const std::vector<Channel>& getChannels() { return channels; }
+        Channel& getChannel(int i) { return channels[i]; }
+
+        //Carriers resolved so far, and of them those with a cell
+        int getScanned() { return scanned; }
+        int getCells() { return cells; }
+        int getWindowCount() { return windows; }
+
+        static const char* stateName(ChannelState state);
+
+    protected:
+        void resolve(Channel& ch, int ms);
+
+        std::vector<Channel> channels;
+        std::vector<int> window;
+        int _channelCount = 0;
+        int _spacing = 0;
+        int _dwellMs = CHANNEL_SCANNER_DEFAULT_DWELL_MS;
+        int _rejectMs = CHANNEL_SCANNER_DEFAULT_REJECT_MS;
+        double center = 0.0;
+        int scanned = 0;
+        int cells = 0;
+        int windows = 0;
+    };
+}
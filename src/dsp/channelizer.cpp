@@ -0,0 +1,180 @@
+#include "channelizer.h"
+
+namespace dsp {
+    namespace multirate {
+        PolyphaseChannelizer::~PolyphaseChannelizer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            fftwf_destroy_plan(fftPlan);
+            fftwf_free(fftIn);
+            fftwf_free(fftOut);
+            buffer::free(revTaps);
+            buffer::free(rotTable);
+            buffer::free(work);
+            buffer::free(buffer);
+        }
+
+        void PolyphaseChannelizer::init(stream<complex_t>* in, int channelCount, int decimation, int tapsPerChannel, double cutoff) {
+            assert(channelCount > 0);
+            assert(decimation > 0 && decimation <= channelCount);
+            _channelCount = channelCount;
+            _decimation = decimation;
+            _tapsPerChannel = tapsPerChannel;
+            _cutoff = cutoff;
+            _tapCount = _channelCount * _tapsPerChannel;
+
+            generateTaps();
+            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + _tapCount);
+            bufStart = &buffer[_tapCount - 1];
+            memset(buffer, 0, (_tapCount - 1) * sizeof(complex_t));
+            work = buffer::alloc<complex_t>(_tapCount);
+
+            fftIn = (complex_t*)fftwf_alloc_complex(_channelCount);
+            fftOut = (complex_t*)fftwf_alloc_complex(_channelCount);
+            fftPlan = fftwf_plan_dft_1d(_channelCount, (fftwf_complex*)fftIn, (fftwf_complex*)fftOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+
+            base_type::init(in);
+        }
+
+        void PolyphaseChannelizer::bindChannel(int bin, stream<complex_t>* out) {
+            addChannel(bin, out, NULL);
+        }
+
+        void PolyphaseChannelizer::bindChannel(std::atomic<int>* bin, stream<complex_t>* out) {
+            addChannel(bin->load(), out, bin);
+        }
+
+        void PolyphaseChannelizer::addChannel(int bin, stream<complex_t>* out, std::atomic<int>* binSrc) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (!validBin(bin)) {
+                throw std::runtime_error("[PolyphaseChannelizer] Tried to bind a channel outside of the channelizer bandwidth");
+            }
+            for (const auto& ch : channels) {
+                if (ch.out == out) {
+                    throw std::runtime_error("[PolyphaseChannelizer] Tried to bind stream that is already bound");
+                }
+            }
+            base_type::tempStop();
+            base_type::registerOutput(out);
+            channels.push_back({ (bin + _channelCount) % _channelCount, out, binSrc });
+            base_type::tempStart();
+        }
+
+        void PolyphaseChannelizer::unbindChannel(stream<complex_t>* out) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            for (auto it = channels.begin(); it != channels.end(); it++) {
+                if (it->out != out) { continue; }
+                base_type::tempStop();
+                base_type::unregisterOutput(out);
+                channels.erase(it);
+                base_type::tempStart();
+                return;
+            }
+            throw std::runtime_error("[PolyphaseChannelizer] Tried to unbind stream that isn't bound");
+        }
+
+        void PolyphaseChannelizer::setThreadTuning(const ThreadTuning* tuning) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            threadTuning = tuning;
+            base_type::tempStart();
+        }
+
+        void PolyphaseChannelizer::setOutputHandler(void (*handler)(int count, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _handler = handler;
+            _handlerCtx = ctx;
+            base_type::tempStart();
+        }
+
+        void PolyphaseChannelizer::reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            memset(buffer, 0, (_tapCount - 1) * sizeof(complex_t));
+            offset = 0;
+            rotIndex = 0;
+            base_type::tempStart();
+        }
+
+        int PolyphaseChannelizer::run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = process(count, base_type::_in->readBuf);
+
+            base_type::_in->flush();
+            if (outCount && _handler) {
+                _handler(outCount, _handlerCtx);
+            }
+            else if (outCount) {
+                for (const auto& ch : channels) {
+                    if (!ch.out->swap(outCount)) { return -1; }
+                }
+            }
+            return count;
+        }
+
+        int PolyphaseChannelizer::process(int count, const complex_t* in) {
+            // Copy data to work buffer
+            memcpy(bufStart, in, count * sizeof(complex_t));
+
+            // Pick up the retuned channels, a block always comes from a single bin
+            for (auto& ch : channels) {
+                if (!ch.binSrc) { continue; }
+                int b = ch.binSrc->load(std::memory_order_relaxed);
+                if (validBin(b)) { ch.bin = (b + _channelCount) % _channelCount; }
+            }
+
+            int outCount = 0;
+            while (offset < count) {
+                // Filter the window ending on the current sample, then fold the M-sample branches on top of each other
+                volk_32fc_32f_multiply_32fc((lv_32fc_t*)work, (lv_32fc_t*)&buffer[offset], revTaps, _tapCount);
+                for (int q = 1; q < _tapsPerChannel; q++) {
+                    volk_32f_x2_add_32f((float*)work, (float*)work, (float*)&work[q * _channelCount], _channelCount * 2);
+                }
+
+                // Branch r of the polyphase filter ended up at M-1-r because the taps are stored reversed
+                for (int r = 0; r < _channelCount; r++) {
+                    fftIn[r] = work[_channelCount - 1 - r];
+                }
+                fftwf_execute(fftPlan);
+
+                // Remove the phase ramp left by decimating before mixing down
+                for (const auto& ch : channels) {
+                    ch.out->writeBuf[outCount] = fftOut[ch.bin] * rotTable[(ch.bin * rotIndex) % _channelCount];
+                }
+                outCount++;
+
+                rotIndex = (rotIndex + _decimation) % _channelCount;
+                offset += _decimation;
+            }
+            offset -= count;
+
+            // Update delay buffer
+            memmove(buffer, &buffer[count], (_tapCount - 1) * sizeof(complex_t));
+
+            return outCount;
+        }
+
+        void PolyphaseChannelizer::generateTaps() {
+            dsp::tap<float> proto = dsp::taps::windowedSinc<float>(_tapCount, dsp::math::hzToRads(_cutoff / (double)_channelCount, 1.0), dsp::window::nuttall);
+            revTaps = buffer::alloc<float>(_tapCount);
+            for (int i = 0; i < _tapCount; i++) {
+                revTaps[i] = proto.taps[_tapCount - 1 - i];
+            }
+            taps::free(proto);
+
+            rotTable = buffer::alloc<complex_t>(_channelCount);
+            for (int i = 0; i < _channelCount; i++) {
+                float ph = -2.0f * FL_M_PI * (float)i / (float)_channelCount;
+                rotTable[i] = { cosf(ph), sinf(ph) };
+            }
+        }
+    }
+}
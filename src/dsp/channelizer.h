@@ -0,0 +1,98 @@
+#pragma once
+#include <dsp/sink.h>
+
+#include <atomic>
+#include <vector>
+#include <fftw3.h>
+
+#include <dsp/taps/windowed_sinc.h>
+#include <dsp/window/nuttall.h>
+#include <math.h>
+
+#include "thread_tuning.h"
+
+namespace dsp {
+    namespace multirate {
+        //Polyphase FFT channelizer: splits one wide stream into M equally spaced channels.
+        //Every output channel is the input mixed down by bin*samplerate/M, lowpass filtered and decimated by `decimation`,
+        //so with decimation = M/2 each channel comes out 2x oversampled relative to the channel spacing.
+        class PolyphaseChannelizer : public Sink<complex_t> {
+            using base_type = Sink<complex_t>;
+        public:
+            PolyphaseChannelizer() {}
+
+            PolyphaseChannelizer(stream<complex_t>* in, int channelCount, int decimation, int tapsPerChannel = 32, double cutoff = 0.6) { init(in, channelCount, decimation, tapsPerChannel, cutoff); }
+
+            ~PolyphaseChannelizer();
+
+            //cutoff is relative to the channel spacing (0.5 = exactly half of the spacing)
+            void init(stream<complex_t>* in, int channelCount, int decimation, int tapsPerChannel = 32, double cutoff = 0.6);
+
+            //bin 0 is the center channel, negative bins are below it. Valid range is [-M/2, M/2)
+            void bindChannel(int bin, stream<complex_t>* out);
+            //The bin is read from *bin at the start of every block, so the channel can be retuned from any thread without
+            //stopping the channelizer. Bins outside of the valid range leave the channel where it was
+            void bindChannel(std::atomic<int>* bin, stream<complex_t>* out);
+            void unbindChannel(stream<complex_t>* out);
+
+            //Hand every block of channel output to handler instead of swapping the channel streams. The samples are
+            //in each bound stream's writeBuf and are overwritten by the next block, NULL goes back to swapping
+            void setOutputHandler(void (*handler)(int count, void* ctx), void* ctx);
+
+            //Pins the DSP thread as tuning says, each time the block starts. tuning is the caller's and has to outlive the
+            //block, NULL leaves the thread alone
+            void setThreadTuning(const ThreadTuning* tuning);
+
+            int getChannelCount() { return _channelCount; }
+            int getDecimation() { return _decimation; }
+
+            void reset();
+
+            int run();
+
+            int process(int count, const complex_t* in);
+
+        protected:
+            void doStart() override {
+                base_type::doStart();
+                if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+            }
+
+            struct Channel {
+                int bin;
+                stream<complex_t>* out;
+                std::atomic<int>* binSrc;
+            };
+
+            bool validBin(int bin) { return bin >= -(_channelCount / 2) && bin < _channelCount - (_channelCount / 2); }
+
+            void generateTaps();
+            void addChannel(int bin, stream<complex_t>* out, std::atomic<int>* binSrc);
+
+            int _channelCount;
+            int _decimation;
+            int _tapsPerChannel;
+            double _cutoff;
+            int _tapCount;
+
+            //Prototype filter stored time-reversed, so a window of the delay buffer can be multiplied directly
+            float* revTaps = NULL;
+            complex_t* rotTable = NULL;
+            complex_t* buffer = NULL;
+            complex_t* bufStart = NULL;
+            complex_t* work = NULL;
+            int offset = 0;
+            int rotIndex = 0;
+
+            complex_t* fftIn = NULL;
+            complex_t* fftOut = NULL;
+            fftwf_plan fftPlan = NULL;
+
+            std::vector<Channel> channels;
+
+            void (*_handler)(int count, void* ctx) = NULL;
+            void* _handlerCtx = NULL;
+            const ThreadTuning* threadTuning = NULL;
+        };
+    }
+}
@@ -0,0 +1,553 @@
+#include "cluster.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <utils/net.h>
+
+extern "C" {
+    #include "tetra_mle_pdu.h"
+}
+
+//Poll interval of the accept and receive loops, how long stop() may take
+#define CLUSTER_POLL_MS 200
+#define CLUSTER_RECONNECT_MS 2000
+//A peer that sends a longer line is not speaking the protocol
+#define CLUSTER_MAX_LINE 4096
+
+namespace dsp {
+    //Splits what comes in on sock into lines. false once the connection is gone, the lines before that are still there
+    static bool readLines(net::Socket& sock, std::string& partial, std::vector<std::string>& lines) {
+        uint8_t buf[1024];
+        int n = sock.recv(buf, sizeof(buf), false, CLUSTER_POLL_MS);
+        if (n < 0) { return false; }
+        if (n == 0) { return sock.isOpen(); }
+        partial.append((const char*)buf, n);
+        size_t start = 0;
+        size_t nl;
+        while ((nl = partial.find('\n', start)) != std::string::npos) {
+            size_t end = (nl > start && partial[nl - 1] == '\r') ? nl - 1 : nl;
+            lines.push_back(partial.substr(start, end - start));
+            start = nl + 1;
+        }
+        partial.erase(0, start);
+        return partial.size() <= CLUSTER_MAX_LINE;
+    }
+
+    static std::string formatCell(const ClusterCellState& s) {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "%d %d %d %d %d", s.mcc, s.mnc, s.cc, s.hn, s.cckId);
+        return buf;
+    }
+
+    //The five fields of formatCell() from p on
+    static bool parseCell(const char* p, ClusterCellState& s) {
+        s.valid = sscanf(p, "%d %d %d %d %d", &s.mcc, &s.mnc, &s.cc, &s.hn, &s.cckId) == 5;
+        return s.valid;
+    }
+
+    //Compares in a time that doesn't tell how much of the secret a node got right
+    static bool secretMatches(const std::string& secret, const char* given) {
+        size_t len = strlen(given);
+        unsigned char diff = (len != secret.size());
+        for (size_t i = 0; i < secret.size(); i++) { diff |= secret[i] ^ given[i % std::max<size_t>(len, 1)]; }
+        return !diff;
+    }
+
+    ClusterCoordinator::~ClusterCoordinator() {
+        stop();
+    }
+
+    void ClusterCoordinator::setHandlers(AssignHandler assign, CellHandler cell, L3Handler l3, void* ctx) {
+        assignHandler = assign;
+        cellHandler = cell;
+        l3Handler = l3;
+        handlerCtx = ctx;
+    }
+
+    void ClusterCoordinator::setSecret(const std::string& s) {
+        std::lock_guard<std::mutex> lck(mtx);
+        secret = s;
+    }
+
+    bool ClusterCoordinator::start(const std::string& host, int port) {
+        std::lock_guard<std::mutex> lck(serverMtx);
+        if (running) { return true; }
+        try {
+            listener = net::listen(host, port);
+        } catch (std::runtime_error& e) {
+            listener.reset();
+            return false;
+        }
+        if (!listener) { return false; }
+        moves = 0;
+        running = true;
+        workerThread = std::thread(&ClusterCoordinator::worker, this);
+        return true;
+    }
+
+    void ClusterCoordinator::stop() {
+        std::lock_guard<std::mutex> lck(serverMtx);
+        if (!running) { return; }
+        running = false;
+        listener->stop();
+        if (workerThread.joinable()) { workerThread.join(); }
+        listener.reset();
+
+        std::vector<Notice> notices;
+        std::vector<std::shared_ptr<Node>> gone;
+        {
+            std::lock_guard<std::mutex> lck2(mtx);
+            for (auto& w : works) {
+                if (!w.node) { continue; }
+                unplace(w, true);
+                notices.push_back({ w.id, "", 0 });
+            }
+            gone.swap(nodes);
+        }
+        for (const auto& n : notices) {
+            if (assignHandler) { assignHandler(n.work, n.host, n.port, handlerCtx); }
+        }
+        for (auto& node : gone) {
+            node->dead = true;
+            if (node->thread.joinable()) { node->thread.join(); }
+            node->sock->close();
+        }
+    }
+
+    void ClusterCoordinator::addWork(int work, const std::string& label, int cellSource) {
+        std::lock_guard<std::mutex> lck(mtx);
+        //The label is the last field of ASSIGN, it can't have spaces
+        std::string l = label;
+        std::replace(l.begin(), l.end(), ' ', '_');
+        Work* w = findWork(work);
+        if (w) {
+            w->label = l;
+            w->source = cellSource;
+            return;
+        }
+        Work nw;
+        nw.id = work;
+        nw.label = l;
+        nw.source = cellSource;
+        works.push_back(nw);
+    }
+
+    void ClusterCoordinator::removeWork(int work) {
+        std::lock_guard<std::mutex> lck(mtx);
+        for (auto it = works.begin(); it != works.end(); it++) {
+            if (it->id != work) { continue; }
+            if (it->node) { unplace(*it, true); }
+            works.erase(it);
+            return;
+        }
+    }
+
+    std::vector<ClusterCoordinator::NodeInfo> ClusterCoordinator::getNodes() {
+        std::lock_guard<std::mutex> lck(mtx);
+        std::vector<NodeInfo> infos;
+        for (const auto& node : nodes) {
+            if (!node->hello || node->dead) { continue; }
+            NodeInfo info;
+            info.name = node->name;
+            info.host = node->host;
+            info.chains = node->chainWork.size();
+            info.used = std::count_if(node->chainWork.begin(), node->chainWork.end(), [](int w) { return w != CLUSTER_NO_WORK; });
+            info.cores = node->cores;
+            info.busy = node->busy;
+            infos.push_back(info);
+        }
+        return infos;
+    }
+
+    int ClusterCoordinator::getRemoteWork() {
+        std::lock_guard<std::mutex> lck(mtx);
+        return std::count_if(works.begin(), works.end(), [](const Work& w) { return (bool)w.node; });
+    }
+
+    void ClusterCoordinator::worker() {
+        while (running) {
+            std::shared_ptr<net::Socket> client;
+            net::Address addr;
+            try {
+                client = listener->accept(&addr, CLUSTER_POLL_MS);
+            } catch (std::runtime_error& e) {
+                client.reset();
+            }
+            if (client) {
+                std::shared_ptr<Node> node = std::make_shared<Node>();
+                node->sock = client;
+                node->host = addr.getIPStr();
+                //Until its HELLO, which has to come within the timeout
+                node->lastReport = std::chrono::steady_clock::now();
+                node->thread = std::thread(&ClusterCoordinator::nodeWorker, this, node);
+                std::lock_guard<std::mutex> lck(mtx);
+                nodes.push_back(node);
+            }
+
+            //The handlers are called unlocked, they may well call back
+            std::vector<Notice> notices;
+            std::vector<std::shared_ptr<Node>> gone;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                tick(notices, gone);
+            }
+            for (const auto& n : notices) {
+                if (assignHandler) { assignHandler(n.work, n.host, n.port, handlerCtx); }
+            }
+            for (auto& node : gone) {
+                if (node->thread.joinable()) { node->thread.join(); }
+                node->sock->close();
+            }
+        }
+    }
+
+    void ClusterCoordinator::nodeWorker(std::shared_ptr<Node> node) {
+        std::string partial;
+        std::vector<std::string> lines;
+        while (running && !node->dead) {
+            lines.clear();
+            bool open = readLines(*node->sock, partial, lines);
+            for (const auto& line : lines) { handleLine(node, line); }
+            if (!open) { break; }
+        }
+        node->dead = true;
+    }
+
+    void ClusterCoordinator::handleLine(const std::shared_ptr<Node>& node, const std::string& line) {
+        const char* p = line.c_str();
+        if (line.rfind("L3 ", 0) == 0) {
+            int work;
+            unsigned int pdisc, parsed, pduType, callId, alloc, allocType, ulDl, chanHz, mainHz, ssi;
+            if (sscanf(p + 3, "%d %u %u %u %u %u %u %u %u %u %u", &work, &pdisc, &parsed, &pduType, &callId, &alloc, &allocType, &ulDl,
+                       &chanHz, &mainHz, &ssi) != 11) { return; }
+            {
+                //Only from the node the work is on, not one it was just moved off
+                std::lock_guard<std::mutex> lck(mtx);
+                node->lastReport = std::chrono::steady_clock::now();
+                Work* w = findWork(work);
+                if (!w || w->node != node) { return; }
+            }
+            struct tetra_l3_event l3;
+            memset(&l3, 0, sizeof(l3));
+            l3.pdisc = pdisc;
+            l3.parsed = parsed;
+            l3.cmce.pdu_type = pduType;
+            l3.cmce.call_id = callId;
+            l3.chan_alloc = alloc;
+            l3.chan_alloc_type = allocType;
+            l3.chan_ul_dl = ulDl;
+            l3.chan_dl_hz = chanHz;
+            l3.main_dl_hz = mainHz;
+            l3.ssi = ssi;
+            if (l3Handler) { l3Handler(work, &l3, handlerCtx); }
+            return;
+        }
+
+        std::lock_guard<std::mutex> lck(mtx);
+        node->lastReport = std::chrono::steady_clock::now();
+        if (line.rfind("HELLO ", 0) == 0) {
+            char name[64];
+            char given[128] = "";
+            int chains, udpPort, cores;
+            if (node->hello || sscanf(p + 6, "%63s %d %d %d %127s", name, &chains, &udpPort, &cores, given) < 4) { return; }
+            if (chains < 0 || chains > CLUSTER_MAX_CHAINS || udpPort <= 0 || udpPort + chains > 65536) { return; }
+            if (!secret.empty() && !secretMatches(secret, given)) {
+                node->dead = true;
+                return;
+            }
+            node->name = name;
+            node->chainWork.assign(chains, CLUSTER_NO_WORK);
+            node->udpPort = udpPort;
+            node->cores = std::max<int>(cores, 1);
+            node->hello = true;
+        } else if (line.rfind("LOAD ", 0) == 0) {
+            double busy;
+            if (sscanf(p + 5, "%lf", &busy) != 1) { return; }
+            node->busy = std::max<double>(busy, 0);
+            node->pending = 0;
+            node->overloaded = (node->busy / node->cores > CLUSTER_OVERLOAD) ? node->overloaded + 1 : 0;
+        } else if (line.rfind("STATE ", 0) == 0) {
+            int chain, work, n;
+            if (sscanf(p + 6, "%d %d %n", &chain, &work, &n) != 2) { return; }
+            Work* w = findWork(work);
+            if (!w || w->node != node || w->chain != chain) { return; }
+            ClusterCellState s;
+            if (parseCell(p + 6 + n, s)) { w->reported = s; }
+        }
+    }
+
+    void ClusterCoordinator::tick(std::vector<Notice>& notices, std::vector<std::shared_ptr<Node>>& gone) {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = nodes.begin(); it != nodes.end();) {
+            std::shared_ptr<Node> node = *it;
+            if (now - node->lastReport > std::chrono::milliseconds(CLUSTER_NODE_TIMEOUT_MS)) { node->dead = true; }
+            if (!node->dead) {
+                it++;
+                continue;
+            }
+            it = nodes.erase(it);
+            gone.push_back(node);
+            for (auto& w : works) {
+                if (w.node != node) { continue; }
+                unplace(w, false);
+                if (!place(w, notices)) { notices.push_back({ w.id, "", 0 }); }
+            }
+        }
+
+        for (auto& w : works) {
+            if (!w.node) {
+                place(w, notices);
+                continue;
+            }
+            //A traffic channel follows the cell state of its control carrier
+            if (w.source == CLUSTER_NO_WORK) { continue; }
+            ClusterCellState s = stateOf(w);
+            if (s.valid && s != w.sent) { sendCell(w, s); }
+        }
+        rebalance(notices);
+    }
+
+    std::shared_ptr<ClusterCoordinator::Node> ClusterCoordinator::findNode(const std::shared_ptr<Node>& except, double maxLoad) {
+        std::shared_ptr<Node> best;
+        double bestLoad = 0;
+        for (auto& node : nodes) {
+            if (node->dead || !node->hello || node == except) { continue; }
+            if (std::find(node->chainWork.begin(), node->chainWork.end(), CLUSTER_NO_WORK) == node->chainWork.end()) { continue; }
+            double load = (node->busy + node->pending + costOf(*node)) / node->cores;
+            if (load > maxLoad || (best && load >= bestLoad)) { continue; }
+            best = node;
+            bestLoad = load;
+        }
+        return best;
+    }
+
+    bool ClusterCoordinator::place(Work& w, std::vector<Notice>& notices) {
+        std::shared_ptr<Node> node = findNode(NULL, CLUSTER_OVERLOAD);
+        if (!node) { return false; }
+        assign(w, node, notices);
+        return true;
+    }
+
+    void ClusterCoordinator::assign(Work& w, const std::shared_ptr<Node>& node, std::vector<Notice>& notices) {
+        //Before it is placed, while stateOf() still looks at where it was decoded so far
+        ClusterCellState s = stateOf(w);
+        int chain = std::find(node->chainWork.begin(), node->chainWork.end(), CLUSTER_NO_WORK) - node->chainWork.begin();
+        node->pending += costOf(*node);
+        node->chainWork[chain] = w.id;
+        w.node = node;
+        w.chain = chain;
+        w.sent = ClusterCellState();
+        send(node, "ASSIGN " + std::to_string(chain) + " " + std::to_string(w.id) + " " + w.label);
+        if (s.valid) { sendCell(w, s); }
+        notices.push_back({ w.id, node->host, node->udpPort + chain });
+    }
+
+    void ClusterCoordinator::unplace(Work& w, bool tell) {
+        if (!w.node) { return; }
+        if (tell) { send(w.node, "RELEASE " + std::to_string(w.chain)); }
+        if (w.chain >= 0 && w.chain < (int)w.node->chainWork.size()) { w.node->chainWork[w.chain] = CLUSTER_NO_WORK; }
+        w.node.reset();
+        w.chain = -1;
+        w.sent = ClusterCellState();
+    }
+
+    void ClusterCoordinator::rebalance(std::vector<Notice>& notices) {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nodes.size(); i++) {
+            std::shared_ptr<Node> from = nodes[i];
+            if (from->dead || !from->hello || from->overloaded < 2 || now < from->holdoff) { continue; }
+            //The last one placed there, the others have been running on it longer
+            Work* w = NULL;
+            for (int c = from->chainWork.size() - 1; c >= 0 && !w; c--) {
+                if (from->chainWork[c] != CLUSTER_NO_WORK) { w = findWork(from->chainWork[c]); }
+            }
+            if (!w) { continue; }
+            //Only where it leaves room, otherwise it stays and the next try waits as long as after a move
+            from->holdoff = now + std::chrono::milliseconds(CLUSTER_MOVE_HOLDOFF_MS);
+            std::shared_ptr<Node> to = findNode(from, CLUSTER_TARGET_LOAD);
+            if (!to) { continue; }
+            double cost = costOf(*from);
+            unplace(*w, true);
+            assign(*w, to, notices);
+            from->busy = std::max<double>(from->busy - cost, 0);
+            from->overloaded = 0;
+            to->holdoff = from->holdoff;
+            moves++;
+        }
+    }
+
+    ClusterCellState ClusterCoordinator::stateOf(const Work& w) {
+        int id = (w.source != CLUSTER_NO_WORK) ? w.source : w.id;
+        Work* src = findWork(id);
+        //What the node decoding it reported, what the local decoder knows, or what was last known
+        if (src && src->node) { return src->reported; }
+        ClusterCellState s;
+        if (cellHandler && cellHandler(id, s, handlerCtx)) {
+            s.valid = true;
+            return s;
+        }
+        return src ? src->reported : ClusterCellState();
+    }
+
+    void ClusterCoordinator::sendCell(Work& w, const ClusterCellState& state) {
+        send(w.node, "CELL " + std::to_string(w.chain) + " " + formatCell(state));
+        w.sent = state;
+    }
+
+    void ClusterCoordinator::send(const std::shared_ptr<Node>& node, const std::string& line) {
+        std::lock_guard<std::mutex> lck(node->sendMtx);
+        if (node->sock->isOpen()) { node->sock->sendstr(line + "\n"); }
+    }
+
+    double ClusterCoordinator::costOf(const Node& node) {
+        int used = std::count_if(node.chainWork.begin(), node.chainWork.end(), [](int w) { return w != CLUSTER_NO_WORK; });
+        return (used > 0 && node.busy > 0) ? node.busy / used : CLUSTER_DEFAULT_WORK_COST;
+    }
+
+    ClusterCoordinator::Work* ClusterCoordinator::findWork(int id) {
+        for (auto& w : works) {
+            if (w.id == id) { return &w; }
+        }
+        return NULL;
+    }
+
+    ClusterNode::~ClusterNode() {
+        stop();
+    }
+
+    void ClusterNode::setHandlers(AssignHandler assign, CellHandler cell, void* ctx) {
+        assignHandler = assign;
+        cellHandler = cell;
+        handlerCtx = ctx;
+    }
+
+    void ClusterNode::start(const std::string& host, int port, const std::string& name, int chains, int udpPort, int cores,
+                            const std::string& secret) {
+        if (running) { return; }
+        _host = host;
+        _port = port;
+        _secret = secret;
+        //The name is a field of HELLO
+        _name = name.empty() ? std::string("node") : name;
+        std::replace(_name.begin(), _name.end(), ' ', '_');
+        _chains = chains;
+        _udpPort = udpPort;
+        _cores = std::max<int>(cores, 1);
+        reported.assign(chains, ClusterCellState());
+        assigned.assign(chains, CLUSTER_NO_WORK);
+        running = true;
+        workerThread = std::thread(&ClusterNode::worker, this);
+    }
+
+    void ClusterNode::stop() {
+        if (!running) { return; }
+        running = false;
+        if (workerThread.joinable()) { workerThread.join(); }
+    }
+
+    void ClusterNode::reportState(int chain, int work, const ClusterCellState& state) {
+        std::lock_guard<std::mutex> lck(sendMtx);
+        if (chain < 0 || chain >= (int)reported.size() || !state.valid || state == reported[chain]) { return; }
+        reported[chain] = state;
+        if (sock && sock->isOpen()) { sock->sendstr("STATE " + std::to_string(chain) + " " + std::to_string(work) + " " + formatCell(state) + "\n"); }
+    }
+
+    void ClusterNode::reportL3(int work, const struct tetra_l3_event* l3) {
+        if (l3->pdisc != TMLE_PDISC_CMCE || !l3->parsed) { return; }
+        char buf[160];
+        snprintf(buf, sizeof(buf), "L3 %d %u %u %u %u %u %u %u %u %u %u", work, l3->pdisc, l3->parsed, l3->cmce.pdu_type, l3->cmce.call_id,
+                 l3->chan_alloc, l3->chan_alloc_type, l3->chan_ul_dl, l3->chan_dl_hz, l3->main_dl_hz, l3->ssi);
+        sendLine(buf);
+    }
+
+    void ClusterNode::worker() {
+        while (running) {
+            std::shared_ptr<net::Socket> s;
+            try {
+                s = net::connect(_host, _port);
+            } catch (std::runtime_error& e) {
+                s.reset();
+            }
+            if (!s || !s->isOpen()) {
+                for (int t = 0; t < CLUSTER_RECONNECT_MS && running; t += CLUSTER_POLL_MS) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(CLUSTER_POLL_MS));
+                }
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lck(sendMtx);
+                sock = s;
+                std::fill(reported.begin(), reported.end(), ClusterCellState());
+            }
+            connected = true;
+            sendLine("HELLO " + _name + " " + std::to_string(_chains) + " " + std::to_string(_udpPort) + " " + std::to_string(_cores) +
+                     (_secret.empty() ? "" : " " + _secret));
+
+            std::string partial;
+            std::vector<std::string> lines;
+            auto lastLoad = std::chrono::steady_clock::now();
+            while (running) {
+                lines.clear();
+                bool open = readLines(*s, partial, lines);
+                for (const auto& line : lines) { handleLine(line); }
+                if (!open) { break; }
+                auto now = std::chrono::steady_clock::now();
+                if (now - lastLoad >= std::chrono::milliseconds(CLUSTER_REPORT_MS)) {
+                    char buf[32];
+                    snprintf(buf, sizeof(buf), "LOAD %.3f", load.load(std::memory_order_relaxed));
+                    sendLine(buf);
+                    lastLoad = now;
+                }
+            }
+
+            connected = false;
+            {
+                std::lock_guard<std::mutex> lck(sendMtx);
+                sock.reset();
+            }
+            s->close();
+            //The coordinator gives the work to others meanwhile
+            releaseAll();
+        }
+    }
+
+    void ClusterNode::handleLine(const std::string& line) {
+        const char* p = line.c_str();
+        if (line.rfind("ASSIGN ", 0) == 0) {
+            int chain, work, n;
+            if (sscanf(p + 7, "%d %d %n", &chain, &work, &n) != 2 || chain < 0 || chain >= _chains) { return; }
+            {
+                std::lock_guard<std::mutex> lck(sendMtx);
+                reported[chain] = ClusterCellState();
+            }
+            assigned[chain] = work;
+            if (assignHandler) { assignHandler(chain, work, std::string(p + 7 + n), handlerCtx); }
+        } else if (line.rfind("RELEASE ", 0) == 0) {
+            int chain = atoi(p + 8);
+            if (chain < 0 || chain >= _chains || assigned[chain] == CLUSTER_NO_WORK) { return; }
+            assigned[chain] = CLUSTER_NO_WORK;
+            if (assignHandler) { assignHandler(chain, CLUSTER_NO_WORK, "", handlerCtx); }
+        } else if (line.rfind("CELL ", 0) == 0) {
+            int chain, n;
+            ClusterCellState s;
+            if (sscanf(p + 5, "%d %n", &chain, &n) != 1 || chain < 0 || chain >= _chains || !parseCell(p + 5 + n, s)) { return; }
+            if (cellHandler) { cellHandler(chain, s, handlerCtx); }
+        }
+    }
+
+    void ClusterNode::releaseAll() {
+        for (int c = 0; c < _chains; c++) {
+            if (assigned[c] == CLUSTER_NO_WORK) { continue; }
+            assigned[c] = CLUSTER_NO_WORK;
+            if (assignHandler) { assignHandler(c, CLUSTER_NO_WORK, "", handlerCtx); }
+        }
+    }
+
+    void ClusterNode::sendLine(const std::string& line) {
+        std::lock_guard<std::mutex> lck(sendMtx);
+        if (sock && sock->isOpen()) { sock->sendstr(line + "\n"); }
+    }
+}
@@ -0,0 +1,251 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "tetra_events.h"
+}
+
+//TCP port of the coordinator
+#define CLUSTER_DEFAULT_PORT 8356
+//First UDP port the chains of a node take the NETSYMS streams on, one port per chain
+#define CLUSTER_DEFAULT_UDP_PORT 8360
+//Chains a node may have, as many as a wideband receiver has carriers. A HELLO with more is not taken
+#define CLUSTER_MAX_CHAINS 1024
+//A node reports its load this often, and is given up on after this long without a word
+#define CLUSTER_REPORT_MS 1000
+#define CLUSTER_NODE_TIMEOUT_MS 5000
+//Load of a node in cores busy per core. Above CLUSTER_OVERLOAD for two reports in a row one carrier is moved off it, to
+//a node it leaves below CLUSTER_TARGET_LOAD. Work is not placed where it would go above CLUSTER_OVERLOAD
+#define CLUSTER_OVERLOAD 0.9
+#define CLUSTER_TARGET_LOAD 0.75
+//After a move, both nodes are left alone until their reports show it
+#define CLUSTER_MOVE_HOLDOFF_MS 10000
+//Cores a carrier is taken to need on a node that has none to go by
+#define CLUSTER_DEFAULT_WORK_COST 0.25
+#define CLUSTER_NO_WORK -1
+
+namespace net {
+    class Listener;
+    class Socket;
+}
+
+namespace dsp {
+    //What is known of the cell a carrier belongs to, see osmotetradec::presetCell
+    struct ClusterCellState {
+        bool valid = false;
+        int mcc = 0;
+        int mnc = 0;
+        int cc = 0;
+        int hn = -1;
+        int cckId = -1;
+
+        bool operator==(const ClusterCellState& b) const {
+            return valid == b.valid && mcc == b.mcc && mnc == b.mnc && cc == b.cc && hn == b.hn && cckId == b.cckId;
+        }
+        bool operator!=(const ClusterCellState& b) const { return !(*this == b); }
+    };
+
+    //The line protocol between the coordinator and the decode nodes, one command per line, fields separated by
+    //spaces. Node to coordinator:
+    //  HELLO <name> <chains> <udp port> <cores> [<secret>]
+    //                                                 chains decoders, the first on udp port, the rest on the ports after it.
+    //                                                 secret is the one of the coordinator, if it has one
+    //  LOAD <busy>                                    cores kept busy by the chains over the last CLUSTER_REPORT_MS
+    //  STATE <chain> <work> <mcc> <mnc> <cc> <hn> <cck id>     the cell the chain decodes, when it changes
+    //  L3 <work> <pdisc> <parsed> <cmce pdu type> <call id> <chan alloc> <alloc type> <ul dl> <chan dl hz> <main dl hz> <ssi>
+    //                                                 the CMCE headers the channel following goes by, see TrafficScheduler
+    //Coordinator to node:
+    //  ASSIGN <chain> <work> <label>                  a NETSYMS stream of work comes to the chain from now on
+    //  RELEASE <chain>
+    //  CELL <chain> <mcc> <mnc> <cc> <hn> <cck id>    what the coordinator knows of the cell of the chain's work
+
+    //Spreads the carriers of a wideband receiver over decode nodes (tetra_cli -N). Every carrier, fixed or a followed
+    //traffic channel, is a piece of work with an id of the caller's. The coordinator places it on the node with the
+    //most cores to spare, by the load the nodes measure on their chains, and moves work off a node that stays
+    //overloaded. Work that finds no node is decoded locally. The assign handler tells where the symbols of a work have
+    //to go, the caller streams them there. A node that goes silent has its work placed elsewhere.
+    //The nodes are kept in sync with the cells: a work that starts on a node is preset with the cell state last known
+    //for it, a traffic channel is kept at that of its control carrier. The CMCE headers the nodes decode come back
+    //through the L3 handler, so control carriers can run on nodes as well.
+    //The protocol is in the clear, the secret as well. It keeps out nodes set up for another coordinator, not anyone
+    //who can see the traffic. No keys go over it, every node decrypts with a keystore of its own
+    class ClusterCoordinator {
+    public:
+        //host empty: decode work locally. port is the UDP port of the chain on host
+        typedef void (*AssignHandler)(int work, const std::string& host, int port, void* ctx);
+        //Cell state of a work decoded locally, false if there is none. Called with the coordinator locked, must not
+        //call back into it
+        typedef bool (*CellHandler)(int work, ClusterCellState& state, void* ctx);
+        typedef void (*L3Handler)(int work, const struct tetra_l3_event* l3, void* ctx);
+
+        struct NodeInfo {
+            std::string name;
+            std::string host;
+            int chains;
+            int used;
+            int cores;
+            double busy;
+        };
+
+        ClusterCoordinator() {}
+
+        ~ClusterCoordinator();
+
+        //Before start(). The handlers are called on the coordinator's threads
+        void setHandlers(AssignHandler assign, CellHandler cell, L3Handler l3, void* ctx);
+
+        //Taken by the nodes that join from now on, empty for none. No spaces
+        void setSecret(const std::string& secret);
+
+        //false if the port can't be listened on
+        bool start(const std::string& host, int port = CLUSTER_DEFAULT_PORT);
+        //Every work is handed back to be decoded locally
+        void stop();
+        bool isRunning() { return running; }
+
+        //cellSource is the work whose cell state goes to work's node, CLUSTER_NO_WORK for its own. Adding a work
+        //that is there updates its label and source. Any thread
+        void addWork(int work, const std::string& label, int cellSource = CLUSTER_NO_WORK);
+        //The work is decoded locally again, without the assign handler being called
+        void removeWork(int work);
+
+        std::vector<NodeInfo> getNodes();
+        //Works on nodes, and moves off overloaded ones since start()
+        int getRemoteWork();
+        uint64_t getMoves() { return moves; }
+
+    protected:
+        struct Node {
+            std::shared_ptr<net::Socket> sock;
+            std::thread thread;
+            std::mutex sendMtx;
+            std::atomic<bool> dead = false;
+            bool hello = false;
+            std::string name;
+            std::string host;
+            int udpPort = 0;
+            int cores = 1;
+            double busy = 0;
+            //Cost of what was placed on it since its last report
+            double pending = 0;
+            int overloaded = 0;
+            std::vector<int> chainWork;
+            std::chrono::steady_clock::time_point lastReport;
+            std::chrono::steady_clock::time_point holdoff;
+        };
+
+        struct Work {
+            int id;
+            std::string label;
+            int source;
+            std::shared_ptr<Node> node;
+            int chain = -1;
+            //Reported by its node, and sent to it
+            ClusterCellState reported;
+            ClusterCellState sent;
+        };
+
+        struct Notice {
+            int work;
+            std::string host;
+            int port;
+        };
+
+        void worker();
+        void nodeWorker(std::shared_ptr<Node> node);
+        void handleLine(const std::shared_ptr<Node>& node, const std::string& line);
+        void tick(std::vector<Notice>& notices, std::vector<std::shared_ptr<Node>>& gone);
+        //The node with a free chain and the lowest load it would have with one more work, if not above maxLoad
+        std::shared_ptr<Node> findNode(const std::shared_ptr<Node>& except, double maxLoad);
+        bool place(Work& w, std::vector<Notice>& notices);
+        void assign(Work& w, const std::shared_ptr<Node>& node, std::vector<Notice>& notices);
+        void unplace(Work& w, bool tell);
+        void rebalance(std::vector<Notice>& notices);
+        ClusterCellState stateOf(const Work& w);
+        void sendCell(Work& w, const ClusterCellState& state);
+        static void send(const std::shared_ptr<Node>& node, const std::string& line);
+        static double costOf(const Node& node);
+        Work* findWork(int id);
+
+        std::mutex mtx;
+        std::vector<std::shared_ptr<Node>> nodes;
+        std::vector<Work> works;
+        std::string secret;
+
+        AssignHandler assignHandler = NULL;
+        CellHandler cellHandler = NULL;
+        L3Handler l3Handler = NULL;
+        void* handlerCtx = NULL;
+
+        std::mutex serverMtx;
+        std::shared_ptr<net::Listener> listener;
+        std::thread workerThread;
+        std::atomic<bool> running = false;
+        std::atomic<uint64_t> moves = 0;
+    };
+
+    //The decode node end: joins a coordinator, reports the load of its chains and tells the caller what to decode.
+    //Reconnects in the background while the coordinator is away, every chain is released then
+    class ClusterNode {
+    public:
+        //work CLUSTER_NO_WORK releases the chain
+        typedef void (*AssignHandler)(int chain, int work, const std::string& label, void* ctx);
+        typedef void (*CellHandler)(int chain, const ClusterCellState& state, void* ctx);
+
+        ClusterNode() {}
+
+        ~ClusterNode();
+
+        //Before start(). The handlers are called on the node's thread
+        void setHandlers(AssignHandler assign, CellHandler cell, void* ctx);
+
+        //chains decoders taking their streams on udpPort and the ports after it. secret is the one of the
+        //coordinator, empty if it has none
+        void start(const std::string& host, int port, const std::string& name, int chains, int udpPort, int cores,
+                   const std::string& secret = "");
+        void stop();
+        bool isConnected() { return connected; }
+
+        //Cores kept busy by the chains, sent with the next report. Any thread
+        void setLoad(double busy) { load.store(busy, std::memory_order_relaxed); }
+        //The cell of the work the chain decodes, sent if it changed. Any thread
+        void reportState(int chain, int work, const ClusterCellState& state);
+        //A CMCE header decoded from work, those of other protocols are left out. Any thread
+        void reportL3(int work, const struct tetra_l3_event* l3);
+
+    protected:
+        void worker();
+        void handleLine(const std::string& line);
+        void releaseAll();
+        void sendLine(const std::string& line);
+
+        std::string _host;
+        int _port = CLUSTER_DEFAULT_PORT;
+        std::string _name;
+        int _chains = 0;
+        int _udpPort = CLUSTER_DEFAULT_UDP_PORT;
+        int _cores = 1;
+        std::string _secret;
+
+        AssignHandler assignHandler = NULL;
+        CellHandler cellHandler = NULL;
+        void* handlerCtx = NULL;
+
+        std::mutex sendMtx;
+        std::shared_ptr<net::Socket> sock;
+        std::vector<ClusterCellState> reported;
+        std::vector<int> assigned;
+        std::atomic<double> load = 0;
+        std::atomic<bool> connected = false;
+        std::atomic<bool> running = false;
+        std::thread workerThread;
+    };
+}
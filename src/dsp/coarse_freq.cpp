@@ -0,0 +1,182 @@
+#include "coarse_freq.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+//Bins summed into one band for matching the RRC shape, the match only has to be good to symbolrate/8
+#define COARSE_FREQ_BAND_BINS 8
+
+namespace dsp {
+    //Vertex of the parabola through y[-1], y[0], y[1], relative to y[0]
+    static inline float parabolicPeak(float ym1, float y0, float yp1) {
+        float d = ym1 - 2.0f * y0 + yp1;
+        return (d < 0.0f) ? std::clamp<float>(0.5f * (ym1 - yp1) / d, -0.5f, 0.5f) : 0.0f;
+    }
+
+    //Center frequency of bin k of an n point FFT, the upper half being the negative frequencies
+    static inline double binFrequency(double k, int n, double samplerate) {
+        return ((k >= n / 2) ? k - n : k) * samplerate / n;
+    }
+
+    CoarseFreqEstimator::~CoarseFreqEstimator() {
+        if (fftPlan) { fftwf_destroy_plan(fftPlan); }
+        fftwf_free(fftIn);
+        fftwf_free(fftOut);
+        delete[] segBuf;
+        delete[] window;
+        delete[] power;
+        delete[] power4;
+        delete[] shape;
+        delete[] work;
+    }
+
+    void CoarseFreqEstimator::init(double symbolrate, double samplerate, double rolloff, int fftSize, int segments) {
+        _symbolrate = symbolrate;
+        _samplerate = samplerate;
+        _rolloff = rolloff;
+        _fftSize = fftSize;
+        _segments = std::max<int>(segments, 1);
+
+        segBuf = new complex_t[_fftSize];
+        window = new float[_fftSize];
+        power = new float[_fftSize];
+        power4 = new float[_fftSize];
+        shape = new float[_fftSize / COARSE_FREQ_BAND_BINS];
+        work = new float[_fftSize];
+        fftIn = (complex_t*)fftwf_alloc_complex(_fftSize);
+        fftOut = (complex_t*)fftwf_alloc_complex(_fftSize);
+        fftPlan = fftwf_plan_dft_1d(_fftSize, (fftwf_complex*)fftIn, (fftwf_complex*)fftOut, FFTW_FORWARD, FFTW_ESTIMATE);
+
+        //Hann
+        for (int i = 0; i < _fftSize; i++) {
+            window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / _fftSize);
+        }
+        buildTemplate();
+        reset();
+    }
+
+    void CoarseFreqEstimator::setSamplerate(double samplerate) {
+        _samplerate = samplerate;
+        buildTemplate();
+        reset();
+    }
+
+    void CoarseFreqEstimator::reset() {
+        fill = 0;
+        segment = 0;
+        done = false;
+        memset(power, 0, _fftSize * sizeof(float));
+        memset(power4, 0, _fftSize * sizeof(float));
+    }
+
+    void CoarseFreqEstimator::buildTemplate() {
+        //Raised cosine, the power spectrum after the RRC of the transmitter
+        int bands = _fftSize / COARSE_FREQ_BAND_BINS;
+        double flat = _symbolrate * (1.0 - _rolloff) / 2.0;
+        double edge = _symbolrate * (1.0 + _rolloff) / 2.0;
+        for (int b = 0; b < bands; b++) {
+            double f = fabs(binFrequency(b, bands, _samplerate));
+            if (f <= flat) {
+                shape[b] = 1.0f;
+            } else if (f < edge) {
+                shape[b] = 0.5f * (1.0f + cosf((float)(M_PI * (f - flat) / (edge - flat))));
+            } else {
+                shape[b] = 0.0f;
+            }
+        }
+    }
+
+    bool CoarseFreqEstimator::feed(int count, const complex_t* in) {
+        if (done) { return true; }
+        for (int i = 0; i < count;) {
+            int n = std::min<int>(count - i, _fftSize - fill);
+            memcpy(&segBuf[fill], &in[i], n * sizeof(complex_t));
+            fill += n;
+            i += n;
+            if (fill < _fftSize) { break; }
+            accumulate();
+            fill = 0;
+            if (++segment >= _segments) {
+                estimate();
+                done = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CoarseFreqEstimator::accumulate() {
+        for (int i = 0; i < _fftSize; i++) {
+            fftIn[i].re = segBuf[i].re * window[i];
+            fftIn[i].im = segBuf[i].im * window[i];
+        }
+        fftwf_execute(fftPlan);
+        for (int i = 0; i < _fftSize; i++) {
+            power[i] += fftOut[i].re * fftOut[i].re + fftOut[i].im * fftOut[i].im;
+        }
+
+        //x^4 / |x|^2 keeps the fourth power phase at the power of the signal, so the strong samples don't drown the rest
+        for (int i = 0; i < _fftSize; i++) {
+            float re = segBuf[i].re;
+            float im = segBuf[i].im;
+            float mag2 = re * re + im * im;
+            float re2 = re * re - im * im;
+            float im2 = 2.0f * re * im;
+            float scale = window[i] / (mag2 + 1e-20f);
+            fftIn[i].re = (re2 * re2 - im2 * im2) * scale;
+            fftIn[i].im = (2.0f * re2 * im2) * scale;
+        }
+        fftwf_execute(fftPlan);
+        for (int i = 0; i < _fftSize; i++) {
+            power4[i] += fftOut[i].re * fftOut[i].re + fftOut[i].im * fftOut[i].im;
+        }
+    }
+
+    void CoarseFreqEstimator::estimate() {
+        //Where the spectrum matches the RRC shape best, circularly over bands of bins
+        int bands = _fftSize / COARSE_FREQ_BAND_BINS;
+        float* bandPower = work;
+        for (int b = 0; b < bands; b++) {
+            bandPower[b] = 0.0f;
+            for (int j = 0; j < COARSE_FREQ_BAND_BINS; j++) { bandPower[b] += power[b * COARSE_FREQ_BAND_BINS + j]; }
+        }
+        float* match = &bandPower[bands];
+        int best = 0;
+        for (int s = 0; s < bands; s++) {
+            float sum = 0.0f;
+            for (int b = 0; b < bands; b++) { sum += bandPower[(b + s) % bands] * shape[b]; }
+            match[s] = sum;
+            if (sum > match[best]) { best = s; }
+        }
+        float off = parabolicPeak(match[(best + bands - 1) % bands], match[best], match[(best + 1) % bands]);
+        double shapeFreq = binFrequency(best + off + (best + off < 0 ? bands : 0), bands, _samplerate);
+
+        //The lines of the fourth power are a symbolrate apart, both are summed up
+        int lineSpacing = (int)round(_symbolrate * _fftSize / _samplerate);
+        int peak = 0;
+        double total = 0.0;
+        float* lines = work;
+        for (int k = 0; k < _fftSize; k++) {
+            lines[k] = power4[k] + power4[(k + lineSpacing) % _fftSize];
+            total += lines[k];
+            if (lines[k] > lines[peak]) { peak = k; }
+        }
+        peakRatio = (total > 0.0) ? (float)(lines[peak] * _fftSize / total) : 0.0f;
+        off = parabolicPeak(lines[(peak + _fftSize - 1) % _fftSize], lines[peak], lines[(peak + 1) % _fftSize]);
+        double lower = (peak + off) * _samplerate / _fftSize;
+
+        //4f is lower + symbolrate/2 modulo the samplerate. Of the candidates for f take the one closest to the RRC match
+        double step = _samplerate / 4.0;
+        double f = (lower + _symbolrate / 2.0) / 4.0;
+        f += step * round((shapeFreq - f) / step);
+        //With the samplerate at twice the symbolrate the two lines fold onto each other, the peak may be the upper one
+        if (2 * lineSpacing == _fftSize) {
+            double alias = f - _symbolrate / 4.0;
+            alias += step * round((shapeFreq - alias) / step);
+            if (fabs(alias - shapeFreq) < fabs(f - shapeFreq)) { f = alias; }
+        }
+        freq = f;
+    }
+}
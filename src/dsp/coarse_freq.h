@@ -0,0 +1,69 @@
+#pragma once
+#include <dsp/types.h>
+
+#include <fftw3.h>
+
+//Samples per FFT, 57 ms at 36 kHz
+#define COARSE_FREQ_FFT_SIZE 2048
+//FFTs whose power spectra are averaged for one estimate
+#define COARSE_FREQ_SEGMENTS 4
+//Peak to mean power of the fourth power line for an estimate to be trusted, about 10 dB
+#define COARSE_FREQ_MIN_PEAK_RATIO 10.0f
+
+namespace dsp {
+    //One-shot carrier offset estimate of pi/4-DQPSK, good to a few Hz over most of the samplerate in a few thousand
+    //samples, for seeding the FLL. Every symbol turns the carrier by an odd multiple of pi/4, so the fourth power of the
+    //signal turns by pi per symbol: its spectrum has lines at 4*f +- symbolrate/2. Those give f modulo
+    //symbolrate/4, the ambiguity is settled by where the power spectrum of the signal itself matches the RRC shape best
+    class CoarseFreqEstimator {
+    public:
+        CoarseFreqEstimator() {}
+
+        ~CoarseFreqEstimator();
+
+        void init(double symbolrate, double samplerate, double rolloff, int fftSize = COARSE_FREQ_FFT_SIZE, int segments = COARSE_FREQ_SEGMENTS);
+        void setSamplerate(double samplerate);
+
+        //Drops what was collected, the next feed() starts a new estimate
+        void reset();
+
+        //Takes samples until the estimate is done, true once it is. The samples are not changed
+        bool feed(int count, const complex_t* in);
+
+        //Carrier offset in Hz of the last estimate, it is to be mixed down by this
+        double getFrequency() { return freq; }
+        //Peak to mean ratio of the fourth power line, below COARSE_FREQ_MIN_PEAK_RATIO there is no carrier to be trusted
+        float getPeakRatio() { return peakRatio; }
+        bool isValid() { return done && peakRatio >= COARSE_FREQ_MIN_PEAK_RATIO; }
+
+    protected:
+        void buildTemplate();
+        void accumulate();
+        void estimate();
+
+        double _symbolrate = 0;
+        double _samplerate = 0;
+        double _rolloff = 0;
+        int _fftSize = 0;
+        int _segments = 0;
+
+        int fill = 0;
+        int segment = 0;
+        bool done = false;
+        double freq = 0;
+        float peakRatio = 0;
+
+        complex_t* segBuf = NULL;
+        float* window = NULL;
+        //Power spectra summed over the segments, of the signal and of its fourth power
+        float* power = NULL;
+        float* power4 = NULL;
+        //Raised cosine power shape, centered on bin 0
+        float* shape = NULL;
+        float* work = NULL;
+
+        complex_t* fftIn = NULL;
+        complex_t* fftOut = NULL;
+        fftwf_plan fftPlan = NULL;
+    };
+}
@@ -5,11 +5,15 @@ namespace dsp {
         COMPLEX_FD::~COMPLEX_FD() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            dsp::multirate::freePolyphaseBank(interpBank);
             buffer::free(buffer);
         }
 
-        void COMPLEX_FD::init(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps, int interpPhaseCount, int interpTapCount) {
+        COMPLEX_FD::InterpBanks::~InterpBanks() {
+            if (interp.phases) { dsp::multirate::freePolyphaseBank(interp); }
+            if (diff.phases) { dsp::multirate::freePolyphaseBank(diff); }
+        }
+
+        void COMPLEX_FD::init(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps, int interpPhaseCount, int interpTapCount, int maxCount) {
             _omega = omega;
             _outSps = outSps;
             _spsctr = 0;
@@ -18,10 +22,11 @@ namespace dsp {
             _omegaRelLimit = omegaRelLimit;
             _interpPhaseCount = interpPhaseCount;
             _interpTapCount = interpTapCount;
+            _maxCount = std::max<int>(maxCount, 1);
 
             pcl.init(_muGain, _omegaGain, 0.0, 0.0, 1.0, _omega, _omega * (1.0 - omegaRelLimit), _omega * (1.0 + omegaRelLimit));
             generateInterpTaps();
-            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer = buffer::alloc<complex_t>(_maxCount + _interpTapCount);
             bufStart = &buffer[_interpTapCount - 1];
 
             base_type::init(in);
@@ -61,16 +66,17 @@ namespace dsp {
             pcl.setFreqLimits(_omega * (1.0 - _omegaRelLimit), _omega * (1.0 + _omegaRelLimit));
         }
 
-        void COMPLEX_FD::setInterpParams(int interpPhaseCount, int interpTapCount) {
+        void COMPLEX_FD::setInterpParams(int interpPhaseCount, int interpTapCount, InterpMode interpMode) {
             assert(base_type::_block_init);
+            assert(interpMode != INTERP_CUBIC || interpTapCount >= 4);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             _interpPhaseCount = interpPhaseCount;
             _interpTapCount = interpTapCount;
-            dsp::multirate::freePolyphaseBank(interpBank);
+            _interpMode = interpMode;
             buffer::free(buffer);
             generateInterpTaps();
-            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + _interpTapCount);
+            buffer = buffer::alloc<complex_t>(_maxCount + _interpTapCount);
             bufStart = &buffer[_interpTapCount - 1];
             base_type::tempStart();
         }
@@ -87,6 +93,14 @@ namespace dsp {
         }
 
         int COMPLEX_FD::process(int count, const complex_t* in, complex_t* out) {
+            int outCount = 0;
+            for (int i = 0; i < count; i += _maxCount) {
+                outCount += processChunk(std::min<int>(_maxCount, count - i), &in[i], &out[outCount]);
+            }
+            return outCount;
+        }
+
+        int COMPLEX_FD::processChunk(int count, const complex_t* in, complex_t* out) {
             // Copy data to work buffer
             memcpy(bufStart, in, count * sizeof(complex_t));
 
@@ -97,30 +111,29 @@ namespace dsp {
                 complex_t outVal;
                 complex_t dfdt;
 
-                // Calculate new output value
-                int phase = std::clamp<int>(floorf(pcl.phase * (float)_interpPhaseCount), 0, _interpPhaseCount - 1);
-                volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&outVal, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase], _interpTapCount);
+                if (_interpMode == INTERP_CUBIC) {
+                    // Samples at -1, 0, 1, 2 around the point the polyphase bank would interpolate
+                    const complex_t* x = &buffer[offset + (_interpTapCount / 2) - 2];
+                    float mu = pcl.phase;
+                    complex_t c1 = x[2] - (x[0] * (1.0f / 3.0f)) - (x[1] * 0.5f) - (x[3] * (1.0f / 6.0f));
+                    complex_t c2 = ((x[0] + x[2]) * 0.5f) - x[1];
+                    complex_t c3 = ((x[3] - x[0]) * (1.0f / 6.0f)) + ((x[1] - x[2]) * 0.5f);
+                    outVal = (((c3 * mu) + c2) * mu + c1) * mu + x[1];
+                    if (_spsctr == 0) {
+                        // Slope per interpolator phase step, like the polyphase derivative
+                        dfdt = (((c3 * (3.0f * mu)) + (c2 * 2.0f)) * mu + c1) * (1.0f / (float)_interpPhaseCount);
+                    }
+                }
+                else {
+                    int phase = std::clamp<int>(floorf(pcl.phase * (float)_interpPhaseCount), 0, _interpPhaseCount - 1);
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&outVal, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase], _interpTapCount);
+                    if (_spsctr == 0) {
+                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&dfdt, (lv_32fc_t*)&buffer[offset], diffBank.phases[phase], _interpTapCount);
+                    }
+                }
                 out[outCount++] = outVal;
 
                 if(_spsctr == 0) {
-                    // Calculate derivative of the signal
-                    if (phase == 0) {
-                        complex_t fT1;
-                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&fT1, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase+1], _interpTapCount);
-                        dfdt = fT1 - outVal;
-                    }
-                    else if (phase == _interpPhaseCount - 1) {
-                        complex_t fT_1;
-                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&fT_1, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase-1], _interpTapCount);
-                        dfdt = outVal - fT_1;
-                    }
-                    else {
-                        complex_t fT_1;
-                        complex_t fT1;
-                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&fT1, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase+1], _interpTapCount);
-                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&fT_1, (lv_32fc_t*)&buffer[offset], interpBank.phases[phase-1], _interpTapCount);
-                        dfdt = (fT1 - fT_1) * 0.5f;
-                    }
                     // Calculate error
                     // error = ((outVal.re * dfdt.re) + (outVal.im * dfdt.im));
                     error = (((outVal.re > 0 ? 1.0f : -1.0f) * dfdt.re) + ((outVal.im > 0 ? 1.0f : -1.0f) * dfdt.im));
@@ -151,10 +164,27 @@ namespace dsp {
         }
 
         void COMPLEX_FD::generateInterpTaps() {
-            double bw = 0.5 / (double)_interpPhaseCount;
-            dsp::tap<float> lp = dsp::taps::windowedSinc<float>(_interpPhaseCount * _interpTapCount, dsp::math::hzToRads(bw, 1.0), dsp::window::nuttall, _interpPhaseCount);
-            interpBank = dsp::multirate::buildPolyphaseBank<float>(_interpPhaseCount, lp);
-            taps::free(lp);
+            int phaseCount = _interpPhaseCount;
+            int tapCount = _interpTapCount;
+            banks = TapCache::get<InterpBanks>(TapCache::key("fd_interp", { (double)phaseCount, (double)tapCount }), [=](InterpBanks& b) {
+                double bw = 0.5 / (double)phaseCount;
+                dsp::tap<float> lp = dsp::taps::windowedSinc<float>(phaseCount * tapCount, dsp::math::hzToRads(bw, 1.0), dsp::window::nuttall, phaseCount);
+                b.interp = dsp::multirate::buildPolyphaseBank<float>(phaseCount, lp);
+
+                // Central differences of the neighbouring phases, one sided at both ends of the bank
+                b.diff = dsp::multirate::buildPolyphaseBank<float>(phaseCount, lp);
+                for (int p = 0; p < phaseCount; p++) {
+                    int lo = std::max<int>(p - 1, 0);
+                    int hi = std::min<int>(p + 1, phaseCount - 1);
+                    float scale = 1.0f / (float)(hi - lo);
+                    for (int i = 0; i < tapCount; i++) {
+                        b.diff.phases[p][i] = (b.interp.phases[hi][i] - b.interp.phases[lo][i]) * scale;
+                    }
+                }
+                taps::free(lp);
+            });
+            interpBank = banks->interp;
+            diffBank = banks->diff;
         }
     }
 }
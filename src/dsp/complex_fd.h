@@ -18,28 +18,45 @@
 #include <dsp/clock_recovery/mm.h>
 #include <math.h>
 
+#include <memory>
+
+#include "tap_cache.h"
+
 namespace dsp {
 
     namespace clock_recovery {
         class COMPLEX_FD : public Processor<complex_t, complex_t> {
             using base_type = Processor<complex_t, complex_t> ;
         public:
+            enum InterpMode {
+                //Windowed sinc polyphase bank, with a matching bank of derivative taps
+                INTERP_POLYPHASE,
+                //Cubic Lagrange interpolation in Farrow form over the 4 samples around the symbol, no tables
+                INTERP_CUBIC
+            };
+
             COMPLEX_FD() {}
 
-            COMPLEX_FD(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps = 1, int interpPhaseCount = 128, int interpTapCount = 8) { init(in, omega, omegaGain, muGain, omegaRelLimit, outSps, interpPhaseCount, interpTapCount); }
+            COMPLEX_FD(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps = 1, int interpPhaseCount = 128, int interpTapCount = 8, int maxCount = STREAM_BUFFER_SIZE) { init(in, omega, omegaGain, muGain, omegaRelLimit, outSps, interpPhaseCount, interpTapCount, maxCount); }
 
             ~COMPLEX_FD();
 
-            void init(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps = 1, int interpPhaseCount = 128, int interpTapCount = 8);
+            //maxCount sizes the delay buffer, process() takes longer inputs in pieces of that many samples
+            void init(stream<complex_t>* in, double omega, double omegaGain, double muGain, double omegaRelLimit, int outSps = 1, int interpPhaseCount = 128, int interpTapCount = 8, int maxCount = STREAM_BUFFER_SIZE);
             void setOmega(double omega);
             void setOmegaGain(double omegaGain);
             void setMuGain(double muGain);
             void setOmegaRelLimit(double omegaRelLimit);
-            void setInterpParams(int interpPhaseCount, int interpTapCount);
+            //interpPhaseCount also sets the derivative scale in cubic mode, so both modes share the same loop gains
+            void setInterpParams(int interpPhaseCount, int interpTapCount, InterpMode interpMode = INTERP_POLYPHASE);
             void reset();
 
             int process(int count, const complex_t* in, complex_t* out);
 
+            //Interpolator and derivative banks of the polyphase mode, for running the same loop elsewhere
+            const dsp::multirate::PolyphaseBank<float>& getInterpBank() { return interpBank; }
+            const dsp::multirate::PolyphaseBank<float>& getDiffBank() { return diffBank; }
+
             int run() {
                 int count = base_type::_in->read();
                 if (count < 0) { return -1; }
@@ -56,9 +73,24 @@ namespace dsp {
 
             loop::PhaseControlLoop<float, false> pcl;
         protected:
+            //Both banks for one phase and tap count, shared through the TapCache
+            struct InterpBanks {
+                InterpBanks() {}
+                InterpBanks(const InterpBanks&) = delete;
+                ~InterpBanks();
+
+                dsp::multirate::PolyphaseBank<float> interp = {};
+                dsp::multirate::PolyphaseBank<float> diff = {};
+            };
+
             void generateInterpTaps();
+            int processChunk(int count, const complex_t* in, complex_t* out);
 
+            //The banks below point into it
+            std::shared_ptr<const InterpBanks> banks;
             dsp::multirate::PolyphaseBank<float> interpBank;
+            //Per phase difference of the neighbouring interpolator phases, one dot product gives the slope
+            dsp::multirate::PolyphaseBank<float> diffBank;
 
             double _omega;
             int _outSps;
@@ -68,6 +100,8 @@ namespace dsp {
             double _omegaRelLimit;
             int _interpPhaseCount;
             int _interpTapCount;
+            InterpMode _interpMode = INTERP_POLYPHASE;
+            int _maxCount;
 
             int offset = 0;
             complex_t* buffer;
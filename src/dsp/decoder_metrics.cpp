@@ -0,0 +1,45 @@
+#include "decoder_metrics.h"
+
+namespace dsp {
+    //Label values of enum tetra_train_seq
+    static const char* trainSeqNames[TETRA_STATS_TRAIN_SEQS] = {
+        "norm1", "norm2", "norm3", "sync", "ext", "norm1_d8psk", "norm2_d8psk", "ext_d8psk"
+    };
+
+    void writeDecoderMetrics(MetricsWriter& w, const std::string& labels, demod::PI4DQPSK& demod, DQPSKSymbolExtractor& symbolExtractor, osmotetradec& decoder) {
+        writeDecoderMetrics(w, labels, demod.getFllFrequency(), demod.isLoopLocked(), demod.isIdle(), symbolExtractor, decoder);
+    }
+
+    void writeDecoderMetrics(MetricsWriter& w, const std::string& labels, double fllFrequency, bool loopLocked, bool idle, DQPSKSymbolExtractor& symbolExtractor, osmotetradec& decoder) {
+        std::string sep = labels.empty() ? "" : ",";
+        int rxState = decoder.getRxState();
+        w.gauge("tetra_symbol_sync", "1 while the symbol extractor is in sync", labels, symbolExtractor.sync);
+        w.gauge("tetra_symbol_error", "Mean phase error of the symbols, 0 for a perfect constellation", labels, symbolExtractor.standarderr);
+        w.gauge("tetra_rx_state", "Burst synchronizer state, 0 unlocked, 1 knows the next frame start, 2 locked", labels, rxState);
+        w.gauge("tetra_locked", "1 while the burst synchronizer is locked", labels, rxState == 2);
+        w.gauge("tetra_fll_frequency_hz", "Carrier offset the FLL corrects", labels, fllFrequency);
+        w.gauge("tetra_loop_locked", "1 while the demodulator loops run at their narrow tracking bandwidths", labels, loopLocked);
+        w.gauge("tetra_demod_idle", "1 while the demodulator sleeps on a carrier without sync", labels, idle);
+        for (int i = 0; i < TETRA_STATS_TRAIN_SEQS; i++) {
+            w.counter("tetra_bursts_total", "Bursts by the training sequence they were found by", labels + sep + MetricsWriter::label("type", trainSeqNames[i]),
+                      decoder.getBursts(i));
+        }
+        w.counter("tetra_crc_ok_total", "MAC blocks that passed their CRC", labels, decoder.getCrcOk());
+        w.counter("tetra_crc_fail_total", "MAC blocks that failed their CRC", labels, decoder.getCrcFail());
+        w.counter("tetra_crc_list_ok_total", "Of the CRC passes, those found by list decoding", labels, decoder.getCrcListOk());
+        w.counter("tetra_aach_fail_total", "AACH blocks the Reed-Muller code could not correct", labels, decoder.getAachFail());
+        w.counter("tetra_sync_lost_total", "Times the burst synchronizer lost the training sequences", labels, decoder.getSyncLost());
+        w.counter("tetra_reacquired_total", "Times it found them again at the predicted slot timing", labels, decoder.getReacquired());
+        w.counter("tetra_slips_total", "Locked bursts taken a symbol or two off their predicted start", labels, decoder.getSlips());
+        w.counter("tetra_burst_snr_db_sum", "SNR of the training sequences of the bursts, summed", labels, decoder.getSnrSum());
+        w.counter("tetra_burst_snr_db_count", "Bursts with an SNR, decoded from soft bits", labels, decoder.getSnrBursts());
+        w.gauge("tetra_burst_snr_db", "SNR of the training sequence of the last burst", labels, decoder.getLastSnr());
+        w.counter("tetra_keystream_ahead_hits_total", "Encrypted voice slots whose keystream was made ahead of time", labels, decoder.getKeystreamHits());
+        w.counter("tetra_keystream_ahead_misses_total", "Encrypted voice slots that generated their keystream in line", labels, decoder.getKeystreamMisses());
+        w.counter("tetra_voice_frames_dropped_total", "Voice frames dropped for a full audio buffer", labels, decoder.getVoiceDropped());
+        w.counter("tetra_fragments_dropped_total", "Fragmented MAC PDUs dropped for the reassembly memory limit", labels, decoder.getFragmentsDropped());
+        w.gauge("tetra_audio_queue_samples", "Voice samples waiting to go out", labels, decoder.getAudioDepth());
+        w.counter("tetra_mac_pipe_dropped_total", "Blocks dropped for a full queue to the upper MAC thread", labels, decoder.getPipelineDropped());
+        w.gauge("tetra_mac_pipe_blocks", "Blocks waiting for the upper MAC thread", labels, decoder.getPipelineDepth());
+    }
+}
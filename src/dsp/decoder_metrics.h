@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+#include "metrics_server.h"
+#include "pi4dqpsk.h"
+#include "dqpsk_sym_extr.h"
+#include "osmotetra_dec.h"
+
+namespace dsp {
+    //The samples of one demodulator and decoder chain, labels tell it apart from the others of the process. Only reads
+    //what the chain keeps as atomics or shows in the menu anyway, so it may run on any thread while the chain runs
+    void writeDecoderMetrics(MetricsWriter& w, const std::string& labels, demod::PI4DQPSK& demod, DQPSKSymbolExtractor& symbolExtractor, osmotetradec& decoder);
+    //The same for a chain whose loops run elsewhere, see gpu::WidebandDemod, with their state as values
+    void writeDecoderMetrics(MetricsWriter& w, const std::string& labels, double fllFrequency, bool loopLocked, bool idle, DQPSKSymbolExtractor& symbolExtractor, osmotetradec& decoder);
+}
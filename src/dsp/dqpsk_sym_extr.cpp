@@ -1,26 +1,120 @@
 #include "dqpsk_sym_extr.h"
 
+#include <string.h>
+
+#include <algorithm>
+
+#define SYNC_ERROR_SCALE 65535.0f
+//Soft bit of an ideal symbol pair at unit amplitude, leaves headroom up to the int8 limit for strong symbols
+#define SOFT_BIT_SCALE 64.0f
+
 namespace dsp {
+    //Slicer mapping, this mapping is required to make substraction differential decoder work properly
+    static inline uint8_t dqpskSymbol(const complex_t& c) {
+        uint8_t a = c.im < 0;
+        uint8_t b = c.re < 0;
+        return (a << 1) | (a ^ b);
+    }
+
+    static inline int8_t softBit(float v) {
+        v = std::clamp<float>(v * SOFT_BIT_SCALE, -127.0f, 127.0f);
+        return (int8_t)lrintf(v);
+    }
+
+    int DQPSKSymbolExtractor::processSoft(int count, const complex_t* in, int8_t* out) {
+        //z = in[i] * conj(in[i-1]) sits on 0, 90, 180 or 270 degrees for the Gray coded dibits 00, 01, 11, 10.
+        //Rotated by -45 degrees the first bit is the sign of the real part and the second one of the imaginary part
+        for (int i = 0; i < count; i++) {
+            complex_t z = in[i] * prevSym.conj();
+            out[(i * 2)] = softBit(z.re + z.im);
+            out[(i * 2) + 1] = softBit(z.re - z.im);
+            prevSym = in[i];
+        }
+        return count * 2;
+    }
+
     int DQPSKSymbolExtractor::process(int count, const complex_t* in, uint8_t* out) {
-        for(int i = 0; i < count; i++) {
-            complex_t sym_c = in[i];
-            bool a = sym_c.im<0;
-            bool b = sym_c.re<0;
-            complex_t ideal_sym = {b?-0.7071f : 0.7071f, a?-0.7071f : 0.7071f};
-            // float dist = fabsf(sqrtf(((ideal_sym.re-sym_c.re)*(ideal_sym.re-sym_c.re))+((ideal_sym.im-sym_c.im)*(ideal_sym.im-sym_c.im))));
-            float dist = std::abs(ideal_sym.phase() - sym_c.phase());
-            errorbuf[errorptr] = dist;
-            errorptr++;
-            if(errorptr >= SYNC_DETECT_BUF) {
-                errorptr = 0;
+        if (count <= 0) { return 0; }
+        if (_symbolHandler) { _symbolHandler(in, count, _symbolCtx); }
+        if (_tapHandler) { updateTap(count, in); }
+
+        if (softBits) {
+            int outCount = processSoft(count, in, (int8_t*)out);
+            prev = dqpskSymbol(in[count - 1]);
+            updateQuality(count, in);
+            return outCount;
+        }
+
+        //Slice and differentially decode without branches, each output only depends on two inputs.
+        //Phase diffs are remapped to the actual tetra symbols by swapping 0b10 and 0b11, which is x ^ (x >> 1)
+        uint8_t d = (dqpskSymbol(in[0]) - prev) & 3;
+        d ^= d >> 1;
+        int outCount;
+        if (unpackBits) {
+            out[0] = d >> 1;
+            out[1] = d & 1;
+            for (int i = 1; i < count; i++) {
+                uint8_t diff = (dqpskSymbol(in[i]) - dqpskSymbol(in[i - 1])) & 3;
+                diff ^= diff >> 1;
+                out[(i * 2)] = diff >> 1;
+                out[(i * 2) + 1] = diff & 1;
+            }
+            outCount = count * 2;
+        }
+        else {
+            out[0] = d;
+            for (int i = 1; i < count; i++) {
+                uint8_t diff = (dqpskSymbol(in[i]) - dqpskSymbol(in[i - 1])) & 3;
+                out[i] = diff ^ (diff >> 1);
+            }
+            outCount = count;
+        }
+        prev = dqpskSymbol(in[count - 1]);
+        prevSym = in[count - 1];
+
+        updateQuality(count, in);
+        return outCount;
+    }
+
+    void DQPSKSymbolExtractor::updateTap(int count, const complex_t* in) {
+        int i = 0;
+        while (i < count) {
+            //A new frame starts once the interval is over and somebody asked for it
+            if (tapFill == 0) {
+                int skip = std::min<int>(count - i, tapWait);
+                tapWait -= skip;
+                i += skip;
+                if (tapWait > 0 || !tapRequested.exchange(false, std::memory_order_relaxed)) { return; }
+            }
+            int n = std::min<int>(count - i, CONST_TAP_POINTS - tapFill);
+            memcpy(&tapBuf[tapFill], &in[i], n * sizeof(complex_t));
+            tapFill += n;
+            i += n;
+            if (tapFill == CONST_TAP_POINTS) {
+                _tapHandler(tapBuf, CONST_TAP_POINTS, _tapCtx);
+                tapFill = 0;
+                tapWait = tapInterval - CONST_TAP_POINTS;
             }
+        }
+    }
+
+    void DQPSKSymbolExtractor::updateQuality(int count, const complex_t* in) {
+        for (int i = 0; i < count; i++) {
+            //Angle to the quadrant diagonal: atan(||im| - |re|| / (|im| + |re|)), with a polynomial atan on [0, 1]
+            float re = fabsf(in[i].re);
+            float im = fabsf(in[i].im);
+            float r = fabsf(im - re) / (im + re + 1e-20f);
+            float dist = r * ((FL_M_PI / 4.0f) + (0.273f * (1.0f - r)));
+            uint16_t err = (uint16_t)(dist * SYNC_ERROR_SCALE + 0.5f);
+
+            errorsum += err;
+            errorsum -= errorbuf[errorptr];
+            errorbuf[errorptr] = err;
+            errorptr = (errorptr + 1) & (SYNC_DETECT_BUF - 1);
+
             errordisplayptr++;
             if(errordisplayptr >= SYNC_DETECT_DISPLAY) {
-                float xerr = 0;
-                for(int i = 0; i < SYNC_DETECT_BUF; i++) {
-                    xerr+=errorbuf[i];
-                }
-                xerr /= (float)SYNC_DETECT_BUF;
+                float xerr = (float)errorsum / (SYNC_ERROR_SCALE * (float)SYNC_DETECT_BUF);
                 standarderr = xerr;
                 if(xerr >= 0.35f) {
                     sync = false;
@@ -29,28 +123,6 @@ namespace dsp {
                 }
                 errordisplayptr = 0;
             }
-            uint8_t sym = ((a)<<1) | (a!=b); //This mapping is required to make substraction differential decoder work properly
-            uint8_t phaseDiff = (sym - prev + 4) % 4;
-            switch(phaseDiff) { //Remap phase diffs to actual tetra symbols(swap 0b10 and 0b11)
-                case 0b00:
-                    //0
-                    out[i] = 0b00;
-                    break;
-                case 0b01:
-                    //pi/2
-                    out[i]=0b01;
-                    break;
-                case 0b10:
-                    //pi
-                    out[i]=0b11;
-                    break;
-                case 0b11:
-                    //-pi/2
-                    out[i]=0b10;
-                    break;
-            }
-            prev = sym;
         }
-        return count;
     }
 }
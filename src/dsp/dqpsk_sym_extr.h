@@ -1,6 +1,9 @@
 #pragma once
 #include <dsp/processor.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -11,11 +14,19 @@
 #include <dsp/math/step.h>
 #include <math.h>
 
+#include "thread_tuning.h"
+
 #define SYNC_DETECT_BUF 4096
 #define SYNC_DETECT_DISPLAY 256
+//Symbols of one constellation diagram frame, and the default time between two of them
+#define CONST_TAP_POINTS 1024
+#define CONST_TAP_DEFAULT_INTERVAL_MS 100
 
 namespace dsp {
-    //Symbol mapper + differential decoder
+    //Symbol mapper + differential decoder. With unpacking enabled every symbol comes out as two bytes holding
+    //one bit each, MSB first, which is what tetra-rx wants, so no separate BitUnpacker stage is needed.
+    //Soft bits are two int8 per symbol instead, taken from the differential phase, positive for a '0'.
+    //Their sign is the hard bit, give them to osmotetradec with setSoftBits(true)
     class DQPSKSymbolExtractor : public Processor<complex_t, uint8_t> {
         using base_type = Processor<complex_t, uint8_t>;
     public:
@@ -35,13 +46,99 @@ namespace dsp {
 
         int process(int count, const complex_t* in, uint8_t* out);
 
+        void setUnpackBits(bool unpack) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            unpackBits = unpack;
+            base_type::tempStart();
+        }
+
+        void setSoftBits(bool soft) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            softBits = soft;
+            base_type::tempStart();
+        }
+
+        //handler gets every symbol before it is sliced, in line on the DSP thread, e.g. for the network output.
+        //NULL to stop
+        void setSymbolHandler(void (*handler)(const complex_t* data, int count, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _symbolHandler = handler;
+            _symbolCtx = ctx;
+            base_type::tempStart();
+        }
+
+        //Demand driven constellation diagram: handler gets CONST_TAP_POINTS symbols in line on the DSP thread, at most
+        //every intervalSymbols and only if requestConstellation() was called since the last time. Nothing is copied
+        //while nobody asks. NULL to stop
+        void setConstellationTap(void (*handler)(const complex_t* data, int count, void* ctx), void* ctx, int intervalSymbols) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _tapHandler = handler;
+            _tapCtx = ctx;
+            tapInterval = std::max<int>(intervalSymbols, CONST_TAP_POINTS);
+            tapFill = 0;
+            tapWait = 0;
+            base_type::tempStart();
+        }
+
+        //From any thread, e.g. each time the diagram is drawn
+        void requestConstellation() {
+            tapRequested.store(true, std::memory_order_relaxed);
+        }
+
+        //Pins the DSP thread as tuning says, each time the block starts. tuning is the caller's and has to outlive the
+        //block, NULL leaves the thread alone
+        void setThreadTuning(const ThreadTuning* tuning) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            threadTuning = tuning;
+            base_type::tempStart();
+        }
+
         bool sync = false;
         float standarderr = 0;
 
+    protected:
+        void doStart() override {
+            base_type::doStart();
+            if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+        }
+
     private:
+        void updateQuality(int count, const complex_t* in);
+        void updateTap(int count, const complex_t* in);
+
+        int processSoft(int count, const complex_t* in, int8_t* out);
+
+        bool unpackBits = false;
+        bool softBits = false;
         uint8_t prev = 0;
-        float errorbuf[SYNC_DETECT_BUF];
+        complex_t prevSym = { 0, 0 };
+        //Per symbol phase error in 1/65535 rad, kept as integers so the running sum never drifts
+        uint16_t errorbuf[SYNC_DETECT_BUF] = { 0 };
+        uint32_t errorsum = 0;
         int errorptr = 0;
         int errordisplayptr = 0;
+
+        void (*_symbolHandler)(const complex_t* data, int count, void* ctx) = NULL;
+        void* _symbolCtx = NULL;
+
+        //See setConstellationTap(). tapWait counts down the symbols to the next frame, tapFill those of it so far
+        void (*_tapHandler)(const complex_t* data, int count, void* ctx) = NULL;
+        void* _tapCtx = NULL;
+        int tapInterval = CONST_TAP_POINTS;
+        int tapWait = 0;
+        int tapFill = 0;
+        std::atomic<bool> tapRequested = false;
+        complex_t tapBuf[CONST_TAP_POINTS];
+        const ThreadTuning* threadTuning = NULL;
     };
 }
@@ -0,0 +1,239 @@
+#include "event_database.h"
+
+#include <algorithm>
+
+#ifdef TETRA_SQLITE
+#include <sqlite3.h>
+#endif
+
+extern "C" {
+    #include "tetra_cmce_pdu.h"
+    #include "tetra_mle_pdu.h"
+    #include "tetra_mm_pdu.h"
+}
+
+namespace dsp {
+#ifdef TETRA_SQLITE
+    static const char* SCHEMA =
+        "CREATE TABLE IF NOT EXISTS events ("
+        "id INTEGER PRIMARY KEY, time_us INTEGER NOT NULL, carrier TEXT, mcc INTEGER, mnc INTEGER, cc INTEGER, "
+        "hn INTEGER, mn INTEGER, fn INTEGER, tn INTEGER, ssi INTEGER, addr_type INTEGER, pdisc TEXT, pdu TEXT, "
+        "call_id INTEGER, party_ssi INTEGER, encryption_mode INTEGER, alloc_type INTEGER, alloc_slots INTEGER, "
+        "alloc_ul_dl INTEGER, alloc_dl_hz INTEGER, main_dl_hz INTEGER);"
+        "CREATE INDEX IF NOT EXISTS events_ssi ON events (ssi);"
+        "CREATE INDEX IF NOT EXISTS events_call ON events (call_id);";
+
+    static const char* INSERT =
+        "INSERT INTO events (time_us, carrier, mcc, mnc, cc, hn, mn, fn, tn, ssi, addr_type, pdisc, pdu, call_id, party_ssi, "
+        "encryption_mode, alloc_type, alloc_slots, alloc_ul_dl, alloc_dl_hz, main_dl_hz) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+#endif
+
+    EventDatabase::~EventDatabase() {
+        close();
+    }
+
+    bool EventDatabase::isAvailable() {
+#ifdef TETRA_SQLITE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool EventDatabase::open(const std::string& path, int batchRows, int flushMs) {
+        close();
+#ifdef TETRA_SQLITE
+        sqlite3* d = NULL;
+        if (sqlite3_open(path.c_str(), &d) != SQLITE_OK) {
+            sqlite3_close(d);
+            return false;
+        }
+        //WAL lets readers look at the database while it is written, NORMAL only syncs at checkpoints
+        sqlite3_busy_timeout(d, 1000);
+        if (sqlite3_exec(d, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, NULL) != SQLITE_OK ||
+            sqlite3_exec(d, SCHEMA, NULL, NULL, NULL) != SQLITE_OK ||
+            sqlite3_prepare_v2(d, INSERT, -1, &insertStmt, NULL) != SQLITE_OK) {
+            sqlite3_close(d);
+            insertStmt = NULL;
+            return false;
+        }
+        _batchRows = std::max<int>(batchRows, 1);
+        flushInterval = std::chrono::milliseconds(flushMs);
+        rows = 0;
+        dropped = 0;
+        errors = 0;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = false;
+            current.clear();
+            current.reserve(_batchRows);
+            db = d;
+        }
+        workerThread = std::thread(&EventDatabase::worker, this);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void EventDatabase::close() {
+        if (!db) { return; }
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+        }
+        cnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+#ifdef TETRA_SQLITE
+        sqlite3_finalize(insertStmt);
+        sqlite3_close(db);
+#endif
+        insertStmt = NULL;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            db = NULL;
+        }
+        pending.clear();
+        spare.clear();
+    }
+
+    void EventDatabase::setFlushInterval(int flushMs) {
+        std::lock_guard<std::mutex> lck(mtx);
+        flushInterval = std::chrono::milliseconds(flushMs);
+    }
+
+    void EventDatabase::setSource(int source, const std::string& label) {
+        std::lock_guard<std::mutex> lck(sourceMtx);
+        labels[source] = label;
+    }
+
+    void EventDatabase::handleL3(int source, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const TetraCellInfo& cell) {
+        if (!l3->parsed || (l3->pdisc != TMLE_PDISC_CMCE && l3->pdisc != TMLE_PDISC_MM)) { return; }
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!db || stopping) { return; }
+        if (current.size() >= (size_t)_batchRows && !submit()) {
+            dropped++;
+            return;
+        }
+        if (current.empty()) { currentSince = std::chrono::steady_clock::now(); }
+        Row& r = current.emplace_back();
+        r.source = source;
+        r.timeUs = now;
+        r.cellKnown = cell.syncs > 0;
+        r.mcc = cell.mcc;
+        r.mnc = cell.mnc;
+        r.cc = cell.cc;
+        r.time = *time;
+        r.l3 = *l3;
+        if (current.size() >= (size_t)_batchRows) { submit(); }
+    }
+
+    bool EventDatabase::submit() {
+        if (pending.size() >= EVENT_DATABASE_MAX_PENDING) { return false; }
+        pending.push_back(std::move(current));
+        if (spare.empty()) {
+            current = std::vector<Row>();
+            current.reserve(_batchRows);
+        } else {
+            current = std::move(spare.back());
+            spare.pop_back();
+        }
+        current.clear();
+        cnd.notify_one();
+        return true;
+    }
+
+    void EventDatabase::worker() {
+        std::unique_lock<std::mutex> lck(mtx);
+        while (true) {
+            //Wake by the time the part filled batch is due, not a full interval after the last
+            //batch went out. With none, it is due no earlier than an interval from now
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = (current.empty() ? now : currentSince) + flushInterval;
+            cnd.wait_until(lck, deadline, [this]() { return stopping || !pending.empty(); });
+            //A part filled batch goes out once it is old enough, and everything on the way out
+            if (!current.empty() && (stopping || std::chrono::steady_clock::now() - currentSince >= flushInterval)) {
+                if (!submit() && stopping) {
+                    pending.push_back(std::move(current));
+                    current.clear();
+                }
+            }
+            if (pending.empty()) {
+                if (stopping) { return; }
+                continue;
+            }
+
+            std::vector<Row> batch = std::move(pending.front());
+            pending.pop_front();
+            lck.unlock();
+            insert(batch);
+            lck.lock();
+            batch.clear();
+            spare.push_back(std::move(batch));
+        }
+    }
+
+    void EventDatabase::insert(const std::vector<Row>& batch) {
+#ifdef TETRA_SQLITE
+        //The labels of a batch are looked up once and stay put while it is bound
+        std::map<int, std::string> names;
+        {
+            std::lock_guard<std::mutex> lck(sourceMtx);
+            names = labels;
+        }
+        if (sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
+            errors++;
+            return;
+        }
+        sqlite3_stmt* s = insertStmt;
+        for (const auto& r : batch) {
+            const struct tetra_l3_event& l3 = r.l3;
+            bool cmce = l3.pdisc == TMLE_PDISC_CMCE;
+            auto it = names.find(r.source);
+            sqlite3_reset(s);
+            sqlite3_clear_bindings(s);
+            sqlite3_bind_int64(s, 1, r.timeUs);
+            if (it != names.end()) { sqlite3_bind_text(s, 2, it->second.c_str(), -1, SQLITE_STATIC); }
+            if (r.cellKnown) {
+                sqlite3_bind_int(s, 3, r.mcc);
+                sqlite3_bind_int(s, 4, r.mnc);
+                sqlite3_bind_int(s, 5, r.cc);
+            }
+            sqlite3_bind_int(s, 6, r.time.hn);
+            sqlite3_bind_int(s, 7, r.time.mn);
+            sqlite3_bind_int(s, 8, r.time.fn);
+            sqlite3_bind_int(s, 9, r.time.tn);
+            sqlite3_bind_int64(s, 10, l3.ssi);
+            sqlite3_bind_int(s, 11, l3.addr_type);
+            sqlite3_bind_text(s, 12, tetra_get_mle_pdisc_name(l3.pdisc), -1, SQLITE_STATIC);
+            sqlite3_bind_text(s, 13, cmce ? tetra_get_cmce_pdut_name(l3.cmce.pdu_type, 0) : tetra_get_mm_pdut_name(l3.mm.pdu_type, 0), -1, SQLITE_STATIC);
+            if (cmce && l3.cmce.call_id) { sqlite3_bind_int(s, 14, l3.cmce.call_id); }
+            if (cmce && l3.cmce.party_type) { sqlite3_bind_int64(s, 15, l3.cmce.party_ssi); }
+            sqlite3_bind_int(s, 16, l3.encryption_mode);
+            if (l3.chan_alloc) {
+                sqlite3_bind_int(s, 17, l3.chan_alloc_type);
+                sqlite3_bind_int(s, 18, l3.chan_timeslot);
+                sqlite3_bind_int(s, 19, l3.chan_ul_dl);
+                if (l3.chan_dl_hz) { sqlite3_bind_int64(s, 20, l3.chan_dl_hz); }
+            }
+            if (l3.main_dl_hz) { sqlite3_bind_int64(s, 21, l3.main_dl_hz); }
+            if (sqlite3_step(s) != SQLITE_DONE) {
+                sqlite3_reset(s);
+                sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+                errors++;
+                return;
+            }
+        }
+        sqlite3_reset(s);
+        if (sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+            sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+            errors++;
+            return;
+        }
+        rows += batch.size();
+#endif
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "osmotetra_dec.h"
+
+extern "C" {
+    #include "tetra_events.h"
+}
+
+//Rows collected before they go to the database in one transaction
+#define EVENT_DATABASE_DEFAULT_BATCH_ROWS 512
+//A batch that is not full is still written once its first row waited this long
+#define EVENT_DATABASE_DEFAULT_FLUSH_MS 1000
+#define EVENT_DATABASE_MAX_FLUSH_MS 60000
+//Batches waiting for the database before new rows are dropped
+#define EVENT_DATABASE_MAX_PENDING 16
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace dsp {
+    //Keeps the call and mobility metadata of the decoders in an SQLite database, one row per CMCE or MM PDU in the
+    //table events: wall clock, carrier, cell (MCC, MNC, colour code), TDMA time, address and address type of the MAC
+    //PDU, PDU type, call identifier, calling or transmitting party, encryption mode of the MAC PDU and the channel it
+    //allocated. handleL3 only copies the PDU's header into a batch in memory, full batches (or those older than the
+    //flush interval) are inserted by a thread of the database, each in one transaction with a prepared statement, on
+    //a database in WAL mode. When the disk falls behind by EVENT_DATABASE_MAX_PENDING batches the rows are dropped
+    //and counted instead. Without TETRA_SQLITE in the build isAvailable() says no and open() fails
+    class EventDatabase {
+    public:
+        EventDatabase() {}
+
+        ~EventDatabase();
+
+        static bool isAvailable();
+
+        //Creates the file and the table if they are not there, rows are added to what is in it. false if it can't
+        //be opened
+        bool open(const std::string& path, int batchRows = EVENT_DATABASE_DEFAULT_BATCH_ROWS, int flushMs = EVENT_DATABASE_DEFAULT_FLUSH_MS);
+
+        //Writes out what is collected and closes the database
+        void close();
+
+        bool isOpen() { return db != NULL; }
+
+        //Takes effect with the next batch
+        void setFlushInterval(int flushMs);
+
+        //Carriers are told apart by source, label goes into their rows. Any thread
+        void setSource(int source, const std::string& label);
+
+        //cell is the decoder's, see osmotetradec::getCellInfo. Everything but parsed CMCE and MM PDUs is left alone,
+        //any thread
+        void handleL3(int source, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const TetraCellInfo& cell);
+
+        uint64_t getRows() { return rows; }
+        uint64_t getDropped() { return dropped; }
+        //Transactions that failed, their rows are lost
+        uint64_t getErrors() { return errors; }
+
+    protected:
+        struct Row {
+            int source;
+            int64_t timeUs;
+            //A SYNC was heard, the ids are those of the last one
+            bool cellKnown;
+            int mcc;
+            int mnc;
+            int cc;
+            struct tetra_tdma_time time;
+            struct tetra_l3_event l3;
+        };
+
+        void worker();
+        //Hand the current batch to the thread, called locked. false if too many are pending already
+        bool submit();
+        void insert(const std::vector<Row>& batch);
+
+        struct sqlite3* db = NULL;
+        struct sqlite3_stmt* insertStmt = NULL;
+        int _batchRows = EVENT_DATABASE_DEFAULT_BATCH_ROWS;
+        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(EVENT_DATABASE_DEFAULT_FLUSH_MS);
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        std::vector<Row> current;
+        std::chrono::steady_clock::time_point currentSince;
+        std::deque<std::vector<Row>> pending;
+        //Written batches kept for reuse, so the steady state allocates nothing
+        std::vector<std::vector<Row>> spare;
+        bool stopping = false;
+        std::thread workerThread;
+
+        std::mutex sourceMtx;
+        std::map<int, std::string> labels;
+
+        std::atomic<uint64_t> rows = 0;
+        std::atomic<uint64_t> dropped = 0;
+        std::atomic<uint64_t> errors = 0;
+    };
+}
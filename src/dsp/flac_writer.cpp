@@ -0,0 +1,246 @@
+#include "flac_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#define FLAC_MAX_FIXED_ORDER 4
+#define FLAC_MAX_PARTITION_ORDER 4
+//Rice parameters of the 4 bit coding method, 15 is the escape code
+#define FLAC_MAX_RICE_PARAM 14
+#define FLAC_STREAMINFO_OFFSET 8
+#define FLAC_STREAMINFO_LEN 34
+
+namespace dsp {
+    static const uint8_t flacMarker[4] = { 'f', 'L', 'a', 'C' };
+
+    static uint8_t crc8(const uint8_t* data, size_t len) {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; b++) { crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1); }
+        }
+        return crc;
+    }
+
+    static uint16_t crc16(const uint8_t* data, size_t len) {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < len; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int b = 0; b < 8; b++) { crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1); }
+        }
+        return crc;
+    }
+
+    static inline int32_t fixedResidual(const int16_t* x, int i, int order) {
+        switch (order) {
+        case 0: return x[i];
+        case 1: return x[i] - x[i - 1];
+        case 2: return x[i] - 2 * x[i - 1] + x[i - 2];
+        case 3: return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+        default: return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+        }
+    }
+
+    static inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+    //Parameter and bits of a Rice coded partition whose zigzag values add up to sum
+    static inline int riceParam(uint64_t sum, int n) {
+        int k = 0;
+        while (k < FLAC_MAX_RICE_PARAM && ((uint64_t)n << (k + 1)) < sum) { k++; }
+        return k;
+    }
+
+    static inline uint64_t riceBits(uint64_t sum, int n, int k) {
+        return (uint64_t)n * (k + 1) + (sum >> k);
+    }
+
+    FlacWriter::~FlacWriter() {
+        close();
+    }
+
+    bool FlacWriter::open(const std::string& path, int samplerate) {
+        close();
+        file = fopen(path.c_str(), "wb");
+        if (!file) { return false; }
+        _samplerate = samplerate;
+        samples = 0;
+        frameNumber = 0;
+        block.clear();
+        block.reserve(FLAC_WRITER_BLOCK_SIZE);
+        residual.resize(FLAC_WRITER_BLOCK_SIZE);
+        out.clear();
+        out.reserve(FLAC_WRITER_FLUSH_BYTES + 4 * FLAC_WRITER_BLOCK_SIZE);
+        bitAcc = 0;
+        bitCount = 0;
+
+        //The marker and the only metadata block, its sample count is filled in by close()
+        for (uint8_t c : flacMarker) { out.push_back(c); }
+        putBits(1, 1);
+        putBits(0, 7);
+        putBits(FLAC_STREAMINFO_LEN, 24);
+        writeStreamInfo();
+        bytes = out.size();
+        return true;
+    }
+
+    void FlacWriter::close() {
+        if (!file) { return; }
+        if (!block.empty()) { encodeBlock(block.data(), block.size()); }
+        block.clear();
+        flush();
+        writeStreamInfo();
+        if (fseek(file, FLAC_STREAMINFO_OFFSET, SEEK_SET) == 0) { fwrite(out.data(), 1, out.size(), file); }
+        out.clear();
+        fclose(file);
+        file = NULL;
+    }
+
+    void FlacWriter::write(const int16_t* data, int count) {
+        if (!file) { return; }
+        while (count > 0) {
+            int n = std::min<int>(count, FLAC_WRITER_BLOCK_SIZE - block.size());
+            block.insert(block.end(), data, data + n);
+            data += n;
+            count -= n;
+            if (block.size() == FLAC_WRITER_BLOCK_SIZE) {
+                encodeBlock(block.data(), block.size());
+                block.clear();
+            }
+        }
+        if (out.size() >= FLAC_WRITER_FLUSH_BYTES) { flush(); }
+    }
+
+    void FlacWriter::encodeBlock(const int16_t* x, int count) {
+        size_t frameStart = out.size();
+
+        //Frame header: sync code and fixed blocking, block size, sample rate, mono, 16 bit
+        putBits(0xFFF8, 16);
+        putBits((count == FLAC_WRITER_BLOCK_SIZE) ? 12 : 7, 4);
+        putBits((_samplerate == 8000) ? 4 : ((_samplerate == 16000) ? 5 : 0), 4);
+        putBits(0, 4);
+        putBits(4, 3);
+        putBits(0, 1);
+        //Frame number, UTF-8 coded
+        uint32_t fn = frameNumber++;
+        if (fn < 0x80) {
+            putBits(fn, 8);
+        } else {
+            int extra = (fn < 0x800) ? 1 : (fn < 0x10000) ? 2 : (fn < 0x200000) ? 3 : (fn < 0x4000000) ? 4 : 5;
+            putBits(((0xFF00 >> (extra + 1)) & 0xFF) | (fn >> (6 * extra)), 8);
+            for (int i = extra - 1; i >= 0; i--) { putBits(0x80 | ((fn >> (6 * i)) & 0x3F), 8); }
+        }
+        if (count != FLAC_WRITER_BLOCK_SIZE) { putBits(count - 1, 16); }
+        out.push_back(crc8(&out[frameStart], out.size() - frameStart));
+
+        bool constant = true;
+        for (int i = 1; i < count && constant; i++) { constant = x[i] == x[0]; }
+        if (constant) {
+            putBits(0x00, 8);
+            putBits((uint16_t)x[0], 16);
+        } else {
+            //The fixed predictor with the smallest residual, every order judged on the same samples
+            uint64_t orderSum[FLAC_MAX_FIXED_ORDER + 1] = { 0 };
+            for (int i = FLAC_MAX_FIXED_ORDER; i < count; i++) {
+                for (int o = 0; o <= FLAC_MAX_FIXED_ORDER; o++) { orderSum[o] += abs(fixedResidual(x, i, o)); }
+            }
+            int order = 0;
+            for (int o = 1; o <= FLAC_MAX_FIXED_ORDER; o++) {
+                if (orderSum[o] < orderSum[order]) { order = o; }
+            }
+            order = std::min<int>(order, count - 1);
+            for (int i = order; i < count; i++) { residual[i] = fixedResidual(x, i, order); }
+
+            //The partition order with the fewest bits, partitions have to hold more than the warm-up samples
+            int bestPorder = 0;
+            uint64_t bestBits = UINT64_MAX;
+            for (int p = 0; p <= FLAC_MAX_PARTITION_ORDER; p++) {
+                if (p && ((count & ((1 << p) - 1)) || (count >> p) <= order)) { break; }
+                uint64_t bits = 0;
+                int len = count >> p;
+                for (int part = 0; part < (1 << p); part++) {
+                    int from = (part == 0) ? order : part * len;
+                    int to = (part + 1) * len;
+                    uint64_t sum = 0;
+                    for (int i = from; i < to; i++) { sum += zigzag(residual[i]); }
+                    bits += 4 + riceBits(sum, to - from, riceParam(sum, to - from));
+                }
+                if (bits < bestBits) {
+                    bestBits = bits;
+                    bestPorder = p;
+                }
+            }
+
+            if (16 * order + 6 + bestBits >= 16 * (uint64_t)count) {
+                putBits(0x02, 8);
+                for (int i = 0; i < count; i++) { putBits((uint16_t)x[i], 16); }
+            } else {
+                putBits((8 + order) << 1, 8);
+                for (int i = 0; i < order; i++) { putBits((uint16_t)x[i], 16); }
+                putBits(0, 2);
+                putBits(bestPorder, 4);
+                int len = count >> bestPorder;
+                for (int part = 0; part < (1 << bestPorder); part++) {
+                    int from = (part == 0) ? order : part * len;
+                    int to = (part + 1) * len;
+                    uint64_t sum = 0;
+                    for (int i = from; i < to; i++) { sum += zigzag(residual[i]); }
+                    int k = riceParam(sum, to - from);
+                    putBits(k, 4);
+                    for (int i = from; i < to; i++) { putRice(residual[i], k); }
+                }
+            }
+        }
+
+        alignByte();
+        uint16_t crc = crc16(&out[frameStart], out.size() - frameStart);
+        out.push_back(crc >> 8);
+        out.push_back(crc & 0xFF);
+        samples += count;
+        bytes += out.size() - frameStart;
+    }
+
+    void FlacWriter::writeStreamInfo() {
+        //Fixed block size, frame sizes and MD5 unknown
+        putBits(FLAC_WRITER_BLOCK_SIZE, 16);
+        putBits(FLAC_WRITER_BLOCK_SIZE, 16);
+        putBits(0, 24);
+        putBits(0, 24);
+        putBits(_samplerate, 20);
+        putBits(0, 3);
+        putBits(15, 5);
+        putBits((uint32_t)(samples >> 32) & 0xF, 4);
+        putBits((uint32_t)samples, 32);
+        for (int i = 0; i < 16; i++) { out.push_back(0); }
+    }
+
+    void FlacWriter::flush() {
+        if (out.empty()) { return; }
+        fwrite(out.data(), 1, out.size(), file);
+        out.clear();
+    }
+
+    void FlacWriter::putBits(uint32_t value, int bits) {
+        bitAcc = (bitAcc << bits) | (value & (uint32_t)((1ull << bits) - 1));
+        bitCount += bits;
+        while (bitCount >= 8) {
+            bitCount -= 8;
+            out.push_back((uint8_t)(bitAcc >> bitCount));
+        }
+    }
+
+    void FlacWriter::putRice(int32_t value, int k) {
+        uint32_t u = zigzag(value);
+        for (uint32_t q = u >> k; q > 0; ) {
+            int n = std::min<uint32_t>(q, 32);
+            putBits(0, n);
+            q -= n;
+        }
+        putBits((1u << k) | (u & ((1u << k) - 1)), k + 1);
+    }
+
+    void FlacWriter::alignByte() {
+        if (bitCount) { putBits(0, 8 - bitCount); }
+    }
+}
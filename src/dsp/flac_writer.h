@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+//Samples per FLAC frame, 512 ms at 8 kHz
+#define FLAC_WRITER_BLOCK_SIZE 4096
+//Encoded frames are collected until there are this many bytes, then written in one go
+#define FLAC_WRITER_FLUSH_BYTES (64 * 1024)
+
+namespace dsp {
+    //16 bit mono FLAC at 8 kHz, the codec output. Every block is coded with the fixed predictor (order 0 to 4) that
+    //leaves the smallest residual, Rice coded in up to 16 partitions, or as a constant for silence, like the reference
+    //encoder at its fastest level. Voice comes out at around 60% of the raw size. Not thread safe, meant for a
+    //worker that keeps the writes away from the decoder
+    class FlacWriter {
+    public:
+        FlacWriter() {}
+
+        ~FlacWriter();
+
+        //false if the file could not be created
+        bool open(const std::string& path, int samplerate = 8000);
+
+        //Codes the last, shorter block, writes the sample count into the stream info and closes the file
+        void close();
+
+        bool isOpen() { return file != NULL; }
+
+        void write(const int16_t* samples, int count);
+
+        uint64_t getSamples() { return samples; }
+        //Bytes of the file so far, what is still buffered included
+        uint64_t getBytes() { return bytes; }
+
+    protected:
+        void encodeBlock(const int16_t* block, int count);
+        void writeStreamInfo();
+        void flush();
+
+        //MSB first bit writer into out
+        void putBits(uint32_t value, int bits);
+        void putRice(int32_t value, int k);
+        void alignByte();
+
+        FILE* file = NULL;
+        int _samplerate = 8000;
+        uint64_t samples = 0;
+        uint64_t bytes = 0;
+        uint32_t frameNumber = 0;
+
+        std::vector<int16_t> block;
+        std::vector<int32_t> residual;
+        std::vector<uint8_t> out;
+        uint64_t bitAcc = 0;
+        int bitCount = 0;
+    };
+}
@@ -3,21 +3,39 @@
 namespace dsp {
     namespace loop {
             FLL::~FLL() {
-                taps::free(lbandedgerrcTaps);
-                taps::free(hbandedgerrcTaps);
+                buffer::free(beBuffer);
+                buffer::free(beQ15Buffer);
+                buffer::free(beQ15Phasors);
             }
 
-            void FLL::init(stream<complex_t>* in, double bandwidth, int sym_rate, int samp_rate, int filt_size, float filt_a, double initFreq, double minFreq, double maxFreq) {
+            FLL::BandedgeTaps::~BandedgeTaps() {
+                taps::free(lower);
+                taps::free(upper);
+                buffer::free(re);
+                buffer::free(im);
+                buffer::free(reQ15);
+                buffer::free(imQ15);
+            }
+
+            void FLL::init(stream<complex_t>* in, double bandwidth, int sym_rate, int samp_rate, int filt_size, float filt_a, double initFreq, double minFreq, double maxFreq, int maxCount) {
                 _initFreq = initFreq;
                 _symbolrate = sym_rate;
                 _samplerate = samp_rate;
                 _filt_size = filt_size;
                 _filt_a = filt_a;
+                _maxCount = std::max<int>(maxCount, 1);
 
                 //Create band-edge and normal filters
                 createBandedgeFilters();
                 lbandedgerrc.init(NULL, lbandedgerrcTaps);
                 hbandedgerrc.init(NULL, hbandedgerrcTaps);
+                beBuffer = buffer::alloc<complex_t>(_maxCount + _filt_size);
+                beBufStart = &beBuffer[_filt_size - 1];
+                memset(beBuffer, 0, (_filt_size - 1) * sizeof(complex_t));
+                beQ15Buffer = buffer::alloc<q15::cq15>(_maxCount + _filt_size);
+                beQ15BufStart = &beQ15Buffer[_filt_size - 1];
+                beQ15Phasors = buffer::alloc<q15::cq15>(_maxCount);
+                memset(beQ15Buffer, 0, (_filt_size - 1) * sizeof(q15::cq15));
 
                 // Init phase control loop
                 float alpha, beta;
@@ -28,38 +46,80 @@ namespace dsp {
             }
 
             void FLL::setSymbolrate(double symbolrate) {
-                assert(base_type::_block_init);
-                std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-                base_type::tempStop();
-                _symbolrate = symbolrate;
-                if(_samplerate/_symbolrate > 0.0f) {
-                    taps::free(lbandedgerrcTaps);
-                    taps::free(hbandedgerrcTaps);
-                    createBandedgeFilters();
-                    lbandedgerrc.setTaps(lbandedgerrcTaps);
-                    hbandedgerrc.setTaps(hbandedgerrcTaps);
+                double samplerate;
+                {
+                    std::lock_guard<std::mutex> lck(pendingMtx);
+                    samplerate = pendingSamplerate;
                 }
-                base_type::tempStart();
+                setRates(symbolrate, samplerate);
             }
 
             void FLL::setSamplerate(double samplerate) {
+                double symbolrate;
+                {
+                    std::lock_guard<std::mutex> lck(pendingMtx);
+                    symbolrate = pendingSymbolrate;
+                }
+                setRates(symbolrate, samplerate);
+            }
+
+            void FLL::setRates(double symbolrate, double samplerate) {
                 assert(base_type::_block_init);
-                std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-                base_type::tempStop();
-                _samplerate = samplerate;
-                if(_samplerate/_symbolrate > 0.0f) {
-                    taps::free(lbandedgerrcTaps);
-                    taps::free(hbandedgerrcTaps);
-                    createBandedgeFilters();
-                    lbandedgerrc.setTaps(lbandedgerrcTaps);
-                    hbandedgerrc.setTaps(hbandedgerrcTaps);
+                std::lock_guard<std::mutex> lck(pendingMtx);
+                if(!(samplerate/symbolrate > 0.0f)) { return; }
+                if(symbolrate == pendingSymbolrate && samplerate == pendingSamplerate) { return; }
+                pendingSymbolrate = symbolrate;
+                pendingSamplerate = samplerate;
+                pendingBandedge = getBandedge(symbolrate, samplerate);
+                tapsPending.store(true, std::memory_order_release);
+            }
+
+            void FLL::createBandedgeFilters() {
+                bandedge = getBandedge(_symbolrate, _samplerate);
+                useBandedge();
+                //Later rate changes start from these
+                pendingSymbolrate = _symbolrate;
+                pendingSamplerate = _samplerate;
+            }
+
+            std::shared_ptr<const FLL::BandedgeTaps> FLL::getBandedge(double symbolrate, double samplerate) {
+                std::string key = TapCache::key("fll_bandedge", { (double)_filt_size, _filt_a, symbolrate, samplerate });
+                return TapCache::get<BandedgeTaps>(key, [&](BandedgeTaps& t) { designBandedge(t, symbolrate, samplerate); });
+            }
+
+            void FLL::useBandedge() {
+                lbandedgerrcTaps = bandedge->lower;
+                hbandedgerrcTaps = bandedge->upper;
+                beTapsRe = bandedge->re;
+                beTapsIm = bandedge->im;
+                beTapsReQ15 = bandedge->reQ15;
+                beTapsImQ15 = bandedge->imQ15;
+                beQ15Shift = bandedge->q15Shift;
+            }
+
+            //DSP thread, at the start of process()
+            void FLL::takeUpdates() {
+                if(coefsPending.exchange(false, std::memory_order_acquire)) {
+                    //alpha = 0, we don't need to track phase in FLL
+                    pcl.setCoefficients(0.0f, pendingBeta.load(std::memory_order_relaxed));
                 }
-                base_type::tempStart();
+                if(!tapsPending.load(std::memory_order_acquire)) { return; }
+                //A setter still at it, the next call picks them up
+                std::unique_lock<std::mutex> lck(pendingMtx, std::try_to_lock);
+                if(!lck.owns_lock()) { return; }
+                _symbolrate = pendingSymbolrate;
+                _samplerate = pendingSamplerate;
+                std::swap(bandedge, pendingBandedge);
+                useBandedge();
+                //Same length, the delay lines stay as they are
+                lbandedgerrc.setTaps(lbandedgerrcTaps);
+                hbandedgerrc.setTaps(hbandedgerrcTaps);
+                tapsPending.store(false, std::memory_order_relaxed);
             }
 
             //STOLEN FROM GNURADIO!
-            void FLL::createBandedgeFilters() {
-                float sps = _samplerate / _symbolrate;
+            void FLL::designBandedge(BandedgeTaps& t, double symbolrate, double samplerate) {
+                float sps = samplerate / symbolrate;
                 // printf("fll new sps: (%f/%f) %f\n", _samplerate, _symbolrate, sps);
                 const int M = (_filt_size / sps);
                 float power = 0;
@@ -74,8 +134,10 @@ namespace dsp {
                     bb_taps.push_back(tap);
                 }
 
-                lbandedgerrcTaps = taps::alloc<complex_t>(_filt_size);
-                hbandedgerrcTaps = taps::alloc<complex_t>(_filt_size);
+                t.lower = taps::alloc<complex_t>(_filt_size);
+                t.upper = taps::alloc<complex_t>(_filt_size);
+                t.re = buffer::alloc<float>(_filt_size);
+                t.im = buffer::alloc<float>(_filt_size);
 
                 // Create the band edge filters by spinning the baseband
                 // filter up and down to the right places in frequency.
@@ -89,20 +151,25 @@ namespace dsp {
                     complex_t t1 = math::phasor(-2.0f * FL_M_PI * (1.0f + _filt_a) * k) * tap;
                     complex_t t2 = math::phasor( 2.0f * FL_M_PI * (1.0f + _filt_a) * k) * tap;
 
-                    lbandedgerrcTaps.taps[_filt_size - i - 1] = t1;
-                    hbandedgerrcTaps.taps[_filt_size - i - 1] = t2;
+                    t.lower.taps[_filt_size - i - 1] = t1;
+                    t.upper.taps[_filt_size - i - 1] = t2;
+                    t.re[_filt_size - i - 1] = t2.re;
+                    t.im[_filt_size - i - 1] = t2.im;
                 }
+
+                t.reQ15 = buffer::alloc<int16_t>(_filt_size);
+                t.imQ15 = buffer::alloc<int16_t>(_filt_size);
+                t.q15Shift = std::min<int>(q15::tapShift(t.re, _filt_size), q15::tapShift(t.im, _filt_size));
+                q15::quantize(t.re, _filt_size, t.q15Shift, t.reQ15);
+                q15::quantize(t.im, _filt_size, t.q15Shift, t.imQ15);
             }
 
             void FLL::setBandwidth(double bandwidth) {
                 assert(base_type::_block_init);
-                std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-                base_type::tempStop();
                 float alpha, beta;
                 PhaseControlLoop<float>::criticallyDamped(bandwidth, alpha, beta);
-                alpha = 0; //we don't need to track phase in FLL
-                pcl.setCoefficients(alpha, beta);
-                base_type::tempStart();
+                pendingBeta.store(beta, std::memory_order_relaxed);
+                coefsPending.store(true, std::memory_order_release);
             }
 
             void FLL::setInitialFreq(double initFreq) {
@@ -123,6 +190,21 @@ namespace dsp {
                 base_type::tempStop();
                 pcl.phase = 0;
                 pcl.freq = _initFreq;
+                lbandedgerrc.reset();
+                hbandedgerrc.reset();
+                memset(beBuffer, 0, (_filt_size - 1) * sizeof(complex_t));
+                memset(beQ15Buffer, 0, (_filt_size - 1) * sizeof(q15::cq15));
+                base_type::tempStart();
+            }
+
+            void FLL::resetHistory() {
+                assert(base_type::_block_init);
+                std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+                base_type::tempStop();
+                lbandedgerrc.reset();
+                hbandedgerrc.reset();
+                memset(beBuffer, 0, (_filt_size - 1) * sizeof(complex_t));
+                memset(beQ15Buffer, 0, (_filt_size - 1) * sizeof(q15::cq15));
                 base_type::tempStart();
             }
 
@@ -132,9 +214,19 @@ namespace dsp {
                 pcl.freq = newf;
             }
 
+            void FLL::setBlockSize(int blockSize) {
+                assert(base_type::_block_init);
+                std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+                base_type::tempStop();
+                _blockSize = std::max<int>(blockSize, 1);
+                base_type::tempStart();
+            }
+
             int FLL::process(int count, complex_t* in, complex_t* out) {
+                takeUpdates();
+                if (_blockSize > 1) { return processBlocks(count, in, out); }
                 for (int i = 0; i < count; i++) {
-                    complex_t shift = math::phasor(-pcl.phase);
+                    complex_t shift = math::lutPhasor(-pcl.phase);
                     complex_t x = in[i] * shift;
                     complex_t lbe_out;
                     complex_t hbe_out;
@@ -147,5 +239,89 @@ namespace dsp {
                 }
                 return count;
             }
+
+            int FLL::processBlocks(int count, const complex_t* in, complex_t* out) {
+                for (int i = 0; i < count; i += _maxCount) {
+                    processChunk(std::min<int>(_maxCount, count - i), &in[i], &out[i]);
+                }
+                return count;
+            }
+
+            int FLL::processChunk(int count, const complex_t* in, complex_t* out) {
+                for (int i = 0; i < count; i += _blockSize) {
+                    int n = std::min<int>(_blockSize, count - i);
+
+                    //Derotate the sub-block with the current correction, stepping the VCO by multiplication
+                    float phase = pcl.phase;
+                    float freq = pcl.freq;
+                    complex_t vco = math::phasor(-phase);
+                    complex_t step = math::phasor(-freq);
+                    for (int j = 0; j < n; j++) {
+                        beBufStart[i + j] = in[i + j] * vco;
+                        vco = vco * step;
+                    }
+
+                    //x*(re + j*im) and x*(re - j*im) give the high and low band-edge outputs
+                    for (int j = 0; j < n; j++) {
+                        complex_t re, im;
+                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&re, (lv_32fc_t*)&beBuffer[i + j], beTapsRe, _filt_size);
+                        volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&im, (lv_32fc_t*)&beBuffer[i + j], beTapsIm, _filt_size);
+                        complex_t hbe_out = { re.re - im.im, re.im + im.re };
+                        complex_t lbe_out = { re.re + im.im, re.im - im.re };
+                        pcl.advance(hbe_out.fastAmplitude() - lbe_out.fastAmplitude());
+                    }
+
+                    //Only the frequency picks up the errors, the phase continues from what was applied
+                    phase += (float)n * freq;
+                    while (phase > FL_M_PI) { phase -= 2.0f * FL_M_PI; }
+                    while (phase < -FL_M_PI) { phase += 2.0f * FL_M_PI; }
+                    pcl.phase = phase;
+                }
+
+                memcpy(out, beBufStart, count * sizeof(complex_t));
+                memmove(beBuffer, &beBuffer[count], (_filt_size - 1) * sizeof(complex_t));
+                return count;
+            }
+
+            int FLL::processQ15(int count, const q15::cq15* in, q15::cq15* out, float scale) {
+                takeUpdates();
+                for (int i = 0; i < count; i += _maxCount) {
+                    processChunkQ15(std::min<int>(_maxCount, count - i), &in[i], &out[i], scale);
+                }
+                return count;
+            }
+
+            int FLL::processChunkQ15(int count, const q15::cq15* in, q15::cq15* out, float scale) {
+                //Back to the units of the float path, so the loop sees the same errors
+                float errScale = 1.0f / (ldexpf(1.0f, beQ15Shift) * scale);
+                for (int i = 0; i < count; i += _blockSize) {
+                    int n = std::min<int>(_blockSize, count - i);
+
+                    //The VCO of the sub-block is an integer phase accumulator, the loop itself stays in float
+                    float phase = pcl.phase;
+                    float freq = pcl.freq;
+                    q15::nco(q15::ncoPhase(-phase), q15::ncoPhase(-freq), beQ15Phasors, n);
+                    q15::rotate(&in[i], beQ15Phasors, &beQ15BufStart[i], n);
+
+                    for (int j = 0; j < n; j++) {
+                        int32_t acc[4];
+                        q15::dot2(&beQ15Buffer[i + j], beTapsReQ15, beTapsImQ15, _filt_size, acc);
+                        complex_t re = { (float)acc[0] * errScale, (float)acc[1] * errScale };
+                        complex_t im = { (float)acc[2] * errScale, (float)acc[3] * errScale };
+                        complex_t hbe_out = { re.re - im.im, re.im + im.re };
+                        complex_t lbe_out = { re.re + im.im, re.im - im.re };
+                        pcl.advance(hbe_out.fastAmplitude() - lbe_out.fastAmplitude());
+                    }
+
+                    phase += (float)n * freq;
+                    while (phase > FL_M_PI) { phase -= 2.0f * FL_M_PI; }
+                    while (phase < -FL_M_PI) { phase += 2.0f * FL_M_PI; }
+                    pcl.phase = phase;
+                }
+
+                memcpy(out, beQ15BufStart, count * sizeof(q15::cq15));
+                memmove(beQ15Buffer, &beQ15Buffer[count], (_filt_size - 1) * sizeof(q15::cq15));
+                return count;
+            }
     }
 }
@@ -18,6 +18,13 @@
 #include <dsp/clock_recovery/mm.h>
 #include <math.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "phasor_lut.h"
+#include "q15_dsp.h"
+#include "tap_cache.h"
 
 namespace dsp {
     namespace loop {
@@ -30,17 +37,39 @@ namespace dsp {
 
             ~FLL();
 
-            void init(stream<complex_t>* in, double bandwidth, int sym_rate, int samp_rate, int filt_size, float filt_a, double initFreq = 0.0, double minFreq = -FL_M_PI, double maxFreq = FL_M_PI);
+            //maxCount sizes the delay buffer of the block mode, longer inputs are taken in pieces of that many samples
+            void init(stream<complex_t>* in, double bandwidth, int sym_rate, int samp_rate, int filt_size, float filt_a, double initFreq = 0.0, double minFreq = -FL_M_PI, double maxFreq = FL_M_PI, int maxCount = STREAM_BUFFER_SIZE);
+            //The rate setters and setBandwidth don't stop the block: the new taps are designed by the caller and
+            //the loop takes them, with the new coefficients, at the start of its next call to process()
             void setSymbolrate(double symbolrate);
             void setSamplerate(double samplerate);
+            void setRates(double symbolrate, double samplerate);
             void createBandedgeFilters();
             void setBandwidth(double bandwidth);
             void setInitialFreq(double initFreq);
             void setFrequencyLimits(double minFreq, double maxFreq);
             void reset();
+            //Clears the delay lines of the band-edge filters, the loop keeps its frequency
+            void resetHistory();
             void force_set_freq(float newf);
 
+            //Samples processed with a frozen frequency correction before the loop is updated, 1 = update after every sample.
+            //Keep it well below 1/bandwidth so the loop dynamics stay the same
+            void setBlockSize(int blockSize);
+
+            //Frequency correction of the loop in Hz
+            double getFrequency() { return pcl.freq * _samplerate / (2.0 * FL_M_PI); }
+
+            //Band-edge taps of the block mode, getFilterSize() each, for running the same loop elsewhere
+            const float* getBandedgeRe() { return beTapsRe; }
+            const float* getBandedgeIm() { return beTapsIm; }
+            int getFilterSize() { return _filt_size; }
+
             int process(int count, complex_t* in, complex_t* out);
+            int processBlocks(int count, const complex_t* in, complex_t* out);
+            //The same loop on int16 samples, scale being what 1.0 of the float path is in them. Always in blocks of
+            //setBlockSize(), the band-edge taps and the derotation in fixed point, the loop itself in float
+            int processQ15(int count, const q15::cq15* in, q15::cq15* out, float scale);
 
             int run() {
                 int count = base_type::_in->read();
@@ -55,7 +84,31 @@ namespace dsp {
 
             // float dbg_last_err = 0;
         protected:
+            //Band-edge taps for one filter and pair of rates, shared through the TapCache
+            struct BandedgeTaps {
+                BandedgeTaps() {}
+                BandedgeTaps(const BandedgeTaps&) = delete;
+                ~BandedgeTaps();
+
+                tap<complex_t> lower = { NULL, 0 };
+                tap<complex_t> upper = { NULL, 0 };
+                float* re = NULL;
+                float* im = NULL;
+                //re and im in fixed point with one shift for both
+                int16_t* reQ15 = NULL;
+                int16_t* imQ15 = NULL;
+                int q15Shift = 0;
+            };
+            std::shared_ptr<const BandedgeTaps> getBandedge(double symbolrate, double samplerate);
+            void designBandedge(BandedgeTaps& t, double symbolrate, double samplerate);
+            void useBandedge();
+            void takeUpdates();
+            int processChunk(int count, const complex_t* in, complex_t* out);
+            int processChunkQ15(int count, const q15::cq15* in, q15::cq15* out, float scale);
+
             PhaseControlLoop<float> pcl;
+            //The taps below point into it
+            std::shared_ptr<const BandedgeTaps> bandedge;
             tap<complex_t> lbandedgerrcTaps;
             filter::FIR<complex_t, complex_t> lbandedgerrc;
             tap<complex_t> hbandedgerrcTaps;
@@ -66,6 +119,32 @@ namespace dsp {
             int _filt_size;
             float _filt_a;
             complex_t lastVCO = { 1.0f, 0.0f };
+
+            //Block mode: the band-edge taps are conjugates of each other, so both outputs are built from the
+            //real and imaginary parts of one tap set, on a delay line holding the derotated input
+            int _blockSize = 1;
+            float* beTapsRe = NULL;
+            float* beTapsIm = NULL;
+            int _maxCount;
+            complex_t* beBuffer = NULL;
+            complex_t* beBufStart = NULL;
+            //Same for processQ15(), with the VCO of a block as Q15 phasors
+            int16_t* beTapsReQ15 = NULL;
+            int16_t* beTapsImQ15 = NULL;
+            int beQ15Shift = 0;
+            q15::cq15* beQ15Buffer = NULL;
+            q15::cq15* beQ15BufStart = NULL;
+            q15::cq15* beQ15Phasors = NULL;
+
+            //Waiting for the next process(). A setter holds pendingMtx while it designs, the DSP thread only
+            //tries it, so it never waits; once taken, pendingBandedge keeps the old taps until the next setter lets go
+            std::mutex pendingMtx;
+            std::shared_ptr<const BandedgeTaps> pendingBandedge;
+            double pendingSymbolrate;
+            double pendingSamplerate;
+            std::atomic<bool> tapsPending = false;
+            std::atomic<float> pendingBeta = 0.0f;
+            std::atomic<bool> coefsPending = false;
         };
     }
 }
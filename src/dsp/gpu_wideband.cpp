@@ -0,0 +1,843 @@
+#include "gpu_wideband.h"
+
+#include <dsp/taps/windowed_sinc.h>
+#include <dsp/window/nuttall.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "complex_fd.h"
+#include "fll.h"
+#include "pi4dqpsk.h"
+
+#ifdef TETRA_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+//Channelizer frames taken through the kernels at once, sizes the device buffers. Longer blocks take several passes
+#define WBGPU_CHUNK_FRAMES 2048
+//Interpolator of the clock recovery, as PI4DQPSK sets it up
+#define WBGPU_FD_PHASES 128
+#define WBGPU_FD_TAPS 8
+
+namespace dsp {
+    namespace gpu {
+        //The kernels keep the state of a channel in one of these, same layout as in the kernel source
+        struct ChannelState {
+            float agcAmp;
+            int rsPhase;
+            int rsOffset;
+            float fllPhase;
+            float fllFreq;
+            float fdPhase;
+            float fdOmega;
+            int fdOffset;
+            float costasPhase;
+            float costasFreq;
+            int costasPh2;
+            float lockError;
+            int locked;
+            int symbolCount;
+        };
+
+        //Loop coefficients, [0] while unlocked and [1] once locked. Same layout as in the kernel source
+        struct DemodCoefs {
+            float agcRate;
+            float agcSetPoint;
+            float agcMaxGain;
+            int feInterp;
+            int feDecim;
+            int feTaps;
+            int fllTaps;
+            int fllBlock;
+            float fllMinFreq;
+            float fllMaxFreq;
+            float fllBeta[2];
+            int fdPhases;
+            int fdTaps;
+            float fdMinOmega;
+            float fdMaxOmega;
+            float fdMu[2];
+            float fdOmegaGain[2];
+            float costasAlpha[2];
+            float costasBeta[2];
+            float costasMaxFreq;
+            float lockRate;
+            float lockEnter;
+            float lockExit;
+        };
+
+        //fold and fftStage channelize as PolyphaseChannelizer::process() does, the radix-2 Stockham FFT standing in for
+        //FFTW. demod then runs one work item per channel through the stages of PI4DQPSK::process() with the front end,
+        //each stage as its CPU block does it. The delay lines of a channel are in its own rows of feBufs and fllBufs
+        static const char* kernelSource = R"CLC(
+typedef struct {
+    float agcAmp;
+    int rsPhase;
+    int rsOffset;
+    float fllPhase;
+    float fllFreq;
+    float fdPhase;
+    float fdOmega;
+    int fdOffset;
+    float costasPhase;
+    float costasFreq;
+    int costasPh2;
+    float lockError;
+    int locked;
+    int symbolCount;
+} ChannelState;
+
+typedef struct {
+    float agcRate;
+    float agcSetPoint;
+    float agcMaxGain;
+    int feInterp;
+    int feDecim;
+    int feTaps;
+    int fllTaps;
+    int fllBlock;
+    float fllMinFreq;
+    float fllMaxFreq;
+    float fllBeta[2];
+    int fdPhases;
+    int fdTaps;
+    float fdMinOmega;
+    float fdMaxOmega;
+    float fdMu[2];
+    float fdOmegaGain[2];
+    float costasAlpha[2];
+    float costasBeta[2];
+    float costasMaxFreq;
+    float lockRate;
+    float lockEnter;
+    float lockExit;
+} DemodCoefs;
+
+#define WB_PI 3.14159265358979f
+
+//phasor(-k*pi/4)
+__constant float pi4Re[8] = { 1.0f, 0.70710678f, 0.0f, -0.70710678f, -1.0f, -0.70710678f, 0.0f, 0.70710678f };
+__constant float pi4Im[8] = { 0.0f, -0.70710678f, -1.0f, -0.70710678f, 0.0f, 0.70710678f, 1.0f, 0.70710678f };
+
+inline float2 mk2(float x, float y) {
+    float2 r;
+    r.x = x;
+    r.y = y;
+    return r;
+}
+
+inline float2 cmul(float2 a, float2 b) {
+    return mk2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+inline float fastAmp(float2 a) {
+    float re = fabs(a.x);
+    float im = fabs(a.y);
+    return (re > im) ? (re + 0.4f * im) : (im + 0.4f * re);
+}
+
+inline float sgn(float x) {
+    return (x > 0.0f) ? 1.0f : -1.0f;
+}
+
+inline float clampf(float x, float lo, float hi) {
+    return fmin(fmax(x, lo), hi);
+}
+
+//One work item per branch r and frame f: the window of the frame times the reversed prototype, folded onto M branches
+__kernel void fold(__global const float2* buf, __global const float* revTaps, __global float2* spec, int M, int tapsPerChannel, int decimation, int offset) {
+    int r = get_global_id(0);
+    int f = get_global_id(1);
+    int k = M - 1 - r;
+    __global const float2* x = &buf[offset + f * decimation + k];
+    __global const float* t = &revTaps[k];
+    float2 acc = mk2(0.0f, 0.0f);
+    for (int q = 0; q < tapsPerChannel; q++) {
+        acc += x[q * M] * t[q * M];
+    }
+    spec[f * M + r] = acc;
+}
+
+//One radix-2 stage over every frame, ns the size of the sub-transforms done so far. twiddle[i] is exp(2j*pi*i/M)
+__kernel void fftStage(__global const float2* src, __global float2* dst, __global const float2* twiddle, int M, int ns) {
+    int j = get_global_id(0);
+    int f = get_global_id(1);
+    int half = M / 2;
+    int k = j & (ns - 1);
+    __global const float2* s = &src[f * M];
+    __global float2* d = &dst[f * M];
+    float2 a = s[j];
+    float2 b = cmul(s[j + half], twiddle[k * (half / ns)]);
+    int o = ((j - k) << 1) + k;
+    d[o] = a + b;
+    d[o + ns] = a - b;
+}
+
+__kernel void demod(__global const float2* spec, int M, int frames, int rotIndex, int decimation, __global const float2* rot,
+                    __global const int* work, __global ChannelState* states, __global const DemodCoefs* c,
+                    __global const float* feBank, __global const float* fllRe, __global const float* fllIm,
+                    __global const float* fdInterp, __global const float* fdDiff,
+                    __global float2* feBufs, int feStride, __global float2* fllBufs, int fllStride,
+                    __global float2* symbols, int channels) {
+    int w = get_global_id(0);
+    int slot = work[2 * w];
+    int bin = work[2 * w + 1];
+    ChannelState s = states[slot];
+    __global float2* fe = &feBufs[slot * feStride];
+    __global float2* fl = &fllBufs[slot * fllStride];
+    int feHist = c->feTaps - 1;
+    int fllHist = c->fllTaps - 1;
+
+    //The bin with the phase ramp of the decimation removed, then the AGC
+    for (int f = 0; f < frames; f++) {
+        int ri = (rotIndex + f * decimation) % M;
+        float2 x = cmul(spec[f * M + bin], rot[(bin * ri) % M]);
+        float amp = sqrt(x.x * x.x + x.y * x.y);
+        float gain = 1.0f;
+        if (amp != 0.0f) {
+            s.agcAmp = (amp > s.agcAmp) ? amp : (s.agcAmp * (1.0f - c->agcRate)) + (amp * c->agcRate);
+            gain = fmin(c->agcSetPoint / s.agcAmp, c->agcMaxGain);
+        }
+        fe[feHist + f] = x * gain;
+    }
+
+    //Resampling RRC, into the delay line of the FLL
+    int n = 0;
+    while (s.rsOffset < frames) {
+        __global const float* t = &feBank[s.rsPhase * c->feTaps];
+        __global const float2* x = &fe[s.rsOffset];
+        float2 acc = mk2(0.0f, 0.0f);
+        for (int k = 0; k < c->feTaps; k++) {
+            acc += x[k] * t[k];
+        }
+        fl[fllHist + n++] = acc;
+        s.rsPhase += c->feDecim;
+        s.rsOffset += s.rsPhase / c->feInterp;
+        s.rsPhase %= c->feInterp;
+    }
+    s.rsOffset -= frames;
+    for (int k = 0; k < feHist; k++) {
+        fe[k] = fe[frames + k];
+    }
+
+    //FLL in blocks of a frozen correction, derotating in place
+    for (int i = 0; i < n; i += c->fllBlock) {
+        int b = min(c->fllBlock, n - i);
+        float phase = s.fllPhase;
+        float freq = s.fllFreq;
+        float2 vco = mk2(cos(phase), -sin(phase));
+        float2 step = mk2(cos(freq), -sin(freq));
+        for (int j = 0; j < b; j++) {
+            fl[fllHist + i + j] = cmul(fl[fllHist + i + j], vco);
+            vco = cmul(vco, step);
+        }
+        for (int j = 0; j < b; j++) {
+            __global const float2* x = &fl[i + j];
+            float2 re = mk2(0.0f, 0.0f);
+            float2 im = mk2(0.0f, 0.0f);
+            for (int k = 0; k < c->fllTaps; k++) {
+                re += x[k] * fllRe[k];
+                im += x[k] * fllIm[k];
+            }
+            float2 hbe = mk2(re.x - im.y, re.y + im.x);
+            float2 lbe = mk2(re.x + im.y, re.y - im.x);
+            s.fllFreq = clampf(s.fllFreq + c->fllBeta[s.locked] * (fastAmp(hbe) - fastAmp(lbe)), c->fllMinFreq, c->fllMaxFreq);
+        }
+        phase += (float)b * freq;
+        while (phase > WB_PI) { phase -= 2.0f * WB_PI; }
+        while (phase < -WB_PI) { phase += 2.0f * WB_PI; }
+        s.fllPhase = phase;
+    }
+
+    //Clock recovery at one output per symbol, its delay line is the tail of the FLL's. Every symbol goes on through
+    //the Costas loop and the lock detector
+    __global const float2* fd = &fl[c->fllTaps - c->fdTaps];
+    int count = 0;
+    while (s.fdOffset < n) {
+        int ph = (int)floor(s.fdPhase * (float)c->fdPhases);
+        ph = min(max(ph, 0), c->fdPhases - 1);
+        __global const float2* x = &fd[s.fdOffset];
+        __global const float* ti = &fdInterp[ph * c->fdTaps];
+        __global const float* td = &fdDiff[ph * c->fdTaps];
+        float2 y = mk2(0.0f, 0.0f);
+        float2 dy = mk2(0.0f, 0.0f);
+        for (int k = 0; k < c->fdTaps; k++) {
+            y += x[k] * ti[k];
+            dy += x[k] * td[k];
+        }
+        float err = clampf(sgn(y.x) * dy.x + sgn(y.y) * dy.y, -1.0f, 1.0f);
+        s.fdOmega = clampf(s.fdOmega + c->fdOmegaGain[s.locked] * err, c->fdMinOmega, c->fdMaxOmega);
+        s.fdPhase += s.fdOmega + c->fdMu[s.locked] * err;
+        float delta = floor(s.fdPhase);
+        s.fdOffset += (int)delta;
+        s.fdPhase -= delta;
+
+        float2 z = cmul(y, mk2(cos(s.costasPhase), -sin(s.costasPhase)));
+        s.costasPh2 = (s.costasPh2 + 1) & 7;
+        z = cmul(z, mk2(pi4Re[s.costasPh2], pi4Im[s.costasPh2]));
+        float cerr = clampf(sgn(z.x) * z.y - sgn(z.y) * z.x, -1.0f, 1.0f);
+        s.costasFreq = clampf(s.costasFreq + c->costasBeta[s.locked] * cerr, -c->costasMaxFreq, c->costasMaxFreq);
+        s.costasPhase += s.costasFreq + c->costasAlpha[s.locked] * cerr;
+        while (s.costasPhase > WB_PI) { s.costasPhase -= 2.0f * WB_PI; }
+        while (s.costasPhase < -WB_PI) { s.costasPhase += 2.0f * WB_PI; }
+        symbols[count * channels + w] = z;
+        count++;
+
+        float are = fabs(z.x);
+        float aim = fabs(z.y);
+        float r = fabs(aim - are) / (aim + are + 1e-20f);
+        float dist = r * ((WB_PI / 4.0f) + (0.273f * (1.0f - r)));
+        s.lockError += (dist - s.lockError) * c->lockRate;
+        s.locked = (s.lockError < (s.locked ? c->lockExit : c->lockEnter)) ? 1 : 0;
+    }
+    s.fdOffset -= n;
+    for (int k = 0; k < fllHist; k++) {
+        fl[k] = fl[n + k];
+    }
+
+    s.symbolCount = count;
+    states[slot] = s;
+}
+)CLC";
+
+#ifdef TETRA_OPENCL
+        struct WidebandDemod::Device {
+            ~Device() {
+                for (cl_mem m : mems) { clReleaseMemObject(m); }
+                if (fold) { clReleaseKernel(fold); }
+                if (fftStage) { clReleaseKernel(fftStage); }
+                if (demod) { clReleaseKernel(demod); }
+                if (program) { clReleaseProgram(program); }
+                if (queue) { clReleaseCommandQueue(queue); }
+                if (context) { clReleaseContext(context); }
+            }
+
+            cl_mem alloc(size_t size) {
+                cl_int err;
+                cl_mem m = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, &err);
+                check(err, "clCreateBuffer");
+                mems.push_back(m);
+                return m;
+            }
+
+            void zero(cl_mem m, size_t offset, size_t size) {
+                float pattern = 0.0f;
+                check(clEnqueueFillBuffer(queue, m, &pattern, sizeof(pattern), offset, size, 0, NULL, NULL), "clEnqueueFillBuffer");
+            }
+
+            static void check(cl_int err, const char* what) {
+                if (err == CL_SUCCESS) { return; }
+                throw std::runtime_error(std::string("[WidebandDemod] ") + what + " failed with " + std::to_string(err));
+            }
+
+            template <class T>
+            static void arg(cl_kernel k, int index, const T& value) {
+                check(clSetKernelArg(k, index, sizeof(T), &value), "clSetKernelArg");
+            }
+
+            cl_device_id device = NULL;
+            cl_context context = NULL;
+            cl_command_queue queue = NULL;
+            cl_program program = NULL;
+            cl_kernel fold = NULL;
+            cl_kernel fftStage = NULL;
+            cl_kernel demod = NULL;
+            std::vector<cl_mem> mems;
+
+            //The input with the history of the prototype filter in front, two of them taking turns
+            cl_mem in[2];
+            cl_mem revTaps;
+            //Fold output and the FFT stages, ping-ponged
+            cl_mem spec[2];
+            cl_mem twiddle;
+            cl_mem rot;
+            cl_mem coefs;
+            cl_mem feBank;
+            cl_mem fllRe;
+            cl_mem fllIm;
+            cl_mem fdInterp;
+            cl_mem fdDiff;
+            cl_mem states;
+            cl_mem work;
+            cl_mem feBufs;
+            cl_mem fllBufs;
+            cl_mem symbols;
+            int feStride;
+            int fllStride;
+            //Symbols a channel may bring out of one pass
+            int maxSymbols;
+        };
+
+        //The first GPU of any platform, or the first accelerator
+        static cl_device_id findDevice(std::string& name) {
+            cl_uint platformCount = 0;
+            if (clGetPlatformIDs(0, NULL, &platformCount) != CL_SUCCESS || !platformCount) {
+                name = "no OpenCL platform";
+                return NULL;
+            }
+            std::vector<cl_platform_id> platforms(platformCount);
+            clGetPlatformIDs(platformCount, platforms.data(), NULL);
+            for (cl_device_type type : { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ACCELERATOR }) {
+                for (cl_platform_id p : platforms) {
+                    cl_device_id d;
+                    cl_uint n = 0;
+                    if (clGetDeviceIDs(p, type, 1, &d, &n) != CL_SUCCESS || !n) { continue; }
+                    char buf[256] = { 0 };
+                    clGetDeviceInfo(d, CL_DEVICE_NAME, sizeof(buf) - 1, buf, NULL);
+                    name = buf;
+                    return d;
+                }
+            }
+            name = "no OpenCL GPU";
+            return NULL;
+        }
+#else
+        struct WidebandDemod::Device {};
+#endif
+
+        WidebandDemod::WidebandDemod() {}
+
+        WidebandDemod::WidebandDemod(stream<complex_t>* in, int channelCount, int decimation, const Params& params, int maxChannels, int tapsPerChannel, double cutoff) {
+            init(in, channelCount, decimation, params, maxChannels, tapsPerChannel, cutoff);
+        }
+
+        WidebandDemod::~WidebandDemod() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            for (auto& ch : channels) {
+                buffer::free(ch.out->symbols);
+                ch.out->symbols = NULL;
+            }
+        }
+
+        bool WidebandDemod::isAvailable(std::string& device) {
+#ifdef TETRA_OPENCL
+            return findDevice(device) != NULL;
+#else
+            device = "built without OpenCL";
+            return false;
+#endif
+        }
+
+        void WidebandDemod::init(stream<complex_t>* in, int channelCount, int decimation, const Params& params, int maxChannels, int tapsPerChannel, double cutoff) {
+            assert(channelCount > 0);
+            assert(decimation > 0 && decimation <= channelCount);
+            if (channelCount & (channelCount - 1)) {
+                throw std::runtime_error("[WidebandDemod] The channel count has to be a power of two");
+            }
+            _channelCount = channelCount;
+            _decimation = decimation;
+            _tapsPerChannel = tapsPerChannel;
+            _tapCount = _channelCount * _tapsPerChannel;
+            _maxChannels = std::max<int>(maxChannels, 1);
+            _params = params;
+
+#ifdef TETRA_OPENCL
+            //The same loops PI4DQPSK runs: its front end taps, and the band-edge taps and interpolator banks of an FLL and
+            //a clock recovery set up as it sets them up
+            int interp, decim;
+            std::shared_ptr<const SharedTaps<float>> frontEnd = demod::PI4DQPSK::designFrontEndTaps(params.symbolrate, params.samplerate, params.rrcTapCount, params.rrcBeta, params.channelSamplerate, interp, decim);
+            if (!frontEnd) {
+                throw std::runtime_error("[WidebandDemod] The channels have to come out faster than the demodulator samplerate");
+            }
+            loop::FLL fll;
+            fll.init(NULL, params.fllBandwidth, params.symbolrate, params.samplerate, params.rrcTapCount, params.rrcBeta, 0, -FL_M_PI/2.0f, FL_M_PI/2.0f, 1);
+            clock_recovery::COMPLEX_FD recov;
+            recov.init(NULL, params.samplerate / params.symbolrate, params.omegaGain, params.muGain, params.omegaRelLimit, 1, WBGPU_FD_PHASES, WBGPU_FD_TAPS, 1);
+            if (fll.getFilterSize() < WBGPU_FD_TAPS) {
+                throw std::runtime_error("[WidebandDemod] The FLL delay line is too short for the clock recovery");
+            }
+
+            DemodCoefs c;
+            memset(&c, 0, sizeof(c));
+            c.agcRate = params.agcRate;
+            c.agcSetPoint = 1.0f;
+            c.agcMaxGain = 10e6;
+            c.feInterp = interp;
+            c.feDecim = decim;
+            multirate::PolyphaseBank<float> feBank = multirate::buildPolyphaseBank<float>(interp, const_cast<tap<float>&>(frontEnd->taps));
+            c.feTaps = feBank.tapsPerPhase;
+            c.fllTaps = fll.getFilterSize();
+            c.fllBlock = PI4DQPSK_FLL_BLOCK_SIZE;
+            c.fllMinFreq = -FL_M_PI / 2.0f;
+            c.fllMaxFreq = FL_M_PI / 2.0f;
+            c.fdPhases = WBGPU_FD_PHASES;
+            c.fdTaps = WBGPU_FD_TAPS;
+            double omega = params.samplerate / params.symbolrate;
+            c.fdMinOmega = omega * (1.0 - params.omegaRelLimit);
+            c.fdMaxOmega = omega * (1.0 + params.omegaRelLimit);
+            c.costasMaxFreq = FL_M_PI / 10.0f;
+            c.lockRate = PI4DQPSK_LOCK_AVG_RATE;
+            c.lockEnter = PI4DQPSK_LOCK_ENTER_ERROR;
+            c.lockExit = PI4DQPSK_LOCK_EXIT_ERROR;
+            //As PI4DQPSK::applyLoopBandwidths() with adaptive bandwidth and without a coarse acquisition
+            for (int locked = 0; locked < 2; locked++) {
+                double scale = locked ? PI4DQPSK_LOCK_NARROW_SCALE : PI4DQPSK_LOCK_WIDE_SCALE;
+                double clockScale = locked ? PI4DQPSK_LOCK_NARROW_SCALE : 1.0;
+                float alpha, beta;
+                loop::PhaseControlLoop<float>::criticallyDamped(params.fllBandwidth * scale, alpha, beta);
+                c.fllBeta[locked] = beta;
+                loop::PhaseControlLoop<float>::criticallyDamped(params.costasBandwidth * scale, alpha, beta);
+                c.costasAlpha[locked] = alpha;
+                c.costasBeta[locked] = beta;
+                c.fdMu[locked] = params.muGain * clockScale;
+                c.fdOmegaGain[locked] = params.omegaGain * clockScale * clockScale;
+            }
+
+            //Prototype filter and phase ramp as PolyphaseChannelizer::generateTaps()
+            dsp::tap<float> proto = dsp::taps::windowedSinc<float>(_tapCount, dsp::math::hzToRads(cutoff / (double)_channelCount, 1.0), dsp::window::nuttall);
+            std::vector<float> revTaps(_tapCount);
+            for (int i = 0; i < _tapCount; i++) { revTaps[i] = proto.taps[_tapCount - 1 - i]; }
+            taps::free(proto);
+            std::vector<complex_t> rot(_channelCount);
+            std::vector<complex_t> twiddle(_channelCount / 2);
+            for (int i = 0; i < _channelCount; i++) {
+                float ph = -2.0f * FL_M_PI * (float)i / (float)_channelCount;
+                rot[i] = { cosf(ph), sinf(ph) };
+            }
+            for (int i = 0; i < _channelCount / 2; i++) {
+                double ph = 2.0 * M_PI * (double)i / (double)_channelCount;
+                twiddle[i] = { (float)cos(ph), (float)sin(ph) };
+            }
+            std::vector<float> feFlat(interp * c.feTaps);
+            for (int p = 0; p < interp; p++) { memcpy(&feFlat[p * c.feTaps], feBank.phases[p], c.feTaps * sizeof(float)); }
+            multirate::freePolyphaseBank(feBank);
+            const multirate::PolyphaseBank<float>& ib = recov.getInterpBank();
+            const multirate::PolyphaseBank<float>& db = recov.getDiffBank();
+            std::vector<float> fdInterp(WBGPU_FD_PHASES * WBGPU_FD_TAPS);
+            std::vector<float> fdDiff(WBGPU_FD_PHASES * WBGPU_FD_TAPS);
+            for (int p = 0; p < WBGPU_FD_PHASES; p++) {
+                memcpy(&fdInterp[p * WBGPU_FD_TAPS], ib.phases[p], WBGPU_FD_TAPS * sizeof(float));
+                memcpy(&fdDiff[p * WBGPU_FD_TAPS], db.phases[p], WBGPU_FD_TAPS * sizeof(float));
+            }
+
+            std::unique_ptr<Device> d = std::make_unique<Device>();
+            d->device = findDevice(deviceName);
+            if (!d->device) { throw std::runtime_error("[WidebandDemod] " + deviceName); }
+            cl_int err;
+            d->context = clCreateContext(NULL, 1, &d->device, NULL, NULL, &err);
+            Device::check(err, "clCreateContext");
+            d->queue = clCreateCommandQueue(d->context, d->device, 0, &err);
+            Device::check(err, "clCreateCommandQueue");
+            d->program = clCreateProgramWithSource(d->context, 1, &kernelSource, NULL, &err);
+            Device::check(err, "clCreateProgramWithSource");
+            if (clBuildProgram(d->program, 1, &d->device, "", NULL, NULL) != CL_SUCCESS) {
+                size_t len = 0;
+                clGetProgramBuildInfo(d->program, d->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &len);
+                std::string log(len, '\0');
+                clGetProgramBuildInfo(d->program, d->device, CL_PROGRAM_BUILD_LOG, len, &log[0], NULL);
+                throw std::runtime_error("[WidebandDemod] The kernels did not build: " + log);
+            }
+            d->fold = clCreateKernel(d->program, "fold", &err);
+            Device::check(err, "clCreateKernel");
+            d->fftStage = clCreateKernel(d->program, "fftStage", &err);
+            Device::check(err, "clCreateKernel");
+            d->demod = clCreateKernel(d->program, "demod", &err);
+            Device::check(err, "clCreateKernel");
+
+            auto upload = [&](const void* data, size_t size) {
+                cl_mem m = d->alloc(size);
+                Device::check(clEnqueueWriteBuffer(d->queue, m, CL_TRUE, 0, size, data, 0, NULL, NULL), "clEnqueueWriteBuffer");
+                return m;
+            };
+            size_t inSize = (_tapCount - 1 + WBGPU_CHUNK_FRAMES * _decimation) * sizeof(complex_t);
+            for (int i = 0; i < 2; i++) {
+                d->in[i] = d->alloc(inSize);
+                d->zero(d->in[i], 0, inSize);
+                d->spec[i] = d->alloc((size_t)_channelCount * WBGPU_CHUNK_FRAMES * sizeof(complex_t));
+            }
+            d->revTaps = upload(revTaps.data(), revTaps.size() * sizeof(float));
+            d->twiddle = upload(twiddle.data(), twiddle.size() * sizeof(complex_t));
+            d->rot = upload(rot.data(), rot.size() * sizeof(complex_t));
+            d->coefs = upload(&c, sizeof(c));
+            d->feBank = upload(feFlat.data(), feFlat.size() * sizeof(float));
+            d->fllRe = upload(fll.getBandedgeRe(), c.fllTaps * sizeof(float));
+            d->fllIm = upload(fll.getBandedgeIm(), c.fllTaps * sizeof(float));
+            d->fdInterp = upload(fdInterp.data(), fdInterp.size() * sizeof(float));
+            d->fdDiff = upload(fdDiff.data(), fdDiff.size() * sizeof(float));
+
+            //Resampler output of a pass, and at most as many symbols with omega > 1
+            int maxResampled = (int)((int64_t)WBGPU_CHUNK_FRAMES * interp / decim) + 2;
+            d->feStride = c.feTaps - 1 + WBGPU_CHUNK_FRAMES;
+            d->fllStride = c.fllTaps - 1 + maxResampled;
+            d->maxSymbols = maxResampled;
+            d->states = d->alloc(_maxChannels * sizeof(ChannelState));
+            d->work = d->alloc(_maxChannels * 2 * sizeof(int));
+            d->feBufs = d->alloc((size_t)_maxChannels * d->feStride * sizeof(complex_t));
+            d->fllBufs = d->alloc((size_t)_maxChannels * d->fllStride * sizeof(complex_t));
+            d->symbols = d->alloc((size_t)_maxChannels * d->maxSymbols * sizeof(complex_t));
+            Device::check(clFinish(d->queue), "clFinish");
+            dev = std::move(d);
+
+            slotUsed.assign(_maxChannels, false);
+            stateScratch.resize(_maxChannels * sizeof(ChannelState));
+            symScratch.resize((size_t)_maxChannels * dev->maxSymbols);
+            offset = 0;
+            rotIndex = 0;
+            inCur = 0;
+            inLast = 0;
+
+            base_type::init(in);
+#else
+            throw std::runtime_error("[WidebandDemod] Built without OpenCL");
+#endif
+        }
+
+        void WidebandDemod::bindChannel(int bin, Output* out) {
+            addChannel(bin, out, NULL);
+        }
+
+        void WidebandDemod::bindChannel(std::atomic<int>* bin, Output* out) {
+            addChannel(bin->load(), out, bin);
+        }
+
+        void WidebandDemod::addChannel(int bin, Output* out, std::atomic<int>* binSrc) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (!validBin(bin)) {
+                throw std::runtime_error("[WidebandDemod] Tried to bind a channel outside of the channelizer bandwidth");
+            }
+            for (const auto& ch : channels) {
+                if (ch.out == out) {
+                    throw std::runtime_error("[WidebandDemod] Tried to bind an output that is already bound");
+                }
+            }
+            auto free = std::find(slotUsed.begin(), slotUsed.end(), false);
+            if (free == slotUsed.end()) {
+                throw std::runtime_error("[WidebandDemod] Tried to bind more channels than it was set up for");
+            }
+            base_type::tempStop();
+            int slot = free - slotUsed.begin();
+            initSlot(slot);
+            slotUsed[slot] = true;
+            out->symbols = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE);
+            out->count = 0;
+            out->resumeSymbols = 0.0;
+            out->locked = false;
+            out->fllFrequency = 0.0;
+            channels.push_back({ (bin + _channelCount) % _channelCount, out, binSrc, slot });
+            base_type::tempStart();
+        }
+
+        void WidebandDemod::unbindChannel(Output* out) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            for (auto it = channels.begin(); it != channels.end(); it++) {
+                if (it->out != out) { continue; }
+                base_type::tempStop();
+                slotUsed[it->slot] = false;
+                buffer::free(out->symbols);
+                out->symbols = NULL;
+                out->count = 0;
+                channels.erase(it);
+                base_type::tempStart();
+                return;
+            }
+            throw std::runtime_error("[WidebandDemod] Tried to unbind an output that isn't bound");
+        }
+
+        //A channel starting out as PI4DQPSK::init() leaves it, with empty delay lines
+        void WidebandDemod::initSlot(int slot) {
+#ifdef TETRA_OPENCL
+            ChannelState s;
+            memset(&s, 0, sizeof(s));
+            s.agcAmp = 1.0f;
+            s.fdOmega = _params.samplerate / _params.symbolrate;
+            s.lockError = FL_M_PI / 8.0f;
+            Device::check(clEnqueueWriteBuffer(dev->queue, dev->states, CL_TRUE, slot * sizeof(ChannelState), sizeof(s), &s, 0, NULL, NULL), "clEnqueueWriteBuffer");
+            dev->zero(dev->feBufs, (size_t)slot * dev->feStride * sizeof(complex_t), dev->feStride * sizeof(complex_t));
+            dev->zero(dev->fllBufs, (size_t)slot * dev->fllStride * sizeof(complex_t), dev->fllStride * sizeof(complex_t));
+            Device::check(clFinish(dev->queue), "clFinish");
+#endif
+        }
+
+        void WidebandDemod::setThreadTuning(const ThreadTuning* tuning) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            threadTuning = tuning;
+            base_type::tempStart();
+        }
+
+        void WidebandDemod::setOutputHandler(void (*handler)(int count, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _handler = handler;
+            _handlerCtx = ctx;
+            base_type::tempStart();
+        }
+
+        void WidebandDemod::setSuspended(bool suspended) {
+            this->suspended.store(suspended, std::memory_order_relaxed);
+        }
+
+        std::string WidebandDemod::getError() {
+            std::lock_guard<std::mutex> lck(errorMtx);
+            return error;
+        }
+
+        void WidebandDemod::fail(const std::string& err) {
+            std::lock_guard<std::mutex> lck(errorMtx);
+            error = err;
+            failed = true;
+        }
+
+        int WidebandDemod::run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = process(count, base_type::_in->readBuf);
+
+            base_type::_in->flush();
+            if (outCount && _handler) {
+                _handler(outCount, _handlerCtx);
+            }
+            return count;
+        }
+
+        int WidebandDemod::process(int count, const complex_t* in) {
+            if (suspended.load(std::memory_order_relaxed) || failed) {
+                for (auto& ch : channels) { ch.out->count = 0; }
+                droppedSamples += count;
+                return 0;
+            }
+            double resume = 0.0;
+            if (droppedSamples) {
+                resume = (double)droppedSamples / (double)_decimation * _params.symbolrate / _params.channelSamplerate;
+                droppedSamples = 0;
+            }
+
+            //Pick up the retuned channels, a block always comes from a single bin
+            for (auto& ch : channels) {
+                ch.out->count = 0;
+                ch.out->resumeSymbols = resume;
+                if (!ch.binSrc) { continue; }
+                int b = ch.binSrc->load(std::memory_order_relaxed);
+                if (validBin(b)) { ch.bin = (b + _channelCount) % _channelCount; }
+            }
+
+            int outCount = 0;
+            int chunk = WBGPU_CHUNK_FRAMES * _decimation;
+            try {
+                for (int i = 0; i < count; i += chunk) {
+                    outCount += processChunk(std::min<int>(chunk, count - i), &in[i]);
+                }
+            }
+            catch (const std::exception& e) {
+                fail(e.what());
+                return 0;
+            }
+            return outCount;
+        }
+
+        int WidebandDemod::processChunk(int count, const complex_t* in) {
+#ifdef TETRA_OPENCL
+            Device& d = *dev;
+            cl_command_queue q = d.queue;
+            //The last _tapCount - 1 samples of the other buffer go in front of the new ones
+            cl_mem prev = d.in[inCur];
+            inCur ^= 1;
+            cl_mem buf = d.in[inCur];
+            Device::check(clEnqueueCopyBuffer(q, prev, buf, inLast * sizeof(complex_t), 0, (_tapCount - 1) * sizeof(complex_t), 0, NULL, NULL), "clEnqueueCopyBuffer");
+            Device::check(clEnqueueWriteBuffer(q, buf, CL_FALSE, (_tapCount - 1) * sizeof(complex_t), count * sizeof(complex_t), in, 0, NULL, NULL), "clEnqueueWriteBuffer");
+            inLast = count;
+
+            int frames = (offset < count) ? (count - offset + _decimation - 1) / _decimation : 0;
+            int channelCount = channels.size();
+            if (frames && channelCount) {
+                size_t foldSize[2] = { (size_t)_channelCount, (size_t)frames };
+                Device::arg(d.fold, 0, buf);
+                Device::arg(d.fold, 1, d.revTaps);
+                Device::arg(d.fold, 2, d.spec[0]);
+                Device::arg(d.fold, 3, _channelCount);
+                Device::arg(d.fold, 4, _tapsPerChannel);
+                Device::arg(d.fold, 5, _decimation);
+                Device::arg(d.fold, 6, offset);
+                Device::check(clEnqueueNDRangeKernel(q, d.fold, 2, NULL, foldSize, NULL, 0, NULL, NULL), "clEnqueueNDRangeKernel");
+
+                int cur = 0;
+                size_t fftSize[2] = { (size_t)_channelCount / 2, (size_t)frames };
+                for (int ns = 1; ns < _channelCount; ns <<= 1) {
+                    Device::arg(d.fftStage, 0, d.spec[cur]);
+                    Device::arg(d.fftStage, 1, d.spec[cur ^ 1]);
+                    Device::arg(d.fftStage, 2, d.twiddle);
+                    Device::arg(d.fftStage, 3, _channelCount);
+                    Device::arg(d.fftStage, 4, ns);
+                    Device::check(clEnqueueNDRangeKernel(q, d.fftStage, 2, NULL, fftSize, NULL, 0, NULL, NULL), "clEnqueueNDRangeKernel");
+                    cur ^= 1;
+                }
+
+                work.resize(2 * channelCount);
+                for (int i = 0; i < channelCount; i++) {
+                    work[2 * i] = channels[i].slot;
+                    work[2 * i + 1] = channels[i].bin;
+                }
+                Device::check(clEnqueueWriteBuffer(q, d.work, CL_FALSE, 0, work.size() * sizeof(int), work.data(), 0, NULL, NULL), "clEnqueueWriteBuffer");
+                cl_kernel k = d.demod;
+                Device::arg(k, 0, d.spec[cur]);
+                Device::arg(k, 1, _channelCount);
+                Device::arg(k, 2, frames);
+                Device::arg(k, 3, rotIndex);
+                Device::arg(k, 4, _decimation);
+                Device::arg(k, 5, d.rot);
+                Device::arg(k, 6, d.work);
+                Device::arg(k, 7, d.states);
+                Device::arg(k, 8, d.coefs);
+                Device::arg(k, 9, d.feBank);
+                Device::arg(k, 10, d.fllRe);
+                Device::arg(k, 11, d.fllIm);
+                Device::arg(k, 12, d.fdInterp);
+                Device::arg(k, 13, d.fdDiff);
+                Device::arg(k, 14, d.feBufs);
+                Device::arg(k, 15, d.feStride);
+                Device::arg(k, 16, d.fllBufs);
+                Device::arg(k, 17, d.fllStride);
+                Device::arg(k, 18, d.symbols);
+                Device::arg(k, 19, channelCount);
+                size_t demodSize = channelCount;
+                Device::check(clEnqueueNDRangeKernel(q, k, 1, NULL, &demodSize, NULL, 0, NULL, NULL), "clEnqueueNDRangeKernel");
+
+                //Symbol s of channel i is at s * channelCount + i, the rows up to the longest channel come back in one read
+                Device::check(clEnqueueReadBuffer(q, d.states, CL_TRUE, 0, stateScratch.size(), stateScratch.data(), 0, NULL, NULL), "clEnqueueReadBuffer");
+                const ChannelState* states = (const ChannelState*)stateScratch.data();
+                int rows = 0;
+                for (const auto& ch : channels) { rows = std::max<int>(rows, states[ch.slot].symbolCount); }
+                rows = std::min<int>(rows, d.maxSymbols);
+                if (rows) {
+                    Device::check(clEnqueueReadBuffer(q, d.symbols, CL_TRUE, 0, (size_t)rows * channelCount * sizeof(complex_t), symScratch.data(), 0, NULL, NULL), "clEnqueueReadBuffer");
+                }
+                for (int i = 0; i < channelCount; i++) {
+                    Output* out = channels[i].out;
+                    const ChannelState& s = states[channels[i].slot];
+                    int n = std::min<int>(std::min<int>(s.symbolCount, rows), STREAM_BUFFER_SIZE - out->count);
+                    for (int j = 0; j < n; j++) {
+                        out->symbols[out->count + j] = symScratch[(size_t)j * channelCount + i];
+                    }
+                    out->count += n;
+                    out->locked.store(s.locked != 0, std::memory_order_relaxed);
+                    out->fllFrequency.store(s.fllFreq * _params.samplerate / (2.0 * FL_M_PI), std::memory_order_relaxed);
+                }
+            }
+            else {
+                //Nothing reads the input before the next pass copies its tail
+                Device::check(clFinish(q), "clFinish");
+            }
+
+            rotIndex = (rotIndex + frames * _decimation) % _channelCount;
+            offset += frames * _decimation - count;
+            return frames;
+#else
+            return 0;
+#endif
+        }
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <dsp/sink.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "thread_tuning.h"
+
+namespace dsp {
+    namespace gpu {
+        //Wideband mode on an OpenCL device: the polyphase FFT channelizer and, for every bound channel, the PI4DQPSK
+        //chain as it runs on a wideband carrier (AGC, resampling RRC, FLL, clock recovery, Costas loop and lock
+        //detector), all channels in one batch. Only the symbols come back, the symbol extractor and the decoder stay
+        //on the CPU. Channelizes as multirate::PolyphaseChannelizer does, the channel count has to be a power of two.
+        //Without TETRA_OPENCL in the build isAvailable() says no and init() throws
+        class WidebandDemod : public Sink<complex_t> {
+            using base_type = Sink<complex_t>;
+        public:
+            //Those of PI4DQPSK::init(), samplerate being the demodulator's and channelSamplerate what each channel comes
+            //out of the channelizer at, the input samplerate / decimation
+            struct Params {
+                double symbolrate;
+                double samplerate;
+                double channelSamplerate;
+                int rrcTapCount;
+                double rrcBeta;
+                double agcRate;
+                double costasBandwidth;
+                double fllBandwidth;
+                double omegaGain;
+                double muGain;
+                double omegaRelLimit;
+            };
+
+            //A bound channel, owned by the caller. After every block symbols holds count symbols, the loop state is
+            //left in the atomics for other threads
+            struct Output {
+                complex_t* symbols = NULL;
+                int count = 0;
+                //Symbols that went by while the block was suspended, on the first block after it and 0 otherwise
+                double resumeSymbols = 0.0;
+                //As PI4DQPSK::isLoopLocked() and getFllFrequency()
+                std::atomic<bool> locked = false;
+                std::atomic<double> fllFrequency = 0.0;
+            };
+
+            //Out of line, Device is only complete in gpu_wideband.cpp
+            WidebandDemod();
+
+            WidebandDemod(stream<complex_t>* in, int channelCount, int decimation, const Params& params, int maxChannels, int tapsPerChannel = 32, double cutoff = 0.6);
+
+            ~WidebandDemod();
+
+            //Whether there is an OpenCL GPU to run on, its name in device or why not
+            static bool isAvailable(std::string& device);
+
+            //At most maxChannels outputs bound at once. Throws if there is no device or it won't take the kernels
+            void init(stream<complex_t>* in, int channelCount, int decimation, const Params& params, int maxChannels, int tapsPerChannel = 32, double cutoff = 0.6);
+
+            //As PolyphaseChannelizer::bindChannel(), out->symbols is allocated here and freed by unbindChannel
+            void bindChannel(int bin, Output* out);
+            void bindChannel(std::atomic<int>* bin, Output* out);
+            void unbindChannel(Output* out);
+
+            //Called on the DSP thread after every block with the channel samples it was, every output holding the
+            //symbols of it. Nothing is written anywhere else
+            void setOutputHandler(void (*handler)(int count, void* ctx), void* ctx);
+
+            //Pins the DSP thread as tuning says, each time the block starts. tuning is the caller's and has to outlive the
+            //block, NULL leaves the thread alone
+            void setThreadTuning(const ThreadTuning* tuning);
+
+            //Suspended, the input is dropped and the loops keep their state, see Output::resumeSymbols
+            void setSuspended(bool suspended);
+
+            int getChannelCount() { return _channelCount; }
+            int getDecimation() { return _decimation; }
+            std::string getDeviceName() { return deviceName; }
+            //Empty until the device failed on a block, the input is dropped from then on
+            std::string getError();
+
+            int run();
+
+            int process(int count, const complex_t* in);
+
+        protected:
+            void doStart() override {
+                base_type::doStart();
+                if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+            }
+
+            struct Channel {
+                int bin;
+                Output* out;
+                std::atomic<int>* binSrc;
+                int slot;
+            };
+            //OpenCL objects, see gpu_wideband.cpp
+            struct Device;
+
+            bool validBin(int bin) { return bin >= -(_channelCount / 2) && bin < _channelCount - (_channelCount / 2); }
+            void addChannel(int bin, Output* out, std::atomic<int>* binSrc);
+            void initSlot(int slot);
+            int processChunk(int count, const complex_t* in);
+            void fail(const std::string& err);
+
+            int _channelCount;
+            int _decimation;
+            int _tapsPerChannel;
+            int _tapCount;
+            int _maxChannels;
+            Params _params;
+            std::string deviceName;
+
+            std::unique_ptr<Device> dev;
+            std::vector<Channel> channels;
+            std::vector<bool> slotUsed;
+            //Per pass: slot and bin of every channel, its state and its symbols
+            std::vector<int> work;
+            std::vector<uint8_t> stateScratch;
+            std::vector<complex_t> symScratch;
+
+            //Channelizer position, as in PolyphaseChannelizer
+            int offset = 0;
+            int rotIndex = 0;
+            int inCur = 0;
+            int inLast = 0;
+
+            std::atomic<bool> suspended = false;
+            uint64_t droppedSamples = 0;
+            std::atomic<bool> failed = false;
+            std::mutex errorMtx;
+            std::string error;
+
+            void (*_handler)(int count, void* ctx) = NULL;
+            void* _handlerCtx = NULL;
+            const ThreadTuning* threadTuning = NULL;
+        };
+    }
+}
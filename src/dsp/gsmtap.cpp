@@ -0,0 +1,191 @@
+#include "gsmtap.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#include <utils/net.h>
+#endif
+
+#define GSMTAP_VERSION 0x02
+#define GSMTAP_TYPE_TETRA_I1 0x05
+
+namespace dsp {
+    //GSMTAP TETRA sub types
+    enum {
+        GSMTAP_TETRA_BSCH = 0x01,
+        GSMTAP_TETRA_AACH = 0x02,
+        GSMTAP_TETRA_SCH_HU = 0x03,
+        GSMTAP_TETRA_SCH_HD = 0x04,
+        GSMTAP_TETRA_SCH_F = 0x05,
+        GSMTAP_TETRA_BNCH = 0x06,
+        GSMTAP_TETRA_STCH = 0x07,
+        GSMTAP_TETRA_TCH_F = 0x08,
+    };
+
+    static int gsmtapSubType(uint8_t lchan) {
+        switch (lchan) {
+            case TETRA_LC_BSCH: return GSMTAP_TETRA_BSCH;
+            case TETRA_LC_AACH: return GSMTAP_TETRA_AACH;
+            case TETRA_LC_SCH_HU: return GSMTAP_TETRA_SCH_HU;
+            case TETRA_LC_SCH_HD: return GSMTAP_TETRA_SCH_HD;
+            case TETRA_LC_SCH_F: return GSMTAP_TETRA_SCH_F;
+            case TETRA_LC_BNCH: return GSMTAP_TETRA_BNCH;
+            case TETRA_LC_STCH: return GSMTAP_TETRA_STCH;
+            case TETRA_LC_TCH: return GSMTAP_TETRA_TCH_F;
+            default: return 0;
+        }
+    }
+
+    int tetraGsmtapEncode(uint8_t* out, const tetra_burst_event& ev) {
+        int subType = gsmtapSubType(ev.lchan);
+        if (ev.kind != TETRA_EV_BLOCK || !subType) { return 0; }
+
+        struct tetra_tdma_time time = ev.time;
+        uint32_t fn = tetra_tdma_time2fn(&time);
+        //All multi-byte fields are in network byte order
+        out[0] = GSMTAP_VERSION;
+        out[1] = GSMTAP_HDR_LEN / 4;
+        out[2] = GSMTAP_TYPE_TETRA_I1;
+        out[3] = ev.time.tn;
+        out[4] = 0; //ARFCN
+        out[5] = 0;
+        out[6] = 0; //signal dBm
+        out[7] = 0; //SNR dB
+        out[8] = fn >> 24;
+        out[9] = fn >> 16;
+        out[10] = fn >> 8;
+        out[11] = fn;
+        out[12] = subType;
+        out[13] = 0; //antenna
+        out[14] = ev.blk_num;
+        out[15] = 0;
+
+        int bytes = (ev.len + 7) / 8;
+        uint8_t* data = &out[GSMTAP_HDR_LEN];
+        for (int i = 0; i < bytes; i++) {
+            uint8_t b = 0;
+            for (int j = 0; j < 8; j++) {
+                unsigned int bit = i * 8 + j;
+                b = (b << 1) | ((bit < ev.len) ? tetra_pwords_get(ev.bits, bit) : 0);
+            }
+            data[i] = b;
+        }
+        return GSMTAP_HDR_LEN + bytes;
+    }
+
+    GsmtapSender::~GsmtapSender() {
+        close();
+    }
+
+    bool GsmtapSender::open(const std::string& host, int port, int flushMs) {
+        close();
+        this->flushMs = flushMs;
+        count = 0;
+        sent = 0;
+        errors = 0;
+#ifdef __linux__
+        struct addrinfo hints = {};
+        struct addrinfo* res;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res)) { return false; }
+        for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+            sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock < 0) { continue; }
+            //Connected, so the batch needs no addresses and ICMP errors come back
+            if (!connect(sock, ai->ai_addr, ai->ai_addrlen)) { break; }
+            ::close(sock);
+            sock = -1;
+        }
+        freeaddrinfo(res);
+        return sock >= 0;
+#else
+        try {
+            conn = net::openudp(host, port);
+        } catch (std::runtime_error& e) {
+            conn.reset();
+        }
+        return isOpen();
+#endif
+    }
+
+    void GsmtapSender::close() {
+        if (!isOpen()) { return; }
+        flush();
+#ifdef __linux__
+        ::close(sock);
+        sock = -1;
+#else
+        conn->close();
+        conn.reset();
+#endif
+    }
+
+    bool GsmtapSender::isOpen() {
+#ifdef __linux__
+        return sock >= 0;
+#else
+        return conn && conn->isOpen();
+#endif
+    }
+
+    void GsmtapSender::write(const tetra_burst_event* events, int n) {
+        if (!isOpen()) { return; }
+        for (int i = 0; i < n; i++) {
+            int len = tetraGsmtapEncode(packets[count], events[i]);
+            if (!len) { continue; }
+            if (!count) { since = std::chrono::steady_clock::now(); }
+            lens[count++] = len;
+            if (count == GSMTAP_BATCH_PACKETS) { flush(); }
+        }
+        poll();
+    }
+
+    void GsmtapSender::poll() {
+        if (count && std::chrono::steady_clock::now() - since >= std::chrono::milliseconds(flushMs)) { flush(); }
+    }
+
+    void GsmtapSender::flush() {
+        if (!count) { return; }
+#ifdef __linux__
+        struct mmsghdr msgs[GSMTAP_BATCH_PACKETS];
+        struct iovec iov[GSMTAP_BATCH_PACKETS];
+        memset(msgs, 0, count * sizeof(msgs[0]));
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = packets[i];
+            iov[i].iov_len = lens[i];
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int done = 0;
+        while (done < count) {
+            int n = sendmmsg(sock, &msgs[done], count - done, 0);
+            if (n <= 0) {
+                //Skip the packet that failed, nobody may be listening yet
+                errors++;
+                done++;
+                continue;
+            }
+            sent += n;
+            done += n;
+        }
+#else
+        for (int i = 0; i < count; i++) {
+            if (conn->send(packets[i], lens[i]) > 0) { sent++; } else { errors++; }
+        }
+#endif
+        count = 0;
+    }
+
+    void GsmtapSender::eventHandler(const tetra_burst_event* events, int count, void* ctx) {
+        ((GsmtapSender*)ctx)->write(events, count);
+    }
+
+    void GsmtapSender::idleHandler(void* ctx) {
+        ((GsmtapSender*)ctx)->poll();
+    }
+}
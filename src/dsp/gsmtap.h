@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+extern "C" {
+    #include "tetra_common.h"
+}
+
+//Port the GSMTAP packets go to, Wireshark dissects it as GSMTAP
+#define GSMTAP_UDP_PORT 4729
+#define GSMTAP_HDR_LEN 16
+//Largest GSMTAP packet of a block record, an SCH/F block
+#define GSMTAP_TETRA_MAX_LEN (GSMTAP_HDR_LEN + (TETRA_EVENT_MAX_BITS + 7) / 8)
+//Packets sent by one system call, a slot brings up to three blocks
+#define GSMTAP_BATCH_PACKETS 64
+#define GSMTAP_DEFAULT_FLUSH_MS 100
+#define GSMTAP_MAX_FLUSH_MS 5000
+
+namespace net { class Socket; }
+
+namespace dsp {
+    //GSMTAP version 2 packet of a TETRA_EV_BLOCK record, type TETRA I1: the header then the type-1 bits of the block
+    //packed MSB first, the way osmo-tetra sends them. The frame number is tetra_tdma_time2fn() of the block and the
+    //sub slot its block number. Returns the bytes written to out, at most GSMTAP_TETRA_MAX_LEN, or 0 for the
+    //records and logical channels GSMTAP has no type for
+    int tetraGsmtapEncode(uint8_t* out, const tetra_burst_event& ev);
+
+    //GSMTAP over UDP of the block records of a decoder, for Wireshark or a collector. The packets are batched and
+    //go out together (with one sendmmsg() on Linux) once GSMTAP_BATCH_PACKETS are waiting or the oldest of them
+    //waited the flush interval. Fits a BurstEventReader, calls come from one thread at a time
+    class GsmtapSender {
+    public:
+        GsmtapSender() {}
+
+        ~GsmtapSender();
+
+        //false if host does not resolve or the socket can't be opened
+        bool open(const std::string& host, int port = GSMTAP_UDP_PORT, int flushMs = GSMTAP_DEFAULT_FLUSH_MS);
+        //Sends what is batched
+        void close();
+        bool isOpen();
+
+        //Longest time a packet waits for the batch to fill up, 0 sends every call's packets right away
+        void setFlushInterval(int ms) { flushMs = ms; }
+
+        void write(const tetra_burst_event* events, int count);
+        //Send the batch if it is due, for the times no records come in
+        void poll();
+        void flush();
+
+        //Fit BurstEventReader::init and setIdleHandler, ctx is the sender
+        static void eventHandler(const tetra_burst_event* events, int count, void* ctx);
+        static void idleHandler(void* ctx);
+
+        uint64_t getSent() { return sent; }
+        //Packets the socket refused, they are dropped rather than retried
+        uint64_t getErrors() { return errors; }
+
+    protected:
+        int sock = -1;
+        std::shared_ptr<net::Socket> conn;
+
+        uint8_t packets[GSMTAP_BATCH_PACKETS][GSMTAP_TETRA_MAX_LEN];
+        int lens[GSMTAP_BATCH_PACKETS];
+        int count = 0;
+        std::chrono::steady_clock::time_point since;
+        std::atomic<int> flushMs = GSMTAP_DEFAULT_FLUSH_MS;
+
+        std::atomic<uint64_t> sent = 0;
+        std::atomic<uint64_t> errors = 0;
+    };
+}
@@ -0,0 +1,46 @@
+#include "keystream_producer.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace dsp {
+    std::mutex KeystreamProducer::ctrlMtx;
+    std::mutex KeystreamProducer::mtx;
+    std::condition_variable KeystreamProducer::cnd;
+    std::vector<struct tetra_ks_sched*> KeystreamProducer::scheds;
+    std::thread KeystreamProducer::workerThread;
+    bool KeystreamProducer::stopping = false;
+    std::atomic<uint64_t> KeystreamProducer::generated = 0;
+
+    void KeystreamProducer::add(struct tetra_ks_sched* s) {
+        if (!s) { return; }
+        std::lock_guard<std::mutex> ctrlLck(ctrlMtx);
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            if (std::find(scheds.begin(), scheds.end(), s) != scheds.end()) { return; }
+            scheds.push_back(s);
+            stopping = false;
+        }
+        if (!workerThread.joinable()) { workerThread = std::thread(&KeystreamProducer::worker); }
+    }
+
+    void KeystreamProducer::remove(struct tetra_ks_sched* s) {
+        std::lock_guard<std::mutex> ctrlLck(ctrlMtx);
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            scheds.erase(std::remove(scheds.begin(), scheds.end(), s), scheds.end());
+            if (!scheds.empty()) { return; }
+            stopping = true;
+        }
+        cnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+    }
+
+    void KeystreamProducer::worker() {
+        std::unique_lock<std::mutex> lck(mtx);
+        while (!stopping) {
+            generated += tetra_ks_sched_fill(scheds.data(), scheds.size());
+            cnd.wait_for(lck, std::chrono::milliseconds(KEYSTREAM_PRODUCER_POLL_MS), []() { return stopping; });
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    #include "crypto/tetra_ks_sched.h"
+}
+
+//Time between the rounds of the producer. A timeslot has a voice slot every 56.67 ms and its ring runs two
+//multiframes (about 2 s) ahead, so a round only ever has a few slots per timeslot to catch up on
+#define KEYSTREAM_PRODUCER_POLL_MS 100
+
+namespace dsp {
+    //Process-wide thread that makes the voice keystream of the followed encrypted calls of all decoders ahead of time
+    //(see tetra_ks_sched.h), so their decoder threads only apply it. The TEA1 keystreams of all decoders go through one
+    //bit-sliced batch per round. The thread runs while at least one scheduler is added
+    class KeystreamProducer {
+    public:
+        //s is the caller's, see tetra_crypto_set_scheduled
+        static void add(struct tetra_ks_sched* s);
+
+        //Once it returns the producer no longer touches s, which may be freed
+        static void remove(struct tetra_ks_sched* s);
+
+        //Keystreams made since the start of the process
+        static uint64_t getGenerated() { return generated; }
+
+    protected:
+        static void worker();
+
+        //Held by add and remove for the whole start or stop of the thread
+        static std::mutex ctrlMtx;
+        //Held by the thread during a round, so remove waits for the one in progress
+        static std::mutex mtx;
+        static std::condition_variable cnd;
+        static std::vector<struct tetra_ks_sched*> scheds;
+        static std::thread workerThread;
+        static bool stopping;
+        static std::atomic<uint64_t> generated;
+    };
+}
@@ -0,0 +1,186 @@
+#include "metrics_server.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <utils/net.h>
+
+extern "C" {
+    #include "tetra_prof.h"
+}
+
+//Poll interval of the accept loop, how long stop() may take
+#define METRICS_ACCEPT_TIMEOUT_MS 200
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+namespace dsp {
+    static std::string formatValue(double v) {
+        char buf[32];
+        if (isnan(v)) { return "NaN"; }
+        if (isinf(v)) { return v > 0 ? "+Inf" : "-Inf"; }
+        //Counters stay exact up to 2^53
+        if (v == floor(v) && fabs(v) < 9007199254740992.0) {
+            snprintf(buf, sizeof(buf), "%.0f", v);
+        } else {
+            snprintf(buf, sizeof(buf), "%.10g", v);
+        }
+        return buf;
+    }
+
+    void MetricsWriter::gauge(const char* name, const char* help, const std::string& labels, double value) {
+        add(name, help, "gauge", labels, value);
+    }
+
+    void MetricsWriter::counter(const char* name, const char* help, const std::string& labels, double value) {
+        add(name, help, "counter", labels, value);
+    }
+
+    void MetricsWriter::add(const char* name, const char* help, const char* type, const std::string& labels, double value) {
+        //A few dozen families at most
+        for (auto& f : families) {
+            if (f.name == name) {
+                f.samples.emplace_back(labels, value);
+                return;
+            }
+        }
+        families.push_back({ name, help, type, { { labels, value } } });
+    }
+
+    std::string MetricsWriter::str() {
+        std::string out;
+        for (const auto& f : families) {
+            out += "# HELP " + f.name + " " + f.help + "\n";
+            out += "# TYPE " + f.name + " " + f.type + "\n";
+            for (const auto& s : f.samples) {
+                out += f.name;
+                if (!s.first.empty()) { out += "{" + s.first + "}"; }
+                out += " " + formatValue(s.second) + "\n";
+            }
+        }
+        return out;
+    }
+
+    std::string MetricsWriter::label(const char* name, const std::string& value) {
+        std::string out = std::string(name) + "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"') { out += '\\'; }
+            if (c == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    MetricsServer::~MetricsServer() {
+        stop();
+    }
+
+    MetricsServer& MetricsServer::get() {
+        static MetricsServer server;
+        return server;
+    }
+
+    bool MetricsServer::start(const std::string& host, int port) {
+        std::lock_guard<std::mutex> lck(serverMtx);
+        if (running) { return true; }
+        try {
+            listener = net::listen(host, port);
+        } catch (std::runtime_error& e) {
+            listener.reset();
+            return false;
+        }
+        if (!listener) { return false; }
+        _port = port;
+        running = true;
+        workerThread = std::thread(&MetricsServer::worker, this);
+        return true;
+    }
+
+    void MetricsServer::stop() {
+        std::lock_guard<std::mutex> lck(serverMtx);
+        if (!running) { return; }
+        running = false;
+        listener->stop();
+        if (workerThread.joinable()) { workerThread.join(); }
+        listener.reset();
+    }
+
+    void MetricsServer::addCollector(Collector collector, void* ctx) {
+        std::lock_guard<std::mutex> lck(collectorMtx);
+        collectors.emplace_back(collector, ctx);
+    }
+
+    void MetricsServer::removeCollector(void* ctx) {
+        std::lock_guard<std::mutex> lck(collectorMtx);
+        for (auto it = collectors.begin(); it != collectors.end();) {
+            it = (it->second == ctx) ? collectors.erase(it) : it + 1;
+        }
+    }
+
+    std::string MetricsServer::scrape() {
+        MetricsWriter w;
+        {
+            std::lock_guard<std::mutex> lck(collectorMtx);
+            for (const auto& c : collectors) { c.first(w, c.second); }
+        }
+        if (tetra_prof_enabled()) {
+            uint64_t v[TETRA_PROF_NR];
+            tetra_prof_snapshot(v);
+            for (int i = 0; i < TETRA_PROF_NR; i++) {
+                enum tetra_prof_counter c = (enum tetra_prof_counter)i;
+                //The times go out in seconds, as Prometheus has them
+                bool time = tetra_prof_is_time(c);
+                std::string name = std::string("tetra_stage_") + tetra_prof_name(c);
+                if (time) { name.replace(name.size() - 3, 3, "_seconds"); }
+                w.counter((name + "_total").c_str(), "Stage counter of the whole process, see tetra_prof.h", "", time ? v[i] / 1e9 : v[i]);
+            }
+        }
+        scrapes++;
+        return w.str();
+    }
+
+    void MetricsServer::worker() {
+        while (running) {
+            std::shared_ptr<net::Socket> client;
+            try {
+                client = listener->accept(NULL, METRICS_ACCEPT_TIMEOUT_MS);
+            } catch (std::runtime_error& e) {
+                client.reset();
+            }
+            if (!client) { continue; }
+            serve(client);
+            client->close();
+        }
+    }
+
+    void MetricsServer::serve(std::shared_ptr<net::Socket> client) {
+        //One request per connection, the headers are read and left alone
+        std::string line;
+        if (client->recvline(line, 1024, METRICS_CLIENT_TIMEOUT_MS) <= 0) { return; }
+        std::string request = line;
+        while (client->recvline(line, 1024, METRICS_CLIENT_TIMEOUT_MS) > 0) {
+            if (line.empty() || line == "\r") { break; }
+        }
+
+        std::string status = "200 OK";
+        std::string type = METRICS_CONTENT_TYPE;
+        std::string body;
+        bool head = (request.rfind("HEAD ", 0) == 0);
+        if (request.rfind("GET ", 0) != 0 && !head) {
+            status = "405 Method Not Allowed";
+            body = "Only GET\n";
+        } else if (request.compare(head ? 5 : 4, 9, "/metrics ") == 0 || request.compare(head ? 5 : 4, 9, "/metrics?") == 0) {
+            body = scrape();
+        } else {
+            status = "404 Not Found";
+            type = "text/plain";
+            body = "TETRA decoder metrics are at /metrics\n";
+        }
+        std::string resp = "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n";
+        if (!head) { resp += body; }
+        client->sendstr(resp);
+    }
+}
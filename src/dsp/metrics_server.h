@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Port of the metrics endpoint, that of the OpenTelemetry Prometheus exporter
+#define METRICS_DEFAULT_PORT 9464
+//A client that sends no request line within this long is dropped
+#define METRICS_CLIENT_TIMEOUT_MS 1000
+
+namespace net {
+    class Listener;
+    class Socket;
+}
+
+namespace dsp {
+    //The samples of one scrape, written out in the Prometheus text format (0.0.4), which OpenMetrics scrapers take as
+    //well. Samples of the same metric are put together under one HELP and TYPE, whichever collector added them
+    class MetricsWriter {
+    public:
+        MetricsWriter() {}
+
+        //labels as they go between the braces, built with label(), empty for none
+        void gauge(const char* name, const char* help, const std::string& labels, double value);
+        //name takes the _total suffix
+        void counter(const char* name, const char* help, const std::string& labels, double value);
+
+        std::string str();
+
+        //name="value", the value escaped. Join several with commas
+        static std::string label(const char* name, const std::string& value);
+
+    protected:
+        void add(const char* name, const char* help, const char* type, const std::string& labels, double value);
+
+        struct Family {
+            std::string name;
+            std::string help;
+            const char* type;
+            std::vector<std::pair<std::string, double>> samples;
+        };
+        std::vector<Family> families;
+    };
+
+    //HTTP endpoint serving /metrics for the whole process. The decoders register collectors that are called on
+    //every scrape, on the server thread: they only read atomics and the state the menus show anyway, so the hot path
+    //has nothing to do for it. The stage counters of tetra_prof.h are added when they are built in
+    class MetricsServer {
+    public:
+        typedef void (*Collector)(MetricsWriter& w, void* ctx);
+
+        MetricsServer() {}
+
+        ~MetricsServer();
+
+        //One server per process, shared by the module instances
+        static MetricsServer& get();
+
+        //false if the port can't be listened on
+        bool start(const std::string& host, int port = METRICS_DEFAULT_PORT);
+        void stop();
+        bool isRunning() { return running; }
+        int getPort() { return _port; }
+
+        //Once removeCollector returns, collector is not running and won't be called again
+        void addCollector(Collector collector, void* ctx);
+        void removeCollector(void* ctx);
+
+        //What a scrape gets
+        std::string scrape();
+        uint64_t getScrapes() { return scrapes; }
+
+    protected:
+        void worker();
+        void serve(std::shared_ptr<net::Socket> client);
+
+        std::mutex collectorMtx;
+        std::vector<std::pair<Collector, void*>> collectors;
+
+        std::mutex serverMtx;
+        std::shared_ptr<net::Listener> listener;
+        std::thread workerThread;
+        std::atomic<bool> running = false;
+        int _port = 0;
+        std::atomic<uint64_t> scrapes = 0;
+    };
+}
@@ -0,0 +1,203 @@
+#include "netsyms.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#define NETSYMS_MAGIC0 'T'
+#define NETSYMS_MAGIC1 'S'
+#define NETSYMS_PHASE_SCALE (128.0f / (float)M_PI)
+
+namespace dsp {
+    static inline void put16(uint8_t* p, uint16_t v) {
+        p[0] = v >> 8;
+        p[1] = v;
+    }
+
+    static inline void put32(uint8_t* p, uint32_t v) {
+        put16(p, v >> 16);
+        put16(p + 2, v);
+    }
+
+    static inline uint16_t get16(const uint8_t* p) { return (p[0] << 8) | p[1]; }
+
+    static inline uint32_t get32(const uint8_t* p) { return ((uint32_t)get16(p) << 16) | get16(p + 2); }
+
+    static inline int8_t toInt8(float v) { return (int8_t)lrintf(std::clamp<float>(v, -127.0f, 127.0f)); }
+
+    //Payload bytes of count symbols
+    static inline int payloadBytes(int format, int count) {
+        switch (format) {
+            case NETSYMS_FORMAT_PACKED: return (count + 3) / 4;
+            case NETSYMS_FORMAT_IQ8: return count * 2;
+            default: return count;
+        }
+    }
+
+    static inline int maxSymbols(int format) {
+        switch (format) {
+            case NETSYMS_FORMAT_PACKED: return NETSYMS_MAX_PAYLOAD * 4;
+            case NETSYMS_FORMAT_IQ8: return NETSYMS_MAX_PAYLOAD / 2;
+            default: return NETSYMS_MAX_PAYLOAD;
+        }
+    }
+
+    void NetsymsFramer::reset(NetsymsFormat format) {
+        _format = format;
+        seq = 0;
+        position = 0;
+        carry = -1;
+        prevSym = { 0, 0 };
+    }
+
+    void NetsymsFramer::write(const uint8_t* bits, int count, float quality, void (*handler)(const uint8_t* pkt, int len, void* ctx), void* ctx) {
+        if (netsymsCarriesSymbols(_format)) { return; }
+        int max = maxSymbols(_format);
+        int n = 0;
+        int i = 0;
+        if (carry >= 0 && count > 0) {
+            syms[n++] = (carry << 1) | (bits[0] & 1);
+            carry = -1;
+            i = 1;
+        }
+        for (; i + 1 < count; i += 2) {
+            syms[n++] = ((bits[i] & 1) << 1) | (bits[i + 1] & 1);
+            if (n == max) {
+                handler(pkt, pack(n, quality), ctx);
+                n = 0;
+            }
+        }
+        if (i < count) { carry = bits[i] & 1; }
+        if (n) { handler(pkt, pack(n, quality), ctx); }
+    }
+
+    void NetsymsFramer::writeSymbols(const complex_t* in, int count, float quality, void (*handler)(const uint8_t* pkt, int len, void* ctx), void* ctx) {
+        if (!netsymsCarriesSymbols(_format)) { return; }
+        int max = maxSymbols(_format);
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            if (_format == NETSYMS_FORMAT_IQ8) {
+                syms[n * 2] = toInt8(in[i].re * NETSYMS_IQ_SCALE);
+                syms[n * 2 + 1] = toInt8(in[i].im * NETSYMS_IQ_SCALE);
+            } else {
+                //in[i] * conj(prevSym)
+                float re = in[i].re * prevSym.re + in[i].im * prevSym.im;
+                float im = in[i].im * prevSym.re - in[i].re * prevSym.im;
+                //pi comes out as -128, the same phase
+                syms[n] = (int8_t)(int)lrintf(atan2f(im, re) * NETSYMS_PHASE_SCALE);
+                prevSym = in[i];
+            }
+            if (++n == max) {
+                handler(pkt, pack(n, quality), ctx);
+                n = 0;
+            }
+        }
+        if (n) { handler(pkt, pack(n, quality), ctx); }
+    }
+
+    int NetsymsFramer::pack(int count, float quality) {
+        pkt[0] = NETSYMS_MAGIC0;
+        pkt[1] = NETSYMS_MAGIC1;
+        pkt[2] = NETSYMS_VERSION;
+        pkt[3] = _format;
+        put32(&pkt[4], seq++);
+        put32(&pkt[8], position >> 32);
+        put32(&pkt[12], position);
+        put16(&pkt[16], std::clamp<float>(quality, 0.0f, 1.0f) * 65535.0f);
+        put16(&pkt[18], count);
+        position += count;
+
+        uint8_t* payload = &pkt[NETSYMS_HEADER_LEN];
+        int bytes = payloadBytes(_format, count);
+        if (_format != NETSYMS_FORMAT_PACKED) {
+            memcpy(payload, syms, bytes);
+            return NETSYMS_HEADER_LEN + bytes;
+        }
+        memset(payload, 0, bytes);
+        for (int i = 0; i < count; i++) {
+            payload[i / 4] |= syms[i] << (6 - 2 * (i % 4));
+        }
+        return NETSYMS_HEADER_LEN + bytes;
+    }
+
+    int NetsymsDeframer::packetLength(const uint8_t* hdr) {
+        if (hdr[0] != NETSYMS_MAGIC0 || hdr[1] != NETSYMS_MAGIC1 || hdr[2] != NETSYMS_VERSION) { return -1; }
+        if (hdr[3] <= NETSYMS_FORMAT_RAW || hdr[3] > NETSYMS_FORMAT_PHASE8) { return -1; }
+        int count = get16(&hdr[18]);
+        if (count > maxSymbols(hdr[3])) { return -1; }
+        return NETSYMS_HEADER_LEN + payloadBytes(hdr[3], count);
+    }
+
+    void NetsymsDeframer::reset() {
+        started = false;
+        lostPackets = 0;
+        lostSymbols = 0;
+        quality = 0;
+        phase = 0;
+    }
+
+    int64_t NetsymsDeframer::accept(const uint8_t* pkt, int len) {
+        if (len < NETSYMS_HEADER_LEN) { return -1; }
+        int total = packetLength(pkt);
+        if (total < 0 || total > len) { return -1; }
+        uint32_t seq = get32(&pkt[4]);
+        uint64_t position = ((uint64_t)get32(&pkt[8]) << 32) | get32(&pkt[12]);
+
+        int64_t fill = 0;
+        if (started) {
+            //Late or repeated packets are of no use once the gap was filled
+            if ((int32_t)(seq - nextSeq) < 0 || position < nextPosition) { return -2; }
+            lostPackets += seq - nextSeq;
+            uint64_t gap = position - nextPosition;
+            lostSymbols += gap;
+            if (gap <= NETSYMS_MAX_FILL_SYMBOLS) { fill = gap; }
+        }
+        started = true;
+        nextSeq = seq + 1;
+        nextPosition = position + get16(&pkt[18]);
+        quality = get16(&pkt[16]) / 65535.0f;
+        return fill;
+    }
+
+    int NetsymsDeframer::process(const uint8_t* pkt, int len, uint8_t* out) {
+        if (len >= NETSYMS_HEADER_LEN && netsymsCarriesSymbols(pkt[3])) { return -1; }
+        int64_t fill = accept(pkt, len);
+        if (fill < 0) { return (fill == -1) ? -1 : 0; }
+
+        int n = fill * 2;
+        memset(out, 0, n);
+        const uint8_t* payload = &pkt[NETSYMS_HEADER_LEN];
+        bool dibits = (pkt[3] == NETSYMS_FORMAT_DIBITS);
+        int count = get16(&pkt[18]);
+        for (int i = 0; i < count; i++) {
+            uint8_t sym = dibits ? payload[i] : (payload[i / 4] >> (6 - 2 * (i % 4)));
+            out[n++] = (sym >> 1) & 1;
+            out[n++] = sym & 1;
+        }
+        return n;
+    }
+
+    int NetsymsDeframer::processSymbols(const uint8_t* pkt, int len, complex_t* out) {
+        if (len >= NETSYMS_HEADER_LEN && !netsymsCarriesSymbols(pkt[3])) { return -1; }
+        int64_t fill = accept(pkt, len);
+        if (fill < 0) { return (fill == -1) ? -1 : 0; }
+
+        int n = fill;
+        for (int i = 0; i < n; i++) { out[i] = { 0, 0 }; }
+        const int8_t* payload = (const int8_t*)&pkt[NETSYMS_HEADER_LEN];
+        int count = get16(&pkt[18]);
+        for (int i = 0; i < count; i++) {
+            if (pkt[3] == NETSYMS_FORMAT_IQ8) {
+                out[n++] = { payload[i * 2] / NETSYMS_IQ_SCALE, payload[i * 2 + 1] / NETSYMS_IQ_SCALE };
+            } else {
+                //Running phase kept in -pi..pi
+                phase += payload[i] / NETSYMS_PHASE_SCALE;
+                if (phase > (float)M_PI) { phase -= 2.0f * (float)M_PI; }
+                if (phase < -(float)M_PI) { phase += 2.0f * (float)M_PI; }
+                out[n++] = { cosf(phase), sinf(phase) };
+            }
+        }
+        return n;
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+
+#include <dsp/types.h>
+
+//Framing of the network symbol stream, all fields big endian:
+//  0  magic 'T' 'S'
+//  2  version, NETSYMS_VERSION
+//  3  payload format, one of NetsymsFormat but NETSYMS_FORMAT_RAW
+//  4  sequence number, one up per packet
+//  8  stream position of the first symbol, in symbols since the stream started (18000 per second)
+//  16 signal quality, 1 - DQPSKSymbolExtractor::standarderr scaled to 0..65535
+//  18 symbols in the packet
+//  20 payload, MSB first, the last byte padded with zeros
+#define NETSYMS_HEADER_LEN 20
+#define NETSYMS_VERSION 1
+//Keeps a packet below a 1500 byte MTU: 4096 symbols packed, 1024 as dibits or phases, 512 as I/Q
+#define NETSYMS_MAX_PAYLOAD 1024
+#define NETSYMS_MAX_SYMBOLS (NETSYMS_MAX_PAYLOAD * 4)
+#define NETSYMS_MAX_PACKET (NETSYMS_HEADER_LEN + NETSYMS_MAX_PAYLOAD)
+//Lost packets up to this many symbols are filled in, zero bits or zero symbols, which keeps the far decoder on its
+//TDMA timing. One multiframe, anything longer needs a new sync anyway
+#define NETSYMS_MAX_FILL_SYMBOLS (18 * 4 * 255)
+//int8 I/Q per unit of the demodulator output, which the AGC keeps near 1
+#define NETSYMS_IQ_SCALE 64.0f
+
+namespace dsp {
+    enum NetsymsFormat {
+        //One bit per byte, no framing, what tetra-rx reads
+        NETSYMS_FORMAT_RAW,
+        //Four symbols per byte
+        NETSYMS_FORMAT_PACKED,
+        //One symbol per byte in the two low bits
+        NETSYMS_FORMAT_DIBITS,
+        //Symbols after timing recovery as int8 I and Q, NETSYMS_IQ_SCALE per unit
+        NETSYMS_FORMAT_IQ8,
+        //Phase from each symbol to the next as int8, 128 per pi. Half the size of I/Q, the amplitude is lost
+        NETSYMS_FORMAT_PHASE8,
+    };
+
+    //The formats that carry symbols rather than decided bits, fed from the demodulator with writeSymbols
+    static inline bool netsymsCarriesSymbols(int format) { return format == NETSYMS_FORMAT_IQ8 || format == NETSYMS_FORMAT_PHASE8; }
+
+    //Packs into framed packets either the unpacked bits of DQPSKSymbolExtractor (one bit per byte, two per symbol) or
+    //the symbols of the demodulator, as the format wants. A symbol split between two calls is carried over, so the
+    //packets always hold whole symbols
+    class NetsymsFramer {
+    public:
+        NetsymsFramer() {}
+
+        //Starts a new stream, sequence and position from 0
+        void reset(NetsymsFormat format);
+
+        //Frames count bits, handler gets every packet as it is done. quality is for all of them, 0..1
+        void write(const uint8_t* bits, int count, float quality, void (*handler)(const uint8_t* pkt, int len, void* ctx), void* ctx);
+
+        //Same for count symbols, in the I/Q and phase formats
+        void writeSymbols(const complex_t* syms, int count, float quality, void (*handler)(const uint8_t* pkt, int len, void* ctx), void* ctx);
+
+        NetsymsFormat getFormat() { return _format; }
+        uint32_t getSequence() { return seq; }
+
+    protected:
+        int pack(int count, float quality);
+
+        NetsymsFormat _format = NETSYMS_FORMAT_PACKED;
+        uint32_t seq = 0;
+        uint64_t position = 0;
+        int carry = -1;
+        complex_t prevSym = { 0, 0 };
+        //Dibits, or the payload bytes of the symbol formats
+        uint8_t syms[NETSYMS_MAX_SYMBOLS];
+        uint8_t pkt[NETSYMS_MAX_PACKET];
+    };
+
+    //Receiving end: turns packets back into one bit per byte or into symbols, filling in what went missing
+    class NetsymsDeframer {
+    public:
+        NetsymsDeframer() {}
+
+        //Total length of the packet starting with hdr, NETSYMS_HEADER_LEN bytes of it. -1 if it is not a header
+        static int packetLength(const uint8_t* hdr);
+
+        //Unpacks one packet of decided bits to out, which takes 2 * (NETSYMS_MAX_FILL_SYMBOLS + NETSYMS_MAX_SYMBOLS)
+        //bits. Returns the bits written, the fill for a gap before the packet included. -1 for a malformed packet or a
+        //symbol format, 0 for a stale one
+        int process(const uint8_t* pkt, int len, uint8_t* out);
+
+        //Same for a packet of symbols, out takes NETSYMS_MAX_FILL_SYMBOLS + NETSYMS_MAX_SYMBOLS. Gaps are filled with
+        //zero symbols, which the soft bits of DQPSKSymbolExtractor turn into erasures. Phases come back as unit
+        //symbols turning by them
+        int processSymbols(const uint8_t* pkt, int len, complex_t* out);
+
+        void reset();
+
+        //Packets missed by the sequence numbers, and the symbols missed with them
+        uint64_t getLostPackets() { return lostPackets; }
+        uint64_t getLostSymbols() { return lostSymbols; }
+        float getQuality() { return quality; }
+
+    protected:
+        //Checks the packet and its place in the stream. Returns the symbols to fill in before it, -1 if it is malformed
+        //and -2 if it is stale
+        int64_t accept(const uint8_t* pkt, int len);
+
+        bool started = false;
+        uint32_t nextSeq = 0;
+        uint64_t nextPosition = 0;
+        uint64_t lostPackets = 0;
+        uint64_t lostSymbols = 0;
+        float quality = 0;
+        float phase = 0;
+    };
+}
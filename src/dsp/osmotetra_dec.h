@@ -1,6 +1,17 @@
 #pragma once
 
 #include <dsp/processor.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "keystream_producer.h"
+#include "thread_tuning.h"
+#include "worker_pool.h"
 
 // #include <osmocom/core/utils.h>
 // #include <osmocom/core/talloc.h>
@@ -10,21 +21,83 @@ extern "C" {
     #include "crypto/tetra_crypto.h"
     #include <phy/tetra_burst.h>
     #include <phy/tetra_burst_sync.h>
-    #include "c-code/channel.h"
-    #include "c-code/source.h"
+    #include <phy/tetra_burst_archive.h>
+    #include "tetra_prof.h"
+    #include "tetra_mac_pipe.h"
+    #include <phy/tetra_train_corr.h>
+    #include <lower_mac/viterbi_list.h>
+    #include <lower_mac/tetra_scramb.h>
 }
 
+//Voice frames queued per timeslot before they are decoded, a call to process() rarely brings more than two
+#define VOICE_QUEUE_FRAMES 4
+//Default number of threads decoding the timeslots, one per timeslot
+#define VOICE_POOL_THREADS TETRA_CODEC_TIMESLOTS
+
 namespace dsp {
 
+    //One slot of decoded speech, 60 ms at 8 kHz, stamped with the TDMA time of its burst (time.tn is the timeslot)
+    struct TetraAudioFrame {
+        struct tetra_tdma_time time;
+        bool active; //the timeslot out would have played
+        std::chrono::steady_clock::time_point received; //when the bits that completed the burst reached the decoder
+        int16_t samples[TETRA_CODEC_SLOT_SAMPLES];
+    };
+
+    //What the carrier told of its cell, see osmotetradec::getCellInfo
+    struct TetraCellInfo {
+        uint64_t syncs = 0;    //SYNC PDUs with a good CRC, the ids are those of the last one
+        int mcc = 0;
+        int mnc = 0;
+        int cc = 0;
+        uint64_t sysinfos = 0; //SYSINFO PDUs, the carriers are those of the last one
+        uint32_t dlHz = 0;
+        uint32_t ulHz = 0;
+        int hn = -1;           //hyperframe and CCK id of the crypto state, -1 until a SYSINFO told them
+        int cckId = -1;
+    };
+
+    //Keeps a stream of TetraAudioFrame in real time for the sink: every traffic frame (1 .. 17) between two frames
+    //that brought no audio is worth one frame of silence. One clock per stream (the active one, or each timeslot).
+    //The TDMA time wraps every 60 multiframes, longer gaps come out short by a multiple of that
+    class AudioFrameClock {
+    public:
+        //Samples of silence that go in front of frame
+        int silenceBefore(const TetraAudioFrame& frame) {
+            int fn = ((frame.time.mn + 59) % 60) * 18 + (frame.time.fn + 17) % 18;
+            int missed = 0;
+            if (started) {
+                int elapsed = (fn - lastFn + 18 * 60) % (18 * 60);
+                for (int i = 1; i < elapsed; i++) {
+                    if ((lastFn + i) % 18 != 17) { missed++; }
+                }
+            }
+            started = true;
+            lastFn = fn;
+            return missed * TETRA_CODEC_SLOT_SAMPLES;
+        }
+
+        void reset() { started = false; }
+
+    private:
+        bool started = false;
+        int lastFn = 0;
+    };
+
     class osmotetradec : public Processor<uint8_t, float> {
         using base_type = Processor<uint8_t, float>;
     public:
         osmotetradec() {}
         
         ~osmotetradec() {
+            stopUpperMac();
+            if (tms->tcs->sched) { KeystreamProducer::remove(tms->tcs->sched); }
+            tetra_mac_pipe_deinit(&macPipe);
+            tetra_mac_state_deinit(tms);
             free(tms->fragslots);
             free(trs);
             free(tms->t_display_st);
+            tetra_crypto_state_deinit(tms->tcs);
             free(tms->tcs);
             free(tms);
             // talloc_free(trs);
@@ -67,116 +140,341 @@ namespace dsp {
 
 
             trs->burst_cb_priv = tms;
+            trs->max_slip_bits = TETRA_RX_MAX_SLIP_SYMS * 2;
 
             tms->put_voice_data = put_voice_data;
             tms->put_voice_data_ctx = this;
             tms->last_frame = 0;
             tms->curr_active_timeslot = 0;
 
-            Init_Decod_Tetra();
-
             out_tmp_buff.init(32768);
 
             base_type::init(in);
         }
 
-        //return current RX state. 0=unlocked, 1=know_next_start, 2=locked
-        int getRxState() {
-            switch(trs->state) {
-                case RX_S_LOCKED:
-                    return 2;
-                case RX_S_KNOW_FSTART:
-                    return 1;
-                default:
-                    return 0;
-            }
+        //Hand decoded blocks and MAC PDUs to a consumer through q, NULL to stop. See BurstEventReader
+        void setEventQueue(struct tetra_event_queue* q) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            tms->events = q;
+            base_type::tempStart();
         }
 
-        int getCurrHyperframe() {
-            return tms->t_display_st->curr_hyperframe;
-        }
-        int getCurrMultiframe() {
-            return tms->t_display_st->curr_multiframe;
-        }
-        int getCurrFrame() {
-            return tms->t_display_st->curr_frame;
-        }
-        int getTimeslotContent(int ts) { //0-other, 1-NORM1, 2-NORM2, 3-SYNC, 4-VOICE
-            return tms->t_display_st->timeslot_content[ts];
-        }
-        int getDlUsage() {
-            return tms->t_display_st->dl_usage;
+        //handler gets every decoded TL-SDU, its header and len bits (one per byte) from the MLE discriminator on, in
+        //line on the decoder thread (the upper MAC thread if pipelined), so what it does holds up the decoding. NULL to stop
+        void setL3Handler(void (*handler)(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            tms->put_l3 = handler;
+            tms->put_l3_ctx = ctx;
+            base_type::tempStart();
         }
-        int getUlUsage() {
-            return tms->t_display_st->ul_usage;
-        }
-        char getAccess1Code() {
-            return tms->t_display_st->access1_code;
-        }
-        char getAccess2Code() {
-            return tms->t_display_st->access2_code;
+
+        //Append every locked burst to ar, opened with tetra_burst_archive_open, NULL to stop. It is written on the decoder
+        //thread, so close it only once it is set back to NULL
+        void setBurstArchive(struct tetra_burst_archive* ar) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            tms->burst_archive = ar;
+            base_type::tempStart();
         }
-        int getAccess1() {
-            return tms->t_display_st->access1;
+
+        //MAC PDUs to decode, a mask of enum tetra_mac_sub, TETRA_SUB_ALL by default. The getters and the event queue only
+        //see what is decoded: the voice of encrypted calls needs TETRA_SUB_SYSINFO and TETRA_SUB_RESOURCE
+        void setSubscriptions(uint32_t mask) {
+            assert(base_type::_block_init);
+            __atomic_store_n(&tms->subscriptions, mask, __ATOMIC_RELAXED);
         }
-        int getAccess2() {
-            return tms->t_display_st->access2;
+
+        //Bit errors tolerated in the training sequence of a locked burst, 0 = exact match only
+        void setTrainSeqMaxErrors(int errors) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            trs->train_seq_max_errors = std::clamp<int>(errors, 0, TETRA_TRAIN_CORR_MAX_ERRORS);
         }
-        int getDlFreq() {
-            return tms->t_display_st->dl_freq;
+
+        //Symbols a locked burst may be early or late and still be taken, the slot timing following it instead of the
+        //sync being lost, TETRA_RX_MAX_SLIP_SYMS by default. 0 = only where predicted
+        void setMaxSlip(int symbols) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            trs->max_slip_bits = std::clamp<int>(symbols, 0, TETRA_RX_MAX_SLIP_SYMS) * 2;
         }
-        int getUlFreq() {
-            return tms->t_display_st->ul_freq;
+
+        //Bytes of packed storage for reassembling fragmented MAC PDUs, shared by the timeslots. PDUs that do not
+        //fit are dropped whole, see getFragmentsDropped. Drops the PDUs in progress
+        void setFragmentMemLimit(unsigned int bytes) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            fragslot_set_mem_limit(tms, bytes);
+            base_type::tempStart();
         }
-        int getMcc() {
-            return tms->t_display_st->mcc;
+
+        //CRC-aided list decoding: a block that fails its CRC is tried again with the next best paths of the trellis, up
+        //to paths of them, within budget paths per TDMA frame for the carrier. 0 paths is off (default)
+        void setListDecoding(int paths, int budget = TETRA_VITERBI_LIST_DEFAULT_BUDGET) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            tms->list_paths = std::clamp<int>(paths, 0, TETRA_VITERBI_LIST_MAX_PATHS);
+            tms->list_budget = std::max<int>(budget, 0);
+            tms->list_tokens = tms->list_budget;
+            base_type::tempStart();
         }
-        int getMnc() {
-            return tms->t_display_st->mnc;
+
+        //Run the upper MAC (PDU parsers, reassembly, decryption, the event queue and the L3 handler) on a thread of its
+        //own, fed by the lower MAC through a queue of TETRA_MAC_PIPE_BLOCKS blocks, so burst sync, channel decoding and
+        //the voice go on while it works through a busy stretch of signalling. Blocks that find the queue full are
+        //dropped, see getPipelineDropped. Only while running as a block, process() and replayBursts() without it
+        void setPipelined(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            if (enabled && !macPipe.ring) { tetra_mac_pipe_init(&macPipe, TETRA_MAC_PIPE_BLOCKS); }
+            if (!enabled) { tetra_mac_pipe_deinit(&macPipe); }
+            pipelined = enabled && macPipe.ring;
+            base_type::tempStart();
         }
-        int getCc() {
-            return tms->t_display_st->cc;
+
+        //Make the keystream of the voice of followed encrypted calls ahead of time on the KeystreamProducer thread,
+        //two multiframes per timeslot, so the decoder thread only applies it. Slots the producer did not get to yet
+        //are generated in line as without it, see getKeystreamMisses
+        void setKeystreamAhead(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (enabled == (tms->tcs->sched != NULL)) { return; }
+            base_type::tempStop();
+            if (!enabled) { KeystreamProducer::remove(tms->tcs->sched); }
+            struct tetra_ks_sched* s = tetra_crypto_set_scheduled(tms->tcs, enabled);
+            if (s) { KeystreamProducer::add(s); }
+            base_type::tempStart();
         }
-        bool getLastCrcFail() {
-            return tms->t_display_st->last_crc_fail;
+
+        //Pins the block thread, the upper MAC thread and the voice pool as tuning says, each time they start. tuning is
+        //the caller's and has to outlive the block, NULL leaves the threads alone
+        void setThreadTuning(const ThreadTuning* tuning) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            threadTuning = tuning;
+            if (voicePool && threadTuning) { voicePool->setThreadTuning(*threadTuning); }
+            base_type::tempStart();
         }
-        bool getAdvancedLink() {
-            return tms->t_display_st->advanced_link;
+
+        unsigned int getPipelineDropped() {
+            return __atomic_load_n(&macPipe.dropped, __ATOMIC_RELAXED);
         }
-        bool getAirEncryption() {
-            return tms->t_display_st->air_encryption;
+        //Blocks waiting for the upper MAC thread
+        unsigned int getPipelineDepth() {
+            return macPipe.ring ? tetra_mac_pipe_depth(&macPipe) : 0;
         }
-        bool getSndcpData() {
-            return tms->t_display_st->sndcp_data;
+
+        unsigned int getFragmentsDropped() {
+            return tms->frag_store.dropped;
         }
-        bool getCircuitData() {
-            return tms->t_display_st->circuit_data;
+
+        //Input bytes are int8 soft bits from DQPSKSymbolExtractor::setSoftBits instead of hard 0/1 bits
+        void setSoftBits(bool soft) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            softBits = soft;
+            base_type::tempStart();
         }
-        bool getVoiceService() {
-            return tms->t_display_st->voice_service;
+
+        //Decode the voice of all four timeslots, each with its own codec, on threads worker threads (1 decodes in
+        //line). handler gets the 8 kHz audio of every timeslot tagged with its number (1 .. 4), out keeps carrying
+        //the active one as before. NULL goes back to decoding only the active timeslot
+        void setSlotAudioHandler(void (*handler)(int tn, int count, float* data, void* ctx), void* ctx, int threads = VOICE_POOL_THREADS) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _slotAudioHandler = handler;
+            _slotAudioCtx = ctx;
+            slotThreads = threads;
+            updateVoicePath();
+            base_type::tempStart();
         }
-        bool getNormalMode() {
-            return tms->t_display_st->normal_mode;
+
+        //Hand the decoded voice out as timestamped frames instead of a sample stream on out, which then stays empty
+        //and is no longer padded: the sink makes up the silence it needs (see AudioFrameClock). handler gets the
+        //frames decoded by one call to process() in the order they came in, straight from the codec; they are only
+        //valid during the call. allSlots decodes every timeslot on threads worker threads, otherwise only the active
+        //one is. NULL goes back to out
+        void setAudioFrameHandler(void (*handler)(TetraAudioFrame* frames, int count, void* ctx), void* ctx, bool allSlots = false, int threads = VOICE_POOL_THREADS) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _audioFrameHandler = handler;
+            _audioFrameCtx = ctx;
+            frameAllSlots = allSlots;
+            frameThreads = threads;
+            updateVoicePath();
+            base_type::tempStart();
         }
-        bool getMigrationSupported() {
-            return tms->t_display_st->migration_supported;
+
+        //The voice frames of every timeslot also go to handler, e.g. a CallRecorder, decoded on threads worker threads.
+        //The audio on out or the audio frame handler stays as it is. Like the frames of the audio frame handler they
+        //are only valid during the call. NULL stops it
+        void setRecordHandler(void (*handler)(TetraAudioFrame* frames, int count, void* ctx), void* ctx, int threads = VOICE_POOL_THREADS) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _recordHandler = handler;
+            _recordCtx = ctx;
+            recordThreads = threads;
+            updateVoicePath();
+            base_type::tempStart();
         }
-        bool getNeverMinimumMode() {
-            return tms->t_display_st->never_minimum_mode;
+
+        //Whether anyone listens to out or the audio frame handler. Without a listener or a slot audio handler the voice
+        //frames are not decoded
+        void setAudioWanted(bool wanted) {
+            assert(base_type::_block_init);
+            audioWanted = wanted;
+            updateVoiceWanted();
         }
-        bool getPriorityCell() {
-            return tms->t_display_st->priority_cell;
+
+        //return current RX state. 0=unlocked, 1=know_next_start (or reacquiring on it), 2=locked
+        int getRxState() {
+            switch(trs->state) {
+                case RX_S_LOCKED:
+                    return 2;
+                case RX_S_KNOW_FSTART:
+                case RX_S_REACQUIRE:
+                    return 1;
+                default:
+                    return 0;
+            }
         }
-        bool getDeregMandatory() {
-            return tms->t_display_st->dereg_mandatory;
+
+        //What the decoder shows of the carrier and its cell, as one consistent copy of what the decoder published after
+        //the last burst. Safe to read from any thread, it never holds up the decoder
+        void getDisplayState(struct tetra_display_state* out) {
+            tetra_display_read(tms, out);
         }
-        bool getRegMandatory() {
-            return tms->t_display_st->reg_mandatory;
+
+        //Running totals since init, safe to read from any thread. type is an enum tetra_train_seq
+        uint64_t getBursts(int type) {
+            return (type >= 0 && type < TETRA_STATS_TRAIN_SEQS) ? __atomic_load_n(&tms->stats.bursts[type], __ATOMIC_RELAXED) : 0;
+        }
+        uint64_t getCrcOk() {
+            return __atomic_load_n(&tms->stats.crc_ok, __ATOMIC_RELAXED);
+        }
+        uint64_t getCrcFail() {
+            return __atomic_load_n(&tms->stats.crc_fail, __ATOMIC_RELAXED);
+        }
+        //Of getCrcOk, the blocks that passed on a later path of the list decoder
+        uint64_t getCrcListOk() {
+            return __atomic_load_n(&tms->stats.crc_list_ok, __ATOMIC_RELAXED);
+        }
+        uint64_t getAachFail() {
+            return __atomic_load_n(&tms->stats.aach_fail, __ATOMIC_RELAXED);
+        }
+        //Times the burst sync lost the training sequences, and found them again at the predicted slot timing
+        uint64_t getSyncLost() {
+            return __atomic_load_n(&tms->stats.sync_lost, __ATOMIC_RELAXED);
+        }
+        uint64_t getReacquired() {
+            return __atomic_load_n(&tms->stats.reacquired, __ATOMIC_RELAXED);
+        }
+        //Locked bursts taken off their predicted start, see setMaxSlip
+        uint64_t getSlips() {
+            return __atomic_load_n(&tms->stats.slips, __ATOMIC_RELAXED);
+        }
+        //SNR of the training sequences in dB (see tetra_train_snr), summed over the bursts that have one, which
+        //getSnrBursts counts, and of the last of them. Only bursts decoded from soft bits have one
+        double getSnrSum() {
+            return (double)__atomic_load_n(&tms->stats.snr_sum, __ATOMIC_RELAXED) / TETRA_TRAIN_SNR_STEPS_PER_DB;
+        }
+        uint64_t getSnrBursts() {
+            return __atomic_load_n(&tms->stats.snr_bursts, __ATOMIC_RELAXED);
+        }
+        float getLastSnr() {
+            return (float)__atomic_load_n(&tms->stats.snr_last, __ATOMIC_RELAXED) / TETRA_TRAIN_SNR_STEPS_PER_DB;
+        }
+        //Encrypted voice slots whose keystream was made ahead, and those that had to generate it in line. Both 0
+        //without setKeystreamAhead, which the lock keeps from freeing the counters under them
+        uint64_t getKeystreamHits() {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            return tms->tcs->sched ? __atomic_load_n(&tms->tcs->sched->hits, __ATOMIC_RELAXED) : 0;
+        }
+        uint64_t getKeystreamMisses() {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            return tms->tcs->sched ? __atomic_load_n(&tms->tcs->sched->misses, __ATOMIC_RELAXED) : 0;
+        }
+        //Cell ids of the SYNC and carriers of the SYSINFO decoded since init, safe to read from any thread
+        TetraCellInfo getCellInfo() {
+            TetraCellInfo info;
+            info.syncs = __atomic_load_n(&tms->stats.sync_ok, __ATOMIC_ACQUIRE);
+            info.mcc = __atomic_load_n(&tms->stats.mcc, __ATOMIC_RELAXED);
+            info.mnc = __atomic_load_n(&tms->stats.mnc, __ATOMIC_RELAXED);
+            info.cc = __atomic_load_n(&tms->stats.cc, __ATOMIC_RELAXED);
+            info.sysinfos = __atomic_load_n(&tms->stats.sysinfo, __ATOMIC_ACQUIRE);
+            info.dlHz = __atomic_load_n(&tms->stats.dl_hz, __ATOMIC_RELAXED);
+            info.ulHz = __atomic_load_n(&tms->stats.ul_hz, __ATOMIC_RELAXED);
+            info.hn = __atomic_load_n(&tms->tcs->hn, __ATOMIC_RELAXED);
+            info.cckId = __atomic_load_n(&tms->tcs->cck_id, __ATOMIC_RELAXED);
+            return info;
+        }
+        //What another decoder of the same cell knows, for a decoder that starts in the middle of its bursts: a traffic
+        //carrier has no SYSINFO to tell the hyperframe, and its first SYNC may be most of a multiframe away. mcc, mnc
+        //and cc set the scrambling code until the decoder's own SYNC does, hn and cckId (if not -1) the crypto state
+        //until the next SYSINFO. Taken over before the next bits, any thread. Not for a pipelined decoder, whose crypto
+        //state belongs to the upper MAC thread
+        void presetCell(const TetraCellInfo& info) {
+            std::lock_guard<std::mutex> lck(presetMtx);
+            preset = info;
+            presetPending.store(true, std::memory_order_release);
+        }
+        //Voice frames dropped because out was full
+        uint64_t getVoiceDropped() {
+            return voiceDropped;
+        }
+        //Samples of voice waiting to go out
+        int getAudioDepth() {
+            return out_tmp_buff.getReadable(true);
+        }
+        //Bits of the stream that never arrive, e.g. while the demodulator was suspended. The decoder drops what it has
+        //buffered and carries the slot timing and TDMA time across them, before the next bits it gets. Any thread
+        void skipBits(uint64_t bits) {
+            pendingSkip.fetch_add(bits, std::memory_order_relaxed);
         }
 
         inline int process(int count, const uint8_t* in, float* out)  {
+            TETRA_PROF_START(profT);
             int outcnt = 0;
-            tetra_burst_sync_in(trs, (uint8_t*)in, count);
+            //The bursts completed by these bits, see put_voice_frame()
+            blockReceived = std::chrono::steady_clock::now();
+            if(pendingSkip.load(std::memory_order_relaxed)) {
+                tetra_burst_sync_skip(trs, pendingSkip.exchange(0, std::memory_order_relaxed));
+            }
+            if(presetPending.load(std::memory_order_acquire)) {
+                applyPreset();
+            }
+            if(softBits) {
+                tetra_burst_sync_in_soft(trs, (const int8_t*)in, count);
+            } else {
+                tetra_burst_sync_in(trs, (uint8_t*)in, count);
+            }
+            if(tms->mac_pipe && tetra_mac_pipe_depth(tms->mac_pipe)) {
+                { std::lock_guard<std::mutex> lck(upperMtx); }
+                upperCnd.notify_one();
+            }
+            if(voiceFrameCount) {
+                flushVoiceFrames();
+            }
+            TETRA_PROF_ADD(TETRA_PROF_DECODER_CALLS, 1);
+            TETRA_PROF_ADD(TETRA_PROF_DECODER_BITS, count);
+            TETRA_PROF_STOP(TETRA_PROF_DECODER_NS, profT);
+            //Frame output carries its own timing, out stays empty
+            if(_audioFrameHandler) {
+                return 0;
+            }
             if(out_tmp_buff.getReadable(false) > 0) {
                 outcnt += out_tmp_buff.read(out, out_tmp_buff.getReadable(false));
             }
@@ -184,7 +482,11 @@ namespace dsp {
             inSymsCtr += count;
             int requiredOut = inSymsCtr * 8 / 36;
             int remainingOut = requiredOut - outSymsCtr;
-            bool decoding = (tms->t_display_st->timeslot_content[0] == 4) | (tms->t_display_st->timeslot_content[1] == 4) | (tms->t_display_st->timeslot_content[2] == 4) | (tms->t_display_st->timeslot_content[3] == 4);
+            //Voice timeslots whose frames were dropped before the codec do not fill out, pad them with silence
+            bool decoding = false;
+            for (int ts = 0; ts < TETRA_CODEC_TIMESLOTS; ts++) {
+                decoding |= (tms->t_display_st->timeslot_content[ts] == 4) && !tms->voice_skipped[ts];
+            }
             if(remainingOut > 0 && !decoding) {
                 memset(&(out[outcnt]), 0, remainingOut*sizeof(float));
                 outcnt += remainingOut;
@@ -194,6 +496,19 @@ namespace dsp {
             return outcnt;
         }
 
+        //Feeds archived bursts straight into the lower MAC, see BurstReplay, in place of bits to the synchronizer. The
+        //output goes where that of process() goes, the voice only through the frame and slot audio handlers. soft[i],
+        //if given, has the TETRA_BITS_PER_TS soft bits recs[i] is decoded from, or is NULL for its bits (see
+        //BurstMerge). For a decoder that is not running as a block
+        void replayBursts(const struct tetra_burst_record* recs, int count, const int8_t* const* soft = NULL) {
+            for (int i = 0; i < count; i++) {
+                tetra_burst_archive_replay(&recs[i], soft ? soft[i] : NULL, tms);
+            }
+            if(voiceFrameCount) {
+                flushVoiceFrames();
+            }
+        }
+
         int run()  {
             int count = base_type::_in->read();
             if (count < 0) { return -1; }
@@ -203,27 +518,236 @@ namespace dsp {
             // Swap if some data was generated
             base_type::_in->flush();
             if (outCount) {
+                TETRA_PROF_START(profT);
                 if (!base_type::out.swap(outCount)) { return -1; }
+                TETRA_PROF_ADD(TETRA_PROF_SWAPS, 1);
+                TETRA_PROF_STOP(TETRA_PROF_SWAP_WAIT_NS, profT);
             }
             return outCount;
         }
 
         static void put_voice_data(void* ctx, int count, int16_t* data) {
             osmotetradec* _this = (osmotetradec*) ctx;
-            float conv_data[STREAM_BUFFER_SIZE];
-            volk_16i_s32f_convert_32f(conv_data, data, 32768.0f, count);
-            if(_this->out_tmp_buff.getWritable(false) >= count) {
-                _this->out_tmp_buff.write(conv_data, count);
+            //The lower MAC hands out one slot at a time
+            float conv_data[TETRA_CODEC_SLOT_SAMPLES];
+            if(_this->out_tmp_buff.getWritable(false) < count) {
+                _this->voiceDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            for(int i = 0; i < count; i += TETRA_CODEC_SLOT_SAMPLES) {
+                int n = std::min<int>(count - i, TETRA_CODEC_SLOT_SAMPLES);
+                volk_16i_s32f_convert_32f(conv_data, &data[i], 32768.0f, n);
+                _this->out_tmp_buff.write(conv_data, n);
+            }
+        }
+
+        //Queue the frame of a timeslot, decoded together with the other timeslots once burst sync returns
+        static void put_voice_frame(void* ctx, const struct tetra_tdma_time* time, bool active, int16_t* coded, const uint8_t* ks) {
+            osmotetradec* _this = (osmotetradec*) ctx;
+            VoiceSlot& vs = _this->voiceSlots[time->tn - 1];
+            if(vs.frames == VOICE_QUEUE_FRAMES) {
+                _this->flushVoiceFrames();
             }
+            TetraAudioFrame& frame = _this->voiceFrames[_this->voiceFrameCount];
+            frame.time = *time;
+            frame.active = active;
+            frame.received = _this->blockReceived;
+            memcpy(vs.coded[vs.frames], coded, sizeof(vs.coded[0]));
+            vs.encrypted[vs.frames] = ks != NULL;
+            if (ks) { memcpy(vs.ks[vs.frames], ks, sizeof(vs.ks[0])); }
+            vs.order[vs.frames++] = _this->voiceFrameCount++;
+        }
+
+    protected:
+        //The upper MAC thread runs along with the block
+        void doStart() override {
+            if (pipelined) { startUpperMac(); }
+            base_type::doStart();
+            if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+        }
+
+        void doStop() override {
+            base_type::doStop();
+            stopUpperMac();
         }
 
     private:
+        void startUpperMac() {
+            upperStop = false;
+            tms->mac_pipe = &macPipe;
+            upperThread = std::thread(&osmotetradec::upperMacWorker, this);
+            if (threadTuning) { threadTuning->apply(upperThread); }
+        }
+
+        //Works off what is left in the queue before it returns, the lower MAC has to be stopped
+        void stopUpperMac() {
+            if (!upperThread.joinable()) { return; }
+            {
+                std::lock_guard<std::mutex> lck(upperMtx);
+                upperStop = true;
+            }
+            upperCnd.notify_one();
+            upperThread.join();
+            tms->mac_pipe = NULL;
+        }
+
+        void applyPreset() {
+            TetraCellInfo info;
+            {
+                std::lock_guard<std::mutex> lck(presetMtx);
+                info = preset;
+                presetPending.store(false, std::memory_order_relaxed);
+            }
+            struct tetra_cell_data* tcd = &tms->cell_data;
+            if(!__atomic_load_n(&tms->stats.sync_ok, __ATOMIC_RELAXED)) {
+                tcd->mcc = info.mcc;
+                tcd->mnc = info.mnc;
+                tcd->colour_code = info.cc;
+                tcd->scramb_init = tetra_scramb_get_init(tcd->mcc, tcd->mnc, tcd->colour_code);
+            }
+            if(tms->mac_pipe) { return; }
+            struct tetra_crypto_state* tcs = tms->tcs;
+            if(tcs->mcc != info.mcc || tcs->mnc != info.mnc) {
+                tcs->cc = info.cc;
+                update_current_network(tcs, info.mcc, info.mnc);
+            }
+            if(info.hn >= 0) { __atomic_store_n(&tcs->hn, info.hn, __ATOMIC_RELAXED); }
+            if(info.cckId >= 0 && info.cckId != tcs->cck_id) {
+                __atomic_store_n(&tcs->cck_id, info.cckId, __ATOMIC_RELAXED);
+                update_current_cck(tcs);
+            }
+        }
+
+        void upperMacWorker() {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lck(upperMtx);
+                    upperCnd.wait(lck, [this]() { return upperStop || tetra_mac_pipe_depth(&macPipe); });
+                    if (upperStop && !tetra_mac_pipe_depth(&macPipe)) { return; }
+                }
+                tetra_mac_pipe_run(tms, macPipe.size);
+            }
+        }
+
+        struct VoiceSlot {
+            int16_t coded[VOICE_QUEUE_FRAMES][TETRA_CODEC_CODED_BITS];
+            uint8_t ks[VOICE_QUEUE_FRAMES][TETRA_CODEC_KS_BYTES];
+            bool encrypted[VOICE_QUEUE_FRAMES];
+            int order[VOICE_QUEUE_FRAMES]; //where in voiceFrames the frames go
+            int frames = 0;
+        };
+
+        //One job per timeslot, the frames of a timeslot have to go through its codec in order
+        static void _voiceJob(int index, void* ctx) {
+            osmotetradec* _this = (osmotetradec*) ctx;
+            int tn = _this->voiceJobSlots[index];
+            VoiceSlot& vs = _this->voiceSlots[tn - 1];
+            for (int i = 0; i < vs.frames; i++) {
+                tetra_codec_decode_slot(&_this->tms->codec[tn - 1], vs.coded[i], vs.encrypted[i] ? vs.ks[i] : NULL, _this->voiceFrames[vs.order[i]].samples);
+            }
+        }
+
+        void updateVoiceWanted() {
+            uint8_t mask = (audioWanted || _slotAudioHandler || _recordHandler) ? (1 << TETRA_CODEC_TIMESLOTS) - 1 : 0;
+            __atomic_store_n(&tms->voice_wanted, mask, __ATOMIC_RELAXED);
+        }
+
+        //Both handlers take their frames from the queue, decoded in line or on the pool. Called with the block stopped
+        void updateVoicePath() {
+            bool allSlots = _slotAudioHandler || _recordHandler || (_audioFrameHandler && frameAllSlots);
+            int threads = 1;
+            if (_slotAudioHandler) { threads = std::max<int>(threads, slotThreads); }
+            if (_recordHandler) { threads = std::max<int>(threads, recordThreads); }
+            if (_audioFrameHandler && frameAllSlots) { threads = std::max<int>(threads, frameThreads); }
+            voicePool.reset();
+            if (_slotAudioHandler || _audioFrameHandler || _recordHandler) { voicePool = std::make_unique<WorkerPool>(threads); }
+            if (voicePool && threadTuning) { voicePool->setThreadTuning(*threadTuning); }
+            voiceFrameCount = 0;
+            for (auto& vs : voiceSlots) { vs.frames = 0; }
+            tms->put_voice_frame = voicePool ? put_voice_frame : NULL;
+            tms->voice_all_slots = allSlots;
+            updateVoiceWanted();
+        }
+
+        void flushVoiceFrames() {
+            int jobs = 0;
+            for (int tn = 1; tn <= TETRA_CODEC_TIMESLOTS; tn++) {
+                if (!voiceSlots[tn - 1].frames) { continue; }
+                if (!tms->codec[tn - 1].slot) { tetra_codec_open(&tms->codec[tn - 1]); }
+                voiceJobSlots[jobs++] = tn;
+            }
+            voicePool->run(jobs, _voiceJob, this);
+
+            //Hand the audio out in the order the frames came in
+            if (_recordHandler) {
+                _recordHandler(voiceFrames, voiceFrameCount, _recordCtx);
+            }
+            if (_audioFrameHandler) {
+                _audioFrameHandler(voiceFrames, voiceFrameCount, _audioFrameCtx);
+            }
+            //With only the record handler the active timeslot still has to go to out
+            if (_slotAudioHandler || !_audioFrameHandler) {
+                float conv_data[TETRA_CODEC_SLOT_SAMPLES];
+                for (int i = 0; i < voiceFrameCount; i++) {
+                    TetraAudioFrame& frame = voiceFrames[i];
+                    if (!_slotAudioHandler && !frame.active) { continue; }
+                    volk_16i_s32f_convert_32f(conv_data, frame.samples, 32768.0f, TETRA_CODEC_SLOT_SAMPLES);
+                    if (_slotAudioHandler) { _slotAudioHandler(frame.time.tn, TETRA_CODEC_SLOT_SAMPLES, conv_data, _slotAudioCtx); }
+                    if (!_audioFrameHandler && frame.active) {
+                        if (out_tmp_buff.getWritable(false) >= TETRA_CODEC_SLOT_SAMPLES) {
+                            out_tmp_buff.write(conv_data, TETRA_CODEC_SLOT_SAMPLES);
+                        } else {
+                            voiceDropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+            voiceFrameCount = 0;
+            for (auto& vs : voiceSlots) { vs.frames = 0; }
+        }
+
+        bool softBits = false;
         int inSymsCtr = 0;
         int outSymsCtr = 0;
         void *tetra_tall_ctx;
         struct tetra_rx_state *trs;
         struct tetra_mac_state *tms;
         buffer::RingBuffer<float> out_tmp_buff;
+        std::atomic<uint64_t> voiceDropped = 0;
+        //See skipBits()
+        std::atomic<uint64_t> pendingSkip = 0;
+        //See presetCell()
+        std::mutex presetMtx;
+        TetraCellInfo preset;
+        std::atomic<bool> presetPending = false;
+
+        void (*_slotAudioHandler)(int tn, int count, float* data, void* ctx) = NULL;
+        void* _slotAudioCtx = NULL;
+        int slotThreads = VOICE_POOL_THREADS;
+        void (*_audioFrameHandler)(TetraAudioFrame* frames, int count, void* ctx) = NULL;
+        void* _audioFrameCtx = NULL;
+        bool frameAllSlots = false;
+        int frameThreads = VOICE_POOL_THREADS;
+        void (*_recordHandler)(TetraAudioFrame* frames, int count, void* ctx) = NULL;
+        void* _recordCtx = NULL;
+        int recordThreads = VOICE_POOL_THREADS;
+        std::atomic<bool> audioWanted = true;
+        std::unique_ptr<WorkerPool> voicePool;
+        VoiceSlot voiceSlots[TETRA_CODEC_TIMESLOTS];
+        TetraAudioFrame voiceFrames[TETRA_CODEC_TIMESLOTS * VOICE_QUEUE_FRAMES];
+        int voiceFrameCount = 0;
+        int voiceJobSlots[TETRA_CODEC_TIMESLOTS];
+        std::chrono::steady_clock::time_point blockReceived;
+
+        const ThreadTuning* threadTuning = NULL;
+
+        //See setPipelined()
+        bool pipelined = false;
+        struct tetra_mac_pipe macPipe = {};
+        std::thread upperThread;
+        std::mutex upperMtx;
+        std::condition_variable upperCnd;
+        bool upperStop = false;
     };
 
 }
@@ -0,0 +1,149 @@
+#include "packet_capture.h"
+#include "gsmtap.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+extern "C" {
+    #include "tetra_llc_pdu.h"
+    #include "tetra_mle_pdu.h"
+}
+
+//One timeslot is 85/6 ms
+#define TDMA_SLOT_US_NUM 85000
+#define TDMA_SLOT_US_DEN 6
+#define TDMA_SLOTS_PER_HYPERFRAME (60 * 18 * 4)
+#define IPV4_UDP_HDR_LEN 28
+
+namespace dsp {
+    bool PacketCapture::open(const std::string& path, bool gsmtap) {
+        std::vector<PcapngWriter::Interface> ifaces = {
+            { PCAPNG_LINKTYPE_RAW, "sndcp" },
+            { PCAPNG_LINKTYPE_IPV4, "gsmtap" },
+        };
+        _gsmtap = gsmtap;
+        {
+            std::lock_guard<std::mutex> lck(clockMtx);
+            clockSet = false;
+        }
+        packets = 0;
+        compressed = 0;
+        return writer.open(path, ifaces);
+    }
+
+    void PacketCapture::close() {
+        writer.close();
+    }
+
+    void PacketCapture::setClock(uint64_t anchorUs) {
+        std::lock_guard<std::mutex> lck(clockMtx);
+        fixedAnchorUs = anchorUs;
+        clockSet = false;
+    }
+
+    void PacketCapture::l3Handler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len) {
+        ((PacketCapture*)ctx)->writeL3(*time, *l3, bits, len);
+    }
+
+    void PacketCapture::eventHandler(const tetra_burst_event* events, int count, void* ctx) {
+        ((PacketCapture*)ctx)->writeEvents(events, count);
+    }
+
+    void PacketCapture::writeL3(const struct tetra_tdma_time& time, const struct tetra_l3_event& l3, const uint8_t* bits, unsigned int len) {
+        if (l3.pdisc != TMLE_PDISC_SNDCP || !l3.parsed || l3.fcs == TLLC_FCS_BAD || !l3.sndcp.npdu_len) { return; }
+        if (l3.sndcp.pcomp || l3.sndcp.dcomp) {
+            compressed++;
+            return;
+        }
+
+        //The N-PDU is whole octets, from after the MLE discriminator and the SNDCP header, and no more than the TL-SDU has
+        unsigned int start = 3 + l3.sndcp.npdu_offset;
+        if (start >= len) { return; }
+        const uint8_t* npdu = bits + start;
+        unsigned int npduBits = l3.sndcp.npdu_len;
+        if (npduBits > len - start) { npduBits = len - start; }
+        int bytes = npduBits / 8;
+        uint8_t buf[FRAGSLOT_MAX_BITS / 8];
+        if (bytes > (int)sizeof(buf)) { bytes = sizeof(buf); }
+        for (int i = 0; i < bytes; i++) {
+            uint8_t b = 0;
+            for (int j = 0; j < 8; j++) { b = (b << 1) | (npdu[i * 8 + j] & 1); }
+            buf[i] = b;
+        }
+
+        char comment[128];
+        snprintf(comment, sizeof(comment), "ssi=%u nsapi=%u %s tdma=%u/%u/%u/%u", l3.ssi, l3.sndcp.nsapi,
+                 tetra_get_sndcp_pdut_name(l3.sndcp.pdu_type, 0), time.hn, time.mn, time.fn, time.tn);
+        writer.writePacket(IFACE_SNDCP, timestamp(time), buf, bytes, comment);
+        packets++;
+    }
+
+    void PacketCapture::writeEvents(const tetra_burst_event* events, int count) {
+        if (!_gsmtap) { return; }
+        uint8_t pkt[IPV4_UDP_HDR_LEN + GSMTAP_TETRA_MAX_LEN];
+        for (int i = 0; i < count; i++) {
+            int n = tetraGsmtapEncode(&pkt[IPV4_UDP_HDR_LEN], events[i]);
+            if (!n) { continue; }
+
+            //Loopback IPv4 and UDP header to the GSMTAP port, so Wireshark picks the dissector on its own
+            int total = IPV4_UDP_HDR_LEN + n;
+            uint8_t* ip = pkt;
+            uint8_t* udp = &pkt[20];
+            memset(pkt, 0, IPV4_UDP_HDR_LEN);
+            ip[0] = 0x45;
+            ip[2] = total >> 8;
+            ip[3] = total;
+            ip[6] = 0x40; //don't fragment
+            ip[8] = 64;
+            ip[9] = 17;
+            ip[12] = 127; ip[15] = 1;
+            ip[16] = 127; ip[19] = 1;
+            uint32_t sum = 0;
+            for (int j = 0; j < 20; j += 2) { sum += (ip[j] << 8) | ip[j + 1]; }
+            while (sum >> 16) { sum = (sum & 0xFFFF) + (sum >> 16); }
+            ip[10] = ~sum >> 8;
+            ip[11] = ~sum;
+            udp[0] = GSMTAP_UDP_PORT >> 8;
+            udp[1] = GSMTAP_UDP_PORT & 0xFF;
+            udp[2] = GSMTAP_UDP_PORT >> 8;
+            udp[3] = GSMTAP_UDP_PORT & 0xFF;
+            udp[4] = (total - 20) >> 8;
+            udp[5] = total - 20;
+            //UDP checksum 0: not computed, allowed over IPv4
+
+            writer.writePacket(IFACE_GSMTAP, timestamp(events[i].time), pkt, total);
+        }
+    }
+
+    uint64_t PacketCapture::timestamp(const struct tetra_tdma_time& time) {
+        struct tetra_tdma_time t = time;
+        uint64_t slot = (uint64_t)tetra_tdma_time2fn(&t) * 4 + (time.tn ? time.tn - 1 : 0);
+
+        std::lock_guard<std::mutex> lck(clockMtx);
+        if (!clockSet) {
+            anchorUs = fixedAnchorUs ? fixedAnchorUs : std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            lastSlot = slot;
+            slotsSinceAnchor = 0;
+            clockSet = true;
+        }
+        int64_t d = (int64_t)(slot - lastSlot);
+        if (d < -TDMA_SLOTS_PER_HYPERFRAME || d > TDMA_SLOTS_PER_HYPERFRAME) {
+            //Lost sync or the hyperframe number changed under us: carry on from the last packet
+            anchorUs += slotsSinceAnchor * TDMA_SLOT_US_NUM / TDMA_SLOT_US_DEN;
+            slotsSinceAnchor = 0;
+            lastSlot = slot;
+            d = 0;
+        }
+        //The two handlers are a little apart, a slot just behind the last one keeps its place
+        int64_t slots = (int64_t)slotsSinceAnchor + d;
+        if (slots < 0) { slots = 0; }
+        if (d > 0) {
+            slotsSinceAnchor += d;
+            lastSlot = slot;
+        }
+        return anchorUs + (uint64_t)slots * TDMA_SLOT_US_NUM / TDMA_SLOT_US_DEN;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "pcapng_writer.h"
+
+extern "C" {
+    #include "tetra_common.h"
+}
+
+namespace dsp {
+    //Exports what a decoder hands out to a pcapng file: the N-PDUs (IP packets) of SN-DATA and SN-UNITDATA on
+    //interface 0, and optionally the decoded MAC blocks as GSMTAP over UDP/IPv4 on interface 1. The timestamps start
+    //at the wall clock of the first packet and go on by the TDMA time, so the spacing is the one on air
+    class PacketCapture {
+    public:
+        enum {
+            IFACE_SNDCP,
+            IFACE_GSMTAP,
+        };
+
+        PacketCapture() {}
+
+        bool open(const std::string& path, bool gsmtap);
+        void close();
+        bool isOpen() { return writer.isOpen(); }
+
+        //Timestamps start at anchorUs (us since the epoch) rather than at the wall clock of the first packet, for output
+        //that does not depend on when it is made. 0 goes back to the wall clock
+        void setClock(uint64_t anchorUs);
+
+        //Fits osmotetradec::setL3Handler, ctx is the capture
+        static void l3Handler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len);
+        //Fits BurstEventReader, only the block records are written
+        static void eventHandler(const tetra_burst_event* events, int count, void* ctx);
+
+        void writeL3(const struct tetra_tdma_time& time, const struct tetra_l3_event& l3, const uint8_t* bits, unsigned int len);
+        void writeEvents(const tetra_burst_event* events, int count);
+
+        //N-PDUs written, and those left out for their compressed headers or data, which have no pcap form
+        uint64_t getPackets() { return packets; }
+        uint64_t getCompressed() { return compressed; }
+        //Lost because the disk fell behind
+        uint64_t getDropped() { return writer.getDropped(); }
+
+    protected:
+        uint64_t timestamp(const struct tetra_tdma_time& time);
+
+        PcapngWriter writer;
+        bool _gsmtap = false;
+
+        //Both handlers run on threads of their own
+        std::mutex clockMtx;
+        bool clockSet = false;
+        uint64_t anchorUs = 0;
+        uint64_t fixedAnchorUs = 0;
+        uint64_t lastSlot = 0;
+        uint64_t slotsSinceAnchor = 0;
+
+        std::atomic<uint64_t> packets = 0;
+        std::atomic<uint64_t> compressed = 0;
+    };
+}
@@ -0,0 +1,151 @@
+#include "pcapng_writer.h"
+
+#include <string.h>
+
+#define PCAPNG_BLOCK_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB 0x00000001
+#define PCAPNG_BLOCK_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_COMMENT 1
+#define PCAPNG_OPT_IF_NAME 2
+
+namespace dsp {
+    //Blocks and options are padded to 32 bits
+    static inline int pad4(int len) { return (len + 3) & ~3; }
+
+    PcapngWriter::~PcapngWriter() {
+        close();
+    }
+
+    bool PcapngWriter::open(const std::string& path, const std::vector<Interface>& interfaces, int bufferSize, int flushMs) {
+        close();
+        file = fopen(path.c_str(), "wb");
+        if (!file) { return false; }
+        _bufferSize = bufferSize;
+        flushInterval = std::chrono::milliseconds(flushMs);
+        written = 0;
+        dropped = 0;
+        stopping = false;
+        current.clear();
+        current.reserve(_bufferSize);
+
+        //Section header, in host byte order as the magic tells the reader. Major version 1, minor 0, no known length
+        uint32_t shb[3] = { PCAPNG_BLOCK_SHB, 28, PCAPNG_BYTE_ORDER_MAGIC };
+        uint16_t version[2] = { 1, 0 };
+        int64_t sectionLen = -1;
+        append(shb, sizeof(shb));
+        append(version, sizeof(version));
+        append(&sectionLen, sizeof(sectionLen));
+        append(&shb[1], sizeof(shb[1]));
+
+        for (const auto& i : interfaces) {
+            uint32_t hdr[2] = { PCAPNG_BLOCK_IDB, (uint32_t)(20 + 4 + pad4(i.name.size()) + 4) };
+            uint16_t linkType[2] = { i.linkType, 0 };
+            uint32_t snapLen = 0;
+            append(hdr, sizeof(hdr));
+            append(linkType, sizeof(linkType));
+            append(&snapLen, sizeof(snapLen));
+            appendOption(PCAPNG_OPT_IF_NAME, i.name.c_str(), i.name.size());
+            appendOption(PCAPNG_OPT_ENDOFOPT, NULL, 0);
+            append(&hdr[1], sizeof(hdr[1]));
+        }
+        currentSince = std::chrono::steady_clock::now();
+
+        workerThread = std::thread(&PcapngWriter::worker, this);
+        return true;
+    }
+
+    void PcapngWriter::close() {
+        if (!file) { return; }
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+        }
+        cnd.notify_all();
+        if (workerThread.joinable()) { workerThread.join(); }
+        fclose(file);
+        file = NULL;
+        pending.clear();
+        spare.clear();
+    }
+
+    void PcapngWriter::writePacket(int iface, uint64_t ts, const uint8_t* data, int len, const char* comment) {
+        int commentLen = comment ? strlen(comment) : 0;
+        uint32_t blockLen = 28 + pad4(len) + (comment ? 4 + pad4(commentLen) + 4 : 0) + 4;
+
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!file || stopping) { return; }
+        if (!current.empty() && current.size() + blockLen > (size_t)_bufferSize && !submit()) {
+            dropped++;
+            return;
+        }
+        if (current.empty()) { currentSince = std::chrono::steady_clock::now(); }
+
+        uint32_t hdr[7] = { PCAPNG_BLOCK_EPB, blockLen, (uint32_t)iface, (uint32_t)(ts >> 32), (uint32_t)ts, (uint32_t)len, (uint32_t)len };
+        append(hdr, sizeof(hdr));
+        append(data, len);
+        static const uint8_t zero[4] = {};
+        append(zero, pad4(len) - len);
+        if (comment) {
+            appendOption(PCAPNG_OPT_COMMENT, comment, commentLen);
+            appendOption(PCAPNG_OPT_ENDOFOPT, NULL, 0);
+        }
+        append(&blockLen, sizeof(blockLen));
+        written++;
+    }
+
+    bool PcapngWriter::submit() {
+        if (pending.size() >= PCAPNG_MAX_PENDING) { return false; }
+        pending.push_back(std::move(current));
+        if (spare.empty()) {
+            current = std::vector<uint8_t>();
+            current.reserve(_bufferSize);
+        } else {
+            current = std::move(spare.back());
+            spare.pop_back();
+        }
+        current.clear();
+        cnd.notify_one();
+        return true;
+    }
+
+    void PcapngWriter::append(const void* data, int len) {
+        current.insert(current.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+    }
+
+    void PcapngWriter::appendOption(uint16_t code, const void* data, int len) {
+        uint16_t hdr[2] = { code, (uint16_t)len };
+        static const uint8_t zero[4] = {};
+        append(hdr, sizeof(hdr));
+        if (len) { append(data, len); }
+        append(zero, pad4(len) - len);
+    }
+
+    void PcapngWriter::worker() {
+        std::unique_lock<std::mutex> lck(mtx);
+        while (true) {
+            cnd.wait_for(lck, flushInterval, [this]() { return stopping || !pending.empty(); });
+            //A part filled buffer goes out once it is old enough, and everything on the way out
+            if (!current.empty() && (stopping || std::chrono::steady_clock::now() - currentSince >= flushInterval)) {
+                if (!submit() && stopping) {
+                    pending.push_back(std::move(current));
+                    current.clear();
+                }
+            }
+            if (pending.empty()) {
+                if (stopping) { return; }
+                continue;
+            }
+
+            std::vector<uint8_t> buf = std::move(pending.front());
+            pending.pop_front();
+            lck.unlock();
+            fwrite(buf.data(), 1, buf.size(), file);
+            fflush(file);
+            lck.lock();
+            buf.clear();
+            spare.push_back(std::move(buf));
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Packets are collected in buffers of this many bytes, a full one is handed to the flush thread
+#define PCAPNG_DEFAULT_BUFFER_SIZE (1 << 20)
+//A buffer that is not full is still written once its first packet waited this long
+#define PCAPNG_DEFAULT_FLUSH_MS 1000
+//Buffers waiting for the disk before new packets are dropped
+#define PCAPNG_MAX_PENDING 8
+
+//pcap link types
+#define PCAPNG_LINKTYPE_RAW 101
+#define PCAPNG_LINKTYPE_IPV4 228
+
+namespace dsp {
+    //pcapng capture file written in large batches. writePacket only appends the packet to a memory buffer, full
+    //buffers are written out by a thread of the writer, so whoever captures is never held up by the disk. When the
+    //disk falls behind by PCAPNG_MAX_PENDING buffers the packets are dropped and counted instead
+    class PcapngWriter {
+    public:
+        struct Interface {
+            uint16_t linkType;
+            std::string name;
+        };
+
+        PcapngWriter() {}
+
+        ~PcapngWriter();
+
+        //Starts a new file with one section and the interfaces, whose index is what writePacket takes. false if the
+        //file could not be created
+        bool open(const std::string& path, const std::vector<Interface>& interfaces, int bufferSize = PCAPNG_DEFAULT_BUFFER_SIZE, int flushMs = PCAPNG_DEFAULT_FLUSH_MS);
+
+        //Writes out what is buffered and closes the file
+        void close();
+
+        bool isOpen() { return file != NULL; }
+
+        //An enhanced packet block, ts in microseconds since the epoch. comment goes into the block as opt_comment and
+        //may be NULL. Thread safe
+        void writePacket(int iface, uint64_t ts, const uint8_t* data, int len, const char* comment = NULL);
+
+        uint64_t getWritten() { return written; }
+        uint64_t getDropped() { return dropped; }
+
+    protected:
+        void worker();
+        //Hand the current buffer to the flush thread, called locked. false if too many are pending already
+        bool submit();
+        void append(const void* data, int len);
+        void appendOption(uint16_t code, const void* data, int len);
+
+        FILE* file = NULL;
+        int _bufferSize = PCAPNG_DEFAULT_BUFFER_SIZE;
+        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(PCAPNG_DEFAULT_FLUSH_MS);
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        std::vector<uint8_t> current;
+        std::chrono::steady_clock::time_point currentSince;
+        std::deque<std::vector<uint8_t>> pending;
+        //Written buffers kept for reuse, so the steady state allocates nothing
+        std::vector<std::vector<uint8_t>> spare;
+        bool stopping = false;
+        std::thread workerThread;
+
+        std::atomic<uint64_t> written = 0;
+        std::atomic<uint64_t> dropped = 0;
+    };
+}
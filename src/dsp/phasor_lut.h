@@ -0,0 +1,41 @@
+#pragma once
+#include <dsp/types.h>
+#include <math.h>
+
+namespace dsp {
+    namespace math {
+        //Unit phasor of any angle from a sin/cos table with linear interpolation, off by at most ~5e-6 from math::phasor
+        class PhasorTable {
+        public:
+            static constexpr int SIZE = 1024;
+
+            static const PhasorTable& get() {
+                static const PhasorTable table;
+                return table;
+            }
+
+            inline complex_t phasor(float phase) const {
+                float pos = phase * ((float)SIZE / (2.0f * FL_M_PI));
+                float whole = floorf(pos);
+                float frac = pos - whole;
+                int i = (int)whole & (SIZE - 1);
+                return table[i] + ((table[i + 1] - table[i]) * frac);
+            }
+
+        private:
+            PhasorTable() {
+                for (int i = 0; i <= SIZE; i++) {
+                    double ph = 2.0 * M_PI * (double)i / (double)SIZE;
+                    table[i] = { (float)cos(ph), (float)sin(ph) };
+                }
+            }
+
+            //One extra entry so the interpolation never wraps
+            complex_t table[SIZE + 1];
+        };
+
+        inline complex_t lutPhasor(float phase) {
+            return PhasorTable::get().phasor(phase);
+        }
+    }
+}
@@ -1,11 +1,41 @@
 #include "pi4dqpsk.h"
 
+#include <algorithm>
+#include <numeric>
+
+//Samples taken through the whole chain at once, small enough for the tile and the stage state to stay in L1
+#define PI4DQPSK_TILE_SIZE 512
+//Coarse acquisition: estimates tried before the loops are left to find the carrier on their own
+#define PI4DQPSK_ACQ_MAX_TRIES 8
+//Loop bandwidths after the estimate, times the normal ones, and for how long: two TDMA frames
+#define PI4DQPSK_ACQ_BANDWIDTH_SCALE 4.0
+#define PI4DQPSK_ACQ_WIDE_SYMBOLS (2 * 255 * 4)
+//Idle mode: the chain runs a second of symbols unsynced before going to sleep, and sleeps four. Asleep, the power is
+//averaged over blocks of PI4DQPSK_IDLE_BLOCK decimated samples, a block 6 dB over the floor wakes it. The floor follows
+//the blocks under it at once and those above it slowly
+#define PI4DQPSK_IDLE_PROBE_SYMBOLS 18000
+#define PI4DQPSK_IDLE_SLEEP_SYMBOLS (4 * 18000)
+#define PI4DQPSK_IDLE_DECIM 8
+#define PI4DQPSK_IDLE_BLOCK 256
+#define PI4DQPSK_IDLE_WAKE_RATIO 4.0f
+#define PI4DQPSK_IDLE_FLOOR_RATE (1.0f / 64.0f)
+//Fixed point: 1.0 out of the AGC as int16, headroom for the peaks of the RRC output and the noise
+#define PI4DQPSK_Q15_SCALE 4096.0f
+
 namespace dsp {
     namespace demod {
+        static std::shared_ptr<const SharedTaps<float>> sharedRRC(int tapCount, double beta, double symbolrate, double samplerate) {
+            std::string key = TapCache::key("rrc", { (double)tapCount, beta, symbolrate, samplerate });
+            return TapCache::get<SharedTaps<float>>(key, [=](SharedTaps<float>& t) {
+                t.taps = taps::rootRaisedCosine<float>(tapCount, beta, symbolrate, samplerate);
+            });
+        }
+
         PI4DQPSK::~PI4DQPSK() {
             if (!base_type::_block_init) { return; }
             base_type::stop();
-            taps::free(rrcTaps);
+            buffer::free(tile);
+            buffer::free(tileQ15);
         }
 
         void PI4DQPSK::init(stream<complex_t>* in, double symbolrate, double samplerate, int rrcTapCount, double rrcBeta, double agcRate, double costasBandwidth, double fllBandwidth, double omegaGain, double muGain, double omegaRelLimit) {
@@ -13,56 +43,109 @@ namespace dsp {
             _samplerate = samplerate;
             _rrcTapCount = rrcTapCount;
             _rrcBeta = rrcBeta;
+            _fllBandwidth = fllBandwidth;
+            _costasBandwidth = costasBandwidth;
+            _omegaGain = omegaGain;
+            _muGain = muGain;
+            pendingRates.symbolrate = symbolrate;
+            pendingRates.samplerate = samplerate;
+            pendingRates.rrcTapCount = rrcTapCount;
+            pendingRates.rrcBeta = rrcBeta;
 
-            fll.init(NULL, fllBandwidth, _symbolrate, _samplerate, _rrcTapCount, _rrcBeta, 0, -FL_M_PI/2.0f, FL_M_PI/2.0f);
-            rrcTaps = taps::rootRaisedCosine<float>(_rrcTapCount, _rrcBeta, _symbolrate, _samplerate);
+            //Both only ever see one tile at a time, their delay buffers need no more
+            fll.init(NULL, fllBandwidth, _symbolrate, _samplerate, _rrcTapCount, _rrcBeta, 0, -FL_M_PI/2.0f, FL_M_PI/2.0f, PI4DQPSK_TILE_SIZE);
+            fll.setBlockSize(PI4DQPSK_FLL_BLOCK_SIZE);
+            rrcShared = sharedRRC(_rrcTapCount, _rrcBeta, _symbolrate, _samplerate);
+            rrcTaps = rrcShared->taps;
             rrc.init(NULL, rrcTaps);
+            rrcQ15.init(rrcTaps, PI4DQPSK_TILE_SIZE);
             agc.init(NULL, 1.0, 10e6, agcRate);
             costas.init(NULL, costasBandwidth, 0, 0, -FL_M_PI/10.0f, FL_M_PI/10.0f); //frequency range limit here is REQUIRED!!!
-            recov.init(NULL, _samplerate / _symbolrate,  omegaGain, muGain, omegaRelLimit);
+            recov.init(NULL, _samplerate / _symbolrate,  omegaGain, muGain, omegaRelLimit, 1, 128, 8, PI4DQPSK_TILE_SIZE);
 
             rrc.out.free();
             agc.out.free();
             costas.out.free();
             recov.out.free();
 
+            tile = buffer::alloc<complex_t>(PI4DQPSK_TILE_SIZE);
+            tileQ15 = buffer::alloc<q15::cq15>(PI4DQPSK_TILE_SIZE);
+
+            coarse.init(_symbolrate, _samplerate, _rrcBeta);
+            startAcquisition();
+            loopLocked = false;
+            lockError = FL_M_PI / 8.0f;
+            applyLoopBandwidths();
+
             base_type::init(in);
         }
 
         void PI4DQPSK::setSymbolrate(double symbolrate) {
             assert(base_type::_block_init);
-            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            base_type::tempStop();
-            _symbolrate = symbolrate;
-            taps::free(rrcTaps);
-            rrcTaps = taps::rootRaisedCosine<float>(_rrcTapCount, _rrcBeta, _symbolrate, _samplerate);
-            rrc.setTaps(rrcTaps);
-            recov.setOmega(_samplerate / _symbolrate);
-            base_type::tempStart();
+            std::lock_guard<std::mutex> lck(rateMtx);
+            pendingRates.symbolrate = symbolrate;
+            publishRates();
         }
 
         void PI4DQPSK::setSamplerate(double samplerate) {
             assert(base_type::_block_init);
-            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            base_type::tempStop();
-            _samplerate = samplerate;
-            taps::free(rrcTaps);
-            rrcTaps = taps::rootRaisedCosine<float>(_rrcTapCount, _rrcBeta, _symbolrate, _samplerate);
-            rrc.setTaps(rrcTaps);
-            recov.setOmega(_samplerate / _symbolrate);
-            base_type::tempStart();
+            std::lock_guard<std::mutex> lck(rateMtx);
+            pendingRates.samplerate = samplerate;
+            publishRates();
         }
 
         void PI4DQPSK::setRRCParams(int rrcTapCount, double rrcBeta) {
             assert(base_type::_block_init);
-            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            base_type::tempStop();
-            _rrcTapCount = rrcTapCount;
-            _rrcBeta = rrcBeta;
-            taps::free(rrcTaps);
-            rrcTaps = taps::rootRaisedCosine<float>(_rrcTapCount, _rrcBeta, _symbolrate, _samplerate);
+            std::lock_guard<std::mutex> lck(rateMtx);
+            pendingRates.rrcTapCount = rrcTapCount;
+            pendingRates.rrcBeta = rrcBeta;
+            publishRates();
+        }
+
+        //rateMtx held. Taps left over from the last update, taken or not, make room for the new ones
+        void PI4DQPSK::publishRates() {
+            RateUpdate& u = pendingRates;
+            u.rrcTaps = sharedRRC(u.rrcTapCount, u.rrcBeta, u.symbolrate, u.samplerate);
+            designFrontEnd(u);
+            //The FLL takes its band-edge taps the same way, on its next process()
+            fll.setRates(u.symbolrate, u.samplerate);
+            ratesPending.store(true, std::memory_order_release);
+        }
+
+        //DSP thread, before the first tile
+        void PI4DQPSK::takeRates() {
+            //A setter still designing, a later call picks it up
+            std::unique_lock<std::mutex> lck(rateMtx, std::try_to_lock);
+            if (!lck.owns_lock()) { return; }
+            RateUpdate& u = pendingRates;
+            bool newSamplerate = (u.samplerate != _samplerate);
+            _symbolrate = u.symbolrate;
+            _samplerate = u.samplerate;
+            _rrcTapCount = u.rrcTapCount;
+            _rrcBeta = u.rrcBeta;
+            _inSamplerate = u.inSamplerate;
+
+            std::swap(rrcShared, u.rrcTaps);
+            rrcTaps = rrcShared->taps;
             rrc.setTaps(rrcTaps);
-            base_type::tempStart();
+            rrcQ15.setTaps(rrcTaps);
+            useFrontEnd = u.useFrontEnd;
+            if (useFrontEnd) {
+                std::swap(frontEndShared, u.frontEndTaps);
+                frontEndTaps = frontEndShared->taps;
+                if (frontEndInit) {
+                    frontEnd.setRatio(u.interp, u.decim, frontEndTaps);
+                }
+                else {
+                    frontEnd.init(NULL, u.interp, u.decim, frontEndTaps);
+                    frontEnd.out.free();
+                    frontEndInit = true;
+                }
+                frontEnd.reset();
+            }
+            recov.setOmega(_samplerate / _symbolrate);
+            if (newSamplerate) { coarse.setSamplerate(_samplerate); }
+            ratesPending.store(false, std::memory_order_relaxed);
         }
 
         void PI4DQPSK::setRRCTapCount(int rrcTapCount) {
@@ -82,33 +165,157 @@ namespace dsp {
         void PI4DQPSK::setCostasBandwidth(double bandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            costas.setBandwidth(bandwidth);
+            _costasBandwidth = bandwidth;
+            applyLoopBandwidths();
         }
 
         void PI4DQPSK::setFllBandwidth(double fllBandwidth) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            fll.setBandwidth(fllBandwidth);
+            _fllBandwidth = fllBandwidth;
+            applyLoopBandwidths();
+        }
+
+        void PI4DQPSK::setAdaptiveBandwidth(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            adaptiveBandwidth = enabled;
+            if (!enabled) { loopLocked = false; }
+            applyLoopBandwidths();
+        }
+
+        void PI4DQPSK::setThreadTuning(const ThreadTuning* tuning) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            threadTuning = tuning;
+            base_type::tempStart();
+        }
+
+        void PI4DQPSK::setFixedPoint(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            if (enabled != fixedPoint) {
+                //The delay lines of the other path are stale, the loops carry on
+                fll.resetHistory();
+                rrc.reset();
+                rrcQ15.reset();
+                fixedPoint = enabled;
+            }
+            base_type::tempStart();
+        }
+
+        void PI4DQPSK::setCoarseAcquisition(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            coarseEnabled = enabled;
+            if (enabled) {
+                startAcquisition();
+            } else {
+                acqState = ACQ_IDLE;
+                applyLoopBandwidths();
+            }
+            base_type::tempStart();
+        }
+
+        void PI4DQPSK::acquire() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            startAcquisition();
+            base_type::tempStart();
+        }
+
+        void PI4DQPSK::startAcquisition() {
+            if (!coarseEnabled) { return; }
+            bool wide = (acqState == ACQ_WIDE);
+            coarse.reset();
+            acqTries = 0;
+            acqState = ACQ_ESTIMATING;
+            if (wide) { applyLoopBandwidths(); }
+        }
+
+        void PI4DQPSK::applyLoopBandwidths() {
+            //None of the loops runs as a block of its own, they take new coefficients from inside process()
+            double scale = 1.0;
+            double clockScale = 1.0;
+            if (acqState == ACQ_WIDE) {
+                scale = PI4DQPSK_ACQ_BANDWIDTH_SCALE;
+            } else if (adaptiveBandwidth) {
+                scale = loopLocked ? PI4DQPSK_LOCK_NARROW_SCALE : PI4DQPSK_LOCK_WIDE_SCALE;
+                clockScale = loopLocked ? PI4DQPSK_LOCK_NARROW_SCALE : 1.0;
+            }
+            fll.setBandwidth(_fllBandwidth * scale);
+            costas.setBandwidth(_costasBandwidth * scale);
+            recov.setMuGain(_muGain * clockScale);
+            recov.setOmegaGain(_omegaGain * clockScale * clockScale);
+        }
+
+        void PI4DQPSK::updateLock(int count, const complex_t* sym) {
+            //Angle to the quadrant diagonal, the same polynomial atan as DQPSKSymbolExtractor
+            float err = lockError;
+            for (int i = 0; i < count; i++) {
+                float re = fabsf(sym[i].re);
+                float im = fabsf(sym[i].im);
+                float r = fabsf(im - re) / (im + re + 1e-20f);
+                float dist = r * ((FL_M_PI / 4.0f) + (0.273f * (1.0f - r)));
+                err += (dist - err) * PI4DQPSK_LOCK_AVG_RATE;
+            }
+            lockError = err;
+            bool locked = (err < (loopLocked ? PI4DQPSK_LOCK_EXIT_ERROR : PI4DQPSK_LOCK_ENTER_ERROR));
+            if (locked == loopLocked) { return; }
+            loopLocked = locked;
+            applyLoopBandwidths();
+        }
+
+        //Called with the samples the FLL is about to get
+        void PI4DQPSK::acquireStep(int count, const complex_t* in) {
+            if (acqState == ACQ_WIDE) {
+                acqWideLeft -= count;
+                if (acqWideLeft <= 0) {
+                    acqState = ACQ_IDLE;
+                    applyLoopBandwidths();
+                }
+                return;
+            }
+            if (!coarse.feed(count, in)) { return; }
+            if (!coarse.isValid()) {
+                //Nothing to lock to yet, try again on the next samples
+                coarse.reset();
+                if (++acqTries >= PI4DQPSK_ACQ_MAX_TRIES) { acqState = ACQ_IDLE; }
+                return;
+            }
+            coarseFreq = coarse.getFrequency();
+            float f = 2.0 * FL_M_PI * coarseFreq / _samplerate;
+            fll.force_set_freq(std::clamp<float>(f, -FL_M_PI / 2.0f, FL_M_PI / 2.0f));
+            acqWideLeft = PI4DQPSK_ACQ_WIDE_SYMBOLS * _samplerate / _symbolrate;
+            acqState = ACQ_WIDE;
+            applyLoopBandwidths();
         }
 
         void PI4DQPSK::setMMParams(double omegaGain, double muGain, double omegaRelLimit) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            recov.setOmegaGain(omegaGain);
-            recov.setMuGain(muGain);
+            _omegaGain = omegaGain;
+            _muGain = muGain;
             recov.setOmegaRelLimit(omegaRelLimit);
+            applyLoopBandwidths();
         }
 
         void PI4DQPSK::setOmegaGain(double omegaGain) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            recov.setOmegaGain(omegaGain);
+            _omegaGain = omegaGain;
+            applyLoopBandwidths();
         }
 
         void PI4DQPSK::setMuGain(double muGain) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            recov.setMuGain(muGain);
+            _muGain = muGain;
+            applyLoopBandwidths();
         }
 
         void PI4DQPSK::setOmegaRelLimit(double omegaRelLimit) {
@@ -117,26 +324,196 @@ namespace dsp {
             recov.setOmegaRelLimit(omegaRelLimit);
         }
 
+        void PI4DQPSK::setInputSamplerate(double inSamplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::mutex> lck(rateMtx);
+            pendingRates.inSamplerate = inSamplerate;
+            publishRates();
+        }
+
+        void PI4DQPSK::designFrontEnd(RateUpdate& u) {
+            u.frontEndTaps = designFrontEndTaps(u.symbolrate, u.samplerate, u.rrcTapCount, u.rrcBeta, u.inSamplerate, u.interp, u.decim);
+            u.useFrontEnd = (bool)u.frontEndTaps;
+        }
+
+        std::shared_ptr<const SharedTaps<float>> PI4DQPSK::designFrontEndTaps(double symbolrate, double samplerate, int rrcTapCount, double rrcBeta, double inSamplerate, int& interp, int& decim) {
+            //Decimation only, the tiles have no room for extra samples
+            if (round(inSamplerate) <= round(samplerate)) { return NULL; }
+
+            int inRate = round(inSamplerate);
+            int outRate = round(samplerate);
+            int g = std::gcd(inRate, outRate);
+            interp = outRate / g;
+            decim = inRate / g;
+
+            //Same RRC span in time as the normal path, designed at the interpolated rate
+            int tapCount = ((int)((double)rrcTapCount * (double)interp * inSamplerate / samplerate)) | 1;
+            double beta = rrcBeta;
+            double designRate = (double)interp * inSamplerate;
+            std::shared_ptr<const SharedTaps<float>> normal = sharedRRC(rrcTapCount, rrcBeta, symbolrate, samplerate);
+            const tap<float>& normalTaps = normal->taps;
+            std::string key = TapCache::key("pi4dqpsk_front_end", { (double)rrcTapCount, beta, symbolrate, samplerate, inSamplerate });
+            return TapCache::get<SharedTaps<float>>(key, [&](SharedTaps<float>& t) {
+                t.taps = taps::rootRaisedCosine<float>(tapCount, beta, symbolrate, designRate);
+
+                //Every polyphase branch gets the DC gain of the normal RRC, so the loops after it see the same levels
+                float rrcGain = 0.0f;
+                float frontEndGain = 0.0f;
+                for (int i = 0; i < normalTaps.size; i++) { rrcGain += normalTaps.taps[i]; }
+                for (int i = 0; i < t.taps.size; i++) { frontEndGain += t.taps.taps[i]; }
+                float scale = rrcGain * (float)interp / frontEndGain;
+                for (int i = 0; i < t.taps.size; i++) {
+                    t.taps.taps[i] *= scale;
+                }
+            });
+        }
+
         void PI4DQPSK::reset() {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
             base_type::tempStop();
             fll.reset();
             rrc.reset();
+            rrcQ15.reset();
+            if (useFrontEnd) { frontEnd.reset(); }
             agc.reset();
             costas.reset();
             recov.reset();
+            startAcquisition();
+            loopLocked = false;
+            lockError = FL_M_PI / 8.0f;
+            applyLoopBandwidths();
+            if (idleEnabled) { idleWake(false); }
             base_type::tempStart();
         }
 
+        void PI4DQPSK::setSuspended(bool suspended) {
+            this->suspended.store(suspended, std::memory_order_relaxed);
+        }
+
+        void PI4DQPSK::setResumeHandler(void (*handler)(double symbols, void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _resumeHandler = handler;
+            _resumeCtx = ctx;
+            base_type::tempStart();
+        }
+
+        void PI4DQPSK::setIdleMode(bool enabled, bool (*synced)(void* ctx), void* ctx) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            idleEnabled = enabled && synced;
+            _idleSynced = synced;
+            _idleCtx = ctx;
+            idleWake(false);
+            base_type::tempStart();
+        }
+
+        double PI4DQPSK::idleSamples(double symbols) {
+            return symbols * (useFrontEnd ? _inSamplerate : _samplerate) / _symbolrate;
+        }
+
+        void PI4DQPSK::idleWake(bool acquire) {
+            idleAsleep = false;
+            idleLeft = idleSamples(PI4DQPSK_IDLE_PROBE_SYMBOLS);
+            if (acquire) { startAcquisition(); }
+        }
+
+        //True while asleep, the samples are not to be demodulated
+        bool PI4DQPSK::idleStep(int count, const complex_t* in) {
+            if (!idleAsleep) {
+                if (_idleSynced(_idleCtx)) {
+                    idleLeft = idleSamples(PI4DQPSK_IDLE_PROBE_SYMBOLS);
+                    return false;
+                }
+                idleLeft -= count;
+                if (idleLeft > 0) { return false; }
+                //The floor is measured anew every sleep, a carrier that woke it last time without syncing has become the floor
+                idleAsleep = true;
+                idleLeft = idleSamples(PI4DQPSK_IDLE_SLEEP_SYMBOLS);
+                idlePhase = 0;
+                idleFill = 0;
+                idleAcc = 0.0f;
+                idleFloor = -1.0f;
+                return true;
+            }
+
+            int i = idlePhase;
+            for (; i < count; i += PI4DQPSK_IDLE_DECIM) {
+                idleAcc += in[i].re * in[i].re + in[i].im * in[i].im;
+                if (++idleFill < PI4DQPSK_IDLE_BLOCK) { continue; }
+                float power = idleAcc / PI4DQPSK_IDLE_BLOCK;
+                idleAcc = 0.0f;
+                idleFill = 0;
+                if (idleFloor < 0.0f || power < idleFloor) {
+                    idleFloor = power;
+                } else if (power > idleFloor * PI4DQPSK_IDLE_WAKE_RATIO) {
+                    idleWake(true);
+                    return false;
+                } else {
+                    idleFloor += (power - idleFloor) * PI4DQPSK_IDLE_FLOOR_RATE;
+                }
+            }
+            idlePhase = i - count;
+            idleLeft -= count;
+            if (idleLeft > 0) { return true; }
+            idleWake(false);
+            return false;
+        }
+
+        //The FLL and, without the front end, the RRC filter on the tile in fixed point
+        int PI4DQPSK::processFixed(int count, bool matchedFilter) {
+            q15::fromFloat(tile, tileQ15, count, PI4DQPSK_Q15_SCALE);
+            fll.processQ15(count, tileQ15, tileQ15, PI4DQPSK_Q15_SCALE);
+            if (matchedFilter) { rrcQ15.process(count, tileQ15, tileQ15); }
+            q15::toFloat(tileQ15, tile, count, 1.0f / PI4DQPSK_Q15_SCALE);
+            return count;
+        }
+
         int PI4DQPSK::process(int count, const complex_t* in, complex_t* out) {
-            int ret = count;
-            ret = agc.process(ret, (complex_t*) in, out);
-            ret = fll.process(ret, out, out);
-            ret = rrc.process(ret, out, out);
-            ret = recov.process(ret, out, out);
-            ret = costas.process(ret, out, out);
-            return ret;
+            if (suspended.load(std::memory_order_relaxed) || (idleEnabled && idleStep(count, in))) {
+                droppedSamples += count;
+                return 0;
+            }
+            if (droppedSamples) {
+                double inRate = useFrontEnd ? _inSamplerate : _samplerate;
+                if (_resumeHandler) { _resumeHandler((double)droppedSamples * _symbolrate / inRate, _resumeCtx); }
+                droppedSamples = 0;
+            }
+
+            //Run every stage on one tile before moving to the next instead of streaming the whole buffer through each stage
+            TETRA_PROF_START(profT);
+            if (ratesPending.load(std::memory_order_acquire)) { takeRates(); }
+            int outCount = 0;
+            for (int i = 0; i < count; i += PI4DQPSK_TILE_SIZE) {
+                int ret = std::min<int>(PI4DQPSK_TILE_SIZE, count - i);
+                ret = agc.process(ret, (complex_t*) &in[i], tile);
+                if (useFrontEnd) {
+                    //The front end applies the matched filter while resampling
+                    ret = frontEnd.process(ret, tile, tile);
+                    if (acqState != ACQ_IDLE) { acquireStep(ret, tile); }
+                    ret = fixedPoint ? processFixed(ret, false) : fll.process(ret, tile, tile);
+                }
+                else if (fixedPoint) {
+                    if (acqState != ACQ_IDLE) { acquireStep(ret, tile); }
+                    ret = processFixed(ret, true);
+                }
+                else {
+                    if (acqState != ACQ_IDLE) { acquireStep(ret, tile); }
+                    ret = fll.process(ret, tile, tile);
+                    ret = rrc.process(ret, tile, tile);
+                }
+                ret = recov.process(ret, tile, &out[outCount]);
+                ret = costas.process(ret, &out[outCount], &out[outCount]);
+                if (adaptiveBandwidth) { updateLock(ret, &out[outCount]); }
+                outCount += ret;
+            }
+            TETRA_PROF_ADD(TETRA_PROF_DEMOD_CALLS, 1);
+            TETRA_PROF_ADD(TETRA_PROF_DEMOD_SAMPLES, count);
+            TETRA_PROF_STOP(TETRA_PROF_DEMOD_NS, profT);
+            return outCount;
         }
     }
 }
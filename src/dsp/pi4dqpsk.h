@@ -16,11 +16,35 @@
 #include <dsp/loop/fast_agc.h>
 #include <dsp/loop/costas.h>
 #include <dsp/clock_recovery/mm.h>
+#include <dsp/multirate/polyphase_resampler.h>
 #include <math.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 #include "fll.h"
 #include "pi4dqpsk_costas.h"
 #include "complex_fd.h"
+#include "coarse_freq.h"
+#include "q15_dsp.h"
+#include "tap_cache.h"
+#include "thread_tuning.h"
+
+extern "C" {
+    #include "tetra_prof.h"
+}
+
+//FLL loop update interval in samples, short against the FLL time constant
+#define PI4DQPSK_FLL_BLOCK_SIZE 16
+//Lock detector: the phase error of the symbols averaged over about a slot, with hysteresis. Noise gives pi/8
+#define PI4DQPSK_LOCK_AVG_RATE (1.0f / 255.0f)
+#define PI4DQPSK_LOCK_ENTER_ERROR 0.20f
+#define PI4DQPSK_LOCK_EXIT_ERROR 0.30f
+//FLL and Costas bandwidths while unlocked and once locked, times the given ones. The clock recovery keeps its gains
+//while unlocked and narrows with the others, its omega gain going with the square of the bandwidth
+#define PI4DQPSK_LOCK_WIDE_SCALE 2.0
+#define PI4DQPSK_LOCK_NARROW_SCALE 0.5
 
 namespace dsp {
     namespace demod {
@@ -44,11 +68,16 @@ namespace dsp {
                 // Swap if some data was generated
                 base_type::_in->flush();
                 if (outCount) {
+                    TETRA_PROF_START(profT);
                     if (!base_type::out.swap(outCount)) { return -1; }
+                    TETRA_PROF_ADD(TETRA_PROF_SWAPS, 1);
+                    TETRA_PROF_STOP(TETRA_PROF_SWAP_WAIT_NS, profT);
                 }
                 return outCount;
             }
 
+            //The rate and RRC setters don't stop the block: the taps are designed by the caller, the DSP thread takes
+            //them at the start of its next process() call. The loops keep their state across the change
             void setSymbolrate(double symbolrate);
             void setSamplerate(double samplerate);
             void setRRCParams(int rrcTapCount, double rrcBeta);
@@ -62,22 +91,160 @@ namespace dsp {
             void setMuGain(double muGain);
             void setOmegaRelLimit(double omegaRelLimit);
 
+            //Accept input at inSamplerate and bring it to the demodulator samplerate with one polyphase resampler
+            //that also is the RRC filter. The FLL then runs after the matched filter. Rates up to the demodulator samplerate disable it
+            void setInputSamplerate(double inSamplerate);
+
+            //Also starts a new coarse acquisition
             void reset();
 
+            //Cold start: the first samples go to a CoarseFreqEstimator, its estimate is where the FLL starts from, and
+            //for a short while after it the FLL and Costas loops run at a wider bandwidth. On by default, runs after
+            //init() and reset() and again until it finds a carrier it can trust, a few times at most
+            void setCoarseAcquisition(bool enabled);
+            //Start a new coarse acquisition, e.g. after a retune
+            void acquire();
+            bool isAcquiring() { return acqState != ACQ_IDLE; }
+            //Carrier offset in Hz of the last estimate that was used, NAN if there was none
+            double getCoarseFrequency() { return coarseFreq; }
+
+            //Carrier offset the FLL corrects, in Hz
+            double getFllFrequency() { return fll.getFrequency(); }
+
+            //Lock detector on the symbols out of the Costas loop: while unlocked the FLL and Costas loops run wider than
+            //the bandwidths given, once locked they and the clock recovery run narrower. The coefficients change from
+            //inside process(), nothing is stopped for it. On by default
+            void setAdaptiveBandwidth(bool enabled);
+            bool isLoopLocked() { return loopLocked; }
+            //Mean phase error of the symbols to the constellation, as DQPSKSymbolExtractor::standarderr but over a slot
+            float getLockError() { return lockError; }
+
+            //Suspended, the input is taken and dropped: nothing runs and every loop keeps its state for the resume. Before
+            //the first output after it, the handler is called on the DSP thread with the symbols that went by meanwhile
+            void setSuspended(bool suspended);
+            bool isSuspended() { return suspended; }
+            void setResumeHandler(void (*handler)(double symbols, void* ctx), void* ctx);
+
+            //Idle mode for a carrier that carries nothing: once synced() has said false for a probe interval the chain
+            //goes to sleep. Asleep, only the power of every PI4DQPSK_IDLE_DECIM-th sample is watched, the rest of the
+            //samples are dropped as when suspended, the resume handler being told of them. A rise of the power over the
+            //noise floor wakes the chain at once with a new coarse acquisition, otherwise it wakes for a probe every
+            //sleep interval. synced() is called on the DSP thread, once a process() call while awake. Off by default
+            void setIdleMode(bool enabled, bool (*synced)(void* ctx) = NULL, void* ctx = NULL);
+            bool isIdle() { return idleAsleep; }
+
+            //Fixed point: the FLL and the RRC filter run on int16 samples, on NEON where the build targets ARM, for boards
+            //that can't take the float chain on several carriers. The loops, the clock recovery and the Costas loop stay
+            //in float and behave the same, the front end resampler too. Off by default
+            void setFixedPoint(bool enabled);
+            bool isFixedPoint() { return fixedPoint; }
+
+            //Pins the DSP thread as tuning says, each time the block starts. tuning is the caller's and has to outlive the
+            //block, NULL leaves the thread alone
+            void setThreadTuning(const ThreadTuning* tuning);
+
             int process(int count, const complex_t* in, complex_t* out);
 
+            //Taps of the resampling RRC the front end takes input at inSamplerate to samplerate with, interp / decim
+            //being its ratio. NULL where inSamplerate is no faster, the front end only decimates
+            static std::shared_ptr<const SharedTaps<float>> designFrontEndTaps(double symbolrate, double samplerate, int rrcTapCount, double rrcBeta, double inSamplerate, int& interp, int& decim);
+
         protected:
+            void doStart() override {
+                base_type::doStart();
+                if (threadTuning) { threadTuning->apply(base_type::workerThread); }
+            }
+
+            const ThreadTuning* threadTuning = NULL;
             double _symbolrate;
             double _samplerate;
             int _rrcTapCount;
             double _rrcBeta;
 
             loop::FLL fll;
+            //Shared through the TapCache, rrcTaps points into it
+            std::shared_ptr<const SharedTaps<float>> rrcShared;
             tap<float> rrcTaps;
             filter::FIR<complex_t, float> rrc;
             loop::FastAGC<complex_t> agc;
             loop::PI4DQPSK_COSTAS costas;
             clock_recovery::COMPLEX_FD recov;
+
+            //Rates and taps for the DSP thread, see takeRates()
+            struct RateUpdate {
+                double symbolrate;
+                double samplerate;
+                int rrcTapCount;
+                double rrcBeta;
+                double inSamplerate = 0;
+                std::shared_ptr<const SharedTaps<float>> rrcTaps;
+                bool useFrontEnd = false;
+                int interp = 1;
+                int decim = 1;
+                std::shared_ptr<const SharedTaps<float>> frontEndTaps;
+            };
+            void publishRates();
+            void designFrontEnd(RateUpdate& u);
+            void takeRates();
+            void startAcquisition();
+            void acquireStep(int count, const complex_t* in);
+            void applyLoopBandwidths();
+            void updateLock(int count, const complex_t* sym);
+            bool idleStep(int count, const complex_t* in);
+            void idleWake(bool acquire);
+            double idleSamples(double symbols);
+            int processFixed(int count, bool matchedFilter);
+
+            enum AcqState { ACQ_IDLE, ACQ_ESTIMATING, ACQ_WIDE };
+            CoarseFreqEstimator coarse;
+            bool coarseEnabled = true;
+            AcqState acqState = ACQ_IDLE;
+            int acqTries = 0;
+            int acqWideLeft = 0;
+            double coarseFreq = NAN;
+            double _fllBandwidth;
+            double _costasBandwidth;
+            double _omegaGain;
+            double _muGain;
+            bool adaptiveBandwidth = true;
+            bool loopLocked = false;
+            float lockError;
+
+            //What the setters asked for last, under rateMtx. The DSP thread only tries the lock, so it never waits on a
+            //design; once taken, the taps it replaced are left here until the next setter lets go of them
+            RateUpdate pendingRates;
+            std::mutex rateMtx;
+            std::atomic<bool> ratesPending = false;
+
+            double _inSamplerate = 0;
+            bool useFrontEnd = false;
+            bool frontEndInit = false;
+            std::shared_ptr<const SharedTaps<float>> frontEndShared;
+            tap<float> frontEndTaps;
+            multirate::PolyphaseResampler<complex_t> frontEnd;
+
+            complex_t* tile = NULL;
+
+            //See setFixedPoint(), rrcQ15 the fixed point copy of rrcTaps
+            bool fixedPoint = false;
+            q15::FIR rrcQ15;
+            q15::cq15* tileQ15 = NULL;
+
+            std::atomic<bool> suspended = false;
+            uint64_t droppedSamples = 0;
+            void (*_resumeHandler)(double symbols, void* ctx) = NULL;
+            void* _resumeCtx = NULL;
+
+            //See setIdleMode(). The counters are samples of the input
+            bool idleEnabled = false;
+            bool (*_idleSynced)(void* ctx) = NULL;
+            void* _idleCtx = NULL;
+            std::atomic<bool> idleAsleep = false;
+            double idleLeft = 0;
+            int idlePhase = 0;
+            int idleFill = 0;
+            float idleAcc = 0.0f;
+            float idleFloor = -1.0f;
         };
     }
 }
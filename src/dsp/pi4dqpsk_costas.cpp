@@ -2,18 +2,25 @@
 
 namespace dsp {
     namespace loop {
+        //phasor(-k*pi/4)
+        const complex_t PI4DQPSK_COSTAS::pi4Phasors[8] = {
+            { 1.0f, 0.0f },
+            { (float)M_SQRT1_2, -(float)M_SQRT1_2 },
+            { 0.0f, -1.0f },
+            { -(float)M_SQRT1_2, -(float)M_SQRT1_2 },
+            { -1.0f, 0.0f },
+            { -(float)M_SQRT1_2, (float)M_SQRT1_2 },
+            { 0.0f, 1.0f },
+            { (float)M_SQRT1_2, (float)M_SQRT1_2 }
+        };
+
         int PI4DQPSK_COSTAS::process(int count, complex_t* in, complex_t* out) {
             for (int i = 0; i < count; i++) {
-                complex_t shift = math::phasor(-pcl.phase);
+                complex_t shift = math::lutPhasor(-pcl.phase);
                 complex_t x = in[i] * shift;
                 //perform pi/4 shift on every symbol
-                ph2 += -FL_M_PI/4.0f;
-                if(ph2 >= 2*FL_M_PI) {
-                    ph2-=2*FL_M_PI;
-                } else if(ph2 <= -2*FL_M_PI) {
-                    ph2+=2*FL_M_PI;
-                }
-                x = x * math::phasor(ph2);
+                ph2 = (ph2 + 1) & 7;
+                x = x * pi4Phasors[ph2];
                 pcl.advance(errorFunction(x));
                 out[i] = x;
             }
@@ -18,6 +18,7 @@
 #include <dsp/clock_recovery/mm.h>
 #include <math.h>
 
+#include "phasor_lut.h"
 
 namespace dsp {
     namespace loop {
@@ -29,7 +30,10 @@ namespace dsp {
 
         protected:
             float errorFunction(complex_t val);
-            float ph2 = 0;
+
+            //The pi/4 derotation steps through 8 fixed angles, ph2 is the index of the current one
+            static const complex_t pi4Phasors[8];
+            int ph2 = 0;
 
         };
     }
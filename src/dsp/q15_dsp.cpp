@@ -0,0 +1,253 @@
+#include "q15_dsp.h"
+
+#include <dsp/buffer/buffer.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef DSP_Q15_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace dsp {
+    namespace q15 {
+        bool haveNeon() {
+#ifdef DSP_Q15_HAVE_NEON
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        int tapShift(const float* taps, int count) {
+            double sumAbs = 0.0;
+            double maxAbs = 0.0;
+            for (int i = 0; i < count; i++) {
+                sumAbs += fabs(taps[i]);
+                maxAbs = std::max<double>(maxAbs, fabs(taps[i]));
+            }
+            //Every quantized tap is off by half a step at most, the input reaches -32768
+            for (int shift = 30; shift > 0; shift--) {
+                double scale = ldexp(1.0, shift);
+                if (maxAbs * scale + 0.5 > 32767.0) { continue; }
+                if ((sumAbs * scale + 0.5 * count) * 32768.0 > 2147483647.0) { continue; }
+                return shift;
+            }
+            return 0;
+        }
+
+        void quantize(const float* taps, int count, int shift, int16_t* out) {
+            double scale = ldexp(1.0, shift);
+            for (int i = 0; i < count; i++) {
+                out[i] = (int16_t)std::clamp<double>(round(taps[i] * scale), -32767.0, 32767.0);
+            }
+        }
+
+        static inline int16_t saturate(int32_t v) {
+            return (int16_t)std::clamp<int32_t>(v, -32768, 32767);
+        }
+
+#ifdef DSP_Q15_HAVE_NEON
+        static inline int32_t hsum(int32x4_t v) {
+#if defined(__aarch64__)
+            return vaddvq_s32(v);
+#else
+            int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+            return vget_lane_s32(vpadd_s32(s, s), 0);
+#endif
+        }
+#endif
+
+        void fromFloat(const complex_t* in, cq15* out, int count, float scale) {
+            const float* f = (const float*)in;
+            int16_t* o = (int16_t*)out;
+            int i = 0;
+#if defined(DSP_Q15_HAVE_NEON) && defined(__aarch64__)
+            //Round to nearest even as lrintf does, both narrowings saturate
+            for (; i + 8 <= 2 * count; i += 8) {
+                int32x4_t lo = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&f[i]), scale));
+                int32x4_t hi = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(&f[i + 4]), scale));
+                vst1q_s16(&o[i], vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+            }
+#endif
+            for (; i < 2 * count; i++) {
+                o[i] = (int16_t)lrintf(std::clamp<float>(f[i] * scale, -32768.0f, 32767.0f));
+            }
+        }
+
+        void toFloat(const cq15* in, complex_t* out, int count, float scale) {
+            const int16_t* s = (const int16_t*)in;
+            float* o = (float*)out;
+            int i = 0;
+#ifdef DSP_Q15_HAVE_NEON
+            for (; i + 8 <= 2 * count; i += 8) {
+                int16x8_t v = vld1q_s16(&s[i]);
+                vst1q_f32(&o[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+                vst1q_f32(&o[i + 4], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+            }
+#endif
+            for (; i < 2 * count; i++) {
+                o[i] = (float)s[i] * scale;
+            }
+        }
+
+        uint32_t ncoPhase(float radians) {
+            return (uint32_t)llrint((double)radians * (4294967296.0 / (2.0 * M_PI)));
+        }
+
+        void nco(uint32_t phase, uint32_t step, cq15* ph, int count) {
+            struct NcoTable {
+                NcoTable() {
+                    for (int i = 0; i < (1 << DSP_Q15_NCO_BITS); i++) {
+                        double ph = 2.0 * M_PI * (double)i / (double)(1 << DSP_Q15_NCO_BITS);
+                        table[i] = { (int16_t)lrint(cos(ph) * 32767.0), (int16_t)lrint(sin(ph) * 32767.0) };
+                    }
+                }
+
+                cq15 table[1 << DSP_Q15_NCO_BITS];
+            };
+            static const NcoTable nt;
+            //Half an entry on top, so the top bits round to the nearest one
+            phase += 1u << (31 - DSP_Q15_NCO_BITS);
+            for (int i = 0; i < count; i++) {
+                ph[i] = nt.table[phase >> (32 - DSP_Q15_NCO_BITS)];
+                phase += step;
+            }
+        }
+
+        void rotate(const cq15* in, const cq15* ph, cq15* out, int count) {
+            int i = 0;
+#ifdef DSP_Q15_HAVE_NEON
+            for (; i + 4 <= count; i += 4) {
+                int16x4x2_t x = vld2_s16((const int16_t*)&in[i]);
+                int16x4x2_t p = vld2_s16((const int16_t*)&ph[i]);
+                int32x4_t re = vmlsl_s16(vmull_s16(x.val[0], p.val[0]), x.val[1], p.val[1]);
+                int32x4_t im = vmlal_s16(vmull_s16(x.val[0], p.val[1]), x.val[1], p.val[0]);
+                int16x4x2_t r;
+                r.val[0] = vqrshrn_n_s32(re, 15);
+                r.val[1] = vqrshrn_n_s32(im, 15);
+                vst2_s16((int16_t*)&out[i], r);
+            }
+#endif
+            for (; i < count; i++) {
+                int32_t re = (int32_t)in[i].re * ph[i].re - (int32_t)in[i].im * ph[i].im;
+                int32_t im = (int32_t)in[i].re * ph[i].im + (int32_t)in[i].im * ph[i].re;
+                out[i].re = saturate((re + (1 << 14)) >> 15);
+                out[i].im = saturate((im + (1 << 14)) >> 15);
+            }
+        }
+
+        //Sums of x[k] * taps[k], exact, so any order gives the same
+        static inline void dot(const cq15* x, const int16_t* taps, int count, int32_t& re, int32_t& im) {
+            int k = 0;
+            int32_t sumRe = 0, sumIm = 0;
+#ifdef DSP_Q15_HAVE_NEON
+            int32x4_t accRe = vdupq_n_s32(0);
+            int32x4_t accIm = vdupq_n_s32(0);
+            for (; k + 8 <= count; k += 8) {
+                int16x8x2_t v = vld2q_s16((const int16_t*)&x[k]);
+                int16x8_t t = vld1q_s16(&taps[k]);
+                accRe = vmlal_s16(accRe, vget_low_s16(v.val[0]), vget_low_s16(t));
+                accRe = vmlal_s16(accRe, vget_high_s16(v.val[0]), vget_high_s16(t));
+                accIm = vmlal_s16(accIm, vget_low_s16(v.val[1]), vget_low_s16(t));
+                accIm = vmlal_s16(accIm, vget_high_s16(v.val[1]), vget_high_s16(t));
+            }
+            sumRe = hsum(accRe);
+            sumIm = hsum(accIm);
+#endif
+            for (; k < count; k++) {
+                sumRe += (int32_t)x[k].re * taps[k];
+                sumIm += (int32_t)x[k].im * taps[k];
+            }
+            re = sumRe;
+            im = sumIm;
+        }
+
+        void dot2(const cq15* x, const int16_t* a, const int16_t* b, int count, int32_t* acc) {
+            int k = 0;
+            int32_t aRe = 0, aIm = 0, bRe = 0, bIm = 0;
+#ifdef DSP_Q15_HAVE_NEON
+            int32x4_t accARe = vdupq_n_s32(0);
+            int32x4_t accAIm = vdupq_n_s32(0);
+            int32x4_t accBRe = vdupq_n_s32(0);
+            int32x4_t accBIm = vdupq_n_s32(0);
+            for (; k + 8 <= count; k += 8) {
+                int16x8x2_t v = vld2q_s16((const int16_t*)&x[k]);
+                int16x8_t ta = vld1q_s16(&a[k]);
+                int16x8_t tb = vld1q_s16(&b[k]);
+                accARe = vmlal_s16(accARe, vget_low_s16(v.val[0]), vget_low_s16(ta));
+                accARe = vmlal_s16(accARe, vget_high_s16(v.val[0]), vget_high_s16(ta));
+                accAIm = vmlal_s16(accAIm, vget_low_s16(v.val[1]), vget_low_s16(ta));
+                accAIm = vmlal_s16(accAIm, vget_high_s16(v.val[1]), vget_high_s16(ta));
+                accBRe = vmlal_s16(accBRe, vget_low_s16(v.val[0]), vget_low_s16(tb));
+                accBRe = vmlal_s16(accBRe, vget_high_s16(v.val[0]), vget_high_s16(tb));
+                accBIm = vmlal_s16(accBIm, vget_low_s16(v.val[1]), vget_low_s16(tb));
+                accBIm = vmlal_s16(accBIm, vget_high_s16(v.val[1]), vget_high_s16(tb));
+            }
+            aRe = hsum(accARe);
+            aIm = hsum(accAIm);
+            bRe = hsum(accBRe);
+            bIm = hsum(accBIm);
+#endif
+            for (; k < count; k++) {
+                aRe += (int32_t)x[k].re * a[k];
+                aIm += (int32_t)x[k].im * a[k];
+                bRe += (int32_t)x[k].re * b[k];
+                bIm += (int32_t)x[k].im * b[k];
+            }
+            acc[0] = aRe;
+            acc[1] = aIm;
+            acc[2] = bRe;
+            acc[3] = bIm;
+        }
+
+        void fir(const cq15* x, const int16_t* taps, int tapCount, int shift, cq15* out, int count) {
+            int64_t round = (shift > 0) ? ((int64_t)1 << (shift - 1)) : 0;
+            for (int i = 0; i < count; i++) {
+                int32_t re, im;
+                dot(&x[i], taps, tapCount, re, im);
+                out[i].re = (int16_t)std::clamp<int64_t>((re + round) >> shift, -32768, 32767);
+                out[i].im = (int16_t)std::clamp<int64_t>((im + round) >> shift, -32768, 32767);
+            }
+        }
+
+        FIR::~FIR() {
+            buffer::free(taps);
+            buffer::free(buffer);
+        }
+
+        void FIR::init(const tap<float>& taps, int maxCount) {
+            this->maxCount = std::max<int>(maxCount, 1);
+            setTaps(taps);
+        }
+
+        void FIR::setTaps(const tap<float>& newTaps) {
+            if (newTaps.size != tapCount || !buffer) {
+                buffer::free(taps);
+                buffer::free(buffer);
+                tapCount = newTaps.size;
+                taps = buffer::alloc<int16_t>(tapCount);
+                buffer = buffer::alloc<cq15>(maxCount + tapCount);
+                bufStart = &buffer[tapCount - 1];
+                reset();
+            }
+            shift = tapShift(newTaps.taps, tapCount);
+            quantize(newTaps.taps, tapCount, shift, taps);
+        }
+
+        void FIR::reset() {
+            memset(buffer, 0, (tapCount - 1) * sizeof(cq15));
+        }
+
+        int FIR::process(int count, const cq15* in, cq15* out) {
+            for (int i = 0; i < count; i += maxCount) {
+                int n = std::min<int>(maxCount, count - i);
+                memcpy(bufStart, &in[i], n * sizeof(cq15));
+                fir(buffer, taps, tapCount, shift, &out[i], n);
+                memmove(buffer, &buffer[n], (tapCount - 1) * sizeof(cq15));
+            }
+            return count;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/taps/tap.h>
+#include <stdint.h>
+
+//NEON kernels where the compiler targets it, the plain C ones compute the same results bit for bit
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_Q15_HAVE_NEON 1
+#endif
+
+//Entries of the phasor table of nco() as a power of two, the phase it looks up is off by at most pi / 2^12
+#define DSP_Q15_NCO_BITS 12
+
+namespace dsp {
+    //Fixed-point building blocks of the int16 demodulator path: I/Q samples as int16, taps as int16 with a shift of their
+    //own, products summed in int32. The taps are scaled so that no sum can leave int32 even at full scale input
+    namespace q15 {
+        struct cq15 {
+            int16_t re;
+            int16_t im;
+        };
+
+        //Whether the kernels below run on NEON in this build
+        bool haveNeon();
+
+        //Largest shift with which taps * 2^shift quantize to int16 and never overflow an int32 dot product
+        int tapShift(const float* taps, int count);
+        void quantize(const float* taps, int count, int shift, int16_t* out);
+
+        //in * scale rounded and saturated to int16, and back
+        void fromFloat(const complex_t* in, cq15* out, int count, float scale);
+        void toFloat(const cq15* in, complex_t* out, int count, float scale);
+
+        //Phase of the NCO for an angle in radians, a turn is 2^32 and wraps
+        uint32_t ncoPhase(float radians);
+
+        //ph[i] = unit phasor of phase + i * step scaled by 32767, from a table of 2^DSP_Q15_NCO_BITS phasors
+        void nco(uint32_t phase, uint32_t step, cq15* ph, int count);
+
+        //out[i] = in[i] * ph[i], ph a unit phasor scaled by 32767, rounded
+        void rotate(const cq15* in, const cq15* ph, cq15* out, int count);
+
+        //The sums of x[k] * a[k] and x[k] * b[k], as re, im of a then re, im of b
+        void dot2(const cq15* x, const int16_t* a, const int16_t* b, int count, int32_t* acc);
+
+        //out[i] = sum of x[i + k] * taps[k] over k, shifted right by shift, rounded and saturated
+        void fir(const cq15* x, const int16_t* taps, int tapCount, int shift, cq15* out, int count);
+
+        //Real FIR on complex samples, as filter::FIR<complex_t, float> with the taps in fixed point
+        class FIR {
+        public:
+            FIR() {}
+            FIR(const FIR&) = delete;
+            ~FIR();
+
+            //maxCount sizes the delay buffer, longer inputs are taken in pieces of that many samples
+            void init(const tap<float>& taps, int maxCount);
+            //The delay line is kept if the tap count stays the same
+            void setTaps(const tap<float>& taps);
+            void reset();
+
+            //in and out may be the same
+            int process(int count, const cq15* in, cq15* out);
+
+        protected:
+            int16_t* taps = NULL;
+            int tapCount = 0;
+            int shift = 0;
+            int maxCount = 0;
+            cq15* buffer = NULL;
+            cq15* bufStart = NULL;
+        };
+    }
+}
@@ -0,0 +1,46 @@
+#include "tap_cache.h"
+
+#include <stdio.h>
+
+#include <map>
+
+namespace dsp {
+    std::mutex TapCache::mtx;
+
+    //Expired entries are dropped when a new one goes in, there are only ever a handful of designs
+    static std::map<std::string, std::weak_ptr<void>> entries;
+
+    std::string TapCache::key(const char* kind, std::initializer_list<double> params) {
+        std::string k = kind;
+        char buf[32];
+        for (double p : params) {
+            snprintf(buf, sizeof(buf), "/%.17g", p);
+            k += buf;
+        }
+        return k;
+    }
+
+    int TapCache::size() {
+        std::lock_guard<std::mutex> lck(mtx);
+        int n = 0;
+        for (auto& e : entries) { n += !e.second.expired(); }
+        return n;
+    }
+
+    std::shared_ptr<void> TapCache::lookup(const std::string& key) {
+        auto it = entries.find(key);
+        if (it == entries.end()) { return NULL; }
+        return it->second.lock();
+    }
+
+    void TapCache::store(const std::string& key, const std::shared_ptr<void>& entry) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second.expired()) {
+                it = entries.erase(it);
+            } else {
+                it++;
+            }
+        }
+        entries[key] = entry;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <dsp/types.h>
+#include <dsp/taps/tap.h>
+
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dsp {
+    //Process-wide store of filter taps keyed by their design parameters, so chains running at the same rates share one
+    //read-only copy instead of designing and holding their own. An entry lives as long as some instance holds it
+    class TapCache {
+    public:
+        //Taps stored under key, designed by design() into a new T if no instance holds them. design() runs with the
+        //cache locked, so two instances asking at once don't design them twice. The result must not be written to
+        template <class T, class F>
+        static std::shared_ptr<const T> get(const std::string& key, F design) {
+            std::lock_guard<std::mutex> lck(mtx);
+            std::shared_ptr<void> found = lookup(key);
+            if (found) { return std::static_pointer_cast<const T>(found); }
+            std::shared_ptr<T> entry = std::make_shared<T>();
+            design(*entry);
+            store(key, entry);
+            return entry;
+        }
+
+        //Key of a design: its kind and every parameter that goes into it, at full precision
+        static std::string key(const char* kind, std::initializer_list<double> params);
+
+        //Entries held by some instance
+        static int size();
+
+    protected:
+        static std::shared_ptr<void> lookup(const std::string& key);
+        static void store(const std::string& key, const std::shared_ptr<void>& entry);
+
+        static std::mutex mtx;
+    };
+
+    //Owns one set of taps, as an entry of the cache
+    template <class T>
+    struct SharedTaps {
+        SharedTaps() {}
+        SharedTaps(const SharedTaps&) = delete;
+        ~SharedTaps() { taps::free(taps); }
+
+        tap<T> taps = { NULL, 0 };
+    };
+}
@@ -0,0 +1,123 @@
+#include "tetra_signal_gen.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <dsp/taps/root_raised_cosine.h>
+
+namespace dsp {
+    //pi/4-DQPSK phase steps in multiples of pi/4 for the bit pairs 00, 01, 10 and 11
+    static const int phaseSteps[4] = { 1, 3, -1, -3 };
+
+    static complex_t octantPhasor(int phase) {
+        static const float h = 0.70710678f;
+        static const complex_t table[8] = { { 1, 0 }, { h, h }, { 0, 1 }, { -h, h }, { -1, 0 }, { -h, -h }, { 0, -1 }, { h, -h } };
+        return table[phase & 7];
+    }
+
+    bool TetraSignalGenerator::init(double samplerate, const std::vector<Carrier>& carriers, double freqOffset, uint64_t seed) {
+        sps = (int)round(samplerate / TETRA_SIGGEN_SYMBOLRATE);
+        if (sps < 2 || fabs(sps * (double)TETRA_SIGGEN_SYMBOLRATE - samplerate) > 1e-6) { return false; }
+        double halfBandwidth = (1.0 + TETRA_SIGGEN_RRC_ALPHA) * TETRA_SIGGEN_SYMBOLRATE / 2.0;
+        for (const Carrier& c : carriers) {
+            if (fabs(c.offset + freqOffset) + halfBandwidth > samplerate / 2.0) { return false; }
+        }
+
+        //Scaled to a sum of squares of sps, so a carrier of unit symbols has unit power
+        int span = TETRA_SIGGEN_RRC_SPAN;
+        tap<float> rrc = taps::rootRaisedCosine<float>(span * sps, TETRA_SIGGEN_RRC_ALPHA, TETRA_SIGGEN_SYMBOLRATE, samplerate);
+        double energy = 0.0;
+        for (int i = 0; i < rrc.size; i++) { energy += (double)rrc.taps[i] * rrc.taps[i]; }
+        float scale = sqrt(sps / energy);
+        poly.assign(sps * span, 0.0f);
+        for (int p = 0; p < sps; p++) {
+            for (int j = 0; j < span; j++) {
+                poly[p * span + j] = rrc.taps[p + (span - 1 - j) * sps] * scale;
+            }
+        }
+        taps::free(rrc);
+
+        //Noise power N in the symbol rate bandwidth, carrier i gets snr_i * N and all of them together 1
+        double snrSum = 0.0;
+        for (const Carrier& c : carriers) { snrSum += pow(10.0, c.snrDb / 10.0); }
+        double noise = carriers.empty() ? 1.0 : 1.0 / snrSum;
+        noiseStd = sqrt(noise * sps / 2.0);
+
+        rng = seed * 0x9e3779b97f4a7c15ULL + 1;
+        samples = 0;
+        this->carriers.resize(carriers.size());
+        for (int i = 0; i < (int)carriers.size(); i++) {
+            const Carrier& c = carriers[i];
+            CarrierState& st = this->carriers[i];
+            //Every cell gets bits of its own
+            tetra_burst_gen_init(&st.gen, &c.cell, seed + 1 + i);
+            st.amp = sqrt(pow(10.0, c.snrDb / 10.0) * noise);
+            st.rot = { st.amp, 0.0f };
+            double w = 2.0 * M_PI * (c.offset + freqOffset) / samplerate;
+            st.step = { (float)cos(w), (float)sin(w) };
+            st.phase = 0;
+            memset(st.syms, 0, sizeof(st.syms));
+            nextBurst(st);
+        }
+        return true;
+    }
+
+    void TetraSignalGenerator::nextBurst(CarrierState& c) {
+        const int hist = TETRA_SIGGEN_RRC_SPAN - 1;
+        uint8_t bits[TETRA_GEN_BURST_BITS];
+        memmove(c.syms, &c.syms[TETRA_SIGGEN_BURST_SYMBOLS], hist * sizeof(complex_t));
+        tetra_burst_gen_next(&c.gen, bits);
+        for (int i = 0; i < TETRA_SIGGEN_BURST_SYMBOLS; i++) {
+            c.phase = (c.phase + phaseSteps[(bits[2 * i] << 1) | bits[2 * i + 1]]) & 7;
+            c.syms[hist + i] = octantPhasor(c.phase);
+        }
+        c.symPos = 0;
+        c.sub = 0;
+    }
+
+    void TetraSignalGenerator::addCarrier(CarrierState& c, complex_t* out, int count) {
+        const int span = TETRA_SIGGEN_RRC_SPAN;
+        for (int n = 0; n < count; n++) {
+            const float* h = &poly[c.sub * span];
+            const complex_t* s = &c.syms[c.symPos];
+            float re = 0.0f, im = 0.0f;
+            for (int j = 0; j < span; j++) {
+                re += s[j].re * h[j];
+                im += s[j].im * h[j];
+            }
+            out[n] = out[n] + complex_t{ re, im } * c.rot;
+            c.rot = c.rot * c.step;
+            if (++c.sub == sps) {
+                c.sub = 0;
+                if (++c.symPos == TETRA_SIGGEN_BURST_SYMBOLS) { nextBurst(c); }
+            }
+        }
+        //Keep the oscillator at the amplitude of the carrier
+        c.rot = c.rot * (c.amp / c.rot.amplitude());
+    }
+
+    void TetraSignalGenerator::addNoise(complex_t* out, int count) {
+        //Box-Muller on xorshift64*, the same on every platform
+        for (int n = 0; n < count; n++) {
+            uint64_t r[2];
+            for (int k = 0; k < 2; k++) {
+                rng ^= rng >> 12;
+                rng ^= rng << 25;
+                rng ^= rng >> 27;
+                r[k] = rng * 0x2545f4914f6cdd1dULL;
+            }
+            float u1 = ((float)(r[0] >> 40) + 1.0f) / 16777216.0f;
+            float u2 = (float)(r[1] >> 40) / 16777216.0f;
+            float mag = sqrtf(-2.0f * logf(u1)) * noiseStd;
+            out[n].re += mag * cosf(2.0f * FL_M_PI * u2);
+            out[n].im += mag * sinf(2.0f * FL_M_PI * u2);
+        }
+    }
+
+    void TetraSignalGenerator::generate(complex_t* out, int count) {
+        memset(out, 0, count * sizeof(complex_t));
+        for (CarrierState& c : carriers) { addCarrier(c, out, count); }
+        addNoise(out, count);
+        samples += count;
+    }
+}
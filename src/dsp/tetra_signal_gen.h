@@ -0,0 +1,75 @@
+#pragma once
+#include <dsp/types.h>
+#include <stdint.h>
+
+#include <vector>
+
+extern "C" {
+    #include <phy/tetra_burst_gen.h>
+}
+
+#define TETRA_SIGGEN_SYMBOLRATE 18000
+#define TETRA_SIGGEN_RRC_ALPHA 0.35
+//Length of the transmit filter in symbols
+#define TETRA_SIGGEN_RRC_SPAN 16
+#define TETRA_SIGGEN_BURST_SYMBOLS (TETRA_GEN_BURST_BITS / 2)
+
+namespace dsp {
+    //Synthetic TETRA downlink IQ for load and regression tests. Every carrier is a cell of its own, its bursts come from
+    //tetra_burst_gen and are pi/4-DQPSK modulated straight at the output samplerate through a polyphase root raised
+    //cosine, moved to the offset of the carrier and summed, with white Gaussian noise on top. The samplerate has to be
+    //a whole multiple of the symbol rate, 36 kHz gives what the demodulator of a single chain takes. The carriers add
+    //up to unit power, their SNRs set how they share it and the noise level. Everything follows from the seed, so a
+    //run can be repeated bit for bit. Not thread safe
+    class TetraSignalGenerator {
+    public:
+        struct Carrier {
+            //Off the center of the output, in Hz
+            double offset = 0.0;
+            //Es/N0 in dB, the carrier power over that of the noise within the symbol rate bandwidth
+            float snrDb = 25.0f;
+            tetra_gen_cell cell;
+        };
+
+        TetraSignalGenerator() {}
+
+        //freqOffset is added to every carrier, as a tuning error would. False if samplerate is no multiple of the
+        //symbol rate or a carrier does not fit into it
+        bool init(double samplerate, const std::vector<Carrier>& carriers, double freqOffset, uint64_t seed);
+
+        void generate(complex_t* out, int count);
+
+        int getCarrierCount() { return carriers.size(); }
+        //Bursts made so far, see tetra_burst_gen
+        const tetra_burst_gen& getBursts(int carrier) { return carriers[carrier].gen; }
+        uint64_t getSampleCount() { return samples; }
+
+    protected:
+        struct CarrierState {
+            tetra_burst_gen gen;
+            //Amplitude of the carrier times its oscillator
+            complex_t rot;
+            complex_t step;
+            float amp;
+            //pi/4-DQPSK phase in multiples of pi/4
+            int phase;
+            //The current burst after the last TETRA_SIGGEN_RRC_SPAN - 1 symbols of the one before, symPos is the
+            //first symbol in the filter and sub the sample of the symbol
+            complex_t syms[TETRA_SIGGEN_RRC_SPAN - 1 + TETRA_SIGGEN_BURST_SYMBOLS];
+            int symPos;
+            int sub;
+        };
+
+        void nextBurst(CarrierState& c);
+        void addCarrier(CarrierState& c, complex_t* out, int count);
+        void addNoise(complex_t* out, int count);
+
+        std::vector<CarrierState> carriers;
+        //Filter phase p of sample sub of a symbol at poly[p * span], oldest symbol first
+        std::vector<float> poly;
+        int sps = 0;
+        float noiseStd = 0.0f;
+        uint64_t rng = 1;
+        uint64_t samples = 0;
+    };
+}
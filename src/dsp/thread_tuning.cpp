@@ -0,0 +1,156 @@
+#include "thread_tuning.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//Memory policy modes of set_mempolicy(2), numaif.h is only there with libnuma installed
+#define THREAD_TUNING_MPOL_DEFAULT 0
+#define THREAD_TUNING_MPOL_PREFERRED 1
+#define THREAD_TUNING_MPOL_INTERLEAVE 3
+#define THREAD_TUNING_MAX_NODES (8 * (int)sizeof(unsigned long))
+
+namespace dsp {
+    bool ThreadTuning::parseCpuList(const std::string& list, std::vector<int>& out) {
+        std::vector<int> result;
+        const char* p = list.c_str();
+        while (*p) {
+            while (*p == ' ' || *p == ',') { p++; }
+            if (!*p) { break; }
+            char* end;
+            long first = strtol(p, &end, 10);
+            if (end == p || first < 0) { return false; }
+            long last = first;
+            p = end;
+            if (*p == '-') {
+                p++;
+                last = strtol(p, &end, 10);
+                if (end == p || last < first) { return false; }
+                p = end;
+            }
+            if (last >= 4096) { return false; }
+            for (long c = first; c <= last; c++) { result.push_back(c); }
+            while (*p == ' ') { p++; }
+            if (*p && *p != ',') { return false; }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        out = result;
+        return true;
+    }
+
+    bool ThreadTuning::setCpuList(const std::string& list) {
+        return parseCpuList(list, cpus);
+    }
+
+    void ThreadTuning::setRtPriority(int priority) {
+        rtPriority = std::clamp<int>(priority, 0, 99);
+    }
+
+    void ThreadTuning::setNumaLocal(bool local) {
+        numaLocal = local;
+    }
+
+    void ThreadTuning::addError(const std::string& err) const {
+        std::lock_guard<std::mutex> lck(errorMtx);
+        //Every thread fails the same way, once is enough
+        if (errors.find(err) != std::string::npos) { return; }
+        if (!errors.empty()) { errors += "; "; }
+        errors += err;
+    }
+
+    std::string ThreadTuning::takeErrors() {
+        std::lock_guard<std::mutex> lck(errorMtx);
+        std::string e = errors;
+        errors.clear();
+        return e;
+    }
+
+    void ThreadTuning::apply(std::thread& th) const {
+        if (!isActive() || !th.joinable()) { return; }
+#ifdef __linux__
+        pthread_t handle = th.native_handle();
+        if (!cpus.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : cpus) {
+                if (c < CPU_SETSIZE) { CPU_SET(c, &set); }
+            }
+            int err = pthread_setaffinity_np(handle, sizeof(set), &set);
+            if (err) { addError(std::string("CPU affinity: ") + strerror(err)); }
+        }
+        if (rtPriority > 0) {
+            sched_param sp = {};
+            sp.sched_priority = std::clamp<int>(rtPriority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+            int err = pthread_setschedparam(handle, SCHED_FIFO, &sp);
+            if (err) { addError(std::string("SCHED_FIFO: ") + strerror(err)); }
+        }
+#else
+        addError("CPU affinity and real-time priority are only supported on Linux");
+#endif
+    }
+
+    unsigned long ThreadTuning::getNodeMask() const {
+        unsigned long mask = 0;
+        if (cpus.empty()) { return 0; }
+        for (int node = 0; node < THREAD_TUNING_MAX_NODES; node++) {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE* f = fopen(path, "r");
+            if (!f) { continue; }
+            char buf[1024] = { 0 };
+            bool ok = fgets(buf, sizeof(buf), f) != NULL;
+            fclose(f);
+            std::vector<int> nodeCpus;
+            if (!ok || !parseCpuList(std::string(buf, strcspn(buf, "\n")), nodeCpus)) { continue; }
+            for (int c : cpus) {
+                if (std::binary_search(nodeCpus.begin(), nodeCpus.end(), c)) {
+                    mask |= 1UL << node;
+                    break;
+                }
+            }
+        }
+        return mask;
+    }
+
+    ScopedNumaPolicy::ScopedNumaPolicy(const ThreadTuning& tuning) {
+        if (!tuning.getNumaLocal() || tuning.getCpus().empty()) { return; }
+#ifdef __linux__
+        unsigned long mask = tuning.getNodeMask();
+        if (!mask) {
+            tuning.addError("NUMA placement: no node found for the CPU set");
+            return;
+        }
+        if (syscall(SYS_get_mempolicy, &oldMode, &oldMask, THREAD_TUNING_MAX_NODES + 1, NULL, 0) != 0) {
+            oldMode = THREAD_TUNING_MPOL_DEFAULT;
+            oldMask = 0;
+        }
+        //One node is preferred, falling back to the others when full. A set spanning nodes is interleaved over them
+        int mode = (mask & (mask - 1)) ? THREAD_TUNING_MPOL_INTERLEAVE : THREAD_TUNING_MPOL_PREFERRED;
+        if (syscall(SYS_set_mempolicy, mode, &mask, THREAD_TUNING_MAX_NODES + 1) != 0) {
+            tuning.addError(std::string("NUMA placement: ") + strerror(errno));
+            return;
+        }
+        active = true;
+#else
+        tuning.addError("NUMA placement is only supported on Linux");
+#endif
+    }
+
+    ScopedNumaPolicy::~ScopedNumaPolicy() {
+#ifdef __linux__
+        if (!active) { return; }
+        syscall(SYS_set_mempolicy, oldMode, oldMode == THREAD_TUNING_MPOL_DEFAULT ? NULL : &oldMask, oldMode == THREAD_TUNING_MPOL_DEFAULT ? 0 : THREAD_TUNING_MAX_NODES + 1);
+#endif
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dsp {
+    //Where the threads of a chain run: a CPU set, SCHED_FIFO at a priority, and the chain's memory taken from the NUMA
+    //nodes of that set. A block given one applies it to its worker thread every time the thread starts. Linux only,
+    //elsewhere nothing is applied and takeErrors() says so
+    class ThreadTuning {
+    public:
+        //A list as taskset -c and /sys take it, "0-3,8,10-11". Empty leaves the affinity alone, false if it doesn't parse
+        bool setCpuList(const std::string& list);
+        //1 - 99 for SCHED_FIFO, 0 keeps the default scheduling. Needs CAP_SYS_NICE or an rtprio limit
+        void setRtPriority(int priority);
+        //See ScopedNumaPolicy, only with a CPU set
+        void setNumaLocal(bool local);
+
+        const std::vector<int>& getCpus() const { return cpus; }
+        int getRtPriority() const { return rtPriority; }
+        bool getNumaLocal() const { return numaLocal; }
+        bool isActive() const { return !cpus.empty() || rtPriority > 0; }
+
+        //Affinity and priority of th, from any thread. Whatever fails is kept for takeErrors()
+        void apply(std::thread& th) const;
+        //What apply() and ScopedNumaPolicy could not do since the last call, empty if all went through
+        std::string takeErrors();
+
+        //Bits of the NUMA nodes the CPU set has cores on, node 63 at most. 0 without a CPU set or NUMA information
+        unsigned long getNodeMask() const;
+
+        static bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+
+    protected:
+        friend class ScopedNumaPolicy;
+        void addError(const std::string& err) const;
+
+        std::vector<int> cpus;
+        int rtPriority = 0;
+        bool numaLocal = false;
+
+        mutable std::mutex errorMtx;
+        mutable std::string errors;
+    };
+
+    //Pages the calling thread first touches while it lives come from the NUMA nodes of the tuning, so the buffers
+    //of a chain set up under it are local to the pinned threads that run it. The threads themselves need nothing,
+    //the kernel default already takes their own pages from the node they run on. Does nothing unless the tuning
+    //asks for NUMA placement
+    class ScopedNumaPolicy {
+    public:
+        ScopedNumaPolicy(const ThreadTuning& tuning);
+        ScopedNumaPolicy(const ScopedNumaPolicy&) = delete;
+        ~ScopedNumaPolicy();
+
+    protected:
+        bool active = false;
+        int oldMode = 0;
+        unsigned long oldMask = 0;
+    };
+}
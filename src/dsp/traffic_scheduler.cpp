@@ -0,0 +1,117 @@
+#include "traffic_scheduler.h"
+
+#include <math.h>
+
+namespace dsp {
+    void TrafficScheduler::init(int followerCount, int channelCount, int spacing, int timeoutMs) {
+        std::lock_guard<std::mutex> lck(mtx);
+        followers.clear();
+        for (int i = 0; i < followerCount; i++) {
+            followers.push_back(std::make_unique<Follower>());
+        }
+        calls.clear();
+        _channelCount = channelCount;
+        _spacing = spacing;
+        timeout = std::chrono::milliseconds(timeoutMs);
+    }
+
+    void TrafficScheduler::setChangeHandler(void (*handler)(int follower, bool assigned, void* ctx), void* ctx) {
+        std::lock_guard<std::mutex> lck(mtx);
+        _handler = handler;
+        _handlerCtx = ctx;
+    }
+
+    void TrafficScheduler::handleL3(int ctrlBin, const struct tetra_l3_event* l3) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lck(mtx);
+        expireLocked(now);
+
+        if (l3->pdisc != TMLE_PDISC_CMCE || !l3->parsed) { return; }
+        const struct tetra_cmce_decoded* cmce = &l3->cmce;
+        //The only downlink CMCE PDUs without a call identifier
+        if (cmce->pdu_type == TCMCE_PDU_T_D_STATUS || cmce->pdu_type == TCMCE_PDU_T_D_SDS_DATA || cmce->pdu_type == TCMCE_PDU_T_D_FACILITY) { return; }
+
+        size_t call = calls.size();
+        for (size_t i = 0; i < calls.size(); i++) {
+            if (calls[i].ctrlBin == ctrlBin && calls[i].callId == cmce->call_id) { call = i; break; }
+        }
+        if (call < calls.size()) { calls[call].lastSeen = now; }
+
+        bool quit = l3->chan_alloc && l3->chan_alloc_type == TMAC_ALLOC_T_QUIT_GO;
+        if (cmce->pdu_type == TCMCE_PDU_T_D_RELEASE || cmce->pdu_type == TCMCE_PDU_T_D_DISCONNECT || quit) {
+            if (call < calls.size()) { release(call); }
+            return;
+        }
+
+        //A downlink, its carrier and the control one known from the SYSINFO
+        if (!l3->chan_alloc || l3->chan_ul_dl == 2 || !l3->chan_dl_hz || !l3->main_dl_hz) { return; }
+        //Back on the control carrier, which is decoded already
+        if (l3->chan_dl_hz == l3->main_dl_hz) {
+            if (call < calls.size()) { release(call); }
+            return;
+        }
+        if (call < calls.size()) {
+            if (followers[calls[call].follower]->hz == l3->chan_dl_hz) { return; }
+            //Moved to another carrier
+            release(call);
+        }
+        int target = ctrlBin + (int)lround(((double)l3->chan_dl_hz - (double)l3->main_dl_hz) / _spacing);
+        if (target < -(_channelCount / 2) || target >= _channelCount - (_channelCount / 2)) { return; }
+        assign(ctrlBin, cmce->call_id, target, l3->chan_dl_hz);
+    }
+
+    void TrafficScheduler::expire() {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lck(mtx);
+        expireLocked(now);
+    }
+
+    void TrafficScheduler::releaseAll(int ctrlBin) {
+        std::lock_guard<std::mutex> lck(mtx);
+        for (size_t i = calls.size(); i > 0; i--) {
+            if (calls[i - 1].ctrlBin == ctrlBin) { release(i - 1); }
+        }
+    }
+
+    void TrafficScheduler::assign(int ctrlBin, uint16_t callId, int targetBin, uint32_t hz) {
+        //Share the follower already on the carrier, or take a free one
+        int f = -1;
+        for (int i = 0; i < (int)followers.size(); i++) {
+            Follower& fl = *followers[i];
+            if (fl.assigned && fl.hz == hz && fl.ctrlBin == ctrlBin) { f = i; break; }
+            if (!fl.assigned && f < 0) { f = i; }
+        }
+        if (f < 0) {
+            missed++;
+            return;
+        }
+
+        Follower& fl = *followers[f];
+        if (!fl.assigned) {
+            fl.hz = hz;
+            fl.calls = 0;
+            fl.ctrlBin = ctrlBin;
+            fl.bin = targetBin;
+            fl.assigned = true;
+            if (_handler) { _handler(f, true, _handlerCtx); }
+        }
+        fl.calls++;
+        calls.push_back({ ctrlBin, callId, f, std::chrono::steady_clock::now() });
+    }
+
+    void TrafficScheduler::release(size_t call) {
+        int f = calls[call].follower;
+        calls.erase(calls.begin() + call);
+        Follower& fl = *followers[f];
+        if (--fl.calls > 0) { return; }
+        fl.assigned = false;
+        fl.hz = 0;
+        if (_handler) { _handler(f, false, _handlerCtx); }
+    }
+
+    void TrafficScheduler::expireLocked(std::chrono::steady_clock::time_point now) {
+        for (size_t i = calls.size(); i > 0; i--) {
+            if (now - calls[i - 1].lastSeen > timeout) { release(i - 1); }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+    #include "tetra_common.h"
+    #include "tetra_mle_pdu.h"
+}
+
+//Calls that are not heard of for this long are released, in case their D-RELEASE was missed
+#define TRAFFIC_SCHEDULER_DEFAULT_TIMEOUT_MS 30000
+
+namespace dsp {
+    //Follows the traffic channels allocated by the CMCE of the control carriers with a fixed pool of follower chains.
+    //A call related PDU (D-SETUP, D-CONNECT, ...) whose MAC PDU allocates a channel on another carrier of the band
+    //gets a follower tuned to that carrier. The calls on one carrier share its follower, which is released with the
+    //D-RELEASE / D-DISCONNECT of the last of them or once they time out. Feed it the L3 headers of the control
+    //carriers and of the followers themselves (see osmotetradec::setL3Handler), thread safe
+    class TrafficScheduler {
+    public:
+        //One follower chain, readable without taking the scheduler's lock. bin fits
+        //PolyphaseChannelizer::bindChannel and is where the chain is tuned while assigned
+        struct Follower {
+            std::atomic<int> bin = 0;
+            std::atomic<bool> assigned = false;
+            //Bin of the control carrier that allocated the channel
+            std::atomic<int> ctrlBin = 0;
+            uint32_t hz = 0;
+            int calls = 0;
+        };
+
+        TrafficScheduler() {}
+
+        TrafficScheduler(int followers, int channelCount, int spacing, int timeoutMs = TRAFFIC_SCHEDULER_DEFAULT_TIMEOUT_MS) { init(followers, channelCount, spacing, timeoutMs); }
+
+        //followers chains over a channelizer of channelCount bins, spacing Hz apart. Drops every assignment
+        void init(int followers, int channelCount, int spacing, int timeoutMs = TRAFFIC_SCHEDULER_DEFAULT_TIMEOUT_MS);
+
+        //handler is told of every assignment and release, with the scheduler locked: it must not call back into the
+        //scheduler except for the followers' fields
+        void setChangeHandler(void (*handler)(int follower, bool assigned, void* ctx), void* ctx);
+
+        //l3 was decoded by the chain on ctrlBin, or by a follower assigned by the control carrier on ctrlBin
+        void handleL3(int ctrlBin, const struct tetra_l3_event* l3);
+
+        //Release the calls that timed out, done by handleL3 as well
+        void expire();
+
+        //Release everything the control carrier on ctrlBin assigned
+        void releaseAll(int ctrlBin);
+
+        int getFollowerCount() { return followers.size(); }
+        Follower& getFollower(int i) { return *followers[i]; }
+
+        //Allocations that found every follower busy
+        unsigned int getMissed() { return missed; }
+
+    protected:
+        struct Call {
+            int ctrlBin;
+            uint16_t callId;
+            int follower;
+            std::chrono::steady_clock::time_point lastSeen;
+        };
+
+        void assign(int ctrlBin, uint16_t callId, int targetBin, uint32_t hz);
+        void release(size_t call);
+        void expireLocked(std::chrono::steady_clock::time_point now);
+
+        std::mutex mtx;
+        std::vector<std::unique_ptr<Follower>> followers;
+        std::vector<Call> calls;
+        int _channelCount = 0;
+        int _spacing = 0;
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(TRAFFIC_SCHEDULER_DEFAULT_TIMEOUT_MS);
+        std::atomic<unsigned int> missed = 0;
+
+        void (*_handler)(int follower, bool assigned, void* ctx) = NULL;
+        void* _handlerCtx = NULL;
+    };
+}
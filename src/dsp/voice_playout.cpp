@@ -0,0 +1,170 @@
+#include "voice_playout.h"
+
+#include <math.h>
+#include <thread>
+
+//Codec samples per tick and the size of the jitter buffer ring
+#define TICK_SAMPLES (VOICE_PLAYOUT_TICK_MS * 8)
+#define RING_SAMPLES ((VOICE_PLAYOUT_MAX_JITTER_MS * 8) + (VOICE_PLAYOUT_MAX_GAP_FRAMES + 2) * TETRA_CODEC_SLOT_SAMPLES)
+//The codec output is band limited to 3.4 kHz anyway
+#define CUTOFF (3800.0 / 8000.0)
+
+namespace dsp {
+    VoicePlayout::~VoicePlayout() {
+        if (!block::_block_init) { return; }
+        block::stop();
+    }
+
+    void VoicePlayout::init(double outSamplerate, int jitterMs) {
+        _outSamplerate = outSamplerate;
+        step = 8000.0 / outSamplerate;
+        jitterSamples = std::clamp<int>(jitterMs, 0, VOICE_PLAYOUT_MAX_JITTER_MS) * 8;
+        ring.resize(RING_SAMPLES);
+        memset(work, 0, sizeof(work));
+        generateTaps();
+        block::registerOutput(&out);
+        block::_block_init = true;
+    }
+
+    void VoicePlayout::setOutSamplerate(double samplerate) {
+        assert(block::_block_init);
+        std::lock_guard<std::mutex> lck(bufMtx);
+        _outSamplerate = samplerate;
+        step = 8000.0 / samplerate;
+    }
+
+    void VoicePlayout::setJitterBuffer(int ms) {
+        jitterSamples = std::clamp<int>(ms, 0, VOICE_PLAYOUT_MAX_JITTER_MS) * 8;
+    }
+
+    void VoicePlayout::pushFrames(const TetraAudioFrame* frames, int count) {
+        static const int16_t silence[TETRA_CODEC_SLOT_SAMPLES] = {};
+        std::lock_guard<std::mutex> lck(bufMtx);
+        for (int i = 0; i < count; i++) {
+            const TetraAudioFrame& frame = frames[i];
+            if (!frame.active) { continue; }
+            //Missed frames keep their place in the call, between calls the playout clock makes the silence
+            int gap = clock.silenceBefore(frame);
+            if (gap <= VOICE_PLAYOUT_MAX_GAP_FRAMES * TETRA_CODEC_SLOT_SAMPLES && writePos != readPos) {
+                for (; gap > 0; gap -= TETRA_CODEC_SLOT_SAMPLES) {
+                    write(silence, std::min<int>(gap, TETRA_CODEC_SLOT_SAMPLES));
+                }
+            }
+            marks.push_back({ writePos, frame.received });
+            write(frame.samples, TETRA_CODEC_SLOT_SAMPLES);
+        }
+    }
+
+    float VoicePlayout::getBuffered() {
+        std::lock_guard<std::mutex> lck(bufMtx);
+        return (float)(writePos - readPos) / 8.0f;
+    }
+
+    void VoicePlayout::reset() {
+        assert(block::_block_init);
+        std::lock_guard<std::recursive_mutex> lck(block::ctrlMtx);
+        block::tempStop();
+        {
+            std::lock_guard<std::mutex> blck(bufMtx);
+            readPos = 0;
+            writePos = 0;
+            marks.clear();
+            clock.reset();
+            playing = false;
+        }
+        memset(work, 0, sizeof(work));
+        pos = 0.0;
+        latency = -1.0f;
+        block::tempStart();
+    }
+
+    int VoicePlayout::run() {
+        auto now = std::chrono::steady_clock::now();
+        //Start over after a stall instead of catching up with a burst of ticks
+        if (nextTick < now - std::chrono::milliseconds(10 * VOICE_PLAYOUT_TICK_MS)) { nextTick = now; }
+        std::this_thread::sleep_until(nextTick);
+        nextTick += std::chrono::milliseconds(VOICE_PLAYOUT_TICK_MS);
+        now = std::chrono::steady_clock::now();
+
+        int16_t in[TICK_SAMPLES];
+        int n = 0;
+        double _step;
+        {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            _step = step;
+            int jitter = jitterSamples;
+            uint64_t avail = writePos - readPos;
+            if (!playing && avail > 0 && avail >= (uint64_t)std::max<int>(jitter, TICK_SAMPLES)) { playing = true; }
+            //The cell's clock runs ahead of ours, drop what piled up beyond the jitter buffer
+            if (playing && avail > (uint64_t)(jitter + 2 * TETRA_CODEC_SLOT_SAMPLES)) {
+                readPos = writePos - jitter;
+                avail = jitter;
+            }
+            if (playing) {
+                n = std::min<uint64_t>(avail, TICK_SAMPLES);
+                for (int i = 0; i < n; i++) { in[i] = ring[(readPos + i) % RING_SAMPLES]; }
+                readPos += n;
+                //Ran dry, wait for the buffer to fill up again
+                if (n < TICK_SAMPLES) { playing = false; }
+            }
+            while (!marks.empty() && marks.front().sample < readPos) {
+                latency = std::chrono::duration<float, std::milli>(now - marks.front().received).count();
+                marks.pop_front();
+            }
+        }
+        memset(&in[n], 0, (TICK_SAMPLES - n) * sizeof(int16_t));
+
+        //Resample straight from the 16 bit codec samples into both channels
+        float* hist = &work[VOICE_PLAYOUT_TAPS - 1];
+        for (int i = 0; i < TICK_SAMPLES; i++) { hist[i] = in[i]; }
+        int outCount = 0;
+        while (true) {
+            //The nearest phase, which may be the first of the next sample. pos just short of the end of the tick then
+            //goes out with the next one, where it is just above -1/2 phase and rounds to sample 0 phase 0
+            int idx = (int)(pos * VOICE_PLAYOUT_PHASES + 0.5);
+            int base = idx / VOICE_PLAYOUT_PHASES;
+            int phase = idx % VOICE_PLAYOUT_PHASES;
+            if (base >= TICK_SAMPLES) { break; }
+            const float* x = &work[base];
+            const float* h = taps[phase];
+            float sum = 0.0f;
+            for (int j = 0; j < VOICE_PLAYOUT_TAPS; j++) { sum += x[j] * h[j]; }
+            out.writeBuf[outCount].l = sum;
+            out.writeBuf[outCount].r = sum;
+            outCount++;
+            pos += _step;
+        }
+        pos -= TICK_SAMPLES;
+        memmove(work, &work[TICK_SAMPLES], (VOICE_PLAYOUT_TAPS - 1) * sizeof(float));
+
+        if (!out.swap(outCount)) { return -1; }
+        return outCount;
+    }
+
+    void VoicePlayout::write(const int16_t* samples, int count) {
+        for (int i = 0; i < count; i++) { ring[(writePos + i) % RING_SAMPLES] = samples[i]; }
+        writePos += count;
+        //Full, the oldest audio goes
+        if (writePos - readPos > RING_SAMPLES) { readPos = writePos - RING_SAMPLES; }
+        while (!marks.empty() && marks.front().sample < readPos) { marks.pop_front(); }
+    }
+
+    //Windowed sinc interpolator, one set of taps per fractional position. The 1/32768 of the 16 bit to float
+    //conversion is folded into the taps
+    void VoicePlayout::generateTaps() {
+        const int center = VOICE_PLAYOUT_TAPS / 2 - 1;
+        for (int p = 0; p < VOICE_PLAYOUT_PHASES; p++) {
+            double frac = (double)p / VOICE_PLAYOUT_PHASES;
+            double sum = 0.0;
+            for (int j = 0; j < VOICE_PLAYOUT_TAPS; j++) {
+                double t = (double)(j - center) - frac;
+                double x = 2.0 * CUTOFF * t;
+                double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+                double w = 0.42 + 0.5 * cos(2.0 * M_PI * t / VOICE_PLAYOUT_TAPS) + 0.08 * cos(4.0 * M_PI * t / VOICE_PLAYOUT_TAPS);
+                taps[p][j] = sinc * w;
+                sum += taps[p][j];
+            }
+            for (int j = 0; j < VOICE_PLAYOUT_TAPS; j++) { taps[p][j] = (taps[p][j] / sum) / 32768.0; }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <dsp/block.h>
+#include <dsp/stream.h>
+#include <dsp/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "osmotetra_dec.h"
+
+//Playout runs in ticks of this many ms, 80 codec samples each
+#define VOICE_PLAYOUT_TICK_MS 10
+#define VOICE_PLAYOUT_DEFAULT_JITTER_MS 120
+#define VOICE_PLAYOUT_MAX_JITTER_MS 1000
+//Gaps up to this many frames inside a call are played as silence, longer ones start a new talk spurt
+#define VOICE_PLAYOUT_MAX_GAP_FRAMES 4
+#define VOICE_PLAYOUT_TAPS 16
+#define VOICE_PLAYOUT_PHASES 64
+
+namespace dsp {
+    //Low latency voice output: plays the active timeslot of the TetraAudioFrame records of osmotetradec straight
+    //to stereo at the sink rate. Resampling, the 16 bit to float conversion and mono to stereo are one pass over the
+    //codec output. Frames wait in a jitter buffer of jitterMs before a talk spurt starts playing, the block keeps its
+    //own clock and plays silence whenever the buffer runs dry
+    class VoicePlayout : public block {
+    public:
+        VoicePlayout() {}
+
+        VoicePlayout(double outSamplerate, int jitterMs) { init(outSamplerate, jitterMs); }
+
+        ~VoicePlayout();
+
+        void init(double outSamplerate, int jitterMs);
+
+        void setOutSamplerate(double samplerate);
+
+        //Audio collected before a talk spurt starts playing, also the most the buffer may drift ahead of playout
+        void setJitterBuffer(int ms);
+
+        //Takes the active frames out of frames, thread safe. Fits the audio frame handler of osmotetradec
+        void pushFrames(const TetraAudioFrame* frames, int count);
+
+        //Time from the burst of a frame reaching the decoder to its first sample leaving the block, in ms, of the last
+        //frame that started playing: the voice decoding, the jitter buffer and the playout. -1 until one did.
+        //Buffering further down the sink comes on top of this
+        float getLatency() { return latency; }
+
+        //Audio waiting in the jitter buffer, in ms
+        float getBuffered();
+
+        void reset();
+
+        int run();
+
+        stream<stereo_t> out;
+
+    protected:
+        struct Mark {
+            uint64_t sample;
+            std::chrono::steady_clock::time_point received;
+        };
+
+        void generateTaps();
+        void write(const int16_t* samples, int count);
+
+        double _outSamplerate;
+        std::atomic<int> jitterSamples = 0;
+
+        //Codec samples between pushFrames and run(), readPos and writePos count from the start
+        std::mutex bufMtx;
+        std::vector<int16_t> ring;
+        uint64_t readPos = 0;
+        uint64_t writePos = 0;
+        std::deque<Mark> marks;
+        AudioFrameClock clock;
+        bool playing = false;
+
+        //Resampler state, only touched by run()
+        float taps[VOICE_PLAYOUT_PHASES][VOICE_PLAYOUT_TAPS];
+        float work[VOICE_PLAYOUT_TAPS - 1 + VOICE_PLAYOUT_TICK_MS * 8];
+        double step = 0.0;
+        double pos = 0.0;
+        std::chrono::steady_clock::time_point nextTick;
+
+        std::atomic<float> latency = -1.0f;
+    };
+}
@@ -0,0 +1,71 @@
+#include "worker_pool.h"
+
+namespace dsp {
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+        }
+        startCnd.notify_all();
+        for (auto& t : threads) {
+            if (t.joinable()) { t.join(); }
+        }
+    }
+
+    void WorkerPool::init(int threadCount) {
+        for (int i = 1; i < threadCount; i++) {
+            threads.push_back(std::thread(&WorkerPool::worker, this));
+        }
+    }
+
+    void WorkerPool::setThreadTuning(const ThreadTuning& tuning) {
+        for (auto& t : threads) { tuning.apply(t); }
+    }
+
+    void WorkerPool::run(int count, void (*job)(int index, void* ctx), void* ctx) {
+        if (threads.empty() || count <= 1) {
+            for (int i = 0; i < count; i++) { job(i, ctx); }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            _job = job;
+            _ctx = ctx;
+            _count = count;
+            next = 0;
+            busy = threads.size();
+            generation++;
+        }
+        startCnd.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lck(mtx);
+        doneCnd.wait(lck, [this]() { return busy == 0; });
+    }
+
+    void WorkerPool::drain() {
+        int i;
+        while ((i = next.fetch_add(1)) < _count) {
+            _job(i, _ctx);
+        }
+    }
+
+    void WorkerPool::worker() {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                startCnd.wait(lck, [&]() { return stopping || generation != seen; });
+                if (stopping) { return; }
+                seen = generation;
+            }
+
+            drain();
+
+            std::lock_guard<std::mutex> lck(mtx);
+            if (--busy == 0) { doneCnd.notify_one(); }
+        }
+    }
+}
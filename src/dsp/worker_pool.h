@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_tuning.h"
+
+namespace dsp {
+    //Fork-join pool: run() spreads count jobs over the pool threads and the calling thread, then waits for all of them
+    class WorkerPool {
+    public:
+        WorkerPool() {}
+
+        WorkerPool(int threadCount) { init(threadCount); }
+
+        ~WorkerPool();
+
+        //threadCount includes the thread calling run(), so 1 runs every job inline
+        void init(int threadCount);
+
+        void run(int count, void (*job)(int index, void* ctx), void* ctx);
+
+        int getThreadCount() { return threads.size() + 1; }
+
+        //Affinity and priority of the pool threads, the calling thread is the caller's to tune
+        void setThreadTuning(const ThreadTuning& tuning);
+
+    protected:
+        void worker();
+        void drain();
+
+        std::vector<std::thread> threads;
+        std::mutex mtx;
+        std::condition_variable startCnd;
+        std::condition_variable doneCnd;
+        bool stopping = false;
+        uint64_t generation = 0;
+        int busy = 0;
+
+        void (*_job)(int index, void* ctx) = NULL;
+        void* _ctx = NULL;
+        int _count = 0;
+        std::atomic<int> next = 0;
+    };
+}
@@ -0,0 +1,194 @@
+//Synthetic TETRA downlink generator: writes the IQ of N cells side by side, with valid SYNC, SYSINFO and ACCESS-ASSIGN
+//PDUs and the chosen traffic on their timeslots, at a given SNR and frequency offset. One carrier at 36 kHz goes
+//straight into tetra_cli, more carriers at a higher rate into the plugin or the wideband chains. For load tests, and
+//for benchmarks and regression runs without live RF: the same seed always gives the same samples
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dsp/tetra_signal_gen.h"
+
+extern "C" {
+    #include <phy/tetra_burst_gen.h>
+}
+
+#define GEN_DEFAULT_SAMPLERATE 36000
+#define GEN_DEFAULT_SPACING 25000
+#define GEN_DEFAULT_SECONDS 10.0
+#define GEN_DEFAULT_SNR_DB 25.0f
+//RMS of the output relative to full scale, leaves room for the peaks of several carriers before cs16 and cu8 clip
+#define GEN_DEFAULT_LEVEL 0.25f
+//Samples generated and written at a time
+#define GEN_BLOCK_SIZE 8192
+
+enum OutputFormat { FORMAT_CF32, FORMAT_CS16, FORMAT_CU8 };
+
+struct Options {
+    std::string output = "-";
+    OutputFormat format = FORMAT_CF32;
+    double samplerate = GEN_DEFAULT_SAMPLERATE;
+    int carriers = 1;
+    double spacing = GEN_DEFAULT_SPACING;
+    double freqOffset = 0;
+    float snrDb = GEN_DEFAULT_SNR_DB;
+    float level = GEN_DEFAULT_LEVEL;
+    double seconds = GEN_DEFAULT_SECONDS;
+    double speed = 0;
+    unsigned int seed = 1;
+    tetra_gen_cell cell;
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -o <file>    IQ output, - for stdout (default)\n"
+        "  -f <fmt>     output format: cf32 (default), cs16 or cu8\n"
+        "  -r <rate>    samplerate in Hz, a multiple of 18000 (default %d)\n"
+        "  -n <n>       carriers, centered around 0 Hz (default 1)\n"
+        "  -d <hz>      carrier spacing (default %d)\n"
+        "  -F <hz>      frequency offset of every carrier (default 0)\n"
+        "  -S <db>      SNR (Es/N0) of every carrier (default %.0f)\n"
+        "  -g <level>   output RMS relative to full scale (default %.2f)\n"
+        "  -m <mcc>     MCC of the cells (default %u)\n"
+        "  -M <mnc>     MNC of the cells (default %u)\n"
+        "  -c <cc>      colour code of the first cell, the others count up from it (default %u)\n"
+        "  -p <slots>   what timeslots 1 to 4 carry: i(dle), r(andom signalling) or t(raffic) each, a shorter\n"
+        "               pattern repeats (default i)\n"
+        "  -t <sec>     seconds of signal, 0 for no end (default %.0f)\n"
+        "  -x <speed>   pace the output, 1 for real time, 0 as fast as possible (default)\n"
+        "  -s <seed>    seed of the bits and the noise (default 1)\n", prog,
+        GEN_DEFAULT_SAMPLERATE, GEN_DEFAULT_SPACING, GEN_DEFAULT_SNR_DB, GEN_DEFAULT_LEVEL, 901, 1, 1, GEN_DEFAULT_SECONDS);
+}
+
+static bool parseArgs(int argc, char** argv, Options& opts) {
+    tetra_gen_cell_default(&opts.cell);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") { return false; }
+        if (arg.size() != 2 || arg[0] != '-' || i + 1 >= argc) {
+            fprintf(stderr, "Invalid argument: %s\n", argv[i]);
+            return false;
+        }
+        std::string val = argv[++i];
+        switch (arg[1]) {
+            case 'o': opts.output = val; break;
+            case 'r': opts.samplerate = atof(val.c_str()); break;
+            case 'n': opts.carriers = atoi(val.c_str()); break;
+            case 'd': opts.spacing = atof(val.c_str()); break;
+            case 'F': opts.freqOffset = atof(val.c_str()); break;
+            case 'S': opts.snrDb = atof(val.c_str()); break;
+            case 'g': opts.level = atof(val.c_str()); break;
+            case 'm': opts.cell.mcc = atoi(val.c_str()) & 0x3ff; break;
+            case 'M': opts.cell.mnc = atoi(val.c_str()) & 0x3fff; break;
+            case 'c': opts.cell.colour_code = atoi(val.c_str()) & 0x3f; break;
+            case 'p':
+                if (tetra_gen_parse_pattern(val.c_str(), opts.cell.slot_pattern) < 0) {
+                    fprintf(stderr, "Invalid timeslot pattern: %s\n", val.c_str());
+                    return false;
+                }
+                break;
+            case 't': opts.seconds = atof(val.c_str()); break;
+            case 'x': opts.speed = atof(val.c_str()); break;
+            case 's': opts.seed = strtoul(val.c_str(), NULL, 10); break;
+            case 'f':
+                if (val == "cf32") { opts.format = FORMAT_CF32; }
+                else if (val == "cs16") { opts.format = FORMAT_CS16; }
+                else if (val == "cu8") { opts.format = FORMAT_CU8; }
+                else {
+                    fprintf(stderr, "Unknown output format: %s\n", val.c_str());
+                    return false;
+                }
+                break;
+            default:
+                fprintf(stderr, "Invalid argument: %s\n", argv[i - 1]);
+                return false;
+        }
+    }
+    if (opts.carriers < 1) {
+        fprintf(stderr, "Needs at least one carrier\n");
+        return false;
+    }
+    return true;
+}
+
+//In the layout tetra_cli reads them back with
+static size_t convert(OutputFormat format, const dsp::complex_t* in, int count, float level, void* out) {
+    const float* f = (const float*)in;
+    switch (format) {
+        case FORMAT_CS16: {
+            int16_t* o = (int16_t*)out;
+            for (int i = 0; i < 2 * count; i++) { o[i] = (int16_t)std::clamp<float>(roundf(f[i] * level * 32768.0f), -32768.0f, 32767.0f); }
+            return 2 * count * sizeof(int16_t);
+        }
+        case FORMAT_CU8: {
+            uint8_t* o = (uint8_t*)out;
+            for (int i = 0; i < 2 * count; i++) { o[i] = (uint8_t)std::clamp<float>(roundf(f[i] * level * 128.0f + 127.5f), 0.0f, 255.0f); }
+            return 2 * count * sizeof(uint8_t);
+        }
+        default: {
+            float* o = (float*)out;
+            for (int i = 0; i < 2 * count; i++) { o[i] = f[i] * level; }
+            return 2 * count * sizeof(float);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if (!parseArgs(argc, argv, opts)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //Every carrier is a cell of its own, the colour codes and carrier numbers count up from the first one
+    std::vector<dsp::TetraSignalGenerator::Carrier> carriers(opts.carriers);
+    for (int i = 0; i < opts.carriers; i++) {
+        carriers[i].offset = (i - (opts.carriers - 1) / 2.0) * opts.spacing;
+        carriers[i].snrDb = opts.snrDb;
+        carriers[i].cell = opts.cell;
+        carriers[i].cell.colour_code = (opts.cell.colour_code + i) & 0x3f;
+        //Carrier numbers are 25 kHz apart
+        carriers[i].cell.main_carrier = (opts.cell.main_carrier + (int)round(i * opts.spacing / 25000.0)) & 0xfff;
+    }
+    dsp::TetraSignalGenerator gen;
+    if (!gen.init(opts.samplerate, carriers, opts.freqOffset, opts.seed)) {
+        fprintf(stderr, "The samplerate has to be a multiple of %d Hz and hold every carrier\n", TETRA_SIGGEN_SYMBOLRATE);
+        return 1;
+    }
+
+    FILE* out = (opts.output == "-") ? stdout : fopen(opts.output.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "Could not open %s\n", opts.output.c_str());
+        return 1;
+    }
+
+    std::vector<dsp::complex_t> iq(GEN_BLOCK_SIZE);
+    std::vector<uint8_t> raw(GEN_BLOCK_SIZE * 2 * sizeof(float));
+    uint64_t total = (opts.seconds > 0) ? (uint64_t)(opts.seconds * opts.samplerate) : UINT64_MAX;
+    uint64_t written = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (written < total) {
+        int n = (int)std::min<uint64_t>(GEN_BLOCK_SIZE, total - written);
+        gen.generate(iq.data(), n);
+        size_t len = convert(opts.format, iq.data(), n, opts.level, raw.data());
+        if (fwrite(raw.data(), 1, len, out) != len) { break; }
+        written += n;
+        if (opts.speed > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration<double>(written / (opts.samplerate * opts.speed)));
+        }
+    }
+    if (out != stdout) { fclose(out); }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const tetra_burst_gen& bursts = gen.getBursts(0);
+    fprintf(stderr, "%llu samples (%.1f s of signal) of %d carriers in %.2f s, %.2f MS/s. Per carrier %llu bursts, %llu sync, %llu traffic\n",
+            (unsigned long long)written, written / opts.samplerate, opts.carriers, secs, written / secs / 1e6,
+            (unsigned long long)bursts.bursts, (unsigned long long)bursts.sync_bursts, (unsigned long long)bursts.traffic_bursts);
+    return 0;
+}
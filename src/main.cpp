@@ -5,14 +5,18 @@
 #include <core.h>
 #include <gui/style.h>
 #include <gui/gui.h>
+#include <gui/tuner.h>
 #include <signal_path/signal_path.h>
 #include <module.h>
 // #include <unistd.h>
 #include <fstream>
+#include <climits>
+#include <chrono>
+#include <thread>
+#include <map>
 
 #include <dsp/demod/psk.h>
 #include <dsp/buffer/packer.h>
-#include <dsp/routing/splitter.h>
 #include <dsp/stream.h>
 #include <dsp/convert/mono_to_stereo.h>
 
@@ -23,12 +27,34 @@
 #include <utils/flog.h>
 #include <utils/net.h>
 
-#include "dsp/bit_unpacker.h"
 #include "dsp/dqpsk_sym_extr.h"
 #include "dsp/pi4dqpsk.h"
 #include "dsp/osmotetra_dec.h"
+#include "dsp/voice_playout.h"
+#include "dsp/channelizer.h"
+#include "dsp/gpu_wideband.h"
+#include "dsp/worker_pool.h"
+#include "dsp/thread_tuning.h"
+#include "dsp/chain_sink.h"
+#include "dsp/traffic_scheduler.h"
+#include "dsp/channel_scanner.h"
+#include "dsp/packet_capture.h"
+#include "dsp/call_recorder.h"
+#include "dsp/event_database.h"
+#include "dsp/gsmtap.h"
+#include "dsp/netsyms.h"
+#include "dsp/burst_event_reader.h"
+#include "dsp/metrics_server.h"
+#include "dsp/decoder_metrics.h"
+#include "dsp/cluster.h"
 #include "gui_widgets.h"
 
+extern "C" {
+    #include <tetra_pbits.h>
+    #include <phy/tetra_train_corr.h>
+    #include <tetra_prof.h>
+}
+
 
 #define CONCAT(a, b)    ((std::string(a) + b).c_str())
 
@@ -42,6 +68,25 @@
 #define AGC_RATE 0.02f
 #define COSTAS_LOOP_BANDWIDTH 0.01f
 #define FLL_LOOP_BANDWIDTH 0.006f
+#define WIDEBAND_CHANNEL_SPACING 25000
+#define WIDEBAND_DEFAULT_CHANNELS 16
+//The upper end is there for the GPU mode, the CPU chains run out of cores well before it
+#define WIDEBAND_MAX_CHANNELS 1024
+//Rates of the stage counters are taken over this long
+#define PROFILE_RATE_MS 1000
+#define WIDEBAND_MAX_THREADS 64
+#define WIDEBAND_MAX_FOLLOWERS 16
+//How often the scan looks at its chains, and how long a retuned source is given before they start
+#define SCAN_POLL_MS 100
+#define SCAN_SETTLE_MS 50
+//Cluster work ids: the bin plus WIDEBAND_MAX_CHANNELS for the carriers picked in the menu, this plus the index for
+//the followers
+#define CLUSTER_FOLLOWER_WORK 100000
+//Recorder and database source of the narrowband chain, the wideband chains go by their work id
+#define NARROWBAND_SOURCE -1
+#define TSFIND_WINDOW_BITS 45
+#define TSFIND_CHUNK_BITS 2048
+#define TSFIND_HOLD_BITS 2048
 
 SDRPP_MOD_INFO {
     /* Name:            */ "tetra_demodulator",
@@ -70,58 +115,246 @@ public:
         strcpy(hostname, std::string(config.conf[name]["hostname"]).c_str());
         port = config.conf[name]["port"];
         bool startNow = config.conf[name]["sending"];
+        if (!config.conf[name].contains("net_format")) {
+            config.conf[name]["net_format"] = dsp::NETSYMS_FORMAT_RAW;
+        }
+        netFormat = std::clamp<int>(config.conf[name]["net_format"], dsp::NETSYMS_FORMAT_RAW, dsp::NETSYMS_FORMAT_PHASE8);
+        if (!config.conf[name].contains("wideband")) {
+            config.conf[name]["wideband"] = false;
+            config.conf[name]["wb_channels"] = WIDEBAND_DEFAULT_CHANNELS;
+            config.conf[name]["wb_bins"] = json::array();
+        }
+        wideband = config.conf[name]["wideband"];
+        wbChannelCount = config.conf[name]["wb_channels"];
+        wbBins = config.conf[name]["wb_bins"].get<std::vector<int>>();
+        if (!config.conf[name].contains("wb_threads")) {
+            config.conf[name]["wb_threads"] = 0;
+        }
+        wbThreads = config.conf[name]["wb_threads"];
+        if (!config.conf[name].contains("single_thread_chain")) {
+            config.conf[name]["single_thread_chain"] = false;
+        }
+        singleThreadChain = config.conf[name]["single_thread_chain"];
+        if (!config.conf[name].contains("wb_followers")) {
+            config.conf[name]["wb_followers"] = 0;
+        }
+        wbFollowers = config.conf[name]["wb_followers"];
+        if (!config.conf[name].contains("wb_gpu")) {
+            config.conf[name]["wb_gpu"] = false;
+        }
+        wbGpu = config.conf[name]["wb_gpu"];
+        wbGpuAvailable = dsp::gpu::WidebandDemod::isAvailable(wbGpuDevice);
+        //Config only: where the chain runs depends on the machine it runs on
+        if (!config.conf[name].contains("cpu_affinity")) {
+            config.conf[name]["cpu_affinity"] = "";
+        }
+        if (!config.conf[name].contains("rt_priority")) {
+            config.conf[name]["rt_priority"] = 0;
+        }
+        if (!config.conf[name].contains("numa_local")) {
+            config.conf[name]["numa_local"] = false;
+        }
+        std::string cpuAffinity = config.conf[name]["cpu_affinity"];
+        if (!chainTuning.setCpuList(cpuAffinity)) {
+            flog::error("TETRA: ignoring the CPU affinity '{0}', expected a list like 0-3,8", cpuAffinity);
+        }
+        chainTuning.setRtPriority(config.conf[name]["rt_priority"]);
+        chainTuning.setNumaLocal(config.conf[name]["numa_local"]);
+        if (!config.conf[name].contains("scan_band")) {
+            //390 - 395 MHz, the European public safety downlinks
+            config.conf[name]["scan_band"] = 3;
+            config.conf[name]["scan_first"] = 3600;
+            config.conf[name]["scan_last"] = 3799;
+            config.conf[name]["scan_offset"] = 0;
+            config.conf[name]["scan_dwell_ms"] = CHANNEL_SCANNER_DEFAULT_DWELL_MS;
+        }
+        scanBand = config.conf[name]["scan_band"];
+        scanFirst = config.conf[name]["scan_first"];
+        scanLast = config.conf[name]["scan_last"];
+        scanOffset = config.conf[name]["scan_offset"];
+        scanDwellMs = config.conf[name]["scan_dwell_ms"];
+        if (!config.conf[name].contains("low_latency")) {
+            config.conf[name]["low_latency"] = false;
+            config.conf[name]["jitter_ms"] = VOICE_PLAYOUT_DEFAULT_JITTER_MS;
+        }
+        lowLatency = config.conf[name]["low_latency"];
+        jitterMs = config.conf[name]["jitter_ms"];
+        if (!config.conf[name].contains("suspend_on_disable")) {
+            config.conf[name]["suspend_on_disable"] = false;
+        }
+        suspendOnDisable = config.conf[name]["suspend_on_disable"];
+        if (!config.conf[name].contains("idle_saving")) {
+            config.conf[name]["idle_saving"] = false;
+        }
+        idleSaving = config.conf[name]["idle_saving"];
+        if (!config.conf[name].contains("list_decoding")) {
+            config.conf[name]["list_decoding"] = false;
+        }
+        listDecoding = config.conf[name]["list_decoding"];
+        if (!config.conf[name].contains("pipelined_mac")) {
+            config.conf[name]["pipelined_mac"] = false;
+        }
+        pipelinedMac = config.conf[name]["pipelined_mac"];
+        if (!config.conf[name].contains("keystream_ahead")) {
+            config.conf[name]["keystream_ahead"] = false;
+        }
+        keystreamAhead = config.conf[name]["keystream_ahead"];
+        if (!config.conf[name].contains("fixed_point_demod")) {
+            config.conf[name]["fixed_point_demod"] = false;
+        }
+        fixedPointDemod = config.conf[name]["fixed_point_demod"];
+        if (!config.conf[name].contains("constellation_interval_ms")) {
+            config.conf[name]["constellation_interval_ms"] = CONST_TAP_DEFAULT_INTERVAL_MS;
+        }
+        constDiagIntervalMs = std::clamp<int>(config.conf[name]["constellation_interval_ms"], 20, 1000);
+        if (!config.conf[name].contains("keyfile")) {
+            config.conf[name]["keyfile"] = "";
+        }
+        strcpy(keyfile, std::string(config.conf[name]["keyfile"]).c_str());
+        if (!config.conf[name].contains("capture_path")) {
+            config.conf[name]["capture_path"] = "";
+            config.conf[name]["capture_gsmtap"] = false;
+        }
+        strcpy(capturePath, std::string(config.conf[name]["capture_path"]).c_str());
+        captureGsmtap = config.conf[name]["capture_gsmtap"];
+        if (!config.conf[name].contains("archive_path")) {
+            config.conf[name]["archive_path"] = "";
+        }
+        strcpy(archivePath, std::string(config.conf[name]["archive_path"]).c_str());
+        if (!config.conf[name].contains("gsmtap_host")) {
+            config.conf[name]["gsmtap_host"] = "localhost";
+            config.conf[name]["gsmtap_port"] = GSMTAP_UDP_PORT;
+            config.conf[name]["gsmtap_flush_ms"] = GSMTAP_DEFAULT_FLUSH_MS;
+            config.conf[name]["gsmtap_sending"] = false;
+        }
+        strcpy(gsmtapHost, std::string(config.conf[name]["gsmtap_host"]).c_str());
+        gsmtapPort = config.conf[name]["gsmtap_port"];
+        gsmtapFlushMs = config.conf[name]["gsmtap_flush_ms"];
+        bool gsmtapNow = config.conf[name]["gsmtap_sending"];
+        if (!config.conf[name].contains("metrics_host")) {
+            config.conf[name]["metrics_host"] = "0.0.0.0";
+            config.conf[name]["metrics_port"] = METRICS_DEFAULT_PORT;
+            config.conf[name]["metrics_serving"] = false;
+        }
+        strcpy(metricsHost, std::string(config.conf[name]["metrics_host"]).c_str());
+        metricsPort = config.conf[name]["metrics_port"];
+        bool metricsNow = config.conf[name]["metrics_serving"];
+        if (!config.conf[name].contains("cluster_host")) {
+            config.conf[name]["cluster_host"] = "127.0.0.1";
+            config.conf[name]["cluster_port"] = CLUSTER_DEFAULT_PORT;
+            config.conf[name]["cluster_serving"] = false;
+        }
+        strcpy(clusterHost, std::string(config.conf[name]["cluster_host"]).c_str());
+        clusterPort = config.conf[name]["cluster_port"];
+        bool clusterNow = config.conf[name]["cluster_serving"];
+        if (!config.conf[name].contains("cluster_secret")) {
+            config.conf[name]["cluster_secret"] = "";
+        }
+        strcpy(clusterSecret, std::string(config.conf[name]["cluster_secret"]).c_str());
+        if (!config.conf[name].contains("record_dir")) {
+            config.conf[name]["record_dir"] = "";
+            config.conf[name]["recording"] = false;
+        }
+        strcpy(recordDir, std::string(config.conf[name]["record_dir"]).c_str());
+        bool recordNow = config.conf[name]["recording"];
+        if (!config.conf[name].contains("db_path")) {
+            config.conf[name]["db_path"] = "";
+            config.conf[name]["db_batch_rows"] = EVENT_DATABASE_DEFAULT_BATCH_ROWS;
+            config.conf[name]["db_flush_ms"] = EVENT_DATABASE_DEFAULT_FLUSH_MS;
+            config.conf[name]["db_writing"] = false;
+        }
+        strcpy(databasePath, std::string(config.conf[name]["db_path"]).c_str());
+        dbBatchRows = config.conf[name]["db_batch_rows"];
+        dbFlushMs = config.conf[name]["db_flush_ms"];
+        bool databaseNow = config.conf[name]["db_writing"];
         config.release(true);
-
-        vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, VFO_BANDWIDTH, VFO_SAMPLERATE, VFO_BANDWIDTH, VFO_BANDWIDTH, true);
+        cluster.setHandlers(_clusterAssignHandler, _clusterCellHandler, _clusterL3Handler, this);
+        recorder.setSource(NARROWBAND_SOURCE, name);
+        database.setSource(NARROWBAND_SOURCE, name);
+        if (keyfile[0]) { loadKeystore(); }
 
         //Clock recov coeffs
         float recov_bandwidth = CLOCK_RECOVERY_BW;
         float recov_dampningFactor = CLOCK_RECOVERY_DAMPN_F;
         float recov_denominator = (1.0f + 2.0*recov_dampningFactor*recov_bandwidth + recov_bandwidth*recov_bandwidth);
-        float recov_mu = (4.0f * recov_dampningFactor * recov_bandwidth) / recov_denominator;
-        float recov_omega = (4.0f * recov_bandwidth * recov_bandwidth) / recov_denominator;
+        recov_mu = (4.0f * recov_dampningFactor * recov_bandwidth) / recov_denominator;
+        recov_omega = (4.0f * recov_bandwidth * recov_bandwidth) / recov_denominator;
 
-        mainDemodulator.init(vfo->output, 18000, VFO_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
-        constDiagSplitter.init(&mainDemodulator.out);
-        constDiagSplitter.bindStream(&constDiagStream);
-        constDiagSplitter.bindStream(&demodStream);
-        constDiagReshaper.init(&constDiagStream, 1024, 0);
-        constDiagSink.init(&constDiagReshaper.out, _constDiagSinkHandler, this);
-        symbolExtractor.init(&demodStream);
-        bitsUnpacker.init(&symbolExtractor.out);
+        //What the blocks allocate and clear here comes from the NUMA node of the CPU set
+        {
+            dsp::ScopedNumaPolicy numa(chainTuning);
+            //Input is connected once the VFO is created in enable()
+            mainDemodulator.init(NULL, 18000, VFO_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+            mainDemodulator.setResumeHandler(_resumeHandler, this);
+            mainDemodulator.setIdleMode(idleSaving, _idleSynced, this);
+            mainDemodulator.setFixedPoint(fixedPointDemod);
+            mainDemodulator.setThreadTuning(&chainTuning);
+            symbolExtractor.init(&mainDemodulator.out);
+            symbolExtractor.setThreadTuning(&chainTuning);
+            //Only while the diagram is drawn, see menuHandler()
+            symbolExtractor.setConstellationTap(_constDiagTapHandler, this, constDiagIntervalMs * 18);
+            symbolExtractor.setUnpackBits(true);
 
-        demodSink.init(&bitsUnpacker.out, _demodSinkHandler, this);
+            demodSink.init(&symbolExtractor.out, _demodSinkHandler, this);
 
-        osmotetradecoder.init(&bitsUnpacker.out);
-        resamp.init(&osmotetradecoder.out, 8000.0, audioSampleRate);
-        outconv.init(&resamp.out);
+            osmotetradecoder.init(&symbolExtractor.out);
+            osmotetradecoder.setSoftBits(true);
+            osmotetradecoder.setListDecoding(listDecoding ? TETRA_VITERBI_LIST_DEFAULT_PATHS : 0);
+            osmotetradecoder.setPipelined(pipelinedMac);
+            osmotetradecoder.setKeystreamAhead(keystreamAhead);
+            osmotetradecoder.setThreadTuning(&chainTuning);
+            resamp.init(&osmotetradecoder.out, 8000.0, audioSampleRate);
+            outconv.init(&resamp.out);
+            playout.init(audioSampleRate, jitterMs);
+
+            //Input is connected in startNarrowband()
+            nbChain.init(NULL, _nbChainHandler, this);
+            nbChain.setThreadTuning(&chainTuning);
+        }
 
         // Initialize the sink
         srChangeHandler.ctx = this;
         srChangeHandler.handler = sampleRateChangeHandler;
-        stream.init(&outconv.out, &srChangeHandler, audioSampleRate);
+        stream.init(lowLatency ? &playout.out : &outconv.out, &srChangeHandler, audioSampleRate);
         sigpath::sinkManager.registerStream(name, &stream);
 
-        mainDemodulator.start();
-        constDiagSplitter.start();
-        constDiagReshaper.start();
-        constDiagSink.start();
-        symbolExtractor.start();
-        bitsUnpacker.start();
-        setMode();
-        resamp.start();
-        outconv.start();
-        stream.start();
+        enable();
         gui::menu.registerEntry(name, menuHandler, this, this);
 
         if(startNow) {
             startNetwork();
         }
+        if(gsmtapNow) {
+            startGsmtap();
+        }
+        dsp::MetricsServer::get().addCollector(_metricsCollector, this);
+        if(metricsNow) {
+            startMetrics();
+        }
+        if(clusterNow) {
+            startCluster();
+        }
+        if(recordNow) {
+            startRecording();
+        }
+        if(databaseNow) {
+            startDatabase();
+        }
     }
 
     ~TetraDemodulatorModule() {
-        if(isEnabled()) {
-            disable();
+        //The server is shared by the instances and keeps running for the others
+        dsp::MetricsServer::get().removeCollector(this);
+        //Every carrier is decoded here again before the chains go
+        cluster.stop();
+        stopRecording();
+        stopDatabase();
+        stopCapture();
+        stopArchive();
+        stopGsmtap();
+        stopNetwork();
+        if(enabled || suspended) {
+            stopChain();
         }
         gui::menu.removeEntry(name);
         sigpath::sinkManager.unregisterStream(name);
@@ -129,66 +362,983 @@ public:
 
     void postInit() {}
 
+    //With suspendOnDisable a disabled instance keeps its VFO and chain, only the demodulator drops its input.
+    //Enabling it again picks up with the loops, the slot timing and what is known of the cell as they were
     void enable() {
-        vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, 29000, 36000, 29000, 29000, true);
-        mainDemodulator.setInput(vfo->output);
-        mainDemodulator.start();
-        constDiagSplitter.start();
-        constDiagReshaper.start();
-        constDiagSink.start();
-        symbolExtractor.start();
-        bitsUnpacker.start();
-        setMode();
-        resamp.start();
-        outconv.start();
-        stream.start();
-
+        if(suspended) {
+            suspended = false;
+            applySuspend();
+        } else {
+            startChain();
+        }
         enabled = true;
     }
 
     void disable() {
-        mainDemodulator.stop();
-        constDiagSplitter.stop();
-        constDiagReshaper.stop();
-        constDiagSink.stop();
-        symbolExtractor.stop();
-        bitsUnpacker.stop();
-        osmotetradecoder.stop();
-        demodSink.stop();
+        if(suspendOnDisable) {
+            suspended = true;
+            applySuspend();
+        } else {
+            stopChain();
+        }
+        enabled = false;
+    }
+
+    bool isEnabled() {
+        return enabled;
+    }
+
+private:
+    void startChain() {
+        if(wideband) {
+            startWideband();
+        } else {
+            startNarrowband();
+        }
+        if(lowLatency) {
+            playout.start();
+        } else {
+            resamp.start();
+            outconv.start();
+        }
+        stream.start();
+        applySuspend();
+        reportTuningErrors();
+    }
+
+    void reportTuningErrors() {
+        std::string err = chainTuning.takeErrors();
+        if (!err.empty()) { flog::warn("TETRA: thread tuning not fully applied, {0}", err); }
+    }
+
+    void stopChain() {
+        if(wideband) {
+            stopWideband();
+        } else {
+            stopNarrowband();
+        }
         resamp.stop();
         outconv.stop();
+        playout.stop();
+        playout.reset();
         stream.stop();
         sigpath::vfoManager.deleteVFO(vfo);
-        enabled = false;
+        suspended = false;
+    }
+
+    //Gates the input of the demodulators, narrowband or every wideband channel, by suspended
+    void applySuspend() {
+        if(!wideband) {
+            mainDemodulator.setSuspended(suspended);
+            return;
+        }
+        if(wbGpuDemod) {
+            wbGpuDemod->setSuspended(suspended);
+            return;
+        }
+        std::lock_guard<std::mutex> lck(wbChannelsMtx);
+        for(auto& ch : wbChannels) { ch->demod.setSuspended(suspended); }
+    }
+
+    //The decoder is told how long the input was gone, 2 bits a symbol, so the slots carry on across the gap
+    static void _resumeHandler(double symbols, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        _this->osmotetradecoder.skipBits((uint64_t)llround(symbols * 2.0));
+    }
+
+    static void _wbResumeHandler(double symbols, void* ctx) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        ch->decoder.skipBits((uint64_t)llround(symbols * 2.0));
+    }
+
+    //Idle mode keeps a chain awake while either the symbols or the bursts are in sync
+    static bool _idleSynced(void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        return _this->symbolExtractor.sync || _this->osmotetradecoder.getRxState() != 0;
+    }
+
+    //A chain decoded on a node never sleeps, its sync is not known here
+    static bool _wbIdleSynced(void* ctx) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        return ch->offloaded || ch->symbolExtractor.sync || ch->decoder.getRxState() != 0;
+    }
+
+    void setListDecoding(bool enable) {
+        listDecoding = enable;
+        int paths = listDecoding ? TETRA_VITERBI_LIST_DEFAULT_PATHS : 0;
+        reconfigureNarrowband([&]() { osmotetradecoder.setListDecoding(paths); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) { ch->decoder.setListDecoding(paths); }
+        }
+        config.acquire();
+        config.conf[name]["list_decoding"] = listDecoding;
+        config.release(true);
+    }
+
+    void setPipelinedMac(bool enable) {
+        pipelinedMac = enable;
+        reconfigureNarrowband([&]() { osmotetradecoder.setPipelined(pipelinedMac); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) { ch->decoder.setPipelined(pipelinedMac); }
+        }
+        config.acquire();
+        config.conf[name]["pipelined_mac"] = pipelinedMac;
+        config.release(true);
+    }
+
+    void setKeystreamAhead(bool enable) {
+        keystreamAhead = enable;
+        reconfigureNarrowband([&]() { osmotetradecoder.setKeystreamAhead(keystreamAhead); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) { ch->decoder.setKeystreamAhead(keystreamAhead); }
+        }
+        config.acquire();
+        config.conf[name]["keystream_ahead"] = keystreamAhead;
+        config.release(true);
+    }
+
+    void setFixedPointDemod(bool enable) {
+        fixedPointDemod = enable;
+        reconfigureNarrowband([&]() { mainDemodulator.setFixedPoint(fixedPointDemod); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) { ch->demod.setFixedPoint(fixedPointDemod); }
+        }
+        config.acquire();
+        config.conf[name]["fixed_point_demod"] = fixedPointDemod;
+        config.release(true);
+    }
+
+    void setIdleSaving(bool enable) {
+        idleSaving = enable;
+        reconfigureNarrowband([&]() { mainDemodulator.setIdleMode(idleSaving, _idleSynced, this); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) {
+                ch->demod.setIdleMode(idleSaving && !scanning && ch->follower < 0, _wbIdleSynced, ch.get());
+            }
+        }
+        config.acquire();
+        config.conf[name]["idle_saving"] = idleSaving;
+        config.release(true);
+    }
+
+    //One carrier split out of the wideband VFO by the channelizer
+    struct WidebandChannel {
+        int bin;
+        //Index in trafficScheduler of a traffic channel follower, which is retuned through it instead of sitting on bin.
+        //-1 for the channels picked in the menu
+        int follower = -1;
+        TetraDemodulatorModule* parent;
+        dsp::stream<dsp::complex_t> input;
+        dsp::demod::PI4DQPSK demod;
+        dsp::DQPSKSymbolExtractor symbolExtractor;
+        dsp::osmotetradec decoder;
+        dsp::sink::Handler<float> audioSink;
+        //Pooled mode only: set once the channelizer writes this channel
+        std::atomic<bool> active = false;
+        //GPU mode: the symbols and loop state of the channel, demod is never run
+        bool gpu = false;
+        dsp::gpu::WidebandDemod::Output gpuOut;
+        //Cluster mode: the symbols go to the chain of a decode node as NETSYMS IQ8 packets, the extractor and the
+        //decoder are not run. remote is set by the coordinator's assign handler
+        std::atomic<bool> offloaded = false;
+        std::mutex remoteMtx;
+        std::shared_ptr<net::Socket> remote;
+        dsp::NetsymsFramer remoteFramer;
+
+        int workId() { return (follower >= 0) ? CLUSTER_FOLLOWER_WORK + follower : bin + WIDEBAND_MAX_CHANNELS; }
+
+        //Pooled mode: run the whole chain on one block of channelizer output. The blocks are never started,
+        //so their own output buffers serve as scratch space between the stages
+        void process(int count) {
+            if(gpu) {
+                processSymbols();
+                return;
+            }
+            int n = demod.process(count, input.writeBuf, demod.out.writeBuf);
+            if(offloaded && sendRemote(demod.out.writeBuf, n)) { return; }
+            n = symbolExtractor.process(n, demod.out.writeBuf, symbolExtractor.out.writeBuf);
+            n = decoder.process(n, symbolExtractor.out.writeBuf, decoder.out.writeBuf);
+            if(n) { _wbAudioHandler(decoder.out.writeBuf, n, this); }
+        }
+
+        //GPU mode: the rest of the chain on the symbols of the last block
+        void processSymbols() {
+            if(offloaded && sendRemote(gpuOut.symbols, gpuOut.count)) { return; }
+            if(gpuOut.resumeSymbols != 0.0) { decoder.skipBits((uint64_t)llround(gpuOut.resumeSymbols * 2.0)); }
+            int n = symbolExtractor.process(gpuOut.count, gpuOut.symbols, symbolExtractor.out.writeBuf);
+            n = decoder.process(n, symbolExtractor.out.writeBuf, decoder.out.writeBuf);
+            if(n) { _wbAudioHandler(decoder.out.writeBuf, n, this); }
+        }
+
+        //false if the channel is decoded here after all
+        bool sendRemote(const dsp::complex_t* syms, int count) {
+            std::lock_guard<std::mutex> lck(remoteMtx);
+            if(!remote) { return false; }
+            if(remote->isOpen()) { remoteFramer.writeSymbols(syms, count, isLoopLocked() ? 1.0f : 0.0f, _remotePacketHandler, this); }
+            return true;
+        }
+
+        //host empty: decode here again
+        void setRemote(const std::string& host, int port) {
+            std::shared_ptr<net::Socket> sock;
+            if(!host.empty()) {
+                try {
+                    sock = net::openudp(host, port);
+                } catch (std::runtime_error& e) {
+                    flog::error("TETRA: could not send channel {0} to {1}:{2}, {3}", workId(), host, port, e.what());
+                }
+            }
+            std::shared_ptr<net::Socket> old;
+            {
+                std::lock_guard<std::mutex> lck(remoteMtx);
+                old = remote;
+                remote = sock;
+                remoteFramer.reset(dsp::NETSYMS_FORMAT_IQ8);
+                offloaded = (bool)sock;
+            }
+            if(old) { old->close(); }
+        }
+
+        static void _remotePacketHandler(const uint8_t* pkt, int len, void* ctx) {
+            WidebandChannel* ch = (WidebandChannel*)ctx;
+            ch->remote->send(pkt, len);
+        }
+
+        double getFllFrequency() { return gpu ? gpuOut.fllFrequency.load(std::memory_order_relaxed) : demod.getFllFrequency(); }
+        bool isLoopLocked() { return gpu ? gpuOut.locked.load(std::memory_order_relaxed) : demod.isLoopLocked(); }
+        bool isIdle() { return !gpu && demod.isIdle(); }
+
+        //Pooled mode: nothing is swapped, so the read halves of the stream buffers are never used
+        void dropReadBuffers() {
+            dropReadBuffer(input);
+            dropReadBuffer(demod.out);
+            dropReadBuffer(symbolExtractor.out);
+            dropReadBuffer(decoder.out);
+        }
+
+        template <class T>
+        static void dropReadBuffer(dsp::stream<T>& s) {
+            dsp::buffer::free(s.readBuf);
+            s.readBuf = NULL;
+        }
+    };
+
+    //One thread per block, or in single-thread mode nbChain alone with the blocks never started, see _nbChainHandler()
+    void startNarrowband() {
+        vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, VFO_BANDWIDTH, VFO_SAMPLERATE, VFO_BANDWIDTH, VFO_BANDWIDTH, true);
+        mainDemodulator.setInput(vfo->output);
+        nbChain.setInput(vfo->output);
+        resamp.setInput(&osmotetradecoder.out);
+        //Low latency: the voice goes to the playout as frames and the decoder output stays empty
+        osmotetradecoder.setAudioFrameHandler(lowLatency ? _voiceFrameHandler : NULL, this);
+        if(singleThreadChain) {
+            setMode();
+            nbChain.start();
+        } else {
+            mainDemodulator.start();
+            symbolExtractor.start();
+            setMode();
+        }
+    }
+
+    void stopNarrowband() {
+        nbChain.stop();
+        mainDemodulator.stop();
+        symbolExtractor.stop();
+        osmotetradecoder.stop();
+        demodSink.stop();
+    }
+
+    //Runs change on the narrowband blocks. Their setters hold the thread of the block around a change, in
+    //single-thread mode none of them is running and it is the thread of nbChain that has to be held
+    void reconfigureNarrowband(const std::function<void()>& change) {
+        if(singleThreadChain) {
+            nbChain.reconfigure(change);
+        } else {
+            change();
+        }
+    }
+
+    void startWideband() {
+        double bw = (double)wbChannelCount * WIDEBAND_CHANNEL_SPACING;
+        vfo = sigpath::vfoManager.createVFO(name, ImGui::WaterfallVFO::REF_CENTER, 0, bw, bw, bw, bw, true);
+        //Decimating by M/2 leaves every channel 2x oversampled, which the RRC and clock recovery need
+        if(wbGpu) { startWidebandGpu(); }
+        if(wbGpuDemod) {
+            //The symbols come back from the GPU, the rest of every chain is run on the pool
+            wbPool = std::make_unique<dsp::WorkerPool>((wbThreads > 0) ? wbThreads : std::max<int>(std::thread::hardware_concurrency(), 1));
+            wbPool->setThreadTuning(chainTuning);
+            wbGpuDemod->setOutputHandler(_wbChannelizerHandler, this);
+            wbGpuDemod->setThreadTuning(&chainTuning);
+        }
+        else {
+            dsp::ScopedNumaPolicy numa(chainTuning);
+            channelizer = std::make_unique<dsp::multirate::PolyphaseChannelizer>(vfo->output, wbChannelCount, wbChannelCount / 2);
+            channelizer->setThreadTuning(&chainTuning);
+            if(wbThreads > 0) {
+                //Every carrier chain runs from the channelizer's output callback, spread over a shared pool
+                wbPool = std::make_unique<dsp::WorkerPool>(wbThreads);
+                wbPool->setThreadTuning(chainTuning);
+                channelizer->setOutputHandler(_wbChannelizerHandler, this);
+            }
+        }
+        resamp.setInput(&wbAudioStream);
+        //A scan brings its own chains, see scanWorker
+        int followers = scanning ? 0 : wbFollowers;
+        if(!scanning) {
+            for(int bin : wbBins) {
+                addWidebandChannel(bin);
+            }
+        }
+        trafficScheduler.init(followers, wbChannelCount, WIDEBAND_CHANNEL_SPACING);
+        trafficScheduler.setChangeHandler(_followerChangeHandler, this);
+        for(int i = 0; i < followers; i++) {
+            addWidebandChannel(0, i);
+        }
+        if(wbGpuDemod) {
+            wbGpuDemod->start();
+        } else {
+            channelizer->start();
+        }
+    }
+
+    //Falls back to the CPU channelizer if the GPU won't take the job
+    void startWidebandGpu() {
+        dsp::gpu::WidebandDemod::Params p;
+        p.symbolrate = 18000;
+        p.samplerate = VFO_SAMPLERATE;
+        p.channelSamplerate = getWidebandChannelSamplerate();
+        p.rrcTapCount = RRC_TAP_COUNT;
+        p.rrcBeta = RRC_ALPHA;
+        p.agcRate = AGC_RATE;
+        p.costasBandwidth = COSTAS_LOOP_BANDWIDTH;
+        p.fllBandwidth = FLL_LOOP_BANDWIDTH;
+        p.omegaGain = recov_omega;
+        p.muGain = recov_mu;
+        p.omegaRelLimit = CLOCK_RECOVERY_REL_LIM;
+        try {
+            dsp::ScopedNumaPolicy numa(chainTuning);
+            wbGpuDemod = std::make_unique<dsp::gpu::WidebandDemod>(vfo->output, wbChannelCount, wbChannelCount / 2, p, wbChannelCount + WIDEBAND_MAX_FOLLOWERS);
+        }
+        catch (const std::exception& e) {
+            flog::error("TETRA: wideband mode stays on the CPU, {0}", e.what());
+            wbGpuDemod.reset();
+        }
+    }
+
+    void stopWideband() {
+        //The scan ends with the chains it runs on
+        scanRunning = false;
+        if(scanThread.joinable()) { scanThread.join(); }
+        scanning = false;
+        if(wbGpuDemod) {
+            wbGpuDemod->stop();
+        } else {
+            channelizer->stop();
+        }
+        for(auto& ch : wbChannels) {
+            removeClusterWork(ch.get());
+            stopWidebandChannel(ch.get());
+        }
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            wbChannels.clear();
+        }
+        wbFollowerChannels.clear();
+        channelizer.reset();
+        wbGpuDemod.reset();
+        trafficScheduler.init(0, wbChannelCount, WIDEBAND_CHANNEL_SPACING);
+        wbPool.reset();
+    }
+
+    double getWidebandChannelSamplerate() {
+        return 2.0 * WIDEBAND_CHANNEL_SPACING;
+    }
+
+    //follower >= 0 adds that traffic channel follower instead, bin is ignored
+    void addWidebandChannel(int bin, int follower = -1) {
+        if(bin < -(wbChannelCount / 2) || bin >= wbChannelCount - (wbChannelCount / 2)) { return; }
+        dsp::ScopedNumaPolicy numa(chainTuning);
+        std::unique_ptr<WidebandChannel> ch = std::make_unique<WidebandChannel>();
+        ch->bin = bin;
+        ch->follower = follower;
+        ch->parent = this;
+        //Demodulate at the same 2 samples/symbol as narrowband, the channel rate is taken care of by the resampling RRC
+        ch->demod.init(&ch->input, 18000, VFO_SAMPLERATE, RRC_TAP_COUNT, RRC_ALPHA, AGC_RATE, COSTAS_LOOP_BANDWIDTH, FLL_LOOP_BANDWIDTH, recov_omega, recov_mu, CLOCK_RECOVERY_REL_LIM);
+        ch->demod.setInputSamplerate(getWidebandChannelSamplerate());
+        ch->demod.setSuspended(suspended);
+        ch->demod.setResumeHandler(_wbResumeHandler, ch.get());
+        //The followers are retuned to calls and the scan has a dwell of its own, neither of them sleeps
+        ch->demod.setIdleMode(idleSaving && !scanning && follower < 0, _wbIdleSynced, ch.get());
+        ch->demod.setFixedPoint(fixedPointDemod);
+        ch->demod.setThreadTuning(&chainTuning);
+        ch->symbolExtractor.init(&ch->demod.out);
+        ch->symbolExtractor.setUnpackBits(true);
+        ch->symbolExtractor.setSoftBits(true);
+        ch->symbolExtractor.setThreadTuning(&chainTuning);
+        ch->decoder.init(&ch->symbolExtractor.out);
+        ch->decoder.setSoftBits(true);
+        ch->decoder.setListDecoding(listDecoding ? TETRA_VITERBI_LIST_DEFAULT_PATHS : 0);
+        ch->decoder.setPipelined(pipelinedMac);
+        ch->decoder.setKeystreamAhead(keystreamAhead);
+        ch->decoder.setThreadTuning(&chainTuning);
+        //Only the channel routed to the audio output runs its voice through the codec
+        ch->decoder.setAudioWanted(!scanning && follower < 0 && bin == wbAudioBin);
+        if(lowLatency) { ch->decoder.setAudioFrameHandler(_wbVoiceFrameHandler, ch.get()); }
+        ch->audioSink.init(&ch->decoder.out, _wbAudioHandler, ch.get());
+        if(wantWidebandL3() && !scanning) { ch->decoder.setL3Handler(_wbL3Handler, ch.get()); }
+        if(recorder.isRunning() && !scanning) { recordWidebandChannel(ch.get()); }
+        //The followers are named once they are assigned, see _followerChangeHandler
+        if(follower < 0) {
+            recorder.setSource(ch->workId(), getClusterLabel(ch.get()));
+            database.setSource(ch->workId(), getClusterLabel(ch.get()));
+        }
+        if(follower >= 0) { wbFollowerChannels.push_back(ch.get()); }
+
+        if(wbPool) {
+            ch->gpu = (bool)wbGpuDemod;
+            ch->dropReadBuffers();
+            WidebandChannel* chp = ch.get();
+            {
+                std::lock_guard<std::mutex> lck(wbChannelsMtx);
+                wbChannels.push_back(std::move(ch));
+            }
+            bindWidebandChannel(chp);
+            //Followers only run while they are assigned a call, and only then go to the cluster
+            chp->active = follower < 0;
+            addClusterChannel(chp);
+            if(follower < 0 && !scanning) { cluster.addWork(chp->workId(), getClusterLabel(chp)); }
+            return;
+        }
+
+        bindWidebandChannel(ch.get());
+        ch->demod.start();
+        ch->symbolExtractor.start();
+        ch->decoder.start();
+        ch->audioSink.start();
+        std::lock_guard<std::mutex> lck(wbChannelsMtx);
+        wbChannels.push_back(std::move(ch));
+    }
+
+    void bindWidebandChannel(WidebandChannel* ch) {
+        if(ch->gpu) {
+            if(ch->follower >= 0) {
+                wbGpuDemod->bindChannel(&trafficScheduler.getFollower(ch->follower).bin, &ch->gpuOut);
+            } else {
+                wbGpuDemod->bindChannel(ch->bin, &ch->gpuOut);
+            }
+            return;
+        }
+        if(ch->follower >= 0) {
+            channelizer->bindChannel(&trafficScheduler.getFollower(ch->follower).bin, &ch->input);
+        } else {
+            channelizer->bindChannel(ch->bin, &ch->input);
+        }
+    }
+
+    void removeWidebandChannel(int bin) {
+        trafficScheduler.releaseAll(bin);
+        for(auto it = wbChannels.begin(); it != wbChannels.end(); it++) {
+            if((*it)->follower >= 0 || (*it)->bin != bin) { continue; }
+            removeClusterWork(it->get());
+            if((*it)->gpu) {
+                wbGpuDemod->unbindChannel(&(*it)->gpuOut);
+            } else {
+                channelizer->unbindChannel(&(*it)->input);
+            }
+            stopWidebandChannel(it->get());
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            wbChannels.erase(it);
+            return;
+        }
+    }
+
+    void stopWidebandChannel(WidebandChannel* ch) {
+        ch->demod.stop();
+        ch->symbolExtractor.stop();
+        ch->decoder.stop();
+        ch->audioSink.stop();
+    }
+
+    void setWideband(bool enable) {
+        bool wasRunning = enabled || suspended;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        wideband = enable;
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["wideband"] = wideband;
+        config.release(true);
+    }
+
+    void loadKeystore() {
+        keystoreStatus = (load_keystore(keyfile) < 0) ? -1 : 1;
+        if (keystoreStatus < 0) {
+            flog::error("TETRA: could not load the keystore from {0}", keyfile);
+        }
+    }
+
+    void startCluster() {
+        cluster.setSecret(clusterSecret);
+        if (!cluster.start(clusterHost, clusterPort)) {
+            flog::error("TETRA: could not coordinate the cluster on {0}:{1}", clusterHost, clusterPort);
+        }
+    }
+
+    //Pooled wideband chains only, the others can't be told where their symbols go
+    void addClusterChannel(WidebandChannel* ch) {
+        std::lock_guard<std::mutex> lck(clusterChannelsMtx);
+        clusterChannels[ch->workId()] = ch;
+    }
+
+    //Before the channel goes. It is decoded here again
+    void removeClusterWork(WidebandChannel* ch) {
+        {
+            std::lock_guard<std::mutex> lck(clusterChannelsMtx);
+            if (!clusterChannels.erase(ch->workId())) { return; }
+        }
+        cluster.removeWork(ch->workId());
+        ch->setRemote("", 0);
+    }
+
+    std::string getClusterLabel(WidebandChannel* ch) {
+        if (ch->follower < 0) { return name + "_" + std::to_string(ch->bin * WIDEBAND_CHANNEL_SPACING / 1000) + "kHz"; }
+        auto& f = trafficScheduler.getFollower(ch->follower);
+        return name + "_" + std::to_string(f.bin * WIDEBAND_CHANNEL_SPACING / 1000) + "kHz_call";
+    }
+
+    static void _clusterAssignHandler(int work, const std::string& host, int port, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->clusterChannelsMtx);
+        auto it = _this->clusterChannels.find(work);
+        if (it == _this->clusterChannels.end()) { return; }
+        it->second->setRemote(host, port);
+    }
+
+    //Called with the coordinator locked
+    static bool _clusterCellHandler(int work, dsp::ClusterCellState& state, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->clusterChannelsMtx);
+        auto it = _this->clusterChannels.find(work);
+        if (it == _this->clusterChannels.end() || it->second->offloaded) { return false; }
+        dsp::TetraCellInfo info = it->second->decoder.getCellInfo();
+        if (!info.syncs) { return false; }
+        state.valid = true;
+        state.mcc = info.mcc;
+        state.mnc = info.mnc;
+        state.cc = info.cc;
+        state.hn = info.hn;
+        state.cckId = info.cckId;
+        return true;
+    }
+
+    //The CMCE headers of the carriers decoded on the nodes, as _wbL3Handler has them for those decoded here
+    static void _clusterL3Handler(int work, const struct tetra_l3_event* l3, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        if (_this->wbFollowers <= 0) { return; }
+        if (work < CLUSTER_FOLLOWER_WORK) {
+            _this->trafficScheduler.handleL3(work - WIDEBAND_MAX_CHANNELS, l3);
+            return;
+        }
+        auto& f = _this->trafficScheduler.getFollower(work - CLUSTER_FOLLOWER_WORK);
+        if(f.assigned) { _this->trafficScheduler.handleL3(f.ctrlBin, l3); }
+    }
+
+    void setLowLatency(bool enable) {
+        bool wasRunning = enabled || suspended;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        lowLatency = enable;
+        resamp.setOutSamplerate(audioSampleRate);
+        stream.setInput(lowLatency ? &playout.out : &outconv.out);
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["low_latency"] = lowLatency;
+        config.release(true);
+    }
+
+    void setWidebandChannelCount(int count) {
+        bool wasRunning = (enabled || suspended) && wideband;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        wbChannelCount = count;
+        //Drop the bins that don't fit into the new bandwidth
+        wbBins.erase(std::remove_if(wbBins.begin(), wbBins.end(), [count](int b) { return b < -(count / 2) || b >= count - (count / 2); }), wbBins.end());
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["wb_channels"] = wbChannelCount;
+        config.conf[name]["wb_bins"] = wbBins;
+        config.release(true);
+    }
+
+    void setWidebandThreads(int threads) {
+        bool wasRunning = (enabled || suspended) && wideband;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        wbThreads = threads;
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["wb_threads"] = wbThreads;
+        config.release(true);
+    }
+
+    void setSingleThreadChain(bool enable) {
+        bool wasRunning = (enabled || suspended) && !wideband;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        singleThreadChain = enable;
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["single_thread_chain"] = singleThreadChain;
+        config.release(true);
+    }
+
+    void setWidebandFollowers(int followers) {
+        bool wasRunning = (enabled || suspended) && wideband;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        wbFollowers = followers;
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["wb_followers"] = wbFollowers;
+        config.release(true);
+    }
+
+    void setWidebandGpu(bool enable) {
+        bool wasRunning = (enabled || suspended) && wideband;
+        bool wasSuspended = suspended;
+        if(wasRunning) { stopChain(); }
+        wbGpu = enable;
+        suspended = wasSuspended;
+        if(wasRunning) { startChain(); }
+        config.acquire();
+        config.conf[name]["wb_gpu"] = wbGpu;
+        config.release(true);
+    }
+
+    void toggleWidebandBin(int bin) {
+        auto it = std::find(wbBins.begin(), wbBins.end(), bin);
+        if(it != wbBins.end()) {
+            wbBins.erase(it);
+            if((enabled || suspended) && wideband) { removeWidebandChannel(bin); }
+        } else {
+            wbBins.push_back(bin);
+            if((enabled || suspended) && wideband) { addWidebandChannel(bin); }
+        }
+        config.acquire();
+        config.conf[name]["wb_bins"] = wbBins;
+        config.release(true);
+    }
+
+    //Survey the carriers of the scan band with the channelizer, the carriers picked in the menu and their
+    //followers make way for it until stopScan
+    void startScan() {
+        if(!enabled || !wideband || scanning) { return; }
+        {
+            std::lock_guard<std::mutex> lck(scanMtx);
+            scanner.init(dsp::ChannelScanner::bandChannels(scanBand, scanFirst, scanLast, scanOffset), wbChannelCount, WIDEBAND_CHANNEL_SPACING, scanDwellMs);
+        }
+        scanReturnHz = gui::waterfall.getCenterFrequency() + sigpath::vfoManager.getOffset(name);
+        stopChain();
+        scanning = true;
+        startChain();
+        scanRunning = true;
+        scanThread = std::thread(&TetraDemodulatorModule::scanWorker, this);
+    }
+
+    //Back to the carriers picked in the menu and to where the VFO was, the results stay
+    void stopScan() {
+        if(!scanning) { return; }
+        stopChain();
+        startChain();
+        tuner::normalTuning(name, scanReturnHz);
+    }
+
+    //Tunes the source from window to window as the scanner module of SDR++ does, the chains are only added and
+    //removed here while the scan runs
+    void scanWorker() {
+        while(scanRunning) {
+            std::vector<int> window;
+            std::vector<int> bins;
+            double center;
+            {
+                std::lock_guard<std::mutex> lck(scanMtx);
+                if(!scanner.nextWindow()) { break; }
+                window = scanner.getWindow();
+                for(int i : window) { bins.push_back(scanner.getChannel(i).bin); }
+                center = scanner.getCenter();
+            }
+            tuner::centerTuning(name, center);
+            std::this_thread::sleep_for(std::chrono::milliseconds(SCAN_SETTLE_MS));
+            std::vector<WidebandChannel*> chains;
+            for(int bin : bins) {
+                addWidebandChannel(bin);
+                chains.push_back(wbChannels.back().get());
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            bool done = false;
+            while(scanRunning && !done) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(SCAN_POLL_MS));
+                int ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                std::lock_guard<std::mutex> lck(scanMtx);
+                for(int i = 0; i < (int)window.size(); i++) {
+                    dsp::ChannelScanner::Observation obs;
+                    obs.locked = chains[i]->decoder.getRxState() != 0;
+                    obs.cell = chains[i]->decoder.getCellInfo();
+                    obs.offset = chains[i]->getFllFrequency();
+                    scanner.observe(window[i], obs, ms);
+                }
+                done = scanner.windowDone(ms);
+            }
+            for(int bin : bins) {
+                removeWidebandChannel(bin);
+            }
+        }
+        //The menu puts the carriers picked back, see drawScanMenu
+        scanRunning = false;
+    }
+
+    void saveScanConfig() {
+        config.acquire();
+        config.conf[name]["scan_band"] = scanBand;
+        config.conf[name]["scan_first"] = scanFirst;
+        config.conf[name]["scan_last"] = scanLast;
+        config.conf[name]["scan_offset"] = scanOffset;
+        config.conf[name]["scan_dwell_ms"] = scanDwellMs;
+        config.release(true);
+    }
+
+    void startCapture() {
+        stopCapture();
+        if (!capture.open(capturePath, captureGsmtap)) {
+            flog::error("TETRA: could not create the capture file {0}", capturePath);
+            return;
+        }
+        updateL3Handler();
+        updateEventReader();
+    }
+
+    void stopCapture() {
+        if (!capture.isOpen()) { return; }
+        resetEventReader();
+        //The handler is taken off before the capture closes, _l3Handler only looks at the capture while it is open
+        reconfigureNarrowband([&]() { osmotetradecoder.setL3Handler(NULL, NULL); });
+        capture.close();
+        updateL3Handler();
+        updateEventReader();
+    }
+
+    //The narrowband decoder has one L3 handler, the capture, the recorder and the database share it
+    void updateL3Handler() {
+        bool used = capture.isOpen() || recorder.isRunning() || database.isOpen();
+        reconfigureNarrowband([&]() { osmotetradecoder.setL3Handler(used ? _l3Handler : NULL, used ? this : NULL); });
+    }
+
+    //Every call of the chains decoded here goes to a FLAC file of its own. The carriers offloaded to a cluster node
+    //are not recorded, their voice stays on the node
+    void startRecording() {
+        stopRecording();
+        if (!recorder.start(recordDir)) {
+            flog::error("TETRA: could not record to {0}, it is not a directory", recordDir);
+            return;
+        }
+        reconfigureNarrowband([&]() { osmotetradecoder.setRecordHandler(_recordHandler, this); });
+        updateL3Handler();
+        updateWidebandL3Handlers();
+        if(scanning) { return; }
+        std::lock_guard<std::mutex> lck(wbChannelsMtx);
+        for(auto& ch : wbChannels) { recordWidebandChannel(ch.get()); }
+    }
+
+    void stopRecording() {
+        if (!recorder.isRunning()) { return; }
+        //The decoders stop decoding the voice of every timeslot first
+        reconfigureNarrowband([&]() { osmotetradecoder.setRecordHandler(NULL, NULL); });
+        {
+            std::lock_guard<std::mutex> lck(wbChannelsMtx);
+            for(auto& ch : wbChannels) { ch->decoder.setRecordHandler(NULL, NULL); }
+        }
+        recorder.stop();
+        updateL3Handler();
+        updateWidebandL3Handlers();
+    }
+
+    //The chains run in parallel already, so every one decodes its voice on a single thread
+    void recordWidebandChannel(WidebandChannel* ch) {
+        ch->decoder.setRecordHandler(_wbRecordHandler, ch, 1);
+    }
+
+    //The CMCE and MM PDUs of the chains decoded here, batched into an SQLite database. The carriers offloaded to a
+    //cluster node are left out
+    void startDatabase() {
+        stopDatabase();
+        if (!database.open(databasePath, dbBatchRows, dbFlushMs)) {
+            flog::error("TETRA: could not open the event database {0}", databasePath);
+            return;
+        }
+        updateL3Handler();
+        updateWidebandL3Handlers();
+    }
+
+    void stopDatabase() {
+        if (!database.isOpen()) { return; }
+        database.close();
+        updateL3Handler();
+        updateWidebandL3Handlers();
+    }
+
+    //The call following, the recorder and the database take the L3 headers of the wideband chains
+    bool wantWidebandL3() {
+        return wbFollowers > 0 || recorder.isRunning() || database.isOpen();
+    }
+
+    void updateWidebandL3Handlers() {
+        if(scanning) { return; }
+        bool wanted = wantWidebandL3();
+        std::lock_guard<std::mutex> lck(wbChannelsMtx);
+        for(auto& ch : wbChannels) { ch->decoder.setL3Handler(wanted ? _wbL3Handler : NULL, wanted ? ch.get() : NULL); }
+    }
+
+    void startArchive() {
+        stopArchive();
+        auto ar = std::make_unique<tetra_burst_archive>();
+        if (tetra_burst_archive_open(ar.get(), archivePath) < 0) {
+            flog::error("TETRA: could not create the burst archive {0}", archivePath);
+            return;
+        }
+        burstArchive = std::move(ar);
+        reconfigureNarrowband([&]() { osmotetradecoder.setBurstArchive(burstArchive.get()); });
+    }
+
+    void stopArchive() {
+        if (!burstArchive) { return; }
+        reconfigureNarrowband([&]() { osmotetradecoder.setBurstArchive(NULL); });
+        tetra_burst_archive_close(burstArchive.get());
+        burstArchive.reset();
+    }
+
+    void startGsmtap() {
+        stopGsmtap();
+        if (!gsmtap.open(gsmtapHost, gsmtapPort, gsmtapFlushMs)) {
+            flog::error("TETRA: could not open the GSMTAP socket to {0}:{1}", gsmtapHost, gsmtapPort);
+            return;
+        }
+        updateEventReader();
+    }
+
+    void stopGsmtap() {
+        if (!gsmtap.isOpen()) { return; }
+        resetEventReader();
+        gsmtap.close();
+        updateEventReader();
+    }
+
+    //The decoder has one event queue, its reader serves the capture and the GSMTAP output. It is restarted whenever
+    //either of them changes, so its handlers never see one half open
+    void updateEventReader() {
+        resetEventReader();
+        if (!(capture.isOpen() && captureGsmtap) && !gsmtap.isOpen()) { return; }
+        //The blocks come off the decoder thread, the handlers only buffer them
+        auto reader = std::make_unique<dsp::BurstEventReader>(&osmotetradecoder, _eventHandler, this);
+        reader->setIdleHandler(_eventIdleHandler);
+        reader->start();
+        std::lock_guard<std::mutex> lck(eventReaderMtx);
+        eventReader = std::move(reader);
     }
 
-    bool isEnabled() {
-        return enabled;
+    //The metrics collector looks at the reader from the server thread
+    void resetEventReader() {
+        std::unique_ptr<dsp::BurstEventReader> reader;
+        {
+            std::lock_guard<std::mutex> lck(eventReaderMtx);
+            reader = std::move(eventReader);
+        }
+        reader.reset();
     }
 
-private:
+    void startMetrics() {
+        if (!dsp::MetricsServer::get().start(metricsHost, metricsPort)) {
+            flog::error("TETRA: could not serve the metrics on {0}:{1}", metricsHost, metricsPort);
+        }
+    }
+
+    //Called on the server thread for every scrape
+    static void _metricsCollector(dsp::MetricsWriter& w, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        std::string labels = dsp::MetricsWriter::label("instance", _this->name);
+        w.gauge("tetra_enabled", "1 while the demodulator instance runs", labels, _this->enabled);
+        w.gauge("tetra_suspended", "1 while the instance is disabled with its chain kept", labels, _this->suspended);
+        if (_this->enabled && !_this->wideband) {
+            dsp::writeDecoderMetrics(w, labels, _this->mainDemodulator, _this->symbolExtractor, _this->osmotetradecoder);
+        }
+        {
+            std::lock_guard<std::mutex> lck(_this->wbChannelsMtx);
+            for (auto& ch : _this->wbChannels) {
+                std::string chLabels = labels + "," + ((ch->follower >= 0) ? dsp::MetricsWriter::label("follower", std::to_string(ch->follower))
+                                                                           : dsp::MetricsWriter::label("channel", std::to_string(ch->bin)));
+                dsp::writeDecoderMetrics(w, chLabels, ch->getFllFrequency(), ch->isLoopLocked(), ch->isIdle(), ch->symbolExtractor, ch->decoder);
+            }
+        }
+        std::lock_guard<std::mutex> lck(_this->eventReaderMtx);
+        if (_this->eventReader) {
+            w.gauge("tetra_event_queue_depth", "Decoded records waiting for the capture and GSMTAP output", labels, _this->eventReader->getDepth());
+            w.counter("tetra_events_dropped_total", "Decoded records lost to a full event queue", labels, _this->eventReader->getDropped());
+        }
+    }
 
     void startNetwork() {
         stopNetwork();
         try {
+            //The sinks only send while the socket is open, so the framer is set up before it
+            netPackets = 0;
+            netFramer.reset((dsp::NetsymsFormat)netFormat);
             conn = net::openudp(hostname, port);
         } catch (std::runtime_error& e) {
             flog::error("Network error: %s\n", e.what());
+            return;
+        }
+        if(dsp::netsymsCarriesSymbols(netFormat)) {
+            //The symbols are handed over by the symbol extractor before it slices them, only while the output is open
+            reconfigureNarrowband([&]() { symbolExtractor.setSymbolHandler(_netSymHandler, this); });
+            netSymBound = true;
         }
     }
 
     void stopNetwork() {
+        if(netSymBound) {
+            reconfigureNarrowband([&]() { symbolExtractor.setSymbolHandler(NULL, NULL); });
+            netSymBound = false;
+        }
         if (conn) { conn->close(); }
     }
 
     void setMode() {
-        if(decoder_mode == 0) {
-            //osmo-tetra
+        if(singleThreadChain) {
+            reconfigureNarrowband([&]() {
+                symbolExtractor.setSoftBits(decoder_mode == 0);
+                nbChainNetsyms = (decoder_mode == 1);
+            });
+        } else if(decoder_mode == 0) {
+            //osmo-tetra, soft decision decoding
             demodSink.stop();
+            symbolExtractor.setSoftBits(true);
             osmotetradecoder.start();
         } else {
-            //network syms
+            //network syms, hard bits as tetra-rx expects them
             osmotetradecoder.stop();
+            symbolExtractor.setSoftBits(false);
             demodSink.start();
         }
         config.acquire();
@@ -200,12 +1350,61 @@ private:
         TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
         float menuWidth = ImGui::GetContentRegionAvail().x;
 
+        if (ImGui::Checkbox(CONCAT("Keep state when disabled##_tetrademod_suspend_", _this->name), &_this->suspendOnDisable)) {
+            config.acquire();
+            config.conf[_this->name]["suspend_on_disable"] = _this->suspendOnDisable;
+            config.release(true);
+        }
+
         if(!_this->enabled) {
             style::beginDisabled();
         }
 
+        bool wb = _this->wideband;
+        if (ImGui::Checkbox(CONCAT("Wideband##_tetrademod_wb_", _this->name), &wb)) {
+            _this->setWideband(wb);
+        }
+        bool idle = _this->idleSaving;
+        if (ImGui::Checkbox(CONCAT("Sleep while unsynced##_tetrademod_idle_", _this->name), &idle)) {
+            _this->setIdleSaving(idle);
+        }
+        bool list = _this->listDecoding;
+        if (ImGui::Checkbox(CONCAT("Retry failed blocks (list decoding)##_tetrademod_list_", _this->name), &list)) {
+            _this->setListDecoding(list);
+        }
+        bool fixedPoint = _this->fixedPointDemod;
+        if (ImGui::Checkbox(CONCAT("Fixed-point demodulator##_tetrademod_fixed_", _this->name), &fixedPoint)) {
+            _this->setFixedPointDemod(fixedPoint);
+        }
+        bool pipelined = _this->pipelinedMac;
+        if (ImGui::Checkbox(CONCAT("Upper MAC on its own thread##_tetrademod_pipe_", _this->name), &pipelined)) {
+            _this->setPipelinedMac(pipelined);
+        }
+        bool ksAhead = _this->keystreamAhead;
+        if (ImGui::Checkbox(CONCAT("Make voice keystream ahead##_tetrademod_ks_", _this->name), &ksAhead)) {
+            _this->setKeystreamAhead(ksAhead);
+        }
+        if(!_this->wideband) {
+            //Wideband has "Worker threads" for the same
+            bool single = _this->singleThreadChain;
+            if (ImGui::Checkbox(CONCAT("Run the chain on one thread##_tetrademod_single_", _this->name), &single)) {
+                _this->setSingleThreadChain(single);
+            }
+        }
+        _this->drawAudioMenu(menuWidth);
+        if(_this->wideband) {
+            _this->drawWidebandMenu(menuWidth);
+            _this->drawMetricsMenu(menuWidth);
+            if(!_this->enabled) {
+                style::endDisabled();
+            }
+            return;
+        }
+
         ImGui::Text("Signal constellation: ");
         ImGui::SetNextItemWidth(menuWidth);
+        //The next frame is only taken because this one is drawn
+        _this->symbolExtractor.requestConstellation();
         _this->constDiag.draw();
 
         float avg = 1.0f - _this->symbolExtractor.standarderr;
@@ -214,7 +1413,11 @@ private:
         ImGui::SigQualityMeter(avg, 0.5f, 1.0f);
         ImGui::BoxIndicator(ImGui::GetFontSize()*2, _this->symbolExtractor.sync ? IM_COL32(5, 230, 5, 255) : IM_COL32(230, 5, 5, 255));
         ImGui::SameLine();
-        ImGui::Text(" Sync");
+        ImGui::Text(" Sync%s", _this->mainDemodulator.isIdle() ? " (asleep)" : "");
+        if (_this->decoder_mode == 0 && _this->osmotetradecoder.getSnrBursts()) {
+            ImGui::SameLine();
+            ImGui::Text("  Burst SNR: %.1f dB", _this->osmotetradecoder.getLastSnr());
+        }
 
         ImGui::BeginGroup();
         ImGui::Columns(2, CONCAT("TetraModeColumns##_", _this->name), false);
@@ -239,15 +1442,18 @@ private:
             if(dec_st != 2) {
                 style::beginDisabled();
             }
+            //One consistent copy per frame, the decoder goes on writing its own
+            struct tetra_display_state ds;
+            _this->osmotetradecoder.getDisplayState(&ds);
             ImGui::Text("Hyperframe: "); ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%05d", _this->osmotetradecoder.getCurrHyperframe()); ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%05d", ds.cell.curr_hyperframe); ImGui::SameLine();
             ImGui::Text(" | Multiframe: "); ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%02d", _this->osmotetradecoder.getCurrMultiframe()); ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%02d", ds.curr_multiframe); ImGui::SameLine();
             ImGui::Text("| Frame: "); ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%02d", _this->osmotetradecoder.getCurrFrame());
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%02d", ds.curr_frame);
             ImGui::Text("Timeslots: ");
             for(int i = 0; i < 4; i++) {
-                switch(_this->osmotetradecoder.getTimeslotContent(i)) {
+                switch(ds.timeslot_content[i]) {
                     case 0:
                         ImGui::SameLine();
                         ImGui::TextColored(ImVec4(0.8, 0.8, 0.8, 1.0), "   UL  ");
@@ -270,7 +1476,7 @@ private:
                         break;
                 }
             }
-            int crc_failed = _this->osmotetradecoder.getLastCrcFail();
+            int crc_failed = ds.last_crc_fail;
             if(crc_failed) {
                 ImGui::BoxIndicator(ImGui::GetFontSize()*2, IM_COL32(230, 5, 5, 255));
                 ImGui::SameLine();
@@ -283,49 +1489,226 @@ private:
                 ImGui::Text(" CRC: "); ImGui::SameLine();
                 ImGui::TextColored(ImVec4(0.05, 0.95, 0.05, 1.0), "PASS");
             }
-            int dl_usg = _this->osmotetradecoder.getDlUsage();
-            int ul_usg = _this->osmotetradecoder.getUlUsage();
+            int dl_usg = ds.dl_usage;
+            int ul_usg = ds.ul_usage;
             ImGui::Text("DL:");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%7.3f", ((float)_this->osmotetradecoder.getDlFreq()/1000000.0f));ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%7.3f", ((float)ds.cell.dl_freq/1000000.0f));ImGui::SameLine();
             ImGui::Text(" MHz ");ImGui::SameLine();
             ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), (dl_usg == 0 ? "Unalloc" : (dl_usg == 1 ? "Assigned ctl" : (dl_usg == 2 ? "Common ctl" : (dl_usg == 3 ? "Reserved" : "Traffic")))));
             ImGui::Text("UL:");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%7.3f", ((float)_this->osmotetradecoder.getUlFreq()/1000000.0f));ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%7.3f", ((float)ds.cell.ul_freq/1000000.0f));ImGui::SameLine();
             ImGui::Text(" MHz ");ImGui::SameLine();
             ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), (ul_usg == 0 ? "Unalloc" : "Traffic"));
             ImGui::Text("Access1: ");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%c", _this->osmotetradecoder.getAccess1Code());ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%c", ds.access1_code);ImGui::SameLine();
             ImGui::Text("/");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%d", _this->osmotetradecoder.getAccess1());ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%d", ds.access1);ImGui::SameLine();
             ImGui::Text("| Access2: ");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%c", _this->osmotetradecoder.getAccess2Code());ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%c", ds.access2_code);ImGui::SameLine();
             ImGui::Text("/");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%d", _this->osmotetradecoder.getAccess2());
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%d", ds.access2);
             ImGui::Text("MCC: ");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%03d", _this->osmotetradecoder.getMcc());ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%03d", ds.mcc);ImGui::SameLine();
             ImGui::Text("| MNC: ");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%03d", _this->osmotetradecoder.getMnc());ImGui::SameLine();
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "%03d", ds.mnc);ImGui::SameLine();
             ImGui::Text("| CC: ");ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "0x%02x", _this->osmotetradecoder.getCc());
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "0x%02x", ds.cc);
             ImVec4 on_color = ImVec4(0.05, 0.95, 0.05, 1.0);
             ImVec4 off_color = ImVec4(0.95, 0.05, 0.05, 1.0);
-            ImGui::TextColored(_this->osmotetradecoder.getAdvancedLink() ? on_color : off_color, "Adv. link  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getAirEncryption() ? on_color : off_color, "Encryption  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getSndcpData() ? on_color : off_color, "SNDCP");
-            ImGui::TextColored(_this->osmotetradecoder.getCircuitData() ? on_color : off_color, "Circuit data  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getVoiceService() ? on_color : off_color, "Voice  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getNormalMode() ? on_color : off_color, "Normal mode");
-            ImGui::TextColored(_this->osmotetradecoder.getMigrationSupported() ? on_color : off_color, "Migration  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getNeverMinimumMode() ? on_color : off_color, "Never min mode  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getPriorityCell() ? on_color : off_color, "Priority cell");
-            ImGui::TextColored(_this->osmotetradecoder.getDeregMandatory() ? on_color : off_color, "Dereg req.  ");ImGui::SameLine();
-            ImGui::TextColored(_this->osmotetradecoder.getRegMandatory() ? on_color : off_color, "Reg req.");
+            ImGui::TextColored(ds.cell.advanced_link ? on_color : off_color, "Adv. link  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.air_encryption ? on_color : off_color, "Encryption  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.sndcp_data ? on_color : off_color, "SNDCP");
+            ImGui::TextColored(ds.cell.circuit_data ? on_color : off_color, "Circuit data  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.voice_service ? on_color : off_color, "Voice  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.normal_mode ? on_color : off_color, "Normal mode");
+            ImGui::TextColored(ds.cell.migration_supported ? on_color : off_color, "Migration  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.never_minimum_mode ? on_color : off_color, "Never min mode  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.priority_cell ? on_color : off_color, "Priority cell");
+            ImGui::TextColored(ds.cell.dereg_mandatory ? on_color : off_color, "Dereg req.  ");ImGui::SameLine();
+            ImGui::TextColored(ds.cell.reg_mandatory ? on_color : off_color, "Reg req.");
             if(crc_failed) {
                 style::endDisabled();
             }
             if(dec_st != 2) {
                 style::endDisabled();
             }
+
+            //The keystore is shared by every instance, the decoders switch over on their next PDU
+            ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Keys ").x);
+            if (ImGui::InputText(CONCAT("Keys##_tetrademod_keyfile_", _this->name), _this->keyfile, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["keyfile"] = _this->keyfile;
+                config.release(true);
+            }
+            if (ImGui::Button(CONCAT("Reload keys##_tetrademod_keyreload_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->loadKeystore();
+            }
+            if (_this->keystoreStatus < 0) {
+                ImGui::TextColored(ImVec4(1.0, 0.0, 0.0, 1.0), "Could not load the keys");
+            }
+
+            //SNDCP packets to a pcapng file, the MAC blocks can go along as GSMTAP
+            bool capActive = _this->capture.isOpen();
+            if(capActive) { style::beginDisabled(); }
+            ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Capture ").x);
+            if (ImGui::InputText(CONCAT("Capture##_tetrademod_cap_path_", _this->name), _this->capturePath, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["capture_path"] = _this->capturePath;
+                config.release(true);
+            }
+            if (ImGui::Checkbox(CONCAT("MAC blocks as GSMTAP##_tetrademod_cap_gsmtap_", _this->name), &_this->captureGsmtap)) {
+                config.acquire();
+                config.conf[_this->name]["capture_gsmtap"] = _this->captureGsmtap;
+                config.release(true);
+            }
+            if(capActive) { style::endDisabled(); }
+            if (capActive && ImGui::Button(CONCAT("Stop capture##_tetrademod_cap_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->stopCapture();
+            } else if (!capActive && ImGui::Button(CONCAT("Start capture##_tetrademod_cap_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->startCapture();
+            }
+            if (capActive) {
+                ImGui::Text("Packets: %llu (%llu dropped)", (unsigned long long)_this->capture.getPackets(), (unsigned long long)_this->capture.getDropped());
+            }
+
+            //Every call to a FLAC file of its own in the directory
+            bool recActive = _this->recorder.isRunning();
+            if(recActive) { style::beginDisabled(); }
+            ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Record to ").x);
+            if (ImGui::InputText(CONCAT("Record to##_tetrademod_rec_dir_", _this->name), _this->recordDir, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["record_dir"] = _this->recordDir;
+                config.release(true);
+            }
+            if(recActive) { style::endDisabled(); }
+            if (recActive && ImGui::Button(CONCAT("Stop recording##_tetrademod_rec_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->stopRecording();
+                config.acquire();
+                config.conf[_this->name]["recording"] = false;
+                config.release(true);
+            } else if (!recActive && ImGui::Button(CONCAT("Start recording##_tetrademod_rec_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->startRecording();
+                config.acquire();
+                config.conf[_this->name]["recording"] = _this->recorder.isRunning();
+                config.release(true);
+            }
+            if (recActive) {
+                ImGui::Text("Calls: %llu (%d open)", (unsigned long long)_this->recorder.getCalls(), _this->recorder.getOpen());
+                ImGui::Text("Written: %.1f MB (%llu frames dropped)", (double)_this->recorder.getBytes() / 1e6, (unsigned long long)_this->recorder.getDropped());
+                std::string last = _this->recorder.getLastPath();
+                if (!last.empty()) { ImGui::TextWrapped("Last: %s", last.c_str()); }
+            }
+
+            //The CMCE and MM PDUs to an SQLite database, a transaction per batch
+            bool dbActive = _this->database.isOpen();
+            bool dbAvailable = dsp::EventDatabase::isAvailable();
+            if(dbActive || !dbAvailable) { style::beginDisabled(); }
+            ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Database ").x);
+            if (ImGui::InputText(CONCAT("Database##_tetrademod_db_path_", _this->name), _this->databasePath, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["db_path"] = _this->databasePath;
+                config.release(true);
+            }
+            ImGui::Text("Batch (rows): ");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputInt(CONCAT("##_tetrademod_db_batch_", _this->name), &(_this->dbBatchRows), 64, 512)) {
+                _this->dbBatchRows = std::max<int>(_this->dbBatchRows, 1);
+                config.acquire();
+                config.conf[_this->name]["db_batch_rows"] = _this->dbBatchRows;
+                config.release(true);
+            }
+            if(dbActive || !dbAvailable) { style::endDisabled(); }
+            //The latency can be changed while it runs
+            if(!dbAvailable) { style::beginDisabled(); }
+            ImGui::Text("Latency (ms): ");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputInt(CONCAT("##_tetrademod_db_flush_", _this->name), &(_this->dbFlushMs), 100, 1000)) {
+                _this->dbFlushMs = std::clamp<int>(_this->dbFlushMs, 0, EVENT_DATABASE_MAX_FLUSH_MS);
+                _this->database.setFlushInterval(_this->dbFlushMs);
+                config.acquire();
+                config.conf[_this->name]["db_flush_ms"] = _this->dbFlushMs;
+                config.release(true);
+            }
+            if (dbActive && ImGui::Button(CONCAT("Stop database##_tetrademod_db_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->stopDatabase();
+                config.acquire();
+                config.conf[_this->name]["db_writing"] = false;
+                config.release(true);
+            } else if (!dbActive && ImGui::Button(CONCAT("Start database##_tetrademod_db_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->startDatabase();
+                config.acquire();
+                config.conf[_this->name]["db_writing"] = _this->database.isOpen();
+                config.release(true);
+            }
+            if(!dbAvailable) { style::endDisabled(); }
+            if (!dbAvailable) {
+                ImGui::TextDisabled("Needs a build with OPT_TETRA_SQLITE");
+            } else if (dbActive) {
+                ImGui::Text("Events: %llu (%llu dropped, %llu failed)", (unsigned long long)_this->database.getRows(),
+                            (unsigned long long)_this->database.getDropped(), (unsigned long long)_this->database.getErrors());
+            }
+
+            //Every locked burst to an archive, which replays without the DSP
+            bool arActive = (bool)_this->burstArchive;
+            if(arActive) { style::beginDisabled(); }
+            ImGui::SetNextItemWidth(menuWidth - ImGui::CalcTextSize("Archive ").x);
+            if (ImGui::InputText(CONCAT("Archive##_tetrademod_ar_path_", _this->name), _this->archivePath, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["archive_path"] = _this->archivePath;
+                config.release(true);
+            }
+            if(arActive) { style::endDisabled(); }
+            if (arActive && ImGui::Button(CONCAT("Stop archive##_tetrademod_ar_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->stopArchive();
+            } else if (!arActive && ImGui::Button(CONCAT("Start archive##_tetrademod_ar_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->startArchive();
+            }
+            if (_this->burstArchive) {
+                ImGui::Text("Bursts: %llu", (unsigned long long)_this->burstArchive->records);
+            }
+
+            //Decoded blocks as GSMTAP over UDP, batched up to the flush interval
+            bool gsmtapActive = _this->gsmtap.isOpen();
+            if(gsmtapActive) { style::beginDisabled(); }
+            if (ImGui::InputText(CONCAT("GSMTAP ##_tetrademod_gsmtap_host_", _this->name), _this->gsmtapHost, 1023)) {
+                config.acquire();
+                config.conf[_this->name]["gsmtap_host"] = _this->gsmtapHost;
+                config.release(true);
+            }
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputInt(CONCAT("##_tetrademod_gsmtap_port_", _this->name), &(_this->gsmtapPort), 0, 0)) {
+                config.acquire();
+                config.conf[_this->name]["gsmtap_port"] = _this->gsmtapPort;
+                config.release(true);
+            }
+            if(gsmtapActive) { style::endDisabled(); }
+            ImGui::Text("Flush (ms): ");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::InputInt(CONCAT("##_tetrademod_gsmtap_flush_", _this->name), &(_this->gsmtapFlushMs), 10, 100)) {
+                _this->gsmtapFlushMs = std::clamp<int>(_this->gsmtapFlushMs, 0, GSMTAP_MAX_FLUSH_MS);
+                _this->gsmtap.setFlushInterval(_this->gsmtapFlushMs);
+                config.acquire();
+                config.conf[_this->name]["gsmtap_flush_ms"] = _this->gsmtapFlushMs;
+                config.release(true);
+            }
+            if (gsmtapActive && ImGui::Button(CONCAT("GSMTAP stop##_tetrademod_gsmtap_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->stopGsmtap();
+                config.acquire();
+                config.conf[_this->name]["gsmtap_sending"] = false;
+                config.release(true);
+            } else if (!gsmtapActive && ImGui::Button(CONCAT("GSMTAP start##_tetrademod_gsmtap_", _this->name), ImVec2(menuWidth, 0))) {
+                _this->startGsmtap();
+                config.acquire();
+                config.conf[_this->name]["gsmtap_sending"] = true;
+                config.release(true);
+            }
+            if (gsmtapActive) {
+                ImGui::Text("Sent: %llu (%llu failed)", (unsigned long long)_this->gsmtap.getSent(), (unsigned long long)_this->gsmtap.getErrors());
+            }
         } else {
             //NETWORK SYM STREAMING
             ImGui::BoxIndicator(menuWidth, _this->tsfound ? IM_COL32(5, 230, 5, 255) : IM_COL32(230, 5, 5, 255));
@@ -346,6 +1729,16 @@ private:
                 config.conf[_this->name]["port"] = _this->port;
                 config.release(true);
             }
+            //Raw is what tetra-rx reads, the framed formats are for tetra_cli -f netsyms on the far end. I/Q and phase
+            //are the symbols ahead of the slicer, for a far end that decodes with soft bits
+            ImGui::Text("Format: ");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            if (ImGui::Combo(CONCAT("##_tetrademod_net_format_", _this->name), &_this->netFormat, "Raw bits\0Packed, framed\0Dibits, framed\0I/Q int8, framed\0Phase int8, framed\0")) {
+                config.acquire();
+                config.conf[_this->name]["net_format"] = _this->netFormat;
+                config.release(true);
+            }
             if(netActive) { style::endDisabled(); }
 
             if (netActive && ImGui::Button(CONCAT("Net stop##_tetrademod_net_stop_", _this->name), ImVec2(menuWidth, 0))) {
@@ -364,58 +1757,589 @@ private:
             ImGui::SameLine();
             if (netActive) {
                 ImGui::TextColored(ImVec4(0.0, 1.0, 0.0, 1.0), "Sending");
+                if (_this->netFormat != dsp::NETSYMS_FORMAT_RAW) {
+                    ImGui::Text("Packets: %llu", (unsigned long long)_this->netPackets);
+                }
             } else {
                 ImGui::TextUnformatted("Idle");
             }
         }
+
+        _this->drawMetricsMenu(menuWidth);
+        _this->drawProfileMenu();
         if(!_this->enabled) {
             style::endDisabled();
         }
     }
 
-    static void _constDiagSinkHandler(dsp::complex_t* data, int count, void* ctx) {
+    //Prometheus endpoint of the process, shared by the instances: any of them starts and stops it for all
+    void drawMetricsMenu(float menuWidth) {
+        dsp::MetricsServer& server = dsp::MetricsServer::get();
+        bool serving = server.isRunning();
+        if(serving) { style::beginDisabled(); }
+        if (ImGui::InputText(CONCAT("Metrics ##_tetrademod_metrics_host_", name), metricsHost, 1023)) {
+            config.acquire();
+            config.conf[name]["metrics_host"] = metricsHost;
+            config.release(true);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_metrics_port_", name), &metricsPort, 0, 0)) {
+            config.acquire();
+            config.conf[name]["metrics_port"] = metricsPort;
+            config.release(true);
+        }
+        if(serving) { style::endDisabled(); }
+        if (serving && ImGui::Button(CONCAT("Metrics stop##_tetrademod_metrics_", name), ImVec2(menuWidth, 0))) {
+            server.stop();
+            config.acquire();
+            config.conf[name]["metrics_serving"] = false;
+            config.release(true);
+        } else if (!serving && ImGui::Button(CONCAT("Metrics start##_tetrademod_metrics_", name), ImVec2(menuWidth, 0))) {
+            startMetrics();
+            config.acquire();
+            config.conf[name]["metrics_serving"] = true;
+            config.release(true);
+        }
+        if (serving) {
+            ImGui::Text("Serving /metrics on port %d, %llu scrapes", server.getPort(), (unsigned long long)server.getScrapes());
+        }
+    }
+
+    //Decode nodes (tetra_cli -N) the pooled wideband chains are spread over
+    void drawClusterMenu(float menuWidth) {
+        bool serving = cluster.isRunning();
+        if(serving) { style::beginDisabled(); }
+        if (ImGui::InputText(CONCAT("Cluster ##_tetrademod_cluster_host_", name), clusterHost, 1023)) {
+            config.acquire();
+            config.conf[name]["cluster_host"] = clusterHost;
+            config.release(true);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_cluster_port_", name), &clusterPort, 0, 0)) {
+            config.acquire();
+            config.conf[name]["cluster_port"] = clusterPort;
+            config.release(true);
+        }
+        //Nodes give it with -T, the others are refused
+        if (ImGui::InputText(CONCAT("Secret##_tetrademod_cluster_secret_", name), clusterSecret, 127,
+                             ImGuiInputTextFlags_Password | ImGuiInputTextFlags_CharsNoBlank)) {
+            config.acquire();
+            config.conf[name]["cluster_secret"] = clusterSecret;
+            config.release(true);
+        }
+        if(serving) { style::endDisabled(); }
+        if (serving && ImGui::Button(CONCAT("Cluster stop##_tetrademod_cluster_", name), ImVec2(menuWidth, 0))) {
+            cluster.stop();
+            config.acquire();
+            config.conf[name]["cluster_serving"] = false;
+            config.release(true);
+        } else if (!serving && ImGui::Button(CONCAT("Cluster start##_tetrademod_cluster_", name), ImVec2(menuWidth, 0))) {
+            startCluster();
+            config.acquire();
+            config.conf[name]["cluster_serving"] = true;
+            config.release(true);
+        }
+        if (!serving) { return; }
+        if (!wbPool) {
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "Only pooled chains are offloaded, set worker threads");
+        }
+        ImGui::Text("Channels on nodes: %d, moved: %llu", cluster.getRemoteWork(), (unsigned long long)cluster.getMoves());
+        std::vector<dsp::ClusterCoordinator::NodeInfo> nodes = cluster.getNodes();
+        if (!nodes.empty() && ImGui::BeginTable(CONCAT("##_tetrademod_cluster_table_", name), 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Node");
+            ImGui::TableSetupColumn("Decoders");
+            ImGui::TableSetupColumn("Load");
+            ImGui::TableHeadersRow();
+            for (const auto& n : nodes) {
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%s (%s)", n.name.c_str(), n.host.c_str());
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%d/%d", n.used, n.chains);
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.0f%%", 100.0 * n.busy / std::max<int>(n.cores, 1));
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    void drawAudioMenu(float menuWidth) {
+        bool ll = lowLatency;
+        if (ImGui::Checkbox(CONCAT("Low latency audio##_tetrademod_ll_", name), &ll)) {
+            setLowLatency(ll);
+        }
+        if(!lowLatency) { return; }
+        ImGui::Text("Jitter buffer: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::SliderInt(CONCAT("##_tetrademod_jitter_", name), &jitterMs, 0, VOICE_PLAYOUT_MAX_JITTER_MS, "%d ms")) {
+            playout.setJitterBuffer(jitterMs);
+            config.acquire();
+            config.conf[name]["jitter_ms"] = jitterMs;
+            config.release(true);
+        }
+        float latency = playout.getLatency();
+        if(latency < 0.0f) {
+            ImGui::Text("Audio delay: -");
+        } else {
+            ImGui::Text("Audio delay: %.0f ms (%.0f ms buffered)", latency, playout.getBuffered());
+        }
+    }
+
+    //Counters of the decoder stages, for all instances together. Times are shown as the share of one core they take
+    void drawProfileMenu() {
+        if (!tetra_prof_enabled()) { return; }
+        auto now = std::chrono::steady_clock::now();
+        if (now - profTime >= std::chrono::milliseconds(PROFILE_RATE_MS)) {
+            uint64_t cur[TETRA_PROF_NR];
+            tetra_prof_snapshot(cur);
+            double secs = std::chrono::duration<double>(now - profTime).count();
+            for (int i = 0; i < TETRA_PROF_NR; i++) {
+                profRate[i] = (cur[i] - profLast[i]) / secs;
+                profLast[i] = cur[i];
+            }
+            profTime = now;
+        }
+        if (!ImGui::CollapsingHeader(CONCAT("Stage counters##_tetrademod_prof_", name))) { return; }
+        if (ImGui::BeginTable(CONCAT("##_tetrademod_prof_table_", name), 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            for (int i = 0; i < TETRA_PROF_NR; i++) {
+                enum tetra_prof_counter c = (enum tetra_prof_counter)i;
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(tetra_prof_name(c));
+                ImGui::TableSetColumnIndex(1);
+                if (tetra_prof_is_time(c)) {
+                    ImGui::Text("%.1f s", profLast[i] / 1e9);
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%.1f %%", profRate[i] / 1e7);
+                } else {
+                    ImGui::Text("%llu", (unsigned long long)profLast[i]);
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%.0f/s", profRate[i]);
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    void drawWidebandMenu(float menuWidth) {
+        //The chains are the scan's while it runs
+        bool scanLocked = scanning;
+        if(scanLocked) { style::beginDisabled(); }
+        int chCount = wbChannelCount;
+        ImGui::Text("Channels: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_wb_channels_", name), &chCount, 2, 16)) {
+            chCount = std::clamp<int>(chCount & ~1, 2, WIDEBAND_MAX_CHANNELS);
+            if(chCount != wbChannelCount) {
+                setWidebandChannelCount(chCount);
+            }
+        }
+        ImGui::Text("Bandwidth: %.3f MHz", (float)(wbChannelCount * WIDEBAND_CHANNEL_SPACING) / 1000000.0f);
+
+        //0 keeps one thread per block and carrier, otherwise all carriers share this many workers
+        int threads = wbThreads;
+        ImGui::Text("Worker threads: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_wb_threads_", name), &threads, 1, 4)) {
+            threads = std::clamp<int>(threads, 0, WIDEBAND_MAX_THREADS);
+            if(threads != wbThreads) {
+                setWidebandThreads(threads);
+            }
+        }
+
+        //Spare chains that follow the traffic channels the selected carriers allocate on other carriers
+        int followers = wbFollowers;
+        ImGui::Text("Call followers: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_wb_followers_", name), &followers, 1, 4)) {
+            followers = std::clamp<int>(followers, 0, WIDEBAND_MAX_FOLLOWERS);
+            if(followers != wbFollowers) {
+                setWidebandFollowers(followers);
+            }
+        }
+        if(wbFollowers > 0) {
+            ImGui::Text("Calls missed: %u", trafficScheduler.getMissed());
+        }
+
+        //Channelizer and demodulator loops of every carrier on the GPU, the channel count has to be a power of two
+        if(!wbGpuAvailable) { style::beginDisabled(); }
+        bool gpu = wbGpu;
+        if (ImGui::Checkbox(CONCAT("Demodulate on the GPU##_tetrademod_wb_gpu_", name), &gpu)) {
+            setWidebandGpu(gpu);
+        }
+        if(!wbGpuAvailable) { style::endDisabled(); }
+        ImGui::TextDisabled("%s", wbGpuDevice.c_str());
+        if(wbGpuDemod && !wbGpuDemod->getError().empty()) {
+            ImGui::TextColored(ImVec4(0.95, 0.05, 0.05, 1.0), "GPU failed: %s", wbGpuDemod->getError().c_str());
+        }
+        else if(wbGpu && wbGpuAvailable && (enabled || suspended) && !wbGpuDemod) {
+            ImGui::TextColored(ImVec4(0.95, 0.95, 0.05, 1.0), "Running on the CPU, see the log");
+        }
+        if(scanLocked) { style::endDisabled(); }
+        drawClusterMenu(menuWidth);
+
+        if (!scanning && ImGui::BeginTable(CONCAT("##_tetrademod_wb_table_", name), 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 300))) {
+            ImGui::TableSetupColumn("Offset");
+            ImGui::TableSetupColumn("Sync");
+            ImGui::TableSetupColumn("Decoder");
+            ImGui::TableSetupColumn("Cell");
+            ImGui::TableSetupColumn("Audio");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+            for(int bin = -(wbChannelCount / 2); bin < wbChannelCount - (wbChannelCount / 2); bin++) {
+                WidebandChannel* ch = NULL;
+                for(auto& c : wbChannels) {
+                    if(c->follower < 0 && c->bin == bin) { ch = c.get(); }
+                }
+                bool active = std::find(wbBins.begin(), wbBins.end(), bin) != wbBins.end();
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                if (ImGui::Checkbox(CONCAT(std::to_string(bin * WIDEBAND_CHANNEL_SPACING / 1000) + " kHz##_tetrademod_wb_bin_", name + std::to_string(bin)), &active)) {
+                    toggleWidebandBin(bin);
+                }
+                if(!ch) { continue; }
+                drawWidebandChannelState(ch);
+                ImGui::TableSetColumnIndex(4);
+                if (ImGui::RadioButton(CONCAT("##_tetrademod_wb_audio_", name + std::to_string(bin)), wbAudioBin == bin)) {
+                    std::lock_guard<std::mutex> lck(wbAudioMtx);
+                    wbAudioBin = bin;
+                    for(auto& c : wbChannels) {
+                        c->decoder.setAudioWanted(getAudioBin(c.get()) == wbAudioBin);
+                    }
+                }
+            }
+            //The followers that carry a call, their audio goes with the carrier that allocated it
+            for(WidebandChannel* ch : wbFollowerChannels) {
+                auto& f = trafficScheduler.getFollower(ch->follower);
+                if(!f.assigned) { continue; }
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%d kHz (call of %d kHz)", f.bin * WIDEBAND_CHANNEL_SPACING / 1000, f.ctrlBin * WIDEBAND_CHANNEL_SPACING / 1000);
+                drawWidebandChannelState(ch);
+            }
+            ImGui::EndTable();
+        }
+        drawScanMenu(menuWidth);
+    }
+
+    void drawScanMenu(float menuWidth) {
+        //The worker is through the band
+        if(scanning && !scanRunning) { stopScan(); }
+        if (!ImGui::CollapsingHeader(CONCAT("Scan##_tetrademod_scan_", name))) { return; }
+        bool scanLocked = scanning;
+        if(scanLocked) { style::beginDisabled(); }
+        bool changed = false;
+        ImGui::Text("Band: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_scan_band_", name), &scanBand, 1, 1)) {
+            scanBand = std::clamp<int>(scanBand, 0, 15);
+            changed = true;
+        }
+        ImGui::Text("Carriers: ");
+        ImGui::SameLine();
+        float carrierWidth = (menuWidth - ImGui::GetCursorPosX() - ImGui::GetStyle().ItemSpacing.x) / 2.0f;
+        ImGui::SetNextItemWidth(carrierWidth);
+        if (ImGui::InputInt(CONCAT("##_tetrademod_scan_first_", name), &scanFirst, 0, 0)) {
+            scanFirst = std::clamp<int>(scanFirst, 0, 4095);
+            changed = true;
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(carrierWidth);
+        if (ImGui::InputInt(CONCAT("##_tetrademod_scan_last_", name), &scanLast, 0, 0)) {
+            scanLast = std::clamp<int>(scanLast, 0, 4095);
+            changed = true;
+        }
+        ImGui::Text("Offset: ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::Combo(CONCAT("##_tetrademod_scan_offset_", name), &scanOffset, "0 kHz\0+6.25 kHz\0-6.25 kHz\0+12.5 kHz\0")) {
+            changed = true;
+        }
+        ImGui::Text("Dwell (ms): ");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+        if (ImGui::InputInt(CONCAT("##_tetrademod_scan_dwell_", name), &scanDwellMs, 500, 1000)) {
+            scanDwellMs = std::clamp<int>(scanDwellMs, CHANNEL_SCANNER_DEFAULT_REJECT_MS, 60000);
+            changed = true;
+        }
+        if(changed) { saveScanConfig(); }
+        ImGui::Text("%.4f - %.4f MHz", tetra_dl_carrier_hz(scanBand, std::min(scanFirst, scanLast), scanOffset) / 1e6,
+                    tetra_dl_carrier_hz(scanBand, std::max(scanFirst, scanLast), scanOffset) / 1e6);
+        if(scanLocked) { style::endDisabled(); }
+
+        if (scanning && ImGui::Button(CONCAT("Stop scan##_tetrademod_scan_btn_", name), ImVec2(menuWidth, 0))) {
+            stopScan();
+        } else if (!scanning && ImGui::Button(CONCAT("Start scan##_tetrademod_scan_btn_", name), ImVec2(menuWidth, 0))) {
+            startScan();
+        }
+
+        std::lock_guard<std::mutex> lck(scanMtx);
+        const auto& channels = scanner.getChannels();
+        if(channels.empty()) { return; }
+        ImGui::Text("Scanned %d/%d in %d windows, %d cells", scanner.getScanned(), (int)channels.size(), scanner.getWindowCount(), scanner.getCells());
+        //Only what has a carrier on it, and what is being listened to
+        if (ImGui::BeginTable(CONCAT("##_tetrademod_scan_table_", name), 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0, 300))) {
+            ImGui::TableSetupColumn("Frequency");
+            ImGui::TableSetupColumn("State");
+            ImGui::TableSetupColumn("Cell");
+            ImGui::TableSetupColumn("Main carrier");
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableHeadersRow();
+            for(const auto& ch : channels) {
+                if(ch.state == dsp::ChannelScanner::SCAN_PENDING || ch.state == dsp::ChannelScanner::SCAN_EMPTY) { continue; }
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%.4f MHz", (ch.hz + ch.offset) / 1e6);
+                ImGui::TableSetColumnIndex(1);
+                ImGui::TextUnformatted(dsp::ChannelScanner::stateName(ch.state));
+                ImGui::TableSetColumnIndex(2);
+                if(ch.cell.syncs) {
+                    ImGui::Text("%03d/%03d/0x%02x", ch.cell.mcc, ch.cell.mnc, ch.cell.cc);
+                }
+                ImGui::TableSetColumnIndex(3);
+                if(ch.cell.sysinfos) {
+                    ImGui::Text("DL %.4f / UL %.4f", ch.cell.dlHz / 1e6, ch.cell.ulHz / 1e6);
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    //Sync, decoder and cell columns of a channel table row
+    void drawWidebandChannelState(WidebandChannel* ch) {
+        if(ch->offloaded) {
+            ImGui::TableSetColumnIndex(2);
+            ImGui::TextColored(ImVec4(0.05, 0.95, 0.95, 1.0), "On a node");
+            return;
+        }
+        ImGui::TableSetColumnIndex(1);
+        ImGui::TextColored(ch->symbolExtractor.sync ? ImVec4(0.05, 0.95, 0.05, 1.0) : ImVec4(0.95, 0.05, 0.05, 1.0), ch->symbolExtractor.sync ? "Yes" : (ch->isIdle() ? "Asleep" : "No"));
+        ImGui::TableSetColumnIndex(2);
+        int dec_st = ch->decoder.getRxState();
+        ImGui::TextColored((dec_st == 0) ? ImVec4(0.95, 0.05, 0.05, 1.0) : ((dec_st == 2) ? ImVec4(0.05, 0.95, 0.05, 1.0) : ImVec4(0.95, 0.95, 0.05, 1.0)), (dec_st == 0) ? "Unlocked" : ((dec_st == 2) ? "Locked" : "Know start"));
+        ImGui::TableSetColumnIndex(3);
+        if(dec_st == 2) {
+            struct tetra_display_state ds;
+            ch->decoder.getDisplayState(&ds);
+            ImGui::Text("%03d/%03d/0x%02x", ds.mcc, ds.mnc, ds.cc);
+        }
+    }
+
+    //Bin whose audio the channel carries: its own, or for a follower the control carrier of its call. INT_MIN if none
+    int getAudioBin(WidebandChannel* ch) {
+        if(ch->follower < 0) { return ch->bin; }
+        auto& f = trafficScheduler.getFollower(ch->follower);
+        return f.assigned ? f.ctrlBin.load() : INT_MIN;
+    }
+
+    static void _wbAudioHandler(float* data, int count, void* ctx) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        TetraDemodulatorModule* _this = ch->parent;
+        std::lock_guard<std::mutex> lck(_this->wbAudioMtx);
+        if(_this->wbAudioBin != _this->getAudioBin(ch)) { return; }
+        memcpy(_this->wbAudioStream.writeBuf, data, count * sizeof(float));
+        _this->wbAudioStream.swap(count);
+    }
+
+    static void _voiceFrameHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        _this->playout.pushFrames(frames, count);
+    }
+
+    static void _wbVoiceFrameHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        TetraDemodulatorModule* _this = ch->parent;
+        std::lock_guard<std::mutex> lck(_this->wbAudioMtx);
+        if(_this->wbAudioBin != _this->getAudioBin(ch)) { return; }
+        _this->playout.pushFrames(frames, count);
+    }
+
+    static void _l3Handler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        if(_this->capture.isOpen()) { dsp::PacketCapture::l3Handler(&_this->capture, time, l3, bits, len); }
+        _this->recorder.handleL3(NARROWBAND_SOURCE, l3);
+        if(_this->database.isOpen()) { _this->database.handleL3(NARROWBAND_SOURCE, time, l3, _this->osmotetradecoder.getCellInfo()); }
+    }
+
+    static void _recordHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        _this->recorder.pushFrames(NARROWBAND_SOURCE, frames, count);
+    }
+
+    static void _wbRecordHandler(dsp::TetraAudioFrame* frames, int count, void* ctx) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        ch->parent->recorder.pushFrames(ch->workId(), frames, count);
+    }
+
+    static void _wbL3Handler(void* ctx, const struct tetra_tdma_time* time, const struct tetra_l3_event* l3, const uint8_t* bits, unsigned int len) {
+        WidebandChannel* ch = (WidebandChannel*)ctx;
+        TetraDemodulatorModule* _this = ch->parent;
+        if(_this->database.isOpen()) { _this->database.handleL3(ch->workId(), time, l3, ch->decoder.getCellInfo()); }
+        if(_this->recorder.isRunning()) {
+            _this->recorder.handleL3(ch->workId(), l3);
+            //The followers on the carriers this one allocates are named by its CMCE, the recorder leaves out what
+            //allocates other carriers
+            if(ch->follower < 0) {
+                for(auto fch : _this->wbFollowerChannels) {
+                    auto& f = _this->trafficScheduler.getFollower(fch->follower);
+                    if(f.assigned && f.ctrlBin == ch->bin) { _this->recorder.handleL3(fch->workId(), l3); }
+                }
+            }
+        }
+        if(_this->wbFollowers <= 0) { return; }
+        if(ch->follower < 0) {
+            _this->trafficScheduler.handleL3(ch->bin, l3);
+            return;
+        }
+        //A follower hears the D-RELEASE of its calls on the traffic channel
+        auto& f = _this->trafficScheduler.getFollower(ch->follower);
+        if(f.assigned) { _this->trafficScheduler.handleL3(f.ctrlBin, l3); }
+    }
+
+    //Called with the scheduler locked, on the thread of the decoder that heard the allocation or the release
+    static void _followerChangeHandler(int follower, bool assigned, void* ctx) {
         TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
-        dsp::complex_t* cdBuff = _this->constDiag.acquireBuffer();
-        if(count == 1024) {
-            memcpy(cdBuff, data, count * sizeof(dsp::complex_t));
+        WidebandChannel* ch = _this->wbFollowerChannels[follower];
+        {
+            std::lock_guard<std::mutex> lck(_this->wbAudioMtx);
+            ch->decoder.setAudioWanted(_this->getAudioBin(ch) == _this->wbAudioBin);
+        }
+        if(assigned) {
+            _this->recorder.setSource(ch->workId(), _this->getClusterLabel(ch), _this->trafficScheduler.getFollower(follower).hz);
+            _this->database.setSource(ch->workId(), _this->getClusterLabel(ch));
+        }
+        //Only read in pooled mode, where an idle follower is not run at all
+        ch->active = assigned;
+        //A call on a node is kept at the cell state of its control carrier
+        if(!_this->wbPool) { return; }
+        if(assigned) {
+            _this->cluster.addWork(ch->workId(), _this->getClusterLabel(ch), _this->trafficScheduler.getFollower(follower).ctrlBin + WIDEBAND_MAX_CHANNELS);
+        } else {
+            _this->cluster.removeWork(ch->workId());
+            ch->setRemote("", 0);
+        }
+    }
+
+    static void _wbChannelizerHandler(int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        std::lock_guard<std::mutex> lck(_this->wbChannelsMtx);
+        _this->wbActive.clear();
+        for(auto& ch : _this->wbChannels) {
+            if(ch->active) { _this->wbActive.push_back(ch.get()); }
         }
+        _this->wbBlockCount = count;
+        _this->wbPool->run(_this->wbActive.size(), _wbChannelJob, _this);
+    }
+
+    static void _wbChannelJob(int index, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        _this->wbActive[index]->process(_this->wbBlockCount);
+    }
+
+    static void _constDiagTapHandler(const dsp::complex_t* data, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        dsp::complex_t* cdBuff = _this->constDiag.acquireBuffer();
+        memcpy(cdBuff, data, std::min<int>(count, 1024) * sizeof(dsp::complex_t));
         _this->constDiag.releaseBuffer();
     }
 
+    static void _eventHandler(const tetra_burst_event* events, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        if(_this->capture.isOpen() && _this->captureGsmtap) { _this->capture.writeEvents(events, count); }
+        if(_this->gsmtap.isOpen()) { _this->gsmtap.write(events, count); }
+    }
+
+    static void _eventIdleHandler(void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        if(_this->gsmtap.isOpen()) { _this->gsmtap.poll(); }
+    }
+
+    //Single-thread mode: the whole narrowband chain on one block of VFO output, as WidebandChannel::process() does it
+    static void _nbChainHandler(dsp::complex_t* data, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        int n = _this->mainDemodulator.process(count, data, _this->mainDemodulator.out.writeBuf);
+        n = _this->symbolExtractor.process(n, _this->mainDemodulator.out.writeBuf, _this->symbolExtractor.out.writeBuf);
+        if(_this->nbChainNetsyms) {
+            if(n) { _demodSinkHandler(_this->symbolExtractor.out.writeBuf, n, _this); }
+            return;
+        }
+        n = _this->osmotetradecoder.process(n, _this->symbolExtractor.out.writeBuf, _this->osmotetradecoder.out.writeBuf);
+        if(n) { _this->osmotetradecoder.out.swap(n); }
+    }
+
     static void _demodSinkHandler(uint8_t* data, int count, void* ctx) {
         TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
         if(_this->conn && _this->conn->isOpen()) {
-            _this->conn->send(data, count);
-        }
-        for(int j = 0; j < count; j++) {
-            for(int i = 0; i < 44; i++) {
-                _this->tsfind_buffer[i] = _this->tsfind_buffer[i+1];
-            }
-            _this->tsfind_buffer[44] = data[j];
-            if(!memcmp(_this->tsfind_buffer, training_seq_n, sizeof(training_seq_n)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_p, sizeof(training_seq_p)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_q, sizeof(training_seq_q)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_N, sizeof(training_seq_N)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_P, sizeof(training_seq_P)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_x, sizeof(training_seq_x)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_X, sizeof(training_seq_X)) ||
-                !memcmp(_this->tsfind_buffer, training_seq_y, sizeof(training_seq_y))
-            ) {
-                _this->tsfound = true;
-                _this->symsbeforeexpire = 2048;
-            }
-            if(_this->symsbeforeexpire > 0) {
-                _this->symsbeforeexpire--;
-                if(_this->symsbeforeexpire == 0) {
-                    _this->tsfound = false;
-                }
+            if(_this->netFormat == dsp::NETSYMS_FORMAT_RAW) {
+                _this->conn->send(data, count);
+            } else if(!dsp::netsymsCarriesSymbols(_this->netFormat)) {
+                _this->netFramer.write(data, count, 1.0f - _this->symbolExtractor.standarderr, _netPacketHandler, _this);
+            }
+        }
+        for(int j = 0; j < count; j += TSFIND_CHUNK_BITS) {
+            _this->updateTsFound(&data[j], std::min<int>(count - j, TSFIND_CHUNK_BITS));
+        }
+    }
+
+    static void _netSymHandler(const dsp::complex_t* data, int count, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        if(_this->decoder_mode == 1 && _this->conn && _this->conn->isOpen()) {
+            _this->netFramer.writeSymbols(data, count, 1.0f - _this->symbolExtractor.standarderr, _netPacketHandler, _this);
+        }
+    }
+
+    static void _netPacketHandler(const uint8_t* pkt, int len, void* ctx) {
+        TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
+        _this->conn->send(pkt, len);
+        _this->netPackets++;
+    }
+
+    //Behaves like a 45-bit sliding window checked after every bit: a training sequence starting at bit s
+    //counts as found once bit s+44 has arrived, and the indicator holds for TSFIND_HOLD_BITS bits after that
+    void updateTsFound(const uint8_t* bits, int count) {
+        int total = tsfind_history + count;
+        tetra_ubit2pwords(bits, tsfind_words, tsfind_history, count);
+
+        //Only complete windows, the last few starts are searched again with the next chunk
+        int last = -1;
+        unsigned int from = 0;
+        unsigned int offset;
+        while((int)from + TSFIND_WINDOW_BITS <= total) {
+            if(tetra_train_corr_find(tsfind_words, from, total - from, TSFIND_SEQ_MASK, 0, &offset) < 0) { break; }
+            if((int)(from + offset) + TSFIND_WINDOW_BITS > total) { break; }
+            last = from + offset;
+            from = last + 1;
+        }
+
+        if(last >= 0) {
+            int foundAt = last + TSFIND_WINDOW_BITS - 1 - tsfind_history;
+            symsbeforeexpire = std::max<int>(TSFIND_HOLD_BITS - (count - foundAt), 0);
+            tsfound = (symsbeforeexpire > 0);
+        } else if(symsbeforeexpire > 0) {
+            symsbeforeexpire -= std::min<int>(symsbeforeexpire, count);
+            if(symsbeforeexpire == 0) {
+                tsfound = false;
             }
         }
+
+        //Keep the tail that can still start a sequence
+        int keep = std::min<int>(total, TSFIND_WINDOW_BITS - 1);
+        tetra_pwords_copy(tsfind_words, 0, tsfind_words, total - keep, keep);
+        tsfind_history = keep;
     }
 
     static void sampleRateChangeHandler(float sampleRate, void* ctx) {
         TetraDemodulatorModule* _this = (TetraDemodulatorModule*)ctx;
         _this->audioSampleRate = sampleRate;
+        _this->playout.setOutSamplerate(_this->audioSampleRate);
+        if(_this->lowLatency) { return; }
         _this->resamp.stop();
         _this->resamp.setOutSamplerate(_this->audioSampleRate);
         _this->resamp.start();
@@ -423,55 +2347,141 @@ private:
 
     std::string name;
     bool enabled = true;
+    //Disabled with the chain kept, see enable()
+    bool suspended = false;
+    bool suspendOnDisable = false;
+    bool idleSaving = false;
+    bool listDecoding = false;
+    bool pipelinedMac = false;
+    bool keystreamAhead = false;
+    bool fixedPointDemod = false;
 
     VFOManager::VFO* vfo;
 
     dsp::demod::PI4DQPSK mainDemodulator;
-    dsp::routing::Splitter<dsp::complex_t> constDiagSplitter;
-    dsp::stream<dsp::complex_t> constDiagStream;
-    dsp::buffer::Reshaper<dsp::complex_t> constDiagReshaper;
-    dsp::sink::Handler<dsp::complex_t> constDiagSink;
     ImGui::ConstellationDiagram constDiag;
-
-    dsp::stream<dsp::complex_t> demodStream;
+    //Time between two frames of the diagram
+    int constDiagIntervalMs = CONST_TAP_DEFAULT_INTERVAL_MS;
 
     dsp::DQPSKSymbolExtractor symbolExtractor;
-    dsp::BitUnpacker bitsUnpacker;
 
     dsp::sink::Handler<uint8_t> demodSink;
+    //Single-thread mode, see reconfigureNarrowband()
+    dsp::ChainSink<dsp::complex_t> nbChain;
+    bool singleThreadChain = false;
+    //decoder_mode as the chain thread sees it, only changed between two blocks
+    bool nbChainNetsyms = false;
+
+    bool netSymBound = false;
 
     dsp::osmotetradec osmotetradecoder;
 
     EventHandler<float> srChangeHandler;
     dsp::multirate::RationalResampler<float> resamp;
     dsp::convert::MonoToStereo outconv;
+    dsp::VoicePlayout playout;
+    bool lowLatency = false;
+    char keyfile[1024];
+    char capturePath[1024];
+    bool captureGsmtap = false;
+    dsp::PacketCapture capture;
+    char recordDir[1024];
+    //The recorder thread is joined in stopRecording, before the chains go
+    dsp::CallRecorder recorder;
+    char databasePath[1024];
+    int dbBatchRows = EVENT_DATABASE_DEFAULT_BATCH_ROWS;
+    int dbFlushMs = EVENT_DATABASE_DEFAULT_FLUSH_MS;
+    //Closed in stopDatabase, before the chains go
+    dsp::EventDatabase database;
+    char archivePath[1024];
+    //Written on the decoder thread, see osmotetradec::setBurstArchive
+    std::unique_ptr<tetra_burst_archive> burstArchive;
+    char gsmtapHost[1024];
+    int gsmtapPort = GSMTAP_UDP_PORT;
+    int gsmtapFlushMs = GSMTAP_DEFAULT_FLUSH_MS;
+    dsp::GsmtapSender gsmtap;
+    //Feeds the capture and gsmtap, declared after them so it goes first
+    std::unique_ptr<dsp::BurstEventReader> eventReader;
+    std::mutex eventReaderMtx;
+    char metricsHost[1024];
+    int metricsPort = METRICS_DEFAULT_PORT;
+    char clusterHost[1024];
+    int clusterPort = CLUSTER_DEFAULT_PORT;
+    char clusterSecret[128];
+    //Distributes the pooled wideband chains over decode nodes
+    dsp::ClusterCoordinator cluster;
+    //The chains the coordinator can offload, by work id
+    std::mutex clusterChannelsMtx;
+    std::map<int, WidebandChannel*> clusterChannels;
+    //0 nothing loaded yet, 1 loaded, -1 the last load failed and the previous keys are still in use
+    int keystoreStatus = 0;
+    std::chrono::steady_clock::time_point profTime;
+    uint64_t profLast[TETRA_PROF_NR] = {};
+    double profRate[TETRA_PROF_NR] = {};
+    int jitterMs = VOICE_PLAYOUT_DEFAULT_JITTER_MS;
     SinkManager::Stream stream;
     double audioSampleRate = 48000.0;
 
 
     int decoder_mode = 0;
 
+    float recov_omega;
+    float recov_mu;
+
+    //Where every thread of the chain runs, narrowband or wideband, see dsp::ThreadTuning
+    dsp::ThreadTuning chainTuning;
 
-    //Sequences from osmo-tetra-sq5bpf source
-    /* 9.4.4.3.2 Normal Training Sequence */
-    static const constexpr uint8_t training_seq_n[22] = { 1,1, 0,1, 0,0, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1, 0,1, 0,0 };
-    static const constexpr uint8_t training_seq_p[22] = { 0,1, 1,1, 1,0, 1,0, 0,1, 0,0, 0,0, 1,1, 0,1, 1,1, 1,0 };
-    static const constexpr uint8_t training_seq_q[22] = { 1,0, 1,1, 0,1, 1,1, 0,0, 0,0, 0,1, 1,0, 1,0, 1,1, 0,1 };
-    static const constexpr uint8_t training_seq_N[33] = { 1,1,1, 0,0,1, 1,0,1, 1,1,1, 0,0,0, 1,1,1, 1,0,0, 0,1,1, 1,1,0, 0,0,0, 0,0,0 };
-    static const constexpr uint8_t training_seq_P[33] = { 1,0,1, 0,1,1, 1,1,1, 1,0,1, 0,1,0, 1,0,1, 1,1,0, 0,0,1, 1,0,0, 0,1,0, 0,1,0 };
+    bool wideband = false;
+    int wbChannelCount = WIDEBAND_DEFAULT_CHANNELS;
+    std::vector<int> wbBins;
+    std::unique_ptr<dsp::multirate::PolyphaseChannelizer> channelizer;
+    //Takes the place of channelizer and of the demodulators when set, see startWidebandGpu
+    std::unique_ptr<dsp::gpu::WidebandDemod> wbGpuDemod;
+    bool wbGpu = false;
+    bool wbGpuAvailable = false;
+    std::string wbGpuDevice;
+    std::vector<std::unique_ptr<WidebandChannel>> wbChannels;
+    int wbThreads = 0;
+    int wbFollowers = 0;
+    dsp::TrafficScheduler trafficScheduler;
+    //Follower chains in the order of their index, owned by wbChannels
+    std::vector<WidebandChannel*> wbFollowerChannels;
+    std::unique_ptr<dsp::WorkerPool> wbPool;
+    //Pooled mode: guards wbChannels against the channelizer callback
+    std::mutex wbChannelsMtx;
+    std::vector<WidebandChannel*> wbActive;
+    int wbBlockCount = 0;
+    std::mutex wbAudioMtx;
+    int wbAudioBin = 0;
+    dsp::stream<float> wbAudioStream;
+    //Guards the scanner against the scan worker
+    std::mutex scanMtx;
+    dsp::ChannelScanner scanner;
+    std::thread scanThread;
+    //The wideband chains are those of the scan
+    std::atomic<bool> scanning = false;
+    //The worker is still at it
+    std::atomic<bool> scanRunning = false;
+    double scanReturnHz = 0.0;
+    int scanBand = 3;
+    int scanFirst = 3600;
+    int scanLast = 3799;
+    int scanOffset = 0;
+    int scanDwellMs = CHANNEL_SCANNER_DEFAULT_DWELL_MS;
 
-    /* 9.4.4.3.3 Extended training sequence */
-    static const constexpr uint8_t training_seq_x[30] = { 1,0, 0,1, 1,1, 0,1, 0,0, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1, 0,1, 0,0, 0,0, 1,1 };
-    static const constexpr uint8_t training_seq_X[45] = { 0,1,1,1,0,0,1,1,0,1,0,0,0,0,1,0,0,0,1,1,1,0,1,1,0,1,0,1,0,1,1,1,1,1,0,1,0,0,0,0,0,1,1,1,0 };
 
-    /* 9.4.4.3.4 Synchronization training sequence */
-    static const constexpr uint8_t training_seq_y[38] = { 1,1, 0,0, 0,0, 0,1, 1,0, 0,1, 1,1, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1, 0,0, 0,0, 0,1, 1,0, 0,1, 1,1 };
-    uint8_t tsfind_buffer[45];
+    //Every normal, extended and sync training sequence, D8PSK ones included
+    static const constexpr uint32_t TSFIND_SEQ_MASK = (1 << (TETRA_TRAIN_EXT_D8PSK + 1)) - 1;
+    uint64_t tsfind_words[TETRA_PWORDS(TSFIND_WINDOW_BITS - 1 + TSFIND_CHUNK_BITS) + TETRA_TRAIN_CORR_PAD_WORDS];
+    int tsfind_history = 0;
     bool tsfound = false;
     int symsbeforeexpire = 0;
 
     char hostname[1024];
     int port = 8355;
+    int netFormat = dsp::NETSYMS_FORMAT_RAW;
+    dsp::NetsymsFramer netFramer;
+    std::atomic<uint64_t> netPackets = 0;
 
     std::shared_ptr<net::Socket> conn;
 
@@ -0,0 +1,77 @@
+/* The decoder on the random slot pattern of the burst generator: it has to
+ * get through every burst, and the cell it reports is the generated one */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <phy/tetra_burst_gen.h>
+
+#include "test_decoder.h"
+
+/* 10 multiframes, 720 bursts */
+#define BURSTS		(10 * 18 * 4)
+#define TIMEOUT_S	10
+
+int main(void)
+{
+	struct tetra_gen_cell cell;
+	struct tetra_burst_gen gen;
+	struct test_decoder *td;
+	struct tetra_mac_state *tms;
+	struct tetra_rx_state *trs;
+	uint8_t bits[TETRA_GEN_BURST_BITS];
+	int i, len;
+
+	/* a MAC PDU the upper MAC does not move on from hangs the decoder */
+	alarm(TIMEOUT_S);
+
+	tetra_gen_cell_default(&cell);
+	if (tetra_gen_parse_pattern("r", cell.slot_pattern) < 0)
+		return 1;
+	tetra_burst_gen_init(&gen, &cell, 1);
+
+	td = test_decoder_new();
+	tms = td->tms;
+	trs = td->trs;
+
+	for (i = 0; i < BURSTS; i++) {
+		len = tetra_burst_gen_next(&gen, bits);
+		tetra_burst_sync_in(trs, bits, len);
+	}
+
+	/* no CRC fails on a clean signal, and the random slots are decoded */
+	CHECK(tms->stats.crc_fail, 0);
+	if (tms->stats.crc_ok < BURSTS / 2) {
+		fprintf(stderr, "%lu blocks with a good CRC of %d bursts\n", (unsigned long)tms->stats.crc_ok, BURSTS);
+		failed = 1;
+	}
+
+	/* the cell of SYNC and SYSINFO, the random PDUs left it alone */
+	if (!tms->stats.sync_ok || !tms->stats.sysinfo) {
+		fprintf(stderr, "no SYNC or SYSINFO decoded\n");
+		failed = 1;
+	}
+	CHECK(tms->stats.mcc, cell.mcc);
+	CHECK(tms->stats.mnc, cell.mnc);
+	CHECK(tms->stats.cc, cell.colour_code);
+	CHECK(tms->stats.dl_hz, tetra_dl_carrier_hz(cell.freq_band, cell.main_carrier, cell.freq_offset));
+	CHECK(tms->last_sid.main_carrier, cell.main_carrier);
+	CHECK(tms->last_sid.mle_si.la, cell.la);
+
+	test_decoder_free(td);
+	return failed;
+}
@@ -0,0 +1,96 @@
+/* Burst sync through a fade: a few slots of the generated downlink are noise,
+ * the sync has to find the slot after them where it was predicted and go on
+ * with the slot timing and the TDMA time of the generator */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <phy/tetra_burst_gen.h>
+
+#include "test_decoder.h"
+
+/* locked on the SYNC of frame 18 well before the fade, and a few multiframes after it */
+#define BURSTS		(6 * 18 * 4)
+#define FADE_FIRST	(2 * 18 * 4 + 9)
+#define FADE_SLOTS	5
+#define TIMEOUT_S	10
+
+/* the decoder has handed out the last burst fed, and it is at the time that
+ * burst was generated with */
+static void check_slot(const char *when, const struct tetra_rx_state *trs, const struct tetra_mac_state *tms,
+		       const struct tetra_tdma_time *time, int fed)
+{
+	int was_failed = failed;
+
+	failed = 0;
+	CHECK(trs->state, RX_S_LOCKED);
+	CHECK(trs->bitbuf_start_bitnum, fed * TETRA_GEN_BURST_BITS);
+	CHECK(trs->next_frame_start_bitnum, (fed + 1) * TETRA_GEN_BURST_BITS);
+	CHECK(tms->phy_state.time.tn, time->tn);
+	CHECK(tms->phy_state.time.fn, time->fn);
+	CHECK(tms->phy_state.time.mn, time->mn);
+	if (failed)
+		fprintf(stderr, "%s, after %d bursts\n", when, fed);
+	failed |= was_failed;
+}
+
+int main(void)
+{
+	struct tetra_gen_cell cell;
+	struct tetra_burst_gen gen;
+	struct tetra_tdma_time time;
+	struct test_decoder *td;
+	struct tetra_mac_state *tms;
+	struct tetra_rx_state *trs;
+	uint8_t bits[TETRA_GEN_BURST_BITS];
+	int i, j, len;
+
+	alarm(TIMEOUT_S);
+
+	tetra_gen_cell_default(&cell);
+	tetra_burst_gen_init(&gen, &cell, 1);
+	srand(1);
+
+	td = test_decoder_new();
+	tms = td->tms;
+	trs = td->trs;
+
+	for (i = 0; i < BURSTS; i++) {
+		time = gen.time;
+		len = tetra_burst_gen_next(&gen, bits);
+		if (i >= FADE_FIRST && i < FADE_FIRST + FADE_SLOTS) {
+			for (j = 0; j < len; j++)
+				bits[j] = rand() & 1;
+		}
+		tetra_burst_sync_in(trs, bits, len);
+
+		if (i == FADE_FIRST - 1)
+			check_slot("before the fade", trs, tms, &time, i + 1);
+		/* before the next SYNC could set the time again */
+		if (i == FADE_FIRST + FADE_SLOTS + 4)
+			check_slot("after the fade", trs, tms, &time, i + 1);
+	}
+	check_slot("at the end", trs, tms, &time, BURSTS);
+
+	/* lost once, and found again at the predicted slot, not by a SYNC search */
+	CHECK(tms->stats.sync_lost, 1);
+	CHECK(tms->stats.reacquired, 1);
+	CHECK(tms->stats.crc_fail, 0);
+
+	test_decoder_free(td);
+	return failed;
+}
@@ -0,0 +1,130 @@
+/* Burst sync on a generated downlink whose bursts now and then come a symbol
+ * or two early or late: the sync has to keep the lock, take every burst and
+ * move the slot timing along with the shift. After a fade the bursts come
+ * more symbols late than a slip may be, they are reacquired there */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <phy/tetra_burst_gen.h>
+
+#include "test_decoder.h"
+
+#define BURSTS		(8 * 18 * 4)
+/* locked on the SYNC of frame 18 before the first shift */
+#define SHIFT_FIRST	(2 * 18 * 4)
+#define SHIFT_EVERY	23
+#define TIMEOUT_S	10
+
+/* bits a shifted burst comes late, negative early. Whole symbols up to TETRA_RX_MAX_SLIP_SYMS */
+static const int shifts[] = { 2, -2, 4, -4, 2, 2, -4, 4, -2 };
+#define SHIFTS		(sizeof(shifts) / sizeof(shifts[0]))
+
+/* well after the shifts, the bursts after the fade are FADE_SHIFT bits late */
+#define FADE_FIRST	(6 * 18 * 4 + 5)
+#define FADE_SLOTS	3
+#define FADE_SHIFT	6
+
+int main(void)
+{
+	struct tetra_gen_cell cell;
+	struct tetra_burst_gen gen;
+	struct tetra_tdma_time time, prev_time;
+	struct test_decoder *td;
+	struct tetra_mac_state *tms;
+	struct tetra_rx_state *trs;
+	uint8_t bits[TETRA_GEN_BURST_BITS];
+	uint8_t noise[FADE_SHIFT];
+	unsigned int pos = 0;
+	unsigned int shifted = 0, checked = 0;
+	int i, j, len, shift;
+
+	alarm(TIMEOUT_S);
+
+	tetra_gen_cell_default(&cell);
+	tetra_burst_gen_init(&gen, &cell, 1);
+	srand(1);
+	for (j = 0; j < (int)sizeof(noise); j++)
+		noise[j] = rand() & 1;
+
+	td = test_decoder_new();
+	tms = td->tms;
+	trs = td->trs;
+	trs->max_slip_bits = TETRA_RX_MAX_SLIP_SYMS * 2;
+
+	memset(&prev_time, 0, sizeof(prev_time));
+	for (i = 0; i < BURSTS; i++) {
+		time = gen.time;
+		len = tetra_burst_gen_next(&gen, bits);
+
+		/* normal bursts only, they start with training sequence 3, which
+		 * takes the bits cut off an early one */
+		shift = 0;
+		if (i >= SHIFT_FIRST && (i - SHIFT_FIRST) % SHIFT_EVERY == 0 && time.fn != 18 &&
+		    shifted < SHIFTS)
+			shift = shifts[shifted++];
+
+		if (i >= FADE_FIRST && i < FADE_FIRST + FADE_SLOTS) {
+			for (j = 0; j < len; j++)
+				bits[j] = rand() & 1;
+		}
+		if (i == FADE_FIRST + FADE_SLOTS)
+			shift = FADE_SHIFT;
+
+		if (shift > 0) {
+			tetra_burst_sync_in(trs, noise, shift);
+			pos += shift;
+			tetra_burst_sync_in(trs, bits, len);
+		} else {
+			tetra_burst_sync_in(trs, bits - shift, len + shift);
+			pos += shift;
+		}
+
+		/* The burst before this one went out, from where it was, and the
+		 * slot timing is at the start of this one. A shifted burst is only
+		 * found once it is all in, with the next one */
+		if (i > SHIFT_FIRST && !shift && (i < FADE_FIRST || i > FADE_FIRST + FADE_SLOTS)) {
+			int was_failed = failed;
+
+			failed = 0;
+			CHECK(trs->state, RX_S_LOCKED);
+			CHECK(trs->bitbuf_start_bitnum, pos);
+			CHECK(trs->next_frame_start_bitnum, pos + TETRA_BITS_PER_TS);
+			CHECK(tms->phy_state.time.tn, prev_time.tn);
+			CHECK(tms->phy_state.time.fn, prev_time.fn);
+			CHECK(tms->phy_state.time.mn, prev_time.mn);
+			if (failed)
+				fprintf(stderr, "after burst %d, stream bit %u\n", i, pos);
+			failed |= was_failed;
+			checked++;
+		}
+		prev_time = time;
+		pos += len;
+	}
+
+	/* every shift followed, only the fade lost the sync */
+	CHECK(shifted, SHIFTS);
+	CHECK(tms->stats.slips, SHIFTS);
+	CHECK(tms->stats.sync_lost, 1);
+	CHECK(tms->stats.reacquired, 1);
+	CHECK(tms->stats.crc_fail, 0);
+	if (!checked)
+		failed = 1;
+
+	test_decoder_free(td);
+	return failed;
+}
@@ -0,0 +1,58 @@
+#ifndef TEST_DECODER_H
+#define TEST_DECODER_H
+
+/* What the decoder tests share: the state of one decoder, set up and torn
+ * down as osmotetradec does it, and CHECK, which sets failed on a mismatch */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tetra_common.h"
+#include "tetra_mac_pdu.h"
+#include "crypto/tetra_crypto.h"
+#include <phy/tetra_burst_sync.h>
+
+/* what main returns */
+static int failed;
+
+#define CHECK(got, want) do { \
+	if ((unsigned long)(got) != (unsigned long)(want)) { \
+		fprintf(stderr, "%s is %lu, not %lu\n", #got, (unsigned long)(got), (unsigned long)(want)); \
+		failed = 1; \
+	} \
+} while (0)
+
+/* the MAC and crypto state of a decoder and the burst sync feeding it */
+struct test_decoder {
+	struct tetra_mac_state *tms;
+	struct tetra_rx_state *trs;
+};
+
+static inline struct test_decoder *test_decoder_new(void)
+{
+	struct test_decoder *td = calloc(1, sizeof(*td));
+
+	td->tms = calloc(1, sizeof(*td->tms));
+	tetra_mac_state_init(td->tms);
+	td->tms->tcs = calloc(1, sizeof(*td->tms->tcs));
+	tetra_crypto_state_init(td->tms->tcs);
+	td->tms->t_display_st = calloc(1, sizeof(*td->tms->t_display_st));
+	td->tms->fragslots = calloc(FRAGSLOT_NR_SLOTS, sizeof(struct fragslot));
+	td->trs = calloc(1, sizeof(*td->trs));
+	td->trs->burst_cb_priv = td->tms;
+	return td;
+}
+
+static inline void test_decoder_free(struct test_decoder *td)
+{
+	tetra_mac_state_deinit(td->tms);
+	free(td->tms->fragslots);
+	free(td->trs);
+	free(td->tms->t_display_st);
+	tetra_crypto_state_deinit(td->tms->tcs);
+	free(td->tms->tcs);
+	free(td->tms);
+	free(td);
+}
+
+#endif /* TEST_DECODER_H */
@@ -0,0 +1,167 @@
+/* The published display state read while it is written: the PHY and the cell
+ * writer each publish records whose fields all hold the number of the write,
+ * the reader must never get a record that mixes two writes */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "test_decoder.h"
+
+/* reads until this many writes of each writer went by. The reader yields
+ * after every read, on a single core the writers are then stopped anywhere
+ * in a write by the end of their time slice */
+#define CHANGES		100
+#define TIMEOUT_S	30
+
+static struct tetra_mac_state *tms;
+static int stop;
+
+/* every field v, the bools and chars as far as they hold it */
+static void fill_phy(struct tetra_display_state *st, int v)
+{
+	int i;
+
+	st->curr_multiframe = v;
+	st->curr_frame = v;
+	for (i = 0; i < 4; i++)
+		st->timeslot_content[i] = v;
+	st->dl_usage = v;
+	st->ul_usage = v;
+	st->access1_code = (char)v;
+	st->access2_code = (char)v;
+	st->access1 = v;
+	st->access2 = v;
+	st->mcc = v;
+	st->mnc = v;
+	st->cc = v;
+	st->last_crc_fail = v & 1;
+}
+
+static void fill_cell(struct tetra_display_cell *cell, int v)
+{
+	cell->curr_hyperframe = v;
+	cell->dl_freq = v;
+	cell->ul_freq = v;
+	cell->advanced_link = v & 1;
+	cell->air_encryption = v & 1;
+	cell->sndcp_data = v & 1;
+	cell->circuit_data = v & 1;
+	cell->voice_service = v & 1;
+	cell->normal_mode = v & 1;
+	cell->migration_supported = v & 1;
+	cell->never_minimum_mode = v & 1;
+	cell->priority_cell = v & 1;
+	cell->dereg_mandatory = v & 1;
+	cell->reg_mandatory = v & 1;
+}
+
+/* all fields of one write, the one the first field tells */
+static int phy_whole(const struct tetra_display_state *st)
+{
+	struct tetra_display_state want;
+	int i;
+
+	fill_phy(&want, st->curr_multiframe);
+	for (i = 0; i < 4; i++) {
+		if (st->timeslot_content[i] != want.timeslot_content[i])
+			return 0;
+	}
+	return st->curr_frame == want.curr_frame && st->dl_usage == want.dl_usage &&
+	       st->ul_usage == want.ul_usage && st->access1_code == want.access1_code &&
+	       st->access2_code == want.access2_code && st->access1 == want.access1 &&
+	       st->access2 == want.access2 && st->mcc == want.mcc && st->mnc == want.mnc &&
+	       st->cc == want.cc && st->last_crc_fail == want.last_crc_fail;
+}
+
+static int cell_whole(const struct tetra_display_cell *cell)
+{
+	struct tetra_display_cell want;
+
+	fill_cell(&want, cell->curr_hyperframe);
+	return cell->dl_freq == want.dl_freq && cell->ul_freq == want.ul_freq &&
+	       cell->advanced_link == want.advanced_link && cell->air_encryption == want.air_encryption &&
+	       cell->sndcp_data == want.sndcp_data && cell->circuit_data == want.circuit_data &&
+	       cell->voice_service == want.voice_service && cell->normal_mode == want.normal_mode &&
+	       cell->migration_supported == want.migration_supported &&
+	       cell->never_minimum_mode == want.never_minimum_mode &&
+	       cell->priority_cell == want.priority_cell && cell->dereg_mandatory == want.dereg_mandatory &&
+	       cell->reg_mandatory == want.reg_mandatory;
+}
+
+/* the PHY after every burst */
+static void *phy_writer(void *arg)
+{
+	int v;
+
+	for (v = 1; !__atomic_load_n(&stop, __ATOMIC_RELAXED); v++) {
+		fill_phy(tms->t_display_st, v);
+		tetra_display_publish(tms);
+	}
+	return arg;
+}
+
+/* the upper MAC after every SYSINFO */
+static void *cell_writer(void *arg)
+{
+	int v;
+
+	for (v = 1; !__atomic_load_n(&stop, __ATOMIC_RELAXED); v++) {
+		fill_cell(&tms->t_display_st->cell, v);
+		tetra_display_publish_cell(tms);
+	}
+	return arg;
+}
+
+int main(void)
+{
+	struct test_decoder *td;
+	struct tetra_display_state out;
+	pthread_t phy, cell;
+	unsigned int torn_phy = 0, torn_cell = 0, changes_phy = 0, changes_cell = 0;
+	int last_phy = 0, last_cell = 0;
+
+	alarm(TIMEOUT_S);
+
+	td = test_decoder_new();
+	tms = td->tms;
+
+	pthread_create(&phy, NULL, phy_writer, NULL);
+	pthread_create(&cell, NULL, cell_writer, NULL);
+	/* the GUI thread, while both write */
+	while (changes_phy < CHANGES || changes_cell < CHANGES) {
+		tetra_display_read(tms, &out);
+		if (!phy_whole(&out))
+			torn_phy++;
+		if (!cell_whole(&out.cell))
+			torn_cell++;
+		changes_phy += out.curr_multiframe != last_phy;
+		changes_cell += out.cell.curr_hyperframe != last_cell;
+		last_phy = out.curr_multiframe;
+		last_cell = out.cell.curr_hyperframe;
+		sched_yield();
+	}
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	pthread_join(phy, NULL);
+	pthread_join(cell, NULL);
+
+	CHECK(torn_phy, 0);
+	CHECK(torn_cell, 0);
+
+	test_decoder_free(td);
+	return failed;
+}
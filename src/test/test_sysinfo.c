@@ -0,0 +1,89 @@
+/* SYSINFO decoding against a hand encoded PDU, EN 300 392-2 21.4.4.1 */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tetra_mac_pdu.h"
+#include "tetra_pbits.h"
+
+#define SYSINFO_BITS	124
+
+/* Broadcast / SYSINFO, main carrier 1234, band 4, offset 1, duplex 2, not
+ * reversed, 1 common SCCH, MS power 5, RXLEV 7, access parameter 9, DL
+ * timeout 3, hyperframe 0x1abc, access code A 0x5a5a5, then D-MLE-SYSINFO
+ * with LA 0x2345, subscriber class 0xbeef, BS service details 0x9a1 */
+static const uint8_t sysinfo_pdu[16] = {
+	0x84, 0xd2, 0x45, 0x1a, 0xf2, 0x61, 0xab, 0xc9,
+	0x69, 0x69, 0x63, 0x45, 0xbe, 0xef, 0x9a, 0x10,
+};
+
+static int failed;
+
+#define CHECK(what, got, want) do { \
+	if ((unsigned long)(got) != (unsigned long)(want)) { \
+		fprintf(stderr, "%s: %s is 0x%lx, not 0x%lx\n", what, #got, (unsigned long)(got), (unsigned long)(want)); \
+		failed = 1; \
+	} \
+} while (0)
+
+static void check(const char *what, const struct tetra_si_decoded *sid)
+{
+	CHECK(what, sid->main_carrier, 1234);
+	CHECK(what, sid->freq_band, 4);
+	CHECK(what, sid->freq_offset, 1);
+	CHECK(what, sid->duplex_spacing, 2);
+	CHECK(what, sid->reverse_operation, 0);
+	CHECK(what, sid->num_of_csch, 1);
+	CHECK(what, sid->ms_txpwr_max_cell, 5);
+	CHECK(what, sid->rxlev_access_min, 7);
+	CHECK(what, sid->access_parameter, 9);
+	CHECK(what, sid->radio_dl_timeout, 3);
+	CHECK(what, sid->cck_valid_no_hf, 0);
+	CHECK(what, sid->hyperframe_number, 0x1abc);
+	CHECK(what, sid->option_field, TETRA_MAC_OPT_FIELD_ACCESS_CODE);
+	CHECK(what, sid->access_code, 0x5a5a5);
+	CHECK(what, sid->mle_si.la, 0x2345);
+	CHECK(what, sid->mle_si.subscr_class, 0xbeef);
+	CHECK(what, sid->mle_si.bs_service_details, 0x9a1);
+}
+
+int main(void)
+{
+	uint8_t ubits[SYSINFO_BITS];
+	uint64_t words[TETRA_PWORDS(SYSINFO_BITS) + 1];
+	struct tetra_bitreader br;
+	struct tetra_si_decoded sid;
+	int i;
+
+	for (i = 0; i < SYSINFO_BITS; i++)
+		ubits[i] = (sysinfo_pdu[i / 8] >> (7 - i % 8)) & 1;
+
+	/* from the unpacked bits, as decrypted PDUs are read */
+	memset(&sid, 0, sizeof(sid));
+	tetra_bitreader_init(&br, ubits, SYSINFO_BITS);
+	macpdu_decode_sysinfo(&sid, &br);
+	check("unpacked", &sid);
+	CHECK("unpacked", tetra_bitreader_tell(&br), SYSINFO_BITS);
+
+	/* and from the packed copy of the lower MAC */
+	memset(words, 0, sizeof(words));
+	tetra_ubit2pwords(ubits, words, 0, SYSINFO_BITS);
+	memset(&sid, 0, sizeof(sid));
+	tetra_bitreader_init_packed(&br, words, 0, SYSINFO_BITS);
+	macpdu_decode_sysinfo(&sid, &br);
+	check("packed", &sid);
+
+	return failed;
+}
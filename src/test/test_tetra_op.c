@@ -0,0 +1,192 @@
+/* The inlined ETSI basic operators of tetra_op_inline.h against the reference
+ * ones of the codec, on seeded random operands and on the limits: the result
+ * and Overflow have to be the same. The reference tetra_op.c is included here
+ * with every inlined operator and Overflow renamed to ref_* */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define Overflow	ref_Overflow
+#define sature		ref_sature
+#define add		ref_add
+#define sub		ref_sub
+#define abs_s		ref_abs_s
+#define negate		ref_negate
+#define extract_h	ref_extract_h
+#define extract_l	ref_extract_l
+#define L_deposit_h	ref_L_deposit_h
+#define L_deposit_l	ref_L_deposit_l
+#define shl		ref_shl
+#define shr		ref_shr
+#define mult		ref_mult
+#define mult_r		ref_mult_r
+#define L_mult		ref_L_mult
+#define L_add		ref_L_add
+#define L_sub		ref_L_sub
+#define L_mac		ref_L_mac
+#define L_msu		ref_L_msu
+#define L_negate	ref_L_negate
+#define L_abs		ref_L_abs
+#define L_shl		ref_L_shl
+#define L_shr		ref_L_shr
+#define L_shr_r		ref_L_shr_r
+#define etsi_round	ref_etsi_round
+#define mac_r		ref_mac_r
+#define msu_r		ref_msu_r
+#define norm_s		ref_norm_s
+#define norm_l		ref_norm_l
+#include "c-code/tetra_op.c"
+#undef Overflow
+#undef sature
+#undef add
+#undef sub
+#undef abs_s
+#undef negate
+#undef extract_h
+#undef extract_l
+#undef L_deposit_h
+#undef L_deposit_l
+#undef shl
+#undef shr
+#undef mult
+#undef mult_r
+#undef L_mult
+#undef L_add
+#undef L_sub
+#undef L_mac
+#undef L_msu
+#undef L_negate
+#undef L_abs
+#undef L_shl
+#undef L_shr
+#undef L_shr_r
+#undef etsi_round
+#undef mac_r
+#undef msu_r
+#undef norm_s
+#undef norm_l
+
+#include "tetra_op_inline.h"
+
+#define ROUNDS		200000
+#define TIMEOUT_S	30
+/* shift counts, both ways. The reference recurses on -var2 and shifts 1 by
+ * var2 in shl, which only holds for counts well inside the 16 bit range */
+#define SHIFT_16	18
+#define SHIFT_32	36
+
+static int failed;
+
+/* the operands of the current round, printed with a mismatch */
+static int16_t a, b, s16;
+static int32_t la, lb, s32;
+
+static const int16_t limits_16[] = {
+	0, 1, -1, 2, -2, 0x4000, -0x4000, 0x7ffe, 0x7fff, -0x7fff, (int16_t)0x8000,
+};
+static const int32_t limits_32[] = {
+	0, 1, -1, 0x8000, -0x8000, 0x7fff, 0x40000000, -0x40000000,
+	0x3fffffff, 0x7ffffffe, 0x7fffffff, -0x7fffffff, (int32_t)0x80000000,
+};
+#define NUM_LIMITS_16	(sizeof(limits_16) / sizeof(limits_16[0]))
+#define NUM_LIMITS_32	(sizeof(limits_32) / sizeof(limits_32[0]))
+
+/* now and then one of the limits, otherwise any value */
+static int16_t operand_16(void)
+{
+	if (!(rand() % 4))
+		return limits_16[rand() % NUM_LIMITS_16];
+	return (int16_t)rand();
+}
+
+static int32_t operand_32(void)
+{
+	if (!(rand() % 4))
+		return limits_32[rand() % NUM_LIMITS_32];
+	/* mostly small, the way the filters keep them */
+	if (rand() % 2)
+		return (int32_t)(int16_t)rand() * (rand() % 0x10000);
+	return (int32_t)(((uint32_t)rand() << 16) ^ (uint32_t)rand());
+}
+
+/* Overflow goes in the same to both, set or not, to see which operators
+ * leave it alone and which clear it */
+#define COMPARE(op, ...) do { \
+	int ovf_in = rand() & 1; \
+	long ref, got; \
+	ref_Overflow = ovf_in; \
+	ref = ref_##op(__VA_ARGS__); \
+	Overflow = ovf_in; \
+	got = op(__VA_ARGS__); \
+	if (got != ref || Overflow != ref_Overflow) { \
+		if (!failed) \
+			fprintf(stderr, "%s(%s) is %ld overflow %d, the reference %ld overflow %d " \
+				"(a %d b %d s16 %d la %ld lb %ld s32 %ld)\n", #op, #__VA_ARGS__, \
+				got, Overflow, ref, ref_Overflow, a, b, s16, (long)la, (long)lb, (long)s32); \
+		failed++; \
+	} \
+} while (0)
+
+int main(void)
+{
+	int i;
+
+	alarm(TIMEOUT_S);
+
+	srand(1);
+	for (i = 0; i < ROUNDS; i++) {
+		a = operand_16();
+		b = operand_16();
+		la = operand_32();
+		lb = operand_32();
+		s16 = rand() % (2 * SHIFT_16 + 1) - SHIFT_16;
+		s32 = rand() % (2 * SHIFT_32 + 1) - SHIFT_32;
+
+		COMPARE(sature, la);
+		COMPARE(add, a, b);
+		COMPARE(sub, a, b);
+		COMPARE(abs_s, a);
+		COMPARE(negate, a);
+		COMPARE(extract_h, la);
+		COMPARE(extract_l, la);
+		COMPARE(L_deposit_h, a);
+		COMPARE(L_deposit_l, a);
+		COMPARE(shl, a, s16);
+		COMPARE(shr, a, s16);
+		COMPARE(mult, a, b);
+		COMPARE(mult_r, a, b);
+		COMPARE(L_mult, a, b);
+		COMPARE(L_add, la, lb);
+		COMPARE(L_sub, la, lb);
+		COMPARE(L_mac, la, a, b);
+		COMPARE(L_msu, la, a, b);
+		COMPARE(L_negate, la);
+		COMPARE(L_abs, la);
+		COMPARE(L_shl, la, s32);
+		COMPARE(L_shr, la, s32);
+		COMPARE(L_shr_r, la, s32);
+		COMPARE(etsi_round, la);
+		COMPARE(mac_r, la, a, b);
+		COMPARE(msu_r, la, a, b);
+		COMPARE(norm_s, a);
+		COMPARE(norm_l, la);
+	}
+
+	if (failed)
+		fprintf(stderr, "%d mismatches\n", failed);
+	return !!failed;
+}
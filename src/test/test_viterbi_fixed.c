@@ -0,0 +1,92 @@
+/* The Viterbi decoder fixed to the TETRA block lengths against the generic
+ * one on the same seeded soft blocks, noisy code words and plain random
+ * symbols, for every length it takes: the bits have to be the same */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lower_mac/tetra_conv_enc.h>
+#include <lower_mac/viterbi.h>
+#include <lower_mac/viterbi_cch.h>
+
+#include "test_decoder.h"
+
+#define BLOCKS		2000
+#define MAX_LEN		288
+/* amplitude of a code bit and of the noise on it in the noisy blocks */
+#define AMPLITUDE	64
+#define NOISE		96
+#define TIMEOUT_S	30
+
+static const int lengths[] = { 80, 112, 144, 288 };
+
+static int8_t clip(int v)
+{
+	return v > 127 ? 127 : v < -127 ? -127 : v;
+}
+
+int main(void)
+{
+	uint8_t bits[MAX_LEN], coded[4 * MAX_LEN];
+	uint8_t out_fixed[MAX_LEN], out_ref[MAX_LEN];
+	int8_t soft[4 * MAX_LEN + TETRA_VITERBI_TAIL];
+	struct conv_enc_state ces;
+	unsigned int l;
+	int b, i, n, mismatches;
+
+	alarm(TIMEOUT_S);
+
+	srand(1);
+	for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+		n = lengths[l];
+		mismatches = 0;
+		for (b = 0; b < BLOCKS; b++) {
+			if (b % 2) {
+				for (i = 0; i < 4 * n; i++)
+					soft[i] = clip(rand() % 255 - 127);
+			} else {
+				/* the last 4 bits are the tail, as in every TETRA block */
+				for (i = 0; i < n; i++)
+					bits[i] = i < n - 4 ? rand() & 1 : 0;
+				conv_enc_init(&ces);
+				conv_enc_input(&ces, bits, n, coded);
+				for (i = 0; i < 4 * n; i++)
+					soft[i] = clip((coded[i] ? -AMPLITUDE : AMPLITUDE) + rand() % (2 * NOISE + 1) - NOISE);
+			}
+			/* erased, as viterbi_dec_soft() gets them */
+			memset(soft + 4 * n, 0, TETRA_VITERBI_TAIL);
+
+			memset(out_fixed, 0xff, sizeof(out_fixed));
+			if (conv_cch_decode_fixed(soft, out_fixed, n) < 0) {
+				fprintf(stderr, "no fixed decoder for %d bits\n", n);
+				return 1;
+			}
+			conv_cch_decode(soft, out_ref, n);
+			if (memcmp(out_fixed, out_ref, n))
+				mismatches++;
+		}
+		if (mismatches)
+			fprintf(stderr, "%d bits: %d of %d blocks decoded differently\n", n, mismatches, BLOCKS);
+		CHECK(mismatches, 0);
+	}
+
+	/* other lengths go to the generic decoder */
+	CHECK(conv_cch_decode_fixed(soft, out_fixed, 100), -1);
+
+	return failed;
+}
@@ -0,0 +1,172 @@
+/* Voice keystream of an encrypted call while the keystore is reloaded, with
+ * the lower and the upper MAC on threads of their own like the MAC pipe runs
+ * them */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tetra_prim.h"
+#include "tetra_upper_mac.h"
+
+#include "test_decoder.h"
+
+#define MCC		901
+#define MNC		9999
+#define CCK_ID		3
+#define UM		1
+#define RELOADS		201
+
+static const uint8_t key_a[10] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0x01, 0x23 };
+static const uint8_t key_b[10] = { 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10, 0xfe, 0xdc };
+
+static struct test_decoder *td;
+static struct tetra_mac_state *tms;
+static struct tetra_tdma_time slot_time = { .hn = 0, .sn = 1, .tn = 2, .fn = 5, .mn = 11 };
+static uint8_t ks_a[TETRA_KS_VOICE_BYTES], ks_b[TETRA_KS_VOICE_BYTES];
+static int done;
+
+static void write_keystore(char *path, const uint8_t *key)
+{
+	FILE *fp;
+	int fd, i;
+
+	fd = mkstemp(path);
+	if (fd < 0 || !(fp = fdopen(fd, "w"))) {
+		perror("keystore");
+		exit(1);
+	}
+	fprintf(fp, "network mcc %d mnc %d ksg_type %d security_class 3\n", MCC, MNC, KSG_TEA1);
+	fprintf(fp, "key mcc %d mnc %d addr 0 key_type %d key_num %d key ", MCC, MNC, KEYTYPE_CCK_SCK, CCK_ID);
+	for (i = 0; i < 10; i++)
+		fprintf(fp, "%02X", key[i]);
+	fprintf(fp, "\n");
+	fclose(fp);
+}
+
+static void cell_init(struct tetra_crypto_state *tcs)
+{
+	tetra_crypto_state_init(tcs);
+	tcs->cn = 1234;
+	tcs->la = 0x2345;
+	tcs->hn = 0x1abc;
+	tcs->cc = 17;
+	tcs->cck_id = CCK_ID;
+}
+
+/* The keystream each of the keys makes, on a state of its own */
+static void expect(const uint8_t *key, uint8_t *ks)
+{
+	struct tetra_crypto_state tcs;
+	struct tetra_netinfo net = { .mcc = MCC, .mnc = MNC, .ksg_type = KSG_TEA1 };
+	struct tetra_key k = { .mcc = MCC, .mnc = MNC, .key_type = KEYTYPE_CCK_SCK, .network_info = &net };
+	struct tetra_voice_key vk;
+
+	memcpy(k.key, key, sizeof(key_a));
+	cell_init(&tcs);
+	tetra_crypto_voice_key(&tcs, true, &k, &vk);
+	if (!tetra_crypto_voice_keystream(&tcs, &vk, &slot_time, ks)) {
+		fprintf(stderr, "no keystream for the expected key\n");
+		exit(1);
+	}
+}
+
+/* The lower MAC: the keystream of every voice slot is one of the two keys */
+static void *lower_mac(void *arg)
+{
+	struct tetra_voice_key vk;
+	uint8_t ks[TETRA_KS_VOICE_BYTES];
+	long slots = 0, bad = 0;
+
+	while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+		tetra_voice_key_read(tms, UM, &vk);
+		if (!vk.encrypted || !vk.have_key ||
+				!tetra_crypto_voice_keystream(tms->tcs, &vk, &slot_time, ks) ||
+				(memcmp(ks, ks_a, sizeof(ks)) && memcmp(ks, ks_b, sizeof(ks))))
+			bad++;
+		slots++;
+	}
+	if (bad)
+		fprintf(stderr, "%ld of %ld voice slots without the keystream of either key\n", bad, slots);
+	return (void *)bad;
+}
+
+int main(void)
+{
+	char path_a[] = "/tmp/tetra_keys_aXXXXXX", path_b[] = "/tmp/tetra_keys_bXXXXXX";
+	struct osmo_prim_hdr none = { .sap = TETRA_SAP_TMA };
+	struct tetra_voice_key vk;
+	uint8_t ks[TETRA_KS_VOICE_BYTES];
+	pthread_t lower;
+	void *bad;
+	int i;
+
+	write_keystore(path_a, key_a);
+	write_keystore(path_b, key_b);
+	expect(key_a, ks_a);
+	expect(key_b, ks_b);
+	if (!memcmp(ks_a, ks_b, sizeof(ks_a))) {
+		fprintf(stderr, "both keys make the same keystream\n");
+		return 1;
+	}
+
+	td = test_decoder_new();
+	tms = td->tms;
+	cell_init(tms->tcs);
+
+	/* a call on UM with the CCK, as a MAC-RESOURCE would have set it up */
+	if (load_keystore(path_a) < 0) {
+		failed = 1;
+		goto out;
+	}
+	upper_mac_prim_recv(&none, tms);
+	update_current_network(tms->tcs, MCC, MNC);
+	if (!tms->tcs->cck) {
+		fprintf(stderr, "CCK not found\n");
+		failed = 1;
+		goto out;
+	}
+	tms->um_crypt[UM].encrypted = true;
+	tms->um_crypt[UM].key = tms->tcs->cck;
+	tms->voice_key_dirty |= 1ULL << UM;
+	upper_mac_prim_recv(&none, tms);
+
+	/* the upper MAC: reload between PDUs, the old keystore goes away each time */
+	pthread_create(&lower, NULL, lower_mac, NULL);
+	for (i = 0; i < RELOADS; i++) {
+		if (load_keystore(i % 2 ? path_a : path_b) < 0)
+			failed = 1;
+		upper_mac_prim_recv(&none, tms);
+	}
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	pthread_join(lower, &bad);
+	if (bad)
+		failed = 1;
+
+	/* the last reload was key B */
+	tetra_voice_key_read(tms, UM, &vk);
+	if (!tetra_crypto_voice_keystream(tms->tcs, &vk, &slot_time, ks) || memcmp(ks, ks_b, sizeof(ks))) {
+		fprintf(stderr, "voice keystream not of the last keystore\n");
+		failed = 1;
+	}
+
+out:
+	test_decoder_free(td);
+	unlink(path_a);
+	unlink(path_b);
+	return failed;
+}